@@ -21,13 +21,71 @@ cbuffer cbPerFrame
 	float sceneTime;
 	float timeStep;
 	float4x4 viewProj; 
+	
+	// Level of detail from the particle budget: the fraction of the burst
+	// rate to emit at, and the scale of the size new particles are given
+	float emitScale = 1.0f;
+	float sizeScale = 1.0f;
+	
+	// Particles to fill the box around the emitter with, then recycle
+	// within it as the camera moves, or zero to emit and kill as usual
+	float wrapCount = 0.0f;
+
+	// The season's wind: the fraction of the way to its velocity a
+	// particle is taken across this step, or zero for none, and the map
+	// from world space into the wind texture
+	float windWeight = 0.0f;
+	float3 windToTex;
+	float3 windOffset;
+
+	// What becomes of a particle that reaches the ground: zero to fall
+	// through it, one to be killed, two or more to rest on it for
+	// restTime. The ground is the terrain's heights in a texture, with
+	// maps from world x and z into its coordinates and from its samples
+	// to world heights. The heights are filtered linearly where the
+	// hardware can filter their format, else the nearest is taken
+	float impact = 0.0f;
+	float3 groundToU;
+	float3 groundToV;
+	float2 groundToWorld;
+	float groundLinear = 1.0f;
 };
 
-cbuffer cbFixed
+// The particle effect's rules, set from its description
+cbuffer cbEffect
 {
-	// Net constant acceleration used to accerlate the particles.
+	// Net constant acceleration used to accelerate the particles.
 	float3 accelW = {0.025f, -0.4f, -0.05f};
 	
+	// Bursts of emitCount particles, at most MAX_BURST, every emitInterval,
+	// spread over a square twice spread across, emitHeight above the emitter
+	float emitInterval = 0.01f;
+	float emitCount = 5.0f;
+	float spread = 50.0f;
+	float emitHeight = 25.0f;
+	
+	// Particles start at initialVel plus speed in a random direction and
+	// live for lifetime. They are drawn size across, growing to sizeGrowth
+	// times that by the end of their life, each with one of the
+	// textureCount slices of the texture array from textureFirst
+	float3 initialVel = {0.0f, 0.0f, 0.0f};
+	float speed = 1.5f;
+	float lifetime = 15.0f;
+	float size = 0.05f;
+	float sizeGrowth = 1.0f;
+	float textureFirst = 0.0f;
+	float textureCount = 1.0f;
+	
+	// Time a particle that has landed rests on the ground for
+	float restTime = 3.0f;
+	
+	// The box particles are wrapped in is as wide as the spread they are
+	// emitted over, and as deep as they fall in their lifetime
+	float wrapDepth = 67.5f;
+};
+
+cbuffer cbFixed
+{
 	// Texture coordinates used to stretch texture over quad 
 	// when we expand point particle into a quad.
 	float2 quadTexC[4] = 
@@ -52,6 +110,34 @@ SamplerState TriLinearSample
 	AddressV = WRAP;
 };
 
+// Wind velocities over the terrain, on a coarse grid
+Texture3D windTex;
+
+SamplerState WindSample
+{
+	Filter = MIN_MAG_MIP_LINEAR;
+	AddressU = CLAMP;
+	AddressV = CLAMP;
+	AddressW = CLAMP;
+};
+
+// Heights of the terrain the particles land on
+Texture2D groundTex;
+
+SamplerState GroundSample
+{
+	Filter = MIN_MAG_MIP_LINEAR;
+	AddressU = CLAMP;
+	AddressV = CLAMP;
+};
+
+SamplerState GroundPoint
+{
+	Filter = MIN_MAG_MIP_POINT;
+	AddressU = CLAMP;
+	AddressV = CLAMP;
+};
+
 DepthStencilState DisableDepth
 {
     DepthEnable = FALSE;
@@ -80,16 +166,23 @@ BlendState AdditiveBlending
 //***********************************************
 // HELPER FUNCTIONS                             *
 //***********************************************
+// Texels of the random texture, each four floats uniform in [-1,1]
+#define RANDOM_TEXELS 1024
+
 float3 RandUnitVec3(float offset)
 {
-	// Use game time plus offset to sample random texture.
+	// Use game time plus offset to pick a texel of the random texture. The
+	// texel is loaded whole, as a blend of two is no longer uniform
 	float u = (sceneTime + offset);
+	float2 v = randomTex.Load(int2(frac(u)*RANDOM_TEXELS, 0)).xy;
 	
-	// coordinates in [-1,1]
-	float3 v = randomTex.SampleLevel(TriLinearSample, u, 0);
-	
-	// project onto unit sphere
-	return normalize(v);
+	// A height uniform in [-1,1] at an angle uniform about the axis is
+	// uniform over the unit sphere, where a normalised cube is bunched
+	// towards its corners
+	float r = sqrt(saturate(1.0f - v.x*v.x));
+	float s, c;
+	sincos(3.14159265f*v.y, s, c);
+	return float3(r*c, r*s, v.x);
 }
 
 float3 RandVec3(float offset)
@@ -102,13 +195,27 @@ float3 RandVec3(float offset)
 	
 	return v;
 }
+
+// A random slice of the particle's textures
+uint RandSlice(float offset)
+{
+	float u = 0.5f*RandVec3(offset).x + 0.5f;
+	return (uint)(textureFirst + min(floor(u*textureCount), textureCount - 1.0f));
+}
  
 //***********************************************
 // STREAM-OUT TECH                              *
 //***********************************************
 
+// Flares are typed PT_FLARE plus the slice of the texture array they are
+// drawn with, and PT_RESTING more once they have landed
 #define PT_EMITTER 0
 #define PT_FLARE 1
+#define PT_RESTING 256
+
+// Most particles emitted in a burst, with the emitter in the stream-out
+// GS's vertex count
+#define MAX_BURST 5
  
 struct Particle
 {
@@ -124,6 +231,47 @@ Particle StreamOutVS(Particle vIn)
 	return vIn;
 }
 
+// Takes a particle's horizontal velocity part of the way to the wind's.
+// The particle's path is a function of its age, so its start is moved to
+// carry the path on from where the particle is now
+void Blow(inout Particle p)
+{
+	float t = p.age;
+	float3 posW = 0.5f*t*t*accelW + t*p.initialVelW + p.initialPosW;
+	float3 velW = t*accelW + p.initialVelW;
+	float3 windW = windTex.SampleLevel(WindSample, posW*windToTex + windOffset, 0).xyz;
+	
+	float3 dv = float3(windW.x - velW.x, 0.0f, windW.z - velW.z) * windWeight;
+	p.initialVelW += dv;
+	p.initialPosW -= dv*t;
+}
+
+// True if a particle at posW has reached the ground, which is there at
+// groundY. Without a ground to land on, particles fall through
+bool Landed(float3 posW, out float groundY)
+{
+	float3 xz1 = float3(posW.xz, 1.0f);
+	float2 texC = float2(dot(groundToU, xz1), dot(groundToV, xz1));
+	float height;
+	[branch] if( groundLinear > 0.0f )
+		height = groundTex.SampleLevel(GroundSample, texC, 0).r;
+	else
+		height = groundTex.SampleLevel(GroundPoint, texC, 0).r;
+	groundY = height*groundToWorld.x + groundToWorld.y;
+	return impact > 0.0f && posW.y <= groundY;
+}
+
+// A copy of a particle that has landed, resting on the ground where it
+// landed. Its age then counts the time it has rested
+Particle Rest(Particle p, float3 posW, float groundY)
+{
+	p.initialPosW = float3(posW.x, groundY, posW.z);
+	p.initialVelW = float3(0.0f, 0.0f, 0.0f);
+	p.age         = 0.0f;
+	p.type        = p.type + PT_RESTING;
+	return p;
+}
+
 // The stream-out GS is just responsible for emitting 
 // new particles and destroying old particles.  The logic
 // programmed here will generally vary from particle system
@@ -137,37 +285,91 @@ void StreamOutGS(point Particle gIn[1],
 	
 	if( gIn[0].type == PT_EMITTER )
 	{	
-		// Time to emit a new particle?
-		if( gIn[0].age > 0.01f )
+		// Time to emit a new particle? When wrapping, the emitter counts
+		// the particles it has emitted in its size, and stops once the box
+		// is full
+		bool full = wrapCount > 0.0f && gIn[0].sizeW.x >= wrapCount;
+		if( gIn[0].age > emitInterval / emitScale && !full )
 		{
-			for(int i = 0; i < 5; ++i)
+			for(int i = 0; i < MAX_BURST; ++i)
 			{
+				if( (float)i >= emitCount )
+					break;
+				
 				// Spread snowflakes out above the camera
-				float3 posRandom = 50.0f*RandVec3((float)i/5.0f);
-				float3 velRandom = RandUnitVec3(0.0f);
-				posRandom.y = 25.0f;
+				float3 posRandom = spread*RandVec3((float)i/emitCount);
+				float3 velRandom = RandUnitVec3(((float)i + 0.5f)/emitCount);
+				posRandom.y = emitHeight;
 			
 				Particle p;
 				p.initialPosW = emitPosW.xyz + posRandom;
-				p.initialVelW = velRandom * 1.5f;
-				p.sizeW       = float2(0.05f, 0.05f);
+				p.initialVelW = initialVel + velRandom*speed;
+				p.sizeW       = float2(size, size) * sizeScale;
 				p.age         = 0.0f;
-				p.type        = PT_FLARE;
+				p.type        = PT_FLARE + RandSlice((float)i/emitCount + 0.25f);
 			
 				ptStream.Append(p);
 			}
 			
 			// Reset the time to emit
 			gIn[0].age = 0.0f;
+			gIn[0].sizeW.x += emitCount;
 		}
 		
 		// Always keep emitters
 		ptStream.Append(gIn[0]);
 	}
+	else if( gIn[0].type >= PT_RESTING )
+	{
+		// Keep a particle that has landed until its rest is over
+		if( gIn[0].age <= restTime )
+			ptStream.Append(gIn[0]);
+	}
+	else if( wrapCount > 0.0f )
+	{
+		Blow(gIn[0]);
+		
+		// Move the particle by whole box widths back over the emitter, and
+		// start it again at the top once it is too old, below the box, left
+		// as far again above it as the emitter drops, or on the ground,
+		// where a resting copy is left
+		float wrapSize = 2.0f*spread;
+		float t = gIn[0].age;
+		float3 posW = 0.5f*t*t*accelW + t*gIn[0].initialVelW + gIn[0].initialPosW;
+		float2 shift = wrapSize*round((posW.xz - emitPosW.xz)/wrapSize);
+		gIn[0].initialPosW.xz -= shift;
+		posW.xz -= shift;
+		
+		float groundY;
+		bool landed = Landed(posW, groundY);
+		if( landed && impact >= 2.0f )
+			ptStream.Append(Rest(gIn[0], posW, groundY));
+		
+		if( landed || t > lifetime || posW.y < emitPosW.y + emitHeight - wrapDepth ||
+		    posW.y > emitPosW.y + emitHeight + wrapDepth )
+		{
+			gIn[0].initialPosW = float3(posW.x, emitPosW.y + emitHeight, posW.z);
+			gIn[0].initialVelW = initialVel + RandUnitVec3((posW.x + posW.z)/wrapSize)*speed;
+			gIn[0].age         = 0.0f;
+		}
+		
+		ptStream.Append(gIn[0]);
+	}
 	else
 	{
-		// Specify conditions to keep particle; this may vary from system to system.
-		if( gIn[0].age <= 15.0f )
+		Blow(gIn[0]);
+		
+		// Kill the particle once it is too old, or on reaching the ground,
+		// where a resting copy is left
+		float t = gIn[0].age;
+		float3 posW = 0.5f*t*t*accelW + t*gIn[0].initialVelW + gIn[0].initialPosW;
+		float groundY;
+		if( Landed(posW, groundY) )
+		{
+			if( impact >= 2.0f )
+				ptStream.Append(Rest(gIn[0], posW, groundY));
+		}
+		else if( t <= lifetime )
 			ptStream.Append(gIn[0]);
 	}		
 }
@@ -200,19 +402,23 @@ struct VS_OUT
 	float3 posW  : POSITION;
 	float2 sizeW : SIZE;
 	uint   type  : TYPE;
+	uint   slice : SLICE;
 };
 
 VS_OUT DrawVS(Particle vIn)
 {
 	VS_OUT vOut;
 	
-	float t = vIn.age;
+	// Particles that have landed stay where they came to rest
+	float t = vIn.type >= PT_RESTING ? 0.0f : vIn.age;
 	
 	// Constant acceleration equation
 	vOut.posW = 0.5f * t * t * accelW + t * vIn.initialVelW + vIn.initialPosW;
 	
-	vOut.sizeW = vIn.sizeW;
+	// Grow or shrink over the particle's life
+	vOut.sizeW = vIn.sizeW * lerp(1.0f, sizeGrowth, saturate(t/lifetime));
 	vOut.type  = vIn.type;
+	vOut.slice = vIn.type % PT_RESTING - PT_FLARE;
 	
 	return vOut;
 }
@@ -221,6 +427,7 @@ struct GS_OUT
 {
 	float4 posH  : SV_Position;
 	float2 texC  : TEXCOORD;
+	nointerpolation uint slice : SLICE;
 };
 
 // The draw GS expands points into camera facing quads
@@ -261,6 +468,7 @@ void DrawGS(point VS_OUT gIn[1],
 		{
 			gOut.posH  = mul(v[i], wvp);
 			gOut.texC  = quadTexC[i];
+			gOut.slice = gIn[0].slice;
 			triStream.Append(gOut);
 		}	
 	}
@@ -268,7 +476,7 @@ void DrawGS(point VS_OUT gIn[1],
 
 float4 DrawPS(GS_OUT pIn) : SV_TARGET
 {
-	return texArray.Sample(TriLinearSample, float3(pIn.texC, 0));
+	return texArray.Sample(TriLinearSample, float3(pIn.texC, pIn.slice));
 }
 
 technique10 DrawTech
@@ -11,6 +11,7 @@
 static const float SHADOW_EPSILON = 0.001f;
 static const float SMAP_SIZE = 1024.0f;
 static const float SMAP_DX = 1.0f / SMAP_SIZE;
+static const int MAX_CASCADES = 4;
  
 cbuffer cbPerFrame
 {
@@ -28,7 +29,9 @@ cbuffer cbPerFrame
 
 cbuffer cbPerObject
 {
-	float4x4 lightWvp; 
+	float4x4 lightWvps[MAX_CASCADES];
+	float4 cascadeEnds;		// View depth each cascade ends at
+	int cascadesNo;
 	float4x4 world;
 	float4x4 wvp; 
 	float4 reflectMaterial;
@@ -44,7 +47,7 @@ cbuffer cbFixed
 Texture2D diffuseMap;
 Texture2D specMap;
 Texture2D normalMap;
-Texture2D shadowMap;
+Texture2DArray shadowMap;	// A slice for each cascade
 
 SamplerState ShadowSample
 {
@@ -75,7 +78,8 @@ struct VS_OUT
     float3 tangentW : TANGENT;
     float3 normalW  : NORMAL;
     float2 texC     : TEXCOORD0;
-    float4 projTexC : TEXCOORD1;
+    float3 posL     : TEXCOORD1;
+    float  viewZ    : TEXCOORD2;
 	float  fogLerp	: FOG;
 };
  
@@ -95,8 +99,10 @@ VS_OUT VS(VS_IN vIn)
 	// Transform to homogeneous clip space
 	vOut.posH = mul(float4(vIn.posL, 1.0f), wvp);
 	
-	// Generate projective tex-coords to project shadow map onto scene
-	vOut.projTexC = mul(float4(vIn.posL, 1.0f), lightWvp);
+	// The shadow map is projected onto the scene per pixel, once its
+	// cascade is known from the view depth
+	vOut.posL = vIn.posL;
+	vOut.viewZ = vOut.posH.w;
 	
 	// Output vertex attributes for interpolation across triangle
 	vOut.texC = vIn.texC;
@@ -105,7 +111,7 @@ VS_OUT VS(VS_IN vIn)
 }
 
 
-float CalcShadowFactor(float4 projTexC)
+float CalcShadowFactor(float4 projTexC, int cascade)
 {
 	// Complete projection by doing division by w
 	projTexC.xyz /= projTexC.w;
@@ -125,10 +131,10 @@ float CalcShadowFactor(float4 projTexC)
 
 	
 	// Sample shadow map to get nearest depth to light
-	float s0 = shadowMap.Sample(ShadowSample, projTexC.xy).r;
-	float s1 = shadowMap.Sample(ShadowSample, projTexC.xy + float2(SMAP_DX, 0)).r;
-	float s2 = shadowMap.Sample(ShadowSample, projTexC.xy + float2(0, SMAP_DX)).r;
-	float s3 = shadowMap.Sample(ShadowSample, projTexC.xy + float2(SMAP_DX, SMAP_DX)).r;
+	float s0 = shadowMap.Sample(ShadowSample, float3(projTexC.xy, cascade)).r;
+	float s1 = shadowMap.Sample(ShadowSample, float3(projTexC.xy + float2(SMAP_DX, 0), cascade)).r;
+	float s2 = shadowMap.Sample(ShadowSample, float3(projTexC.xy + float2(0, SMAP_DX), cascade)).r;
+	float s3 = shadowMap.Sample(ShadowSample, float3(projTexC.xy + float2(SMAP_DX, SMAP_DX), cascade)).r;
 	
 	// Is the pixel depth <= shadow map value?
 	float result0 = depth <= s0 + SHADOW_EPSILON;
@@ -172,7 +178,15 @@ float4 PS(VS_OUT pIn) : SV_Target
 	// Transform from tangent space to world space
 	float3 bumpedNormalW = normalize(mul(normalT, TBN));
     
-    float shadowFactor = CalcShadowFactor(pIn.projTexC);
+	// Pick the first cascade that reaches this far from the camera
+	int cascade = 0;
+	[unroll]
+	for (int i = 0; i < MAX_CASCADES - 1; ++i)
+		cascade += (pIn.viewZ > cascadeEnds[i]) ? 1 : 0;
+	cascade = min(cascade, cascadesNo - 1);
+	
+	float4 projTexC = mul(float4(pIn.posL, 1.0f), lightWvps[cascade]);
+    float shadowFactor = CalcShadowFactor(projTexC, cascade);
     
 	// Compute the lit color for this pixel
     SurfaceInfo v = {pIn.posW, bumpedNormalW, diff, spec};
@@ -0,0 +1,431 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Benchmark
+	Brief		Command line options and drivers for running the scene
+				headlessly and reporting how long its frames take
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include "Benchmark/Benchmark.hpp"
+#include "Scene/Scene.hpp"
+#include "Input/InputLog.hpp"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	/*
+		Name		percentile
+		Syntax		percentile(const std::vector<double>& sorted, double p)
+		Param		const std::vector<double>& sorted - Samples in ascending order
+		Param		double p - The percentile, from 0 to 1
+		Return		double - The nearest rank percentile, 0 if there are no samples
+		Brief		Gets a percentile of a sorted set of samples
+	*/
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.0;
+
+		size_t rank = (size_t)ceil(p * sorted.size());
+		return sorted[rank > 0 ? rank - 1 : 0];
+	}
+
+	/*
+		Name		writeCullStats
+		Syntax		writeCullStats(FILE* file, const CullStats& stats, double frames)
+		Param		FILE* file - The report file
+		Param		const CullStats& stats - Culling totals of the run
+		Param		double frames - Frames rendered in the run
+		Brief		Appends how much the frustum and occlusion culling removed
+					and how long each took a frame
+	*/
+	void writeCullStats(FILE* file, const CullStats& stats, double frames)
+	{
+		double culled = stats.tested ? 100.0 * stats.culled / stats.tested : 0.0;
+		double us = (double)stats.ticks * 1000000.0 / (double)GameTimer::ticksPerSecond();
+		fprintf(file, "culled/frame      %.1f of %.1f (%.1f%%)\n", stats.culled / frames, 
+				stats.tested / frames, culled);
+		fprintf(file, "cull us/frame     %.2f\n", us / frames);
+
+		double occluded = stats.tested ? 100.0 * stats.occluded / stats.tested : 0.0;
+		double occlusionUs = (double)stats.occlusionTicks * 1000000.0 / (double)GameTimer::ticksPerSecond();
+		fprintf(file, "occluded/frame    %.1f of %.1f (%.1f%%)\n", stats.occluded / frames, 
+				stats.tested / frames, occluded);
+		fprintf(file, "occlude us/frame  %.2f\n", occlusionUs / frames);
+	}
+
+	/*
+		Name		writeShadowStats
+		Syntax		writeShadowStats(FILE* file, const ShadowStats& stats, double frames)
+		Param		FILE* file - The report file
+		Param		const ShadowStats& stats - Shadow cascade totals of the run
+		Param		double frames - Frames rendered in the run
+		Brief		Appends how many shadow cascades were drawn again a frame,
+					the rest being cached, and how long fitting them took
+	*/
+	void writeShadowStats(FILE* file, const ShadowStats& stats, double frames)
+	{
+		double us = (double)stats.ticks * 1000000.0 / (double)GameTimer::ticksPerSecond();
+		fprintf(file, "cascades/frame    %.2f drawn of %.1f\n", stats.drawn / frames,
+				stats.cascades / frames);
+		fprintf(file, "cascade us/frame  %.2f\n", us / frames);
+	}
+
+	/*
+		Name		writeParticleStats
+		Syntax		writeParticleStats(FILE* file, const ParticleStats& stats, double frames)
+		Param		FILE* file - The report file
+		Param		const ParticleStats& stats - Particle totals of the run
+		Param		double frames - Frames rendered in the run
+		Brief		Appends the particles alive, emitted and killed a frame,
+					and the mean emission scale the particle budget gave
+	*/
+	void writeParticleStats(FILE* file, const ParticleStats& stats, double frames)
+	{
+		double systems = stats.systems ? (double)stats.systems : 1.0;
+		fprintf(file, "particles/frame   %.0f live, %.1f emitted, %.1f killed\n", stats.live / frames,
+				stats.emitted / frames, stats.killed / frames);
+		fprintf(file, "emit scale        %.2f\n", stats.emitScale / systems);
+	}
+
+	/*
+		Name		writePrefetchStats
+		Syntax		writePrefetchStats(FILE* file, const PrefetchStats& stats)
+		Param		FILE* file - The report file
+		Param		const PrefetchStats& stats - Look ahead totals of the run
+		Brief		Appends how often each of the camera's look ahead hints
+					named the terrain cell the camera reached, against taking
+					the cell it was over
+	*/
+	void writePrefetchStats(FILE* file, const PrefetchStats& stats)
+	{
+		fprintf(file, "\nlook ahead    hints   hit rate   still hit rate\n");
+		for (int h = 0; h < Camera::LOOKAHEAD_NO; ++h)
+		{
+			double hints = (double)stats.hints[h];
+			fprintf(file, "%4.1f s   %9.0f %9.1f%% %15.1f%%\n", Camera::LOOKAHEAD_TIMES[h], hints,
+					hints > 0.0 ? 100.0 * stats.hits[h] / hints : 0.0,
+					hints > 0.0 ? 100.0 * stats.stillHits[h] / hints : 0.0);
+		}
+	}
+
+	/*
+		Name		writeProfile
+		Syntax		writeProfile(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Appends the profiled zones to a report when the profiler 
+					is compiled in
+	*/
+	void writeProfile(FILE* file)
+	{
+#ifdef PROFILER_ENABLED
+		fprintf(file, "\n");
+		Profiler::instance()->writeSummary(file);
+#endif
+	}
+
+	/*
+		Name		beginTrace
+		Syntax		beginTrace(const std::string& fileName)
+		Param		const std::string& fileName - The trace file
+		Return		bool - False if the trace could not be started
+		Brief		Starts tracing the profiled zones to a file, saying why
+					if it cannot
+		Details		Without the profiler compiled in there are no zones to
+					trace, so the trace is refused rather than left empty
+	*/
+	bool beginTrace(const std::string& fileName)
+	{
+#ifdef PROFILER_ENABLED
+		if (Profiler::instance()->beginTrace(fileName))
+			return true;
+
+		MessageBox(0, "Opening trace file - Failed", "Error", MB_OK);
+		return false;
+#else
+		MessageBox(0, "Tracing needs a build with PROFILER_ENABLED defined", 
+				   "Error", MB_OK);
+		return false;
+#endif
+	}
+}
+
+/*
+	Name		BenchmarkOptions::BenchmarkOptions
+	Syntax		BenchmarkOptions()
+	Brief		BenchmarkOptions constructor sets the default options
+*/
+BenchmarkOptions::BenchmarkOptions()
+: headless(false), frames(1000), report("benchmark.txt"), fixedStep(0.0f), 
+  frameCap(120.0f), simStep(1.0f / 60.0f), simThread(false), noGround(false)
+{
+}
+
+/*
+	Name		parseBenchmarkOptions
+	Syntax		parseBenchmarkOptions(const char* cmdLine,
+									  BenchmarkOptions* options)
+	Param		const char* cmdLine - The command line passed to WinMain
+	Param		BenchmarkOptions* options - Receives the parsed options
+	Return		bool - False if an option is not recognised
+	Brief		Parses the benchmark options from the command line
+*/
+bool parseBenchmarkOptions(const char* cmdLine, BenchmarkOptions* options)
+{
+	std::istringstream args(cmdLine ? cmdLine : "");
+	std::string arg;
+
+	while (args >> arg)
+	{
+		if (arg == "-headless")
+		{
+			options->headless = true;
+		}
+		else if (arg == "-frames")
+		{
+			if (!(args >> options->frames))
+				return false;
+		}
+		else if (arg == "-report")
+		{
+			if (!(args >> options->report))
+				return false;
+		}
+		else if (arg == "-record")
+		{
+			if (!(args >> options->record))
+				return false;
+		}
+		else if (arg == "-replay")
+		{
+			if (!(args >> options->replay))
+				return false;
+		}
+		else if (arg == "-trace")
+		{
+			if (!(args >> options->trace))
+				return false;
+		}
+		else if (arg == "-fpscap")
+		{
+			if (!(args >> options->frameCap) || options->frameCap < 0.0f)
+				return false;
+		}
+		else if (arg == "-simstep")
+		{
+			if (!(args >> options->simStep) || options->simStep < 0.0f)
+				return false;
+		}
+		else if (arg == "-simthread")
+		{
+			options->simThread = true;
+		}
+		else if (arg == "-noground")
+		{
+			options->noGround = true;
+		}
+		else if (arg == "-bench")
+		{
+			if (!(args >> options->bench))
+				return false;
+		}
+		else if (arg == "-fixedstep")
+		{
+			if (!(args >> options->fixedStep) || options->fixedStep < 0.0f)
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+	Name		runFrameBenchmark
+	Syntax		runFrameBenchmark(const BenchmarkOptions& options)
+	Param		const BenchmarkOptions& options - The benchmark options
+	Return		int - Zero if the benchmark ran and the report was written
+	Brief		Runs the full frame loop for a number of frames and reports
+				the frame rate and the work submitted to the render backend
+*/
+int runFrameBenchmark(const BenchmarkOptions& options)
+{
+	Scene* scene = Scene::instance();
+	scene->setSimStep(options.simStep);
+	scene->setSimThreaded(options.simThread);
+	scene->setParticlesLand(!options.noGround);
+	scene->initialise(options.headless);
+
+	RenderBackend* backend = scene->getBackend();
+	if (!backend || !backend->getDevice())
+		return 1;
+
+	if (!options.trace.empty() && !beginTrace(options.trace))
+	{
+		scene->deinitialise();
+		return 1;
+	}
+
+	__int64 countsPerSec, start, end;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	QueryPerformanceCounter((LARGE_INTEGER*)&start);
+
+	for (UINT i = 0; i < options.frames; ++i)
+	{
+		scene->runFrame();
+		PROFILE_END_FRAME();
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&end);
+	Profiler::instance()->endTrace();
+
+	double seconds = (double)(end - start) / (double)countsPerSec;
+	const RenderStats& stats = backend->getTotalStats();
+	double frames = (double)(backend->getFrameCount() ? backend->getFrameCount() : 1);
+
+	FILE* file = 0;
+	if (fopen_s(&file, options.report.c_str(), "w") != 0)
+	{
+		scene->deinitialise();
+		return 1;
+	}
+
+	fprintf(file, "backend           %s\n", backend->isHeadless() ? "null" : "hardware");
+	fprintf(file, "ground            %s\n", options.noGround ? "none" : "terrain");
+	fprintf(file, "frames            %u\n", backend->getFrameCount());
+	fprintf(file, "seconds           %.3f\n", seconds);
+	fprintf(file, "frames/second     %.1f\n", frames / seconds);
+	fprintf(file, "ms/frame          %.4f\n", seconds * 1000.0 / frames);
+	fprintf(file, "draws/frame       %.1f\n", stats.drawCalls / frames);
+	fprintf(file, "auto draws/frame  %.1f\n", stats.autoDrawCalls / frames);
+	fprintf(file, "vertices/frame    %.1f\n", stats.vertices / frames);
+	fprintf(file, "bytes uploaded    %I64u\n", stats.bytesUploaded);
+	fprintf(file, "buffers created   %u\n", stats.buffersCreated);
+	fprintf(file, "textures created  %u\n", stats.texturesCreated);
+	writeCullStats(file, scene->getCullStats(), frames);
+	writeShadowStats(file, scene->getShadowStats(), frames);
+	writeParticleStats(file, scene->getParticleStats(), frames);
+	writeProfile(file);
+	fclose(file);
+
+	scene->deinitialise();
+	return 0;
+}
+
+/*
+	Name		runReplayBenchmark
+	Syntax		runReplayBenchmark(const BenchmarkOptions& options)
+	Param		const BenchmarkOptions& options - The benchmark options
+	Return		int - Zero if the benchmark ran and the report was written
+	Brief		Replays a recorded input log and reports the frame time 
+				percentiles and the particles alive a frame for each season,
+				and how well the camera's look ahead hints predicted the
+				flight
+	Details		Every frame of the log is timed, including the frames that 
+				change state, so that the cost of loading a season shows up
+				in the max of the season being left. The particles alive are
+				those read back from the systems' stream-out queries, so
+				are only counted on hardware, and are compared with and
+				without -noground
+*/
+int runReplayBenchmark(const BenchmarkOptions& options)
+{
+	InputLog log;
+	if (!log.openForReplay(options.replay))
+		return 1;
+
+	Scene* scene = Scene::instance();
+	scene->setInputLog(&log);
+	scene->setReplayStep(options.fixedStep);
+	scene->setParticlesLand(!options.noGround);
+	scene->initialise(options.headless);
+
+	RenderBackend* backend = scene->getBackend();
+	if (!backend || !backend->getDevice())
+		return 1;
+
+	if (!options.trace.empty() && !beginTrace(options.trace))
+	{
+		scene->deinitialise();
+		scene->setInputLog(0);
+		return 1;
+	}
+
+	std::vector<double> frameTimes[SEASONS_NO];
+	UINT64 particlesLive[SEASONS_NO];
+	for (int i = 0; i < SEASONS_NO; ++i)
+	{
+		frameTimes[i].reserve(log.getFramesNo());
+		particlesLive[i] = 0;
+	}
+
+	__int64 countsPerSec, start, end;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	double msPerCount = 1000.0 / (double)countsPerSec;
+
+	for (;;)
+	{
+		Season season = scene->getSeason();
+		UINT64 live = scene->getParticleStats().live;
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		bool running = scene->runFrame();
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+		PROFILE_END_FRAME();
+
+		if (!running)
+			break;
+
+		frameTimes[season].push_back((double)(end - start) * msPerCount);
+		particlesLive[season] += scene->getParticleStats().live - live;
+	}
+	Profiler::instance()->endTrace();
+
+	FILE* file = 0;
+	if (fopen_s(&file, options.report.c_str(), "w") != 0)
+	{
+		scene->deinitialise();
+		scene->setInputLog(0);
+		return 1;
+	}
+
+	fprintf(file, "backend    %s\n", backend->isHeadless() ? "null" : "hardware");
+	fprintf(file, "replay     %s\n", options.replay.c_str());
+	fprintf(file, "frames     %u\n", log.getFramesNo());
+	if (options.fixedStep > 0.0f)
+		fprintf(file, "time step  %.6f s\n", options.fixedStep);
+	else
+		fprintf(file, "time step  recorded\n");
+	fprintf(file, "ground     %s\n\n", options.noGround ? "none" : "terrain");
+
+	fprintf(file, "season     frames     p50 ms     p95 ms     p99 ms     max ms   particles\n");
+	for (int i = 0; i < SEASONS_NO; ++i)
+	{
+		std::vector<double>& times = frameTimes[i];
+		std::sort(times.begin(), times.end());
+
+		fprintf(file, "%-10s %6u %10.4f %10.4f %10.4f %10.4f %11.0f\n",
+			getSeasonName((Season)i), (UINT)times.size(), percentile(times, 0.50),
+			percentile(times, 0.95), percentile(times, 0.99),
+			times.empty() ? 0.0 : times.back(),
+			times.empty() ? 0.0 : (double)particlesLive[i] / times.size());
+	}
+	writePrefetchStats(file, scene->getPrefetchStats());
+	writeProfile(file);
+	fclose(file);
+
+	scene->deinitialise();
+	scene->setInputLog(0);
+	return 0;
+}
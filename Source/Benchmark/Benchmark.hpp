@@ -0,0 +1,51 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Benchmark
+	Brief		Command line options and drivers for running the scene
+				headlessly and reporting how long its frames take
+*/
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <windows.h>
+#include <stdio.h>
+#include <string>
+
+/*
+	Name		BenchmarkOptions
+	Syntax		BenchmarkOptions
+	Brief		Options parsed from the command line
+*/
+struct BenchmarkOptions
+{
+	BenchmarkOptions();
+
+	bool headless;			// -headless		Render through the null backend
+	UINT frames;			// -frames <n>		Number of frames to run
+	std::string report;		// -report <file>	File the results are written to
+	std::string record;		// -record <file>	Records the input of a normal run
+	std::string replay;		// -replay <file>	Replays recorded input and reports
+							//					the frame times per season
+	float fixedStep;		// -fixedstep <s>	Replay time step, 0 uses the recorded one
+	std::string trace;		// -trace <file>	Chrome trace of the profiled zones
+	float frameCap;			// -fpscap <n>		Frame rate cap of a normal run, 0 for none
+	float simStep;			// -simstep <s>		Fixed simulation step, 0 for one per frame
+	bool simThread;			// -simthread		Simulate on a thread of its own
+	bool noGround;			// -noground		Particles fall through the terrain
+	std::string bench;		// -bench <name>	Runs a math benchmark instead of the scene
+};
+
+bool parseBenchmarkOptions(const char* cmdLine, BenchmarkOptions* options);
+int runFrameBenchmark(const BenchmarkOptions& options);
+int runReplayBenchmark(const BenchmarkOptions& options);
+int runMathBenchmark(const BenchmarkOptions& options);
+
+// The texture benchmarks, run by runMathBenchmark as -bench dds and arrays
+void runTextureBenchmark(FILE* file);
+void runArrayBenchmark(FILE* file);
+
+#endif // BENCHMARK_H
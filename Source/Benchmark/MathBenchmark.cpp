@@ -0,0 +1,3608 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		MathBenchmark
+	Brief		Standalone benchmarks of the math3d kernels, timing the scalar
+				versions against the SIMD ones
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <vector>
+#include <algorithm>
+
+#include "Benchmark/Benchmark.hpp"
+#include "Maths/math3d.h"
+#include "Maths/m3dSIMD.h"
+#include "Maths/m3dBatch.h"
+#include "Maths/m3dRay.h"
+#include "Maths/m3dApprox.h"
+#include "Maths/m3dCull.h"
+#include "Maths/m3dBVH.h"
+#include "Maths/m3dCascade.h"
+#include "Maths/m3dHeight.h"
+#include "Maths/m3dField.h"
+#include "Maths/m3dRandom.h"
+#include "Renderer/OcclusionBuffer.hpp"
+#include "ParticleSystem/ParticleSorter.hpp"
+#include "ParticleSystem/ParticleSimulation.hpp"
+#include "ParticleSystem/ParticleBudget.hpp"
+#include "ParticleSystem/WindField.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "ParticleSystem/EmitterPool.hpp"
+
+namespace
+{
+	const int BATCH_SIZE = 4096;		// Matrices or vectors per pass
+	const double MIN_SECONDS = 0.25;	// Each kernel is repeated for at least this long
+
+	/*
+		Name		MatrixBatch
+		Syntax		MatrixBatch
+		Brief		Inputs and outputs shared by the matrix kernels
+	*/
+	struct MatrixBatch
+	{
+		M3DMatrix44f a[BATCH_SIZE];
+		M3DMatrix44f b[BATCH_SIZE];
+		M3DMatrix44f affine[BATCH_SIZE];
+		M3DMatrix44f out[BATCH_SIZE];
+		M3DVector4f vectors[BATCH_SIZE];
+		M3DVector4f transformed[BATCH_SIZE];
+		M3DVector3f normals[BATCH_SIZE];
+	};
+
+	MatrixBatch batch;		// Static, as it is too large for the stack
+	volatile float sink;	// Keeps the results alive so that no kernel is optimised away
+
+	/*
+		Name		random
+		Syntax		random()
+		Return		float - A random number from -1 to 1
+		Brief		Gets a random number for the benchmark inputs
+	*/
+	float random()
+	{
+		return (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+	}
+
+	/*
+		Name		fillBatch
+		Syntax		fillBatch()
+		Brief		Fills the batch with random matrices and vectors
+		Details		The affine matrices are made from a rotation and a
+					translation so that they can always be inverted
+	*/
+	void fillBatch()
+	{
+		srand(1);
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			for (int j = 0; j < 16; ++j)
+			{
+				batch.a[i][j] = random();
+				batch.b[i][j] = random();
+			}
+
+			m3dRotationMatrix44(batch.affine[i], random() * (float)M3D_PI,
+								random(), random(), 1.0f);
+			batch.affine[i][12] = random() * 100.0f;
+			batch.affine[i][13] = random() * 100.0f;
+			batch.affine[i][14] = random() * 100.0f;
+			batch.affine[i][15] = 1.0f;
+
+			m3dLoadVector4(batch.vectors[i], random(), random(), random(), 1.0f);
+		}
+	}
+
+	/*
+		Name		resetNormals
+		Syntax		resetNormals()
+		Brief		Scales the vectors to be normalised back to random lengths,
+					so each pass has the same work to do
+	*/
+	void resetNormals()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			m3dLoadVector3(batch.normals[i], batch.vectors[i][0] * 4.0f,
+						   batch.vectors[i][1] * 4.0f, batch.vectors[i][2] + 2.0f);
+		}
+	}
+
+	void multiplyScalar()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dMatrixMultiply44Scalar(batch.out[i], batch.a[i], batch.b[i]);
+	}
+
+	void multiplySimd()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dMatrixMultiply44(batch.out[i], batch.a[i], batch.b[i]);
+	}
+
+	void invertScalar()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dInvertMatrix44Scalar(batch.out[i], batch.a[i]);
+	}
+
+	void invertSimd()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dInvertMatrix44(batch.out[i], batch.a[i]);
+	}
+
+	void invertAffineScalar()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dInvertAffineMatrix44Scalar(batch.out[i], batch.affine[i]);
+	}
+
+	void invertAffineSimd()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dInvertAffineMatrix44(batch.out[i], batch.affine[i]);
+	}
+
+	void transposeScalar()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			for (int r = 0; r < 4; ++r)
+				for (int c = 0; c < 4; ++c)
+					batch.out[i][r * 4 + c] = batch.a[i][c * 4 + r];
+	}
+
+	void transposeSimd()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dTransposeMatrix44(batch.out[i], batch.a[i]);
+	}
+
+	void transformScalar()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dTransformVector4(batch.transformed[i], batch.vectors[i], batch.affine[0]);
+	}
+
+	void transformSimd()
+	{
+		m3dTransformVectors4(batch.transformed, batch.vectors, BATCH_SIZE, batch.affine[0]);
+	}
+
+	void normaliseScalar()
+	{
+		resetNormals();
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			m3dNormalizeVector3(batch.normals[i]);
+	}
+
+	void normaliseSimd()
+	{
+		resetNormals();
+		m3dNormalizeVectors3(batch.normals, BATCH_SIZE);
+	}
+
+	/*
+		Name		MathKernel
+		Syntax		MathKernel
+		Brief		A kernel timed in both its scalar and SIMD versions
+	*/
+	struct MathKernel
+	{
+		const char* name;
+		void (*scalar)();
+		void (*simd)();
+	};
+
+	const MathKernel MATRIX_KERNELS[] =
+	{
+		{ "multiply 4x4",		multiplyScalar,		multiplySimd },
+		{ "invert 4x4",			invertScalar,		invertSimd },
+		{ "invert affine",		invertAffineScalar,	invertAffineSimd },
+		{ "transpose 4x4",		transposeScalar,	transposeSimd },
+		{ "transform vector4",	transformScalar,	transformSimd },
+		{ "normalise vector3",	normaliseScalar,	normaliseSimd }
+	};
+
+	/*
+		Name		timeKernel
+		Syntax		timeKernel(void (*kernel)(), int opsPerPass)
+		Param		void (*kernel)() - Runs one pass over its inputs
+		Param		int opsPerPass - Operations done by one pass
+		Return		double - Operations per second
+		Brief		Repeats a kernel until it has run for long enough to time
+	*/
+	double timeKernel(void (*kernel)(), int opsPerPass)
+	{
+		__int64 countsPerSec, start, end;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+
+		// Warm the caches and the branch predictors first
+		kernel();
+
+		UINT passes = 0;
+		double seconds = 0.0;
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		do
+		{
+			kernel();
+			++passes;
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			seconds = (double)(end - start) / (double)countsPerSec;
+		}
+		while (seconds < MIN_SECONDS);
+
+		return (double)passes * opsPerPass / seconds;
+	}
+
+	/*
+		Name		runMatrixBenchmark
+		Syntax		runMatrixBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times the matrix and vector kernels of math3d
+	*/
+	void runMatrixBenchmark(FILE* file)
+	{
+		fillBatch();
+		resetNormals();
+
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		fprintf(file, "kernel             scalar ops/s      simd ops/s   speedup\n");
+
+		const int kernelsNo = sizeof(MATRIX_KERNELS) / sizeof(MATRIX_KERNELS[0]);
+		for (int i = 0; i < kernelsNo; ++i)
+		{
+			double scalar = timeKernel(MATRIX_KERNELS[i].scalar, BATCH_SIZE);
+			double simd = timeKernel(MATRIX_KERNELS[i].simd, BATCH_SIZE);
+
+			fprintf(file, "%-18s %12.0f %15.0f %8.2fx\n", MATRIX_KERNELS[i].name,
+				scalar, simd, simd / scalar);
+		}
+		sink = batch.out[1][1] + batch.transformed[1][0] + batch.normals[1][0];
+	}
+
+	const int MAX_MATRIX_PAIRS = 1000000;	// 10M pairs would need almost 2GB
+
+	/*
+		Name		PointBatch
+		Syntax		PointBatch
+		Brief		Points in both layouts, and matrix pairs, for the batched
+					kernels
+	*/
+	struct PointBatch
+	{
+		int count;
+		std::vector<float> aosIn;			// x y z x y z...
+		std::vector<float> aosOut;
+		M3DPointArray soaIn;
+		M3DPointArray soaOut;
+
+		int pairsNo;
+		std::vector<float> a;				// 16 floats a matrix
+		std::vector<float> b;
+		std::vector<float> product;
+
+		M3DMatrix44f modelView;
+		M3DMatrix44f projection;
+		int viewport[4];
+	};
+
+	PointBatch points;
+
+	/*
+		Name		fillPoints
+		Syntax		fillPoints(int count)
+		Param		int count - Number of points
+		Brief		Fills both layouts with the same random points, and the
+					matrix pairs up to MAX_MATRIX_PAIRS
+	*/
+	void fillPoints(int count)
+	{
+		points.count = count;
+		points.aosIn.resize(count * 3);
+		points.aosOut.resize(count * 3);
+		points.soaIn.resize(count);
+		points.soaOut.resize(count);
+
+		srand(2);
+		for (int i = 0; i < count; ++i)
+		{
+			points.aosIn[i * 3] = points.soaIn.getX()[i] = random() * 100.0f;
+			points.aosIn[i * 3 + 1] = points.soaIn.getY()[i] = random() * 100.0f;
+			points.aosIn[i * 3 + 2] = points.soaIn.getZ()[i] = random() * 100.0f;
+		}
+
+		points.pairsNo = count < MAX_MATRIX_PAIRS ? count : MAX_MATRIX_PAIRS;
+		points.a.resize(points.pairsNo * 16);
+		points.b.resize(points.pairsNo * 16);
+		points.product.resize(points.pairsNo * 16);
+		for (int i = 0; i < points.pairsNo * 16; ++i)
+		{
+			points.a[i] = random();
+			points.b[i] = random();
+		}
+
+		m3dRotationMatrix44(points.modelView, 0.3f, 0.0f, 1.0f, 0.0f);
+		points.modelView[14] = -250.0f;
+		m3dMakePerspectiveMatrix(points.projection, (float)M3D_PI / 4.0f, 4.0f / 3.0f, 1.0f, 1000.0f);
+		points.viewport[0] = points.viewport[1] = 0;
+		points.viewport[2] = 800;
+		points.viewport[3] = 600;
+	}
+
+	M3DVector3f* aosIn() { return (M3DVector3f*)&points.aosIn[0]; }
+	M3DVector3f* aosOut() { return (M3DVector3f*)&points.aosOut[0]; }
+	M3DMatrix44f* matrices(std::vector<float>& m) { return (M3DMatrix44f*)&m[0]; }
+
+	void transformEach()
+	{
+		for (int i = 0; i < points.count; ++i)
+			m3dTransformVector3(aosOut()[i], aosIn()[i], points.modelView);
+	}
+
+	void transformBatch()
+	{
+		m3dTransformPoints(points.soaOut.getX(), points.soaOut.getY(), points.soaOut.getZ(),
+						   points.soaIn.getX(), points.soaIn.getY(), points.soaIn.getZ(),
+						   points.count, points.modelView);
+	}
+
+	void multiplyEach()
+	{
+		for (int i = 0; i < points.pairsNo; ++i)
+			m3dMatrixMultiply44Scalar(matrices(points.product)[i], matrices(points.a)[i],
+									  matrices(points.b)[i]);
+	}
+
+	void multiplyBatch()
+	{
+		m3dMatrixMultiply44Batch(matrices(points.product), matrices(points.a),
+								 matrices(points.b), points.pairsNo);
+	}
+
+	void projectEach()
+	{
+		for (int i = 0; i < points.count; ++i)
+			m3dProjectXYZ(aosOut()[i], points.modelView, points.projection, points.viewport,
+						  aosIn()[i]);
+	}
+
+	void projectBatch()
+	{
+		m3dProjectPoints(points.soaOut.getX(), points.soaOut.getY(), points.soaOut.getZ(),
+						 points.soaIn.getX(), points.soaIn.getY(), points.soaIn.getZ(),
+						 points.count, points.modelView, points.projection, points.viewport);
+	}
+
+	/*
+		Name		runBatchBenchmark
+		Syntax		runBatchBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times the batched point and matrix kernels from 1k to 10M 
+					elements against the math3d functions called once an element
+		Details		The single calls work on x y z arrays and the batched ones
+					on separate x, y and z arrays. Matrix pairs stop at 1M
+	*/
+	void runBatchBenchmark(FILE* file)
+	{
+		const int SIZES[] = { 1000, 10000, 100000, 1000000, 10000000 };
+		const int sizesNo = sizeof(SIZES) / sizeof(SIZES[0]);
+
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		fprintf(file, "kernel             elements       each/s      batch/s   speedup\n");
+
+		for (int i = 0; i < sizesNo; ++i)
+		{
+			fillPoints(SIZES[i]);
+			if (points.soaIn.getCount() != SIZES[i])
+			{
+				fprintf(file, "out of memory at %d elements\n", SIZES[i]);
+				break;
+			}
+
+			const MathKernel BATCH_KERNELS[] =
+			{
+				{ "transform points",	transformEach,	transformBatch },
+				{ "multiply pairs",		multiplyEach,	multiplyBatch },
+				{ "project points",		projectEach,	projectBatch }
+			};
+			const int ops[] = { points.count, points.pairsNo, points.count };
+
+			for (int k = 0; k < 3; ++k)
+			{
+				double each = timeKernel(BATCH_KERNELS[k].scalar, ops[k]);
+				double batched = timeKernel(BATCH_KERNELS[k].simd, ops[k]);
+
+				fprintf(file, "%-18s %8d %12.0f %12.0f %8.2fx\n", BATCH_KERNELS[k].name,
+					ops[k], each, batched, batched / each);
+			}
+			sink = points.aosOut[1] + points.soaOut.getX()[1] + points.product[1];
+		}
+
+		points.soaIn.resize(0);
+		points.soaOut.resize(0);
+		std::vector<float>().swap(points.aosIn);
+		std::vector<float>().swap(points.aosOut);
+		std::vector<float>().swap(points.a);
+		std::vector<float>().swap(points.b);
+		std::vector<float>().swap(points.product);
+	}
+
+	/*
+		Name		RayBatch
+		Syntax		RayBatch
+		Brief		Rays, spheres and boxes for the ray kernels
+	*/
+	struct RayBatch
+	{
+		float ox[BATCH_SIZE], oy[BATCH_SIZE], oz[BATCH_SIZE];
+		float dx[BATCH_SIZE], dy[BATCH_SIZE], dz[BATCH_SIZE];
+		float cx[BATCH_SIZE], cy[BATCH_SIZE], cz[BATCH_SIZE], radius[BATCH_SIZE];
+		float minX[BATCH_SIZE], minY[BATCH_SIZE], minZ[BATCH_SIZE];
+		float maxX[BATCH_SIZE], maxY[BATCH_SIZE], maxZ[BATCH_SIZE];
+		float t[BATCH_SIZE];
+		int packetSize;
+		int nearest;
+	};
+
+	RayBatch rays;
+
+	/*
+		Name		fillRays
+		Syntax		fillRays()
+		Brief		Fills the batch with rays from around the origin and with
+					spheres and boxes scattered in front of them
+	*/
+	void fillRays()
+	{
+		srand(3);
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f dir = { random() * 0.5f, random() * 0.5f, 1.0f };
+			m3dNormalizeVector3(dir);
+			rays.ox[i] = random();
+			rays.oy[i] = random();
+			rays.oz[i] = random();
+			rays.dx[i] = dir[0];
+			rays.dy[i] = dir[1];
+			rays.dz[i] = dir[2];
+
+			rays.cx[i] = random() * 50.0f;
+			rays.cy[i] = random() * 50.0f;
+			rays.cz[i] = 60.0f + random() * 50.0f;
+			rays.radius[i] = 0.5f + (random() + 1.0f);
+
+			rays.minX[i] = rays.cx[i] - rays.radius[i];
+			rays.minY[i] = rays.cy[i] - rays.radius[i];
+			rays.minZ[i] = rays.cz[i] - rays.radius[i];
+			rays.maxX[i] = rays.cx[i] + rays.radius[i];
+			rays.maxY[i] = rays.cy[i] + rays.radius[i];
+			rays.maxZ[i] = rays.cz[i] + rays.radius[i];
+		}
+	}
+
+	M3DSphereArray sphereArray()
+	{
+		M3DSphereArray spheres = { rays.cx, rays.cy, rays.cz, rays.radius, BATCH_SIZE };
+		return spheres;
+	}
+
+	M3DBoxArray boxArray()
+	{
+		M3DBoxArray boxes = { rays.minX, rays.minY, rays.minZ, rays.maxX, rays.maxY, rays.maxZ, BATCH_SIZE };
+		return boxes;
+	}
+
+	/*
+		Name		scalarSlab
+		Brief		The scalar slab test the box kernels are compared with, as
+					math3d has no ray box test of its own
+	*/
+	float scalarSlab(const M3DVector3f o, const M3DVector3f d, int box)
+	{
+		const float boxMin[3] = { rays.minX[box], rays.minY[box], rays.minZ[box] };
+		const float boxMax[3] = { rays.maxX[box], rays.maxY[box], rays.maxZ[box] };
+		float tNear = 0.0f, tFar = 1e30f;
+		for (int i = 0; i < 3; ++i)
+		{
+			float t0 = (boxMin[i] - o[i]) / d[i];
+			float t1 = (boxMax[i] - o[i]) / d[i];
+			if (t0 > t1) { float swap = t0; t0 = t1; t1 = swap; }
+			if (t0 > tNear) tNear = t0;
+			if (t1 < tFar) tFar = t1;
+		}
+		return tNear <= tFar ? tNear : -1.0f;
+	}
+
+	void packetSphereEach()
+	{
+		M3DVector3f centre = { rays.cx[0], rays.cy[0], rays.cz[0] };
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f o = { rays.ox[i], rays.oy[i], rays.oz[i] };
+			M3DVector3f d = { rays.dx[i], rays.dy[i], rays.dz[i] };
+			rays.t[i] = m3dRaySphereTest(o, d, centre, rays.radius[0]);
+		}
+	}
+
+	void packetSphereBatch()
+	{
+		M3DVector3f centre = { rays.cx[0], rays.cy[0], rays.cz[0] };
+		for (int i = 0; i < BATCH_SIZE; i += rays.packetSize)
+		{
+			M3DRayPacket packet = { rays.ox + i, rays.oy + i, rays.oz + i,
+									rays.dx + i, rays.dy + i, rays.dz + i, rays.packetSize };
+			m3dRayPacketSphereTest(packet, centre, rays.radius[0], rays.t + i);
+		}
+	}
+
+	void packetBoxEach()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f o = { rays.ox[i], rays.oy[i], rays.oz[i] };
+			M3DVector3f d = { rays.dx[i], rays.dy[i], rays.dz[i] };
+			rays.t[i] = scalarSlab(o, d, 0);
+		}
+	}
+
+	void packetBoxBatch()
+	{
+		M3DVector3f boxMin = { rays.minX[0], rays.minY[0], rays.minZ[0] };
+		M3DVector3f boxMax = { rays.maxX[0], rays.maxY[0], rays.maxZ[0] };
+		for (int i = 0; i < BATCH_SIZE; i += rays.packetSize)
+		{
+			M3DRayPacket packet = { rays.ox + i, rays.oy + i, rays.oz + i,
+									rays.dx + i, rays.dy + i, rays.dz + i, rays.packetSize };
+			m3dRayPacketBoxTest(packet, boxMin, boxMax, rays.t + i);
+		}
+	}
+
+	void spheresEach()
+	{
+		M3DVector3f o = { rays.ox[0], rays.oy[0], rays.oz[0] };
+		M3DVector3f d = { rays.dx[0], rays.dy[0], rays.dz[0] };
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f centre = { rays.cx[i], rays.cy[i], rays.cz[i] };
+			rays.t[i] = m3dRaySphereTest(o, d, centre, rays.radius[i]);
+		}
+	}
+
+	void spheresBatch()
+	{
+		M3DVector3f o = { rays.ox[0], rays.oy[0], rays.oz[0] };
+		M3DVector3f d = { rays.dx[0], rays.dy[0], rays.dz[0] };
+		m3dRaySpheresTest(o, d, sphereArray(), rays.t);
+	}
+
+	void nearestSphereEach()
+	{
+		M3DVector3f o = { rays.ox[0], rays.oy[0], rays.oz[0] };
+		M3DVector3f d = { rays.dx[0], rays.dy[0], rays.dz[0] };
+		float best = 1e30f;
+		rays.nearest = -1;
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f centre = { rays.cx[i], rays.cy[i], rays.cz[i] };
+			float t = m3dRaySphereTest(o, d, centre, rays.radius[i]);
+			if (t > 0.0f && t < best)
+			{
+				best = t;
+				rays.nearest = i;
+			}
+		}
+	}
+
+	void nearestSphereBatch()
+	{
+		M3DVector3f o = { rays.ox[0], rays.oy[0], rays.oz[0] };
+		M3DVector3f d = { rays.dx[0], rays.dy[0], rays.dz[0] };
+		float t;
+		rays.nearest = m3dRayNearestSphere(o, d, sphereArray(), &t);
+	}
+
+	void boxesEach()
+	{
+		M3DVector3f o = { rays.ox[0], rays.oy[0], rays.oz[0] };
+		M3DVector3f d = { rays.dx[0], rays.dy[0], rays.dz[0] };
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			rays.t[i] = scalarSlab(o, d, i);
+	}
+
+	void boxesBatch()
+	{
+		M3DVector3f o = { rays.ox[0], rays.oy[0], rays.oz[0] };
+		M3DVector3f d = { rays.dx[0], rays.dy[0], rays.dz[0] };
+		m3dRayBoxesTest(o, d, boxArray(), rays.t);
+	}
+
+	/*
+		Name		runRayBenchmark
+		Syntax		runRayBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times the packet and many primitive ray tests against 
+					calling the scalar tests once a ray or primitive
+	*/
+	void runRayBenchmark(FILE* file)
+	{
+		fillRays();
+
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		fprintf(file, "test                     scalar tests/s    batch tests/s   speedup\n");
+
+		const int PACKET_SIZES[] = { 4, 8, 16 };
+		for (int i = 0; i < 3; ++i)
+		{
+			rays.packetSize = PACKET_SIZES[i];
+
+			char name[32];
+			double scalar = timeKernel(packetSphereEach, BATCH_SIZE);
+			double batched = timeKernel(packetSphereBatch, BATCH_SIZE);
+			_snprintf_s(name, sizeof(name), _TRUNCATE, "%d rays x sphere", rays.packetSize);
+			fprintf(file, "%-24s %15.0f %16.0f %8.2fx\n", name, scalar, batched, batched / scalar);
+
+			scalar = timeKernel(packetBoxEach, BATCH_SIZE);
+			batched = timeKernel(packetBoxBatch, BATCH_SIZE);
+			_snprintf_s(name, sizeof(name), _TRUNCATE, "%d rays x box", rays.packetSize);
+			fprintf(file, "%-24s %15.0f %16.0f %8.2fx\n", name, scalar, batched, batched / scalar);
+		}
+
+		const MathKernel RAY_KERNELS[] =
+		{
+			{ "ray x spheres",			spheresEach,		spheresBatch },
+			{ "ray x nearest sphere",	nearestSphereEach,	nearestSphereBatch },
+			{ "ray x boxes",			boxesEach,			boxesBatch }
+		};
+		for (int i = 0; i < 3; ++i)
+		{
+			double scalar = timeKernel(RAY_KERNELS[i].scalar, BATCH_SIZE);
+			double batched = timeKernel(RAY_KERNELS[i].simd, BATCH_SIZE);
+			fprintf(file, "%-24s %15.0f %16.0f %8.2fx\n", RAY_KERNELS[i].name,
+				scalar, batched, batched / scalar);
+		}
+		sink = rays.t[1] + (float)rays.nearest;
+	}
+
+	/*
+		Name		ApproxBatch
+		Syntax		ApproxBatch
+		Brief		Inputs and outputs of the approximation kernels
+	*/
+	struct ApproxBatch
+	{
+		float angles[BATCH_SIZE];
+		float x[BATCH_SIZE];
+		float y[BATCH_SIZE];
+		float exponents[BATCH_SIZE];
+		float positive[BATCH_SIZE];
+		float out[BATCH_SIZE];
+		float out2[BATCH_SIZE];
+	};
+
+	ApproxBatch approx;
+
+	void fillApprox()
+	{
+		srand(4);
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			approx.angles[i] = random() * 4.0f * (float)M3D_PI;
+			approx.x[i] = random();
+			approx.y[i] = random();
+			approx.exponents[i] = random() * 20.0f;
+			approx.positive[i] = (random() + 1.001f) * 50.0f;
+		}
+	}
+
+	void sinCosLibm()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			approx.out[i] = sinf(approx.angles[i]);
+			approx.out2[i] = cosf(approx.angles[i]);
+		}
+	}
+
+	void sinCosFast()
+	{
+		m3dFastSinCos(approx.angles, approx.out, approx.out2, BATCH_SIZE);
+	}
+
+	void atan2Libm()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			approx.out[i] = atan2f(approx.y[i], approx.x[i]);
+	}
+
+	void atan2Fast()
+	{
+		m3dFastAtan2(approx.y, approx.x, approx.out, BATCH_SIZE);
+	}
+
+	void expLibm()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			approx.out[i] = expf(approx.exponents[i]);
+	}
+
+	void expFast()
+	{
+		m3dFastExp(approx.exponents, approx.out, BATCH_SIZE);
+	}
+
+	void logLibm()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			approx.out[i] = logf(approx.positive[i]);
+	}
+
+	void logFast()
+	{
+		m3dFastLog(approx.positive, approx.out, BATCH_SIZE);
+	}
+
+	void rsqrtLibm()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			approx.out[i] = 1.0f / sqrtf(approx.positive[i]);
+	}
+
+	void rsqrtFast()
+	{
+		m3dFastRsqrt(approx.positive, approx.out, BATCH_SIZE);
+	}
+
+	/*
+		Name		ApproxError
+		Syntax		ApproxError
+		Brief		The largest absolute and relative errors seen
+	*/
+	struct ApproxError
+	{
+		ApproxError() : absolute(0.0), relative(0.0) {}
+
+		void add(float value, double exact)
+		{
+			double error = fabs((double)value - exact);
+			if (error > absolute)
+				absolute = error;
+			if (exact != 0.0 && error / fabs(exact) > relative)
+				relative = error / fabs(exact);
+		}
+
+		double absolute;
+		double relative;
+	};
+
+	/*
+		Name		writeAccuracy
+		Syntax		writeAccuracy(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Sweeps each approximation over its documented range and
+					writes the largest errors against the double precision C
+					library
+		Details		The sweeps go through the array versions, so the SIMD path
+					is the one checked when it is compiled in
+	*/
+	void writeAccuracy(FILE* file)
+	{
+		const int SAMPLES = 1 << 20;
+		std::vector<float> x(SAMPLES), y(SAMPLES), out(SAMPLES), out2(SAMPLES);
+		ApproxError sinError, cosError, atan2Error, expError, logError, logRangeError, rsqrtError;
+
+		for (int i = 0; i < SAMPLES; ++i)
+			x[i] = -8192.0f + 16384.0f * (float)i / (float)SAMPLES;
+		m3dFastSinCos(&x[0], &out[0], &out2[0], SAMPLES);
+		for (int i = 0; i < SAMPLES; ++i)
+		{
+			sinError.add(out[i], sin((double)x[i]));
+			cosError.add(out2[i], cos((double)x[i]));
+		}
+
+		// Circles of several radii, through every octant
+		for (int i = 0; i < SAMPLES; ++i)
+		{
+			double angle = M3D_2PI * (double)i / (double)SAMPLES;
+			float radius = 0.01f + (float)(i % 7);
+			x[i] = radius * (float)cos(angle);
+			y[i] = radius * (float)sin(angle);
+		}
+		m3dFastAtan2(&y[0], &x[0], &out[0], SAMPLES);
+		for (int i = 0; i < SAMPLES; ++i)
+			atan2Error.add(out[i], atan2((double)y[i], (double)x[i]));
+
+		for (int i = 0; i < SAMPLES; ++i)
+			x[i] = -87.0f + 175.0f * (float)i / (float)SAMPLES;
+		m3dFastExp(&x[0], &out[0], SAMPLES);
+		for (int i = 0; i < SAMPLES; ++i)
+			expError.add(out[i], exp((double)x[i]));
+
+		// Every mantissa of the binades from 2^-8 to 2^8, as the errors
+		// of log and rsqrt hang on the mantissa and on the exponent near
+		// one, and each binade holds only its own worst cases
+		const int MANTISSAS = 1 << 23;
+		std::vector<float> binade(MANTISSAS), logOut(MANTISSAS), rsqrtOut(MANTISSAS);
+		for (int e = -8; e < 8; ++e)
+		{
+			for (int i = 0; i < MANTISSAS; ++i)
+				binade[i] = ldexpf(1.0f + (float)i / (float)MANTISSAS, e);
+			m3dFastLog(&binade[0], &logOut[0], MANTISSAS);
+			m3dFastRsqrt(&binade[0], &rsqrtOut[0], MANTISSAS);
+			for (int i = 0; i < MANTISSAS; ++i)
+			{
+				if (e == -1 || e == 0)
+					logError.add(logOut[i], log((double)binade[i]));
+				else
+					logRangeError.add(logOut[i], log((double)binade[i]));
+				rsqrtError.add(rsqrtOut[i], 1.0 / sqrt((double)binade[i]));
+			}
+		}
+
+		// Mantissas across every normal exponent
+		for (int i = 0; i < SAMPLES; ++i)
+			x[i] = ldexpf(1.0f + (float)(i % 1024) / 1024.0f, (i / 1024) % 254 - 126);
+		m3dFastLog(&x[0], &out[0], SAMPLES);
+		m3dFastRsqrt(&x[0], &out2[0], SAMPLES);
+		for (int i = 0; i < SAMPLES; ++i)
+		{
+			if (x[i] < 0.5f || x[i] >= 2.0f)
+				logRangeError.add(out[i], log((double)x[i]));
+			rsqrtError.add(out2[i], 1.0 / sqrt((double)x[i]));
+		}
+
+		fprintf(file, "function   range                     max abs error   max rel error\n");
+		fprintf(file, "sin        -8192 to 8192             %13.2e\n", sinError.absolute);
+		fprintf(file, "cos        -8192 to 8192             %13.2e\n", cosError.absolute);
+		fprintf(file, "atan2      all angles                %13.2e\n", atan2Error.absolute);
+		fprintf(file, "exp        -87 to 88                 %13s %15.2e\n", "", expError.relative);
+		fprintf(file, "log        0.5 to 2                  %13.2e\n", logError.absolute);
+		fprintf(file, "log        FLT_MIN to FLT_MAX        %13s %15.2e\n", "", logRangeError.relative);
+		fprintf(file, "rsqrt      FLT_MIN to FLT_MAX        %13s %15.2e\n\n", "", rsqrtError.relative);
+	}
+
+	/*
+		Name		runApproxBenchmark
+		Syntax		runApproxBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Writes the accuracy of the fast approximations and times
+					them against the C library
+	*/
+	void runApproxBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		writeAccuracy(file);
+
+		fillApprox();
+		const MathKernel APPROX_KERNELS[] =
+		{
+			{ "sincos",		sinCosLibm,		sinCosFast },
+			{ "atan2",		atan2Libm,		atan2Fast },
+			{ "exp",		expLibm,		expFast },
+			{ "log",		logLibm,		logFast },
+			{ "rsqrt",		rsqrtLibm,		rsqrtFast }
+		};
+
+		fprintf(file, "function   C library ops/s       fast ops/s   speedup\n");
+		const int kernelsNo = sizeof(APPROX_KERNELS) / sizeof(APPROX_KERNELS[0]);
+		for (int i = 0; i < kernelsNo; ++i)
+		{
+			double libm = timeKernel(APPROX_KERNELS[i].scalar, BATCH_SIZE);
+			double fast = timeKernel(APPROX_KERNELS[i].simd, BATCH_SIZE);
+			fprintf(file, "%-10s %15.0f %16.0f %8.2fx\n", APPROX_KERNELS[i].name,
+				libm, fast, fast / libm);
+		}
+		sink = approx.out[1] + approx.out2[1];
+	}
+
+	/*
+		Name		CullBatch
+		Syntax		CullBatch
+		Brief		Volumes scattered around a frustum for the culling kernels
+	*/
+	struct CullBatch
+	{
+		M3DFrustum frustum;
+		float x[BATCH_SIZE], y[BATCH_SIZE], z[BATCH_SIZE], radius[BATCH_SIZE];
+		float minX[BATCH_SIZE], minY[BATCH_SIZE], minZ[BATCH_SIZE];
+		float maxX[BATCH_SIZE], maxY[BATCH_SIZE], maxZ[BATCH_SIZE];
+		float axes[3][3][BATCH_SIZE];
+		unsigned char visible[BATCH_SIZE];
+		int visibleNo;
+	};
+
+	CullBatch cull;
+
+	/*
+		Name		fillCull
+		Syntax		fillCull()
+		Brief		Builds a frustum looking down +z, as the camera's
+					projection does, with volumes all around it so that most
+					of them are culled, as in a scene seen from inside
+	*/
+	void fillCull()
+	{
+		const float zn = 1.0f, zf = 500.0f;
+		float scale = 1.0f / tanf((float)M3D_PI * 0.125f);
+		M3DMatrix44f projection = { scale, 0.0f, 0.0f, 0.0f,
+									0.0f, scale, 0.0f, 0.0f,
+									0.0f, 0.0f, zf / (zf - zn), 1.0f,
+									0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f };
+		m3dExtractFrustum(&cull.frustum, projection);
+
+		srand(5);
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			cull.x[i] = random() * 300.0f;
+			cull.y[i] = random() * 300.0f;
+			cull.z[i] = random() * 300.0f + 200.0f;
+			cull.radius[i] = 1.0f + (random() + 1.0f) * 5.0f;
+
+			cull.minX[i] = cull.x[i] - cull.radius[i];
+			cull.minY[i] = cull.y[i] - cull.radius[i];
+			cull.minZ[i] = cull.z[i] - cull.radius[i];
+			cull.maxX[i] = cull.x[i] + cull.radius[i];
+			cull.maxY[i] = cull.y[i] + cull.radius[i];
+			cull.maxZ[i] = cull.z[i] + cull.radius[i];
+
+			M3DMatrix33f rotation;
+			m3dRotationMatrix33(rotation, random() * (float)M3D_PI, random(), random(), random() + 2.0f);
+			for (int a = 0; a < 3; ++a)
+				for (int c = 0; c < 3; ++c)
+					cull.axes[a][c][i] = rotation[a * 3 + c];
+		}
+	}
+
+	M3DOrientedBoxArray orientedBoxArray(int first, int count)
+	{
+		M3DOrientedBoxArray boxes;
+		boxes.x = cull.x + first;
+		boxes.y = cull.y + first;
+		boxes.z = cull.z + first;
+		for (int a = 0; a < 3; ++a)
+		{
+			boxes.extent[a] = cull.radius + first;
+			for (int c = 0; c < 3; ++c)
+				boxes.axis[a][c] = cull.axes[a][c] + first;
+		}
+		boxes.count = count;
+		return boxes;
+	}
+
+	void cullSpheresEach()
+	{
+		cull.visibleNo = 0;
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f centre = { cull.x[i], cull.y[i], cull.z[i] };
+			cull.visible[i] = m3dSphereInFrustum(cull.frustum, centre, cull.radius[i]) ? 1 : 0;
+			cull.visibleNo += cull.visible[i];
+		}
+	}
+
+	void cullSpheresBatch()
+	{
+		M3DSphereArray spheres = { cull.x, cull.y, cull.z, cull.radius, BATCH_SIZE };
+		cull.visibleNo = m3dCullSpheres(cull.frustum, spheres, cull.visible);
+	}
+
+	void cullBoxesEach()
+	{
+		cull.visibleNo = 0;
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f boxMin = { cull.minX[i], cull.minY[i], cull.minZ[i] };
+			M3DVector3f boxMax = { cull.maxX[i], cull.maxY[i], cull.maxZ[i] };
+			unsigned int mask = M3D_CULL_ALL_PLANES;
+			cull.visible[i] = m3dCullBox(cull.frustum, boxMin, boxMax, &mask) != M3D_CULL_OUTSIDE;
+			cull.visibleNo += cull.visible[i];
+		}
+	}
+
+	void cullBoxesBatch()
+	{
+		M3DBoxArray boxes = { cull.minX, cull.minY, cull.minZ, cull.maxX, cull.maxY, cull.maxZ, BATCH_SIZE };
+		cull.visibleNo = m3dCullBoxes(cull.frustum, boxes, cull.visible);
+	}
+
+	void cullOrientedBoxesEach()
+	{
+		cull.visibleNo = 0;
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			cull.visibleNo += m3dCullOrientedBoxes(cull.frustum, orientedBoxArray(i, 1), cull.visible + i);
+	}
+
+	void cullOrientedBoxesBatch()
+	{
+		cull.visibleNo = m3dCullOrientedBoxes(cull.frustum, orientedBoxArray(0, BATCH_SIZE), cull.visible);
+	}
+
+	/*
+		Name		runCullBenchmark
+		Syntax		runCullBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times culling volumes one at a time against the batches,
+					and reports the time to cull a batch and how many it culled
+	*/
+	void runCullBenchmark(FILE* file)
+	{
+		fillCull();
+
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		fprintf(file, "volumes             one at a time/s      batched/s   speedup   us/%d   culled\n", BATCH_SIZE);
+
+		const MathKernel CULL_KERNELS[] =
+		{
+			{ "spheres",		cullSpheresEach,		cullSpheresBatch },
+			{ "boxes",			cullBoxesEach,			cullBoxesBatch },
+			{ "oriented boxes",	cullOrientedBoxesEach,	cullOrientedBoxesBatch }
+		};
+		const int kernelsNo = sizeof(CULL_KERNELS) / sizeof(CULL_KERNELS[0]);
+		for (int i = 0; i < kernelsNo; ++i)
+		{
+			double each = timeKernel(CULL_KERNELS[i].scalar, BATCH_SIZE);
+			double batched = timeKernel(CULL_KERNELS[i].simd, BATCH_SIZE);
+			double culled = 100.0 * (BATCH_SIZE - cull.visibleNo) / BATCH_SIZE;
+			fprintf(file, "%-16s %17.0f %14.0f %8.2fx %9.2f %7.1f%%\n", CULL_KERNELS[i].name,
+				each, batched, batched / each, BATCH_SIZE * 1000000.0 / batched, culled);
+		}
+		sink = (float)cull.visibleNo;
+	}
+
+	const int BVH_QUERIES = 1000;	// Rays and points per query pass
+
+	/*
+		Name		BvhBatch
+		Syntax		BvhBatch
+		Brief		Boxes scattered over a wide flat world, as objects on the
+					terrain would be, with the tree built over them
+	*/
+	struct BvhBatch
+	{
+		std::vector<float> bounds[6];	// min x, y, z and max x, y, z
+		std::vector<float> queries[6];	// Origins and directions of the rays
+		std::vector<int> items;
+		std::vector<unsigned char> visible;
+		M3DFrustum frustum;
+		M3DBVH bvh;
+		int size;
+		int found;
+	};
+
+	BvhBatch bvhBatch;
+
+	M3DBoxArray bvhBoxes()
+	{
+		M3DBoxArray boxes = { &bvhBatch.bounds[0][0], &bvhBatch.bounds[1][0], &bvhBatch.bounds[2][0],
+							  &bvhBatch.bounds[3][0], &bvhBatch.bounds[4][0], &bvhBatch.bounds[5][0],
+							  bvhBatch.size };
+		return boxes;
+	}
+
+	/*
+		Name		fillBvh
+		Syntax		fillBvh(int size)
+		Param		int size - Number of boxes
+		Brief		Scatters the boxes at a constant density, so the queries
+					do the same work near the camera at every size
+	*/
+	void fillBvh(int size)
+	{
+		srand(6);
+		bvhBatch.size = size;
+		float spread = sqrtf((float)size) * 10.0f;
+		for (int i = 0; i < 6; ++i)
+			bvhBatch.bounds[i].resize(size);
+		for (int i = 0; i < size; ++i)
+		{
+			float x = random() * spread, y = random() * 20.0f, z = random() * spread;
+			float half = 0.5f + (random() + 1.0f) * 2.0f;
+			bvhBatch.bounds[0][i] = x - half;
+			bvhBatch.bounds[1][i] = y - half;
+			bvhBatch.bounds[2][i] = z - half;
+			bvhBatch.bounds[3][i] = x + half;
+			bvhBatch.bounds[4][i] = y + half;
+			bvhBatch.bounds[5][i] = z + half;
+		}
+		bvhBatch.items.resize(size);
+		bvhBatch.visible.resize(size);
+
+		// Rays from near the middle, roughly level
+		for (int i = 0; i < 6; ++i)
+			bvhBatch.queries[i].resize(BVH_QUERIES);
+		for (int i = 0; i < BVH_QUERIES; ++i)
+		{
+			M3DVector3f dir = { random(), random() * 0.1f, random() };
+			m3dNormalizeVector3(dir);
+			bvhBatch.queries[0][i] = random() * 100.0f;
+			bvhBatch.queries[1][i] = random() * 20.0f;
+			bvhBatch.queries[2][i] = random() * 100.0f;
+			bvhBatch.queries[3][i] = dir[0];
+			bvhBatch.queries[4][i] = dir[1];
+			bvhBatch.queries[5][i] = dir[2];
+		}
+
+		// The camera's frustum, 5000 deep, looking along +z from the middle
+		const float zn = 1.0f, zf = 5000.0f;
+		float scale = 1.0f / tanf((float)M3D_PI * 0.125f);
+		M3DMatrix44f projection = { scale, 0.0f, 0.0f, 0.0f,
+									0.0f, scale, 0.0f, 0.0f,
+									0.0f, 0.0f, zf / (zf - zn), 1.0f,
+									0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f };
+		m3dExtractFrustum(&bvhBatch.frustum, projection);
+	}
+
+	void bvhBuild()
+	{
+		bvhBatch.bvh.build(bvhBoxes());
+	}
+
+	// Moves every box a little, as objects do from one frame to the next
+	void bvhRefit()
+	{
+		for (int i = 0; i < bvhBatch.size; ++i)
+		{
+			float dx = (i & 1) ? 0.01f : -0.01f;
+			bvhBatch.bounds[0][i] += dx;
+			bvhBatch.bounds[3][i] += dx;
+		}
+		bvhBatch.bvh.refit(bvhBoxes());
+	}
+
+	void bvhFrustum()
+	{
+		bvhBatch.found = bvhBatch.bvh.cullFrustum(bvhBatch.frustum, &bvhBatch.items[0]);
+	}
+
+	void flatFrustum()
+	{
+		bvhBatch.found = m3dCullBoxes(bvhBatch.frustum, bvhBoxes(), &bvhBatch.visible[0]);
+	}
+
+	void bvhRays()
+	{
+		bvhBatch.found = 0;
+		for (int i = 0; i < BVH_QUERIES; ++i)
+		{
+			M3DVector3f origin = { bvhBatch.queries[0][i], bvhBatch.queries[1][i], bvhBatch.queries[2][i] };
+			M3DVector3f dir = { bvhBatch.queries[3][i], bvhBatch.queries[4][i], bvhBatch.queries[5][i] };
+			float t;
+			bvhBatch.found += bvhBatch.bvh.rayCast(origin, dir, &t) >= 0;
+		}
+	}
+
+	void flatRays()
+	{
+		bvhBatch.found = 0;
+		for (int i = 0; i < BVH_QUERIES; ++i)
+		{
+			M3DVector3f origin = { bvhBatch.queries[0][i], bvhBatch.queries[1][i], bvhBatch.queries[2][i] };
+			M3DVector3f dir = { bvhBatch.queries[3][i], bvhBatch.queries[4][i], bvhBatch.queries[5][i] };
+			float t;
+			bvhBatch.found += m3dRayNearestBox(origin, dir, bvhBoxes(), &t) >= 0;
+		}
+	}
+
+	void bvhNearest()
+	{
+		bvhBatch.found = 0;
+		for (int i = 0; i < BVH_QUERIES; ++i)
+		{
+			M3DVector3f point = { bvhBatch.queries[0][i], bvhBatch.queries[1][i], bvhBatch.queries[2][i] };
+			float distance;
+			bvhBatch.found += bvhBatch.bvh.nearest(point, &distance);
+		}
+	}
+
+	/*
+		Name		runBvhBenchmark
+		Syntax		runBvhBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times building, refitting and querying the hierarchy at
+					1k to 1M boxes, with the frustum and ray queries also
+					timed over the flat arrays for comparison
+	*/
+	void runBvhBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		fprintf(file, "boxes      nodes   build ms   refit ms  frustum us    flat us   in view"
+					  "    ray us  flat ray us  nearest us\n");
+
+		const int SIZES[] = { 1000, 10000, 100000, 1000000 };
+		for (int s = 0; s < 4; ++s)
+		{
+			fillBvh(SIZES[s]);
+
+			double build = 1000.0 / timeKernel(bvhBuild, 1);
+			double refit = 1000.0 / timeKernel(bvhRefit, 1);
+			double frustum = 1000000.0 / timeKernel(bvhFrustum, 1);
+			int inView = bvhBatch.found;
+			double flat = 1000000.0 / timeKernel(flatFrustum, 1);
+			double ray = 1000000.0 / timeKernel(bvhRays, BVH_QUERIES);
+			double flatRay = 1000000.0 / timeKernel(flatRays, BVH_QUERIES);
+			double nearest = 1000000.0 / timeKernel(bvhNearest, BVH_QUERIES);
+
+			fprintf(file, "%-8d %7d %10.3f %10.3f %11.2f %10.2f %9d %9.3f %12.3f %11.3f\n",
+				SIZES[s], bvhBatch.bvh.getNodesNo(), build, refit, frustum, flat, inView,
+				ray, flatRay, nearest);
+		}
+
+		sink = (float)bvhBatch.found;
+		bvhBatch.bvh.clear();
+		for (int i = 0; i < 6; ++i)
+			std::vector<float>().swap(bvhBatch.bounds[i]);
+		std::vector<int>().swap(bvhBatch.items);
+		std::vector<unsigned char>().swap(bvhBatch.visible);
+	}
+
+	const int OCCLUSION_GRID = 257;			// Heights along each side of the hills
+	const int OCCLUSION_STEP = 8;			// Heights between occluder vertices
+	const float OCCLUSION_SPACING = 8.0f;	// World units between heights
+	const int OCCLUSION_TREES = 4096;
+	const int OCCLUSION_VIEWS = 8;
+
+	/*
+		Name		OcclusionBatch
+		Syntax		OcclusionBatch
+		Brief		Rolling hills covered in trees, seen from eye height at
+					several places and headings
+	*/
+	struct OcclusionBatch
+	{
+		std::vector<float> heights;
+		std::vector<float> vertices;		// Occluder mesh, below the hills
+		std::vector<UINT> indices;
+		std::vector<float> bounds[6];		// Tree boxes, min x, y, z and max x, y, z
+		std::vector<unsigned char> inFrustum[OCCLUSION_VIEWS];
+		M3DMatrix44f viewProj[OCCLUSION_VIEWS];
+		M3DMatrix44f world;
+		OcclusionBuffer buffer;
+		int view;
+		int tested;
+		int occluded;
+	};
+
+	OcclusionBatch occlusion;
+
+	float hillHeight(float x, float z)
+	{
+		return 60.0f * sinf(x * 0.004f) * cosf(z * 0.005f) + 25.0f * sinf(x * 0.013f + z * 0.011f) +
+			   8.0f * cosf(x * 0.031f - z * 0.027f);
+	}
+
+	/*
+		Name		fillOcclusion
+		Syntax		fillOcclusion()
+		Brief		Makes the hills, their occluder mesh, the trees and the
+					views
+		Details		Each occluder vertex takes the lowest height within a step
+					of it, so that the coarse mesh stays under the hills, as
+					the terrain's does
+	*/
+	void fillOcclusion()
+	{
+		const int n = OCCLUSION_GRID;
+		occlusion.heights.resize(n * n);
+		for (int j = 0; j < n; ++j)
+		{
+			for (int i = 0; i < n; ++i)
+				occlusion.heights[j * n + i] = hillHeight(i * OCCLUSION_SPACING, j * OCCLUSION_SPACING);
+		}
+
+		const int coarse = (n - 1) / OCCLUSION_STEP + 1;
+		occlusion.vertices.clear();
+		occlusion.indices.clear();
+		for (int cj = 0; cj < coarse; ++cj)
+		{
+			for (int ci = 0; ci < coarse; ++ci)
+			{
+				int i = ci * OCCLUSION_STEP, j = cj * OCCLUSION_STEP;
+				float lowest = occlusion.heights[j * n + i];
+				for (int y = max(j - OCCLUSION_STEP, 0); y <= min(j + OCCLUSION_STEP, n - 1); ++y)
+				{
+					for (int x = max(i - OCCLUSION_STEP, 0); x <= min(i + OCCLUSION_STEP, n - 1); ++x)
+						lowest = min(lowest, occlusion.heights[y * n + x]);
+				}
+				occlusion.vertices.push_back(i * OCCLUSION_SPACING);
+				occlusion.vertices.push_back(lowest);
+				occlusion.vertices.push_back(j * OCCLUSION_SPACING);
+			}
+		}
+		for (int cj = 0; cj < coarse - 1; ++cj)
+		{
+			for (int ci = 0; ci < coarse - 1; ++ci)
+			{
+				UINT v = cj * coarse + ci;
+				UINT quad[6] = { v, v + coarse, v + 1, v + 1, v + coarse, v + coarse + 1 };
+				occlusion.indices.insert(occlusion.indices.end(), quad, quad + 6);
+			}
+		}
+		m3dLoadIdentity44(occlusion.world);
+
+		srand(7);
+		float size = (n - 1) * OCCLUSION_SPACING;
+		for (int i = 0; i < 6; ++i)
+			occlusion.bounds[i].resize(OCCLUSION_TREES);
+		for (int t = 0; t < OCCLUSION_TREES; ++t)
+		{
+			float x = (random() + 1.0f) * 0.5f * size, z = (random() + 1.0f) * 0.5f * size;
+			float y = hillHeight(x, z);
+			occlusion.bounds[0][t] = x - 4.0f;
+			occlusion.bounds[1][t] = y - 1.0f;
+			occlusion.bounds[2][t] = z - 4.0f;
+			occlusion.bounds[3][t] = x + 4.0f;
+			occlusion.bounds[4][t] = y + 20.0f;
+			occlusion.bounds[5][t] = z + 4.0f;
+		}
+		M3DBoxArray trees = { &occlusion.bounds[0][0], &occlusion.bounds[1][0], &occlusion.bounds[2][0],
+							  &occlusion.bounds[3][0], &occlusion.bounds[4][0], &occlusion.bounds[5][0],
+							  OCCLUSION_TREES };
+
+		// The scene's projection, from eye height at points around the
+		// middle of the hills, looking out level
+		const float zn = 1.0f, zf = 5000.0f, aspect = 4.0f / 3.0f;
+		float scale = 1.0f / tanf((float)M3D_PI * 0.125f);
+		M3DMatrix44f projection = { scale / aspect, 0.0f, 0.0f, 0.0f,
+									0.0f, scale, 0.0f, 0.0f,
+									0.0f, 0.0f, zf / (zf - zn), 1.0f,
+									0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f };
+		for (int v = 0; v < OCCLUSION_VIEWS; ++v)
+		{
+			float heading = (float)M3D_PI * 2.0f * v / OCCLUSION_VIEWS;
+			M3DVector3f eye = { size * (0.5f + 0.15f * cosf(heading * 3.0f)), 0.0f,
+								size * (0.5f + 0.15f * sinf(heading * 3.0f)) };
+			eye[1] = hillHeight(eye[0], eye[2]) + 10.0f;
+
+			// Left handed look along the heading, tipped a little down
+			M3DVector3f front = { sinf(heading), -0.05f, cosf(heading) };
+			M3DVector3f up = { 0.0f, 1.0f, 0.0f };
+			M3DVector3f right, top;
+			m3dNormalizeVector3(front);
+			m3dCrossProduct3(right, up, front);
+			m3dNormalizeVector3(right);
+			m3dCrossProduct3(top, front, right);
+			M3DMatrix44f view = { right[0], top[0], front[0], 0.0f,
+								  right[1], top[1], front[1], 0.0f,
+								  right[2], top[2], front[2], 0.0f,
+								  -m3dDotProduct3(right, eye), -m3dDotProduct3(top, eye),
+								  -m3dDotProduct3(front, eye), 1.0f };
+			m3dMatrixMultiply44(occlusion.viewProj[v], projection, view);
+
+			M3DFrustum frustum;
+			m3dExtractFrustum(&frustum, occlusion.viewProj[v]);
+			occlusion.inFrustum[v].resize(OCCLUSION_TREES);
+			m3dCullBoxes(frustum, trees, &occlusion.inFrustum[v][0]);
+		}
+	}
+
+	// Draws the occluders of the next view
+	void occlusionRaster()
+	{
+		occlusion.view = (occlusion.view + 1) % OCCLUSION_VIEWS;
+		occlusion.buffer.begin(occlusion.viewProj[occlusion.view]);
+		occlusion.buffer.addOccluders(&occlusion.vertices[0], (int)occlusion.vertices.size() / 3,
+									  &occlusion.indices[0], (int)occlusion.indices.size(),
+									  occlusion.world);
+		occlusion.buffer.rasterise();
+	}
+
+	// Tests the trees in the frustum of the view last drawn
+	void occlusionTest()
+	{
+		const std::vector<unsigned char>& inFrustum = occlusion.inFrustum[occlusion.view];
+		occlusion.tested = 0;
+		occlusion.occluded = 0;
+		for (int t = 0; t < OCCLUSION_TREES; ++t)
+		{
+			if (!inFrustum[t])
+				continue;
+
+			M3DVector3f boxMin = { occlusion.bounds[0][t], occlusion.bounds[1][t], occlusion.bounds[2][t] };
+			M3DVector3f boxMax = { occlusion.bounds[3][t], occlusion.bounds[4][t], occlusion.bounds[5][t] };
+			++occlusion.tested;
+			occlusion.occluded += !occlusion.buffer.isVisible(boxMin, boxMax);
+		}
+	}
+
+	/*
+		Name		runOcclusionBenchmark
+		Syntax		runOcclusionBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times rasterising the hills into the occlusion buffer with
+					one to eight threads, and testing the trees in view
+					against it, and reports how many of them it hides
+	*/
+	void runOcclusionBenchmark(FILE* file)
+	{
+		fillOcclusion();
+
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		fprintf(file, "buffer             %dx%d, %d tiles\n", OcclusionBuffer::WIDTH,
+				OcclusionBuffer::HEIGHT, OcclusionBuffer::TILES_NO);
+		fprintf(file, "occluders          %d triangles\n", (int)occlusion.indices.size() / 3);
+
+		// The occluded fraction of each view, and over them all
+		fprintf(file, "\nview   drawn triangles   trees in view   occluded\n");
+		occlusion.buffer.initialise(1);
+		int tested = 0, occluded = 0;
+		occlusion.view = OCCLUSION_VIEWS - 1;
+		for (int v = 0; v < OCCLUSION_VIEWS; ++v)
+		{
+			occlusionRaster();
+			occlusionTest();
+			tested += occlusion.tested;
+			occluded += occlusion.occluded;
+			fprintf(file, "%-6d %15d %15d %9.1f%%\n", v, occlusion.buffer.getTrianglesNo(),
+					occlusion.tested, occlusion.tested ? 100.0 * occlusion.occluded / occlusion.tested : 0.0);
+		}
+		fprintf(file, "all    %15s %15d %9.1f%%\n", "", tested, tested ? 100.0 * occluded / tested : 0.0);
+		double test = 1000000000.0 / timeKernel(occlusionTest, max(occlusion.tested, 1));
+		fprintf(file, "\ntest ns/box        %.1f\n", test);
+
+		fprintf(file, "\nthreads   raster us/frame   speedup\n");
+		double single = 0.0;
+		const int THREADS[] = { 1, 2, 4, 8 };
+		for (int i = 0; i < 4; ++i)
+		{
+			occlusion.buffer.initialise(THREADS[i]);
+			double us = 1000000.0 / timeKernel(occlusionRaster, 1);
+			if (i == 0)
+				single = us;
+			fprintf(file, "%-9d %15.1f %8.2fx\n", occlusion.buffer.getThreadsNo(), us, single / us);
+		}
+
+		sink = (float)occluded;
+		occlusion.buffer.deinitialise();
+	}
+
+	const int CASCADES_NO = 4;
+	const int CASCADE_RESOLUTION = 1024;
+	const int CASCADE_FRAMES = 3600;		// A minute's flight at 60 frames a second
+	const float CASCADE_NEAR = 1.0f;
+	const float CASCADE_FAR = 1000.0f;
+
+	/*
+		Name		CascadeBatch
+		Syntax		CascadeBatch
+		Brief		A camera flight over a minute of frames, with the sun
+					moving once half way
+	*/
+	struct CascadeBatch
+	{
+		std::vector<float> eyes;			// x, y and z of each frame
+		std::vector<float> forwards;
+		std::vector<float> lights;
+		M3DCascadeSet set;
+		M3DCascade cascade;
+		int frame;
+		int dirty;
+	};
+
+	CascadeBatch cascades;
+
+	const float CASCADE_TAN_HALF_FOV = 0.41421356f;	// A quarter turn field of view
+	const float CASCADE_ASPECT = 4.0f / 3.0f;
+
+	/*
+		Name		fillCascades
+		Syntax		fillCascades()
+		Brief		Makes the flight: forwards at walking to running pace
+					while slowly weaving from side to side and looking
+					about
+	*/
+	void fillCascades()
+	{
+		cascades.eyes.resize(CASCADE_FRAMES * 3);
+		cascades.forwards.resize(CASCADE_FRAMES * 3);
+		cascades.lights.resize(CASCADE_FRAMES * 3);
+
+		M3DVector3f eye = { 0.0f, 10.0f, 0.0f };
+		for (int f = 0; f < CASCADE_FRAMES; ++f)
+		{
+			float t = f / 60.0f;
+			float heading = 0.6f * sinf(t * 0.2f) + 0.3f * sinf(t * 1.1f);
+			float speed = 6.0f + 4.0f * sinf(t * 0.35f);
+			eye[0] += sinf(heading) * speed / 60.0f;
+			eye[2] += cosf(heading) * speed / 60.0f;
+			eye[1] = 10.0f + 3.0f * sinf(t * 0.5f);
+
+			M3DVector3f forward = { sinf(heading), -0.1f + 0.05f * sinf(t * 0.7f), cosf(heading) };
+			m3dNormalizeVector3(forward);
+
+			M3DVector3f light = { 0.05f, -1.0f, 0.45f };
+			if (f >= CASCADE_FRAMES / 2)
+				light[0] = 0.1f;
+			m3dNormalizeVector3(light);
+
+			for (int i = 0; i < 3; ++i)
+			{
+				cascades.eyes[f * 3 + i] = eye[i];
+				cascades.forwards[f * 3 + i] = forward[i];
+				cascades.lights[f * 3 + i] = light[i];
+			}
+		}
+	}
+
+	// Fits one cascade to the far slice of the next frame
+	void fitCascade()
+	{
+		cascades.frame = (cascades.frame + 1) % CASCADE_FRAMES;
+		int f = cascades.frame * 3;
+		m3dFitCascade(&cascades.cascade, &cascades.eyes[f], &cascades.forwards[f],
+					  CASCADE_TAN_HALF_FOV, CASCADE_ASPECT, 250.0f, CASCADE_FAR,
+					  &cascades.lights[f], CASCADE_RESOLUTION, 200.0f, 1.0f);
+		sink += cascades.cascade.viewProj[12];
+	}
+
+	// Updates the set of cascades for the next frame
+	void updateCascades()
+	{
+		cascades.frame = (cascades.frame + 1) % CASCADE_FRAMES;
+		int f = cascades.frame * 3;
+		cascades.dirty += m3dUpdateCascades(&cascades.set, &cascades.eyes[f], &cascades.forwards[f],
+											CASCADE_TAN_HALF_FOV, CASCADE_ASPECT, CASCADE_NEAR,
+											CASCADE_FAR, &cascades.lights[f]);
+	}
+
+	/*
+		Name		cascadeSnapError
+		Syntax		cascadeSnapError(const M3DCascade& cascade)
+		Param		const M3DCascade& cascade - A fitted cascade
+		Return		float - How far, in texels, the world origin lies from
+					the texel grid it had when it was on a texel corner
+		Brief		Is zero when the cascade only ever moves in whole texels
+	*/
+	float cascadeSnapError(const M3DCascade& cascade)
+	{
+		// The origin's shadow map position, in texels from the map's corner
+		float u = (cascade.viewProj[12] * 0.5f + 0.5f) * CASCADE_RESOLUTION;
+		float v = (cascade.viewProj[13] * 0.5f + 0.5f) * CASCADE_RESOLUTION;
+		float du = fabsf(u - floorf(u + 0.5f));
+		float dv = fabsf(v - floorf(v + 0.5f));
+		return max(du, dv);
+	}
+
+	/*
+		Name		runCascadeBenchmark
+		Syntax		runCascadeBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Reports the cascade splits and texel sizes, times fitting
+					them, checks they are stable as the camera moves and
+					turns, and counts the shadow maps drawn a frame over a
+					flight with none, two and three cascades cached
+	*/
+	void runCascadeBenchmark(FILE* file)
+	{
+		fillCascades();
+
+		fprintf(file, "cascades           %d of %dx%d, depths %.0f to %.0f\n", CASCADES_NO,
+				CASCADE_RESOLUTION, CASCADE_RESOLUTION, CASCADE_NEAR, CASCADE_FAR);
+		fprintf(file, "frames             %d\n", CASCADE_FRAMES);
+
+		// The slices with two cached, as the states use them
+		m3dInitCascades(&cascades.set, CASCADES_NO, CASCADE_RESOLUTION, 2);
+		cascades.frame = -1;
+		updateCascades();
+		fprintf(file, "\ncascade   near      far     radius   texel   cached\n");
+		for (int i = 0; i < CASCADES_NO; ++i)
+		{
+			const M3DCascade& c = cascades.set.cascades[i];
+			fprintf(file, "%-9d %-9.1f %-7.1f %7.1f %7.3f   %s\n", i, c.splitNear, c.splitFar,
+					c.radius, c.texelSize, i >= cascades.set.cachedFrom ? "yes" : "no");
+		}
+
+		// Sphere fitting keeps the texel size as the camera turns, and
+		// snapping keeps the grid as it moves
+		float radiusChange = 0.0f, snapError = 0.0f;
+		float firstRadius = 0.0f;
+		for (int f = 0; f < CASCADE_FRAMES; ++f)
+		{
+			fitCascade();
+			if (f == 0)
+				firstRadius = cascades.cascade.radius;
+			radiusChange = max(radiusChange, fabsf(cascades.cascade.radius - firstRadius));
+			snapError = max(snapError, cascadeSnapError(cascades.cascade));
+		}
+		fprintf(file, "\nradius change      %.6f\n", radiusChange);
+		fprintf(file, "snap error texels  %.4f\n", snapError);
+
+		double fit = 1000000000.0 / timeKernel(fitCascade, 1);
+		cascades.frame = -1;
+		double update = 1000000000.0 / timeKernel(updateCascades, 1);
+		fprintf(file, "\nfit ns/cascade     %.1f\n", fit);
+		fprintf(file, "update ns/frame    %.1f\n", update);
+
+		// Shadow maps drawn over the flight
+		fprintf(file, "\ncached   drawn/frame   drawn by cascade\n");
+		for (int cachedFrom = CASCADES_NO; cachedFrom >= 1; --cachedFrom)
+		{
+			m3dInitCascades(&cascades.set, CASCADES_NO, CASCADE_RESOLUTION, cachedFrom);
+			int drawn[M3D_MAX_CASCADES] = { 0 };
+			cascades.frame = -1;
+			cascades.dirty = 0;
+			for (int f = 0; f < CASCADE_FRAMES; ++f)
+			{
+				updateCascades();
+				for (int i = 0; i < CASCADES_NO; ++i)
+					drawn[i] += cascades.set.dirty[i] ? 1 : 0;
+			}
+
+			fprintf(file, "%-8d %11.2f  ", CASCADES_NO - cachedFrom,
+					(double)cascades.dirty / CASCADE_FRAMES);
+			for (int i = 0; i < CASCADES_NO; ++i)
+				fprintf(file, " %6d", drawn[i]);
+			fprintf(file, "\n");
+		}
+	}
+
+	const int SORT_THREADS = 4;
+	const int SORT_FRAMES = 3;			// The first, then drifted, and turned
+
+	/*
+		Name		SortBatch
+		Syntax		SortBatch
+		Brief		Snow filling a box ahead of the camera, at two frames a
+					sixtieth of a second apart
+	*/
+	struct SortBatch
+	{
+		std::vector<float> x[SORT_FRAMES];
+		std::vector<float> y[SORT_FRAMES];
+		std::vector<float> z[SORT_FRAMES];
+		M3DVector3f eye[SORT_FRAMES];
+		M3DVector3f forward[SORT_FRAMES];
+		std::vector<float> depth;
+		std::vector<UINT> order;
+		ParticleSorter sorter;
+		int count;
+		int next;						// Frame sorted against the first
+		int frame;
+		int sorts;
+		int incremental;				// Sorts finished by insertion
+	};
+
+	SortBatch sortBatch;
+
+	/*
+		Name		fillSort
+		Syntax		fillSort(int count)
+		Param		int count - Number of particles
+		Brief		Scatters the flakes through a box 400 units across, then
+					makes the next frame twice: once with them drifting a
+					little as the camera moves on, and once with the camera
+					also turning a fifth of a degree
+	*/
+	void fillSort(int count)
+	{
+		sortBatch.count = count;
+		for (int f = 0; f < SORT_FRAMES; ++f)
+		{
+			sortBatch.x[f].resize(count);
+			sortBatch.y[f].resize(count);
+			sortBatch.z[f].resize(count);
+		}
+		for (int i = 0; i < count; ++i)
+		{
+			sortBatch.x[0][i] = random() * 200.0f;
+			sortBatch.y[0][i] = random() * 200.0f;
+			sortBatch.z[0][i] = random() * 200.0f + 200.0f;
+			for (int f = 1; f < SORT_FRAMES; ++f)
+			{
+				sortBatch.x[f][i] = sortBatch.x[0][i] + random() * 0.001f;
+				sortBatch.y[f][i] = sortBatch.y[0][i] - 0.1f;
+				sortBatch.z[f][i] = sortBatch.z[0][i] + random() * 0.001f;
+			}
+		}
+
+		for (int f = 0; f < SORT_FRAMES; ++f)
+		{
+			m3dLoadVector3(sortBatch.eye[f], 0.0f, 0.0f, f ? 0.15f : 0.0f);
+			m3dLoadVector3(sortBatch.forward[f], 0.0f, 0.0f, 1.0f);
+		}
+		m3dLoadVector3(sortBatch.forward[2], sinf(0.003f), 0.0f, cosf(0.003f));
+		sortBatch.depth.resize(count);
+		sortBatch.order.resize(count);
+		sortBatch.frame = 0;
+	}
+
+	/*
+		Name		DeeperFirst
+		Syntax		DeeperFirst
+		Brief		Orders particle indices by their depth, deepest first
+	*/
+	struct DeeperFirst
+	{
+		DeeperFirst(const std::vector<float>& depth) : depth(depth) {}
+		bool operator()(UINT a, UINT b) const { return depth[a] > depth[b]; }
+		const std::vector<float>& depth;
+	};
+
+	// Sorts the first frame afresh with std::sort on the depths
+	void sortLibrary()
+	{
+		const M3DVector3f& e = sortBatch.eye[0];
+		const M3DVector3f& f = sortBatch.forward[0];
+		for (int i = 0; i < sortBatch.count; ++i)
+		{
+			sortBatch.depth[i] = (sortBatch.x[0][i] - e[0]) * f[0] + (sortBatch.y[0][i] - e[1]) * f[1] +
+								 (sortBatch.z[0][i] - e[2]) * f[2];
+			sortBatch.order[i] = (UINT)i;
+		}
+		std::sort(sortBatch.order.begin(), sortBatch.order.end(), DeeperFirst(sortBatch.depth));
+		sink += (float)sortBatch.order[0];
+	}
+
+	// Sorts the first frame afresh with the radix sort
+	void sortRadix()
+	{
+		sortBatch.sorter.reset();
+		sortBatch.sorter.sort(&sortBatch.x[0][0], &sortBatch.y[0][0], &sortBatch.z[0][0],
+							  sortBatch.count, sortBatch.eye[0], sortBatch.forward[0]);
+		sink += (float)sortBatch.sorter.getOrder()[0];
+	}
+
+	// Sorts the first frame and the next in turn, each from the other's order
+	void sortCoherent()
+	{
+		int f = sortBatch.frame = sortBatch.frame ? 0 : sortBatch.next;
+		sortBatch.sorter.sort(&sortBatch.x[f][0], &sortBatch.y[f][0], &sortBatch.z[f][0],
+							  sortBatch.count, sortBatch.eye[f], sortBatch.forward[f]);
+		++sortBatch.sorts;
+		sortBatch.incremental += sortBatch.sorter.wasIncremental() ? 1 : 0;
+		sink += (float)sortBatch.sorter.getOrder()[0];
+	}
+
+	/*
+		Name		timeCoherent
+		Syntax		timeCoherent(int next, double* incremental)
+		Param		int next - The frame to sort in turn with the first
+		Param		double* incremental - Receives the share of sorts
+					finished by insertion
+		Return		double - Milliseconds a sort
+	*/
+	double timeCoherent(int next, double* incremental)
+	{
+		// Start from a sorted frame, as every frame after the first would
+		sortBatch.next = next;
+		sortBatch.frame = next;
+		sortBatch.sorter.reset();
+		sortCoherent();
+		sortBatch.sorts = 0;
+		sortBatch.incremental = 0;
+		double ms = 1000.0 / timeKernel(sortCoherent, 1);
+		*incremental = 100.0 * sortBatch.incremental / max(sortBatch.sorts, 1);
+		return ms;
+	}
+
+	/*
+		Name		sortIsOrdered
+		Syntax		sortIsOrdered(int frame)
+		Param		int frame - The frame last sorted
+		Return		bool - True if the sorter's order is deepest first
+	*/
+	bool sortIsOrdered(int frame)
+	{
+		const UINT* order = sortBatch.sorter.getOrder();
+		const M3DVector3f& e = sortBatch.eye[frame];
+		const M3DVector3f& f = sortBatch.forward[frame];
+		float last = FLT_MAX;
+		for (int i = 0; i < sortBatch.count; ++i)
+		{
+			UINT p = order[i];
+			float depth = sortBatch.x[frame][p] * f[0] + sortBatch.y[frame][p] * f[1] +
+						  sortBatch.z[frame][p] * f[2] - m3dDotProduct3(e, f);
+			if (depth > last)
+				return false;
+			last = depth;
+		}
+		return true;
+	}
+
+	/*
+		Name		runSortBenchmark
+		Syntax		runSortBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Times sorting 50k, 500k and 5M particles back to front with
+					std::sort, with the radix sort on one thread and on four,
+					and from the last frame's order as the particles drift or
+					the camera turns, and checks the orders
+	*/
+	void runSortBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		fprintf(file, "radix              %d bit digits, %d chunks\n", ParticleSorter::RADIX_BITS,
+				ParticleSorter::CHUNKS_NO);
+
+		fprintf(file, "\n           std::sort  radix     radix %dt  drifting %dt        turning %dt\n",
+				SORT_THREADS, SORT_THREADS, SORT_THREADS);
+		fprintf(file, "particles  ms         ms        ms         ms    incremental  ms    incremental  ordered\n");
+		const int SIZES[] = { 50000, 500000, 5000000 };
+		for (int s = 0; s < 3; ++s)
+		{
+			fillSort(SIZES[s]);
+
+			double library = 1000.0 / timeKernel(sortLibrary, 1);
+
+			sortBatch.sorter.initialise(1);
+			double radix = 1000.0 / timeKernel(sortRadix, 1);
+			bool ordered = sortIsOrdered(0);
+
+			sortBatch.sorter.initialise(SORT_THREADS);
+			double threaded = 1000.0 / timeKernel(sortRadix, 1);
+			ordered = ordered && sortIsOrdered(0);
+
+			double drifted = 0.0, turned = 0.0;
+			double drifting = timeCoherent(1, &drifted);
+			ordered = ordered && sortIsOrdered(sortBatch.frame);
+			double turning = timeCoherent(2, &turned);
+			ordered = ordered && sortIsOrdered(sortBatch.frame);
+
+			fprintf(file, "%-10d %-10.3f %-9.3f %-10.3f %-5.3f %9.1f%%  %-5.3f %9.1f%%  %s\n", SIZES[s],
+					library, radix, threaded, drifting, drifted, turning, turned, ordered ? "yes" : "no");
+		}
+
+		sortBatch.sorter.deinitialise();
+		for (int f = 0; f < SORT_FRAMES; ++f)
+		{
+			std::vector<float>().swap(sortBatch.x[f]);
+			std::vector<float>().swap(sortBatch.y[f]);
+			std::vector<float>().swap(sortBatch.z[f]);
+		}
+		std::vector<float>().swap(sortBatch.depth);
+		std::vector<UINT>().swap(sortBatch.order);
+	}
+
+	const int PARTICLE_GRID = 257;				// Height samples along each side
+	const float PARTICLE_SPACING = 5.0f;		// The terrain's scale
+	const float PARTICLE_ORIGIN = -600.0f;
+	const float PARTICLE_STEP = 1.0f / 60.0f;
+	const float PARTICLE_WARM_UP = 30.0f;		// Seconds run before timing, past
+												// the longest lifetime
+	const int PARTICLE_FRAMES = 600;
+	const int PARTICLE_RUNS = 5;
+	const int PARTICLE_SYSTEMS = 3;
+
+	/*
+		Name		ParticleBatch
+		Syntax		ParticleBatch
+		Brief		The hills and a simulation of the season's system being
+					run over them
+	*/
+	struct ParticleBatch
+	{
+		std::vector<float> heights;
+		M3DHeightField ground;
+		ParticleSimulation simulation;
+		float time;
+	};
+
+	ParticleBatch particles;
+
+	/*
+		Name		fillParticles
+		Syntax		fillParticles()
+		Brief		Makes the hills under where the terrain lies in the scene
+	*/
+	void fillParticles()
+	{
+		const int n = PARTICLE_GRID;
+		particles.heights.resize(n * n);
+		for (int j = 0; j < n; ++j)
+		{
+			for (int i = 0; i < n; ++i)
+			{
+				particles.heights[j * n + i] = hillHeight(PARTICLE_ORIGIN + i * PARTICLE_SPACING,
+														  PARTICLE_ORIGIN + j * PARTICLE_SPACING);
+			}
+		}
+		m3dInitHeightField(&particles.ground, &particles.heights[0], n, n, PARTICLE_ORIGIN,
+						   PARTICLE_ORIGIN, PARTICLE_SPACING, 1.0f, 0.0f);
+	}
+
+	/*
+		Name		stepParticles
+		Syntax		stepParticles(Particle particle)
+		Param		Particle particle - The system being run
+		Brief		Moves the emitter as its state does and steps the
+					simulation a frame
+		Details		Rain and snow follow the camera, walking a wide circle
+					as low as it is kept above the ground. The leaves fall
+					from the top of the tree, 90 units above the ground
+	*/
+	void stepParticles(Particle particle)
+	{
+		particles.time += PARTICLE_STEP;
+		float t = particles.time;
+
+		M3DVector3f emitPos = { 0.0f, 0.0f, 350.0f };
+		if (particle != PARTICLE_LEAVES)
+		{
+			emitPos[0] = 300.0f * sinf(t * 0.03f);
+			emitPos[2] = 300.0f * cosf(t * 0.03f);
+			emitPos[1] = m3dSampleHeight(&particles.ground, emitPos[0], emitPos[2]) + 10.0f;
+		}
+		else
+		{
+			emitPos[1] = m3dSampleHeight(&particles.ground, emitPos[0], emitPos[2]) + 90.0f;
+		}
+
+		particles.simulation.setEmitPos(emitPos);
+		particles.simulation.update(PARTICLE_STEP);
+	}
+
+	/*
+		Name		runParticles
+		Syntax		runParticles(Particle particle, const ParticleRules& rules,
+					int maxParticles, double* live, double* resting,
+					double* lookups)
+		Param		Particle particle - The system being run
+		Param		const ParticleRules& rules - Its rules
+		Param		int maxParticles - Its budget
+		Param		double* live, resting, lookups - Receive the mean
+					particles alive, resting and looked up, a frame
+		Return		double - Microseconds an update
+	*/
+	double runParticles(Particle particle, const ParticleRules& rules, int maxParticles,
+						double* live, double* resting, double* lookups)
+	{
+		particles.simulation.initialise(rules, maxParticles, 7);
+		particles.simulation.setGround(&particles.ground);
+		particles.time = 0.0f;
+		while (particles.time < PARTICLE_WARM_UP)
+			stepParticles(particle);
+
+		// The quickest of a few runs of frames, as each is short
+		__int64 countsPerSec, start, end, quickest = 0;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		*live = 0.0;
+		*resting = 0.0;
+		*lookups = 0.0;
+		for (int run = 0; run < PARTICLE_RUNS; ++run)
+		{
+			__int64 total = 0;
+			for (int f = 0; f < PARTICLE_FRAMES; ++f)
+			{
+				QueryPerformanceCounter((LARGE_INTEGER*)&start);
+				stepParticles(particle);
+				QueryPerformanceCounter((LARGE_INTEGER*)&end);
+				total += end - start;
+				*live += particles.simulation.getLiveNo();
+				*resting += particles.simulation.getRestingNo();
+				*lookups += particles.simulation.getLookupsNo();
+			}
+			quickest = run == 0 || total < quickest ? total : quickest;
+		}
+		*live /= PARTICLE_RUNS * PARTICLE_FRAMES;
+		*resting /= PARTICLE_RUNS * PARTICLE_FRAMES;
+		*lookups /= PARTICLE_RUNS * PARTICLE_FRAMES;
+		sink += particles.simulation.getLiveNo() ? particles.simulation.getX()[0] : 0.0f;
+
+		return 1000000.0 * (double)quickest / (double)countsPerSec / PARTICLE_FRAMES;
+	}
+
+	/*
+		Name		runParticleBenchmark
+		Syntax		runParticleBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Runs each season's system over the hills with its
+					particles falling through the ground, as on the GPU,
+					killed where they land, and resting where they land, at
+					the effect file's rate and at sixteen times that, and
+					reports the particles alive and the cost of an update
+	*/
+	void runParticleBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		fillParticles();
+		fprintf(file, "ground             %dx%d heights, %.0f apart\n", PARTICLE_GRID, PARTICLE_GRID,
+				PARTICLE_SPACING);
+		fprintf(file, "frames             %d runs of %d of %.4f s, after %.0f s\n", PARTICLE_RUNS,
+				PARTICLE_FRAMES, PARTICLE_STEP, PARTICLE_WARM_UP);
+
+		// The budgets the states give their systems
+		const Particle SYSTEMS[PARTICLE_SYSTEMS] = { PARTICLE_RAIN, PARTICLE_LEAVES, PARTICLE_SNOW };
+		const char* NAMES[PARTICLE_SYSTEMS] = { "rain", "leaves", "snow" };
+		const int BUDGETS[PARTICLE_SYSTEMS] = { 50000, 1000, 100000 };
+		const int RATES[] = { 1, 16 };
+
+		fprintf(file, "\n                      falling through      killed on landing    resting on landing\n");
+		fprintf(file, "system  rate  budget  live      update us  live      update us  live      resting   lookups   update us\n");
+		for (int r = 0; r < 2; ++r)
+		{
+			for (int s = 0; s < PARTICLE_SYSTEMS; ++s)
+			{
+				ParticleRules rules;
+				ParticleSimulation::getRules(SYSTEMS[s], &rules);
+				rules.emitCount *= RATES[r];
+
+				const ParticleImpact IMPACTS[] = { IMPACT_NONE, IMPACT_KILL, rules.impact };
+				double live[3], resting[3], lookups[3], update[3];
+				for (int i = 0; i < 3; ++i)
+				{
+					rules.impact = IMPACTS[i];
+					update[i] = runParticles(SYSTEMS[s], rules, BUDGETS[s], &live[i], &resting[i],
+											 &lookups[i]);
+				}
+
+				fprintf(file, "%-7s %3dx  %-7d %-9.0f %-10.1f %-9.0f %-10.1f %-9.0f %-9.0f %-9.0f %.1f\n",
+						NAMES[s], RATES[r], BUDGETS[s], live[0], update[0], live[1], update[1], live[2],
+						resting[2], lookups[2], update[2]);
+			}
+		}
+
+		std::vector<float>().swap(particles.heights);
+	}
+
+	const int EMITTERS_ACROSS = 8;				// Emitters along each side of the grid
+	const int EMITTERS_NO = EMITTERS_ACROSS * EMITTERS_ACROSS;
+	const float EMITTERS_APART = 160.0f;
+	const int EMITTERS_RATE = 4;				// Times the effect files' burst rates
+	const int EMITTERS_BUDGET = 200000;			// Particle budget of the budgeted run
+	const float EMITTERS_TIME = 0.0005f;		// Seconds of the timed run
+	const float EMITTERS_ORBIT = 350.0f;		// Radius of the camera's circle
+	const float EMITTERS_TURN = 0.1f;			// Its turn, radians a second
+
+	/*
+		Name		EmitterBatch
+		Syntax		EmitterBatch
+		Brief		Many systems over the hills sharing a budget, and the
+					camera flying between them
+	*/
+	struct EmitterBatch
+	{
+		ParticleSimulation simulations[EMITTERS_NO];
+		M3DVector3f emitPos[EMITTERS_NO];
+		int handles[EMITTERS_NO];
+		ParticleBudget budget;
+		M3DMatrix44f projection;
+		M3DFrustum frustum;
+		M3DVector3f eye;
+		float time;
+	};
+
+	EmitterBatch emitters;
+
+	/*
+		Name		EmitterTotals
+		Syntax		EmitterTotals
+		Brief		What a run of the emitters measured, summed over its frames
+	*/
+	struct EmitterTotals
+	{
+		double live;
+		double inView;				// Live particles of systems in view
+		double emitted;
+		double killed;
+		double scaleInView;			// Emission scales of systems in and out of view
+		double scaleOutOfView;
+		double inViewNo;
+		double outOfViewNo;
+		__int64 updateTicks;
+		__int64 budgetTicks;
+	};
+
+	/*
+		Name		moveEmitterCamera
+		Syntax		moveEmitterCamera()
+		Brief		Flies the camera a step round its circle, as low as the
+					camera is kept above the ground, looking along the circle,
+					and takes its frustum
+	*/
+	void moveEmitterCamera()
+	{
+		float heading = emitters.time * EMITTERS_TURN;
+		m3dLoadVector3(emitters.eye, EMITTERS_ORBIT * sinf(heading), 0.0f,
+					   EMITTERS_ORBIT * cosf(heading));
+		emitters.eye[1] = m3dSampleHeight(&particles.ground, emitters.eye[0], emitters.eye[2]) +
+						  10.0f;
+
+		// Left handed, along the circle and tipped a little up
+		M3DVector3f front = { cosf(heading), 0.1f, -sinf(heading) };
+		M3DVector3f up = { 0.0f, 1.0f, 0.0f };
+		M3DVector3f right, top;
+		m3dNormalizeVector3(front);
+		m3dCrossProduct3(right, up, front);
+		m3dNormalizeVector3(right);
+		m3dCrossProduct3(top, front, right);
+		const float* eye = emitters.eye;
+		M3DMatrix44f view = { right[0], top[0], front[0], 0.0f,
+							  right[1], top[1], front[1], 0.0f,
+							  right[2], top[2], front[2], 0.0f,
+							  -m3dDotProduct3(right, eye), -m3dDotProduct3(top, eye),
+							  -m3dDotProduct3(front, eye), 1.0f };
+		M3DMatrix44f viewProj;
+		m3dMatrixMultiply44(viewProj, emitters.projection, view);
+		m3dExtractFrustum(&emitters.frustum, viewProj);
+	}
+
+	/*
+		Name		initialiseEmitters
+		Syntax		initialiseEmitters(int particleBudget, float timeBudget)
+		Param		int particleBudget - Live particles to share out, or zero
+		Param		float timeBudget - Seconds of updates to share out, or zero
+		Brief		Starts a grid of rain, snow and leaves over the hills,
+					each able to hold a little more than it keeps alive at
+					the raised rate, and registers them with the budget
+	*/
+	void initialiseEmitters(int particleBudget, float timeBudget)
+	{
+		const Particle SYSTEMS[PARTICLE_SYSTEMS] = { PARTICLE_RAIN, PARTICLE_SNOW, PARTICLE_LEAVES };
+
+		emitters.budget = ParticleBudget();
+		emitters.budget.setParticleBudget(particleBudget);
+		emitters.budget.setTimeBudget(timeBudget);
+		for (int j = 0; j < EMITTERS_ACROSS; ++j)
+		{
+			for (int i = 0; i < EMITTERS_ACROSS; ++i)
+			{
+				int e = j * EMITTERS_ACROSS + i;
+				Particle particle = SYSTEMS[(i + j) % PARTICLE_SYSTEMS];
+				ParticleRules rules;
+				ParticleSimulation::getRules(particle, &rules);
+				rules.emitCount *= EMITTERS_RATE;
+
+				float x = (i - (EMITTERS_ACROSS - 1) * 0.5f) * EMITTERS_APART;
+				float z = (j - (EMITTERS_ACROSS - 1) * 0.5f) * EMITTERS_APART;
+				float above = particle == PARTICLE_LEAVES ? 90.0f : 10.0f;
+				m3dLoadVector3(emitters.emitPos[e], x, m3dSampleHeight(&particles.ground, x, z) + above,
+							   z);
+
+				float demand = ParticleBudget::getDemand(rules, INT_MAX);
+				emitters.simulations[e].initialise(rules, (int)(demand * 1.1f) + 1, e + 1);
+				emitters.simulations[e].setGround(&particles.ground);
+				emitters.simulations[e].setEmitPos(emitters.emitPos[e]);
+				emitters.handles[e] = emitters.budget.addSystem(demand);
+			}
+		}
+		emitters.time = 0.0f;
+	}
+
+	/*
+		Name		stepEmitters
+		Syntax		stepEmitters(bool budgeted, EmitterTotals* totals)
+		Param		bool budgeted - Take the emission scales from the budget,
+					rather than emitting every system at its full rate
+		Param		EmitterTotals* totals - Receives the frame's measures, or
+					zero while warming up
+		Brief		Moves the camera, shares the budget out and updates
+					every system a frame
+		Details		The budget is shared out in both runs, for the coverage
+					that tells the systems in view from the rest
+	*/
+	void stepEmitters(bool budgeted, EmitterTotals* totals)
+	{
+		emitters.time += PARTICLE_STEP;
+		moveEmitterCamera();
+
+		__int64 start, end;
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		ParticleBudget& budget = emitters.budget;
+		for (int e = 0; e < EMITTERS_NO; ++e)
+		{
+			M3DVector3f centre;
+			float radius;
+			ParticleBudget::getVolume(emitters.simulations[e].getRules(), emitters.emitPos[e], centre,
+									  &radius);
+			budget.setVolume(emitters.handles[e], centre, radius);
+		}
+		budget.distribute(emitters.frustum, emitters.eye, emitters.projection);
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+		if (totals)
+			totals->budgetTicks += end - start;
+
+		for (int e = 0; e < EMITTERS_NO; ++e)
+		{
+			ParticleSimulation& simulation = emitters.simulations[e];
+			int handle = emitters.handles[e];
+			simulation.setEmitScale(budgeted ? budget.getEmitScale(handle) : 1.0f);
+
+			unsigned int emitted = simulation.getEmittedNo();
+			unsigned int killed = simulation.getKilledNo();
+			QueryPerformanceCounter((LARGE_INTEGER*)&start);
+			simulation.update(PARTICLE_STEP);
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+
+			budget.setCounts(handle, simulation.getLiveNo(), simulation.getEmittedNo(),
+							 simulation.getKilledNo());
+			__int64 countsPerSec;
+			QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+			budget.setCost(handle, (float)((double)(end - start) / (double)countsPerSec),
+						   simulation.getLiveNo());
+
+			if (!totals)
+				continue;
+			totals->updateTicks += end - start;
+			totals->live += simulation.getLiveNo();
+			totals->emitted += simulation.getEmittedNo() - emitted;
+			totals->killed += simulation.getKilledNo() - killed;
+			if (budget.getCoverage(handle) > 0.0f)
+			{
+				totals->inView += simulation.getLiveNo();
+				totals->scaleInView += simulation.getEmitScale();
+				totals->inViewNo += 1.0;
+			}
+			else
+			{
+				totals->scaleOutOfView += simulation.getEmitScale();
+				totals->outOfViewNo += 1.0;
+			}
+		}
+	}
+
+	/*
+		Name		runEmitterBenchmark
+		Syntax		runEmitterBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Runs a grid of rain, snow and leaves systems at four
+					times their rates, with the camera flying round among
+					them, first each at its full rate, then sharing a
+					particle budget, then sharing a time budget, and reports
+					the particles alive and in view, emitted and killed, and
+					the time taken by the updates and by the budget
+	*/
+	void runEmitterBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		fillParticles();
+		fprintf(file, "emitters           %d rain, snow and leaves, %.0f apart, at %dx their rates\n",
+				EMITTERS_NO, EMITTERS_APART, EMITTERS_RATE);
+		fprintf(file, "frames             %d of %.4f s, after %.0f s\n", PARTICLE_FRAMES, PARTICLE_STEP,
+				PARTICLE_WARM_UP);
+
+		// The scene's projection
+		const float zn = 1.0f, zf = 5000.0f, aspect = 4.0f / 3.0f;
+		float scale = 1.0f / tanf((float)M3D_PI * 0.125f);
+		M3DMatrix44f projection = { scale / aspect, 0.0f, 0.0f, 0.0f,
+									0.0f, scale, 0.0f, 0.0f,
+									0.0f, 0.0f, zf / (zf - zn), 1.0f,
+									0.0f, 0.0f, -zn * zf / (zf - zn), 0.0f };
+		m3dCopyMatrix44(emitters.projection, projection);
+
+		__int64 countsPerSec;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		double frames = PARTICLE_FRAMES;
+		double seconds = PARTICLE_FRAMES * PARTICLE_STEP;
+
+		fprintf(file, "particle budget    %d live\n", EMITTERS_BUDGET);
+		fprintf(file, "time budget        %.2f ms\n", EMITTERS_TIME * 1000.0f);
+
+		const char* NAMES[] = { "none", "particles", "time" };
+		fprintf(file, "\nbudget     live      in view   emitted/s  killed/s   scale in/out  update us  budget us\n");
+		for (int run = 0; run < 3; ++run)
+		{
+			initialiseEmitters(run == 1 ? EMITTERS_BUDGET : 0, run == 2 ? EMITTERS_TIME : 0.0f);
+
+			while (emitters.time < PARTICLE_WARM_UP)
+				stepEmitters(run > 0, 0);
+
+			EmitterTotals totals = { 0 };
+			for (int f = 0; f < PARTICLE_FRAMES; ++f)
+				stepEmitters(run > 0, &totals);
+
+			fprintf(file, "%-10s %-9.0f %-9.0f %-10.0f %-10.0f %4.2f / %-6.2f %-10.1f %.1f\n", NAMES[run],
+					totals.live / frames, totals.inView / frames, totals.emitted / seconds,
+					totals.killed / seconds,
+					totals.inViewNo > 0.0 ? totals.scaleInView / totals.inViewNo : 0.0,
+					totals.outOfViewNo > 0.0 ? totals.scaleOutOfView / totals.outOfViewNo : 0.0,
+					1000000.0 * (double)totals.updateTicks / (double)countsPerSec / frames,
+					1000000.0 * (double)totals.budgetTicks / (double)countsPerSec / frames);
+		}
+
+		std::vector<float>().swap(particles.heights);
+	}
+
+	const int WEATHER_PATHS = 3;
+	const int WEATHER_SEGMENTS = 5;
+	const float WEATHER_ABOVE = 10.0f;			// Height the camera is kept above the ground
+
+	/*
+		Name		WeatherSegment
+		Syntax		WeatherSegment
+		Brief		A stretch of recorded camera input, held for a time
+	*/
+	struct WeatherSegment
+	{
+		float seconds;
+		float forward;				// Fraction of the path's speed moved at
+		float turn;					// Radians a second turned
+	};
+
+	/*
+		Name		WeatherBatch
+		Syntax		WeatherBatch
+		Brief		A weather system following the camera along a path
+	*/
+	struct WeatherBatch
+	{
+		ParticleSimulation simulation;
+		M3DVector3f eye;
+		float heading;
+		float speed;
+		float time;
+	};
+
+	WeatherBatch weather;
+
+	/*
+		Name		stepWeather
+		Syntax		stepWeather()
+		Brief		Replays the camera input a frame, keeping the camera
+					above the ground, and steps the system emitted about it
+		Details		The input is that of walking with the arrow keys at the
+					states' turning speed: runs ahead, turns while moving,
+					and stops to look round, over again
+	*/
+	void stepWeather()
+	{
+		const WeatherSegment PATH[WEATHER_SEGMENTS] = { { 3.0f, 1.0f, 0.0f },
+														{ 1.0f, 1.0f, 1.5f },
+														{ 2.0f, 0.0f, -1.5f },
+														{ 4.0f, 1.0f, 0.0f },
+														{ 2.0f, 1.0f, -0.75f } };
+		float length = 0.0f;
+		for (int i = 0; i < WEATHER_SEGMENTS; ++i)
+			length += PATH[i].seconds;
+
+		float t = fmodf(weather.time, length);
+		int segment = 0;
+		while (segment < WEATHER_SEGMENTS - 1 && t >= PATH[segment].seconds)
+			t -= PATH[segment++].seconds;
+
+		weather.time += PARTICLE_STEP;
+		weather.heading += PATH[segment].turn * PARTICLE_STEP;
+		float step = PATH[segment].forward * weather.speed * PARTICLE_STEP;
+		weather.eye[0] += step * sinf(weather.heading);
+		weather.eye[2] += step * cosf(weather.heading);
+		weather.eye[1] = m3dSampleHeight(&particles.ground, weather.eye[0], weather.eye[2]) +
+						 WEATHER_ABOVE;
+
+		weather.simulation.setEmitPos(weather.eye);
+		weather.simulation.update(PARTICLE_STEP);
+	}
+
+	/*
+		Name		countInBox
+		Syntax		countInBox()
+		Return		int - Falling particles in the box around the camera
+		Brief		Counts the particles that can be seen falling around the
+					camera, between where bursts start and the wrapping
+					box's bottom
+	*/
+	int countInBox()
+	{
+		const ParticleSimulation& simulation = weather.simulation;
+		const ParticleRules& rules = simulation.getRules();
+		const float* x = simulation.getX();
+		const float* y = simulation.getY();
+		const float* z = simulation.getZ();
+		float top = weather.eye[1] + rules.emitHeight;
+		float bottom = top - simulation.getWrapDepth();
+
+		int count = 0;
+		for (int i = 0; i < simulation.getFallingNo(); ++i)
+		{
+			count += fabsf(x[i] - weather.eye[0]) <= rules.spread &&
+					 fabsf(z[i] - weather.eye[2]) <= rules.spread && y[i] >= bottom &&
+					 y[i] <= top;
+		}
+		return count;
+	}
+
+	/*
+		Name		runWeatherBenchmark
+		Syntax		runWeatherBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Replays the camera walking, flying and dashing over the
+					hills with rain and with snow, first emitted about the
+					camera as the effect files do, then wrapped in a box
+					around it, and reports the particles alive and in the
+					box, those emitted, recycled and killed, and the cost of
+					an update
+	*/
+	void runWeatherBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		fillParticles();
+		fprintf(file, "frames             %d of %.4f s, after %.0f s\n", PARTICLE_FRAMES, PARTICLE_STEP,
+				PARTICLE_WARM_UP);
+
+		// The states' budgets, and camera speeds from theirs to a fast flight
+		const Particle SYSTEMS[] = { PARTICLE_RAIN, PARTICLE_SNOW };
+		const char* NAMES[] = { "rain", "snow" };
+		const int BUDGETS[] = { 50000, 100000 };
+		const char* PATHS[WEATHER_PATHS] = { "walk", "fly", "dash" };
+		const float SPEEDS[WEATHER_PATHS] = { 50.0f, 150.0f, 400.0f };
+		const char* MODES[] = { "emit", "wrap" };
+
+		double frames = PARTICLE_FRAMES;
+		double seconds = PARTICLE_FRAMES * PARTICLE_STEP;
+		__int64 countsPerSec;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+
+		fprintf(file, "\npath  speed  system  mode  live      in box    emitted/s  recycled/s killed/s   update us\n");
+		for (int p = 0; p < WEATHER_PATHS; ++p)
+		{
+			for (int s = 0; s < 2; ++s)
+			{
+				for (int m = 0; m < 2; ++m)
+				{
+					ParticleRules rules;
+					ParticleSimulation::getRules(SYSTEMS[s], &rules);
+					weather.simulation.initialise(rules, BUDGETS[s], 7);
+					weather.simulation.setGround(&particles.ground);
+					weather.simulation.setWrapping(m == 1);
+					m3dLoadVector3(weather.eye, 0.0f, 0.0f, 0.0f);
+					weather.heading = 0.0f;
+					weather.speed = SPEEDS[p];
+					weather.time = 0.0f;
+					while (weather.time < PARTICLE_WARM_UP)
+						stepWeather();
+
+					unsigned int emitted = weather.simulation.getEmittedNo();
+					unsigned int recycled = weather.simulation.getRecycledNo();
+					unsigned int killed = weather.simulation.getKilledNo();
+					double live = 0.0, inBox = 0.0;
+					__int64 start, end, total = 0;
+					for (int f = 0; f < PARTICLE_FRAMES; ++f)
+					{
+						QueryPerformanceCounter((LARGE_INTEGER*)&start);
+						stepWeather();
+						QueryPerformanceCounter((LARGE_INTEGER*)&end);
+						total += end - start;
+						live += weather.simulation.getLiveNo();
+						inBox += countInBox();
+					}
+
+					fprintf(file, "%-5s %-6.0f %-7s %-5s %-9.0f %-9.0f %-10.0f %-10.0f %-10.0f %.1f\n",
+							PATHS[p], SPEEDS[p], NAMES[s], MODES[m], live / frames, inBox / frames,
+							(weather.simulation.getEmittedNo() - emitted) / seconds,
+							(weather.simulation.getRecycledNo() - recycled) / seconds,
+							(weather.simulation.getKilledNo() - killed) / seconds,
+							1000000.0 * (double)total / (double)countsPerSec / frames);
+				}
+			}
+		}
+
+		std::vector<float>().swap(particles.heights);
+	}
+
+	const float WIND_SPACING = 40.0f;			// As the states lay the field out
+	const float WIND_ABOVE = 200.0f;
+	const int WIND_SAMPLES = 100000;			// Positions looked up at once
+
+	/*
+		Name		WindBatch
+		Syntax		WindBatch
+		Brief		A wind field over the hills, and positions to look it up at
+	*/
+	struct WindBatch
+	{
+		WindField field;
+		std::vector<float> x, y, z;
+		std::vector<float> vx, vy, vz;
+	};
+
+	WindBatch wind;
+
+	/*
+		Name		setAutumnWind
+		Syntax		setAutumnWind(float gusts)
+		Param		float gusts - Fraction the wind's speed varies by
+		Brief		Sets the wind Autumn blows its leaves with
+	*/
+	void setAutumnWind(float gusts)
+	{
+		M3DVector3f breeze = { 3.0f, 0.0f, 1.5f };
+		wind.field.setWind(breeze, gusts, 4.0f, 60.0f, 2.0f);
+	}
+
+	/*
+		Name		runBlown
+		Syntax		runBlown(Particle particle, int maxParticles, bool blown,
+					double* live)
+		Param		Particle particle - The system being run
+		Param		int maxParticles - Its budget
+		Param		bool blown - Whether the wind blows it
+		Param		double* live - Receives the mean particles alive
+		Return		double - Microseconds an update, not counting the wind's
+	*/
+	double runBlown(Particle particle, int maxParticles, bool blown, double* live)
+	{
+		ParticleRules rules;
+		ParticleSimulation::getRules(particle, &rules);
+		particles.simulation.initialise(rules, maxParticles, 7);
+		particles.simulation.setGround(&particles.ground);
+		particles.simulation.setWind(blown ? wind.field.getField() : 0, wind.field.getMaxSpeed());
+
+		setAutumnWind(0.5f);
+		particles.time = 0.0f;
+		while (particles.time < PARTICLE_WARM_UP)
+		{
+			wind.field.update(PARTICLE_STEP);
+			stepParticles(particle);
+		}
+
+		__int64 countsPerSec, start, end, quickest = 0;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		*live = 0.0;
+		for (int run = 0; run < PARTICLE_RUNS; ++run)
+		{
+			__int64 total = 0;
+			for (int f = 0; f < PARTICLE_FRAMES; ++f)
+			{
+				if (blown)
+					wind.field.update(PARTICLE_STEP);
+				QueryPerformanceCounter((LARGE_INTEGER*)&start);
+				stepParticles(particle);
+				QueryPerformanceCounter((LARGE_INTEGER*)&end);
+				total += end - start;
+				*live += particles.simulation.getLiveNo();
+			}
+			quickest = run == 0 || total < quickest ? total : quickest;
+		}
+		*live /= PARTICLE_RUNS * PARTICLE_FRAMES;
+		sink += particles.simulation.getLiveNo() ? particles.simulation.getX()[0] : 0.0f;
+
+		return 1000000.0 * (double)quickest / (double)countsPerSec / PARTICLE_FRAMES;
+	}
+
+	/*
+		Name		runWindBenchmark
+		Syntax		runWindBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Lays Autumn's wind over the hills and reports the cost of
+					building a keyframe against that of an update, how fast
+					the eddies blow, the cost of looking the field up one
+					position at a time and in batches, and the cost the wind
+					adds to updating the leaves and the snow
+	*/
+	void runWindBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		fillParticles();
+		wind.field.initialise(&particles.ground, WIND_SPACING, WIND_ABOVE);
+		const M3DVectorField* field = wind.field.getField();
+		fprintf(file, "field              %dx%dx%d samples, %.0f apart\n", field->width,
+				field->height, field->depth, WIND_SPACING);
+		fprintf(file, "frames             %d runs of %d of %.4f s, after %.0f s\n", PARTICLE_RUNS,
+				PARTICLE_FRAMES, PARTICLE_STEP, PARTICLE_WARM_UP);
+
+		__int64 countsPerSec, start, end;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		double toUs = 1000000.0 / (double)countsPerSec;
+
+		// Setting the wind builds the two keyframes either side of the time
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		setAutumnWind(0.5f);
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+		double keyframe = (double)(end - start) * toUs / 2.0;
+
+		__int64 total = 0, quickest = 0;
+		double rows = 0.0;
+		for (int f = 0; f < PARTICLE_FRAMES; ++f)
+		{
+			QueryPerformanceCounter((LARGE_INTEGER*)&start);
+			wind.field.update(PARTICLE_STEP);
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			total += end - start;
+			quickest = f == 0 || end - start < quickest ? end - start : quickest;
+			rows += wind.field.getRowsBuilt();
+		}
+		fprintf(file, "\nkeyframe build     %.1f us\n", keyframe);
+		fprintf(file, "update             %.1f us mean, %.1f us quickest, %.1f rows built\n",
+				(double)total * toUs / PARTICLE_FRAMES, (double)quickest * toUs,
+				rows / PARTICLE_FRAMES);
+
+		// Without gusts, the field less the wind is the eddies
+		setAutumnWind(0.0f);
+		std::vector<float> eddies;
+		for (int f = 0; f < PARTICLE_FRAMES; f += 60)
+		{
+			for (int i = 0; i < wind.field.getSamplesNo(); ++i)
+			{
+				const float* v = field->samples + i * 4;
+				M3DVector3f eddy = { v[0] - 3.0f, v[1], v[2] - 1.5f };
+				eddies.push_back(m3dGetVectorLength3(eddy));
+			}
+			for (int step = 0; step < 60; ++step)
+				wind.field.update(PARTICLE_STEP);
+		}
+		std::sort(eddies.begin(), eddies.end());
+		double mean = 0.0;
+		for (size_t i = 0; i < eddies.size(); ++i)
+			mean += eddies[i];
+		fprintf(file, "eddy speed         %.2f mean, %.2f median, %.2f 90th percentile, %.2f most, "
+				"of %.2f\n", mean / eddies.size(), eddies[eddies.size() / 2],
+				eddies[eddies.size() * 9 / 10], eddies.back(), 4.0f);
+
+		// Positions through the field's box, a little past its edges
+		wind.x.resize(WIND_SAMPLES);
+		wind.y.resize(WIND_SAMPLES);
+		wind.z.resize(WIND_SAMPLES);
+		wind.vx.resize(WIND_SAMPLES);
+		wind.vy.resize(WIND_SAMPLES);
+		wind.vz.resize(WIND_SAMPLES);
+		float extent[3] = { (field->width - 1) * WIND_SPACING, (field->height - 1) * WIND_SPACING,
+							(field->depth - 1) * WIND_SPACING };
+		srand(7);
+		for (int i = 0; i < WIND_SAMPLES; ++i)
+		{
+			wind.x[i] = field->origin[0] + extent[0] * (1.1f * rand() / RAND_MAX - 0.05f);
+			wind.y[i] = field->origin[1] + extent[1] * (1.1f * rand() / RAND_MAX - 0.05f);
+			wind.z[i] = field->origin[2] + extent[2] * (1.1f * rand() / RAND_MAX - 0.05f);
+		}
+
+		__int64 single = 0, batched = 0;
+		float error = 0.0f;
+		for (int run = 0; run < PARTICLE_RUNS; ++run)
+		{
+			QueryPerformanceCounter((LARGE_INTEGER*)&start);
+			for (int i = 0; i < WIND_SAMPLES; ++i)
+			{
+				M3DVector3f pos = { wind.x[i], wind.y[i], wind.z[i] };
+				M3DVector3f v;
+				m3dSampleVector(field, pos, v);
+				wind.vx[i] = v[0];
+				wind.vy[i] = v[1];
+				wind.vz[i] = v[2];
+			}
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			single = run == 0 || end - start < single ? end - start : single;
+			sink += wind.vx[run];
+
+			std::vector<float> vx(wind.vx), vy(wind.vy), vz(wind.vz);
+			QueryPerformanceCounter((LARGE_INTEGER*)&start);
+			m3dSampleVectors(field, &wind.x[0], &wind.y[0], &wind.z[0], &wind.vx[0], &wind.vy[0],
+							 &wind.vz[0], WIND_SAMPLES);
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			batched = run == 0 || end - start < batched ? end - start : batched;
+			for (int i = 0; i < WIND_SAMPLES; ++i)
+			{
+				float d = fabsf(vx[i] - wind.vx[i]) + fabsf(vy[i] - wind.vy[i]) +
+						  fabsf(vz[i] - wind.vz[i]);
+				error = d > error ? d : error;
+			}
+		}
+		fprintf(file, "\nlookups            %d positions\n", WIND_SAMPLES);
+		fprintf(file, "one at a time      %.2f ns each\n", (double)single * toUs * 1000.0 / WIND_SAMPLES);
+		fprintf(file, "batched            %.2f ns each, %.1fx\n",
+				(double)batched * toUs * 1000.0 / WIND_SAMPLES, (double)single / (double)batched);
+		fprintf(file, "largest difference %g\n", error);
+
+		// The states' budgets
+		const Particle SYSTEMS[] = { PARTICLE_LEAVES, PARTICLE_SNOW };
+		const char* NAMES[] = { "leaves", "snow" };
+		const int BUDGETS[] = { 1000, 100000 };
+
+		fprintf(file, "\n                calm                 blown\n");
+		fprintf(file, "system  budget  live      update us  live      update us\n");
+		for (int s = 0; s < 2; ++s)
+		{
+			double live[2], update[2];
+			for (int b = 0; b < 2; ++b)
+				update[b] = runBlown(SYSTEMS[s], BUDGETS[s], b == 1, &live[b]);
+
+			fprintf(file, "%-7s %-7d %-9.0f %-10.1f %-9.0f %.1f\n", NAMES[s], BUDGETS[s], live[0],
+					update[0], live[1], update[1]);
+		}
+
+		std::vector<float>().swap(wind.x);
+		std::vector<float>().swap(wind.y);
+		std::vector<float>().swap(wind.z);
+		std::vector<float>().swap(wind.vx);
+		std::vector<float>().swap(wind.vy);
+		std::vector<float>().swap(wind.vz);
+		std::vector<float>().swap(particles.heights);
+	}
+
+	const char* const SPLASH_FILE = "Assets/Particles/Splash.txt";
+	const int SPLASH_EMITTERS = 1024;			// Pool slots
+	const float SPLASH_RATE = 2000.0f;			// Splashes started a second
+	const float SPLASH_DURATION = 0.1f;			// Time a splash emits for
+
+	/*
+		Name		SplashTotals
+		Syntax		SplashTotals
+		Brief		Measures of the splashes, summed over the timed frames
+	*/
+	struct SplashTotals
+	{
+		double emitters;
+		double live;
+		unsigned int spawned;
+		unsigned int refused;
+		unsigned int recycled;
+		__int64 updateTicks;
+	};
+
+	/*
+		Name		SplashBatch
+		Syntax		SplashBatch
+		Brief		Splashes started at random over the hills, either in a
+					pool or each in a simulation of its own
+	*/
+	struct SplashBatch
+	{
+		ParticleRules rules;
+		int slotParticles;
+		EmitterPool pool;
+		std::vector<ParticleSimulation*> simulations;
+		std::vector<float> stops;		// Time each simulation stops emitting
+		unsigned int spawned;			// Of the simulations
+		unsigned int recycled;
+		float time;
+		float due;						// Splashes owed to the rate
+	};
+
+	SplashBatch splashes;
+
+	/*
+		Name		clearSplashes
+		Syntax		clearSplashes()
+		Brief		Deletes the simulations of the unpooled splashes
+	*/
+	void clearSplashes()
+	{
+		for (size_t i = 0; i < splashes.simulations.size(); ++i)
+			delete splashes.simulations[i];
+		splashes.simulations.clear();
+		splashes.stops.clear();
+	}
+
+	/*
+		Name		stepSplashes
+		Syntax		stepSplashes(bool pooled, SplashTotals* totals)
+		Param		bool pooled - Run the splashes in the pool, rather than
+					creating a simulation for each
+		Param		SplashTotals* totals - Receives the frame's measures, or
+					zero while warming up
+		Brief		Starts the splashes due this frame at random spots on
+					the hills and updates them all
+		Details		An unpooled splash is stopped emitting once its duration
+					is up, and deleted when its last particle has died. The
+					time taken counts the starting and finishing of splashes
+					along with the updates
+	*/
+	void stepSplashes(bool pooled, SplashTotals* totals)
+	{
+		const float extent = (PARTICLE_GRID - 1) * PARTICLE_SPACING;
+		splashes.time += PARTICLE_STEP;
+		splashes.due += SPLASH_RATE * PARTICLE_STEP;
+
+		__int64 start, end;
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		for (; splashes.due >= 1.0f; splashes.due -= 1.0f)
+		{
+			M3DVector3f pos;
+			pos[0] = PARTICLE_ORIGIN + extent * rand() / RAND_MAX;
+			pos[2] = PARTICLE_ORIGIN + extent * rand() / RAND_MAX;
+			pos[1] = m3dSampleHeight(&particles.ground, pos[0], pos[2]);
+			if (pooled)
+			{
+				splashes.pool.spawn(&splashes.rules, pos, SPLASH_DURATION);
+			}
+			else
+			{
+				ParticleSimulation* simulation = new ParticleSimulation;
+				simulation->initialise(splashes.rules, splashes.slotParticles, splashes.spawned + 1);
+				simulation->setEmitPos(pos);
+				splashes.simulations.push_back(simulation);
+				splashes.stops.push_back(splashes.time + SPLASH_DURATION);
+				++splashes.spawned;
+			}
+		}
+
+		if (pooled)
+		{
+			splashes.pool.update(PARTICLE_STEP);
+		}
+		else
+		{
+			for (size_t i = 0; i < splashes.simulations.size(); )
+			{
+				ParticleSimulation* simulation = splashes.simulations[i];
+				simulation->update(PARTICLE_STEP);
+				if (splashes.time < splashes.stops[i])
+				{
+					++i;
+					continue;
+				}
+
+				simulation->setEmitScale(0.0f);
+				if (simulation->getLiveNo() > 0)
+				{
+					++i;
+					continue;
+				}
+
+				delete simulation;
+				splashes.simulations[i] = splashes.simulations.back();
+				splashes.simulations.pop_back();
+				splashes.stops[i] = splashes.stops.back();
+				splashes.stops.pop_back();
+				++splashes.recycled;
+			}
+		}
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+
+		if (!totals)
+			return;
+		totals->updateTicks += end - start;
+		if (pooled)
+		{
+			totals->emitters += splashes.pool.getEmittersNo();
+			totals->live += splashes.pool.getLiveNo();
+		}
+		else
+		{
+			totals->emitters += (double)splashes.simulations.size();
+			for (size_t i = 0; i < splashes.simulations.size(); ++i)
+				totals->live += splashes.simulations[i]->getLiveNo();
+		}
+	}
+
+	/*
+		Name		runPoolBenchmark
+		Syntax		runPoolBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Starts splashes over the hills at a steady rate, first in
+					an EmitterPool, then creating and deleting a simulation
+					for each, and reports the splashes and particles alive,
+					the splashes started, refused and finished a second, and
+					the time taken a frame
+	*/
+	void runPoolBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n");
+#endif
+		ParticleEffect effect;
+		if (!effect.load(SPLASH_FILE))
+		{
+			fprintf(file, "loading %s failed\n", SPLASH_FILE);
+			return;
+		}
+		fillParticles();
+		splashes.rules = effect.getRules();
+		splashes.slotParticles = effect.getMaxParticles();
+		fprintf(file, "splash             %s, %d particles each\n", SPLASH_FILE,
+				splashes.slotParticles);
+		fprintf(file, "splashes           %.0f a second, emitting for %.2f s, %d pool slots\n",
+				SPLASH_RATE, SPLASH_DURATION, SPLASH_EMITTERS);
+		fprintf(file, "frames             %d of %.4f s, after %.0f s\n", PARTICLE_FRAMES, PARTICLE_STEP,
+				PARTICLE_WARM_UP);
+
+		__int64 countsPerSec;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		double frames = PARTICLE_FRAMES;
+		double seconds = PARTICLE_FRAMES * PARTICLE_STEP;
+
+		const char* NAMES[] = { "pooled", "allocated" };
+		fprintf(file, "\nsplashes   alive     particles  spawned/s  refused/s  recycled/s update us\n");
+		for (int run = 0; run < 2; ++run)
+		{
+			bool pooled = run == 0;
+			srand(11);
+			splashes.pool.initialise(SPLASH_EMITTERS, splashes.slotParticles, 11);
+			splashes.spawned = 0;
+			splashes.recycled = 0;
+			splashes.time = 0.0f;
+			splashes.due = 0.0f;
+
+			while (splashes.time < PARTICLE_WARM_UP)
+				stepSplashes(pooled, 0);
+
+			unsigned int spawned = pooled ? splashes.pool.getSpawnedNo() : splashes.spawned;
+			unsigned int refused = splashes.pool.getRefusedNo();
+			unsigned int recycled = pooled ? splashes.pool.getRecycledNo() : splashes.recycled;
+			SplashTotals totals = { 0 };
+			for (int f = 0; f < PARTICLE_FRAMES; ++f)
+				stepSplashes(pooled, &totals);
+			totals.spawned = (pooled ? splashes.pool.getSpawnedNo() : splashes.spawned) - spawned;
+			totals.refused = splashes.pool.getRefusedNo() - refused;
+			totals.recycled = (pooled ? splashes.pool.getRecycledNo() : splashes.recycled) - recycled;
+
+			fprintf(file, "%-10s %-9.0f %-10.0f %-10.0f %-10.0f %-10.0f %.1f\n", NAMES[run],
+					totals.emitters / frames, totals.live / frames, totals.spawned / seconds,
+					totals.refused / seconds, totals.recycled / seconds,
+					1000000.0 * (double)totals.updateTicks / (double)countsPerSec / frames);
+			clearSplashes();
+		}
+
+		splashes.pool.initialise(0, 0);
+		std::vector<float>().swap(particles.heights);
+	}
+
+	const int RANDOM_CHECKS = 1 << 20;			// Numbers the statistics are taken over
+
+	/*
+		Name		RandomBatch
+		Syntax		RandomBatch
+		Brief		A stream and the numbers drawn from it by the kernels
+	*/
+	struct RandomBatch
+	{
+		M3DRandom random;
+		float x[BATCH_SIZE], y[BATCH_SIZE], z[BATCH_SIZE];
+	};
+
+	RandomBatch randomBatch;
+
+	/*
+		Name		randFloat
+		Syntax		randFloat()
+		Return		float - A float in [0, 1] from rand, as the utility
+					functions made them before
+	*/
+	inline float randFloat()
+	{
+		return (float)rand() / (float)RAND_MAX;
+	}
+
+	void uniformRand()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			randomBatch.x[i] = randFloat();
+	}
+
+	void uniformSingle()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			randomBatch.x[i] = m3dRandomFloat(&randomBatch.random);
+	}
+
+	void uniformBatch()
+	{
+		m3dRandomFloats(&randomBatch.random, randomBatch.x, BATCH_SIZE, 0.0f, 1.0f);
+	}
+
+	// Box-Muller by the C library
+	void normalRand()
+	{
+		for (int i = 0; i < BATCH_SIZE; i += 2)
+		{
+			float r = sqrtf(-2.0f * logf(1.0f - randFloat() * 0.999999f));
+			float a = 2.0f * (float)M3D_PI * randFloat();
+			randomBatch.x[i] = r * cosf(a);
+			randomBatch.x[i + 1] = r * sinf(a);
+		}
+	}
+
+	void normalSingle()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+			randomBatch.x[i] = m3dRandomNormal(&randomBatch.random);
+	}
+
+	void normalBatch()
+	{
+		m3dRandomNormals(&randomBatch.random, randomBatch.x, BATCH_SIZE);
+	}
+
+	// A cube of rand normalised, as randUnitVector3 did but from [-1, 1)
+	void unitRand()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f v = { randFloat() * 2.0f - 1.0f, randFloat() * 2.0f - 1.0f,
+							  randFloat() * 2.0f - 1.0f };
+			m3dNormalizeVector3(v);
+			randomBatch.x[i] = v[0];
+			randomBatch.y[i] = v[1];
+			randomBatch.z[i] = v[2];
+		}
+	}
+
+	void unitSingle()
+	{
+		for (int i = 0; i < BATCH_SIZE; ++i)
+		{
+			M3DVector3f v;
+			m3dRandomUnitVector3(&randomBatch.random, v);
+			randomBatch.x[i] = v[0];
+			randomBatch.y[i] = v[1];
+			randomBatch.z[i] = v[2];
+		}
+	}
+
+	void unitBatch()
+	{
+		m3dRandomUnitVectors3(&randomBatch.random, randomBatch.x, randomBatch.y, randomBatch.z,
+							  BATCH_SIZE);
+	}
+
+	/*
+		Name		checkPhilox
+		Syntax		checkPhilox()
+		Return		bool - True if the generator gives the known answers of
+					Philox4x32-10
+	*/
+	bool checkPhilox()
+	{
+		const unsigned int COUNTERS[3][4] = { { 0u, 0u, 0u, 0u },
+											  { 0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu },
+											  { 0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u } };
+		const unsigned int KEYS[3][2] = { { 0u, 0u }, { 0xffffffffu, 0xffffffffu },
+										  { 0xa4093822u, 0x299f31d0u } };
+		const unsigned int ANSWERS[3][4] = { { 0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u },
+											 { 0x408f276du, 0x41c83b0eu, 0xa20bc7c6u, 0x6d5451fdu },
+											 { 0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u } };
+		for (int i = 0; i < 3; ++i)
+		{
+			unsigned int block[4];
+			m3dRandomBlock(COUNTERS[i], KEYS[i], block);
+			for (int j = 0; j < 4; ++j)
+			{
+				if (block[j] != ANSWERS[i][j])
+					return false;
+			}
+		}
+		return true;
+	}
+
+	/*
+		Name		checkBatches
+		Syntax		checkBatches()
+		Return		bool - True if the batches give the same numbers as the
+					same stream drawn one at a time
+		Details		A count that is not a whole number of blocks runs the
+					SIMD loop and the scalar tail both
+	*/
+	bool checkBatches()
+	{
+		const int COUNT = 1001;
+		std::vector<float> x(COUNT), y(COUNT), z(COUNT);
+		M3DRandom single, batched;
+		bool same = true;
+
+		m3dSeedRandom(&single, 3, 1);
+		m3dSeedRandom(&batched, 3, 1);
+		m3dRandomFloats(&batched, &x[0], COUNT, -2.0f, 5.0f);
+		for (int i = 0; i < COUNT; ++i)
+			same = same && m3dRandomFloat(&single, -2.0f, 5.0f) == x[i];
+
+		m3dSeedRandom(&single, 3, 2);
+		m3dSeedRandom(&batched, 3, 2);
+		m3dRandomUnitVectors3(&batched, &x[0], &y[0], &z[0], COUNT);
+		for (int i = 0; i < COUNT; ++i)
+		{
+			M3DVector3f v;
+			m3dRandomUnitVector3(&single, v);
+			same = same && v[0] == x[i] && v[1] == y[i] && v[2] == z[i];
+		}
+		return same;
+	}
+
+	/*
+		Name		runRandomBenchmark
+		Syntax		runRandomBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Checks the generator against Philox's known answers and
+					its batches against single draws, gives the statistics of
+					its uniform floats, normals and unit vectors and of two
+					streams of a seed, and times each drawn from rand, one at
+					a time and in batches
+	*/
+	void runRandomBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		fprintf(file, "known answers      %s\n", checkPhilox() ? "match" : "DIFFER");
+		fprintf(file, "batches            %s single draws\n", checkBatches() ? "match" : "DIFFER FROM");
+
+		// Statistics of a million of each, from two streams of a seed
+		std::vector<float> a(RANDOM_CHECKS), b(RANDOM_CHECKS), c(RANDOM_CHECKS);
+		M3DRandom random;
+		m3dSeedRandom(&random, 1, 0);
+		m3dRandomFloats(&random, &a[0], RANDOM_CHECKS, 0.0f, 1.0f);
+		m3dSeedRandom(&random, 1, 1);
+		m3dRandomFloats(&random, &b[0], RANDOM_CHECKS, 0.0f, 1.0f);
+		double mean = 0.0, variance = 0.0, covariance = 0.0, meanB = 0.0;
+		for (int i = 0; i < RANDOM_CHECKS; ++i)
+		{
+			mean += a[i];
+			meanB += b[i];
+		}
+		mean /= RANDOM_CHECKS;
+		meanB /= RANDOM_CHECKS;
+		for (int i = 0; i < RANDOM_CHECKS; ++i)
+		{
+			variance += (a[i] - mean) * (a[i] - mean);
+			covariance += (a[i] - mean) * (b[i] - meanB);
+		}
+		variance /= RANDOM_CHECKS;
+		covariance /= RANDOM_CHECKS;
+		fprintf(file, "uniform            mean %.5f (0.5), variance %.5f (%.5f)\n", mean, variance,
+				1.0 / 12.0);
+		fprintf(file, "streams 0 and 1    correlation %.5f\n", covariance / variance);
+
+		m3dRandomNormals(&random, &a[0], RANDOM_CHECKS);
+		mean = variance = 0.0;
+		for (int i = 0; i < RANDOM_CHECKS; ++i)
+		{
+			mean += a[i];
+			variance += (double)a[i] * a[i];
+		}
+		mean /= RANDOM_CHECKS;
+		fprintf(file, "normal             mean %.5f (0), variance %.5f (1)\n", mean,
+				variance / RANDOM_CHECKS - mean * mean);
+
+		m3dRandomUnitVectors3(&random, &a[0], &b[0], &c[0], RANDOM_CHECKS);
+		double sum[3] = { 0.0, 0.0, 0.0 };
+		float lengthError = 0.0f;
+		for (int i = 0; i < RANDOM_CHECKS; ++i)
+		{
+			sum[0] += a[i];
+			sum[1] += b[i];
+			sum[2] += c[i];
+			float error = fabsf(sqrtf(a[i] * a[i] + b[i] * b[i] + c[i] * c[i]) - 1.0f);
+			lengthError = error > lengthError ? error : lengthError;
+		}
+		fprintf(file, "unit vector        mean (%.4f, %.4f, %.4f) (0), length within %g of 1\n",
+				sum[0] / RANDOM_CHECKS, sum[1] / RANDOM_CHECKS, sum[2] / RANDOM_CHECKS, lengthError);
+
+		const struct
+		{
+			const char* name;
+			void (*rand)();
+			void (*single)();
+			void (*batch)();
+		}
+		RANDOM_KERNELS[] =
+		{
+			{ "uniform",		uniformRand,	uniformSingle,	uniformBatch },
+			{ "normal",			normalRand,		normalSingle,	normalBatch },
+			{ "unit vector",	unitRand,		unitSingle,		unitBatch }
+		};
+
+		m3dSeedRandom(&randomBatch.random, 1, 0);
+		fprintf(file, "\nnumbers        rand ops/s   single ops/s    batch ops/s   speedup\n");
+		for (int i = 0; i < 3; ++i)
+		{
+			double fromRand = timeKernel(RANDOM_KERNELS[i].rand, BATCH_SIZE);
+			double single = timeKernel(RANDOM_KERNELS[i].single, BATCH_SIZE);
+			double batch = timeKernel(RANDOM_KERNELS[i].batch, BATCH_SIZE);
+			fprintf(file, "%-12s %12.0f %14.0f %14.0f %8.2fx\n", RANDOM_KERNELS[i].name, fromRand,
+					single, batch, batch / fromRand);
+		}
+		sink = randomBatch.x[1] + randomBatch.y[1] + randomBatch.z[1];
+	}
+
+	const int DIRECTION_CELLS = 8;				// Height and angle cells a side
+	const float CHI_SQUARE_LIMIT = 103.4f;		// Of 63 degrees of freedom at 0.1%
+
+	enum Distribution
+	{
+		DISTRIBUTION_CUBE,
+		DISTRIBUTION_SPHERE,
+		DISTRIBUTION_HEMISPHERE,
+		DISTRIBUTION_COSINE,
+		DISTRIBUTION_CONE,
+		DISTRIBUTION_NARROW
+	};
+
+	/*
+		Name		DirectionTest
+		Syntax		DirectionTest
+		Brief		A distribution of directions and what its statistics should
+					be
+	*/
+	struct DirectionTest
+	{
+		const char* name;
+		Distribution distribution;
+		float cosAngle;				// Of the edge of the directions
+		bool cosine;				// Weighted by their cosine to the axis
+	};
+
+	const DirectionTest DIRECTION_TESTS[] =
+	{
+		{ "cube [0, 1)",	DISTRIBUTION_CUBE,			-1.0f,		false },
+		{ "sphere",			DISTRIBUTION_SPHERE,		-1.0f,		false },
+		{ "hemisphere",		DISTRIBUTION_HEMISPHERE,	0.0f,		false },
+		{ "cosine",			DISTRIBUTION_COSINE,		0.0f,		true },
+		{ "cone 30",		DISTRIBUTION_CONE,			0.8660254f,	false },
+		{ "cone 1",			DISTRIBUTION_NARROW,		0.9998477f,	false }
+	};
+
+	// The axis the directions are made about, off every coordinate axis
+	M3DVector3f directionAxis = { 0.26726124f, 0.53452248f, 0.80178373f };
+	int directionTest;
+
+	/*
+		Name		drawDirections
+		Syntax		drawDirections(const DirectionTest& test, M3DRandom* random,
+					float* x, float* y, float* z, int count, bool batched)
+		Brief		Draws count directions of a distribution, in a batch or one
+					at a time. The cube is the three floats of rand normalised,
+					as randUnitVector3 made them, about the z axis
+	*/
+	void drawDirections(const DirectionTest& test, M3DRandom* random, float* x, float* y,
+						float* z, int count, bool batched)
+	{
+		if (test.distribution == DISTRIBUTION_CUBE)
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				M3DVector3f v = { randFloat(), randFloat(), randFloat() };
+				m3dNormalizeVector3(v);
+				x[i] = v[0];
+				y[i] = v[1];
+				z[i] = v[2];
+			}
+		}
+		else if (batched)
+		{
+			switch (test.distribution)
+			{
+			case DISTRIBUTION_SPHERE:
+				m3dRandomUnitVectors3(random, x, y, z, count);
+				break;
+			case DISTRIBUTION_HEMISPHERE:
+				m3dRandomHemispheres3(random, directionAxis, x, y, z, count);
+				break;
+			case DISTRIBUTION_COSINE:
+				m3dRandomCosineHemispheres3(random, directionAxis, x, y, z, count);
+				break;
+			default:
+				m3dRandomCones3(random, directionAxis, test.cosAngle, x, y, z, count);
+				break;
+			}
+		}
+		else
+		{
+			for (int i = 0; i < count; ++i)
+			{
+				M3DVector3f v;
+				switch (test.distribution)
+				{
+				case DISTRIBUTION_SPHERE:
+					m3dRandomUnitVector3(random, v);
+					break;
+				case DISTRIBUTION_HEMISPHERE:
+					m3dRandomHemisphere3(random, directionAxis, v);
+					break;
+				case DISTRIBUTION_COSINE:
+					m3dRandomCosineHemisphere3(random, directionAxis, v);
+					break;
+				default:
+					m3dRandomCone3(random, directionAxis, test.cosAngle, v);
+					break;
+				}
+				x[i] = v[0];
+				y[i] = v[1];
+				z[i] = v[2];
+			}
+		}
+	}
+
+	void directionSingle()
+	{
+		drawDirections(DIRECTION_TESTS[directionTest], &randomBatch.random, randomBatch.x,
+					   randomBatch.y, randomBatch.z, BATCH_SIZE, false);
+	}
+
+	void directionBatch()
+	{
+		drawDirections(DIRECTION_TESTS[directionTest], &randomBatch.random, randomBatch.x,
+					   randomBatch.y, randomBatch.z, BATCH_SIZE, true);
+	}
+
+	/*
+		Name		DirectionStats
+		Syntax		DirectionStats
+		Brief		How far a million directions are from their distribution
+	*/
+	struct DirectionStats
+	{
+		double meanCos;				// Mean cosine to the axis
+		double meanSide;			// Length of their mean off the axis
+		float outside;				// Most a cosine is below the edge's
+		float lengthError;			// Most a length is from 1
+		double chiSquare;			// Over cells of height and angle
+	};
+
+	/*
+		Name		directionStats
+		Syntax		directionStats(const DirectionTest& test, const float* x,
+					const float* y, const float* z, int count,
+					DirectionStats* stats)
+		Brief		Takes the statistics of directions of a distribution
+		Details		The directions are split into cells by their angle about
+					the axis, and by their height up it mapped by the
+					distribution's own cumulative distribution, so that each
+					cell should hold as many as the others. The chi-square of
+					the counts is then as likely as not below 63, and below
+					103.4 but for one time in a thousand
+	*/
+	void directionStats(const DirectionTest& test, const float* x, const float* y,
+						const float* z, int count, DirectionStats* stats)
+	{
+		M3DVector3f axis = { 0.0f, 0.0f, 1.0f };
+		if (test.distribution != DISTRIBUTION_CUBE && test.distribution != DISTRIBUTION_SPHERE)
+			m3dCopyVector3(axis, directionAxis);
+
+		// Two sides at right angles to the axis, to measure the angle about it
+		M3DVector3f across = { 1.0f, 0.0f, 0.0f }, side, up;
+		if (fabsf(axis[0]) > 0.9f)
+			m3dLoadVector3(across, 0.0f, 1.0f, 0.0f);
+		m3dCrossProduct3(side, axis, across);
+		m3dNormalizeVector3(side);
+		m3dCrossProduct3(up, axis, side);
+
+		std::vector<int> cells(DIRECTION_CELLS * DIRECTION_CELLS, 0);
+		double sum[3] = { 0.0, 0.0, 0.0 };
+		double sumCos = 0.0;
+		stats->outside = 0.0f;
+		stats->lengthError = 0.0f;
+		for (int i = 0; i < count; ++i)
+		{
+			M3DVector3f v = { x[i], y[i], z[i] };
+			float length = m3dGetVectorLength3(v);
+			float error = fabsf(length - 1.0f);
+			stats->lengthError = error > stats->lengthError ? error : stats->lengthError;
+
+			float cosine = m3dDotProduct3(v, axis) / length;
+			float below = test.cosAngle - cosine;
+			stats->outside = below > stats->outside ? below : stats->outside;
+			sumCos += cosine;
+			sum[0] += v[0] - cosine * axis[0];
+			sum[1] += v[1] - cosine * axis[1];
+			sum[2] += v[2] - cosine * axis[2];
+
+			// Heights weighted by the cosine are spread as 1 - h^2, the
+			// others evenly from the edge's
+			float q = test.cosine ? 1.0f - cosine * cosine :
+						(1.0f - cosine) / (1.0f - test.cosAngle);
+			float angle = atan2f(m3dDotProduct3(v, up), m3dDotProduct3(v, side));
+			int row = (int)(q * DIRECTION_CELLS);
+			int column = (int)((angle / (float)M3D_2PI + 0.5f) * DIRECTION_CELLS);
+			row = row < 0 ? 0 : (row >= DIRECTION_CELLS ? DIRECTION_CELLS - 1 : row);
+			column = column < 0 ? 0 : (column >= DIRECTION_CELLS ? DIRECTION_CELLS - 1 : column);
+			++cells[row * DIRECTION_CELLS + column];
+		}
+
+		stats->meanCos = sumCos / count;
+		stats->meanSide = sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]) / count;
+		double expected = (double)count / cells.size();
+		stats->chiSquare = 0.0;
+		for (int i = 0; i < (int)cells.size(); ++i)
+			stats->chiSquare += (cells[i] - expected) * (cells[i] - expected) / expected;
+	}
+
+	/*
+		Name		runDirectionsBenchmark
+		Syntax		runDirectionsBenchmark(FILE* file)
+		Param		FILE* file - The report file
+		Brief		Checks random directions over the sphere, the hemisphere
+					uniformly and by cosine, and cones of 30 and 1 degrees
+					against their distributions, along with the normalised
+					cube randUnitVector3 once drew, and times each drawn one
+					at a time and in batches
+	*/
+	void runDirectionsBenchmark(FILE* file)
+	{
+#ifdef M3D_SSE
+		fprintf(file, "simd               sse2\n\n");
+#else
+		fprintf(file, "simd               none (scalar fallback)\n\n");
+#endif
+		const int tests = sizeof(DIRECTION_TESTS) / sizeof(DIRECTION_TESTS[0]);
+
+		// Batches must give the same directions as single draws, through
+		// both the SIMD loop and the scalar tail
+		const int SAME_COUNT = 1001;
+		std::vector<float> a(RANDOM_CHECKS), b(RANDOM_CHECKS), c(RANDOM_CHECKS);
+		std::vector<float> sa(SAME_COUNT), sb(SAME_COUNT), sc(SAME_COUNT);
+		bool same = true;
+		for (int t = 1; t < tests; ++t)
+		{
+			M3DRandom random;
+			m3dSeedRandom(&random, 5, t);
+			drawDirections(DIRECTION_TESTS[t], &random, &a[0], &b[0], &c[0], SAME_COUNT, true);
+			m3dSeedRandom(&random, 5, t);
+			drawDirections(DIRECTION_TESTS[t], &random, &sa[0], &sb[0], &sc[0], SAME_COUNT, false);
+			for (int i = 0; i < SAME_COUNT; ++i)
+				same = same && a[i] == sa[i] && b[i] == sb[i] && c[i] == sc[i];
+		}
+		fprintf(file, "batches            %s single draws\n\n", same ? "match" : "DIFFER FROM");
+
+		fprintf(file, "directions     mean cos (expected)   mean side    outside  length error"
+					  "   chi-square (< %.1f)\n", CHI_SQUARE_LIMIT);
+		srand(1);
+		for (int t = 0; t < tests; ++t)
+		{
+			const DirectionTest& test = DIRECTION_TESTS[t];
+			M3DRandom random;
+			m3dSeedRandom(&random, 1, t);
+			drawDirections(test, &random, &a[0], &b[0], &c[0], RANDOM_CHECKS, true);
+			DirectionStats stats;
+			directionStats(test, &a[0], &b[0], &c[0], RANDOM_CHECKS, &stats);
+
+			// The mean cosine is 2/3 weighted by cosine, else halfway from
+			// the edge's to 1
+			double expected = test.cosine ? 2.0 / 3.0 : (1.0 + test.cosAngle) / 2.0;
+			fprintf(file, "%-12s %9.5f (%8.5f) %11.5f %10.2g %13.2g %12.1f%s\n", test.name,
+					stats.meanCos, expected, stats.meanSide, stats.outside, stats.lengthError,
+					stats.chiSquare, stats.chiSquare < CHI_SQUARE_LIMIT ? "" : "  FAIL");
+		}
+
+		m3dSeedRandom(&randomBatch.random, 1, 0);
+		fprintf(file, "\ndirections       single ops/s    batch ops/s   speedup over cube\n");
+		double cube = 0.0;
+		for (directionTest = 0; directionTest < tests; ++directionTest)
+		{
+			double single = timeKernel(directionSingle, BATCH_SIZE);
+			double batch = timeKernel(directionBatch, BATCH_SIZE);
+			if (directionTest == 0)
+			{
+				cube = single;
+				fprintf(file, "%-12s %16.0f %14s\n", DIRECTION_TESTS[directionTest].name, single,
+						"-");
+			}
+			else
+			{
+				fprintf(file, "%-12s %16.0f %14.0f %8.2fx\n", DIRECTION_TESTS[directionTest].name,
+						single, batch, batch / cube);
+			}
+		}
+		sink = randomBatch.x[1] + randomBatch.y[1] + randomBatch.z[1];
+	}
+}
+
+/*
+	Name		runMathBenchmark
+	Syntax		runMathBenchmark(const BenchmarkOptions& options)
+	Param		const BenchmarkOptions& options - The benchmark options
+	Return		int - Zero if the benchmark ran and the report was written
+	Brief		Runs the math benchmark named by -bench without starting the
+				scene
+*/
+int runMathBenchmark(const BenchmarkOptions& options)
+{
+	FILE* file = 0;
+	if (fopen_s(&file, options.report.c_str(), "w") != 0)
+		return 1;
+
+	int result = 0;
+	if (options.bench == "matrix")
+	{
+		runMatrixBenchmark(file);
+	}
+	else if (options.bench == "batch")
+	{
+		runBatchBenchmark(file);
+	}
+	else if (options.bench == "ray")
+	{
+		runRayBenchmark(file);
+	}
+	else if (options.bench == "approx")
+	{
+		runApproxBenchmark(file);
+	}
+	else if (options.bench == "cull")
+	{
+		runCullBenchmark(file);
+	}
+	else if (options.bench == "bvh")
+	{
+		runBvhBenchmark(file);
+	}
+	else if (options.bench == "occlusion")
+	{
+		runOcclusionBenchmark(file);
+	}
+	else if (options.bench == "cascade")
+	{
+		runCascadeBenchmark(file);
+	}
+	else if (options.bench == "sort")
+	{
+		runSortBenchmark(file);
+	}
+	else if (options.bench == "particles")
+	{
+		runParticleBenchmark(file);
+	}
+	else if (options.bench == "emitters")
+	{
+		runEmitterBenchmark(file);
+	}
+	else if (options.bench == "weather")
+	{
+		runWeatherBenchmark(file);
+	}
+	else if (options.bench == "wind")
+	{
+		runWindBenchmark(file);
+	}
+	else if (options.bench == "pool")
+	{
+		runPoolBenchmark(file);
+	}
+	else if (options.bench == "random")
+	{
+		runRandomBenchmark(file);
+	}
+	else if (options.bench == "directions")
+	{
+		runDirectionsBenchmark(file);
+	}
+	else if (options.bench == "dds")
+	{
+		runTextureBenchmark(file);
+	}
+	else if (options.bench == "arrays")
+	{
+		runArrayBenchmark(file);
+	}
+	else
+	{
+		fprintf(file, "unknown benchmark %s\n", options.bench.c_str());
+		result = 1;
+	}
+
+	fclose(file);
+	return result;
+}
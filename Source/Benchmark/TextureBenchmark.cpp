@@ -0,0 +1,611 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		TextureBenchmark
+	Brief		Standalone benchmarks of loading the DDS textures and the
+				particle texture arrays, timing the ways of loading them
+				and the memory each uses
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <psapi.h>
+
+#include "Benchmark/Benchmark.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "Utility/DDSFile.hpp"
+#include "Utility/TextureArrays.hpp"
+#include "Renderer/RenderBackend.hpp"
+
+#pragma comment(lib, "psapi.lib")
+
+namespace
+{
+	volatile float sink;	// Keeps the files' bytes alive so that no touch is optimised away
+
+	const char* TEXTURE_ROOT = "Assets";		// Searched for DDS files
+	const UINT TEXTURE_RESIDENT_SIZE = 64;		// Mips streamed first, as models do
+	const int TEXTURE_RUNS = 5;					// The quickest run of each way is kept
+
+	/*
+		Name		findTextures
+		Syntax		findTextures(const std::string& directory,
+					std::vector<std::string>* files)
+		Param		const std::string& directory - The directory to search
+		Param		std::vector<std::string>* files - Receives the DDS files
+					in it and the directories below it
+	*/
+	void findTextures(const std::string& directory, std::vector<std::string>* files)
+	{
+		WIN32_FIND_DATAA found;
+		HANDLE find = FindFirstFileA((directory + "/*").c_str(), &found);
+		if (find == INVALID_HANDLE_VALUE)
+			return;
+
+		do
+		{
+			std::string name = found.cFileName;
+			if (name == "." || name == "..")
+				continue;
+
+			std::string path = directory + "/" + name;
+			if (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			{
+				findTextures(path, files);
+			}
+			else if (name.size() > 4)
+			{
+				std::string extension = name.substr(name.size() - 4);
+				std::transform(extension.begin(), extension.end(), extension.begin(), tolower);
+				if (extension == ".dds")
+					files->push_back(path);
+			}
+		}
+		while (FindNextFileA(find, &found));
+		FindClose(find);
+	}
+
+	/*
+		Name		formatName
+		Syntax		formatName(DXGI_FORMAT format)
+		Return		const char* - A short name for the formats the assets use
+	*/
+	const char* formatName(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:			return "BC1";
+		case DXGI_FORMAT_BC2_UNORM:			return "BC2";
+		case DXGI_FORMAT_BC3_UNORM:			return "BC3";
+		case DXGI_FORMAT_BC4_UNORM:			return "BC4";
+		case DXGI_FORMAT_BC5_UNORM:			return "BC5";
+		case DXGI_FORMAT_R8G8B8A8_UNORM:	return "RGBA8";
+		case DXGI_FORMAT_B8G8R8A8_UNORM:	return "BGRA8";
+		case DXGI_FORMAT_B8G8R8X8_UNORM:	return "BGRX8";
+		default:							return "other";
+		}
+	}
+
+	/*
+		Name		MemoryUse
+		Syntax		MemoryUse
+		Brief		Memory of the process, in bytes
+	*/
+	struct MemoryUse
+	{
+		double privateBytes;		// Committed to the process alone
+		double workingSet;			// In memory, counting mapped file pages
+	};
+
+	void getMemoryUse(MemoryUse* use)
+	{
+		PROCESS_MEMORY_COUNTERS_EX counters;
+		GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&counters,
+							 sizeof(counters));
+		use->privateBytes = (double)counters.PrivateUsage;
+		use->workingSet = (double)counters.WorkingSetSize;
+	}
+
+	enum TextureLoad
+	{
+		TEXTURE_READ,			// Read whole into memory
+		TEXTURE_MAP,			// Mapped and every mip touched
+		TEXTURE_MAP_LOW			// Mapped and the small mips touched
+	};
+
+	/*
+		Name		TextureRun
+		Syntax		TextureRun
+		Brief		The time and memory of loading every texture one way
+	*/
+	struct TextureRun
+	{
+		double seconds;
+		double restSeconds;			// To touch the large mips afterwards
+		double bytesTouched;
+		MemoryUse peak;				// Above the memory before loading
+	};
+
+	/*
+		Name		loadTextures
+		Syntax		loadTextures(const std::vector<std::string>& files,
+					TextureLoad load, TextureRun* run)
+		Brief		Loads every texture one way, keeping them all loaded as a
+					scene does, and measures the time taken and the most
+					memory used above what was used before
+		Details		Read textures are read whole into a buffer each, as any
+					loader that decodes or copies them first does. Mapped ones
+					are opened with DDSFile, reading only their headers, and
+					then have a byte of each page of their mips touched, so
+					that the system reads those pages in
+	*/
+	void loadTextures(const std::vector<std::string>& files, TextureLoad load, TextureRun* run)
+	{
+		__int64 countsPerSec, start, end;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+
+		MemoryUse before, now;
+		getMemoryUse(&before);
+		run->peak.privateBytes = 0.0;
+		run->peak.workingSet = 0.0;
+		run->bytesTouched = 0.0;
+		run->restSeconds = 0.0;
+
+		std::vector<std::vector<BYTE> > buffers(files.size());
+		std::vector<DDSFile*> mapped(files.size(), (DDSFile*)0);
+		UINT sum = 0;
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		for (int i = 0; i < (int)files.size(); ++i)
+		{
+			if (load == TEXTURE_READ)
+			{
+				FILE* in = 0;
+				if (fopen_s(&in, files[i].c_str(), "rb") == 0)
+				{
+					fseek(in, 0, SEEK_END);
+					buffers[i].resize(ftell(in));
+					fseek(in, 0, SEEK_SET);
+					if (!buffers[i].empty())
+						fread(&buffers[i][0], 1, buffers[i].size(), in);
+					fclose(in);
+					run->bytesTouched += buffers[i].size();
+				}
+			}
+			else
+			{
+				mapped[i] = new DDSFile;
+				if (mapped[i]->open(files[i]))
+				{
+					DDSFile& dds = *mapped[i];
+					UINT first = load == TEXTURE_MAP_LOW ? dds.getMipFor(TEXTURE_RESIDENT_SIZE) : 0;
+					sum += dds.pageIn(first, dds.getMipLevels() - 1);
+					for (UINT mip = first; mip < dds.getMipLevels(); ++mip)
+						run->bytesTouched += dds.getMipBytes(mip);
+				}
+			}
+
+			getMemoryUse(&now);
+			run->peak.privateBytes = max(run->peak.privateBytes,
+										 now.privateBytes - before.privateBytes);
+			run->peak.workingSet = max(run->peak.workingSet, now.workingSet - before.workingSet);
+		}
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+		run->seconds = (double)(end - start) / (double)countsPerSec;
+
+		// The large mips, as models fetch them when the camera comes near
+		if (load == TEXTURE_MAP_LOW)
+		{
+			QueryPerformanceCounter((LARGE_INTEGER*)&start);
+			for (int i = 0; i < (int)files.size(); ++i)
+			{
+				DDSFile& dds = *mapped[i];
+				if (!dds.isOpen())
+					continue;
+				UINT first = dds.getMipFor(TEXTURE_RESIDENT_SIZE);
+				if (first > 0)
+					sum += dds.pageIn(0, first - 1);
+			}
+			QueryPerformanceCounter((LARGE_INTEGER*)&end);
+			run->restSeconds = (double)(end - start) / (double)countsPerSec;
+		}
+
+		for (int i = 0; i < (int)files.size(); ++i)
+		{
+			if (!buffers[i].empty())
+				sum += buffers[i][buffers[i].size() - 1];
+			delete mapped[i];
+		}
+		sink = (float)sum;
+	}
+
+	// The particle effects whose texture arrays the states load
+	const char* const ARRAY_EFFECTS[] =
+	{
+		"Assets/Particles/Leaves.txt",
+		"Assets/Particles/Rain.txt",
+		"Assets/Particles/Snow.txt"
+	};
+	const int ARRAY_EFFECTS_NO = sizeof(ARRAY_EFFECTS) / sizeof(ARRAY_EFFECTS[0]);
+	const int ARRAY_USERS = 2;					// Systems asking for each array
+
+	enum ArrayLoad
+	{
+		ARRAY_STAGING,			// Each slice loaded by D3DX into a staging copy
+		ARRAY_BUILDER,			// TextureArrays, read on the calling thread
+		ARRAY_READ_AHEAD		// TextureArrays, read ahead on worker threads
+	};
+
+	/*
+		Name		ArrayRun
+		Syntax		ArrayRun
+		Brief		The time and memory of loading every array one way
+	*/
+	struct ArrayRun
+	{
+		double seconds;
+		UINT built;					// Arrays created
+		double arrayBytes;			// Of the arrays created
+		MemoryUse peak;				// Above the memory before loading
+	};
+
+	/*
+		Name		arrayBytes
+		Syntax		arrayBytes(ID3D10ShaderResourceView* view)
+		Param		ID3D10ShaderResourceView* view - A texture array
+		Return		double - Bytes of every mip of every slice, for the block
+					compressed formats and those of four bytes a pixel
+	*/
+	double arrayBytes(ID3D10ShaderResourceView* view)
+	{
+		ID3D10Resource* resource = 0;
+		view->GetResource(&resource);
+		D3D10_TEXTURE2D_DESC desc;
+		((ID3D10Texture2D*)resource)->GetDesc(&desc);
+		resource->Release();
+
+		UINT blockBytes = 0;
+		if (desc.Format == DXGI_FORMAT_BC1_UNORM)
+			blockBytes = 8;
+		else if (desc.Format == DXGI_FORMAT_BC2_UNORM || desc.Format == DXGI_FORMAT_BC3_UNORM)
+			blockBytes = 16;
+
+		double bytes = 0.0;
+		for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+		{
+			UINT width = max(1u, desc.Width >> mip);
+			UINT height = max(1u, desc.Height >> mip);
+			if (blockBytes)
+				bytes += ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+			else
+				bytes += width * height * 4;
+		}
+		return bytes * desc.ArraySize;
+	}
+
+	/*
+		Name		loadStagingArray
+		Syntax		loadStagingArray(RenderBackend* backend,
+					const std::vector<std::string>& fileNames)
+		Param		RenderBackend* backend - The backend to create it through
+		Param		const std::vector<std::string>& fileNames - A DDS file
+					for each slice
+		Return		ID3D10ShaderResourceView* - The array, or 0
+		Brief		Loads a texture array as the states once did, each slice
+					by D3DX into a staging texture converted to RGBA, mapped
+					and copied into the array a mip at a time
+	*/
+	ID3D10ShaderResourceView* loadStagingArray(RenderBackend* backend,
+											   const std::vector<std::string>& fileNames)
+	{
+		ID3D10Device* device = backend->getDevice();
+		UINT arraySize = (UINT)fileNames.size();
+		std::vector<ID3D10Texture2D*> srcTex(arraySize, (ID3D10Texture2D*)0);
+		ID3D10Texture2D* texArray = 0;
+		ID3D10ShaderResourceView* view = 0;
+		bool loaded = true;
+		for (UINT i = 0; i < arraySize && loaded; ++i)
+		{
+			D3DX10_IMAGE_LOAD_INFO loadInfo;
+			loadInfo.Width = D3DX10_FROM_FILE;
+			loadInfo.Height = D3DX10_FROM_FILE;
+			loadInfo.Depth = D3DX10_FROM_FILE;
+			loadInfo.FirstMipLevel = 0;
+			loadInfo.MipLevels = D3DX10_FROM_FILE;
+			loadInfo.Usage = D3D10_USAGE_STAGING;
+			loadInfo.BindFlags = 0;
+			loadInfo.CpuAccessFlags = D3D10_CPU_ACCESS_WRITE | D3D10_CPU_ACCESS_READ;
+			loadInfo.MiscFlags = 0;
+			loadInfo.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			loadInfo.Filter = D3DX10_FILTER_NONE;
+			loadInfo.MipFilter = D3DX10_FILTER_NONE;
+			loadInfo.pSrcInfo = 0;
+			loaded = SUCCEEDED(D3DX10CreateTextureFromFile(device, fileNames[i].c_str(), &loadInfo,
+														   0, (ID3D10Resource**)&srcTex[i], 0));
+		}
+
+		D3D10_TEXTURE2D_DESC desc;
+		if (loaded)
+		{
+			srcTex[0]->GetDesc(&desc);
+			desc.ArraySize = arraySize;
+			desc.Usage = D3D10_USAGE_DEFAULT;
+			desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+			desc.CPUAccessFlags = 0;
+			loaded = SUCCEEDED(backend->createTexture2D(&desc, 0, &texArray));
+		}
+
+		if (loaded)
+		{
+			for (UINT i = 0; i < arraySize; ++i)
+			{
+				for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+				{
+					D3D10_MAPPED_TEXTURE2D mapped;
+					srcTex[i]->Map(mip, D3D10_MAP_READ, 0, &mapped);
+					UINT rows = max(1u, desc.Height >> mip);
+					backend->updateSubresource(texArray, D3D10CalcSubresource(mip, i, desc.MipLevels),
+											   mapped.pData, mapped.RowPitch, mapped.RowPitch * rows);
+					srcTex[i]->Unmap(mip);
+				}
+			}
+
+			D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
+			viewDesc.Format = desc.Format;
+			viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+			viewDesc.Texture2DArray.MostDetailedMip = 0;
+			viewDesc.Texture2DArray.MipLevels = desc.MipLevels;
+			viewDesc.Texture2DArray.FirstArraySlice = 0;
+			viewDesc.Texture2DArray.ArraySize = arraySize;
+			if (FAILED(device->CreateShaderResourceView(texArray, &viewDesc, &view)))
+				view = 0;
+		}
+
+		if (texArray)
+			texArray->Release();
+		for (UINT i = 0; i < arraySize; ++i)
+		{
+			if (srcTex[i])
+				srcTex[i]->Release();
+		}
+		return view;
+	}
+
+	/*
+		Name		loadArrays
+		Syntax		loadArrays(RenderBackend* backend,
+					const std::vector<std::vector<std::string> >& arrays,
+					ArrayLoad load, ArrayRun* run)
+		Brief		Loads the array of each effect for each of its users one
+					way, keeping them all loaded, and measures the time taken
+					and the most memory used above what was used before
+		Details		The staging loads build an array for every user, as each
+					state built its own. The builder shares one between the
+					users, and when reading ahead starts every read before
+					the first array is acquired, as the states do before
+					loading their geometry
+	*/
+	void loadArrays(RenderBackend* backend, const std::vector<std::vector<std::string> >& arrays,
+					ArrayLoad load, ArrayRun* run)
+	{
+		__int64 countsPerSec, start, end;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+
+		MemoryUse before, now;
+		getMemoryUse(&before);
+		run->peak.privateBytes = 0.0;
+		run->peak.workingSet = 0.0;
+		run->built = 0;
+		run->arrayBytes = 0.0;
+
+		TextureArrays textureArrays;
+		textureArrays.initialise(backend);
+		std::vector<ID3D10ShaderResourceView*> views;
+
+		QueryPerformanceCounter((LARGE_INTEGER*)&start);
+		if (load == ARRAY_READ_AHEAD)
+		{
+			for (int a = 0; a < (int)arrays.size(); ++a)
+				textureArrays.prefetch(arrays[a]);
+		}
+		for (int a = 0; a < (int)arrays.size(); ++a)
+		{
+			for (int user = 0; user < ARRAY_USERS; ++user)
+			{
+				ID3D10ShaderResourceView* view = 0;
+				if (load == ARRAY_STAGING)
+				{
+					view = loadStagingArray(backend, arrays[a]);
+					if (view)
+					{
+						++run->built;
+						run->arrayBytes += arrayBytes(view);
+					}
+				}
+				else
+				{
+					UINT built = textureArrays.getArraysBuilt();
+					view = textureArrays.acquire(arrays[a]);
+					if (textureArrays.getArraysBuilt() != built)
+					{
+						++run->built;
+						run->arrayBytes += arrayBytes(view);
+					}
+				}
+				views.push_back(view);
+
+				getMemoryUse(&now);
+				run->peak.privateBytes = max(run->peak.privateBytes,
+											 now.privateBytes - before.privateBytes);
+				run->peak.workingSet = max(run->peak.workingSet, now.workingSet - before.workingSet);
+			}
+		}
+		QueryPerformanceCounter((LARGE_INTEGER*)&end);
+		run->seconds = (double)(end - start) / (double)countsPerSec;
+
+		for (int i = 0; i < (int)views.size(); ++i)
+		{
+			if (load == ARRAY_STAGING)
+			{
+				if (views[i])
+					views[i]->Release();
+			}
+			else
+			{
+				textureArrays.release(views[i]);
+			}
+		}
+	}
+}
+
+/*
+	Name		runTextureBenchmark
+	Syntax		runTextureBenchmark(FILE* file)
+	Param		FILE* file - The report file
+	Brief		Lists every DDS file in the assets with its format, size
+				and mips, then loads them all by reading them whole, by
+				mapping them and touching every mip, and by mapping them
+				and touching only the small mips, giving the time and the
+				most memory used by each
+	Details		An untimed pass first reads every file, so the runs load
+				from the system's file cache rather than the disk. Each way
+				is run a few times and the quickest kept
+*/
+void runTextureBenchmark(FILE* file)
+{
+	std::vector<std::string> files;
+	findTextures(TEXTURE_ROOT, &files);
+	std::sort(files.begin(), files.end());
+
+	fprintf(file, "texture                                          format   size     mips items"
+				  "        bytes        resident\n");
+	double total = 0.0;
+	for (int i = 0; i < (int)files.size(); ++i)
+	{
+		DDSFile dds;
+		if (!dds.open(files[i]))
+		{
+			fprintf(file, "%-48s unreadable\n", files[i].c_str());
+			continue;
+		}
+		UINT first = dds.getMipFor(TEXTURE_RESIDENT_SIZE);
+		UINT lowBytes = 0;
+		for (UINT mip = first; mip < dds.getMipLevels(); ++mip)
+			lowBytes += dds.getMipBytes(mip);
+		fprintf(file, "%-48s %-6s %4ux%-4u %4u %5u %12u %15u\n", files[i].c_str(),
+				formatName(dds.getFormat()), dds.getWidth(), dds.getHeight(),
+				dds.getMipLevels(), dds.getArraySize(), dds.getFileSize(), lowBytes);
+		total += dds.getFileSize();
+	}
+	fprintf(file, "%d files, %.2f MB\n\n", (int)files.size(), total / (1024.0 * 1024.0));
+
+	TextureRun warm;
+	loadTextures(files, TEXTURE_READ, &warm);
+
+	const struct
+	{
+		const char* name;
+		TextureLoad load;
+	}
+	LOADS[] =
+	{
+		{ "read whole",		TEXTURE_READ },
+		{ "map, all mips",	TEXTURE_MAP },
+		{ "map, small mips",	TEXTURE_MAP_LOW }
+	};
+
+	const double MB = 1024.0 * 1024.0;
+	fprintf(file, "load                  ms    MB touched   peak private MB   peak working MB"
+				  "   large mips ms\n");
+	for (int l = 0; l < 3; ++l)
+	{
+		TextureRun quickest;
+		for (int r = 0; r < TEXTURE_RUNS; ++r)
+		{
+			TextureRun run;
+			loadTextures(files, LOADS[l].load, &run);
+			if (r == 0 || run.seconds + run.restSeconds < quickest.seconds + quickest.restSeconds)
+				quickest = run;
+		}
+		fprintf(file, "%-16s %8.3f %13.2f %17.2f %17.2f", LOADS[l].name,
+				quickest.seconds * 1000.0, quickest.bytesTouched / MB,
+				quickest.peak.privateBytes / MB, quickest.peak.workingSet / MB);
+		if (LOADS[l].load == TEXTURE_MAP_LOW)
+			fprintf(file, " %15.3f", quickest.restSeconds * 1000.0);
+		fprintf(file, "\n");
+	}
+}
+
+/*
+	Name		runArrayBenchmark
+	Syntax		runArrayBenchmark(FILE* file)
+	Param		FILE* file - The report file
+	Brief		Loads the particle effects' texture arrays on the null
+				device as the states once did, through staging copies,
+				and through TextureArrays with and without reading ahead,
+				giving the time, the arrays built and the most memory
+				used by each
+	Details		Each effect's array is asked for by two systems. An
+				untimed pass first loads every array, so the runs load
+				from the system's file cache rather than the disk. Each
+				way is run a few times and the quickest kept
+*/
+void runArrayBenchmark(FILE* file)
+{
+	NullBackend backend;
+	if (!backend.initialise(0, 64, 64))
+	{
+		fprintf(file, "the null device could not be created\n");
+		return;
+	}
+
+	std::vector<std::vector<std::string> > arrays;
+	for (int e = 0; e < ARRAY_EFFECTS_NO; ++e)
+	{
+		ParticleEffect effect;
+		if (effect.load(ARRAY_EFFECTS[e]))
+		{
+			arrays.push_back(effect.getTextures());
+			fprintf(file, "%-32s %u slices\n", ARRAY_EFFECTS[e],
+					(UINT)effect.getTextures().size());
+		}
+	}
+	fprintf(file, "%d arrays, each for %d systems\n\n", (int)arrays.size(), ARRAY_USERS);
+
+	ArrayRun warm;
+	loadArrays(&backend, arrays, ARRAY_STAGING, &warm);
+
+	const struct
+	{
+		const char* name;
+		ArrayLoad load;
+	}
+	LOADS[] =
+	{
+		{ "staging copies",	ARRAY_STAGING },
+		{ "builder",		ARRAY_BUILDER },
+		{ "read ahead",		ARRAY_READ_AHEAD }
+	};
+
+	const double KB = 1024.0;
+	fprintf(file, "load                ms   arrays built   array KB   peak private KB"
+				  "   peak working KB\n");
+	for (int l = 0; l < 3; ++l)
+	{
+		ArrayRun quickest;
+		for (int r = 0; r < TEXTURE_RUNS; ++r)
+		{
+			ArrayRun run;
+			loadArrays(&backend, arrays, LOADS[l].load, &run);
+			if (r == 0 || run.seconds < quickest.seconds)
+				quickest = run;
+		}
+		fprintf(file, "%-14s %8.3f %14u %10.1f %17.1f %17.1f\n", LOADS[l].name,
+				quickest.seconds * 1000.0, quickest.built, quickest.arrayBytes / KB,
+				quickest.peak.privateBytes / KB, quickest.peak.workingSet / KB);
+	}
+}
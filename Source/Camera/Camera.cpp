@@ -8,7 +8,26 @@
 */
 
 #include "Camera/Camera.hpp"
+#include <math.h>
+#include "Geometry/Terrain.hpp"
 #include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	// Bases the camera is rotated from. Plain D3DVECTORs so that they are
+	// constant data rather than constructed at startup
+	const D3DVECTOR DEFAULT_FRONT = { 0.0f, 0.0f, 1.0f };
+	const D3DVECTOR DEFAULT_RIGHT = { 1.0f, 0.0f, 0.0f };
+
+	const float SMOOTHING_TIME = 0.15f;		// Seconds to close most of the gap to
+											// the velocity asked for
+	const float EYE_HEIGHT = 10.0f;			// Height kept above the terrain
+	const float MIN_HINT_SPEED = 1.0f;		// Slower than this the hints are not scored
+	const float SHADOW_DISTANCE = 1000.0f;	// View depth shadows are drawn to
+}
+
+const float Camera::LOOKAHEAD_TIMES[Camera::LOOKAHEAD_NO] = { 0.5f, 1.0f, 2.0f };
 
 /*
 	Name		Camera::Camera
@@ -16,10 +35,14 @@
 	Brief		Camera constructor initialises member variables
 */
 Camera::Camera()
-: position_(0, 0, 0), target_(0, 0, 1), up_(0, 1, 0), front_(0, 0, 1), 
-  right_(1, 0, 0), DEFAULT_FRONT(0, 0, 1), DEFAULT_RIGHT(1, 0, 0), zoomFactor_(1)
+: position_(0, 0, 0), velocity_(0, 0, 0), moveStep_(0, 0, 0), look_(0, 0, 1), 
+  target_(0, 0, 1), up_(0, 1, 0), front_(0, 0, 1), right_(1, 0, 0), zoomFactor_(1), 
+  ground_(0), time_(0.0)
 {
-	update();
+	update(0.0f);
+	publish();
+	publish();
+	apply(1.0f);
 }
 
 /*
@@ -34,13 +57,79 @@ Camera::~Camera()
 
 /*
 	Name		Camera::update
-	Syntax		Camera::update()
+	Syntax		Camera::update(float dt)
+	Param		float dt - Length of the simulation step
 	Brief		Updates the camera
+	Details		Eases the velocity toward the movement asked for in the step
+				and moves by it, keeps above the ground, then ends the step by
+				storing the camera pose and look ahead hints. The view and
+				projection matrices are only built from the pose by apply
+*/
+void Camera::update(float dt)
+{
+	PROFILE_ZONE("Camera::update");
+
+	if (dt > 0.0f)
+	{
+		D3DXVECTOR3 wanted = moveStep_ / dt;
+		velocity_ += (wanted - velocity_) * (1.0f - expf(-dt / SMOOTHING_TIME));
+		if (D3DXVec3LengthSq(&velocity_) < 1e-4f)
+			velocity_ = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+
+		position_ += velocity_ * dt;
+		time_ += dt;
+	}
+	moveStep_ = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+
+	followGround();
+	target_ = position_ + look_;
+
+	setLookAhead();
+	scoreLookAhead();
+
+	stepPose_.position = position_;
+	stepPose_.target = target_;
+	stepPose_.up = up_;
+	stepPose_.zoomFactor = zoomFactor_;
+}
+
+/*
+	Name		Camera::publish
+	Syntax		Camera::publish()
+	Brief		Hands the pose of the last simulation step over to rendering
+	Details		Called once per simulation step, so the previous pose is 
+				always one step behind the current one
 */
-void Camera::update()
+void Camera::publish()
 {
+	previousPose_ = currentPose_;
+	currentPose_ = stepPose_;
+
+	for (int h = 0; h < LOOKAHEAD_NO; ++h)
+		publishedHints_[h] = stepHints_[h];
+}
+
+/*
+	Name		Camera::apply
+	Syntax		Camera::apply(float alpha)
+	Param		float alpha - Fraction of a step to interpolate from the 
+				previous pose to the current one
+	Brief		Interpolates the published poses and sets the view and
+				projection matrices for rendering
+*/
+void Camera::apply(float alpha)
+{
+	D3DXVec3Lerp(&renderPose_.position, &previousPose_.position, 
+				 &currentPose_.position, alpha);
+	D3DXVec3Lerp(&renderPose_.target, &previousPose_.target, 
+				 &currentPose_.target, alpha);
+	D3DXVec3Lerp(&renderPose_.up, &previousPose_.up, &currentPose_.up, alpha);
+	renderPose_.zoomFactor = previousPose_.zoomFactor + 
+		(currentPose_.zoomFactor - previousPose_.zoomFactor) * alpha;
+
 	setCameraViewMatrix();
 	setCameraProjectionMatrix();
+	setFrustum();
 }
 
 /*
@@ -48,14 +137,13 @@ void Camera::update()
 	Syntax		Camera::move(float moveX, float moveZ)
 	Param		float moveX - Distance to move the camera along its x-axis
 	Param		float moveZ - Distance to move the camera along its z-axis
-	Brief		Moves the camera
+	Brief		Asks for the camera to move
+	Details		The movement is taken up by update, which smooths it
 */
 void Camera::move(float moveX, float moveZ)
 {
-	position_ += moveX * right_;
-	position_ += moveZ * front_;
-
-	target_ += position_ + target_;
+	moveStep_ += moveX * right_;
+	moveStep_ += moveZ * front_;
 }
 
 /*
@@ -71,14 +159,15 @@ void Camera::rotate(float yaw, float pitch, float roll)
 {
 	// Update camera rotation matrix and find new Target and Up vectors
 	D3DXMatrixRotationYawPitchRoll(&rotationMatrix_, yaw, pitch, roll);
-	D3DXVec3TransformCoord(&target_, &DEFAULT_FRONT, &rotationMatrix_);
+	D3DXVec3TransformNormal(&look_, (const D3DXVECTOR3*)&DEFAULT_FRONT, &rotationMatrix_);
+	target_ = position_ + look_;
 
 	// Find new Right and Front vectors - Moving only on the x and z axes
 	D3DXMATRIX rotateY;
 	D3DXMatrixRotationY(&rotateY, yaw);
-	D3DXVec3TransformNormal(&right_, &DEFAULT_RIGHT, &rotateY);
+	D3DXVec3TransformNormal(&right_, (const D3DXVECTOR3*)&DEFAULT_RIGHT, &rotateY);
 	D3DXVec3TransformNormal(&up_, &up_, &rotateY);
-	D3DXVec3TransformNormal(&front_, &DEFAULT_FRONT, &rotationMatrix_);
+	D3DXVec3TransformNormal(&front_, (const D3DXVECTOR3*)&DEFAULT_FRONT, &rotationMatrix_);
 }
 
 /*
@@ -100,6 +189,20 @@ void Camera::zoom(float direction)
 	}
 }
 
+/*
+	Name		Camera::setGround
+	Syntax		Camera::setGround(const Terrain* terrain)
+	Param		const Terrain* terrain - Terrain to keep above, or 0 for none
+	Brief		Sets the terrain the camera cannot go below, and whose cells
+				the look ahead hints name
+*/
+void Camera::setGround(const Terrain* terrain)
+{
+	ground_ = terrain;
+	for (int h = 0; h < LOOKAHEAD_NO; ++h)
+		pending_[h].clear();
+}
+
 /*
 	Name		Camera::setCameraViewMatrix
 	Syntax		Camera::setCameraViewMatrix()
@@ -109,7 +212,8 @@ void Camera::setCameraViewMatrix()
 {
 	// Create the view matrix
 	D3DXMATRIX view;
-	D3DXMatrixLookAtLH(&view, &position_, &target_, &up_);
+	D3DXMatrixLookAtLH(&view, &renderPose_.position, &renderPose_.target, 
+					   &renderPose_.up);
 
 	// Set the view matrix
 	Scene::instance()->setView(view);
@@ -124,8 +228,122 @@ void Camera::setCameraProjectionMatrix()
 {
 	// Create the projection matrix
 	D3DXMATRIX projection;
-	D3DXMatrixPerspectiveFovLH(&projection, (float)D3DX_PI * 0.25f, Scene::instance()->getAspect(), 1.0f, 5000.0f * zoomFactor_);
+	D3DXMatrixPerspectiveFovLH(&projection, (float)D3DX_PI * 0.25f, Scene::instance()->getAspect(), 1.0f, 5000.0f * renderPose_.zoomFactor);
 
 	// Set the projection matrix
 	Scene::instance()->setProjection(projection);
-}
\ No newline at end of file
+}
+
+/*
+	Name		Camera::setFrustum
+	Syntax		Camera::setFrustum()
+	Brief		Extracts the world space frustum from the view and projection
+				matrices just set, for culling the frame
+*/
+void Camera::setFrustum()
+{
+	viewProj_ = Scene::instance()->getView() * Scene::instance()->getProjection();
+	m3dExtractFrustum(&frustum_, viewProj_);
+}
+
+/*
+	Name		Camera::fitShadowCascades
+	Syntax		Camera::fitShadowCascades(M3DCascadeSet* cascades,
+				const D3DXVECTOR3& lightDir) const
+	Param		M3DCascadeSet* cascades - The cascades to fit
+	Param		const D3DXVECTOR3& lightDir - Unit direction the light travels
+	Return		int - Number of cascades whose shadow maps must be drawn
+	Brief		Fits a light's shadow cascades to the pose being rendered
+*/
+int Camera::fitShadowCascades(M3DCascadeSet* cascades, const D3DXVECTOR3& lightDir) const
+{
+	D3DXVECTOR3 forward = renderPose_.target - renderPose_.position;
+	D3DXVec3Normalize(&forward, &forward);
+
+	return m3dUpdateCascades(cascades, renderPose_.position, forward, tanf((float)D3DX_PI * 0.125f),
+							 Scene::instance()->getAspect(), 1.0f, SHADOW_DISTANCE, lightDir);
+}
+
+/*
+	Name		Camera::followGround
+	Syntax		Camera::followGround()
+	Brief		Lifts the camera to eye height over the terrain if it has
+				gone lower, and stops it moving further down
+*/
+void Camera::followGround()
+{
+	float height;
+	if (!ground_ || !ground_->getHeight(position_.x, position_.z, &height))
+		return;
+
+	if (position_.y < height + EYE_HEIGHT)
+	{
+		position_.y = height + EYE_HEIGHT;
+		velocity_.y = max(velocity_.y, 0.0f);
+	}
+}
+
+/*
+	Name		Camera::setLookAhead
+	Syntax		Camera::setLookAhead()
+	Brief		Predicts where the camera will be at each hint's time from
+				its smoothed velocity, kept above the ground as it would be
+*/
+void Camera::setLookAhead()
+{
+	for (int h = 0; h < LOOKAHEAD_NO; ++h)
+	{
+		LookAheadHint& hint = stepHints_[h];
+		hint.time = LOOKAHEAD_TIMES[h];
+		hint.position = position_ + velocity_ * hint.time;
+		hint.cell = -1;
+
+		float height;
+		if (ground_ && ground_->getHeight(hint.position.x, hint.position.z, &height))
+		{
+			hint.position.y = max(hint.position.y, height + EYE_HEIGHT);
+			hint.cell = ground_->getCell(hint.position.x, hint.position.z);
+		}
+	}
+}
+
+/*
+	Name		Camera::scoreLookAhead
+	Syntax		Camera::scoreLookAhead()
+	Brief		Scores the hints whose time is up against the cell the camera
+				is over, then queues the hints of this step
+	Details		Each hint is also scored as if it had named the cell the
+				camera was over when it was given, which is what prefetching
+				around the camera alone would load. Hints given while the
+				camera is all but still are left out, as both score alike
+*/
+void Camera::scoreLookAhead()
+{
+	if (!ground_)
+		return;
+
+	int cell = ground_->getCell(position_.x, position_.z);
+	for (int h = 0; h < LOOKAHEAD_NO; ++h)
+	{
+		// Steps may not add up to the hint's time exactly
+		std::deque<PendingPrefetch>& pending = pending_[h];
+		while (!pending.empty() && pending.front().due <= time_ + 1e-3)
+		{
+			if (cell >= 0)
+			{
+				Scene::instance()->addPrefetchResult(h, pending.front().cell == cell, 
+													 pending.front().stillCell == cell);
+			}
+			pending.pop_front();
+		}
+	}
+
+	if (cell < 0 || D3DXVec3Length(&velocity_) < MIN_HINT_SPEED)
+		return;
+
+	for (int h = 0; h < LOOKAHEAD_NO; ++h)
+	{
+		PendingPrefetch prefetch = { time_ + LOOKAHEAD_TIMES[h], stepHints_[h].cell, cell };
+		pending_[h].push_back(prefetch);
+	}
+}
@@ -11,32 +11,127 @@
 #define CAMERA_H
 
 #include <d3dx10.h>
+#include <deque>
+#include "Maths/m3dCull.h"
+#include "Maths/m3dCascade.h"
+
+class Terrain;
+
+/*
+	Name		CameraPose
+	Syntax		CameraPose
+	Brief		The camera state needed to render a frame
+*/
+struct CameraPose
+{
+	D3DXVECTOR3 position;
+	D3DXVECTOR3 target;
+	D3DXVECTOR3 up;
+	float zoomFactor;
+};
+
+/*
+	Name		LookAheadHint
+	Syntax		LookAheadHint
+	Brief		Where the camera is expected to be a little while ahead, for
+				whatever loads or picks detail by camera position to get
+				ready for
+*/
+struct LookAheadHint
+{
+	D3DXVECTOR3 position;
+	float time;			// Seconds ahead
+	int cell;			// Terrain cell below position, -1 if off the terrain
+};
 
 class Camera
 {
 public:
 	Camera();		// Initialises mCameraPos (0, 0, 6) and mCameraView (0, 0, -6) (looking at the origin)
 	~Camera();	
-	void update();
+	void update(float dt);
 	void move(float moveX, float moveZ);
 	void rotate(float yaw, float pitch, float roll);
 	void zoom(float direction);
+	void setGround(const Terrain* terrain);
 	D3DXVECTOR3 getPosition() const { return position_; };
+	D3DXVECTOR3 getVelocity() const { return velocity_; };
+
+	// Simulation to render hand over
+	void publish();
+	void apply(float alpha);
+	D3DXVECTOR3 getRenderPosition() const { return renderPose_.position; };
+	const M3DFrustum& getFrustum() const { return frustum_; };
+	const D3DXMATRIX& getViewProj() const { return viewProj_; };
+	const LookAheadHint* getLookAhead() const { return publishedHints_; };
+	int fitShadowCascades(M3DCascadeSet* cascades, const D3DXVECTOR3& lightDir) const;
+
+	static const int LOOKAHEAD_NO = 3;
+	static const float LOOKAHEAD_TIMES[LOOKAHEAD_NO];
 	
 private:
+	/*
+		Name		PendingPrefetch
+		Syntax		PendingPrefetch
+		Brief		A hint waiting to be scored against where the camera
+					really is once its time is up
+	*/
+	struct PendingPrefetch
+	{
+		double due;
+		int cell;			// Cell the hint asked for
+		int stillCell;		// Cell the camera was over when it was given
+	};
+
 	void setCameraViewMatrix();
 	void setCameraProjectionMatrix();
+	void setFrustum();
+	void followGround();
+	void setLookAhead();
+	void scoreLookAhead();
+
+	CameraPose stepPose_;		// Pose at the end of the last simulation step
+	CameraPose previousPose_;	// Published poses of the last two steps
+	CameraPose currentPose_;
+	CameraPose renderPose_;		// Pose interpolated for the frame being rendered
+	M3DFrustum frustum_;		// World space frustum of renderPose_
+	D3DXMATRIX viewProj_;		// View and projection of renderPose_
 	D3DXVECTOR3 position_;
+	D3DXVECTOR3 velocity_;		// Smoothed velocity, in units a second
+	D3DXVECTOR3 moveStep_;		// Movement asked for since the last update
+	D3DXVECTOR3 look_;			// Unit direction the camera faces
 	D3DXVECTOR3 target_;	
 	D3DXVECTOR3 up_;
 	D3DXVECTOR3 front_;
 	D3DXVECTOR3 right_;
-	const D3DXVECTOR3 DEFAULT_FRONT;
-	const D3DXVECTOR3 DEFAULT_RIGHT;
 
 	D3DXMATRIX rotationMatrix_;
 
 	float zoomFactor_;
+
+	const Terrain* ground_;		// Terrain the camera stays above, if set
+	double time_;				// Seconds simulated
+
+	LookAheadHint stepHints_[LOOKAHEAD_NO];
+	LookAheadHint publishedHints_[LOOKAHEAD_NO];
+	std::deque<PendingPrefetch> pending_[LOOKAHEAD_NO];
+};
+
+/*
+	Name		PrefetchStats
+	Syntax		PrefetchStats
+	Brief		Counters for how often the look ahead hints named the terrain
+				cell the camera really reached, by hint
+*/
+struct PrefetchStats
+{
+	PrefetchStats() { reset(); }
+	void reset() { ZeroMemory(this, sizeof(PrefetchStats)); }
+
+	UINT64 hints[Camera::LOOKAHEAD_NO];
+	UINT64 hits[Camera::LOOKAHEAD_NO];
+	UINT64 stillHits[Camera::LOOKAHEAD_NO];	// Hits had the hint been where the
+											// camera was when it was given
 };
 
 #endif
\ No newline at end of file
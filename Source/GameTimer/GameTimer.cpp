@@ -3,20 +3,53 @@
 //=======================================================================================
 
 #include "GameTimer.h"
+
+#ifdef _WIN32
 #include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <time.h>
+#endif
 
 GameTimer::GameTimer()
-: mSecondsPerCount(0.0), mDeltaTime(-1.0), mBaseTime(0), 
-  mPausedTime(0), mPrevTime(0), mCurrTime(0), mStopped(false)
+: mSecondsPerTick(0.0), mDeltaTime(-1.0), mDeltaTicks(0), mBaseTime(0),
+  mPausedTime(0), mStopTime(0), mPrevTime(0), mCurrTime(0), mFixedStep(0),
+  mAccumulator(0), mMinFrameTicks(0), mStopped(false)
+{
+	mSecondsPerTick = 1.0 / (double)ticksPerSecond();
+}
+
+// Reads the monotonic clock.  QueryPerformanceCounter on Windows and
+// CLOCK_MONOTONIC elsewhere; neither jumps when the wall clock is changed.
+TimerTicks GameTimer::now()
 {
-	__int64 countsPerSec;
-	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
-	mSecondsPerCount = 1.0 / (double)countsPerSec;
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (TimerTicks)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+TimerTicks GameTimer::ticksPerSecond()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return frequency.QuadPart;
+#else
+	return 1000000000LL;
+#endif
 }
 
 // Returns the total time elapsed since reset() was called, NOT counting any
-// time when the clock is stopped.
-float GameTimer::getGameTime()const
+// time when the clock is stopped.  Returned as a double, since a float of
+// seconds is only accurate to about a millisecond after a few hours.
+double GameTimer::getGameTime()const
 {
 	// If we are stopped, do not count the time that has passed since we stopped.
 	//
@@ -25,22 +58,22 @@ float GameTimer::getGameTime()const
 
 	if( mStopped )
 	{
-		return (float)((mStopTime - mBaseTime)*mSecondsPerCount);
+		return (double)(mStopTime - mPausedTime - mBaseTime)*mSecondsPerTick;
 	}
 
 	// The distance mCurrTime - mBaseTime includes paused time,
-	// which we do not want to count.  To correct this, we can subtract 
-	// the paused time from mCurrTime:  
+	// which we do not want to count.  To correct this, we can subtract
+	// the paused time from mCurrTime:
 	//
-	//  (mCurrTime - mPausedTime) - mBaseTime 
+	//  (mCurrTime - mPausedTime) - mBaseTime
 	//
 	//                     |<-------d------->|
 	// ----*---------------*-----------------*------------*------> time
 	//  mBaseTime       mStopTime        startTime     mCurrTime
-	
+
 	else
 	{
-		return (float)(((mCurrTime-mPausedTime)-mBaseTime)*mSecondsPerCount);
+		return (double)((mCurrTime-mPausedTime)-mBaseTime)*mSecondsPerTick;
 	}
 }
 
@@ -49,32 +82,37 @@ float GameTimer::getDeltaTime()const
 	return (float)mDeltaTime;
 }
 
+TimerTicks GameTimer::getDeltaTicks()const
+{
+	return mDeltaTicks;
+}
+
 void GameTimer::reset()
 {
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	TimerTicks currTime = now();
 
 	mBaseTime = currTime;
 	mPrevTime = currTime;
+	mCurrTime = currTime;
+	mPausedTime = 0;
 	mStopTime = 0;
+	mAccumulator = 0;
 	mStopped  = false;
 }
 
 void GameTimer::start()
 {
-	__int64 startTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
-
+	TimerTicks startTime = now();
 
 	// Accumulate the time elapsed between stop and start pairs.
 	//
 	//                     |<-------d------->|
 	// ----*---------------*-----------------*------------> time
-	//  mBaseTime       mStopTime        startTime     
+	//  mBaseTime       mStopTime        startTime
 
 	if( mStopped )
 	{
-		mPausedTime += (startTime - mStopTime);	
+		mPausedTime += (startTime - mStopTime);
 
 		mPrevTime = startTime;
 		mStopTime = 0;
@@ -86,10 +124,7 @@ void GameTimer::stop()
 {
 	if( !mStopped )
 	{
-		__int64 currTime;
-		QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
-
-		mStopTime = currTime;
+		mStopTime = now();
 		mStopped  = true;
 	}
 }
@@ -99,25 +134,132 @@ void GameTimer::tick()
 	if( mStopped )
 	{
 		mDeltaTime = 0.0;
+		mDeltaTicks = 0;
 		return;
 	}
 
-	__int64 currTime;
-	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
-	mCurrTime = currTime;
+	mCurrTime = now();
 
 	// Time difference between this frame and the previous.
-	mDeltaTime = (mCurrTime - mPrevTime)*mSecondsPerCount;
+	mDeltaTicks = mCurrTime - mPrevTime;
 
 	// Prepare for next frame.
 	mPrevTime = mCurrTime;
 
-	// Force nonnegative.  The DXSDK's CDXUTTimer mentions that if the 
+	// Force nonnegative.  The DXSDK's CDXUTTimer mentions that if the
 	// processor goes into a power save mode or we get shuffled to another
 	// processor, then mDeltaTime can be negative.
-	if(mDeltaTime < 0.0)
+	if(mDeltaTicks < 0)
 	{
-		mDeltaTime = 0.0;
+		mDeltaTicks = 0;
+	}
+	mDeltaTime = (double)mDeltaTicks*mSecondsPerTick;
+
+	if(mFixedStep > 0)
+	{
+		mAccumulator += mDeltaTicks;
+	}
+}
+
+void GameTimer::setFixedStep(double seconds)
+{
+	mFixedStep = seconds > 0.0 ? (TimerTicks)(seconds / mSecondsPerTick) : 0;
+	mAccumulator = 0;
+}
+
+double GameTimer::getFixedStep()const
+{
+	return (double)mFixedStep*mSecondsPerTick;
+}
+
+// Takes one fixed step from the accumulator.  Call in a loop after tick():
+//
+//	while(timer.stepFixed())
+//		update(timer.getFixedStep());
+bool GameTimer::stepFixed()
+{
+	if(mFixedStep <= 0 || mAccumulator < mFixedStep)
+	{
+		return false;
 	}
+
+	mAccumulator -= mFixedStep;
+	return true;
+}
+
+float GameTimer::getStepAlpha()const
+{
+	if(mFixedStep <= 0)
+	{
+		return 1.0f;
+	}
+	return (float)((double)mAccumulator / (double)mFixedStep);
+}
+
+// Used to cap catch-up after a long frame: rather than simulating every
+// step that has built up, the whole steps are thrown away.
+void GameTimer::dropSteps()
+{
+	if(mFixedStep > 0)
+	{
+		mAccumulator %= mFixedStep;
+	}
+}
+
+void GameTimer::setFrameCap(double fps)
+{
+	mMinFrameTicks = fps > 0.0 ? (TimerTicks)(1.0 / (fps * mSecondsPerTick)) : 0;
+}
+
+// Sleeps until the next frame is due.
+void GameTimer::waitForNextFrame()const
+{
+	if(mMinFrameTicks <= 0 || mStopped)
+	{
+		return;
+	}
+
+	sleepUntil(mPrevTime + mMinFrameTicks);
 }
 
+// Sleeps for most of the time left and spins for the last couple of
+// milliseconds, since a sleep can overshoot by a scheduler quantum.  On
+// Windows that quantum is about 15.6 ms unless the timer period is raised,
+// so it is held at 1 ms while sleeping and the spin covers what is left.
+void GameTimer::sleepUntil(TimerTicks due)
+{
+	double secondsPerTick = 1.0 / (double)ticksPerSecond();
+	TimerTicks spinTicks = (TimerTicks)(0.002 / secondsPerTick);
+
+	if(due - now() > spinTicks)
+	{
+#ifdef _WIN32
+		timeBeginPeriod(1);
+#endif
+		for(;;)
+		{
+			TimerTicks remaining = due - now();
+			if(remaining <= spinTicks)
+			{
+				break;
+			}
+
+			double ms = (double)(remaining - spinTicks)*secondsPerTick*1000.0;
+#ifdef _WIN32
+			Sleep((DWORD)ms);
+#else
+			timespec ts;
+			ts.tv_sec = (time_t)(ms / 1000.0);
+			ts.tv_nsec = (long)((ms - ts.tv_sec * 1000.0) * 1000000.0);
+			nanosleep(&ts, 0);
+#endif
+		}
+#ifdef _WIN32
+		timeEndPeriod(1);
+#endif
+	}
+
+	while(due - now() > 0)
+	{
+	}
+}
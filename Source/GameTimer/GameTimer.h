@@ -5,31 +5,60 @@
 #ifndef GAMETIMER_H
 #define GAMETIMER_H
 
+// Ticks of the monotonic clock.  Kept as 64 bit integers so that no precision
+// is lost however long the timer runs; only differences are turned into seconds.
+typedef long long TimerTicks;
 
 class GameTimer
 {
 public:
 	GameTimer();
 
-	float getGameTime()const;  // in seconds
+	double getGameTime()const;  // in seconds
 	float getDeltaTime()const; // in seconds
+	TimerTicks getDeltaTicks()const;
 
 	void reset(); // Call before message loop.
 	void start(); // Call when unpaused.
 	void stop();  // Call when paused.
 	void tick();  // Call every frame.
 
+	// Fixed-timestep accumulation.  Each tick adds the frame's time to the
+	// accumulator; stepFixed() then returns true once per whole step held.
+	void setFixedStep(double seconds); // 0 disables
+	double getFixedStep()const;
+	bool stepFixed();
+	float getStepAlpha()const; // fraction of a step left in the accumulator
+	void dropSteps(); // discards the whole steps left, keeping the fraction
+
+	// Frame-rate cap.  waitForNextFrame() sleeps until 1/fps seconds have
+	// passed since the previous tick, so the loop does not spin.
+	void setFrameCap(double fps); // 0 disables
+	void waitForNextFrame()const;
+
+	static TimerTicks now();
+	static TimerTicks ticksPerSecond();
+
+	// Sleeps, with a 1 ms timer period on Windows, for most of the
+	// time until now() reaches due, then spins for the rest.
+	static void sleepUntil(TimerTicks due);
+
 private:
-	double mSecondsPerCount;
+	double mSecondsPerTick;
 	double mDeltaTime;
+	TimerTicks mDeltaTicks;
+
+	TimerTicks mBaseTime;
+	TimerTicks mPausedTime;
+	TimerTicks mStopTime;
+	TimerTicks mPrevTime;
+	TimerTicks mCurrTime;
 
-	__int64 mBaseTime;
-	__int64 mPausedTime;
-	__int64 mStopTime;
-	__int64 mPrevTime;
-	__int64 mCurrTime;
+	TimerTicks mFixedStep;
+	TimerTicks mAccumulator;
+	TimerTicks mMinFrameTicks;
 
 	bool mStopped;
 };
 
-#endif // GAMETIMER_H
\ No newline at end of file
+#endif // GAMETIMER_H
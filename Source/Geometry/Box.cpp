@@ -10,10 +10,67 @@
 
 #include "Geometry/Box.hpp"
 #include "Vertex/Vertex.hpp"
+#include "Scene/Scene.hpp"
+#include "Maths/m3dConst.h"
 
 #define VERTICES_NO 24
 #define FACES_NO 12
 
+namespace
+{
+	// Position, normal and texture coordinates of each corner of each face
+	const VertexData BOX_VERTICES[] =
+	{
+		// Front face
+		{ { -1.0f, -1.0f, -1.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 1.0f } },
+		{ { -1.0f,  1.0f, -1.0f }, { 0.0f, 0.0f, -1.0f }, { 0.0f, 0.0f } },
+		{ {  1.0f,  1.0f, -1.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 0.0f } },
+		{ {  1.0f, -1.0f, -1.0f }, { 0.0f, 0.0f, -1.0f }, { 1.0f, 1.0f } },
+
+		// Back face
+		{ { -1.0f, -1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f } },
+		{ {  1.0f, -1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f } },
+		{ {  1.0f,  1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f } },
+		{ { -1.0f,  1.0f, 1.0f }, { 0.0f, 0.0f, 1.0f }, { 1.0f, 0.0f } },
+
+		// Top face
+		{ { -1.0f, 1.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { -1.0f, 1.0f,  1.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ {  1.0f, 1.0f,  1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ {  1.0f, 1.0f, -1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Bottom face
+		{ { -1.0f, -1.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 1.0f, 1.0f } },
+		{ {  1.0f, -1.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ {  1.0f, -1.0f,  1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -1.0f, -1.0f,  1.0f }, { 0.0f, -1.0f, 0.0f }, { 1.0f, 0.0f } },
+
+		// Left face
+		{ { -1.0f, -1.0f,  1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { -1.0f,  1.0f,  1.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { -1.0f,  1.0f, -1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { -1.0f, -1.0f, -1.0f }, { -1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } },
+
+		// Right face
+		{ { 1.0f, -1.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f } },
+		{ { 1.0f,  1.0f, -1.0f }, { 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 1.0f,  1.0f,  1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 0.0f } },
+		{ { 1.0f, -1.0f,  1.0f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 1.0f } }
+	};
+
+	// Two triangles for each face, fanned from its first corner
+	#define BOX_FACE(f)		4 * (f), 4 * (f) + 1, 4 * (f) + 2, \
+							4 * (f), 4 * (f) + 2, 4 * (f) + 3
+
+	const DWORD BOX_INDICES[] =
+	{
+		BOX_FACE(0), BOX_FACE(1), BOX_FACE(2), BOX_FACE(3), BOX_FACE(4), BOX_FACE(5)
+	};
+
+	M3D_STATIC_ASSERT(M3D_COUNT_OF(BOX_VERTICES) == VERTICES_NO, boxVerticesNo);
+	M3D_STATIC_ASSERT(M3D_COUNT_OF(BOX_INDICES) == FACES_NO * 3, boxIndicesNo);
+}
+
 /*
 	Name		Box::Box
 	Syntax		Box()
@@ -54,49 +111,20 @@ bool Box::initialise(ID3D10Device* device, float scale)
 	verticesNo_ = VERTICES_NO;
 	facesNo_    = FACES_NO; // 2 per quad
 
-	// Create vertex buffer
-    Vertex v[VERTICES_NO];
-
-	// Fill in the front face vertex data.
- 	v[0] = Vertex(-1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-1.0f,  1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[2] = Vertex( 1.0f,  1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[3] = Vertex( 1.0f, -1.0f, -1.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[4] = Vertex(-1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-	v[5] = Vertex( 1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-	v[6] = Vertex( 1.0f,  1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[7] = Vertex(-1.0f,  1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-
-	// Fill in the top face vertex data.
-	v[8]  = Vertex(-1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f);
-	v[9]  = Vertex(-1.0f, 1.0f,  1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
-	v[10] = Vertex( 1.0f, 1.0f,  1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f);
-	v[11] = Vertex( 1.0f, 1.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the bottom face vertex data.
-	v[12] = Vertex(-1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 1.0f);
-	v[13] = Vertex( 1.0f, -1.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f);
-	v[14] = Vertex( 1.0f, -1.0f,  1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f);
-	v[15] = Vertex(-1.0f, -1.0f,  1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	v[16] = Vertex(-1.0f, -1.0f,  1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[17] = Vertex(-1.0f,  1.0f,  1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[18] = Vertex(-1.0f,  1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[19] = Vertex(-1.0f, -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the right face vertex data.
-	v[20] = Vertex( 1.0f, -1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[21] = Vertex( 1.0f,  1.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[22] = Vertex( 1.0f,  1.0f,  1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[23] = Vertex( 1.0f, -1.0f,  1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Scale the box
-	for (DWORD i = 0; i < verticesNo_; ++i)
-		v[i].pos *= scale;
-
+	// Create vertex buffer. The table is used as it is unless it needs scaling
+	const VertexData* vertices = BOX_VERTICES;
+	VertexData scaled[VERTICES_NO];
+	if (scale != 1.0f)
+	{
+		for (DWORD i = 0; i < verticesNo_; ++i)
+		{
+			scaled[i] = BOX_VERTICES[i];
+			scaled[i].pos[0] *= scale;
+			scaled[i].pos[1] *= scale;
+			scaled[i].pos[2] *= scale;
+		}
+		vertices = scaled;
+	}
 
     D3D10_BUFFER_DESC vbd;
     vbd.Usage = D3D10_USAGE_IMMUTABLE;
@@ -105,8 +133,9 @@ bool Box::initialise(ID3D10Device* device, float scale)
     vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     D3D10_SUBRESOURCE_DATA vinitData;
-    vinitData.pSysMem = v;
-    HRESULT hr = d3dDevice_->CreateBuffer(&vbd, &vinitData, &vertexBuffer_);
+    vinitData.pSysMem = vertices;
+    RenderBackend* backend = Scene::instance()->getBackend();
+    HRESULT hr = backend->createBuffer(&vbd, &vinitData, &vertexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Create Box Vertex Buffer - Failed", "Error", MB_OK);
@@ -114,32 +143,6 @@ bool Box::initialise(ID3D10Device* device, float scale)
 	}
 
 	// Create the index buffer
-	DWORD i[36];
-
-	// Fill in the front face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
-
-	// Fill in the back face index data
-	i[6] = 4; i[7]  = 5; i[8]  = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
-
-	// Fill in the top face index data
-	i[12] = 8; i[13] =  9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
-
-	// Fill in the bottom face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
-	i[21] = 12; i[22] = 14; i[23] = 15;
-
-	// Fill in the left face index data
-	i[24] = 16; i[25] = 17; i[26] = 18;
-	i[27] = 16; i[28] = 18; i[29] = 19;
-
-	// Fill in the right face index data
-	i[30] = 20; i[31] = 21; i[32] = 22;
-	i[33] = 20; i[34] = 22; i[35] = 23;
-
 	D3D10_BUFFER_DESC ibd;
     ibd.Usage = D3D10_USAGE_IMMUTABLE;
 	ibd.ByteWidth = sizeof(DWORD) * facesNo_ * 3;
@@ -147,8 +150,8 @@ bool Box::initialise(ID3D10Device* device, float scale)
     ibd.CPUAccessFlags = 0;
     ibd.MiscFlags = 0;
     D3D10_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = i;
-	hr = d3dDevice_->CreateBuffer(&ibd, &iinitData, &indexBuffer_);
+    iinitData.pSysMem = BOX_INDICES;
+	hr = backend->createBuffer(&ibd, &iinitData, &indexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Create Box Index Buffer - Failed", "Error", MB_OK);
@@ -170,7 +173,7 @@ void Box::render()
     d3dDevice_->IASetVertexBuffers(0, 1, &vertexBuffer_, &stride, &offset);
 	d3dDevice_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R32_UINT, 0);
 	d3dDevice_->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	d3dDevice_->DrawIndexed(facesNo_ * 3, 0, 0);
+	Scene::instance()->getBackend()->drawIndexed(facesNo_ * 3, 0, 0);
 }
 
 /*
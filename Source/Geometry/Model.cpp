@@ -17,6 +17,7 @@
 #include "Shaders/ModelShader.hpp"
 #include "Shaders/ShadowShader.hpp"
 #include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
 
 
 // Overloads the binary >> operator to take D3DXVECTOR3
@@ -40,9 +41,10 @@ std::wistream& operator>>(std::wistream& is, D3DXVECTOR2& v)
 */
 Model::Model() 
 : verticesNo_(0), facesNo_(0), d3dDevice_(0), scale_(1,1,1), theta_(0,0,0), 
-  pos_(0,0,0)
+  pos_(0,0,0), boundCentre_(0,0,0), boundRadius_(0)
 {
-
+	// Matches no world, so the first shadow draws every cascade
+	ZeroMemory(&shadowWorld_, sizeof(D3DXMATRIX));
 }
 
 /*
@@ -55,6 +57,13 @@ Model::~Model()
 	if (meshData_)
 		meshData_->Release();
 
+	for (UINT i = 0; i < diffuseTextures_.size(); ++i)
+		delete diffuseTextures_[i];
+	for (UINT i = 0; i < specTextures_.size(); ++i)
+		delete specTextures_[i];
+	for (UINT i = 0; i < normalTextures_.size(); ++i)
+		delete normalTextures_[i];
+
 	delete modelShader_;
 	delete shadowShader_;
 }
@@ -78,17 +87,10 @@ bool Model::initialise(ID3D10Device* device, std::wstring modelName)
 	shadowShader_ = new ShadowShader;
 	shadowShader_->initialise();
 
-	shadowMap_.initialise(d3dDevice_, 1024, 1024);
+	shadowMap_.initialise(d3dDevice_, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE, M3D_MAX_CASCADES);
 
-	// Load the model file
-	bool result = loadModel(modelName);
-
-	if (!result)
-	{
-		MessageBox(0, "Loading model - Failed", "Error", MB_OK);
-		return false;
-	}
-	return true;
+	// Load the model file. Each step that fails reports itself
+	return loadModel(modelName);
 }
 
 /*
@@ -98,7 +100,8 @@ bool Model::initialise(ID3D10Device* device, std::wstring modelName)
 	Param		D3DXVECTOR3* cameraPos - The position of the camera
 	Param		Light* light - The light used in the scene
 	Param		D3DXVECTOR3* fogColor - The fog color
-	Brief		Renders the model
+	Brief		Renders the model, first streaming in more of its textures'
+				mips if it is near enough to need them
 */
 void Model::render(D3DXVECTOR3* cameraPos, Light* light, D3DXVECTOR3* fogColor)
 {
@@ -106,6 +109,7 @@ void Model::render(D3DXVECTOR3* cameraPos, Light* light, D3DXVECTOR3* fogColor)
 	d3dDevice_->IASetInputLayout(modelShader_->getLayout());
 
 	setTrans();
+	streamTextures(*cameraPos);
 	Scene::instance()->setWorld(world_);
 	Scene::instance()->setWVP();
 
@@ -115,6 +119,8 @@ void Model::render(D3DXVECTOR3* cameraPos, Light* light, D3DXVECTOR3* fogColor)
 
 	modelShader_->setShadowMap(shadowMap_.depthMap());
 
+	RenderBackend* backend = Scene::instance()->getBackend();
+
     D3D10_TECHNIQUE_DESC techDesc;
     modelShader_->setTechniqueDesc(&techDesc);
 
@@ -123,11 +129,11 @@ void Model::render(D3DXVECTOR3* cameraPos, Light* light, D3DXVECTOR3* fogColor)
 		for(UINT subsetID = 0; subsetID < subsetsNo_; ++subsetID)
 		{
 			modelShader_->setupRender(&reflectMaterials_[subsetID], 
-									  diffuseTextures_[subsetID], 
-									  specTextures_[subsetID], 
-									  normalTextures_[subsetID]);
+									  diffuseTextures_[subsetID]->getView(), 
+									  specTextures_[subsetID]->getView(), 
+									  normalTextures_[subsetID]->getView());
 			modelShader_->applyPassState(i);
-			meshData_->DrawSubset(subsetID);
+			backend->drawSubset(meshData_, subsetID, subsetVertices_[subsetID]);
 		}
 	}
 
@@ -136,32 +142,55 @@ void Model::render(D3DXVECTOR3* cameraPos, Light* light, D3DXVECTOR3* fogColor)
 
 /*
 	Name		Model::renderShadow
-	Syntax		Model::renderShadow()
-	Brief		Renders the model's shadow map
+	Syntax		Model::renderShadow(const M3DCascadeSet& cascades)
+	Param		const M3DCascadeSet& cascades - The light's shadow cascades
+	Return		UINT - Number of cascades drawn
+	Brief		Renders the model into the shadow map of each cascade that
+				needs it
+	Details		The cached cascades keep what was drawn into them, so they
+				are all drawn again once the model has moved
 */
-void Model::renderShadow()
+UINT Model::renderShadow(const M3DCascadeSet& cascades)
 {
+	PROFILE_ZONE("Model::renderShadow");
+
 	d3dDevice_->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	d3dDevice_->IASetInputLayout(shadowShader_->getLayout());
 
-	// Render model to shadow map
-	shadowMap_.begin();
+	bool moved = world_ != shadowWorld_;
+	shadowWorld_ = world_;
+
+	RenderBackend* backend = Scene::instance()->getBackend();
 
 	D3D10_TECHNIQUE_DESC techDesc;
 	shadowShader_->setTechniqueDesc(&techDesc);
 
-    for(UINT i = 0; i < techDesc.Passes; ++i)
-    {
-		// We only need diffuse map for drawing into shadow map
-		for(UINT subsetID = 0; subsetID < subsetsNo_; ++subsetID)
+	UINT drawn = 0;
+	for (int c = 0; c < cascades.count; ++c)
+	{
+		if (!cascades.dirty[c] && !moved)
+			continue;
+
+		// Render model to the cascade's slice of the shadow map
+		shadowShader_->setLightWvp(lightWvps_[c]);
+		shadowMap_.begin(c);
+
+		for(UINT i = 0; i < techDesc.Passes; ++i)
 		{
-			shadowShader_->setDiffuseRV(diffuseTextures_[subsetID]);
-			shadowShader_->applyPassState(i);
-			meshData_->DrawSubset(subsetID);
+			// We only need diffuse map for drawing into shadow map
+			for(UINT subsetID = 0; subsetID < subsetsNo_; ++subsetID)
+			{
+				shadowShader_->setDiffuseRV(diffuseTextures_[subsetID]->getView());
+				shadowShader_->applyPassState(i);
+				backend->drawSubset(meshData_, subsetID, subsetVertices_[subsetID]);
+			}
 		}
+		++drawn;
 	}
 
-	shadowMap_.end();
+	if (drawn)
+		shadowMap_.end();
+	return drawn;
 }
 
 /*
@@ -216,13 +245,8 @@ bool Model::loadModel(std::wstring modelName)
 		for(UINT i = 0; i < subsetsNo_; ++i)
 		{
 			std::wstring diffuseMapName;
-			ID3D10ShaderResourceView* diffuseMapResourceView;
-
 			std::wstring specMapName;
-			ID3D10ShaderResourceView* specMapResourceView;
-
 			std::wstring normalMapName;
-			ID3D10ShaderResourceView* normalMapResourceView;
 
 			inFile >> diffuseMapName;
 			inFile >> specMapName;
@@ -234,38 +258,23 @@ bool Model::loadModel(std::wstring modelName)
 
 			reflectMaterials_.push_back(reflectivity);
 
-			hr = D3DX10CreateShaderResourceViewFromFile(d3dDevice_,
-										wStringtoString(diffuseMapName).c_str(),
-										0, 0, &diffuseMapResourceView, 0 );
-			if (FAILED(hr))
-			{
-				MessageBox(0, "Create diffuse RV - Failed", "Error", MB_OK);
+			StreamedTexture* diffuseMap = loadTexture(diffuseMapName);
+			if (!diffuseMap)
 				return false;
-			}
 			else
-				diffuseTextures_.push_back(diffuseMapResourceView);
+				diffuseTextures_.push_back(diffuseMap);
 
-			hr = D3DX10CreateShaderResourceViewFromFile(d3dDevice_,
-										wStringtoString(specMapName).c_str(), 
-										0, 0, &specMapResourceView, 0 );
-			if (FAILED(hr))
-			{
-				MessageBox(0, "Create spec RV - Failed", "Error", MB_OK);
+			StreamedTexture* specMap = loadTexture(specMapName);
+			if (!specMap)
 				return false;
-			}
 			else
-				specTextures_.push_back(specMapResourceView);
+				specTextures_.push_back(specMap);
 
-			hr = D3DX10CreateShaderResourceViewFromFile(d3dDevice_,
-										wStringtoString(normalMapName).c_str(), 
-										0, 0, &normalMapResourceView, 0 );
-			if (FAILED(hr))
-			{
-				MessageBox(0, "Create normal RV - Failed", "Error", MB_OK);
+			StreamedTexture* normalMap = loadTexture(normalMapName);
+			if (!normalMap)
 				return false;
-			}
 			else
-				normalTextures_.push_back(normalMapResourceView);
+				normalTextures_.push_back(normalMap);
 		}
 
 		// Load vertex data for model to mesh
@@ -291,6 +300,8 @@ bool Model::loadModel(std::wstring modelName)
 			MessageBox(0, "Setting mesh vertex data - Failed", "Error", MB_OK);
 			return false;
 		}
+		D3DXComputeBoundingSphere(&vertices[0].pos, verticesNo_, sizeof(MeshVertex), 
+								  &boundCentre_, &boundRadius_);
 		delete[] vertices;
 
 		// Load index data for model to mesh
@@ -328,23 +339,97 @@ bool Model::loadModel(std::wstring modelName)
 		hr = meshData_->CommitToDevice();
 		if (FAILED(hr))
 		{
+			MessageBox(0, "Loading model - Failed", "Error", MB_OK);
 			return false;
 		}
+
+		// Record the number of vertices drawn by each subset
+		UINT rangesNo = 0;
+		meshData_->GetAttributeTable(0, &rangesNo);
+		std::vector<D3DX10_ATTRIBUTE_RANGE> ranges(rangesNo);
+		if (rangesNo)
+			meshData_->GetAttributeTable(&ranges[0], &rangesNo);
+
+		subsetVertices_.assign(subsetsNo_, 0);
+		for(UINT i = 0; i < rangesNo; ++i)
+		{
+			if (ranges[i].AttribId < subsetsNo_)
+				subsetVertices_[ranges[i].AttribId] += ranges[i].FaceCount * 3;
+		}
 	}
 	return true;
 }
 
+/*
+	Name		Model::loadTexture
+	Syntax		Model::loadTexture(const std::wstring& fileName)
+	Param		const std::wstring& fileName - A DDS file
+	Return		StreamedTexture* - The texture, with its small mips
+				uploaded, or 0 if it could not be loaded
+	Brief		Loads a texture of the model
+	Details		A texture that fails to load has already reported why, with
+				its file name
+*/
+StreamedTexture* Model::loadTexture(const std::wstring& fileName)
+{
+	StreamedTexture* texture = new StreamedTexture;
+	if (!texture->initialise(d3dDevice_, wStringtoString(fileName), RESIDENT_TEXTURE_SIZE))
+	{
+		delete texture;
+		return 0;
+	}
+	return texture;
+}
+
+/*
+	Name		Model::streamTextures
+	Syntax		Model::streamTextures(const D3DXVECTOR3& cameraPos)
+	Param		const D3DXVECTOR3& cameraPos - The position of the camera
+	Brief		Asks each texture for the mip the model, as last placed by
+				setTrans, needs at its distance from the camera
+	Details		The textures are wanted in full within four radii of the
+				model, and a mip smaller each time the distance doubles
+				beyond that, as the model covers half as much of the screen.
+				Each texture uploads at most one mip a frame, and keeps the
+				mips it has once the camera moves away
+*/
+void Model::streamTextures(const D3DXVECTOR3& cameraPos)
+{
+	D3DXVECTOR3 centre;
+	float radius;
+	getBoundingSphere(&centre, &radius);
+	D3DXVECTOR3 offset = cameraPos - centre;
+	float distance = D3DXVec3Length(&offset);
+
+	UINT mip = 0;
+	for (float reach = radius * 4.0f; distance > reach && mip < D3D10_REQ_MIP_LEVELS; reach *= 2.0f)
+		++mip;
+
+	for (UINT i = 0; i < subsetsNo_; ++i)
+	{
+		diffuseTextures_[i]->requestMip(mip);
+		specTextures_[i]->requestMip(mip);
+		normalTextures_[i]->requestMip(mip);
+	}
+}
+
 /*
 	Name		Model::update
-	Syntax		Model::update(D3DXMATRIX lightViewProj)
-	Param		D3DXMATRIX lightViewProj - light view projection matrix
-	Brief		Updates the wvp matrix for the lights affecting the model
+	Syntax		Model::update(const M3DCascadeSet& cascades)
+	Param		const M3DCascadeSet& cascades - The light's shadow cascades,
+				fitted for this frame
+	Brief		Updates the wvp matrices of the light's cascades for the
+				model
 */
-void Model::update(D3DXMATRIX lightViewProj)
+void Model::update(const M3DCascadeSet& cascades)
 {
-	D3DXMATRIX lightWvp = world_ * lightViewProj;
-	modelShader_->setLightWvp(lightWvp);
-	shadowShader_->setLightWvp(lightWvp);
+	float splitFars[M3D_MAX_CASCADES];
+	for (int c = 0; c < cascades.count; ++c)
+	{
+		lightWvps_[c] = world_ * D3DXMATRIX(cascades.cascades[c].viewProj);
+		splitFars[c] = cascades.cascades[c].splitFar;
+	}
+	modelShader_->setCascades(lightWvps_, splitFars, cascades.count);
 }
 
 /*
@@ -364,6 +449,26 @@ void Model::setTrans()
 	world_ *= m;
 }
 
+/*
+	Name		Model::getBoundingSphere
+	Syntax		Model::getBoundingSphere(D3DXVECTOR3* centre, float* radius)
+	Param		D3DXVECTOR3* centre - Receives the centre in world space
+	Param		float* radius - Receives the radius in world space
+	Brief		Gets a sphere bounding the model as last placed by setTrans
+*/
+void Model::getBoundingSphere(D3DXVECTOR3* centre, float* radius) const
+{
+	D3DXVec3TransformCoord(centre, &boundCentre_, &world_);
+
+	// Scaled by the largest axis, so the sphere still bounds a squashed model
+	float scale = fabs(scale_.x);
+	if (fabs(scale_.y) > scale)
+		scale = fabs(scale_.y);
+	if (fabs(scale_.z) > scale)
+		scale = fabs(scale_.z);
+	*radius = boundRadius_ * scale;
+}
+
 /*
 	Name		Model::increasePosX
 	Syntax		Model::increasePosX(float x)
@@ -14,6 +14,8 @@
 #include <vector>
 #include <string>
 #include "Utility/DepthMap.hpp"
+#include "Utility/StreamedTexture.hpp"
+#include "Maths/m3dCascade.h"
 
 class ModelShader;
 class ShadowShader;
@@ -26,8 +28,8 @@ public:
 	~Model();
 	bool initialise(ID3D10Device* device, std::wstring modelName);
 	void render(D3DXVECTOR3* cameraPos, Light* light, D3DXVECTOR3* fogColor); 
-	void renderShadow();
-	void update(D3DXMATRIX lightViewProj);
+	UINT renderShadow(const M3DCascadeSet& cascades);
+	void update(const M3DCascadeSet& cascades);
 	void setTrans();
 	void increasePosX(float x);
 	void increasePosY(float y);
@@ -41,26 +43,38 @@ public:
 	void increaseScaleY(float y);
 	void increaseScaleZ(float z);
 	void setScale(float x, float y, float z);
+	void getBoundingSphere(D3DXVECTOR3* centre, float* radius) const;
+
+	static const int SHADOW_MAP_SIZE = 1024;
+	static const UINT RESIDENT_TEXTURE_SIZE = 64;	// Textures start with the mips this size and under
 
 private:
 	bool loadModel(std::wstring modelName);
+	StreamedTexture* loadTexture(const std::wstring& fileName);
+	void streamTextures(const D3DXVECTOR3& cameraPos);
 
 	ID3DX10Mesh* meshData_;
 
-	DepthMap shadowMap_;
+	DepthMap shadowMap_;						// A slice for each cascade
+	D3DXMATRIX lightWvps_[M3D_MAX_CASCADES];
+	D3DXMATRIX shadowWorld_;				// World the cached cascades were drawn with
 
 	D3DXMATRIX world_;
 
 	D3DXVECTOR3 pos_, theta_, scale_;
 
+	D3DXVECTOR3 boundCentre_;	// Bounding sphere of the mesh in model space
+	float boundRadius_;
+
 	DWORD verticesNo_;
 	DWORD facesNo_;
 
 	DWORD subsetsNo_;
+	std::vector<UINT> subsetVertices_;
 	std::vector<D3DXVECTOR3> reflectMaterials_;
-	std::vector<ID3D10ShaderResourceView*> diffuseTextures_;
-	std::vector<ID3D10ShaderResourceView*> specTextures_;
-	std::vector<ID3D10ShaderResourceView*> normalTextures_;
+	std::vector<StreamedTexture*> diffuseTextures_;
+	std::vector<StreamedTexture*> specTextures_;
+	std::vector<StreamedTexture*> normalTextures_;
 
 	ID3D10Device* d3dDevice_;
 
@@ -9,10 +9,57 @@
 
 #include "Geometry/SkySphere.hpp"
 #include "Vertex/Vertex.hpp"
+#include "Scene/Scene.hpp"
+#include "Maths/m3dConst.h"
 
 #define VERTICES_NO 18
 #define FACES_NO 28
 
+namespace
+{
+	// The sphere is a grid of 8 vertices around by 4 from pole to pole, with
+	// the two pole rows each collapsed to a single vertex
+	const int SPHERE_WIDTH = 8;
+	const int SPHERE_HEIGHT = 4;
+
+	#define SKY_THETA(j)		((double)(j) / (SPHERE_HEIGHT - 1) * M3D_PI)
+	#define SKY_PHI(i)			((double)(i) / (SPHERE_WIDTH - 1) * M3D_2PI)
+	#define SKY_VERTEX(j, i)	{ { (float)M3D_CONST_SPHERE_X(SKY_THETA(j), SKY_PHI(i)), \
+									(float)M3D_CONST_SPHERE_Y(SKY_THETA(j), SKY_PHI(i)), \
+									(float)M3D_CONST_SPHERE_Z(SKY_THETA(j), SKY_PHI(i)) }, \
+								  { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } }
+	#define SKY_RING(j)			SKY_VERTEX(j, 0), SKY_VERTEX(j, 1), SKY_VERTEX(j, 2), SKY_VERTEX(j, 3), \
+								SKY_VERTEX(j, 4), SKY_VERTEX(j, 5), SKY_VERTEX(j, 6), SKY_VERTEX(j, 7)
+
+	// Rings of the rows between the poles, then the top and bottom poles
+	const VertexData SKY_VERTICES[] =
+	{
+		SKY_RING(1),
+		SKY_RING(2),
+		{ { 0.0f,  1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } },
+		{ { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f } }
+	};
+
+	#define SKY_TOP				((SPHERE_HEIGHT - 2) * SPHERE_WIDTH)
+	#define SKY_BOTTOM			((SPHERE_HEIGHT - 2) * SPHERE_WIDTH + 1)
+	#define SKY_LAST_RING		((SPHERE_HEIGHT - 3) * SPHERE_WIDTH)
+
+	// Two triangles between the rings, then a triangle to each pole
+	#define SKY_BAND(i)			(i), SPHERE_WIDTH + (i) + 1, (i) + 1, \
+								(i), SPHERE_WIDTH + (i), SPHERE_WIDTH + (i) + 1
+	#define SKY_CAPS(i)			SKY_TOP, (i), (i) + 1, \
+								SKY_BOTTOM, SKY_LAST_RING + (i) + 1, SKY_LAST_RING + (i)
+
+	const DWORD SKY_INDICES[] =
+	{
+		SKY_BAND(0), SKY_BAND(1), SKY_BAND(2), SKY_BAND(3), SKY_BAND(4), SKY_BAND(5), SKY_BAND(6),
+		SKY_CAPS(0), SKY_CAPS(1), SKY_CAPS(2), SKY_CAPS(3), SKY_CAPS(4), SKY_CAPS(5), SKY_CAPS(6)
+	};
+
+	M3D_STATIC_ASSERT(M3D_COUNT_OF(SKY_VERTICES) == VERTICES_NO, skyVerticesNo);
+	M3D_STATIC_ASSERT(M3D_COUNT_OF(SKY_INDICES) == FACES_NO * 3, skyIndicesNo);
+}
+
 /*
 	Name		SkySphere::SkySphere
 	Syntax		SkySphere()
@@ -42,7 +89,9 @@ SkySphere::~SkySphere()
 	Name		SkySphere::initialise
 	Syntax		SkySphere::initialise(ID3D10Device* device)
 	Param		ID3D10Device* device - pointer to the D3D device
-	Brief		Creates the sky sphere's vertices and indices
+	Brief		Creates the sky sphere's vertex and index buffers
+	Details		The vertices and indices are constant tables built by the 
+				compiler, so nothing is computed here
 */
 void SkySphere::initialise(ID3D10Device* device)
 {
@@ -51,30 +100,7 @@ void SkySphere::initialise(ID3D10Device* device)
 	verticesNo_ = VERTICES_NO;
 	facesNo_    = FACES_NO;
 
-	int width = 8;	
-	int height = 4;	
-	float theta, phi;
-	int i, j, t, ntri, nvec;
-	
-	nvec = (height - 2) * width + 2;		
-	ntri = (height - 2) * (width - 1) * 2;
-	
-	// Create vertex buffer
-    Vertex vertices[VERTICES_NO];
-	t = 0;
-	for (j = 1; j < height - 1; ++j)
-	{
-		for (i = 0; i < width; ++i)		
-		{			
-			theta = float(j) / (height - 1) * (float)D3DX_PI;			
-			phi   = float(i) / (width - 1)  * (float)(D3DX_PI * 2);	
-			vertices[t++].pos = D3DXVECTOR3(sinf(theta) * cosf(phi), cosf(theta), -sinf(theta) * sinf(phi));
-		}		
-	}	
-	vertices[t++].pos = D3DXVECTOR3(0.0f, 1.0f, 0.0f);		
-	vertices[t++].pos = D3DXVECTOR3(0.0f, -1.0f, 0.0f);
-	
-
+	// Create the vertex buffer
     D3D10_BUFFER_DESC vbd;
     vbd.Usage = D3D10_USAGE_IMMUTABLE;
     vbd.ByteWidth = sizeof(Vertex) * verticesNo_;
@@ -82,40 +108,15 @@ void SkySphere::initialise(ID3D10Device* device)
     vbd.CPUAccessFlags = 0;
     vbd.MiscFlags = 0;
     D3D10_SUBRESOURCE_DATA vinitData;
-    vinitData.pSysMem = vertices;
-    HRESULT hr = d3dDevice_->CreateBuffer(&vbd, &vinitData, &vertexBuffer_);
+    vinitData.pSysMem = SKY_VERTICES;
+    RenderBackend* backend = Scene::instance()->getBackend();
+    HRESULT hr = backend->createBuffer(&vbd, &vinitData, &vertexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Creating sky sphere vertex buffer - Failed", "Error", MB_OK);
 	}
 
 	// Create the index buffer
-
-	DWORD indices[FACES_NO * 3]; 
-	t = 0;
-	for (j = 0; j < height - 3; ++j)
-	{
-		for (i = 0; i < width - 1; ++i)			
-		{				
-			indices[t++] = (j  )	* width + i  ;				
-			indices[t++] = (j + 1)	* width + i + 1;				
-			indices[t++] = (j  )	* width + i + 1;				
-			indices[t++] = (j  )	* width + i  ;				
-			indices[t++] = (j + 1)	* width + i  ;				
-			indices[t++] = (j + 1)	* width + i + 1;			
-		}			
-	}	
-	for (i = 0; i < width - 1; ++i)			
-	{				
-		indices[t++] = (height - 2) * width;				
-		indices[t++] = i;				
-		indices[t++] = i + 1;				
-		indices[t++] = (height - 2) * width + 1;				
-		indices[t++] = (height - 3) * width + i + 1;				
-		indices[t++] = (height - 3) * width + i;			
-	}	
-	
-
 	D3D10_BUFFER_DESC ibd;
     ibd.Usage = D3D10_USAGE_IMMUTABLE;
     ibd.ByteWidth = sizeof(DWORD) * facesNo_ * 3;
@@ -123,8 +124,8 @@ void SkySphere::initialise(ID3D10Device* device)
     ibd.CPUAccessFlags = 0;
     ibd.MiscFlags = 0;
     D3D10_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = indices;
-    hr = d3dDevice_->CreateBuffer(&ibd, &iinitData, &indexBuffer_);
+    iinitData.pSysMem = SKY_INDICES;
+    hr = backend->createBuffer(&ibd, &iinitData, &indexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Creating sky sphere index buffer - Failed", "Error", MB_OK);
@@ -145,7 +146,7 @@ void SkySphere::render()
     d3dDevice_->IASetVertexBuffers(0, 1, &vertexBuffer_, &stride, &offset);
 	d3dDevice_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R32_UINT, 0);
 	d3dDevice_->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-	d3dDevice_->DrawIndexed(facesNo_ * 3, 0, 0);
+	Scene::instance()->getBackend()->drawIndexed(facesNo_ * 3, 0, 0);
 }
 
 /*
@@ -11,6 +11,8 @@
 #include <vector>
 #include <fstream>
 #include "Vertex/Vertex.hpp"
+#include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
 
 /*
 	Name		Terrain::Terrain
@@ -20,9 +22,10 @@
 Terrain::Terrain() 
 : verticesNo_(0), facesNo_(0), d3dDevice_(0), vertexBuffer_(0), indexBuffer_(0), 
   heightMap_(0), scale_(1,1,1), theta_(0,0,0), pos_(0,0,0), width_(0), height_(0),
-  DIMENSIONS(257), SMOOTHING_FACTOR(0.1f)
+  cellsNo_(0), cellsAcross_(0), DIMENSIONS(257), SMOOTHING_FACTOR(0.1f)
 {
-
+	D3DXMatrixIdentity(&world_);
+	D3DXMatrixIdentity(&invWorld_);
 }
 
 /*
@@ -73,6 +76,12 @@ bool Terrain::initialise(ID3D10Device* device, char* heightMapFileName)
 	// Smooth the height map
 	smoothHeightMap();
 
+	// Keep the heights on their own, row by row, for the height field
+	fieldHeights_.resize(width_ * height_);
+	for (UINT j = 0; j < height_; ++j)
+		for (UINT i = 0; i < width_; ++i)
+			fieldHeights_[j * width_ + i] = heightMap_[(height_ * j) + i].y;
+
 	// Create the vertices and indices
 	result = initialiseBuffers();
 	if (!result)
@@ -91,6 +100,7 @@ bool Terrain::initialise(ID3D10Device* device, char* heightMapFileName)
 */
 void Terrain::render()
 {
+	PROFILE_ZONE("Terrain::render");
 
 	// Set the type of primitive to line list
 	d3dDevice_->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -99,11 +109,111 @@ void Terrain::render()
     UINT offset = 0;
     d3dDevice_->IASetVertexBuffers(0, 1, &vertexBuffer_, &stride, &offset);
 	d3dDevice_->IASetIndexBuffer(indexBuffer_, DXGI_FORMAT_R32_UINT, 0);
-	d3dDevice_->DrawIndexed(facesNo_ * 3, 0, 0);
+
+	// Draw each run of neighbouring cells that survived culling in one call
+	RenderBackend* backend = Scene::instance()->getBackend();
+	UINT runStart = 0;
+	UINT runCount = 0;
+	for (UINT c = 0; c < cellsNo_; ++c)
+	{
+		if (!cellVisible_[c])
+			continue;
+
+		if (runCount > 0 && runStart + runCount != cellStarts_[c])
+		{
+			backend->drawIndexed(runCount, runStart, 0);
+			runCount = 0;
+		}
+		if (runCount == 0)
+			runStart = cellStarts_[c];
+		runCount += cellCounts_[c];
+	}
+	if (runCount > 0)
+		backend->drawIndexed(runCount, runStart, 0);
 
 	return;
 }
 
+/*
+	Name		Terrain::cull
+	Syntax		Terrain::cull(const M3DFrustum& frustum)
+	Param		const M3DFrustum& frustum - The camera's frustum
+	Return		UINT - Number of cells that may be seen
+	Brief		Marks the cells outside the frustum so that render skips them
+	Details		The cells are gathered from the hierarchy of their bounds, so
+				whole blocks of cells out of view are skipped with one test
+*/
+UINT Terrain::cull(const M3DFrustum& frustum)
+{
+	// Until the world bounds are set every cell is drawn
+	if (cellTree_.getItemsNo() == 0)
+		return cellsNo_;
+
+	int inView = cellTree_.cullFrustum(frustum, &cellsInView_[0]);
+	cellVisible_.assign(cellsNo_, 0);
+	for (int i = 0; i < inView; ++i)
+		cellVisible_[cellsInView_[i]] = 1;
+	return (UINT)inView;
+}
+
+/*
+	Name		Terrain::drawOccluders
+	Syntax		Terrain::drawOccluders(OcclusionBuffer* buffer)
+	Param		OcclusionBuffer* buffer - The buffer begun for the frame
+	Brief		Adds the occluders of the cells left by the last cull
+*/
+void Terrain::drawOccluders(OcclusionBuffer* buffer)
+{
+	occludersInView_.clear();
+	for (UINT c = 0; c < cellsNo_; ++c)
+	{
+		if (cellVisible_[c] && occluderCounts_[c] > 0)
+		{
+			const UINT* first = &occluderIndices_[occluderStarts_[c]];
+			occludersInView_.insert(occludersInView_.end(), first, first + occluderCounts_[c]);
+		}
+	}
+
+	if (!occludersInView_.empty())
+	{
+		buffer->addOccluders(&occluderVertices_[0], (int)occluderVertices_.size() / 3,
+							 &occludersInView_[0], (int)occludersInView_.size(), world_);
+	}
+}
+
+/*
+	Name		Terrain::cullOccluded
+	Syntax		Terrain::cullOccluded(const OcclusionBuffer& buffer)
+	Param		const OcclusionBuffer& buffer - The rasterised buffer
+	Return		UINT - Number of cells found to be hidden
+	Brief		Marks the cells in view that the nearer hills hide so that
+				render skips them too
+	Details		A cell's own occluder lies inside its bounds, behind their
+				nearest corner, so it never hides the cell itself
+*/
+UINT Terrain::cullOccluded(const OcclusionBuffer& buffer)
+{
+	if (cellTree_.getItemsNo() == 0)
+		return 0;
+
+	UINT hidden = 0;
+	for (UINT c = 0; c < cellsNo_; ++c)
+	{
+		if (!cellVisible_[c])
+			continue;
+
+		M3DVector3f boxMin = { cellBounds_[c], cellBounds_[cellsNo_ + c], cellBounds_[cellsNo_ * 2 + c] };
+		M3DVector3f boxMax = { cellBounds_[cellsNo_ * 3 + c], cellBounds_[cellsNo_ * 4 + c], 
+							   cellBounds_[cellsNo_ * 5 + c] };
+		if (!buffer.isVisible(boxMin, boxMax))
+		{
+			cellVisible_[c] = 0;
+			++hidden;
+		}
+	}
+	return hidden;
+}
+
 /*
 	Name		Terrain::loadHeightMap
 	Syntax		Terrain::loadHeightMap(char* heightMapFileName)
@@ -330,24 +440,63 @@ bool Terrain::initialiseBuffers()
 		}
 	}
 
+	// Build the quads a cell at a time, so that each cell is a contiguous
+	// run of indices, and find the bounds of each cell as it is built
+	cellStarts_.clear();
+	cellCounts_.clear();
+	cellLocalMins_.clear();
+	cellLocalMaxs_.clear();
+
 	int k = 0;
-	for (UINT i = 0; i < width_-1; ++i)
+	for (UINT ci = 0; ci < width_-1; ci += CELL_QUADS)
 	{
-		for (UINT j = 0; j < height_-1; ++j)
+		UINT iEnd = min(ci + CELL_QUADS, width_-1);
+		for (UINT cj = 0; cj < height_-1; cj += CELL_QUADS)
 		{
-			indices[k]   = i * height_ + j;
-			indices[k+1] = (i+1) * height_ + j;
-			indices[k+2] = i * height_ + j + 1;
-
-			indices[k+3] = i * height_ + j + 1;
-			indices[k+4] = (i+1) * height_ + j;
-			indices[k+5] = (i+1) * height_ + j + 1;
-
-			k += 6; // next quad
+			UINT jEnd = min(cj + CELL_QUADS, height_-1);
+			cellStarts_.push_back(k);
+
+			D3DXVECTOR3 cellMin = vertices[ci * height_ + cj].pos;
+			D3DXVECTOR3 cellMax = cellMin;
+			for (UINT i = ci; i <= iEnd; ++i)
+			{
+				for (UINT j = cj; j <= jEnd; ++j)
+				{
+					D3DXVec3Minimize(&cellMin, &cellMin, &vertices[i * height_ + j].pos);
+					D3DXVec3Maximize(&cellMax, &cellMax, &vertices[i * height_ + j].pos);
+				}
+			}
+			cellLocalMins_.push_back(cellMin);
+			cellLocalMaxs_.push_back(cellMax);
+
+			for (UINT i = ci; i < iEnd; ++i)
+			{
+				for (UINT j = cj; j < jEnd; ++j)
+				{
+					indices[k]   = i * height_ + j;
+					indices[k+1] = (i+1) * height_ + j;
+					indices[k+2] = i * height_ + j + 1;
+
+					indices[k+3] = i * height_ + j + 1;
+					indices[k+4] = (i+1) * height_ + j;
+					indices[k+5] = (i+1) * height_ + j + 1;
+
+					k += 6; // next quad
+				}
+			}
+			cellCounts_.push_back(k - cellStarts_.back());
 		}
 	}
 
+	// Every cell is drawn until the terrain is first culled
+	cellsNo_ = (UINT)cellStarts_.size();
+	cellsAcross_ = (height_ - 2) / CELL_QUADS + 1;
+	cellBounds_.assign(cellsNo_ * 6, 0.0f);
+	cellVisible_.assign(cellsNo_, 1);
+	cellsInView_.resize(cellsNo_);
+
 	calculateNormals(vertices, indices);
+	initialiseOccluders();
 
 	D3D10_BUFFER_DESC vbd;
     vbd.Usage = D3D10_USAGE_IMMUTABLE;
@@ -357,7 +506,8 @@ bool Terrain::initialiseBuffers()
     vbd.MiscFlags = 0;
     D3D10_SUBRESOURCE_DATA vinitData;
     vinitData.pSysMem = vertices;
-    HRESULT hr = d3dDevice_->CreateBuffer(&vbd, &vinitData, &vertexBuffer_);
+    RenderBackend* backend = Scene::instance()->getBackend();
+    HRESULT hr = backend->createBuffer(&vbd, &vinitData, &vertexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Create Box Vertex Buffer - Failed", "Error", MB_OK);
@@ -372,7 +522,7 @@ bool Terrain::initialiseBuffers()
     ibd.MiscFlags = 0;
     D3D10_SUBRESOURCE_DATA iinitData;
     iinitData.pSysMem = indices;
-	hr = d3dDevice_->CreateBuffer(&ibd, &iinitData, &indexBuffer_);
+	hr = backend->createBuffer(&ibd, &iinitData, &indexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Create Box Index Buffer - Failed",
@@ -390,6 +540,82 @@ bool Terrain::initialiseBuffers()
 	return true;
 }
 
+/*
+	Name		Terrain::initialiseOccluders
+	Syntax		Terrain::initialiseOccluders()
+	Brief		Builds the coarse occluder mesh of each cell
+	Details		The mesh takes every OCCLUDER_QUADS-th row and column of the
+				height map, and the last. Each of its vertices is given the
+				lowest height within OCCLUDER_QUADS of it, which covers every
+				occluder quad it is a corner of, so the mesh never rises above
+				the terrain and only hides what the terrain would
+*/
+void Terrain::initialiseOccluders()
+{
+	// Rows and columns of the height map kept in the coarse mesh, and the
+	// coarse index of each kept one
+	std::vector<UINT> kept;
+	std::vector<UINT> coarseOf(width_, 0);
+	for (UINT i = 0; i < width_; i += OCCLUDER_QUADS)
+		kept.push_back(i);
+	if (kept.back() != width_ - 1)
+		kept.push_back(width_ - 1);
+	for (UINT k = 0; k < kept.size(); ++k)
+		coarseOf[kept[k]] = k;
+	UINT keptNo = (UINT)kept.size();
+
+	occluderVertices_.clear();
+	for (UINT a = 0; a < keptNo; ++a)
+	{
+		for (UINT b = 0; b < keptNo; ++b)
+		{
+			UINT i = kept[a];
+			UINT j = kept[b];
+			D3DXVECTOR3 pos = heightMap_[i * height_ + j];
+
+			UINT iStart = i > OCCLUDER_QUADS ? i - OCCLUDER_QUADS : 0;
+			UINT jStart = j > OCCLUDER_QUADS ? j - OCCLUDER_QUADS : 0;
+			UINT iEnd = min(i + OCCLUDER_QUADS, width_ - 1);
+			UINT jEnd = min(j + OCCLUDER_QUADS, height_ - 1);
+			for (UINT y = iStart; y <= iEnd; ++y)
+			{
+				for (UINT x = jStart; x <= jEnd; ++x)
+					pos.y = min(pos.y, heightMap_[y * height_ + x].y);
+			}
+
+			occluderVertices_.push_back(pos.x);
+			occluderVertices_.push_back(pos.y);
+			occluderVertices_.push_back(pos.z);
+		}
+	}
+
+	// The cells are walked in the order they were built in, with the same
+	// winding as the terrain
+	occluderIndices_.clear();
+	occluderStarts_.clear();
+	occluderCounts_.clear();
+	for (UINT ci = 0; ci < width_-1; ci += CELL_QUADS)
+	{
+		UINT iEnd = coarseOf[min(ci + CELL_QUADS, width_-1)];
+		for (UINT cj = 0; cj < height_-1; cj += CELL_QUADS)
+		{
+			UINT jEnd = coarseOf[min(cj + CELL_QUADS, height_-1)];
+			occluderStarts_.push_back((UINT)occluderIndices_.size());
+
+			for (UINT a = coarseOf[ci]; a < iEnd; ++a)
+			{
+				for (UINT b = coarseOf[cj]; b < jEnd; ++b)
+				{
+					UINT v = a * keptNo + b;
+					UINT quad[6] = { v, v + keptNo, v + 1, v + 1, v + keptNo, v + keptNo + 1 };
+					occluderIndices_.insert(occluderIndices_.end(), quad, quad + 6);
+				}
+			}
+			occluderCounts_.push_back((UINT)occluderIndices_.size() - occluderStarts_.back());
+		}
+	}
+}
+
 /*
 	Name		Terrain::calculateNormals
 	Syntax		Terrain::calculateNormals(Vertex* vertices, DWORD* indices)
@@ -481,6 +707,158 @@ void Terrain::setTrans()
 	world_ *= m;
 	D3DXMatrixTranslation(&m, pos_.x, pos_.y, pos_.z);
 	world_ *= m;
+	D3DXMatrixInverse(&invWorld_, 0, &world_);
+
+	setCellBounds();
+}
+
+/*
+	Name		Terrain::getHeight
+	Syntax		Terrain::getHeight(float x, float z, float* height)
+	Param		float x, z - A world space position
+	Param		float* height - Receives the world height of the terrain there
+	Return		bool - False if the position is off the terrain
+	Brief		Finds the height of the terrain surface below a position
+	Details		The height is interpolated across the same triangle the mesh
+				draws there, so it lies on the rendered surface. Assumes the
+				terrain is only turned about the y axis
+*/
+bool Terrain::getHeight(float x, float z, float* height) const
+{
+	float gridX, gridZ;
+	if (!toGrid(x, z, &gridX, &gridZ))
+		return false;
+
+	UINT col = min((UINT)gridX, width_ - 2);
+	UINT row = min((UINT)gridZ, height_ - 2);
+	float fx = gridX - col;
+	float fz = gridZ - row;
+
+	float h00 = heightMap_[row * height_ + col].y;
+	float h10 = heightMap_[row * height_ + col + 1].y;
+	float h01 = heightMap_[(row + 1) * height_ + col].y;
+	float h11 = heightMap_[(row + 1) * height_ + col + 1].y;
+
+	// Each quad is split from its (x + 1, z) corner to its (x, z + 1) one
+	float local;
+	if (fx + fz <= 1.0f)
+		local = h00 + fx * (h10 - h00) + fz * (h01 - h00);
+	else
+		local = h11 + (1.0f - fx) * (h01 - h11) + (1.0f - fz) * (h10 - h11);
+
+	D3DXVECTOR3 surface(gridX, local, gridZ);
+	D3DXVec3TransformCoord(&surface, &surface, &world_);
+	*height = surface.y;
+	return true;
+}
+
+/*
+	Name		Terrain::getCell
+	Syntax		Terrain::getCell(float x, float z)
+	Param		float x, z - A world space position
+	Return		int - Index of the cell below the position, or -1 if it is
+				off the terrain
+	Brief		Finds the cell a position is over, as terrain paging would
+*/
+int Terrain::getCell(float x, float z) const
+{
+	float gridX, gridZ;
+	if (!toGrid(x, z, &gridX, &gridZ))
+		return -1;
+
+	UINT col = min((UINT)gridX, width_ - 2) / CELL_QUADS;
+	UINT row = min((UINT)gridZ, height_ - 2) / CELL_QUADS;
+	return (int)(row * cellsAcross_ + col);
+}
+
+/*
+	Name		Terrain::getHeightField
+	Syntax		Terrain::getHeightField(M3DHeightField* field)
+	Param		M3DHeightField* field - Receives the terrain's heights and the
+				map from world space into them
+	Brief		Describes the terrain for batched height lookups
+	Details		The field blends the four samples around a position, so it
+				can differ from getHeight's triangles by a little inside a
+				quad. Like getHeight it assumes the terrain is only turned
+				about the y axis, and it must be fetched again after the
+				terrain is moved
+*/
+void Terrain::getHeightField(M3DHeightField* field) const
+{
+	field->heights = fieldHeights_.empty() ? 0 : &fieldHeights_[0];
+	field->width = (int)width_;
+	field->depth = (int)height_;
+	field->toGrid[0] = invWorld_._11;
+	field->toGrid[1] = invWorld_._31;
+	field->toGrid[2] = invWorld_._41;
+	field->toGrid[3] = invWorld_._13;
+	field->toGrid[4] = invWorld_._33;
+	field->toGrid[5] = invWorld_._43;
+	field->heightScale = world_._22;
+	field->heightOffset = world_._42;
+}
+
+/*
+	Name		Terrain::toGrid
+	Syntax		Terrain::toGrid(float x, float z, float* gridX, float* gridZ)
+	Param		float x, z - A world space position
+	Param		float* gridX, gridZ - Receive the position in height map
+				samples
+	Return		bool - False if the position is off the terrain
+	Brief		Takes a world position into the height map's grid
+*/
+bool Terrain::toGrid(float x, float z, float* gridX, float* gridZ) const
+{
+	if (!heightMap_ || width_ < 2 || height_ < 2)
+		return false;
+
+	D3DXVECTOR3 local(x, 0.0f, z);
+	D3DXVec3TransformCoord(&local, &local, &invWorld_);
+	if (local.x < 0.0f || local.z < 0.0f || local.x > width_ - 1 || local.z > height_ - 1)
+		return false;
+
+	*gridX = local.x;
+	*gridZ = local.z;
+	return true;
+}
+
+/*
+	Name		Terrain::setCellBounds
+	Syntax		Terrain::setCellBounds()
+	Brief		Transforms the bounds of the cells into world space and
+				rebuilds the hierarchy over them
+	Details		The centre of each box is transformed, and its half extents
+				are taken through the absolute values of the matrix, which
+				gives the world box that holds the rotated local one
+*/
+void Terrain::setCellBounds()
+{
+	for (UINT c = 0; c < cellsNo_; ++c)
+	{
+		D3DXVECTOR3 centre = (cellLocalMins_[c] + cellLocalMaxs_[c]) * 0.5f;
+		D3DXVECTOR3 extent = (cellLocalMaxs_[c] - cellLocalMins_[c]) * 0.5f;
+
+		D3DXVECTOR3 worldCentre;
+		D3DXVec3TransformCoord(&worldCentre, &centre, &world_);
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float worldExtent = fabsf(world_(0, axis)) * extent.x + 
+								fabsf(world_(1, axis)) * extent.y + 
+								fabsf(world_(2, axis)) * extent.z;
+			cellBounds_[axis * cellsNo_ + c] = worldCentre[axis] - worldExtent;
+			cellBounds_[(axis + 3) * cellsNo_ + c] = worldCentre[axis] + worldExtent;
+		}
+	}
+
+	if (cellsNo_ > 0)
+	{
+		float* bounds = &cellBounds_[0];
+		M3DBoxArray boxes = { bounds, bounds + cellsNo_, bounds + cellsNo_ * 2,
+							  bounds + cellsNo_ * 3, bounds + cellsNo_ * 4, bounds + cellsNo_ * 5,
+							  (int)cellsNo_ };
+		cellTree_.build(boxes);
+	}
 }
 
 /*
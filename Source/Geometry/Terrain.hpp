@@ -14,6 +14,10 @@
 #include <d3dx10math.h>
 #include <stdio.h>
 #include <fstream>
+#include <vector>
+#include "Maths/m3dBVH.h"
+#include "Maths/m3dHeight.h"
+#include "Renderer/OcclusionBuffer.hpp"
 
 struct Vertex;
 
@@ -24,6 +28,13 @@ public:
 	~Terrain();
 	bool initialise(ID3D10Device* device, char* heightMapFileName);
 	void render(); 
+	UINT cull(const M3DFrustum& frustum);
+	void drawOccluders(OcclusionBuffer* buffer);
+	UINT cullOccluded(const OcclusionBuffer& buffer);
+	UINT getCellsNo() const { return cellsNo_; };
+	bool getHeight(float x, float z, float* height) const;
+	int getCell(float x, float z) const;
+	void getHeightField(M3DHeightField* field) const;
 	DWORD getNumVertices() const { return verticesNo_; };
 	DWORD getfacesNo_() const { return facesNo_; };
 	D3DXMATRIX getWorld() const { return world_; };
@@ -48,8 +59,13 @@ private:
 	bool initialiseBuffers();
 	void calculateNormals(Vertex* vertices, DWORD* indices);
 	void calculateNormalsPerTriangle(Vertex* vertices, DWORD* indices);
+	void setCellBounds();
+	void initialiseOccluders();
+
+	bool toGrid(float x, float z, float* gridX, float* gridZ) const;
 
 	D3DXMATRIX world_;
+	D3DXMATRIX invWorld_;
 	D3DXVECTOR3 pos_, theta_, scale_;
 
 	DWORD verticesNo_;
@@ -63,6 +79,33 @@ private:
 	UINT height_;
 
 	D3DXVECTOR3* heightMap_;
+	std::vector<float> fieldHeights_;			// Heights alone, for batched lookups
+
+	// Square cells of the grid, each a contiguous run of the index buffer
+	// so that the cells left after culling can be drawn in a few calls
+	UINT cellsNo_;
+	UINT cellsAcross_;							// Cells along each row of the grid
+	std::vector<UINT> cellStarts_;				// First index of each cell
+	std::vector<UINT> cellCounts_;				// Indices in each cell
+	std::vector<D3DXVECTOR3> cellLocalMins_;	// Bounds in the terrain's space
+	std::vector<D3DXVECTOR3> cellLocalMaxs_;
+	std::vector<float> cellBounds_;				// World bounds as min x, y, z and
+												// max x, y, z arrays, one after another
+	std::vector<unsigned char> cellVisible_;
+	std::vector<int> cellsInView_;				// Cells gathered by the last cull
+	M3DBVH cellTree_;							// Hierarchy of the world bounds
+
+	// Coarse mesh under the terrain drawn into the occlusion buffer, with
+	// each cell's triangles a contiguous run of its indices
+	std::vector<float> occluderVertices_;		// x, y and z in the terrain's space
+	std::vector<UINT> occluderIndices_;
+	std::vector<UINT> occluderStarts_;
+	std::vector<UINT> occluderCounts_;
+	std::vector<UINT> occludersInView_;			// Indices of the cells in view
+
+	static const UINT CELL_QUADS = 32;			// Quads along the side of a cell
+	static const UINT OCCLUDER_QUADS = 8;		// Quads along the side of an occluder quad,
+												// a factor of CELL_QUADS
 	const int DIMENSIONS;
 	const float SMOOTHING_FACTOR;
 };
@@ -10,18 +10,25 @@
 #include <exception>
 #include <cassert>
 #include "Input/DirectInput.hpp"
+#include "Input/InputLog.hpp"
+#include "Profiler/Profiler.hpp"
 
 /*
 	Name		DirectInput::DirectInput
-	Syntax		DirectInput()
+	Syntax		DirectInput(InputLog* log)
+	Param		InputLog* log - Log to record the input to or replay it from
 	Brief		DirectInput constructor gets the input devices and initialises input variables
+	Details		The devices are not acquired when the input is replayed
 */
-DirectInput::DirectInput()
-: diObject_(0), keyboardDevice_(0), mouseDevice_(0), mouseX_(0), mouseY_(0), mouseZ_(0),
+DirectInput::DirectInput(InputLog* log)
+: log_(log), diObject_(0), keyboardDevice_(0), mouseDevice_(0), mouseX_(0), mouseY_(0), mouseZ_(0),
   mouseLeftUp_(true), mouseLeftDown_(false), mouseRightUp_(true), mouseRightDown_(false),
   mouseLeftPressed_(false), mouseRightPressed_(false), KEYBOARD_BUFFER_SIZE(16)
 { 
-    if (!getDevices())
+	ZeroMemory(keyBuffer_, sizeof(keyBuffer_));
+	ZeroMemory(&mouseState_, sizeof(mouseState_));
+
+    if (!(log_ && log_->isReplaying()) && !getDevices())
     {
         throw new std::exception("getDevices failed.");
     }
@@ -60,13 +67,28 @@ DirectInput::~DirectInput()
 	Name		DirectInput::update
 	Syntax		directInputObj.update()
 	Brief		Reads the active input devices and maps into the key events arrays and mouse button flags
+	Details		When replaying, the device state is taken from the input log 
+				instead of the devices
 */
 void DirectInput::update()
 {	
-    // Obtain the current keyboard state and pack it into the keyBuffer_ 
-    bool deviceState = SUCCEEDED(keyboardDevice_->GetDeviceState(sizeof(keyBuffer_),
-                                keyBuffer_));
-    assert(deviceState);
+	PROFILE_ZONE("DirectInput::update");
+
+	if (log_ && log_->isReplaying())
+	{
+		readLog();
+	}
+	else
+	{
+		readDevices();
+
+		if (log_ && log_->isRecording())
+		{
+			log_->capture(keyBuffer_, mouseState_.lX, mouseState_.lY, mouseState_.lZ,
+						  (mouseState_.rgbButtons[0] & 0x80) != 0, 
+						  (mouseState_.rgbButtons[1] & 0x80) != 0);
+		}
+	}
 
     // Set key states
 	for (int i = 0; i < 256; ++i)
@@ -89,10 +111,6 @@ void DirectInput::update()
 		}
 	}
 
-	bool MouseDeviceState = SUCCEEDED(mouseDevice_->GetDeviceState(sizeof(mouseState_),
-                                &mouseState_));
-    assert(MouseDeviceState);
-
 	if (mouseState_.rgbButtons[0] & 0x80)
 	{
 		// Pressed
@@ -129,6 +147,47 @@ void DirectInput::update()
 	mouseZ_ = static_cast<float>(mouseState_.lZ);
 }
 
+/*
+	Name		DirectInput::readDevices
+	Syntax		directInputObj.readDevices()
+	Brief		Reads the keyboard and mouse state from the devices
+*/
+void DirectInput::readDevices()
+{
+    // Obtain the current keyboard state and pack it into the keyBuffer_ 
+    bool deviceState = SUCCEEDED(keyboardDevice_->GetDeviceState(sizeof(keyBuffer_),
+                                keyBuffer_));
+    assert(deviceState);
+
+	bool MouseDeviceState = SUCCEEDED(mouseDevice_->GetDeviceState(sizeof(mouseState_),
+                                &mouseState_));
+    assert(MouseDeviceState);
+}
+
+/*
+	Name		DirectInput::readLog
+	Syntax		directInputObj.readLog()
+	Brief		Reads the keyboard and mouse state from the current frame of 
+				the input log
+*/
+void DirectInput::readLog()
+{
+	const InputFrame& frame = log_->getFrame();
+
+	ZeroMemory(keyBuffer_, sizeof(keyBuffer_));
+	for (int i = 0; i < frame.keysNo; ++i)
+	{
+		keyBuffer_[frame.keys[i]] = (char)0x80;
+	}
+
+	ZeroMemory(&mouseState_, sizeof(mouseState_));
+	mouseState_.lX = frame.mouseX;
+	mouseState_.lY = frame.mouseY;
+	mouseState_.lZ = frame.mouseZ;
+	mouseState_.rgbButtons[0] = (frame.mouseButtons & InputFrame::MOUSE_LEFT) ? 0x80 : 0;
+	mouseState_.rgbButtons[1] = (frame.mouseButtons & InputFrame::MOUSE_RIGHT) ? 0x80 : 0;
+}
+
 /*
 	Name		DirectInput::getDevices
 	Syntax		directInputObj.getDevices()
@@ -13,10 +13,12 @@
 #define DIRECTINPUT_VERSION 0x0800
 #include <dinput.h> 
 
+class InputLog;
+
 class DirectInput 
 {
 public:
-	DirectInput();
+	DirectInput(InputLog* log = 0);
 
 	virtual ~DirectInput();
 	virtual void update();
@@ -31,6 +33,10 @@ private:
 
 	bool getDevices();
 	void shutDown();
+	void readDevices();
+	void readLog();
+
+	InputLog* log_;							// Records or replays the input, if set
 
 	LPDIRECTINPUT8 diObject_;				// DirectInput main object
 	LPDIRECTINPUTDEVICE8 keyboardDevice_;	// Keyboard device
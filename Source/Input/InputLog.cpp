@@ -0,0 +1,256 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Input Log
+	Brief		Definition of InputLog class used to record the per-frame
+				input and time step to a compact binary file and to feed it
+				back to the scene for repeatable runs
+	Details		The log starts with the magic "SEAS", a 16 bit version and a
+				16 bit reserved field. Each frame is then stored as
+				float		dt
+				int16 x 3	mouse x, y and z deltas
+				uint8		mouse buttons
+				uint8		season
+				uint8		number of keys held
+				uint8 x n	scan codes of the keys held
+*/
+
+#include <limits.h>
+
+#include "Input/InputLog.hpp"
+
+namespace
+{
+	const char LOG_MAGIC[4] = { 'S', 'E', 'A', 'S' };
+	const unsigned short LOG_VERSION = 1;
+
+	/*
+		Name		clampShort
+		Syntax		clampShort(long value)
+		Param		long value - The value to clamp
+		Return		short - The value clamped to the range of a short
+		Brief		Clamps a mouse delta so that it fits in the log
+	*/
+	short clampShort(long value)
+	{
+		if (value > SHRT_MAX) return SHRT_MAX;
+		if (value < SHRT_MIN) return SHRT_MIN;
+		return (short)value;
+	}
+}
+
+/*
+	Name		InputLog::InputLog
+	Syntax		InputLog()
+	Brief		InputLog constructor initialises member variables
+*/
+InputLog::InputLog()
+: mode_(MODE_NONE), file_(0), cursor_(0)
+{
+}
+
+/*
+	Name		InputLog::~InputLog
+	Syntax		~InputLog()
+	Brief		InputLog destructor closes the log
+*/
+InputLog::~InputLog()
+{
+	close();
+}
+
+/*
+	Name		InputLog::openForRecording
+	Syntax		InputLog::openForRecording(const std::string& fileName)
+	Param		const std::string& fileName - The file the log is written to
+	Return		bool - False if the file could not be created
+	Brief		Creates the log file and writes its header
+*/
+bool InputLog::openForRecording(const std::string& fileName)
+{
+	close();
+
+	if (fopen_s(&file_, fileName.c_str(), "wb") != 0)
+	{
+		file_ = 0;
+		return false;
+	}
+
+	unsigned short header[2] = { LOG_VERSION, 0 };
+	fwrite(LOG_MAGIC, sizeof(LOG_MAGIC), 1, file_);
+	fwrite(header, sizeof(header), 1, file_);
+
+	mode_ = MODE_RECORD;
+	return true;
+}
+
+/*
+	Name		InputLog::openForReplay
+	Syntax		InputLog::openForReplay(const std::string& fileName)
+	Param		const std::string& fileName - The file the log is read from
+	Return		bool - False if the file could not be read or is not a log
+	Brief		Reads every frame of the log into memory
+	Details		The whole log is read up front so that no file access is
+				timed during a replay
+*/
+bool InputLog::openForReplay(const std::string& fileName)
+{
+	close();
+
+	FILE* file = 0;
+	if (fopen_s(&file, fileName.c_str(), "rb") != 0)
+		return false;
+
+	char magic[4];
+	unsigned short header[2];
+	if (fread(magic, sizeof(magic), 1, file) != 1 ||
+		fread(header, sizeof(header), 1, file) != 1 ||
+		memcmp(magic, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0 ||
+		header[0] != LOG_VERSION)
+	{
+		fclose(file);
+		return false;
+	}
+
+	for (;;)
+	{
+		InputFrame frame;
+		short mouse[3];
+		unsigned char flags[3];
+
+		if (fread(&frame.dt, sizeof(frame.dt), 1, file) != 1 ||
+			fread(mouse, sizeof(mouse), 1, file) != 1 ||
+			fread(flags, sizeof(flags), 1, file) != 1)
+		{
+			break;
+		}
+
+		frame.mouseX = mouse[0];
+		frame.mouseY = mouse[1];
+		frame.mouseZ = mouse[2];
+		frame.mouseButtons = flags[0];
+		frame.season = flags[1];
+		frame.keysNo = flags[2];
+
+		if (frame.keysNo > InputFrame::MAX_KEYS ||
+			fread(frame.keys, 1, frame.keysNo, file) != frame.keysNo)
+		{
+			break;
+		}
+
+		frames_.push_back(frame);
+	}
+	fclose(file);
+
+	mode_ = MODE_REPLAY;
+	cursor_ = 0;
+	return true;
+}
+
+/*
+	Name		InputLog::close
+	Syntax		InputLog::close()
+	Brief		Closes the log file and discards any loaded frames
+*/
+void InputLog::close()
+{
+	if (file_)
+	{
+		fclose(file_);
+		file_ = 0;
+	}
+
+	frames_.clear();
+	cursor_ = 0;
+	mode_ = MODE_NONE;
+}
+
+/*
+	Name		InputLog::beginFrame
+	Syntax		InputLog::beginFrame(float dt, int season)
+	Param		float dt - Time step of the frame being recorded
+	Param		int season - The season the frame is run in
+	Brief		Starts recording a new frame
+*/
+void InputLog::beginFrame(float dt, int season)
+{
+	frame_ = InputFrame();
+	frame_.dt = dt;
+	frame_.season = (unsigned char)season;
+}
+
+/*
+	Name		InputLog::capture
+	Syntax		InputLog::capture(const char* keyBuffer, long mouseX, long mouseY,
+								  long mouseZ, bool mouseLeftDown,
+								  bool mouseRightDown)
+	Param		const char* keyBuffer - The 256 byte DirectInput key state
+	Param		long mouseX - Mouse x delta
+	Param		long mouseY - Mouse y delta
+	Param		long mouseZ - Mouse wheel delta
+	Param		bool mouseLeftDown - True if the left button is held
+	Param		bool mouseRightDown - True if the right button is held
+	Brief		Stores the device state read this frame
+*/
+void InputLog::capture(const char* keyBuffer, long mouseX, long mouseY,
+					   long mouseZ, bool mouseLeftDown, bool mouseRightDown)
+{
+	frame_.keysNo = 0;
+	for (int i = 0; i < 256 && frame_.keysNo < InputFrame::MAX_KEYS; ++i)
+	{
+		if (keyBuffer[i] & 0x80)
+			frame_.keys[frame_.keysNo++] = (unsigned char)i;
+	}
+
+	frame_.mouseX = clampShort(mouseX);
+	frame_.mouseY = clampShort(mouseY);
+	frame_.mouseZ = clampShort(mouseZ);
+	frame_.mouseButtons = (mouseLeftDown ? InputFrame::MOUSE_LEFT : 0) |
+						  (mouseRightDown ? InputFrame::MOUSE_RIGHT : 0);
+}
+
+/*
+	Name		InputLog::endFrame
+	Syntax		InputLog::endFrame()
+	Brief		Writes the recorded frame to the log
+*/
+void InputLog::endFrame()
+{
+	if (!file_)
+		return;
+
+	short mouse[3] = { frame_.mouseX, frame_.mouseY, frame_.mouseZ };
+	unsigned char flags[3] = { frame_.mouseButtons, frame_.season, frame_.keysNo };
+
+	fwrite(&frame_.dt, sizeof(frame_.dt), 1, file_);
+	fwrite(mouse, sizeof(mouse), 1, file_);
+	fwrite(flags, sizeof(flags), 1, file_);
+	fwrite(frame_.keys, 1, frame_.keysNo, file_);
+}
+
+/*
+	Name		InputLog::nextFrame
+	Syntax		InputLog::nextFrame()
+	Return		bool - False once every frame has been replayed
+	Brief		Moves on to the next frame of the replay
+*/
+bool InputLog::nextFrame()
+{
+	if (cursor_ >= frames_.size())
+		return false;
+
+	frame_ = frames_[cursor_++];
+	return true;
+}
+
+/*
+	Name		InputLog::rewind
+	Syntax		InputLog::rewind()
+	Brief		Restarts the replay from the first frame
+*/
+void InputLog::rewind()
+{
+	cursor_ = 0;
+}
@@ -0,0 +1,90 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Input Log
+	Brief		Definition of InputLog class used to record the per-frame
+				input and time step to a compact binary file and to feed it
+				back to the scene for repeatable runs
+*/
+
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+	Name		InputFrame
+	Syntax		InputFrame
+	Brief		The input and time step for a single frame
+	Details		Only the scan codes of keys held down are stored, so a frame
+				is usually 11 or 12 bytes in the log
+*/
+struct InputFrame
+{
+	InputFrame() { memset(this, 0, sizeof(InputFrame)); }
+
+	enum { MAX_KEYS = 32 };
+	enum { MOUSE_LEFT = 0x1, MOUSE_RIGHT = 0x2 };
+
+	float dt;
+	short mouseX;
+	short mouseY;
+	short mouseZ;
+	unsigned char mouseButtons;
+	unsigned char season;
+	unsigned char keysNo;
+	unsigned char keys[MAX_KEYS];	// Scan codes of the keys held down
+};
+
+class InputLog
+{
+public:
+	InputLog();
+	~InputLog();
+
+	bool openForRecording(const std::string& fileName);
+	bool openForReplay(const std::string& fileName);
+	void close();
+
+	bool isRecording() const { return mode_ == MODE_RECORD; };
+	bool isReplaying() const { return mode_ == MODE_REPLAY; };
+
+	// Recording
+	void beginFrame(float dt, int season);
+	void capture(const char* keyBuffer, long mouseX, long mouseY, long mouseZ,
+				 bool mouseLeftDown, bool mouseRightDown);
+	void endFrame();
+
+	// Replay
+	bool nextFrame();
+	void rewind();
+	UINT getFramesNo() const { return (UINT)frames_.size(); };
+
+	const InputFrame& getFrame() const { return frame_; };
+
+private:
+	InputLog(const InputLog& rhs);
+	InputLog& operator=(const InputLog& rhs);
+
+	enum Mode
+	{
+		MODE_NONE,
+		MODE_RECORD,
+		MODE_REPLAY,
+	};
+
+	Mode mode_;
+	FILE* file_;
+
+	InputFrame frame_;
+	std::vector<InputFrame> frames_;
+	UINT cursor_;
+};
+
+#endif // INPUTLOG_H
@@ -0,0 +1,93 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dApprox
+	Brief		Array versions of the fast approximations, four elements at a
+				time with SSE and the rest one at a time
+*/
+
+#include "Maths/m3dApprox.h"
+
+void m3dFastSinCos(const float* x, float* s, float* c, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 vs, vc;
+		m3dFastSinCos(_mm_loadu_ps(x + i), &vs, &vc);
+		_mm_storeu_ps(s + i, vs);
+		_mm_storeu_ps(c + i, vc);
+	}
+#endif
+	for (; i < count; ++i)
+		m3dFastSinCos(x[i], s + i, c + i);
+}
+
+void m3dFastSin(const float* x, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, m3dFastSin(_mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; ++i)
+		out[i] = m3dFastSin(x[i]);
+}
+
+void m3dFastCos(const float* x, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, m3dFastCos(_mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; ++i)
+		out[i] = m3dFastCos(x[i]);
+}
+
+void m3dFastAtan2(const float* y, const float* x, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, m3dFastAtan2(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; ++i)
+		out[i] = m3dFastAtan2(y[i], x[i]);
+}
+
+void m3dFastExp(const float* x, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, m3dFastExp(_mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; ++i)
+		out[i] = m3dFastExp(x[i]);
+}
+
+void m3dFastLog(const float* x, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, m3dFastLog(_mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; ++i)
+		out[i] = m3dFastLog(x[i]);
+}
+
+void m3dFastRsqrt(const float* x, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, m3dFastRsqrt(_mm_loadu_ps(x + i)));
+#endif
+	for (; i < count; ++i)
+		out[i] = m3dFastRsqrt(x[i]);
+}
@@ -0,0 +1,350 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dApprox
+	Brief		Fast approximations of sin, cos, atan2, exp, log and 1 / sqrt,
+				for one float, four floats in an SSE register, or an array
+	Details		The polynomials are the single precision ones of the Cephes
+				library. The scalar and SSE versions do the same operations in
+				the same order, so they give the same results bit for bit,
+				apart from m3dFastRsqrt.
+				Measured against the double precision C library with -bench
+				approx, which sweeps every mantissa of the binades near one,
+				the largest errors are:
+
+				m3dFastSin, m3dFastCos	1.0e-7 absolute for |x| <= 8192; the
+										range reduction loses accuracy beyond
+				m3dFastAtan2			3.0e-7 absolute (radians)
+				m3dFastExp				1.2e-7 relative for -87 <= x <= 88; x
+										is clamped to that range
+				m3dFastLog				4.0e-8 absolute for 0.5 <= x <= 2, and
+										8.2e-8 relative elsewhere; x below
+										FLT_MIN is treated as FLT_MIN
+				m3dFastRsqrt			2.8e-7 relative; one Newton step on the
+										SSE estimate, or 9.0e-8 without SSE,
+										where it is 1 / sqrtf
+
+				None of them handle infinities or NaNs as the C library does
+*/
+
+#ifndef M3DAPPROX_H
+#define M3DAPPROX_H
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+#include "Maths/math3d.h"
+#include "Maths/m3dSIMD.h"
+
+// Constants shared by the scalar and SSE versions
+#define M3D_APPROX_2_OVER_PI	0.636619772367581343f
+#define M3D_APPROX_PI_2_A		1.5703125f						// pi / 2 split in three so that
+#define M3D_APPROX_PI_2_B		4.837512969970703125e-4f		// n * A and n * B are exact
+#define M3D_APPROX_PI_2_C		7.54978995489188216e-8f
+#define M3D_APPROX_TAN_PI_8		0.414213562373095f
+#define M3D_APPROX_LOG2E		1.44269504088896341f
+#define M3D_APPROX_LN2_A		0.693359375f					// ln 2 split in two
+#define M3D_APPROX_LN2_B		-2.12194440e-4f
+#define M3D_APPROX_SQRT_HALF	0.707106781186547524f
+#define M3D_APPROX_EXP_MIN		-87.0f
+#define M3D_APPROX_EXP_MAX		88.0f
+
+// sin(r) and cos(r) for |r| <= pi / 4
+#define M3D_APPROX_SIN_POLY(r, r2)	((r) + (r) * (r2) * (-1.6666654611e-1f + (r2) * \
+										(8.3321608736e-3f + (r2) * -1.9515295891e-4f)))
+#define M3D_APPROX_COS_POLY(r2)		(1.0f - 0.5f * (r2) + (r2) * (r2) * (4.166664568298827e-2f + \
+										(r2) * (-1.388731625493765e-3f + (r2) * 2.443315711809948e-5f)))
+
+// atan(z) - z for |z| <= tan(pi / 8)
+#define M3D_APPROX_ATAN_POLY(z, z2)	((z) * (z2) * (-3.33329491539e-1f + (z2) * (1.99777106478e-1f + \
+										(z2) * (-1.38776856032e-1f + (z2) * 8.05374449538e-2f))))
+
+// exp(r) - 1 - r for |r| <= ln 2 / 2
+#define M3D_APPROX_EXP_POLY(r)		((r) * (r) * (5.0000001201e-1f + (r) * (1.6666665459e-1f + \
+										(r) * (4.1665795894e-2f + (r) * (8.3334519073e-3f + \
+										(r) * (1.3981999507e-3f + (r) * 1.9875691500e-4f))))))
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar versions
+
+// sin and cos of x. The quadrant n is rounded from |x| and the remainder
+// taken in three steps, then the sin or cos polynomial is picked by it
+inline void m3dFastSinCos(float x, float* s, float* c)
+{
+	float a = fabsf(x);
+	int n = (int)(a * M3D_APPROX_2_OVER_PI + 0.5f);
+	float fn = (float)n;
+	float r = ((a - fn * M3D_APPROX_PI_2_A) - fn * M3D_APPROX_PI_2_B) - fn * M3D_APPROX_PI_2_C;
+	float r2 = r * r;
+
+	float ps = M3D_APPROX_SIN_POLY(r, r2);
+	float pc = M3D_APPROX_COS_POLY(r2);
+
+	float sinA = (n & 1) ? pc : ps;
+	float cosA = (n & 1) ? ps : pc;
+	if (n & 2) sinA = -sinA;
+	if ((n + 1) & 2) cosA = -cosA;
+
+	*s = x < 0.0f ? -sinA : sinA;
+	*c = cosA;
+}
+
+inline float m3dFastSin(float x)
+{
+	float s, c;
+	m3dFastSinCos(x, &s, &c);
+	return s;
+}
+
+inline float m3dFastCos(float x)
+{
+	float s, c;
+	m3dFastSinCos(x, &s, &c);
+	return c;
+}
+
+// atan2(y, x) in [-pi, pi]. atan of the smaller over the larger of |x|
+// and |y|, which is in [0, 1], is reflected into the right octant
+inline float m3dFastAtan2(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float big = ax > ay ? ax : ay;
+	float t = (ax < ay ? ax : ay) / (big > FLT_MIN ? big : FLT_MIN);
+
+	float base = 0.0f;
+	if (t > M3D_APPROX_TAN_PI_8)
+	{
+		base = float(M3D_PI) * 0.25f;
+		t = (t - 1.0f) / (t + 1.0f);
+	}
+	float r = base + t + M3D_APPROX_ATAN_POLY(t, t * t);
+
+	if (ay > ax) r = float(M3D_PI) * 0.5f - r;
+	if (x < 0.0f) r = float(M3D_PI) - r;
+
+	unsigned int bits;
+	memcpy(&bits, &y, sizeof(bits));
+	return (bits & 0x80000000u) ? -r : r;
+}
+
+// e^x. x = n ln 2 + r, and 2^n is built directly in the exponent bits
+inline float m3dFastExp(float x)
+{
+	x = x < M3D_APPROX_EXP_MIN ? M3D_APPROX_EXP_MIN : (x > M3D_APPROX_EXP_MAX ? M3D_APPROX_EXP_MAX : x);
+
+	float fn = floorf(x * M3D_APPROX_LOG2E + 0.5f);
+	float r = (x - fn * M3D_APPROX_LN2_A) - fn * M3D_APPROX_LN2_B;
+	float e = 1.0f + r + M3D_APPROX_EXP_POLY(r);
+
+	unsigned int bits = (unsigned int)((int)fn + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return e * scale;
+}
+
+// Natural log of x. x = m 2^e with m in [sqrt(1/2), sqrt(2)), read from
+// the float's bits, and log(m) comes from the polynomial
+inline float m3dFastLog(float x)
+{
+	x = x > FLT_MIN ? x : FLT_MIN;
+
+	unsigned int bits;
+	memcpy(&bits, &x, sizeof(bits));
+	int e = (int)(bits >> 23) - 126;
+	bits = (bits & 0x007fffffu) | 0x3f000000u;
+	float m;
+	memcpy(&m, &bits, sizeof(m));		// m in [0.5, 1)
+
+	if (m < M3D_APPROX_SQRT_HALF)
+	{
+		--e;
+		m = m + m;
+	}
+	float f = m - 1.0f;
+	float f2 = f * f;
+	float fe = (float)e;
+
+	float p = ((((((((7.0376836292e-2f * f - 1.1514610310e-1f) * f + 1.1676998740e-1f) * f
+				- 1.2420140846e-1f) * f + 1.4249322787e-1f) * f - 1.6668057665e-1f) * f
+				+ 2.0000714765e-1f) * f - 2.4999993993e-1f) * f + 3.3333331174e-1f) * f * f2;
+
+	p += fe * M3D_APPROX_LN2_B;
+	p -= 0.5f * f2;
+	return (f + p) + fe * M3D_APPROX_LN2_A;
+}
+
+inline float m3dFastRsqrt(float x)
+{
+#ifdef M3D_SSE
+	return _mm_cvtss_f32(m3dRsqrt(_mm_set_ss(x)));
+#else
+	return 1.0f / sqrtf(x);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// SSE versions, four lanes at a time with the same polynomials
+
+#ifdef M3D_SSE
+
+inline void m3dFastSinCos(__m128 x, __m128* s, __m128* c)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+
+	__m128 sign = _mm_and_ps(x, signMask);
+	__m128 a = _mm_andnot_ps(signMask, x);
+
+	__m128i n = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(M3D_APPROX_2_OVER_PI)),
+											_mm_set1_ps(0.5f)));
+	__m128 fn = _mm_cvtepi32_ps(n);
+	__m128 r = _mm_sub_ps(a, _mm_mul_ps(fn, _mm_set1_ps(M3D_APPROX_PI_2_A)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(M3D_APPROX_PI_2_B)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(M3D_APPROX_PI_2_C)));
+	__m128 r2 = _mm_mul_ps(r, r);
+
+	// Sin polynomial
+	__m128 ps = _mm_add_ps(_mm_set1_ps(8.3321608736e-3f), _mm_mul_ps(r2, _mm_set1_ps(-1.9515295891e-4f)));
+	ps = _mm_add_ps(_mm_set1_ps(-1.6666654611e-1f), _mm_mul_ps(r2, ps));
+	ps = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2), ps));
+
+	// Cos polynomial
+	__m128 pc = _mm_add_ps(_mm_set1_ps(-1.388731625493765e-3f), _mm_mul_ps(r2, _mm_set1_ps(2.443315711809948e-5f)));
+	pc = _mm_add_ps(_mm_set1_ps(4.166664568298827e-2f), _mm_mul_ps(r2, pc));
+	pc = _mm_mul_ps(_mm_mul_ps(r2, r2), pc);
+	pc = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), r2)), pc);
+
+	// Odd quadrants swap the polynomials, and the quadrant flips the signs
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(n, one), one));
+	__m128 sinA = _mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps));
+	__m128 cosA = _mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc));
+
+	__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(n, two), 30));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(n, one), two), 30));
+
+	*s = _mm_xor_ps(sinA, _mm_xor_ps(sinSign, sign));
+	*c = _mm_xor_ps(cosA, cosSign);
+}
+
+inline __m128 m3dFastSin(__m128 x)
+{
+	__m128 s, c;
+	m3dFastSinCos(x, &s, &c);
+	return s;
+}
+
+inline __m128 m3dFastCos(__m128 x)
+{
+	__m128 s, c;
+	m3dFastSinCos(x, &s, &c);
+	return c;
+}
+
+inline __m128 m3dFastAtan2(__m128 y, __m128 x)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 ax = _mm_andnot_ps(signMask, x);
+	__m128 ay = _mm_andnot_ps(signMask, y);
+	__m128 big = _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(FLT_MIN));
+	__m128 t = _mm_div_ps(_mm_min_ps(ax, ay), big);
+
+	__m128 reduce = _mm_cmpgt_ps(t, _mm_set1_ps(M3D_APPROX_TAN_PI_8));
+	__m128 base = _mm_and_ps(reduce, _mm_set1_ps(float(M3D_PI) * 0.25f));
+	__m128 tr = _mm_div_ps(_mm_sub_ps(t, one), _mm_add_ps(t, one));
+	t = _mm_or_ps(_mm_and_ps(reduce, tr), _mm_andnot_ps(reduce, t));
+
+	__m128 t2 = _mm_mul_ps(t, t);
+	__m128 p = _mm_add_ps(_mm_set1_ps(-1.38776856032e-1f), _mm_mul_ps(t2, _mm_set1_ps(8.05374449538e-2f)));
+	p = _mm_add_ps(_mm_set1_ps(1.99777106478e-1f), _mm_mul_ps(t2, p));
+	p = _mm_add_ps(_mm_set1_ps(-3.33329491539e-1f), _mm_mul_ps(t2, p));
+	__m128 r = _mm_add_ps(_mm_add_ps(base, t), _mm_mul_ps(_mm_mul_ps(t, t2), p));
+
+	__m128 steep = _mm_cmpgt_ps(ay, ax);
+	r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(_mm_set1_ps(float(M3D_PI) * 0.5f), r)),
+				  _mm_andnot_ps(steep, r));
+	__m128 back = _mm_cmplt_ps(x, _mm_setzero_ps());
+	r = _mm_or_ps(_mm_and_ps(back, _mm_sub_ps(_mm_set1_ps(float(M3D_PI)), r)),
+				  _mm_andnot_ps(back, r));
+
+	return _mm_xor_ps(r, _mm_and_ps(y, signMask));
+}
+
+inline __m128 m3dFastExp(__m128 x)
+{
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(M3D_APPROX_EXP_MIN)), _mm_set1_ps(M3D_APPROX_EXP_MAX));
+
+	// floor(x log2 e + 0.5), from a truncation corrected for negatives
+	__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(M3D_APPROX_LOG2E)), _mm_set1_ps(0.5f));
+	__m128 fn = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	fn = _mm_sub_ps(fn, _mm_and_ps(_mm_cmpgt_ps(fn, fx), _mm_set1_ps(1.0f)));
+
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(M3D_APPROX_LN2_A)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(M3D_APPROX_LN2_B)));
+
+	__m128 p = _mm_add_ps(_mm_set1_ps(1.3981999507e-3f), _mm_mul_ps(r, _mm_set1_ps(1.9875691500e-4f)));
+	p = _mm_add_ps(_mm_set1_ps(8.3334519073e-3f), _mm_mul_ps(r, p));
+	p = _mm_add_ps(_mm_set1_ps(4.1665795894e-2f), _mm_mul_ps(r, p));
+	p = _mm_add_ps(_mm_set1_ps(1.6666665459e-1f), _mm_mul_ps(r, p));
+	p = _mm_add_ps(_mm_set1_ps(5.0000001201e-1f), _mm_mul_ps(r, p));
+	p = _mm_mul_ps(_mm_mul_ps(r, r), p);
+	__m128 e = _mm_add_ps(_mm_add_ps(_mm_set1_ps(1.0f), r), p);
+
+	__m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(fn), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(e, _mm_castsi128_ps(bits));
+}
+
+inline __m128 m3dFastLog(__m128 x)
+{
+	x = _mm_max_ps(x, _mm_set1_ps(FLT_MIN));
+
+	__m128i bits = _mm_castps_si128(x);
+	__m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+											 _mm_set1_epi32(0x3f000000)));
+
+	__m128 small = _mm_cmplt_ps(m, _mm_set1_ps(M3D_APPROX_SQRT_HALF));
+	__m128 fe = _mm_sub_ps(_mm_cvtepi32_ps(e), _mm_and_ps(small, _mm_set1_ps(1.0f)));
+	m = _mm_add_ps(m, _mm_and_ps(small, m));
+	__m128 f = _mm_sub_ps(m, _mm_set1_ps(1.0f));
+	__m128 f2 = _mm_mul_ps(f, f);
+
+	__m128 p = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(7.0376836292e-2f), f), _mm_set1_ps(1.1514610310e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.1676998740e-1f));
+	p = _mm_sub_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.2420140846e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.4249322787e-1f));
+	p = _mm_sub_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.6668057665e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.0000714765e-1f));
+	p = _mm_sub_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.4999993993e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(3.3333331174e-1f));
+	p = _mm_mul_ps(_mm_mul_ps(p, f), f2);
+
+	p = _mm_add_ps(p, _mm_mul_ps(fe, _mm_set1_ps(M3D_APPROX_LN2_B)));
+	p = _mm_sub_ps(p, _mm_mul_ps(_mm_set1_ps(0.5f), f2));
+	return _mm_add_ps(_mm_add_ps(f, p), _mm_mul_ps(fe, _mm_set1_ps(M3D_APPROX_LN2_A)));
+}
+
+inline __m128 m3dFastRsqrt(__m128 x)
+{
+	return m3dRsqrt(x);
+}
+
+#endif // M3D_SSE
+
+///////////////////////////////////////////////////////////////////////////////
+// Array versions, four at a time with SSE. The outputs may be the inputs
+void m3dFastSinCos(const float* x, float* s, float* c, int count);
+void m3dFastSin(const float* x, float* out, int count);
+void m3dFastCos(const float* x, float* out, int count);
+void m3dFastAtan2(const float* y, const float* x, float* out, int count);
+void m3dFastExp(const float* x, float* out, int count);
+void m3dFastLog(const float* x, float* out, int count);
+void m3dFastRsqrt(const float* x, float* out, int count);
+
+#endif // M3DAPPROX_H
@@ -0,0 +1,595 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dBVH
+	Brief		Bounding volume hierarchy over axis aligned boxes
+*/
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "Maths/m3dBVH.h"
+#include "Maths/m3dRay.h"
+
+namespace
+{
+	const int MAX_LEAF_ITEMS = 4;	// One SSE pass of the leaf kernels
+	const int SAH_BINS = 16;		// Candidate split planes per axis
+
+	/*
+		Name		Bounds
+		Syntax		Bounds
+		Brief		A box grown to hold points and other boxes
+	*/
+	struct Bounds
+	{
+		Bounds()
+		{
+			min[0] = min[1] = min[2] = FLT_MAX;
+			max[0] = max[1] = max[2] = -FLT_MAX;
+		}
+
+		void add(const float boxMin[3], const float boxMax[3])
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				min[i] = boxMin[i] < min[i] ? boxMin[i] : min[i];
+				max[i] = boxMax[i] > max[i] ? boxMax[i] : max[i];
+			}
+		}
+
+		// Half the surface area, which is all the heuristic needs
+		float area() const
+		{
+			if (min[0] > max[0])
+				return 0.0f;
+			float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+			return dx * dy + dy * dz + dz * dx;
+		}
+
+		float min[3];
+		float max[3];
+	};
+
+	/*
+		Name		Bin
+		Syntax		Bin
+		Brief		Items whose centres fall in one slice of a node
+	*/
+	struct Bin
+	{
+		Bin() : count(0) {}
+
+		Bounds bounds;
+		int count;
+	};
+
+	/*
+		Name		BinOf
+		Syntax		BinOf
+		Brief		Predicate for partitioning items by the bin of their centre
+	*/
+	struct BinOf
+	{
+		BinOf(const std::vector<float>& centres, int axis, float min, float scale, int split)
+		: centres(centres), axis(axis), min(min), scale(scale), split(split) {}
+
+		static int bin(float centre, float min, float scale)
+		{
+			int b = (int)((centre - min) * scale);
+			return b < SAH_BINS - 1 ? b : SAH_BINS - 1;
+		}
+
+		bool operator()(int item) const
+		{
+			return bin(centres[item * 3 + axis], min, scale) <= split;
+		}
+
+		const std::vector<float>& centres;
+		int axis;
+		float min;
+		float scale;
+		int split;
+	};
+
+	inline float inverse(float d)
+	{
+		if (d == 0.0f)
+			return 1.0f / FLT_MIN;
+		return 1.0f / d;
+	}
+
+	/*
+		Name		rayNode
+		Syntax		rayNode(const float o[3], const float invD[3], const M3DCullNode& node)
+		Return		float - Distance at which the ray enters the node's box, 0 if
+					it starts inside, -1 if it misses
+	*/
+	inline float rayNode(const float o[3], const float invD[3], const M3DCullNode& node)
+	{
+		float tNear = 0.0f, tFar = FLT_MAX;
+		for (int i = 0; i < 3; ++i)
+		{
+			float t0 = (node.min[i] - o[i]) * invD[i];
+			float t1 = (node.max[i] - o[i]) * invD[i];
+			if (t0 > t1)
+			{
+				float swap = t0;
+				t0 = t1;
+				t1 = swap;
+			}
+			tNear = t0 > tNear ? t0 : tNear;
+			tFar = t1 < tFar ? t1 : tFar;
+		}
+		return tNear <= tFar ? tNear : -1.0f;
+	}
+
+	/*
+		Name		distanceSquared
+		Syntax		distanceSquared(const float p[3], const float boxMin[3],
+										const float boxMax[3])
+		Return		float - Squared distance from a point to a box, 0 inside it
+	*/
+	inline float distanceSquared(const float p[3], const float boxMin[3], const float boxMax[3])
+	{
+		float sum = 0.0f;
+		for (int i = 0; i < 3; ++i)
+		{
+			float d = 0.0f;
+			if (p[i] < boxMin[i])
+				d = boxMin[i] - p[i];
+			else if (p[i] > boxMax[i])
+				d = p[i] - boxMax[i];
+			sum += d * d;
+		}
+		return sum;
+	}
+}
+
+/*
+	Name		M3DBVH::M3DBVH
+	Syntax		M3DBVH()
+	Brief		M3DBVH constructor makes an empty tree
+*/
+M3DBVH::M3DBVH()
+{
+}
+
+/*
+	Name		M3DBVH::clear
+	Syntax		M3DBVH::clear()
+	Brief		Removes every item
+*/
+void M3DBVH::clear()
+{
+	nodes_.clear();
+	parents_.clear();
+	items_.clear();
+	slots_.clear();
+	leaves_.clear();
+	bounds_.clear();
+}
+
+/*
+	Name		M3DBVH::build
+	Syntax		M3DBVH::build(const M3DBoxArray& boxes)
+	Param		const M3DBoxArray& boxes - The items, identified from then on
+				by their index here
+	Brief		Builds the tree from scratch
+*/
+void M3DBVH::build(const M3DBoxArray& boxes)
+{
+	clear();
+
+	int count = boxes.count;
+	if (count <= 0)
+		return;
+
+	std::vector<float> centres(count * 3);
+	items_.resize(count);
+	for (int i = 0; i < count; ++i)
+	{
+		items_[i] = i;
+		centres[i * 3 + 0] = (boxes.minX[i] + boxes.maxX[i]) * 0.5f;
+		centres[i * 3 + 1] = (boxes.minY[i] + boxes.maxY[i]) * 0.5f;
+		centres[i * 3 + 2] = (boxes.minZ[i] + boxes.maxZ[i]) * 0.5f;
+	}
+
+	// A binary tree with n leaves has 2n - 1 nodes
+	nodes_.reserve(count * 2);
+	parents_.reserve(count * 2);
+	nodes_.resize(1);
+	parents_.push_back(-1);
+	leaves_.resize(count);
+
+	buildNode(0, 0, count, 0, boxes, centres);
+
+	slots_.resize(count);
+	bounds_.resize(count * 6);
+	for (int slot = 0; slot < count; ++slot)
+	{
+		int item = items_[slot];
+		slots_[item] = slot;
+
+		M3DVector3f boxMin = { boxes.minX[item], boxes.minY[item], boxes.minZ[item] };
+		M3DVector3f boxMax = { boxes.maxX[item], boxes.maxY[item], boxes.maxZ[item] };
+		setItemBox(slot, boxMin, boxMax);
+	}
+}
+
+/*
+	Name		M3DBVH::buildNode
+	Syntax		M3DBVH::buildNode(int node, int first, int count, int depth,
+						const M3DBoxArray& boxes, const std::vector<float>& centres)
+	Param		int node - The node to build
+	Param		int first - First of its items in items_
+	Param		int count - Number of its items
+	Param		int depth - Depth of the node, 0 for the root
+	Brief		Bounds a node and either makes it a leaf or splits its items
+				between two new children
+	Details		The centres are sorted into bins along each axis, and the
+				split between bins with the least summed area times count of
+				the two sides is taken. Items with coincident centres cannot
+				be split that way, so they are halved by count instead
+*/
+void M3DBVH::buildNode(int node, int first, int count, int depth, const M3DBoxArray& boxes,
+					   const std::vector<float>& centres)
+{
+	Bounds bounds, centreBounds;
+	for (int i = first; i < first + count; ++i)
+	{
+		int item = items_[i];
+		float boxMin[3] = { boxes.minX[item], boxes.minY[item], boxes.minZ[item] };
+		float boxMax[3] = { boxes.maxX[item], boxes.maxY[item], boxes.maxZ[item] };
+		bounds.add(boxMin, boxMax);
+		centreBounds.add(&centres[item * 3], &centres[item * 3]);
+	}
+	m3dCopyVector3(nodes_[node].min, bounds.min);
+	m3dCopyVector3(nodes_[node].max, bounds.max);
+
+	if (count <= MAX_LEAF_ITEMS || depth >= M3D_CULL_MAX_DEPTH - 1)
+	{
+		nodes_[node].first = first;
+		nodes_[node].count = count;
+		for (int i = first; i < first + count; ++i)
+			leaves_[i] = node;
+		return;
+	}
+
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float extent = centreBounds.max[axis] - centreBounds.min[axis];
+		if (extent <= 0.0f)
+			continue;
+
+		float scale = SAH_BINS / extent;
+		Bin bins[SAH_BINS];
+		for (int i = first; i < first + count; ++i)
+		{
+			int item = items_[i];
+			Bin& bin = bins[BinOf::bin(centres[item * 3 + axis], centreBounds.min[axis], scale)];
+			float boxMin[3] = { boxes.minX[item], boxes.minY[item], boxes.minZ[item] };
+			float boxMax[3] = { boxes.maxX[item], boxes.maxY[item], boxes.maxZ[item] };
+			bin.bounds.add(boxMin, boxMax);
+			++bin.count;
+		}
+
+		// Sweep from the right to get the area of every right hand side,
+		// then from the left to cost each split
+		float rightAreas[SAH_BINS];
+		Bounds right;
+		for (int b = SAH_BINS - 1; b > 0; --b)
+		{
+			right.add(bins[b].bounds.min, bins[b].bounds.max);
+			rightAreas[b] = right.area();
+		}
+
+		Bounds left;
+		int leftCount = 0;
+		for (int b = 0; b < SAH_BINS - 1; ++b)
+		{
+			left.add(bins[b].bounds.min, bins[b].bounds.max);
+			leftCount += bins[b].count;
+			int rightCount = count - leftCount;
+			if (leftCount == 0 || rightCount == 0)
+				continue;
+
+			float cost = left.area() * leftCount + rightAreas[b + 1] * rightCount;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	int leftCount = count / 2;
+	if (bestAxis >= 0)
+	{
+		float extent = centreBounds.max[bestAxis] - centreBounds.min[bestAxis];
+		BinOf inLeft(centres, bestAxis, centreBounds.min[bestAxis], SAH_BINS / extent, bestSplit);
+		leftCount = (int)(std::partition(items_.begin() + first, items_.begin() + first + count,
+										 inLeft) - (items_.begin() + first));
+	}
+
+	int child = (int)nodes_.size();
+	nodes_.resize(child + 2);
+	parents_.push_back(node);
+	parents_.push_back(node);
+	nodes_[node].first = child;
+	nodes_[node].count = 0;
+
+	buildNode(child, first, leftCount, depth + 1, boxes, centres);
+	buildNode(child + 1, first + leftCount, count - leftCount, depth + 1, boxes, centres);
+}
+
+/*
+	Name		M3DBVH::setItemBox
+	Syntax		M3DBVH::setItemBox(int slot, const M3DVector3f boxMin,
+						const M3DVector3f boxMax)
+	Brief		Stores the box of the item at a position in leaf order
+*/
+void M3DBVH::setItemBox(int slot, const M3DVector3f boxMin, const M3DVector3f boxMax)
+{
+	int n = (int)items_.size();
+	for (int i = 0; i < 3; ++i)
+	{
+		bounds_[i * n + slot] = boxMin[i];
+		bounds_[(i + 3) * n + slot] = boxMax[i];
+	}
+}
+
+/*
+	Name		M3DBVH::fitNode
+	Syntax		M3DBVH::fitNode(int node)
+	Brief		Shrinks or grows a node to hold its items or its children
+*/
+void M3DBVH::fitNode(int node)
+{
+	M3DCullNode& n = nodes_[node];
+	Bounds bounds;
+	if (n.count > 0)
+	{
+		M3DBoxArray boxes = getLeafBoxes(n);
+		for (int i = 0; i < n.count; ++i)
+		{
+			float boxMin[3] = { boxes.minX[i], boxes.minY[i], boxes.minZ[i] };
+			float boxMax[3] = { boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i] };
+			bounds.add(boxMin, boxMax);
+		}
+	}
+	else
+	{
+		bounds.add(nodes_[n.first].min, nodes_[n.first].max);
+		bounds.add(nodes_[n.first + 1].min, nodes_[n.first + 1].max);
+	}
+	m3dCopyVector3(n.min, bounds.min);
+	m3dCopyVector3(n.max, bounds.max);
+}
+
+/*
+	Name		M3DBVH::refit
+	Syntax		M3DBVH::refit(const M3DBoxArray& boxes)
+	Param		const M3DBoxArray& boxes - The new boxes of every item, in
+				the order the tree was built with
+	Brief		Refits every node, children before their parents
+	Details		Children are always stored after their parent, so walking
+				the node array backwards visits them first
+*/
+void M3DBVH::refit(const M3DBoxArray& boxes)
+{
+	int count = (int)items_.size();
+	for (int slot = 0; slot < count; ++slot)
+	{
+		int item = items_[slot];
+		M3DVector3f boxMin = { boxes.minX[item], boxes.minY[item], boxes.minZ[item] };
+		M3DVector3f boxMax = { boxes.maxX[item], boxes.maxY[item], boxes.maxZ[item] };
+		setItemBox(slot, boxMin, boxMax);
+	}
+
+	for (int node = (int)nodes_.size() - 1; node >= 0; --node)
+		fitNode(node);
+}
+
+/*
+	Name		M3DBVH::refit
+	Syntax		M3DBVH::refit(int item, const M3DVector3f boxMin,
+						const M3DVector3f boxMax)
+	Param		int item - The item that has moved
+	Brief		Refits the nodes from the item's leaf up to the root
+*/
+void M3DBVH::refit(int item, const M3DVector3f boxMin, const M3DVector3f boxMax)
+{
+	if (item < 0 || item >= (int)slots_.size())
+		return;
+
+	int slot = slots_[item];
+	setItemBox(slot, boxMin, boxMax);
+	for (int node = leaves_[slot]; node >= 0; node = parents_[node])
+		fitNode(node);
+}
+
+/*
+	Name		M3DBVH::getLeafBoxes
+	Syntax		M3DBVH::getLeafBoxes(const M3DCullNode& leaf)
+	Return		M3DBoxArray - The boxes of a leaf's items
+*/
+M3DBoxArray M3DBVH::getLeafBoxes(const M3DCullNode& leaf) const
+{
+	int n = (int)items_.size();
+	const float* base = &bounds_[0] + leaf.first;
+	M3DBoxArray boxes = { base, base + n, base + n * 2, base + n * 3, base + n * 4, base + n * 5,
+						  leaf.count };
+	return boxes;
+}
+
+/*
+	Name		M3DBVH::cullFrustum
+	Syntax		M3DBVH::cullFrustum(const M3DFrustum& frustum, int* items)
+	Return		int - Number of items written
+	Brief		Gathers the items of every leaf not wholly outside the frustum
+*/
+int M3DBVH::cullFrustum(const M3DFrustum& frustum, int* items) const
+{
+	if (nodes_.empty())
+		return 0;
+	return m3dCullHierarchy(frustum, &nodes_[0], &items_[0], items);
+}
+
+/*
+	Name		M3DBVH::rayCast
+	Syntax		M3DBVH::rayCast(const M3DVector3f origin, const M3DVector3f dir,
+						float* t)
+	Return		int - The item hit first, -1 if none is
+	Brief		Walks the tree nearest child first, skipping nodes entered
+				further away than the nearest hit so far
+*/
+int M3DBVH::rayCast(const M3DVector3f origin, const M3DVector3f dir, float* t) const
+{
+	*t = -1.0f;
+	if (nodes_.empty())
+		return -1;
+
+	float invD[3] = { inverse(dir[0]), inverse(dir[1]), inverse(dir[2]) };
+	float rootT = rayNode(origin, invD, nodes_[0]);
+	if (rootT < 0.0f)
+		return -1;
+
+	int stack[M3D_CULL_MAX_DEPTH + 1];
+	float entry[M3D_CULL_MAX_DEPTH + 1];
+	int top = 0;
+	stack[top] = 0;
+	entry[top] = rootT;
+	++top;
+
+	int best = -1;
+	float bestT = FLT_MAX;
+	while (top > 0)
+	{
+		--top;
+		if (entry[top] > bestT)
+			continue;
+
+		const M3DCullNode& node = nodes_[stack[top]];
+		if (node.count > 0)
+		{
+			float hitT;
+			int hit = m3dRayNearestBox(origin, dir, getLeafBoxes(node), &hitT);
+			if (hit >= 0 && hitT < bestT)
+			{
+				bestT = hitT;
+				best = items_[node.first + hit];
+			}
+			continue;
+		}
+
+		int nearChild = node.first;
+		int farChild = node.first + 1;
+		float nearT = rayNode(origin, invD, nodes_[nearChild]);
+		float farT = rayNode(origin, invD, nodes_[farChild]);
+		if (farT >= 0.0f && (nearT < 0.0f || farT < nearT))
+		{
+			std::swap(nearChild, farChild);
+			std::swap(nearT, farT);
+		}
+
+		// Push the far child first so that the near one is walked first
+		if (farT >= 0.0f && farT <= bestT)
+		{
+			stack[top] = farChild;
+			entry[top] = farT;
+			++top;
+		}
+		if (nearT >= 0.0f && nearT <= bestT)
+		{
+			stack[top] = nearChild;
+			entry[top] = nearT;
+			++top;
+		}
+	}
+
+	if (best >= 0)
+		*t = bestT;
+	return best;
+}
+
+/*
+	Name		M3DBVH::nearest
+	Syntax		M3DBVH::nearest(const M3DVector3f point, float* distance)
+	Return		int - The item nearest the point, -1 if the tree is empty
+	Brief		Walks the tree nearest child first, skipping nodes further
+				away than the nearest item so far
+*/
+int M3DBVH::nearest(const M3DVector3f point, float* distance) const
+{
+	*distance = -1.0f;
+	if (nodes_.empty())
+		return -1;
+
+	int stack[M3D_CULL_MAX_DEPTH + 1];
+	float nodeDistance[M3D_CULL_MAX_DEPTH + 1];
+	int top = 0;
+	stack[top] = 0;
+	nodeDistance[top] = distanceSquared(point, nodes_[0].min, nodes_[0].max);
+	++top;
+
+	int best = -1;
+	float bestSq = FLT_MAX;
+	while (top > 0)
+	{
+		--top;
+		if (nodeDistance[top] >= bestSq)
+			continue;
+
+		const M3DCullNode& node = nodes_[stack[top]];
+		if (node.count > 0)
+		{
+			M3DBoxArray boxes = getLeafBoxes(node);
+			for (int i = 0; i < node.count; ++i)
+			{
+				float boxMin[3] = { boxes.minX[i], boxes.minY[i], boxes.minZ[i] };
+				float boxMax[3] = { boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i] };
+				float d = distanceSquared(point, boxMin, boxMax);
+				if (d < bestSq)
+				{
+					bestSq = d;
+					best = items_[node.first + i];
+				}
+			}
+			continue;
+		}
+
+		int nearChild = node.first;
+		int farChild = node.first + 1;
+		float nearSq = distanceSquared(point, nodes_[nearChild].min, nodes_[nearChild].max);
+		float farSq = distanceSquared(point, nodes_[farChild].min, nodes_[farChild].max);
+		if (farSq < nearSq)
+		{
+			std::swap(nearChild, farChild);
+			std::swap(nearSq, farSq);
+		}
+
+		if (farSq < bestSq)
+		{
+			stack[top] = farChild;
+			nodeDistance[top] = farSq;
+			++top;
+		}
+		if (nearSq < bestSq)
+		{
+			stack[top] = nearChild;
+			nodeDistance[top] = nearSq;
+			++top;
+		}
+	}
+
+	*distance = sqrtf(bestSq);
+	return best;
+}
@@ -0,0 +1,80 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dBVH
+	Brief		Bounding volume hierarchy over axis aligned boxes, for
+				frustum culling, ray casts and nearest object queries
+	Details		The tree is built top down, splitting each node where the
+				surface area heuristic estimates the cheapest traversal, and
+				is held in one flat array of M3DCullNodes with the two
+				children of a node side by side, so that m3dCullHierarchy
+				can walk it directly. The item boxes are kept as structure of
+				arrays in leaf order, so each leaf's boxes are contiguous and
+				are tested with the m3dRay batch kernels.
+
+				Moving items only refits the bounds; the shape of the tree is
+				kept, so it should be rebuilt once the items have moved far
+				from where it was built
+*/
+
+#ifndef M3DBVH_H
+#define M3DBVH_H
+
+#include <vector>
+
+#include "Maths/m3dCull.h"
+
+/*
+	Name		M3DBVH
+	Syntax		M3DBVH
+	Brief		Bounding volume hierarchy of boxes, each identified by its
+				index in the array it was built from
+*/
+class M3DBVH
+{
+public:
+	M3DBVH();
+
+	void build(const M3DBoxArray& boxes);
+	void clear();
+
+	// Refits after every box has moved, or after one has. Either way the
+	// boxes are given by the index they were built with
+	void refit(const M3DBoxArray& boxes);
+	void refit(int item, const M3DVector3f boxMin, const M3DVector3f boxMax);
+
+	// Writes the items of the leaves that may be in view, and returns their
+	// number. items must have room for every item in the tree
+	int cullFrustum(const M3DFrustum& frustum, int* items) const;
+
+	// Returns the item first hit by a ray with a unit direction, or -1 if
+	// none is, with the distance to it in t, 0 if the origin is inside it
+	int rayCast(const M3DVector3f origin, const M3DVector3f dir, float* t) const;
+
+	// Returns the item whose box is nearest a point, or -1 if the tree is
+	// empty, with the distance to its box in distance
+	int nearest(const M3DVector3f point, float* distance) const;
+
+	int getItemsNo() const { return (int)items_.size(); };
+	int getNodesNo() const { return (int)nodes_.size(); };
+	const M3DCullNode* getNodes() const { return nodes_.empty() ? 0 : &nodes_[0]; };
+
+private:
+	void buildNode(int node, int first, int count, int depth, const M3DBoxArray& boxes,
+				   const std::vector<float>& centres);
+	void setItemBox(int slot, const M3DVector3f boxMin, const M3DVector3f boxMax);
+	void fitNode(int node);
+	M3DBoxArray getLeafBoxes(const M3DCullNode& leaf) const;
+
+	std::vector<M3DCullNode> nodes_;
+	std::vector<int> parents_;		// Parent of each node, -1 for the root
+	std::vector<int> items_;		// Items in leaf order
+	std::vector<int> slots_;		// Position of each item in items_
+	std::vector<int> leaves_;		// Leaf holding each position of items_
+	std::vector<float> bounds_;		// Item boxes in leaf order, as min x, y, z and
+									// max x, y, z arrays one after another
+};
+
+#endif // M3DBVH_H
@@ -0,0 +1,362 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dBatch
+	Brief		Batched versions of the math3d transforms, working on arrays of
+				points and matrices rather than one at a time
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+#include "Maths/m3dBatch.h"
+#include "Maths/m3dSIMD.h"
+
+namespace
+{
+#ifdef M3D_SSE
+	/*
+		Name		load
+		Syntax		load<Aligned>(const float* p)
+		Param		const float* p - Four floats, aligned to 16 bytes if Aligned
+		Return		__m128 - The four floats
+		Brief		Loads with an aligned or unaligned load, so that each
+					kernel can be written once and instanced for both
+	*/
+	template <bool Aligned> __m128 load(const float* p);
+	template <> inline __m128 load<true>(const float* p) { return _mm_load_ps(p); }
+	template <> inline __m128 load<false>(const float* p) { return _mm_loadu_ps(p); }
+
+	template <bool Aligned> void store(float* p, __m128 v);
+	template <> inline void store<true>(float* p, __m128 v) { _mm_store_ps(p, v); }
+	template <> inline void store<false>(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+
+	/*
+		Name		isAligned
+		Syntax		isAligned(const void* p)
+		Return		bool - True if p is aligned to 16 bytes
+	*/
+	inline bool isAligned(const void* p)
+	{
+		return ((size_t)p & 15) == 0;
+	}
+
+	/*
+		Name		transformPointsSse
+		Syntax		transformPointsSse<Aligned>(float* xOut, float* yOut,
+						float* zOut, const float* x, const float* y,
+						const float* z, int count, const M3DMatrix44f m)
+		Return		int - The number of points transformed, a multiple of four
+		Brief		Transforms four points at a time, with every element of the
+					matrix splatted across a register once for the batch
+	*/
+	template <bool Aligned>
+	int transformPointsSse(float* xOut, float* yOut, float* zOut, const float* x,
+						   const float* y, const float* z, int count, const M3DMatrix44f m)
+	{
+		__m128 m0 = _mm_set1_ps(m[0]),  m1 = _mm_set1_ps(m[1]),  m2 = _mm_set1_ps(m[2]);
+		__m128 m4 = _mm_set1_ps(m[4]),  m5 = _mm_set1_ps(m[5]),  m6 = _mm_set1_ps(m[6]);
+		__m128 m8 = _mm_set1_ps(m[8]),  m9 = _mm_set1_ps(m[9]),  m10 = _mm_set1_ps(m[10]);
+		__m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]);
+
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 px = load<Aligned>(x + i);
+			__m128 py = load<Aligned>(y + i);
+			__m128 pz = load<Aligned>(z + i);
+
+			__m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, px), _mm_mul_ps(m4, py)),
+								   _mm_add_ps(_mm_mul_ps(m8, pz), m12));
+			__m128 ry = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, px), _mm_mul_ps(m5, py)),
+								   _mm_add_ps(_mm_mul_ps(m9, pz), m13));
+			__m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, px), _mm_mul_ps(m6, py)),
+								   _mm_add_ps(_mm_mul_ps(m10, pz), m14));
+
+			store<Aligned>(xOut + i, rx);
+			store<Aligned>(yOut + i, ry);
+			store<Aligned>(zOut + i, rz);
+		}
+		return i;
+	}
+
+	/*
+		Name		projectPointsSse
+		Syntax		projectPointsSse<Aligned>(float* xOut, float* yOut,
+						float* zOut, const float* x, const float* y,
+						const float* z, int count, const M3DMatrix44f m,
+						float halfWidth, float halfHeight)
+		Return		int - The number of points projected, a multiple of four
+		Brief		Projects four points at a time by the combined modelview
+					projection matrix
+		Details		As in m3dProjectXYZ, points with a w of almost zero are
+					left undivided
+	*/
+	template <bool Aligned>
+	int projectPointsSse(float* xOut, float* yOut, float* zOut, const float* x,
+						 const float* y, const float* z, int count, const M3DMatrix44f m,
+						 float halfWidth, float halfHeight)
+	{
+		__m128 m0 = _mm_set1_ps(m[0]),  m1 = _mm_set1_ps(m[1]),  m2 = _mm_set1_ps(m[2]),  m3 = _mm_set1_ps(m[3]);
+		__m128 m4 = _mm_set1_ps(m[4]),  m5 = _mm_set1_ps(m[5]),  m6 = _mm_set1_ps(m[6]),  m7 = _mm_set1_ps(m[7]);
+		__m128 m8 = _mm_set1_ps(m[8]),  m9 = _mm_set1_ps(m[9]),  m10 = _mm_set1_ps(m[10]), m11 = _mm_set1_ps(m[11]);
+		__m128 m12 = _mm_set1_ps(m[12]), m13 = _mm_set1_ps(m[13]), m14 = _mm_set1_ps(m[14]), m15 = _mm_set1_ps(m[15]);
+
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 epsilon = _mm_set1_ps(0.000001f);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 scaleX = _mm_set1_ps(halfWidth);
+		const __m128 scaleY = _mm_set1_ps(halfHeight);
+
+		int i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 px = load<Aligned>(x + i);
+			__m128 py = load<Aligned>(y + i);
+			__m128 pz = load<Aligned>(z + i);
+
+			__m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, px), _mm_mul_ps(m4, py)),
+								   _mm_add_ps(_mm_mul_ps(m8, pz), m12));
+			__m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m1, px), _mm_mul_ps(m5, py)),
+								   _mm_add_ps(_mm_mul_ps(m9, pz), m13));
+			__m128 cz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m2, px), _mm_mul_ps(m6, py)),
+								   _mm_add_ps(_mm_mul_ps(m10, pz), m14));
+			__m128 cw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, px), _mm_mul_ps(m7, py)),
+								   _mm_add_ps(_mm_mul_ps(m11, pz), m15));
+
+			// Divide by w only where it is not close to zero
+			__m128 divide = _mm_cmpge_ps(_mm_and_ps(cw, absMask), epsilon);
+			__m128 w = _mm_or_ps(_mm_and_ps(divide, cw), _mm_andnot_ps(divide, one));
+			__m128 invW = _mm_div_ps(one, w);
+
+			store<Aligned>(xOut + i, _mm_mul_ps(_mm_add_ps(one, _mm_mul_ps(cx, invW)), scaleX));
+			store<Aligned>(yOut + i, _mm_mul_ps(_mm_add_ps(one, _mm_mul_ps(cy, invW)), scaleY));
+			store<Aligned>(zOut + i, _mm_mul_ps(cz, invW));
+		}
+		return i;
+	}
+#endif // M3D_SSE
+}
+
+/*
+	Name		m3dAlignedAlloc
+	Syntax		m3dAlignedAlloc(size_t bytes)
+	Param		size_t bytes - Size of the block
+	Return		void* - A block aligned to 16 bytes, 0 if it could not be made
+	Brief		Allocates memory for SSE loads and stores. Free it with
+				m3dAlignedFree
+*/
+void* m3dAlignedAlloc(size_t bytes)
+{
+#ifdef _MSC_VER
+	return _aligned_malloc(bytes, 16);
+#else
+	void* p = 0;
+	return posix_memalign(&p, 16, bytes) == 0 ? p : 0;
+#endif
+}
+
+/*
+	Name		m3dAlignedFree
+	Syntax		m3dAlignedFree(void* p)
+	Param		void* p - A block from m3dAlignedAlloc, or 0
+	Brief		Frees memory allocated by m3dAlignedAlloc
+*/
+void m3dAlignedFree(void* p)
+{
+#ifdef _MSC_VER
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/*
+	Name		M3DPointArray::M3DPointArray
+	Syntax		M3DPointArray()
+	Brief		M3DPointArray constructor makes an empty array
+*/
+M3DPointArray::M3DPointArray()
+: x_(0), y_(0), z_(0), count_(0)
+{
+}
+
+/*
+	Name		M3DPointArray::M3DPointArray
+	Syntax		M3DPointArray(int count)
+	Param		int count - Number of points
+	Brief		M3DPointArray constructor makes an array of count points
+*/
+M3DPointArray::M3DPointArray(int count)
+: x_(0), y_(0), z_(0), count_(0)
+{
+	resize(count);
+}
+
+/*
+	Name		M3DPointArray::~M3DPointArray
+	Syntax		~M3DPointArray()
+	Brief		M3DPointArray destructor frees the arrays
+*/
+M3DPointArray::~M3DPointArray()
+{
+	release();
+}
+
+/*
+	Name		M3DPointArray::resize
+	Syntax		M3DPointArray::resize(int count)
+	Param		int count - Number of points
+	Brief		Reallocates the arrays for count points. The old points are
+				not kept
+	Details		Each array is padded to a multiple of four points, with the
+				padding zeroed, so a kernel may safely run over the end
+*/
+void M3DPointArray::resize(int count)
+{
+	release();
+	if (count <= 0)
+		return;
+
+	size_t padded = ((size_t)count + 3) & ~(size_t)3;
+	size_t bytes = padded * sizeof(float);
+
+	x_ = (float*)m3dAlignedAlloc(bytes);
+	y_ = (float*)m3dAlignedAlloc(bytes);
+	z_ = (float*)m3dAlignedAlloc(bytes);
+	if (!x_ || !y_ || !z_)
+	{
+		release();
+		return;
+	}
+
+	for (size_t i = count; i < padded; ++i)
+	{
+		x_[i] = y_[i] = z_[i] = 0.0f;
+	}
+	count_ = count;
+}
+
+/*
+	Name		M3DPointArray::release
+	Syntax		M3DPointArray::release()
+	Brief		Frees the arrays
+*/
+void M3DPointArray::release()
+{
+	m3dAlignedFree(x_);
+	m3dAlignedFree(y_);
+	m3dAlignedFree(z_);
+	x_ = y_ = z_ = 0;
+	count_ = 0;
+}
+
+/*
+	Name		m3dTransformPoints
+	Syntax		m3dTransformPoints(float* xOut, float* yOut, float* zOut,
+								   const float* x, const float* y,
+								   const float* z, int count,
+								   const M3DMatrix44f m)
+	Brief		Transforms count points by m, as m3dTransformVector3 does
+	Details		Aligned loads are used when every array is aligned to 16
+				bytes. The points left over after the last group of four are
+				transformed one at a time
+*/
+void m3dTransformPoints(float* xOut, float* yOut, float* zOut,
+						const float* x, const float* y, const float* z,
+						int count, const M3DMatrix44f m)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	if (isAligned(xOut) && isAligned(yOut) && isAligned(zOut) &&
+		isAligned(x) && isAligned(y) && isAligned(z))
+	{
+		i = transformPointsSse<true>(xOut, yOut, zOut, x, y, z, count, m);
+	}
+	else
+	{
+		i = transformPointsSse<false>(xOut, yOut, zOut, x, y, z, count, m);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		xOut[i] = m[0] * px + m[4] * py + m[8] * pz + m[12];
+		yOut[i] = m[1] * px + m[5] * py + m[9] * pz + m[13];
+		zOut[i] = m[2] * px + m[6] * py + m[10] * pz + m[14];
+	}
+}
+
+/*
+	Name		m3dMatrixMultiply44Batch
+	Syntax		m3dMatrixMultiply44Batch(M3DMatrix44f* product,
+										 const M3DMatrix44f* a,
+										 const M3DMatrix44f* b, int count)
+	Brief		Multiplies count pairs of matrices
+	Details		A matrix is already four registers of work, so the pairs are
+				left as arrays of matrices and multiplied with the SSE
+				m3dMatrixMultiply44
+*/
+void m3dMatrixMultiply44Batch(M3DMatrix44f* product, const M3DMatrix44f* a,
+							  const M3DMatrix44f* b, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		m3dMatrixMultiply44(product[i], a[i], b[i]);
+	}
+}
+
+/*
+	Name		m3dProjectPoints
+	Syntax		m3dProjectPoints(float* xOut, float* yOut, float* zOut,
+								 const float* x, const float* y,
+								 const float* z, int count,
+								 const M3DMatrix44f mModelView,
+								 const M3DMatrix44f mProjection,
+								 const int iViewPort[4])
+	Brief		Projects count points to window coordinates
+	Details		Like m3dProjectXYZ, x and y are relative to the viewport
+				origin and z is the normalised device depth
+*/
+void m3dProjectPoints(float* xOut, float* yOut, float* zOut,
+					  const float* x, const float* y, const float* z, int count,
+					  const M3DMatrix44f mModelView, const M3DMatrix44f mProjection,
+					  const int iViewPort[4])
+{
+	M3DMatrix44f m;
+	m3dMatrixMultiply44(m, mProjection, mModelView);
+
+	float halfWidth = float(iViewPort[2]) * 0.5f;
+	float halfHeight = float(iViewPort[3]) * 0.5f;
+
+	int i = 0;
+#ifdef M3D_SSE
+	if (isAligned(xOut) && isAligned(yOut) && isAligned(zOut) &&
+		isAligned(x) && isAligned(y) && isAligned(z))
+	{
+		i = projectPointsSse<true>(xOut, yOut, zOut, x, y, z, count, m, halfWidth, halfHeight);
+	}
+	else
+	{
+		i = projectPointsSse<false>(xOut, yOut, zOut, x, y, z, count, m, halfWidth, halfHeight);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		float cx = m[0] * px + m[4] * py + m[8] * pz + m[12];
+		float cy = m[1] * px + m[5] * py + m[9] * pz + m[13];
+		float cz = m[2] * px + m[6] * py + m[10] * pz + m[14];
+		float cw = m[3] * px + m[7] * py + m[11] * pz + m[15];
+
+		float invW = fabs(cw) >= 0.000001f ? 1.0f / cw : 1.0f;
+		xOut[i] = (1.0f + cx * invW) * halfWidth;
+		yOut[i] = (1.0f + cy * invW) * halfHeight;
+		zOut[i] = cz * invW;
+	}
+}
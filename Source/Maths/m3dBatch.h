@@ -0,0 +1,109 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dBatch
+	Brief		Batched versions of the math3d transforms, working on arrays of
+				points and matrices rather than one at a time
+	Details		Points are held as structure of arrays - separate x, y and z
+				arrays - so that four points fill one SSE register with no
+				shuffling. The kernels take plain pointers, so any SoA storage
+				can be passed; M3DPointArray gives storage aligned to 16 bytes,
+				which lets the kernels use aligned loads and stores. Counts
+				that are not a multiple of four are finished one at a time
+*/
+
+#ifndef M3DBATCH_H
+#define M3DBATCH_H
+
+#include <stddef.h>
+
+#include "Maths/math3d.h"
+
+void* m3dAlignedAlloc(size_t bytes);
+void m3dAlignedFree(void* p);
+
+/*
+	Name		M3DPointArray
+	Syntax		M3DPointArray
+	Brief		Owns x, y and z arrays of points, each aligned to 16 bytes
+				and padded to a whole number of SSE registers
+*/
+class M3DPointArray
+{
+public:
+	M3DPointArray();
+	explicit M3DPointArray(int count);
+	~M3DPointArray();
+
+	void resize(int count);
+
+	int getCount() const { return count_; };
+	float* getX() { return x_; };
+	float* getY() { return y_; };
+	float* getZ() { return z_; };
+	const float* getX() const { return x_; };
+	const float* getY() const { return y_; };
+	const float* getZ() const { return z_; };
+
+private:
+	M3DPointArray(const M3DPointArray& rhs);
+	M3DPointArray& operator=(const M3DPointArray& rhs);
+
+	void release();
+
+	float* x_;
+	float* y_;
+	float* z_;
+	int count_;
+};
+
+/*
+	Name		M3DSphereArray
+	Syntax		M3DSphereArray
+	Brief		count spheres, with centres and radii in separate arrays
+*/
+struct M3DSphereArray
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* radius;
+	int count;
+};
+
+/*
+	Name		M3DBoxArray
+	Syntax		M3DBoxArray
+	Brief		count axis aligned boxes, with their corners in separate arrays
+*/
+struct M3DBoxArray
+{
+	const float* minX;
+	const float* minY;
+	const float* minZ;
+	const float* maxX;
+	const float* maxY;
+	const float* maxZ;
+	int count;
+};
+
+// Transforms count points (w = 1) by m. The outputs may be the inputs
+void m3dTransformPoints(float* xOut, float* yOut, float* zOut,
+						const float* x, const float* y, const float* z,
+						int count, const M3DMatrix44f m);
+
+// product[i] = a[i] * b[i] for count pairs. product must not alias a or b
+void m3dMatrixMultiply44Batch(M3DMatrix44f* product, const M3DMatrix44f* a,
+							  const M3DMatrix44f* b, int count);
+
+// Projects count points to window coordinates, mapped the same way as
+// m3dProjectXYZ. The modelview and projection are multiplied once for the
+// whole batch. The outputs may be the inputs
+void m3dProjectPoints(float* xOut, float* yOut, float* zOut,
+					  const float* x, const float* y, const float* z, int count,
+					  const M3DMatrix44f mModelView, const M3DMatrix44f mProjection,
+					  const int iViewPort[4]);
+
+#endif // M3DBATCH_H
@@ -0,0 +1,282 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dCascade
+	Brief		Fitting of cascaded shadow maps to the camera, with the far
+				cascades cached between frames
+*/
+
+#include <math.h>
+
+#include "Maths/m3dCascade.h"
+
+namespace
+{
+	const float DEFAULT_LAMBDA = 0.75f;
+	const float DEFAULT_CASTER_DEPTH = 200.0f;
+	const float DEFAULT_PADDING = 1.5f;
+	const float LIGHT_CHANGE_COS = 0.99999f;	// Light directions closer than this
+												// are taken to be the same
+
+	/*
+		Name		sliceSphere
+		Syntax		sliceSphere(const M3DVector3f eye, const M3DVector3f forward,
+					float tanHalfFovY, float aspect, float splitNear,
+					float splitFar, M3DVector3f centre, float* radius)
+		Brief		Finds the smallest sphere around a slice of the view
+					frustum
+		Details		By symmetry the centre lies on the view axis, where it is
+					as far from the near corners as from the far ones, unless
+					that is beyond the far plane, when the far corners alone
+					decide it
+	*/
+	void sliceSphere(const M3DVector3f eye, const M3DVector3f forward, float tanHalfFovY,
+					 float aspect, float splitNear, float splitFar, M3DVector3f centre,
+					 float* radius)
+	{
+		// Distance from the view axis to a corner, per unit of depth
+		float cornerSlope = tanHalfFovY * sqrtf(1.0f + aspect * aspect);
+		float nearCorner = splitNear * cornerSlope;
+		float farCorner = splitFar * cornerSlope;
+
+		float depth = splitFar;
+		if (splitFar > splitNear)
+		{
+			depth = (splitFar * splitFar - splitNear * splitNear +
+					 farCorner * farCorner - nearCorner * nearCorner) /
+					(2.0f * (splitFar - splitNear));
+			depth = depth > splitNear ? depth : splitNear;
+			depth = depth < splitFar ? depth : splitFar;
+		}
+
+		float toNear = depth - splitNear;
+		float toFar = splitFar - depth;
+		float nearSquared = toNear * toNear + nearCorner * nearCorner;
+		float farSquared = toFar * toFar + farCorner * farCorner;
+		*radius = sqrtf(nearSquared > farSquared ? nearSquared : farSquared);
+
+		centre[0] = eye[0] + forward[0] * depth;
+		centre[1] = eye[1] + forward[1] * depth;
+		centre[2] = eye[2] + forward[2] * depth;
+	}
+
+	/*
+		Name		lightBasis
+		Syntax		lightBasis(const M3DVector3f lightDir, M3DVector3f xAxis,
+					M3DVector3f yAxis)
+		Brief		Finds the axes across the light, as D3DXMatrixLookAtLH
+					would with y up, or z up for a light that is nearly
+					straight up or down
+	*/
+	void lightBasis(const M3DVector3f lightDir, M3DVector3f xAxis, M3DVector3f yAxis)
+	{
+		M3DVector3f up = { 0.0f, 1.0f, 0.0f };
+		if (fabsf(lightDir[1]) > 0.99f)
+		{
+			up[1] = 0.0f;
+			up[2] = 1.0f;
+		}
+
+		m3dCrossProduct3(xAxis, up, lightDir);
+		m3dNormalizeVector3(xAxis);
+		m3dCrossProduct3(yAxis, lightDir, xAxis);
+	}
+}
+
+/*
+	Name		m3dCascadeSplits
+	Syntax		m3dCascadeSplits(float* splits, int count, float zNear,
+				float zFar, float lambda)
+	Param		float* splits - Receives count + 1 view depths
+	Param		int count - Number of cascades
+	Param		float zNear - Nearest depth shadowed
+	Param		float zFar - Furthest depth shadowed
+	Param		float lambda - Blend from even splits, 0, to logarithmic, 1
+	Brief		Splits the view depths among the cascades
+	Details		Logarithmic splits keep the texels a similar size on screen
+				at every depth, but make the near cascades very thin; the
+				even ones give the far cascades too little
+*/
+void m3dCascadeSplits(float* splits, int count, float zNear, float zFar, float lambda)
+{
+	float ratio = zFar / zNear;
+	for (int i = 0; i <= count; ++i)
+	{
+		float f = (float)i / (float)count;
+		float logSplit = zNear * powf(ratio, f);
+		float evenSplit = zNear + (zFar - zNear) * f;
+		splits[i] = evenSplit + (logSplit - evenSplit) * lambda;
+	}
+
+	// Exactly the range asked for, whatever the rounding
+	splits[0] = zNear;
+	splits[count] = zFar;
+}
+
+/*
+	Name		m3dFitCascade
+	Syntax		m3dFitCascade(M3DCascade* cascade, const M3DVector3f eye,
+				const M3DVector3f forward, float tanHalfFovY, float aspect,
+				float splitNear, float splitFar, const M3DVector3f lightDir,
+				int resolution, float casterDepth, float radiusScale)
+	Param		M3DCascade* cascade - Receives the fitted cascade
+	Param		const M3DVector3f eye - Camera position
+	Param		const M3DVector3f forward - Unit direction the camera faces
+	Param		float tanHalfFovY - Tangent of half the vertical field of view
+	Param		float aspect - Width over height of the view
+	Param		float splitNear, splitFar - View depths of the slice
+	Param		const M3DVector3f lightDir - Unit direction the light travels
+	Param		int resolution - Width and height of the shadow map
+	Param		float casterDepth - Extra depth towards the light for casters
+	Param		float radiusScale - Scale of the covered sphere
+	Brief		Fits a cascade to one slice of the view
+	Details		The sphere's centre is moved to the nearest texel corner of
+				the light's grid before the projection is built around it
+*/
+void m3dFitCascade(M3DCascade* cascade, const M3DVector3f eye, const M3DVector3f forward,
+				   float tanHalfFovY, float aspect, float splitNear, float splitFar,
+				   const M3DVector3f lightDir, int resolution, float casterDepth,
+				   float radiusScale)
+{
+	M3DVector3f centre;
+	float radius;
+	sliceSphere(eye, forward, tanHalfFovY, aspect, splitNear, splitFar, centre, &radius);
+	radius *= radiusScale;
+
+	M3DVector3f xAxis, yAxis;
+	lightBasis(lightDir, xAxis, yAxis);
+
+	// Snap the centre across the light to whole texels. Along the light it
+	// only moves the depth range, which does not show
+	float texelSize = 2.0f * radius / (float)resolution;
+	float cx = floorf(m3dDotProduct3(centre, xAxis) / texelSize + 0.5f) * texelSize;
+	float cy = floorf(m3dDotProduct3(centre, yAxis) / texelSize + 0.5f) * texelSize;
+	float cz = m3dDotProduct3(centre, lightDir);
+
+	float zMin = cz - radius - casterDepth;
+	float depthRange = cz + radius - zMin;
+	float invRadius = 1.0f / radius;
+
+	// Rows of the light view and orthographic projection combined, stored
+	// column major
+	M3DMatrix44f& m = cascade->viewProj;
+	m[0] = xAxis[0] * invRadius;
+	m[4] = xAxis[1] * invRadius;
+	m[8] = xAxis[2] * invRadius;
+	m[12] = -cx * invRadius;
+	m[1] = yAxis[0] * invRadius;
+	m[5] = yAxis[1] * invRadius;
+	m[9] = yAxis[2] * invRadius;
+	m[13] = -cy * invRadius;
+	m[2] = lightDir[0] / depthRange;
+	m[6] = lightDir[1] / depthRange;
+	m[10] = lightDir[2] / depthRange;
+	m[14] = -zMin / depthRange;
+	m[3] = 0.0f;
+	m[7] = 0.0f;
+	m[11] = 0.0f;
+	m[15] = 1.0f;
+
+	for (int i = 0; i < 3; ++i)
+		cascade->centre[i] = xAxis[i] * cx + yAxis[i] * cy + lightDir[i] * cz;
+	cascade->radius = radius;
+	cascade->splitNear = splitNear;
+	cascade->splitFar = splitFar;
+	cascade->texelSize = texelSize;
+}
+
+/*
+	Name		m3dInitCascades
+	Syntax		m3dInitCascades(M3DCascadeSet* set, int count,
+				int resolution, int cachedFrom)
+	Param		M3DCascadeSet* set - The set to set up
+	Param		int count - Number of cascades, at most M3D_MAX_CASCADES
+	Param		int resolution - Width and height of each shadow map
+	Param		int cachedFrom - First cascade to cache, count for none
+	Brief		Sets up a set of cascades
+*/
+void m3dInitCascades(M3DCascadeSet* set, int count, int resolution, int cachedFrom)
+{
+	set->count = count < M3D_MAX_CASCADES ? count : M3D_MAX_CASCADES;
+	set->resolution = resolution;
+	set->cachedFrom = cachedFrom < set->count ? cachedFrom : set->count;
+	set->lambda = DEFAULT_LAMBDA;
+	set->casterDepth = DEFAULT_CASTER_DEPTH;
+	set->padding = DEFAULT_PADDING;
+	m3dLoadVector3(set->lightDir, 0.0f, -1.0f, 0.0f);
+	m3dInvalidateCascades(set);
+}
+
+/*
+	Name		m3dUpdateCascades
+	Syntax		m3dUpdateCascades(M3DCascadeSet* set, const M3DVector3f eye,
+				const M3DVector3f forward, float tanHalfFovY, float aspect,
+				float zNear, float zFar, const M3DVector3f lightDir)
+	Param		M3DCascadeSet* set - The cascades to update
+	Param		const M3DVector3f eye - Camera position
+	Param		const M3DVector3f forward - Unit direction the camera faces
+	Param		float tanHalfFovY - Tangent of half the vertical field of view
+	Param		float aspect - Width over height of the view
+	Param		float zNear, zFar - View depths shadows are drawn over
+	Param		const M3DVector3f lightDir - Unit direction the light travels
+	Return		int - Number of cascades whose shadow maps must be drawn
+	Brief		Fits the cascades to the camera for a frame
+	Details		The cascades before cachedFrom are fitted tightly and drawn
+				every frame. Each one after is kept while its slice still
+				lies within its padded sphere and the light has not turned,
+				and otherwise refitted around where the slice is now
+*/
+int m3dUpdateCascades(M3DCascadeSet* set, const M3DVector3f eye, const M3DVector3f forward,
+					  float tanHalfFovY, float aspect, float zNear, float zFar,
+					  const M3DVector3f lightDir)
+{
+	float splits[M3D_MAX_CASCADES + 1];
+	m3dCascadeSplits(splits, set->count, zNear, zFar, set->lambda);
+
+	bool lightChanged = !set->valid ||
+		m3dDotProduct3(lightDir, set->lightDir) < LIGHT_CHANGE_COS;
+	m3dCopyVector3(set->lightDir, lightDir);
+	set->valid = true;
+
+	int dirtyNo = 0;
+	for (int i = 0; i < set->count; ++i)
+	{
+		M3DCascade& cascade = set->cascades[i];
+		bool cached = i >= set->cachedFrom;
+		set->dirty[i] = false;
+
+		if (cached && !lightChanged &&
+			cascade.splitNear == splits[i] && cascade.splitFar == splits[i + 1])
+		{
+			M3DVector3f centre;
+			float radius;
+			sliceSphere(eye, forward, tanHalfFovY, aspect, splits[i], splits[i + 1],
+						centre, &radius);
+			if (m3dGetDistance3(centre, cascade.centre) + radius <= cascade.radius)
+				continue;
+		}
+
+		m3dFitCascade(&cascade, eye, forward, tanHalfFovY, aspect, splits[i],
+					  splits[i + 1], lightDir, set->resolution, set->casterDepth,
+					  cached ? set->padding : 1.0f);
+		set->dirty[i] = true;
+		++dirtyNo;
+	}
+
+	return dirtyNo;
+}
+
+/*
+	Name		m3dInvalidateCascades
+	Syntax		m3dInvalidateCascades(M3DCascadeSet* set)
+	Param		M3DCascadeSet* set - The cascades to redraw
+	Brief		Makes the next update fit and draw every cascade afresh
+*/
+void m3dInvalidateCascades(M3DCascadeSet* set)
+{
+	set->valid = false;
+	for (int i = 0; i < M3D_MAX_CASCADES; ++i)
+		set->dirty[i] = true;
+}
@@ -0,0 +1,99 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dCascade
+	Brief		Fitting of cascaded shadow maps to the camera, with the far
+				cascades cached between frames
+	Details		The view distance covered by shadows is split into slices,
+				spaced between even and logarithmic by lambda, and each
+				slice is bounded by a sphere. A sphere does not change size
+				as the camera turns, so neither does the cascade's texel
+				size, and the cascade is moved over the light's texel grid
+				only in whole texels. Together these stop shadow edges
+				swimming as the camera moves.
+
+				The matrices follow the Direct3D conventions, like those of
+				m3dCull: a depth of 0 nearest the light and 1 furthest, and
+				the same memory layout as the D3DXMATRIX used with row
+				vectors, so they can be handed straight to an effect.
+
+				Cascades from cachedFrom on are only expected to hold static
+				casters. They are fitted to a sphere padded beyond their
+				slice, and kept as they are until the light turns or the
+				slice leaves that sphere, so their shadow maps need not be
+				drawn again every frame
+*/
+
+#ifndef M3DCASCADE_H
+#define M3DCASCADE_H
+
+#include "Maths/math3d.h"
+
+// Most cascades a set can hold
+#define M3D_MAX_CASCADES	4
+
+/*
+	Name		M3DCascade
+	Syntax		M3DCascade
+	Brief		One cascade: the slice of view depth it shades, the sphere
+				its shadow map covers and the matrix into the map
+*/
+struct M3DCascade
+{
+	M3DMatrix44f viewProj;		// World to the cascade's clip space
+	M3DVector3f centre;			// Centre of the covered sphere, snapped to a texel
+	float radius;
+	float splitNear;			// View depths of the slice
+	float splitFar;
+	float texelSize;			// World size of one shadow map texel
+};
+
+/*
+	Name		M3DCascadeSet
+	Syntax		M3DCascadeSet
+	Brief		The cascades of one light, with the settings they are
+				fitted with and which of them need drawing this frame
+*/
+struct M3DCascadeSet
+{
+	int count;
+	int resolution;				// Width and height of each shadow map
+	int cachedFrom;				// First cascade that is cached, count for none
+	float lambda;				// 0 for even splits, 1 for logarithmic
+	float casterDepth;			// Distance towards the light casters may lie
+								// beyond a cascade's sphere
+	float padding;				// Scale of a cached cascade's sphere
+	M3DCascade cascades[M3D_MAX_CASCADES];
+	bool dirty[M3D_MAX_CASCADES];	// Shadow map must be drawn this frame
+	M3DVector3f lightDir;		// Light the cascades were last fitted to
+	bool valid;
+};
+
+// Writes count + 1 view depths into splits, from zNear to zFar
+void m3dCascadeSplits(float* splits, int count, float zNear, float zFar, float lambda);
+
+// Fits one cascade to the view depths splitNear to splitFar of a camera at
+// eye, looking down the unit vector forward. lightDir is the unit direction
+// the light travels in. radiusScale grows the covered sphere
+void m3dFitCascade(M3DCascade* cascade, const M3DVector3f eye, const M3DVector3f forward,
+				   float tanHalfFovY, float aspect, float splitNear, float splitFar,
+				   const M3DVector3f lightDir, int resolution, float casterDepth,
+				   float radiusScale);
+
+// Sets up a set with the usual lambda, caster depth and padding, every
+// cascade to be drawn on the first update
+void m3dInitCascades(M3DCascadeSet* set, int count, int resolution, int cachedFrom);
+
+// Refits the cascades to the camera for this frame and marks the ones whose
+// shadow maps must be drawn. Returns how many are
+int m3dUpdateCascades(M3DCascadeSet* set, const M3DVector3f eye, const M3DVector3f forward,
+					  float tanHalfFovY, float aspect, float zNear, float zFar,
+					  const M3DVector3f lightDir);
+
+// Forces every cascade to be drawn on the next update, such as when static
+// casters have moved
+void m3dInvalidateCascades(M3DCascadeSet* set);
+
+#endif // M3DCASCADE_H
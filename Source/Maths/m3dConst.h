@@ -0,0 +1,53 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dConst
+	Brief		Compile time versions of the math3d functions, for building
+				constant tables of geometry
+	Details		The compiler has no constexpr, so these are macros in the same
+				way as m3dDegToRad - given constant arguments they expand to
+				constant expressions. A const table of plain structs filled
+				with them is built by the compiler and kept in read-only data,
+				with no code run at startup. The trig is worked in double and
+				should be cast to float where it is stored
+*/
+
+#ifndef M3DCONST_H
+#define M3DCONST_H
+
+#include "Maths/math3d.h"
+
+#define M3D_HALF_PI (0.5 * M3D_PI)
+
+// Fails to compile if an integral constant condition is false
+#define M3D_STATIC_ASSERT(condition, name)	typedef char m3dStaticAssert_##name[(condition) ? 1 : -1]
+
+// Number of elements in an array
+#define M3D_COUNT_OF(a)		(sizeof(a) / sizeof((a)[0]))
+
+// sin(x) for |x| <= pi/2 - the Taylor series to x^11, which is within 6e-8
+#define M3D_CONST_SIN_POLY(x)	((x) * (1.0 + (x) * (x) * (-1.0 / 6.0 + (x) * (x) * (1.0 / 120.0 + \
+								(x) * (x) * (-1.0 / 5040.0 + (x) * (x) * (1.0 / 362880.0 + \
+								(x) * (x) * (-1.0 / 39916800.0)))))))
+
+// sin(x) for |x| <= pi, reflected into the range of the series
+#define M3D_CONST_SIN_PI(x)		((x) > M3D_HALF_PI ? M3D_CONST_SIN_POLY(M3D_PI - (x)) : \
+								 (x) < -M3D_HALF_PI ? M3D_CONST_SIN_POLY(-M3D_PI - (x)) : \
+								 M3D_CONST_SIN_POLY(x))
+
+// sin(x) for |x| <= 2pi and cos(x) for -3pi/2 <= x <= 5pi/2. Each use of
+// the argument is expanded many times, so keep it a simple constant
+#define M3D_CONST_SIN(x)		((x) > M3D_PI ? M3D_CONST_SIN_PI((x) - M3D_2PI) : \
+								 (x) < -M3D_PI ? M3D_CONST_SIN_PI((x) + M3D_2PI) : \
+								 M3D_CONST_SIN_PI(x))
+#define M3D_CONST_COS(x)		M3D_CONST_SIN(M3D_HALF_PI - (x))
+
+// Point on the unit sphere at polar angle theta from +y and azimuth phi
+// about it, as used for the sky sphere
+#define M3D_CONST_SPHERE_X(theta, phi)	(M3D_CONST_SIN(theta) * M3D_CONST_COS(phi))
+#define M3D_CONST_SPHERE_Y(theta, phi)	(M3D_CONST_COS(theta))
+#define M3D_CONST_SPHERE_Z(theta, phi)	(-M3D_CONST_SIN(theta) * M3D_CONST_SIN(phi))
+
+#endif // M3DCONST_H
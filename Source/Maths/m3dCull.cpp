@@ -0,0 +1,445 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dCull
+	Brief		View frustum extraction and culling of bounding volumes
+*/
+
+#include <math.h>
+
+#include "Maths/m3dCull.h"
+#include "Maths/m3dSIMD.h"
+
+namespace
+{
+	/*
+		Name		planeDistance
+		Syntax		planeDistance(const M3DVector4f plane, float x, float y, float z)
+		Return		float - Signed distance of the point from the plane
+	*/
+	inline float planeDistance(const M3DVector4f plane, float x, float y, float z)
+	{
+		return plane[0] * x + plane[1] * y + plane[2] * z + plane[3];
+	}
+
+	/*
+		Name		boxRadius
+		Syntax		boxRadius(const M3DVector4f plane, float ex, float ey, float ez)
+		Return		float - Half the extent of an axis aligned box along the
+					normal of the plane
+	*/
+	inline float boxRadius(const M3DVector4f plane, float ex, float ey, float ez)
+	{
+		return fabsf(plane[0]) * ex + fabsf(plane[1]) * ey + fabsf(plane[2]) * ez;
+	}
+
+	bool sphereVisible(const M3DFrustum& frustum, float x, float y, float z, float radius)
+	{
+		for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+		{
+			if (planeDistance(frustum.planes[p], x, y, z) < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	bool boxVisible(const M3DFrustum& frustum, const M3DBoxArray& boxes, int i)
+	{
+		float cx = (boxes.minX[i] + boxes.maxX[i]) * 0.5f;
+		float cy = (boxes.minY[i] + boxes.maxY[i]) * 0.5f;
+		float cz = (boxes.minZ[i] + boxes.maxZ[i]) * 0.5f;
+		float ex = (boxes.maxX[i] - boxes.minX[i]) * 0.5f;
+		float ey = (boxes.maxY[i] - boxes.minY[i]) * 0.5f;
+		float ez = (boxes.maxZ[i] - boxes.minZ[i]) * 0.5f;
+
+		for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+		{
+			const float* plane = frustum.planes[p];
+			if (planeDistance(plane, cx, cy, cz) < -boxRadius(plane, ex, ey, ez))
+				return false;
+		}
+		return true;
+	}
+
+	bool orientedBoxVisible(const M3DFrustum& frustum, const M3DOrientedBoxArray& boxes, int i)
+	{
+		for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+		{
+			const float* plane = frustum.planes[p];
+
+			// The box reaches along the normal by the sum of its extents
+			// projected onto it
+			float radius = 0.0f;
+			for (int a = 0; a < 3; ++a)
+			{
+				float dot = plane[0] * boxes.axis[a][0][i] + plane[1] * boxes.axis[a][1][i] +
+							plane[2] * boxes.axis[a][2][i];
+				radius += boxes.extent[a][i] * fabsf(dot);
+			}
+
+			if (planeDistance(plane, boxes.x[i], boxes.y[i], boxes.z[i]) < -radius)
+				return false;
+		}
+		return true;
+	}
+
+#ifdef M3D_SSE
+	/*
+		Name		SsePlanes
+		Syntax		SsePlanes
+		Brief		The frustum planes with each coefficient splatted across a
+					register, and the absolute values of the normals
+	*/
+	struct SsePlanes
+	{
+		explicit SsePlanes(const M3DFrustum& frustum)
+		{
+			for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+			{
+				for (int c = 0; c < 4; ++c)
+					v[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+				for (int c = 0; c < 3; ++c)
+					abs[p][c] = _mm_set1_ps(fabsf(frustum.planes[p][c]));
+			}
+		}
+
+		__m128 distance(int p, __m128 x, __m128 y, __m128 z) const
+		{
+			__m128 d = _mm_add_ps(_mm_mul_ps(v[p][0], x), _mm_mul_ps(v[p][1], y));
+			return _mm_add_ps(_mm_add_ps(d, _mm_mul_ps(v[p][2], z)), v[p][3]);
+		}
+
+		__m128 v[M3D_FRUSTUM_PLANES_NO][4];
+		__m128 abs[M3D_FRUSTUM_PLANES_NO][3];
+	};
+
+	/*
+		Name		storeVisible
+		Syntax		storeVisible(__m128 outside, unsigned char* visible)
+		Param		__m128 outside - Lanes set for the volumes culled
+		Return		int - The number of the four volumes that may be seen
+	*/
+	inline int storeVisible(__m128 outside, unsigned char* visible)
+	{
+		int mask = _mm_movemask_ps(outside);
+		int count = 0;
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			visible[lane] = (unsigned char)(((mask >> lane) & 1) ^ 1);
+			count += visible[lane];
+		}
+		return count;
+	}
+
+	int cullSpheresSse(const SsePlanes& planes, const M3DSphereArray& spheres, unsigned char* visible)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		int count = 0;
+		for (int i = 0; i + 4 <= spheres.count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(spheres.x + i);
+			__m128 y = _mm_loadu_ps(spheres.y + i);
+			__m128 z = _mm_loadu_ps(spheres.z + i);
+			__m128 negRadius = _mm_sub_ps(zero, _mm_loadu_ps(spheres.radius + i));
+
+			__m128 outside = zero;
+			for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(planes.distance(p, x, y, z), negRadius));
+			count += storeVisible(outside, visible + i);
+		}
+		return count;
+	}
+
+	int cullBoxesSse(const SsePlanes& planes, const M3DBoxArray& boxes, unsigned char* visible)
+	{
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		int count = 0;
+		for (int i = 0; i + 4 <= boxes.count; i += 4)
+		{
+			__m128 minX = _mm_loadu_ps(boxes.minX + i);
+			__m128 minY = _mm_loadu_ps(boxes.minY + i);
+			__m128 minZ = _mm_loadu_ps(boxes.minZ + i);
+			__m128 maxX = _mm_loadu_ps(boxes.maxX + i);
+			__m128 maxY = _mm_loadu_ps(boxes.maxY + i);
+			__m128 maxZ = _mm_loadu_ps(boxes.maxZ + i);
+
+			__m128 cx = _mm_mul_ps(_mm_add_ps(minX, maxX), half);
+			__m128 cy = _mm_mul_ps(_mm_add_ps(minY, maxY), half);
+			__m128 cz = _mm_mul_ps(_mm_add_ps(minZ, maxZ), half);
+			__m128 ex = _mm_mul_ps(_mm_sub_ps(maxX, minX), half);
+			__m128 ey = _mm_mul_ps(_mm_sub_ps(maxY, minY), half);
+			__m128 ez = _mm_mul_ps(_mm_sub_ps(maxZ, minZ), half);
+
+			__m128 outside = zero;
+			for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+			{
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes.abs[p][0], ex),
+													  _mm_mul_ps(planes.abs[p][1], ey)),
+										   _mm_mul_ps(planes.abs[p][2], ez));
+				__m128 d = planes.distance(p, cx, cy, cz);
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_sub_ps(zero, radius)));
+			}
+			count += storeVisible(outside, visible + i);
+		}
+		return count;
+	}
+
+	int cullOrientedBoxesSse(const SsePlanes& planes, const M3DOrientedBoxArray& boxes,
+							 unsigned char* visible)
+	{
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+		const __m128 zero = _mm_setzero_ps();
+		int count = 0;
+		for (int i = 0; i + 4 <= boxes.count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(boxes.x + i);
+			__m128 y = _mm_loadu_ps(boxes.y + i);
+			__m128 z = _mm_loadu_ps(boxes.z + i);
+
+			__m128 extent[3];
+			__m128 axis[3][3];
+			for (int a = 0; a < 3; ++a)
+			{
+				extent[a] = _mm_loadu_ps(boxes.extent[a] + i);
+				for (int c = 0; c < 3; ++c)
+					axis[a][c] = _mm_loadu_ps(boxes.axis[a][c] + i);
+			}
+
+			__m128 outside = zero;
+			for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+			{
+				__m128 radius = zero;
+				for (int a = 0; a < 3; ++a)
+				{
+					__m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes.v[p][0], axis[a][0]),
+													   _mm_mul_ps(planes.v[p][1], axis[a][1])),
+											_mm_mul_ps(planes.v[p][2], axis[a][2]));
+					radius = _mm_add_ps(radius, _mm_mul_ps(extent[a], _mm_andnot_ps(signMask, dot)));
+				}
+				__m128 d = planes.distance(p, x, y, z);
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_sub_ps(zero, radius)));
+			}
+			count += storeVisible(outside, visible + i);
+		}
+		return count;
+	}
+#endif // M3D_SSE
+}
+
+/*
+	Name		m3dExtractFrustum
+	Syntax		m3dExtractFrustum(M3DFrustum* frustum, const M3DMatrix44f viewProj)
+	Param		M3DFrustum* frustum - Receives the planes
+	Param		const M3DMatrix44f viewProj - The view matrix times the
+				projection matrix
+	Brief		Builds the frustum planes from sums and differences of the
+				rows of the matrix
+	Details		A point is inside the clip volume when -w <= x <= w,
+				-w <= y <= w and 0 <= z <= w; each of those inequalities is
+				one plane, such as w + x >= 0 for the left
+*/
+void m3dExtractFrustum(M3DFrustum* frustum, const M3DMatrix44f viewProj)
+{
+	// Row r of the column major matrix is m[r], m[4 + r], m[8 + r], m[12 + r]
+	for (int c = 0; c < 4; ++c)
+	{
+		float x = viewProj[c * 4 + 0];
+		float y = viewProj[c * 4 + 1];
+		float z = viewProj[c * 4 + 2];
+		float w = viewProj[c * 4 + 3];
+
+		frustum->planes[M3D_FRUSTUM_LEFT][c]	= w + x;
+		frustum->planes[M3D_FRUSTUM_RIGHT][c]	= w - x;
+		frustum->planes[M3D_FRUSTUM_BOTTOM][c]	= w + y;
+		frustum->planes[M3D_FRUSTUM_TOP][c]		= w - y;
+		frustum->planes[M3D_FRUSTUM_NEAR][c]	= z;
+		frustum->planes[M3D_FRUSTUM_FAR][c]		= w - z;
+	}
+
+	for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+	{
+		float* plane = frustum->planes[p];
+		float length = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		if (length > 0.0f)
+		{
+			float scale = 1.0f / length;
+			plane[0] *= scale;
+			plane[1] *= scale;
+			plane[2] *= scale;
+			plane[3] *= scale;
+		}
+	}
+}
+
+/*
+	Name		m3dSphereInFrustum
+	Syntax		m3dSphereInFrustum(const M3DFrustum& frustum,
+						const M3DVector3f centre, float radius)
+	Return		bool - False if the sphere is wholly outside the frustum
+*/
+bool m3dSphereInFrustum(const M3DFrustum& frustum, const M3DVector3f centre, float radius)
+{
+	return sphereVisible(frustum, centre[0], centre[1], centre[2], radius);
+}
+
+/*
+	Name		m3dCullBox
+	Syntax		m3dCullBox(const M3DFrustum& frustum, const M3DVector3f boxMin,
+						const M3DVector3f boxMax, unsigned int* planeMask)
+	Param		unsigned int* planeMask - Bit p set to test plane p. Receives
+				the mask with the planes the box is wholly inside cleared
+	Return		M3DCullResult - Whether the box is outside, inside, or
+				crosses the planes tested
+*/
+M3DCullResult m3dCullBox(const M3DFrustum& frustum, const M3DVector3f boxMin,
+						 const M3DVector3f boxMax, unsigned int* planeMask)
+{
+	float cx = (boxMin[0] + boxMax[0]) * 0.5f;
+	float cy = (boxMin[1] + boxMax[1]) * 0.5f;
+	float cz = (boxMin[2] + boxMax[2]) * 0.5f;
+	float ex = (boxMax[0] - boxMin[0]) * 0.5f;
+	float ey = (boxMax[1] - boxMin[1]) * 0.5f;
+	float ez = (boxMax[2] - boxMin[2]) * 0.5f;
+
+	unsigned int mask = *planeMask;
+	for (int p = 0; p < M3D_FRUSTUM_PLANES_NO; ++p)
+	{
+		if (!(mask & (1u << p)))
+			continue;
+
+		const float* plane = frustum.planes[p];
+		float d = planeDistance(plane, cx, cy, cz);
+		float radius = boxRadius(plane, ex, ey, ez);
+		if (d < -radius)
+			return M3D_CULL_OUTSIDE;
+		if (d >= radius)
+			mask &= ~(1u << p);
+	}
+
+	*planeMask = mask;
+	return mask ? M3D_CULL_INTERSECT : M3D_CULL_INSIDE;
+}
+
+/*
+	Name		m3dCullSpheres
+	Syntax		m3dCullSpheres(const M3DFrustum& frustum,
+						const M3DSphereArray& spheres, unsigned char* visible)
+	Return		int - The number of spheres that may be seen
+*/
+int m3dCullSpheres(const M3DFrustum& frustum, const M3DSphereArray& spheres, unsigned char* visible)
+{
+	int count = 0;
+	int i = 0;
+#ifdef M3D_SSE
+	SsePlanes planes(frustum);
+	count = cullSpheresSse(planes, spheres, visible);
+	i = spheres.count & ~3;
+#endif
+	for (; i < spheres.count; ++i)
+	{
+		visible[i] = sphereVisible(frustum, spheres.x[i], spheres.y[i], spheres.z[i],
+								   spheres.radius[i]) ? 1 : 0;
+		count += visible[i];
+	}
+	return count;
+}
+
+/*
+	Name		m3dCullBoxes
+	Syntax		m3dCullBoxes(const M3DFrustum& frustum, const M3DBoxArray& boxes,
+						unsigned char* visible)
+	Return		int - The number of boxes that may be seen
+*/
+int m3dCullBoxes(const M3DFrustum& frustum, const M3DBoxArray& boxes, unsigned char* visible)
+{
+	int count = 0;
+	int i = 0;
+#ifdef M3D_SSE
+	SsePlanes planes(frustum);
+	count = cullBoxesSse(planes, boxes, visible);
+	i = boxes.count & ~3;
+#endif
+	for (; i < boxes.count; ++i)
+	{
+		visible[i] = boxVisible(frustum, boxes, i) ? 1 : 0;
+		count += visible[i];
+	}
+	return count;
+}
+
+/*
+	Name		m3dCullOrientedBoxes
+	Syntax		m3dCullOrientedBoxes(const M3DFrustum& frustum,
+						const M3DOrientedBoxArray& boxes, unsigned char* visible)
+	Return		int - The number of boxes that may be seen
+*/
+int m3dCullOrientedBoxes(const M3DFrustum& frustum, const M3DOrientedBoxArray& boxes,
+						 unsigned char* visible)
+{
+	int count = 0;
+	int i = 0;
+#ifdef M3D_SSE
+	SsePlanes planes(frustum);
+	count = cullOrientedBoxesSse(planes, boxes, visible);
+	i = boxes.count & ~3;
+#endif
+	for (; i < boxes.count; ++i)
+	{
+		visible[i] = orientedBoxVisible(frustum, boxes, i) ? 1 : 0;
+		count += visible[i];
+	}
+	return count;
+}
+
+/*
+	Name		m3dCullHierarchy
+	Syntax		m3dCullHierarchy(const M3DFrustum& frustum,
+						const M3DCullNode* nodes, const int* items,
+						int* visibleItems)
+	Return		int - The number of items written to visibleItems
+	Brief		Walks the hierarchy depth first, carrying each node's plane
+				mask down to its children
+	Details		The stack holds at most one more node than the depth of the
+				hierarchy, which must be no more than M3D_CULL_MAX_DEPTH
+*/
+int m3dCullHierarchy(const M3DFrustum& frustum, const M3DCullNode* nodes,
+					 const int* items, int* visibleItems)
+{
+	int stack[M3D_CULL_MAX_DEPTH + 1];
+	unsigned int masks[M3D_CULL_MAX_DEPTH + 1];
+	int top = 0;
+	int count = 0;
+
+	stack[0] = 0;
+	masks[0] = M3D_CULL_ALL_PLANES;
+	++top;
+
+	while (top > 0)
+	{
+		--top;
+		const M3DCullNode& node = nodes[stack[top]];
+		unsigned int mask = masks[top];
+
+		// Nodes inside every plane already tested have nothing left to test
+		if (mask && m3dCullBox(frustum, node.min, node.max, &mask) == M3D_CULL_OUTSIDE)
+			continue;
+
+		if (node.count > 0)
+		{
+			for (int i = 0; i < node.count; ++i)
+				visibleItems[count++] = items[node.first + i];
+		}
+		else
+		{
+			stack[top] = node.first + 1;
+			masks[top] = mask;
+			stack[top + 1] = node.first;
+			masks[top + 1] = mask;
+			top += 2;
+		}
+	}
+	return count;
+}
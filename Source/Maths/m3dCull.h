@@ -0,0 +1,117 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dCull
+	Brief		View frustum extraction and culling of bounding volumes, one
+				at a time, in SIMD batches, or down a hierarchy of boxes
+	Details		The frustum planes are taken from the rows of the combined
+				view and projection matrix, for the Direct3D depth range of
+				0 to w. A D3DXMATRIX, being row major with row vectors, has
+				the same layout in memory as the column major math3d matrix
+				that transforms column vectors, so either can be passed.
+				Each plane is normalised and faces into the frustum, so that
+				a point is inside when a x + b y + c z + d >= 0 for all six.
+
+				The tests are conservative: a volume is only culled when it
+				is wholly outside one plane, so some volumes near the corners
+				of the frustum are kept although they cannot be seen
+*/
+
+#ifndef M3DCULL_H
+#define M3DCULL_H
+
+#include "Maths/m3dBatch.h"
+
+enum M3DFrustumPlane
+{
+	M3D_FRUSTUM_LEFT,
+	M3D_FRUSTUM_RIGHT,
+	M3D_FRUSTUM_BOTTOM,
+	M3D_FRUSTUM_TOP,
+	M3D_FRUSTUM_NEAR,
+	M3D_FRUSTUM_FAR,
+	M3D_FRUSTUM_PLANES_NO
+};
+
+// Plane mask with every plane still to be tested
+#define M3D_CULL_ALL_PLANES		((1u << M3D_FRUSTUM_PLANES_NO) - 1)
+
+// Deepest hierarchy m3dCullHierarchy can walk
+#define M3D_CULL_MAX_DEPTH		64
+
+enum M3DCullResult
+{
+	M3D_CULL_OUTSIDE,
+	M3D_CULL_INTERSECT,
+	M3D_CULL_INSIDE
+};
+
+/*
+	Name		M3DFrustum
+	Syntax		M3DFrustum
+	Brief		Six inward facing planes, indexed by M3DFrustumPlane
+*/
+struct M3DFrustum
+{
+	M3DVector4f planes[M3D_FRUSTUM_PLANES_NO];
+};
+
+/*
+	Name		M3DOrientedBoxArray
+	Syntax		M3DOrientedBoxArray
+	Brief		count oriented boxes, with their centres, half extents along
+				their own axes and unit axes in separate arrays
+	Details		axis[i][j] holds component j of axis i of every box
+*/
+struct M3DOrientedBoxArray
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* extent[3];
+	const float* axis[3][3];
+	int count;
+};
+
+/*
+	Name		M3DCullNode
+	Syntax		M3DCullNode
+	Brief		A box of a hierarchy held in one flat array
+	Details		A node with a count of zero has two children, at first and
+				first + 1 in the node array. Otherwise it is a leaf holding
+				count items, at first to first + count - 1 in the item array
+*/
+struct M3DCullNode
+{
+	M3DVector3f min;
+	M3DVector3f max;
+	int first;
+	int count;
+};
+
+void m3dExtractFrustum(M3DFrustum* frustum, const M3DMatrix44f viewProj);
+
+// Single volumes. A box also takes a mask of the planes left to test, which
+// has the planes the box is wholly inside cleared, so that the children of
+// a box in a hierarchy need not test them again
+bool m3dSphereInFrustum(const M3DFrustum& frustum, const M3DVector3f centre, float radius);
+M3DCullResult m3dCullBox(const M3DFrustum& frustum, const M3DVector3f boxMin,
+						 const M3DVector3f boxMax, unsigned int* planeMask);
+
+// Batches, four at a time with SSE. visible receives 1 for each volume that
+// may be seen and 0 for each that is culled, and the number that may be seen
+// is returned
+int m3dCullSpheres(const M3DFrustum& frustum, const M3DSphereArray& spheres, unsigned char* visible);
+int m3dCullBoxes(const M3DFrustum& frustum, const M3DBoxArray& boxes, unsigned char* visible);
+int m3dCullOrientedBoxes(const M3DFrustum& frustum, const M3DOrientedBoxArray& boxes, unsigned char* visible);
+
+// Walks a hierarchy from nodes[0], skipping the subtrees outside the frustum
+// and taking the subtrees inside it without further tests. visibleItems
+// receives the items of the leaves that may be seen, and their number is
+// returned
+int m3dCullHierarchy(const M3DFrustum& frustum, const M3DCullNode* nodes,
+					 const int* items, int* visibleItems);
+
+#endif // M3DCULL_H
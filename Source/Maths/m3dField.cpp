@@ -0,0 +1,198 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dField
+	Brief		Trilinear lookups in a regular 3D grid of vectors
+*/
+
+#include "Maths/m3dField.h"
+#include "Maths/m3dSIMD.h"
+
+namespace
+{
+#ifdef M3D_SSE
+	/*
+		Name		blendCorners
+		Syntax		blendCorners(const float* s, int row, int slice, __m128 fx,
+					__m128 fy, __m128 fz)
+		Param		const float* s - The first of the cell's eight samples
+		Param		int row, slice - Floats between samples along y and z
+		Param		__m128 fx, fy, fz - The position in the cell, in every lane
+		Return		__m128 - The blended vector
+		Brief		Blends the eight corners of a cell, each loaded whole
+	*/
+	inline __m128 blendCorners(const float* s, int row, int slice, __m128 fx, __m128 fy,
+							   __m128 fz)
+	{
+		__m128 c000 = _mm_loadu_ps(s);
+		__m128 c100 = _mm_loadu_ps(s + 4);
+		__m128 c010 = _mm_loadu_ps(s + row);
+		__m128 c110 = _mm_loadu_ps(s + row + 4);
+		__m128 c001 = _mm_loadu_ps(s + slice);
+		__m128 c101 = _mm_loadu_ps(s + slice + 4);
+		__m128 c011 = _mm_loadu_ps(s + slice + row);
+		__m128 c111 = _mm_loadu_ps(s + slice + row + 4);
+
+		__m128 c00 = _mm_add_ps(c000, _mm_mul_ps(_mm_sub_ps(c100, c000), fx));
+		__m128 c10 = _mm_add_ps(c010, _mm_mul_ps(_mm_sub_ps(c110, c010), fx));
+		__m128 c01 = _mm_add_ps(c001, _mm_mul_ps(_mm_sub_ps(c101, c001), fx));
+		__m128 c11 = _mm_add_ps(c011, _mm_mul_ps(_mm_sub_ps(c111, c011), fx));
+		__m128 c0 = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), fy));
+		__m128 c1 = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), fy));
+		return _mm_add_ps(c0, _mm_mul_ps(_mm_sub_ps(c1, c0), fz));
+	}
+#endif
+}
+
+/*
+	Name		m3dInitVectorField
+	Syntax		m3dInitVectorField(M3DVectorField* field, const float* samples,
+				int width, int height, int depth, const M3DVector3f origin,
+				float spacing)
+	Param		M3DVectorField* field - The field to set up
+	Param		const float* samples - width * height * depth samples of 4
+				floats, kept by pointer
+	Param		int width, height, depth - Samples along x, y and z, at least 2
+				each
+	Param		const M3DVector3f origin - World position of the first sample
+	Param		float spacing - World distance between samples
+	Brief		Sets up an axis aligned vector field
+*/
+void m3dInitVectorField(M3DVectorField* field, const float* samples, int width, int height,
+						int depth, const M3DVector3f origin, float spacing)
+{
+	field->samples = samples;
+	field->width = width;
+	field->height = height;
+	field->depth = depth;
+	m3dCopyVector3(field->origin, origin);
+	field->invSpacing = 1.0f / spacing;
+}
+
+/*
+	Name		m3dSampleVector
+	Syntax		m3dSampleVector(const M3DVectorField* field,
+				const M3DVector3f pos, M3DVector3f v)
+	Param		const M3DVectorField* field - The field to sample
+	Param		const M3DVector3f pos - A world space position
+	Param		M3DVector3f v - Receives the vector of the field there
+	Brief		Blends the eight samples around a position
+*/
+void m3dSampleVector(const M3DVectorField* field, const M3DVector3f pos, M3DVector3f v)
+{
+	const int size[3] = { field->width, field->height, field->depth };
+	int cell[3];
+	float f[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float most = (float)(size[axis] - 1);
+		float g = (pos[axis] - field->origin[axis]) * field->invSpacing;
+		g = g > 0.0f ? (g < most ? g : most) : 0.0f;
+
+		// The last sample along an axis blends in from the one before it
+		cell[axis] = (int)g;
+		cell[axis] = cell[axis] < size[axis] - 2 ? cell[axis] : size[axis] - 2;
+		f[axis] = g - (float)cell[axis];
+	}
+
+	const int row = 4 * field->width;
+	const int slice = row * field->height;
+	const float* s = field->samples + ((cell[2] * field->height + cell[1]) * field->width +
+									   cell[0]) * 4;
+	for (int i = 0; i < 3; ++i)
+	{
+		float c00 = s[i] + (s[4 + i] - s[i]) * f[0];
+		float c10 = s[row + i] + (s[row + 4 + i] - s[row + i]) * f[0];
+		float c01 = s[slice + i] + (s[slice + 4 + i] - s[slice + i]) * f[0];
+		float c11 = s[slice + row + i] + (s[slice + row + 4 + i] - s[slice + row + i]) * f[0];
+		float c0 = c00 + (c10 - c00) * f[1];
+		float c1 = c01 + (c11 - c01) * f[1];
+		v[i] = c0 + (c1 - c0) * f[2];
+	}
+}
+
+/*
+	Name		m3dSampleVectors
+	Syntax		m3dSampleVectors(const M3DVectorField* field, const float* x,
+				const float* y, const float* z, float* vx, float* vy,
+				float* vz, int count)
+	Param		const M3DVectorField* field - The field to sample
+	Param		const float* x, y, z - count world space positions
+	Param		float* vx, vy, vz - Receive the count vectors
+	Param		int count - Number of positions
+	Brief		Samples the field at many positions at once
+	Details		The vectors may be written over the positions
+*/
+void m3dSampleVectors(const M3DVectorField* field, const float* x, const float* y,
+					  const float* z, float* vx, float* vy, float* vz, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	const int row = 4 * field->width;
+	const int slice = row * field->height;
+	const __m128 ox = _mm_set1_ps(field->origin[0]);
+	const __m128 oy = _mm_set1_ps(field->origin[1]);
+	const __m128 oz = _mm_set1_ps(field->origin[2]);
+	const __m128 scale = _mm_set1_ps(field->invSpacing);
+	const __m128 maxX = _mm_set1_ps((float)(field->width - 1));
+	const __m128 maxY = _mm_set1_ps((float)(field->height - 1));
+	const __m128 maxZ = _mm_set1_ps((float)(field->depth - 1));
+	const __m128 lastX = _mm_set1_ps((float)(field->width - 2));
+	const __m128 lastY = _mm_set1_ps((float)(field->height - 2));
+	const __m128 lastZ = _mm_set1_ps((float)(field->depth - 2));
+	const __m128 width = _mm_set1_ps((float)field->width);
+	const __m128 height = _mm_set1_ps((float)field->height);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 gx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + i), ox), scale);
+		__m128 gy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(y + i), oy), scale);
+		__m128 gz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z + i), oz), scale);
+		gx = _mm_min_ps(_mm_max_ps(gx, zero), maxX);
+		gy = _mm_min_ps(_mm_max_ps(gy, zero), maxY);
+		gz = _mm_min_ps(_mm_max_ps(gz, zero), maxZ);
+
+		// Truncation is the floor once clamped to be positive, and the
+		// sample indices are exact in floats for any grid that fits memory
+		__m128 cx = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gx)), lastX);
+		__m128 cy = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gy)), lastY);
+		__m128 cz = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gz)), lastZ);
+		__m128 fx = _mm_sub_ps(gx, cx);
+		__m128 fy = _mm_sub_ps(gy, cy);
+		__m128 fz = _mm_sub_ps(gz, cz);
+		__m128 sample = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(cz, height), cy), width), cx);
+		__m128i index = _mm_slli_epi32(_mm_cvttps_epi32(sample), 2);
+
+		const float* a = field->samples + _mm_cvtsi128_si32(index);
+		const float* b = field->samples + _mm_cvtsi128_si32(_mm_shuffle_epi32(index, 1));
+		const float* c = field->samples + _mm_cvtsi128_si32(_mm_shuffle_epi32(index, 2));
+		const float* d = field->samples + _mm_cvtsi128_si32(_mm_shuffle_epi32(index, 3));
+		__m128 va = blendCorners(a, row, slice, M3D_SPLAT(fx, 0), M3D_SPLAT(fy, 0),
+								 M3D_SPLAT(fz, 0));
+		__m128 vb = blendCorners(b, row, slice, M3D_SPLAT(fx, 1), M3D_SPLAT(fy, 1),
+								 M3D_SPLAT(fz, 1));
+		__m128 vc = blendCorners(c, row, slice, M3D_SPLAT(fx, 2), M3D_SPLAT(fy, 2),
+								 M3D_SPLAT(fz, 2));
+		__m128 vd = blendCorners(d, row, slice, M3D_SPLAT(fx, 3), M3D_SPLAT(fy, 3),
+								 M3D_SPLAT(fz, 3));
+
+		// The x, y and z of the four, and the unused w
+		_MM_TRANSPOSE4_PS(va, vb, vc, vd);
+		_mm_storeu_ps(vx + i, va);
+		_mm_storeu_ps(vy + i, vb);
+		_mm_storeu_ps(vz + i, vc);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		M3DVector3f pos = { x[i], y[i], z[i] };
+		M3DVector3f v;
+		m3dSampleVector(field, pos, v);
+		vx[i] = v[0];
+		vy[i] = v[1];
+		vz[i] = v[2];
+	}
+}
@@ -0,0 +1,56 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dField
+	Brief		Trilinear lookups in a regular 3D grid of vectors, one at a
+				time or in batches
+	Details		The field does not own its samples. Each sample is four
+				floats, x, y, z and an unused w, which is the layout of a
+				four component float texture, so the same samples can be
+				uploaded for the shaders to filter as they are.
+
+				Positions off the grid take the vector of the nearest face,
+				edge or corner.
+
+				The batch lookup maps, clamps and splits four positions at a
+				time with SSE. Each position's eight corners are then loaded
+				whole and blended as vectors, and the four results turned
+				into separate x, y and z arrays
+*/
+
+#ifndef M3DFIELD_H
+#define M3DFIELD_H
+
+#include "Maths/math3d.h"
+
+/*
+	Name		M3DVectorField
+	Syntax		M3DVectorField
+	Brief		A grid of vector samples, axis aligned and evenly spaced
+*/
+struct M3DVectorField
+{
+	const float* samples;		// 4 floats each, a row of width for each y and
+								// a slice of height rows for each z
+	int width;
+	int height;
+	int depth;
+	M3DVector3f origin;			// World position of the first sample
+	float invSpacing;
+};
+
+// Sets up a field whose first sample lies at origin, with spacing world
+// units between samples along every axis. Each axis has at least 2 samples
+void m3dInitVectorField(M3DVectorField* field, const float* samples, int width, int height,
+						int depth, const M3DVector3f origin, float spacing);
+
+// Vector of the field at pos
+void m3dSampleVector(const M3DVectorField* field, const M3DVector3f pos, M3DVector3f v);
+
+// Vectors of the field at count positions
+void m3dSampleVectors(const M3DVectorField* field, const float* x, const float* y,
+					  const float* z, float* vx, float* vy, float* vz, int count);
+
+#endif // M3DFIELD_H
@@ -0,0 +1,147 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dHeight
+	Brief		Bilinear height lookups on a regular grid of samples
+*/
+
+#include "Maths/m3dHeight.h"
+#include "Maths/m3dSIMD.h"
+
+/*
+	Name		m3dInitHeightField
+	Syntax		m3dInitHeightField(M3DHeightField* field, const float* heights,
+				int width, int depth, float originX, float originZ,
+				float spacing, float heightScale, float heightOffset)
+	Param		M3DHeightField* field - The field to set up
+	Param		const float* heights - width * depth samples, kept by pointer
+	Param		int width, depth - Samples along x and z, at least 2 each
+	Param		float originX, originZ - World position of the first sample
+	Param		float spacing - World distance between samples
+	Param		float heightScale, heightOffset - Take samples to world heights
+	Brief		Sets up an axis aligned height field
+*/
+void m3dInitHeightField(M3DHeightField* field, const float* heights, int width, int depth,
+						float originX, float originZ, float spacing,
+						float heightScale, float heightOffset)
+{
+	float invSpacing = 1.0f / spacing;
+
+	field->heights = heights;
+	field->width = width;
+	field->depth = depth;
+	field->toGrid[0] = invSpacing;
+	field->toGrid[1] = 0.0f;
+	field->toGrid[2] = -originX * invSpacing;
+	field->toGrid[3] = 0.0f;
+	field->toGrid[4] = invSpacing;
+	field->toGrid[5] = -originZ * invSpacing;
+	field->heightScale = heightScale;
+	field->heightOffset = heightOffset;
+}
+
+/*
+	Name		m3dSampleHeight
+	Syntax		m3dSampleHeight(const M3DHeightField* field, float x, float z)
+	Param		const M3DHeightField* field - The field to sample
+	Param		float x, z - A world space position
+	Return		float - The world height of the field there
+	Brief		Blends the four samples around a position
+*/
+float m3dSampleHeight(const M3DHeightField* field, float x, float z)
+{
+	const float* m = field->toGrid;
+	float maxX = (float)(field->width - 1);
+	float maxZ = (float)(field->depth - 1);
+
+	float gx = m[0] * x + m[1] * z + m[2];
+	float gz = m[3] * x + m[4] * z + m[5];
+	gx = gx > 0.0f ? (gx < maxX ? gx : maxX) : 0.0f;
+	gz = gz > 0.0f ? (gz < maxZ ? gz : maxZ) : 0.0f;
+
+	// The last row and column blend in from the one before them
+	int col = (int)gx;
+	int row = (int)gz;
+	col = col < field->width - 2 ? col : field->width - 2;
+	row = row < field->depth - 2 ? row : field->depth - 2;
+	float fx = gx - (float)col;
+	float fz = gz - (float)row;
+
+	const float* h = field->heights + row * field->width + col;
+	float h0 = h[0] + (h[1] - h[0]) * fx;
+	float h1 = h[field->width] + (h[field->width + 1] - h[field->width]) * fx;
+	return (h0 + (h1 - h0) * fz) * field->heightScale + field->heightOffset;
+}
+
+/*
+	Name		m3dSampleHeights
+	Syntax		m3dSampleHeights(const M3DHeightField* field, const float* x,
+				const float* z, float* heights, int count)
+	Param		const M3DHeightField* field - The field to sample
+	Param		const float* x, z - count world space positions
+	Param		float* heights - Receives the count world heights
+	Param		int count - Number of positions
+	Brief		Samples the field at many positions at once
+	Details		heights may be the same array as x or z
+*/
+void m3dSampleHeights(const M3DHeightField* field, const float* x, const float* z,
+					  float* heights, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	const float* m = field->toGrid;
+	const int width = field->width;
+	const __m128 m0 = _mm_set1_ps(m[0]);
+	const __m128 m1 = _mm_set1_ps(m[1]);
+	const __m128 m2 = _mm_set1_ps(m[2]);
+	const __m128 m3 = _mm_set1_ps(m[3]);
+	const __m128 m4 = _mm_set1_ps(m[4]);
+	const __m128 m5 = _mm_set1_ps(m[5]);
+	const __m128 maxX = _mm_set1_ps((float)(field->width - 1));
+	const __m128 maxZ = _mm_set1_ps((float)(field->depth - 1));
+	const __m128 lastCol = _mm_set1_ps((float)(field->width - 2));
+	const __m128 lastRow = _mm_set1_ps((float)(field->depth - 2));
+	const __m128 scale = _mm_set1_ps(field->heightScale);
+	const __m128 offset = _mm_set1_ps(field->heightOffset);
+	const __m128 rowStride = _mm_set1_ps((float)width);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vz = _mm_loadu_ps(z + i);
+		__m128 gx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, vx), _mm_mul_ps(m1, vz)), m2);
+		__m128 gz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m3, vx), _mm_mul_ps(m4, vz)), m5);
+		gx = _mm_min_ps(_mm_max_ps(gx, zero), maxX);
+		gz = _mm_min_ps(_mm_max_ps(gz, zero), maxZ);
+
+		// Truncation is the floor once clamped to be positive. The sample
+		// indices are exact in floats up to 4096 samples a side
+		__m128 colf = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gx)), lastCol);
+		__m128 rowf = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(gz)), lastRow);
+		__m128 fx = _mm_sub_ps(gx, colf);
+		__m128 fz = _mm_sub_ps(gz, rowf);
+		__m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(rowf, rowStride), colf));
+
+		// The corners are gathered in registers, as writing them to memory
+		// and loading them back as one vector stalls the load
+		const float* a = field->heights + _mm_cvtsi128_si32(index);
+		const float* b = field->heights + _mm_cvtsi128_si32(_mm_shuffle_epi32(index, 1));
+		const float* c = field->heights + _mm_cvtsi128_si32(_mm_shuffle_epi32(index, 2));
+		const float* d = field->heights + _mm_cvtsi128_si32(_mm_shuffle_epi32(index, 3));
+		__m128 h00 = _mm_set_ps(d[0], c[0], b[0], a[0]);
+		__m128 h10 = _mm_set_ps(d[1], c[1], b[1], a[1]);
+		__m128 h01 = _mm_set_ps(d[width], c[width], b[width], a[width]);
+		__m128 h11 = _mm_set_ps(d[width + 1], c[width + 1], b[width + 1], a[width + 1]);
+
+		__m128 h0 = _mm_add_ps(h00, _mm_mul_ps(_mm_sub_ps(h10, h00), fx));
+		__m128 h1 = _mm_add_ps(h01, _mm_mul_ps(_mm_sub_ps(h11, h01), fx));
+		__m128 h = _mm_add_ps(h0, _mm_mul_ps(_mm_sub_ps(h1, h0), fz));
+		_mm_storeu_ps(heights + i, _mm_add_ps(_mm_mul_ps(h, scale), offset));
+	}
+#endif
+	for (; i < count; ++i)
+		heights[i] = m3dSampleHeight(field, x[i], z[i]);
+}
@@ -0,0 +1,56 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dHeight
+	Brief		Bilinear height lookups on a regular grid of samples, one at a
+				time or in batches
+	Details		The field does not own its samples. World x and z are taken
+				into the grid by an affine map, so a field may be scaled,
+				moved and turned about the y axis, and the sampled heights
+				are scaled and offset into world space afterwards.
+
+				Positions off the grid take the height of the nearest edge,
+				which suits particles drifting past the end of the terrain.
+
+				The batch lookup maps, clamps and blends four positions at a
+				time with SSE; only the fetch of the four corner samples is
+				done one lane at a time
+*/
+
+#ifndef M3DHEIGHT_H
+#define M3DHEIGHT_H
+
+#include "Maths/math3d.h"
+
+/*
+	Name		M3DHeightField
+	Syntax		M3DHeightField
+	Brief		A grid of height samples and the map from world space into it
+*/
+struct M3DHeightField
+{
+	const float* heights;		// width * depth samples, a row of width for each z
+	int width;
+	int depth;
+	float toGrid[6];			// Grid x is toGrid[0] * x + toGrid[1] * z + toGrid[2],
+								// grid z is toGrid[3] * x + toGrid[4] * z + toGrid[5]
+	float heightScale;			// World height is a sample * heightScale + heightOffset
+	float heightOffset;
+};
+
+// Sets up a field whose first sample lies at originX, originZ, with spacing
+// world units between samples along both axes
+void m3dInitHeightField(M3DHeightField* field, const float* heights, int width, int depth,
+						float originX, float originZ, float spacing,
+						float heightScale, float heightOffset);
+
+// World height of the field at x, z
+float m3dSampleHeight(const M3DHeightField* field, float x, float z);
+
+// World heights of the field at count positions
+void m3dSampleHeights(const M3DHeightField* field, const float* x, const float* z,
+					  float* heights, int count);
+
+#endif // M3DHEIGHT_H
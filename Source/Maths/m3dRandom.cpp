@@ -0,0 +1,734 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dRandom
+	Brief		Counter based random numbers, by the Philox4x32-10 generator
+*/
+
+#include <math.h>
+
+#include "Maths/m3dRandom.h"
+#include "Maths/m3dSIMD.h"
+#include "Maths/m3dApprox.h"
+
+namespace
+{
+	// Philox4x32 multipliers and key increments, and its rounds
+	const unsigned int PHILOX_M0 = 0xD2511F53u;
+	const unsigned int PHILOX_M1 = 0xCD9E8D57u;
+	const unsigned int PHILOX_W0 = 0x9E3779B9u;
+	const unsigned int PHILOX_W1 = 0xBB67AE85u;
+	const int PHILOX_ROUNDS = 10;
+
+	const float TO_FLOAT = 1.0f / 16777216.0f;		// 2^-24, for the top 24 bits
+	const float TWO_PI = 6.28318530717958648f;
+
+	/*
+		Name		mulHiLo
+		Syntax		mulHiLo(unsigned int a, unsigned int b, unsigned int* hi,
+					unsigned int* lo)
+		Brief		Multiplies two numbers into the high and low halves of
+					their 64 bit product
+	*/
+	inline void mulHiLo(unsigned int a, unsigned int b, unsigned int* hi, unsigned int* lo)
+	{
+		unsigned __int64 product = (unsigned __int64)a * b;
+		*hi = (unsigned int)(product >> 32);
+		*lo = (unsigned int)product;
+	}
+
+	/*
+		Name		nextBlock
+		Syntax		nextBlock(M3DRandom* random)
+		Brief		Moves the stream's counter on a block
+	*/
+	inline void nextBlock(M3DRandom* random)
+	{
+		if (++random->counter[0] == 0)
+			++random->counter[1];
+	}
+
+	/*
+		Name		toFloat
+		Syntax		toFloat(unsigned int u)
+		Return		float - The top 24 bits of u as a float in [0, 1)
+	*/
+	inline float toFloat(unsigned int u)
+	{
+		return (float)(u >> 8) * TO_FLOAT;
+	}
+
+	/*
+		Name		normalPair
+		Syntax		normalPair(unsigned int u0, unsigned int u1, float* n0,
+					float* n1)
+		Brief		Makes two normals from two numbers by the Box-Muller
+					transform. 1 - u0 is in (0, 1], so its log is finite
+	*/
+	inline void normalPair(unsigned int u0, unsigned int u1, float* n0, float* n1)
+	{
+		float r = sqrtf(-2.0f * m3dFastLog(1.0f - toFloat(u0)));
+		float s, c;
+		m3dFastSinCos(TWO_PI * toFloat(u1), &s, &c);
+		*n0 = r * c;
+		*n1 = r * s;
+	}
+
+	/*
+		Name		unitVector
+		Syntax		unitVector(unsigned int u0, unsigned int u1, float* x,
+					float* y, float* z)
+		Brief		Makes a unit vector from two numbers. By Archimedes' hat
+					box theorem, a height uniform from -1 to 1 with an angle
+					uniform about the axis is uniform over the sphere
+	*/
+	inline void unitVector(unsigned int u0, unsigned int u1, float* x, float* y, float* z)
+	{
+		float h = 2.0f * toFloat(u0) - 1.0f;
+		float r = sqrtf(1.0f - h * h);
+		float s, c;
+		m3dFastSinCos(TWO_PI * toFloat(u1), &s, &c);
+		*x = r * c;
+		*y = r * s;
+		*z = h;
+	}
+
+	/*
+		Name		Basis
+		Syntax		Basis
+		Brief		Two unit vectors at right angles to an axis and each other,
+					turning directions about the z axis onto it
+	*/
+	struct Basis
+	{
+		float t[3], b[3], n[3];
+	};
+
+	/*
+		Name		makeBasis
+		Syntax		makeBasis(const M3DVector3f axis, Basis* basis)
+		Param		const M3DVector3f axis - A unit axis
+		Param		Basis* basis - Receives the axis's basis
+		Brief		Builds the basis of Duff et al., which takes its sign from
+					the axis's z so that it never divides by zero
+	*/
+	inline void makeBasis(const M3DVector3f axis, Basis* basis)
+	{
+		float sign = axis[2] >= 0.0f ? 1.0f : -1.0f;
+		float a = -1.0f / (sign + axis[2]);
+		float b = axis[0] * axis[1] * a;
+		basis->t[0] = 1.0f + sign * axis[0] * axis[0] * a;
+		basis->t[1] = sign * b;
+		basis->t[2] = -sign * axis[0];
+		basis->b[0] = b;
+		basis->b[1] = sign + axis[1] * axis[1] * a;
+		basis->b[2] = -axis[1];
+		basis->n[0] = axis[0];
+		basis->n[1] = axis[1];
+		basis->n[2] = axis[2];
+	}
+
+	/*
+		Name		direction
+		Syntax		direction(unsigned int u0, unsigned int u1, float spread,
+					const Basis& basis, float* x, float* y, float* z)
+		Param		unsigned int u0, u1 - Two numbers
+		Param		float spread - One minus the cosine of the cone's angle, or
+					less than 0 for directions weighted by their cosine
+		Param		const Basis& basis - The axis's basis
+		Param		float* x, y, z - Receive the direction
+		Brief		Makes a direction about the z axis from two numbers and
+					turns it onto the axis
+		Details		For a cone the height is 1 - s, with s uniform in
+					[0, spread), and the distance from the axis is worked out
+					as sqrt(s (2 - s)), which keeps its precision in narrow
+					cones where 1 - h^2 would cancel. Weighted directions take
+					a distance uniform over the area of the disc, sqrt(u), and
+					lift it onto the hemisphere
+	*/
+	inline void direction(unsigned int u0, unsigned int u1, float spread, const Basis& basis,
+						  float* x, float* y, float* z)
+	{
+		float u = toFloat(u0);
+		float h, r;
+		if (spread >= 0.0f)
+		{
+			float s = u * spread;
+			h = 1.0f - s;
+			r = sqrtf(s * (2.0f - s));
+		}
+		else
+		{
+			h = sqrtf(1.0f - u);
+			r = sqrtf(u);
+		}
+		float s, c;
+		m3dFastSinCos(TWO_PI * toFloat(u1), &s, &c);
+		float lx = r * c, ly = r * s;
+		*x = basis.t[0] * lx + basis.b[0] * ly + basis.n[0] * h;
+		*y = basis.t[1] * lx + basis.b[1] * ly + basis.n[1] * h;
+		*z = basis.t[2] * lx + basis.b[2] * ly + basis.n[2] * h;
+	}
+
+	/*
+		Name		nextBlockOf
+		Syntax		nextBlockOf(M3DRandom* random, unsigned int block[4])
+		Brief		Makes the stream's next block and moves past it
+	*/
+	inline void nextBlockOf(M3DRandom* random, unsigned int block[4])
+	{
+		m3dRandomBlock(random->counter, random->key, block);
+		nextBlock(random);
+	}
+
+#ifdef M3D_SSE
+	/*
+		Name		mulHiLo
+		Syntax		mulHiLo(__m128i a, unsigned int b, __m128i* hi, __m128i* lo)
+		Brief		Multiplies four numbers by b into the high and low halves
+					of their 64 bit products. SSE2 multiplies the even lanes
+					only, so the odd ones are shifted down and multiplied apart
+	*/
+	inline void mulHiLo(__m128i a, unsigned int b, __m128i* hi, __m128i* lo)
+	{
+		const __m128i m = _mm_set1_epi32((int)b);
+		__m128i even = _mm_mul_epu32(a, m);
+		__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), m);
+		*lo = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, M3D_SHUFFLE(0, 2, 0, 0)),
+								 _mm_shuffle_epi32(odd, M3D_SHUFFLE(0, 2, 0, 0)));
+		*hi = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, M3D_SHUFFLE(1, 3, 0, 0)),
+								 _mm_shuffle_epi32(odd, M3D_SHUFFLE(1, 3, 0, 0)));
+	}
+
+	/*
+		Name		nextBlocks
+		Syntax		nextBlocks(M3DRandom* random, __m128i c[4])
+		Param		__m128i c[4] - Receives the stream's next four blocks,
+					word n of block i in lane i of c[n]
+		Brief		Makes four blocks at once and moves the stream past them
+	*/
+	inline void nextBlocks(M3DRandom* random, __m128i c[4])
+	{
+		unsigned int n = random->counter[0];
+		unsigned int high = random->counter[1];
+		c[0] = _mm_set_epi32((int)(n + 3), (int)(n + 2), (int)(n + 1), (int)n);
+		c[1] = _mm_set_epi32((int)(high + (n + 3 < n)), (int)(high + (n + 2 < n)),
+							 (int)(high + (n + 1 < n)), (int)high);
+		c[2] = _mm_set1_epi32((int)random->counter[2]);
+		c[3] = _mm_set1_epi32((int)random->counter[3]);
+
+		random->counter[0] = n + 4;
+		if (random->counter[0] < n)
+			++random->counter[1];
+
+		unsigned int k0 = random->key[0], k1 = random->key[1];
+		for (int round = 0; round < PHILOX_ROUNDS; ++round)
+		{
+			__m128i hi0, lo0, hi1, lo1;
+			mulHiLo(c[0], PHILOX_M0, &hi0, &lo0);
+			mulHiLo(c[2], PHILOX_M1, &hi1, &lo1);
+			c[0] = _mm_xor_si128(_mm_xor_si128(hi1, c[1]), _mm_set1_epi32((int)k0));
+			c[1] = lo1;
+			c[2] = _mm_xor_si128(_mm_xor_si128(hi0, c[3]), _mm_set1_epi32((int)k1));
+			c[3] = lo0;
+			k0 += PHILOX_W0;
+			k1 += PHILOX_W1;
+		}
+	}
+
+	inline __m128 toFloat(__m128i u)
+	{
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(u, 8)), _mm_set1_ps(TO_FLOAT));
+	}
+
+	inline void normalPair(__m128i u0, __m128i u1, __m128* n0, __m128* n1)
+	{
+		__m128 l = m3dFastLog(_mm_sub_ps(_mm_set1_ps(1.0f), toFloat(u0)));
+		__m128 r = _mm_sqrt_ps(_mm_mul_ps(_mm_set1_ps(-2.0f), l));
+		__m128 s, c;
+		m3dFastSinCos(_mm_mul_ps(_mm_set1_ps(TWO_PI), toFloat(u1)), &s, &c);
+		*n0 = _mm_mul_ps(r, c);
+		*n1 = _mm_mul_ps(r, s);
+	}
+
+	inline void unitVector(__m128i u0, __m128i u1, __m128* x, __m128* y, __m128* z)
+	{
+		__m128 h = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), toFloat(u0)), _mm_set1_ps(1.0f));
+		__m128 r = _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(h, h)));
+		__m128 s, c;
+		m3dFastSinCos(_mm_mul_ps(_mm_set1_ps(TWO_PI), toFloat(u1)), &s, &c);
+		*x = _mm_mul_ps(r, c);
+		*y = _mm_mul_ps(r, s);
+		*z = h;
+	}
+
+	inline void direction(__m128i u0, __m128i u1, float spread, const Basis& basis,
+						  __m128* x, __m128* y, __m128* z)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		__m128 u = toFloat(u0);
+		__m128 h, r;
+		if (spread >= 0.0f)
+		{
+			__m128 s = _mm_mul_ps(u, _mm_set1_ps(spread));
+			h = _mm_sub_ps(one, s);
+			r = _mm_sqrt_ps(_mm_mul_ps(s, _mm_sub_ps(_mm_set1_ps(2.0f), s)));
+		}
+		else
+		{
+			h = _mm_sqrt_ps(_mm_sub_ps(one, u));
+			r = _mm_sqrt_ps(u);
+		}
+		__m128 s, c;
+		m3dFastSinCos(_mm_mul_ps(_mm_set1_ps(TWO_PI), toFloat(u1)), &s, &c);
+		__m128 lx = _mm_mul_ps(r, c), ly = _mm_mul_ps(r, s);
+		*x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(basis.t[0]), lx),
+								   _mm_mul_ps(_mm_set1_ps(basis.b[0]), ly)),
+						_mm_mul_ps(_mm_set1_ps(basis.n[0]), h));
+		*y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(basis.t[1]), lx),
+								   _mm_mul_ps(_mm_set1_ps(basis.b[1]), ly)),
+						_mm_mul_ps(_mm_set1_ps(basis.n[1]), h));
+		*z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(basis.t[2]), lx),
+								   _mm_mul_ps(_mm_set1_ps(basis.b[2]), ly)),
+						_mm_mul_ps(_mm_set1_ps(basis.n[2]), h));
+	}
+
+	/*
+		Name		storePairs
+		Syntax		storePairs(__m128 v0, __m128 v1, float* out)
+		Brief		Stores eight vectors' components made two from each of
+					four blocks, block i giving vectors 2i and 2i + 1
+	*/
+	inline void storePairs(__m128 v0, __m128 v1, float* out)
+	{
+		_mm_storeu_ps(out, _mm_unpacklo_ps(v0, v1));
+		_mm_storeu_ps(out + 4, _mm_unpackhi_ps(v0, v1));
+	}
+
+	/*
+		Name		storeBlocks
+		Syntax		storeBlocks(__m128 w0, __m128 w1, __m128 w2, __m128 w3,
+					float* out)
+		Brief		Stores four blocks' words in block order
+	*/
+	inline void storeBlocks(__m128 w0, __m128 w1, __m128 w2, __m128 w3, float* out)
+	{
+		_MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+		_mm_storeu_ps(out, w0);
+		_mm_storeu_ps(out + 4, w1);
+		_mm_storeu_ps(out + 8, w2);
+		_mm_storeu_ps(out + 12, w3);
+	}
+#endif
+
+	/*
+		Name		directions
+		Syntax		directions(M3DRandom* random, const M3DVector3f axis,
+					float spread, float* x, float* y, float* z, int count)
+		Brief		Makes a batch of directions about an axis, as direction
+					makes them, one from each two numbers
+	*/
+	void directions(M3DRandom* random, const M3DVector3f axis, float spread,
+					float* x, float* y, float* z, int count)
+	{
+		Basis basis;
+		makeBasis(axis, &basis);
+
+		int i = 0;
+#ifdef M3D_SSE
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i c[4];
+			nextBlocks(random, c);
+			__m128 x0, y0, z0, x1, y1, z1;
+			direction(c[0], c[1], spread, basis, &x0, &y0, &z0);
+			direction(c[2], c[3], spread, basis, &x1, &y1, &z1);
+			storePairs(x0, x1, x + i);
+			storePairs(y0, y1, y + i);
+			storePairs(z0, z1, z + i);
+		}
+#endif
+		for (; i < count; i += 2)
+		{
+			unsigned int block[4];
+			nextBlockOf(random, block);
+			direction(block[0], block[1], spread, basis, &x[i], &y[i], &z[i]);
+			if (i + 1 < count)
+				direction(block[2], block[3], spread, basis, &x[i + 1], &y[i + 1], &z[i + 1]);
+		}
+		random->used = 4;
+	}}
+
+/*
+	Name		m3dSeedRandom
+	Syntax		m3dSeedRandom(M3DRandom* random, unsigned int seed,
+				unsigned int stream)
+	Param		M3DRandom* random - The stream to start
+	Param		unsigned int seed - Seed of the numbers
+	Param		unsigned int stream - Which of the seed's streams to draw,
+				such as one for each thread
+	Brief		Starts a stream at its first block
+*/
+void m3dSeedRandom(M3DRandom* random, unsigned int seed, unsigned int stream)
+{
+	random->key[0] = seed;
+	random->key[1] = 0;
+	random->counter[0] = 0;
+	random->counter[1] = 0;
+	random->counter[2] = stream;
+	random->counter[3] = 0;
+	random->used = 4;
+}
+
+/*
+	Name		m3dRandomBlock
+	Syntax		m3dRandomBlock(const unsigned int counter[4],
+				const unsigned int key[2], unsigned int out[4])
+	Param		const unsigned int counter[4] - The block's counter
+	Param		const unsigned int key[2] - The key
+	Param		unsigned int out[4] - Receives the block
+	Brief		Scrambles the counter by ten Philox rounds, each multiplying
+				two words into four and mixing in the key, which is bumped
+				between rounds
+*/
+void m3dRandomBlock(const unsigned int counter[4], const unsigned int key[2],
+					unsigned int out[4])
+{
+	unsigned int c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+	unsigned int k0 = key[0], k1 = key[1];
+	for (int round = 0; round < PHILOX_ROUNDS; ++round)
+	{
+		unsigned int hi0, lo0, hi1, lo1;
+		mulHiLo(c0, PHILOX_M0, &hi0, &lo0);
+		mulHiLo(c2, PHILOX_M1, &hi1, &lo1);
+		c0 = hi1 ^ c1 ^ k0;
+		c1 = lo1;
+		c2 = hi0 ^ c3 ^ k1;
+		c3 = lo0;
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+/*
+	Name		m3dRandomUInt
+	Syntax		m3dRandomUInt(M3DRandom* random)
+	Param		M3DRandom* random - The stream to draw from
+	Return		unsigned int - The stream's next number
+	Brief		Takes the next number of the stream's block, making the next
+				block once it is used up
+*/
+unsigned int m3dRandomUInt(M3DRandom* random)
+{
+	if (random->used == 4)
+	{
+		nextBlockOf(random, random->block);
+		random->used = 0;
+	}
+	return random->block[random->used++];
+}
+
+/*
+	Name		m3dRandomFloat
+	Syntax		m3dRandomFloat(M3DRandom* random)
+	Param		M3DRandom* random - The stream to draw from
+	Return		float - A float in [0, 1)
+*/
+float m3dRandomFloat(M3DRandom* random)
+{
+	return toFloat(m3dRandomUInt(random));
+}
+
+/*
+	Name		m3dRandomFloat
+	Syntax		m3dRandomFloat(M3DRandom* random, float a, float b)
+	Param		M3DRandom* random - The stream to draw from
+	Param		float a, b - The range
+	Return		float - A float in [a, b)
+*/
+float m3dRandomFloat(M3DRandom* random, float a, float b)
+{
+	return a + toFloat(m3dRandomUInt(random)) * (b - a);
+}
+
+/*
+	Name		m3dRandomNormal
+	Syntax		m3dRandomNormal(M3DRandom* random)
+	Param		M3DRandom* random - The stream to draw from
+	Return		float - A normal of mean 0 and standard deviation 1
+	Brief		Makes a pair of normals from two numbers and returns the
+				first. m3dRandomNormals keeps both
+*/
+float m3dRandomNormal(M3DRandom* random)
+{
+	unsigned int u0 = m3dRandomUInt(random);
+	unsigned int u1 = m3dRandomUInt(random);
+	float n0, n1;
+	normalPair(u0, u1, &n0, &n1);
+	return n0;
+}
+
+/*
+	Name		m3dRandomUnitVector3
+	Syntax		m3dRandomUnitVector3(M3DRandom* random, M3DVector3f v)
+	Param		M3DRandom* random - The stream to draw from
+	Param		M3DVector3f v - Receives a vector uniform over the unit sphere
+*/
+void m3dRandomUnitVector3(M3DRandom* random, M3DVector3f v)
+{
+	unsigned int u0 = m3dRandomUInt(random);
+	unsigned int u1 = m3dRandomUInt(random);
+	unitVector(u0, u1, &v[0], &v[1], &v[2]);
+}
+
+/*
+	Name		m3dRandomCone3
+	Syntax		m3dRandomCone3(M3DRandom* random, const M3DVector3f axis,
+				float cosAngle, M3DVector3f v)
+	Param		M3DRandom* random - The stream to draw from
+	Param		const M3DVector3f axis - The cone's unit axis
+	Param		float cosAngle - The cosine of the angle from the axis to
+				the cone's edge, in [-1, 1]
+	Param		M3DVector3f v - Receives a unit vector uniform over the
+				directions within the cone
+*/
+void m3dRandomCone3(M3DRandom* random, const M3DVector3f axis, float cosAngle, M3DVector3f v)
+{
+	Basis basis;
+	makeBasis(axis, &basis);
+	unsigned int u0 = m3dRandomUInt(random);
+	unsigned int u1 = m3dRandomUInt(random);
+	direction(u0, u1, 1.0f - cosAngle, basis, &v[0], &v[1], &v[2]);
+}
+
+/*
+	Name		m3dRandomHemisphere3
+	Syntax		m3dRandomHemisphere3(M3DRandom* random,
+				const M3DVector3f normal, M3DVector3f v)
+	Param		M3DRandom* random - The stream to draw from
+	Param		const M3DVector3f normal - The hemisphere's unit normal
+	Param		M3DVector3f v - Receives a unit vector uniform over the
+				hemisphere
+*/
+void m3dRandomHemisphere3(M3DRandom* random, const M3DVector3f normal, M3DVector3f v)
+{
+	m3dRandomCone3(random, normal, 0.0f, v);
+}
+
+/*
+	Name		m3dRandomCosineHemisphere3
+	Syntax		m3dRandomCosineHemisphere3(M3DRandom* random,
+				const M3DVector3f normal, M3DVector3f v)
+	Param		M3DRandom* random - The stream to draw from
+	Param		const M3DVector3f normal - The hemisphere's unit normal
+	Param		M3DVector3f v - Receives a unit vector over the hemisphere,
+				as likely as its cosine to the normal
+*/
+void m3dRandomCosineHemisphere3(M3DRandom* random, const M3DVector3f normal, M3DVector3f v)
+{
+	Basis basis;
+	makeBasis(normal, &basis);
+	unsigned int u0 = m3dRandomUInt(random);
+	unsigned int u1 = m3dRandomUInt(random);
+	direction(u0, u1, -1.0f, basis, &v[0], &v[1], &v[2]);
+}
+
+/*
+	Name		m3dRandomUInts
+	Syntax		m3dRandomUInts(M3DRandom* random, unsigned int* out,
+				int count)
+	Param		M3DRandom* random - The stream to draw from
+	Param		unsigned int* out - Receives count numbers
+	Param		int count - Numbers to make
+	Brief		Makes a batch of numbers from the stream's next whole blocks
+*/
+void m3dRandomUInts(M3DRandom* random, unsigned int* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i c[4];
+		nextBlocks(random, c);
+		storeBlocks(_mm_castsi128_ps(c[0]), _mm_castsi128_ps(c[1]), _mm_castsi128_ps(c[2]),
+					_mm_castsi128_ps(c[3]), (float*)(out + i));
+	}
+#endif
+	for (; i < count; i += 4)
+	{
+		unsigned int block[4];
+		nextBlockOf(random, block);
+		for (int j = 0; j < 4 && i + j < count; ++j)
+			out[i + j] = block[j];
+	}
+	random->used = 4;
+}
+
+/*
+	Name		m3dRandomFloats
+	Syntax		m3dRandomFloats(M3DRandom* random, float* out, int count,
+				float a, float b)
+	Param		M3DRandom* random - The stream to draw from
+	Param		float* out - Receives count floats
+	Param		int count - Floats to make
+	Param		float a, b - Their range, [a, b)
+	Brief		Makes a batch of uniform floats, one from each number
+*/
+void m3dRandomFloats(M3DRandom* random, float* out, int count, float a, float b)
+{
+	const float range = b - a;
+	int i = 0;
+#ifdef M3D_SSE
+	const __m128 va = _mm_set1_ps(a);
+	const __m128 vrange = _mm_set1_ps(range);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i c[4];
+		nextBlocks(random, c);
+		storeBlocks(_mm_add_ps(va, _mm_mul_ps(toFloat(c[0]), vrange)),
+					_mm_add_ps(va, _mm_mul_ps(toFloat(c[1]), vrange)),
+					_mm_add_ps(va, _mm_mul_ps(toFloat(c[2]), vrange)),
+					_mm_add_ps(va, _mm_mul_ps(toFloat(c[3]), vrange)), out + i);
+	}
+#endif
+	for (; i < count; i += 4)
+	{
+		unsigned int block[4];
+		nextBlockOf(random, block);
+		for (int j = 0; j < 4 && i + j < count; ++j)
+			out[i + j] = a + toFloat(block[j]) * range;
+	}
+	random->used = 4;
+}
+
+/*
+	Name		m3dRandomNormals
+	Syntax		m3dRandomNormals(M3DRandom* random, float* out, int count)
+	Param		M3DRandom* random - The stream to draw from
+	Param		float* out - Receives count normals
+	Param		int count - Normals to make
+	Brief		Makes a batch of normals, a pair from each two numbers
+*/
+void m3dRandomNormals(M3DRandom* random, float* out, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i c[4];
+		nextBlocks(random, c);
+		__m128 n0, n1, n2, n3;
+		normalPair(c[0], c[1], &n0, &n1);
+		normalPair(c[2], c[3], &n2, &n3);
+		storeBlocks(n0, n1, n2, n3, out + i);
+	}
+#endif
+	for (; i < count; i += 4)
+	{
+		unsigned int block[4];
+		nextBlockOf(random, block);
+		float n[4];
+		normalPair(block[0], block[1], &n[0], &n[1]);
+		normalPair(block[2], block[3], &n[2], &n[3]);
+		for (int j = 0; j < 4 && i + j < count; ++j)
+			out[i + j] = n[j];
+	}
+	random->used = 4;
+}
+
+/*
+	Name		m3dRandomUnitVectors3
+	Syntax		m3dRandomUnitVectors3(M3DRandom* random, float* x, float* y,
+				float* z, int count)
+	Param		M3DRandom* random - The stream to draw from
+	Param		float* x, y, z - Receive count vectors uniform over the unit
+				sphere
+	Param		int count - Vectors to make
+	Brief		Makes a batch of unit vectors, one from each two numbers
+*/
+void m3dRandomUnitVectors3(M3DRandom* random, float* x, float* y, float* z, int count)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i c[4];
+		nextBlocks(random, c);
+		__m128 x0, y0, z0, x1, y1, z1;
+		unitVector(c[0], c[1], &x0, &y0, &z0);
+		unitVector(c[2], c[3], &x1, &y1, &z1);
+		storePairs(x0, x1, x + i);
+		storePairs(y0, y1, y + i);
+		storePairs(z0, z1, z + i);
+	}
+#endif
+	for (; i < count; i += 2)
+	{
+		unsigned int block[4];
+		nextBlockOf(random, block);
+		unitVector(block[0], block[1], &x[i], &y[i], &z[i]);
+		if (i + 1 < count)
+			unitVector(block[2], block[3], &x[i + 1], &y[i + 1], &z[i + 1]);
+	}
+	random->used = 4;
+}
+
+/*
+	Name		m3dRandomCones3
+	Syntax		m3dRandomCones3(M3DRandom* random, const M3DVector3f axis,
+				float cosAngle, float* x, float* y, float* z, int count)
+	Param		M3DRandom* random - The stream to draw from
+	Param		const M3DVector3f axis - The cone's unit axis
+	Param		float cosAngle - The cosine of the angle from the axis to
+				the cone's edge, in [-1, 1]
+	Param		float* x, y, z - Receive count vectors uniform over the
+				directions within the cone
+	Param		int count - Vectors to make
+	Brief		Makes a batch of directions in a cone, the axis's basis
+				built once for them all
+*/
+void m3dRandomCones3(M3DRandom* random, const M3DVector3f axis, float cosAngle,
+					 float* x, float* y, float* z, int count)
+{
+	directions(random, axis, 1.0f - cosAngle, x, y, z, count);
+}
+
+/*
+	Name		m3dRandomHemispheres3
+	Syntax		m3dRandomHemispheres3(M3DRandom* random,
+				const M3DVector3f normal, float* x, float* y, float* z,
+				int count)
+	Param		M3DRandom* random - The stream to draw from
+	Param		const M3DVector3f normal - The hemisphere's unit normal
+	Param		float* x, y, z - Receive count vectors uniform over the
+				hemisphere
+	Param		int count - Vectors to make
+*/
+void m3dRandomHemispheres3(M3DRandom* random, const M3DVector3f normal,
+						   float* x, float* y, float* z, int count)
+{
+	directions(random, normal, 1.0f, x, y, z, count);
+}
+
+/*
+	Name		m3dRandomCosineHemispheres3
+	Syntax		m3dRandomCosineHemispheres3(M3DRandom* random,
+				const M3DVector3f normal, float* x, float* y, float* z,
+				int count)
+	Param		M3DRandom* random - The stream to draw from
+	Param		const M3DVector3f normal - The hemisphere's unit normal
+	Param		float* x, y, z - Receive count vectors over the hemisphere,
+				each as likely as its cosine to the normal
+	Param		int count - Vectors to make
+*/
+void m3dRandomCosineHemispheres3(M3DRandom* random, const M3DVector3f normal,
+								 float* x, float* y, float* z, int count)
+{
+	directions(random, normal, -1.0f, x, y, z, count);
+}
@@ -0,0 +1,102 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dRandom
+	Brief		Counter based random numbers: uniform, normal and on the unit
+				sphere, one at a time or in batches
+	Details		The numbers are the Philox4x32-10 generator of Salmon et al.,
+				"Parallel random numbers: as easy as 1, 2, 3" (2011), which
+				scrambles a 128 bit counter with a 64 bit key into four 32 bit
+				numbers, a block. The key comes from the seed, and the counter
+				holds the block's number and the stream's, so any block of
+				any stream can be made without making those before it, and
+				threads given streams of their own draw different numbers
+				from the same seed without sharing any state.
+
+				A stream is the same from a seed wherever it is drawn. The
+				scalar and SSE versions do the same operations in the same
+				order, and the normals and unit vectors are made with the
+				m3dApprox functions that give the same results in both, so a
+				batch is the same bit for bit with or without SIMD.
+
+				A batch starts at the stream's next whole block and uses
+				every number of its blocks, so a batch and single draws
+				interleaved skip what was left of the block the single draws
+				were in. The SSE versions make four blocks at a time
+
+				Uniform floats are made from the top 24 bits of a number, so
+				they are evenly spaced multiples of 2^-24 in [0, 1). Normals
+				come in pairs from two numbers by the Box-Muller transform,
+				and unit vectors from two numbers as a height uniform in
+				[-1, 1] and an angle about the axis, which is uniform over
+				the sphere
+*/
+
+#ifndef M3DRANDOM_H
+#define M3DRANDOM_H
+
+#include "Maths/math3d.h"
+
+/*
+	Name		M3DRandom
+	Syntax		M3DRandom
+	Brief		A stream of random numbers
+*/
+struct M3DRandom
+{
+	unsigned int key[2];		// From the seed
+	unsigned int counter[4];	// The next block's number in 0 and 1, the
+								// stream's in 2 and 3
+	unsigned int block[4];		// The block single draws are taken from
+	int used;					// Numbers of it taken
+};
+
+// Starts stream number stream of the numbers from seed
+void m3dSeedRandom(M3DRandom* random, unsigned int seed, unsigned int stream);
+
+// The block of four numbers for a counter and key
+void m3dRandomBlock(const unsigned int counter[4], const unsigned int key[2],
+					unsigned int out[4]);
+
+// A number in [0, 2^32)
+unsigned int m3dRandomUInt(M3DRandom* random);
+
+// A float in [0, 1), or in [a, b)
+float m3dRandomFloat(M3DRandom* random);
+float m3dRandomFloat(M3DRandom* random, float a, float b);
+
+// A float from the normal distribution of mean 0 and standard deviation 1
+float m3dRandomNormal(M3DRandom* random);
+
+// A vector uniform over the unit sphere
+void m3dRandomUnitVector3(M3DRandom* random, M3DVector3f v);
+
+// Batches of count numbers, floats in [a, b), normals, and unit vectors as
+// separate x, y and z arrays
+void m3dRandomUInts(M3DRandom* random, unsigned int* out, int count);
+void m3dRandomFloats(M3DRandom* random, float* out, int count, float a, float b);
+void m3dRandomNormals(M3DRandom* random, float* out, int count);
+void m3dRandomUnitVectors3(M3DRandom* random, float* x, float* y, float* z, int count);
+
+// A vector uniform over the directions within an angle of a unit axis,
+// given as the angle's cosine, so 0 gives the hemisphere and -1 the sphere
+void m3dRandomCone3(M3DRandom* random, const M3DVector3f axis, float cosAngle, M3DVector3f v);
+
+// A vector uniform over the hemisphere about a unit normal
+void m3dRandomHemisphere3(M3DRandom* random, const M3DVector3f normal, M3DVector3f v);
+
+// A vector over the hemisphere about a unit normal, weighted by its cosine
+// to the normal
+void m3dRandomCosineHemisphere3(M3DRandom* random, const M3DVector3f normal, M3DVector3f v);
+
+// Batches of count of the same, as separate x, y and z arrays
+void m3dRandomCones3(M3DRandom* random, const M3DVector3f axis, float cosAngle,
+					 float* x, float* y, float* z, int count);
+void m3dRandomHemispheres3(M3DRandom* random, const M3DVector3f normal,
+						   float* x, float* y, float* z, int count);
+void m3dRandomCosineHemispheres3(M3DRandom* random, const M3DVector3f normal,
+								 float* x, float* y, float* z, int count);
+
+#endif // M3DRANDOM_H
@@ -0,0 +1,431 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dRay
+	Brief		Ray intersection tests over many rays or many primitives at
+				once, for picking and occlusion queries
+*/
+
+#include <float.h>
+#include <math.h>
+
+#include "Maths/m3dRay.h"
+#include "Maths/m3dSIMD.h"
+
+namespace
+{
+	/*
+		Name		raySphere
+		Syntax		raySphere(float ox, float oy, float oz, float dx,
+							  float dy, float dz, float cx, float cy,
+							  float cz, float radius)
+		Return		float - Distance to the first hit at or ahead of the
+					origin, -1 for a miss
+		Brief		Tests one ray against one sphere
+	*/
+	inline float raySphere(float ox, float oy, float oz, float dx, float dy, float dz,
+						   float cx, float cy, float cz, float radius)
+	{
+		float lx = cx - ox, ly = cy - oy, lz = cz - oz;
+		float a = lx * dx + ly * dy + lz * dz;
+		float disc = radius * radius - (lx * lx + ly * ly + lz * lz) + a * a;
+		if (disc < 0.0f)
+			return -1.0f;
+
+		// Missed if the far side of the sphere is behind the origin
+		float s = sqrtf(disc);
+		if (a + s < 0.0f)
+			return -1.0f;
+		return a - s > 0.0f ? a - s : 0.0f;
+	}
+
+	/*
+		Name		rayBox
+		Syntax		rayBox(const float o[3], const float invD[3],
+						   const float boxMin[3], const float boxMax[3])
+		Return		float - Distance to the first hit at or ahead of the
+					origin, -1 for a miss
+		Brief		Tests one ray against one box with the slab method
+	*/
+	inline float rayBox(const float o[3], const float invD[3], const float boxMin[3],
+						const float boxMax[3])
+	{
+		float tNear = 0.0f, tFar = FLT_MAX;
+		for (int i = 0; i < 3; ++i)
+		{
+			float t0 = (boxMin[i] - o[i]) * invD[i];
+			float t1 = (boxMax[i] - o[i]) * invD[i];
+			if (t0 > t1)
+			{
+				float swap = t0;
+				t0 = t1;
+				t1 = swap;
+			}
+			tNear = t0 > tNear ? t0 : tNear;
+			tFar = t1 < tFar ? t1 : tFar;
+		}
+		return tNear <= tFar ? tNear : -1.0f;
+	}
+
+	/*
+		Name		inverse
+		Syntax		inverse(float d)
+		Return		float - 1 / d, or a huge number for 0
+		Brief		Reciprocal of a ray direction for the slab test
+		Details		Keeping it finite means a ray lying in the plane of a slab
+					gives a distance of 0 there rather than a NaN
+	*/
+	inline float inverse(float d)
+	{
+		if (d == 0.0f)
+			return 1.0f / FLT_MIN;
+		return 1.0f / d;
+	}
+
+#ifdef M3D_SSE
+	/*
+		Name		raySphereSse
+		Brief		raySphere for four lanes, each a ray, a sphere or both
+	*/
+	inline __m128 raySphereSse(__m128 ox, __m128 oy, __m128 oz, __m128 dx, __m128 dy, __m128 dz,
+							   __m128 cx, __m128 cy, __m128 cz, __m128 radius)
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 miss = _mm_set1_ps(-1.0f);
+
+		__m128 lx = _mm_sub_ps(cx, ox), ly = _mm_sub_ps(cy, oy), lz = _mm_sub_ps(cz, oz);
+		__m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, dx), _mm_mul_ps(ly, dy)), _mm_mul_ps(lz, dz));
+		__m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+		__m128 disc = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(radius, radius), l2), _mm_mul_ps(a, a));
+
+		__m128 s = _mm_sqrt_ps(_mm_max_ps(disc, zero));
+		__m128 tNear = _mm_sub_ps(a, s);
+		__m128 tFar = _mm_add_ps(a, s);
+
+		// Hit where the sphere is crossed and its far side is ahead
+		__m128 hit = _mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmpge_ps(tFar, zero));
+		__m128 t = _mm_max_ps(tNear, zero);
+		return _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, miss));
+	}
+
+	/*
+		Name		rayBoxSse
+		Brief		rayBox for four lanes, each a ray, a box or both
+	*/
+	inline __m128 rayBoxSse(__m128 ox, __m128 oy, __m128 oz, __m128 invX, __m128 invY, __m128 invZ,
+							__m128 minX, __m128 minY, __m128 minZ,
+							__m128 maxX, __m128 maxY, __m128 maxZ)
+	{
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(minX, ox), invX);
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(maxX, ox), invX);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(minY, oy), invY);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(maxY, oy), invY);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(minZ, oz), invZ);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(maxZ, oz), invZ);
+
+		__m128 tNear = _mm_setzero_ps();
+		__m128 tFar = _mm_set1_ps(FLT_MAX);
+		tNear = _mm_max_ps(_mm_min_ps(tx0, tx1), tNear);
+		tFar = _mm_min_ps(_mm_max_ps(tx0, tx1), tFar);
+		tNear = _mm_max_ps(_mm_min_ps(ty0, ty1), tNear);
+		tFar = _mm_min_ps(_mm_max_ps(ty0, ty1), tFar);
+		tNear = _mm_max_ps(_mm_min_ps(tz0, tz1), tNear);
+		tFar = _mm_min_ps(_mm_max_ps(tz0, tz1), tFar);
+
+		__m128 hit = _mm_cmple_ps(tNear, tFar);
+		return _mm_or_ps(_mm_and_ps(hit, tNear), _mm_andnot_ps(hit, _mm_set1_ps(-1.0f)));
+	}
+
+	/*
+		Name		inverseSse
+		Brief		inverse for four lanes
+	*/
+	inline __m128 inverseSse(__m128 d)
+	{
+		__m128 zero = _mm_cmpeq_ps(d, _mm_setzero_ps());
+		__m128 safe = _mm_or_ps(_mm_and_ps(zero, _mm_set1_ps(FLT_MIN)), _mm_andnot_ps(zero, d));
+		return _mm_div_ps(_mm_set1_ps(1.0f), safe);
+	}
+
+	/*
+		Name		countHits
+		Syntax		countHits(__m128 t)
+		Return		int - The number of lanes of t that are not -1
+	*/
+	inline int countHits(__m128 t)
+	{
+		int mask = _mm_movemask_ps(_mm_cmpge_ps(t, _mm_setzero_ps()));
+		return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+	}
+
+	/*
+		Name		NearestHit
+		Syntax		NearestHit
+		Brief		Keeps the nearest hit in each of four lanes while a ray is
+					tested against groups of four primitives
+	*/
+	struct NearestHit
+	{
+		NearestHit()
+		: t(_mm_set1_ps(FLT_MAX)), index(_mm_set1_epi32(-1)),
+		  next(_mm_set_epi32(3, 2, 1, 0))
+		{
+		}
+
+		void add(__m128 hitT)
+		{
+			__m128 closer = _mm_and_ps(_mm_cmpge_ps(hitT, _mm_setzero_ps()), _mm_cmplt_ps(hitT, t));
+			t = _mm_or_ps(_mm_and_ps(closer, hitT), _mm_andnot_ps(closer, t));
+
+			__m128i closerI = _mm_castps_si128(closer);
+			index = _mm_or_si128(_mm_and_si128(closerI, next), _mm_andnot_si128(closerI, index));
+			next = _mm_add_epi32(next, _mm_set1_epi32(4));
+		}
+
+		int reduce(float* bestT) const
+		{
+			M3D_ALIGN16 float lanesT[4];
+			M3D_ALIGN16 int lanesIndex[4];
+			_mm_store_ps(lanesT, t);
+			_mm_store_si128((__m128i*)lanesIndex, index);
+
+			int best = -1;
+			*bestT = FLT_MAX;
+			for (int i = 0; i < 4; ++i)
+			{
+				// Ties go to the lowest index, as in the scalar loop
+				if (lanesIndex[i] >= 0 && (lanesT[i] < *bestT ||
+					(lanesT[i] == *bestT && lanesIndex[i] < best)))
+				{
+					*bestT = lanesT[i];
+					best = lanesIndex[i];
+				}
+			}
+			return best;
+		}
+
+		__m128 t;
+		__m128i index;
+		__m128i next;
+	};
+#endif // M3D_SSE
+}
+
+/*
+	Name		m3dRayPacketSphereTest
+	Syntax		m3dRayPacketSphereTest(const M3DRayPacket& rays,
+									   const M3DVector3f centre,
+									   float radius, float* t)
+	Return		int - The number of rays that hit
+	Brief		Tests a packet of rays against one sphere
+*/
+int m3dRayPacketSphereTest(const M3DRayPacket& rays, const M3DVector3f centre, float radius, float* t)
+{
+	int hits = 0;
+	int i = 0;
+#ifdef M3D_SSE
+	__m128 cx = _mm_set1_ps(centre[0]), cy = _mm_set1_ps(centre[1]), cz = _mm_set1_ps(centre[2]);
+	__m128 r = _mm_set1_ps(radius);
+	for (; i + 4 <= rays.count; i += 4)
+	{
+		__m128 hitT = raySphereSse(_mm_loadu_ps(rays.ox + i), _mm_loadu_ps(rays.oy + i),
+								   _mm_loadu_ps(rays.oz + i), _mm_loadu_ps(rays.dx + i),
+								   _mm_loadu_ps(rays.dy + i), _mm_loadu_ps(rays.dz + i),
+								   cx, cy, cz, r);
+		_mm_storeu_ps(t + i, hitT);
+		hits += countHits(hitT);
+	}
+#endif
+	for (; i < rays.count; ++i)
+	{
+		t[i] = raySphere(rays.ox[i], rays.oy[i], rays.oz[i], rays.dx[i], rays.dy[i], rays.dz[i],
+						 centre[0], centre[1], centre[2], radius);
+		if (t[i] >= 0.0f)
+			++hits;
+	}
+	return hits;
+}
+
+/*
+	Name		m3dRayPacketBoxTest
+	Syntax		m3dRayPacketBoxTest(const M3DRayPacket& rays,
+									const M3DVector3f boxMin,
+									const M3DVector3f boxMax, float* t)
+	Return		int - The number of rays that hit
+	Brief		Tests a packet of rays against one axis aligned box
+*/
+int m3dRayPacketBoxTest(const M3DRayPacket& rays, const M3DVector3f boxMin, const M3DVector3f boxMax, float* t)
+{
+	int hits = 0;
+	int i = 0;
+#ifdef M3D_SSE
+	__m128 minX = _mm_set1_ps(boxMin[0]), minY = _mm_set1_ps(boxMin[1]), minZ = _mm_set1_ps(boxMin[2]);
+	__m128 maxX = _mm_set1_ps(boxMax[0]), maxY = _mm_set1_ps(boxMax[1]), maxZ = _mm_set1_ps(boxMax[2]);
+	for (; i + 4 <= rays.count; i += 4)
+	{
+		__m128 hitT = rayBoxSse(_mm_loadu_ps(rays.ox + i), _mm_loadu_ps(rays.oy + i),
+								_mm_loadu_ps(rays.oz + i), inverseSse(_mm_loadu_ps(rays.dx + i)),
+								inverseSse(_mm_loadu_ps(rays.dy + i)), inverseSse(_mm_loadu_ps(rays.dz + i)),
+								minX, minY, minZ, maxX, maxY, maxZ);
+		_mm_storeu_ps(t + i, hitT);
+		hits += countHits(hitT);
+	}
+#endif
+	for (; i < rays.count; ++i)
+	{
+		float o[3] = { rays.ox[i], rays.oy[i], rays.oz[i] };
+		float invD[3] = { inverse(rays.dx[i]), inverse(rays.dy[i]), inverse(rays.dz[i]) };
+		t[i] = rayBox(o, invD, boxMin, boxMax);
+		if (t[i] >= 0.0f)
+			++hits;
+	}
+	return hits;
+}
+
+/*
+	Name		m3dRaySpheresTest
+	Syntax		m3dRaySpheresTest(const M3DVector3f origin,
+								  const M3DVector3f dir,
+								  const M3DSphereArray& spheres, float* t)
+	Brief		Tests one ray against an array of spheres
+*/
+void m3dRaySpheresTest(const M3DVector3f origin, const M3DVector3f dir, const M3DSphereArray& spheres, float* t)
+{
+	int i = 0;
+#ifdef M3D_SSE
+	__m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+	__m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+	for (; i + 4 <= spheres.count; i += 4)
+	{
+		_mm_storeu_ps(t + i, raySphereSse(ox, oy, oz, dx, dy, dz,
+										  _mm_loadu_ps(spheres.x + i), _mm_loadu_ps(spheres.y + i),
+										  _mm_loadu_ps(spheres.z + i), _mm_loadu_ps(spheres.radius + i)));
+	}
+#endif
+	for (; i < spheres.count; ++i)
+	{
+		t[i] = raySphere(origin[0], origin[1], origin[2], dir[0], dir[1], dir[2],
+						 spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i]);
+	}
+}
+
+/*
+	Name		m3dRayBoxesTest
+	Syntax		m3dRayBoxesTest(const M3DVector3f origin,
+								const M3DVector3f dir,
+								const M3DBoxArray& boxes, float* t)
+	Brief		Tests one ray against an array of axis aligned boxes
+*/
+void m3dRayBoxesTest(const M3DVector3f origin, const M3DVector3f dir, const M3DBoxArray& boxes, float* t)
+{
+	float invD[3] = { inverse(dir[0]), inverse(dir[1]), inverse(dir[2]) };
+
+	int i = 0;
+#ifdef M3D_SSE
+	__m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+	__m128 invX = _mm_set1_ps(invD[0]), invY = _mm_set1_ps(invD[1]), invZ = _mm_set1_ps(invD[2]);
+	for (; i + 4 <= boxes.count; i += 4)
+	{
+		_mm_storeu_ps(t + i, rayBoxSse(ox, oy, oz, invX, invY, invZ,
+									   _mm_loadu_ps(boxes.minX + i), _mm_loadu_ps(boxes.minY + i),
+									   _mm_loadu_ps(boxes.minZ + i), _mm_loadu_ps(boxes.maxX + i),
+									   _mm_loadu_ps(boxes.maxY + i), _mm_loadu_ps(boxes.maxZ + i)));
+	}
+#endif
+	for (; i < boxes.count; ++i)
+	{
+		float boxMin[3] = { boxes.minX[i], boxes.minY[i], boxes.minZ[i] };
+		float boxMax[3] = { boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i] };
+		t[i] = rayBox(origin, invD, boxMin, boxMax);
+	}
+}
+
+/*
+	Name		m3dRayNearestSphere
+	Syntax		m3dRayNearestSphere(const M3DVector3f origin,
+									const M3DVector3f dir,
+									const M3DSphereArray& spheres, float* t)
+	Return		int - Index of the nearest sphere hit, -1 if none is
+	Brief		Finds the first sphere along a ray
+*/
+int m3dRayNearestSphere(const M3DVector3f origin, const M3DVector3f dir, const M3DSphereArray& spheres, float* t)
+{
+	int best = -1;
+	*t = FLT_MAX;
+
+	int i = 0;
+#ifdef M3D_SSE
+	__m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+	__m128 dx = _mm_set1_ps(dir[0]), dy = _mm_set1_ps(dir[1]), dz = _mm_set1_ps(dir[2]);
+	NearestHit nearest;
+	for (; i + 4 <= spheres.count; i += 4)
+	{
+		nearest.add(raySphereSse(ox, oy, oz, dx, dy, dz,
+								 _mm_loadu_ps(spheres.x + i), _mm_loadu_ps(spheres.y + i),
+								 _mm_loadu_ps(spheres.z + i), _mm_loadu_ps(spheres.radius + i)));
+	}
+	best = nearest.reduce(t);
+#endif
+	for (; i < spheres.count; ++i)
+	{
+		float hitT = raySphere(origin[0], origin[1], origin[2], dir[0], dir[1], dir[2],
+							   spheres.x[i], spheres.y[i], spheres.z[i], spheres.radius[i]);
+		if (hitT >= 0.0f && hitT < *t)
+		{
+			*t = hitT;
+			best = i;
+		}
+	}
+
+	if (best < 0)
+		*t = -1.0f;
+	return best;
+}
+
+/*
+	Name		m3dRayNearestBox
+	Syntax		m3dRayNearestBox(const M3DVector3f origin,
+								 const M3DVector3f dir,
+								 const M3DBoxArray& boxes, float* t)
+	Return		int - Index of the nearest box hit, -1 if none is
+	Brief		Finds the first axis aligned box along a ray
+*/
+int m3dRayNearestBox(const M3DVector3f origin, const M3DVector3f dir, const M3DBoxArray& boxes, float* t)
+{
+	float invD[3] = { inverse(dir[0]), inverse(dir[1]), inverse(dir[2]) };
+
+	int best = -1;
+	*t = FLT_MAX;
+
+	int i = 0;
+#ifdef M3D_SSE
+	__m128 ox = _mm_set1_ps(origin[0]), oy = _mm_set1_ps(origin[1]), oz = _mm_set1_ps(origin[2]);
+	__m128 invX = _mm_set1_ps(invD[0]), invY = _mm_set1_ps(invD[1]), invZ = _mm_set1_ps(invD[2]);
+	NearestHit nearest;
+	for (; i + 4 <= boxes.count; i += 4)
+	{
+		nearest.add(rayBoxSse(ox, oy, oz, invX, invY, invZ,
+							  _mm_loadu_ps(boxes.minX + i), _mm_loadu_ps(boxes.minY + i),
+							  _mm_loadu_ps(boxes.minZ + i), _mm_loadu_ps(boxes.maxX + i),
+							  _mm_loadu_ps(boxes.maxY + i), _mm_loadu_ps(boxes.maxZ + i)));
+	}
+	best = nearest.reduce(t);
+#endif
+	for (; i < boxes.count; ++i)
+	{
+		float boxMin[3] = { boxes.minX[i], boxes.minY[i], boxes.minZ[i] };
+		float boxMax[3] = { boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i] };
+		float hitT = rayBox(origin, invD, boxMin, boxMax);
+		if (hitT >= 0.0f && hitT < *t)
+		{
+			*t = hitT;
+			best = i;
+		}
+	}
+
+	if (best < 0)
+		*t = -1.0f;
+	return best;
+}
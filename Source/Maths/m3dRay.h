@@ -0,0 +1,54 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dRay
+	Brief		Ray intersection tests over many rays or many primitives at
+				once, for picking and occlusion queries
+	Details		Rays, spheres and boxes are held as structure of arrays and
+				tested four at a time with SSE, so a packet of 4, 8 or 16
+				rays is just a count that is a multiple of four; other counts
+				are finished one at a time. Ray directions must be unit length.
+				Unlike m3dRaySphereTest, the distance returned is that of the
+				first hit at or ahead of the ray origin, with -1 for a miss,
+				and 0 when the origin is inside the primitive
+*/
+
+#ifndef M3DRAY_H
+#define M3DRAY_H
+
+#include "Maths/m3dBatch.h"
+
+/*
+	Name		M3DRayPacket
+	Syntax		M3DRayPacket
+	Brief		count rays, with origins and unit directions in separate
+				x, y and z arrays
+*/
+struct M3DRayPacket
+{
+	const float* ox;
+	const float* oy;
+	const float* oz;
+	const float* dx;
+	const float* dy;
+	const float* dz;
+	int count;
+};
+
+// Many rays against one primitive. t receives a distance for each ray, and
+// the number of rays that hit is returned
+int m3dRayPacketSphereTest(const M3DRayPacket& rays, const M3DVector3f centre, float radius, float* t);
+int m3dRayPacketBoxTest(const M3DRayPacket& rays, const M3DVector3f boxMin, const M3DVector3f boxMax, float* t);
+
+// One ray against many primitives. t receives a distance for each primitive
+void m3dRaySpheresTest(const M3DVector3f origin, const M3DVector3f dir, const M3DSphereArray& spheres, float* t);
+void m3dRayBoxesTest(const M3DVector3f origin, const M3DVector3f dir, const M3DBoxArray& boxes, float* t);
+
+// One ray against many primitives, keeping only the nearest hit. Returns its
+// index, or -1 if nothing is hit, and its distance in t
+int m3dRayNearestSphere(const M3DVector3f origin, const M3DVector3f dir, const M3DSphereArray& spheres, float* t);
+int m3dRayNearestBox(const M3DVector3f origin, const M3DVector3f dir, const M3DBoxArray& boxes, float* t);
+
+#endif // M3DRAY_H
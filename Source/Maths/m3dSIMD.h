@@ -0,0 +1,81 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		m3dSIMD
+	Brief		SSE helpers shared by the SIMD kernels of the math3d library
+	Details		M3D_SSE is defined when the compiler targets SSE2 - always on
+				x64, and on x86 with /arch:SSE2. Defining M3D_NO_SIMD in the
+				project forces the scalar fallbacks for comparison
+*/
+
+#ifndef M3DSIMD_H
+#define M3DSIMD_H
+
+#if !defined(M3D_NO_SIMD) && (defined(_M_X64) || defined(__SSE2__) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define M3D_SSE
+#endif
+
+// Aligns a local or static array to 16 bytes for SSE loads and stores
+#ifdef _MSC_VER
+	#define M3D_ALIGN16		__declspec(align(16))
+#else
+	#define M3D_ALIGN16		__attribute__((aligned(16)))
+#endif
+
+#ifdef M3D_SSE
+
+#include <emmintrin.h>
+
+#define M3D_SHUFFLE(x, y, z, w)		((x) | ((y) << 2) | ((z) << 4) | ((w) << 6))
+#define M3D_SWIZZLE(v, x, y, z, w)	_mm_shuffle_ps((v), (v), M3D_SHUFFLE(x, y, z, w))
+#define M3D_SPLAT(v, i)				_mm_shuffle_ps((v), (v), M3D_SHUFFLE(i, i, i, i))
+
+/*
+	Name		m3dHorizontalSum
+	Syntax		m3dHorizontalSum(__m128 v)
+	Return		__m128 - The sum of the four lanes of v in every lane
+	Brief		Adds the lanes of a vector together without SSE3
+*/
+inline __m128 m3dHorizontalSum(__m128 v)
+{
+	__m128 s = _mm_add_ps(v, M3D_SWIZZLE(v, 1, 0, 3, 2));
+	return _mm_add_ps(s, M3D_SWIZZLE(s, 2, 3, 0, 1));
+}
+
+/*
+	Name		m3dLinearCombine
+	Syntax		m3dLinearCombine(__m128 v, const __m128 columns[4])
+	Return		__m128 - columns[0] * v.x + columns[1] * v.y + columns[2] * v.z
+				+ columns[3] * v.w
+	Brief		Transforms a vector by a column major matrix held in registers
+*/
+inline __m128 m3dLinearCombine(__m128 v, const __m128 columns[4])
+{
+	__m128 r = _mm_mul_ps(M3D_SPLAT(v, 0), columns[0]);
+	r = _mm_add_ps(r, _mm_mul_ps(M3D_SPLAT(v, 1), columns[1]));
+	r = _mm_add_ps(r, _mm_mul_ps(M3D_SPLAT(v, 2), columns[2]));
+	return _mm_add_ps(r, _mm_mul_ps(M3D_SPLAT(v, 3), columns[3]));
+}
+
+/*
+	Name		m3dRsqrt
+	Syntax		m3dRsqrt(__m128 v)
+	Return		__m128 - 1 / sqrt(v) to about 23 bits
+	Brief		Reciprocal square root estimate refined by one Newton step
+*/
+inline __m128 m3dRsqrt(__m128 v)
+{
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 three = _mm_set1_ps(3.0f);
+
+	__m128 e = _mm_rsqrt_ps(v);
+	__m128 ve2 = _mm_mul_ps(_mm_mul_ps(v, e), e);
+	return _mm_mul_ps(_mm_mul_ps(half, e), _mm_sub_ps(three, ve2));
+}
+
+#endif // M3D_SSE
+
+#endif // M3DSIMD_H
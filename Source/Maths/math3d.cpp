@@ -43,6 +43,8 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 
 // Most functions are in-lined... and are defined here
 #include "Maths/math3d.h"
+#include "Maths/m3dSIMD.h"
+#include "Maths/m3dApprox.h"
 
 
 ////////////////////////////////////////////////////////////
@@ -52,7 +54,7 @@ ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF S
 void m3dLoadIdentity33(M3DMatrix33f m)
 	{
 	// Don't be fooled, this is still column major
-	static M3DMatrix33f	identity = { 1.0f, 0.0f, 0.0f ,
+	static const M3DMatrix33f	identity = { 1.0f, 0.0f, 0.0f ,
 									 0.0f, 1.0f, 0.0f,
 									 0.0f, 0.0f, 1.0f };
 
@@ -63,7 +65,7 @@ void m3dLoadIdentity33(M3DMatrix33f m)
 void m3dLoadIdentity33(M3DMatrix33d m)
 	{
 	// Don't be fooled, this is still column major
-	static M3DMatrix33d	identity = { 1.0, 0.0, 0.0 ,
+	static const M3DMatrix33d	identity = { 1.0, 0.0, 0.0 ,
 									 0.0, 1.0, 0.0,
 									 0.0, 0.0, 1.0 };
 
@@ -74,7 +76,7 @@ void m3dLoadIdentity33(M3DMatrix33d m)
 void m3dLoadIdentity44(M3DMatrix44f m)
 	{
 	// Don't be fooled, this is still column major
-	static M3DMatrix44f	identity = { 1.0f, 0.0f, 0.0f, 0.0f,
+	static const M3DMatrix44f	identity = { 1.0f, 0.0f, 0.0f, 0.0f,
 									 0.0f, 1.0f, 0.0f, 0.0f,
 									 0.0f, 0.0f, 1.0f, 0.0f,
 									 0.0f, 0.0f, 0.0f, 1.0f };
@@ -85,7 +87,7 @@ void m3dLoadIdentity44(M3DMatrix44f m)
 // 4x4 double
 void m3dLoadIdentity44(M3DMatrix44d m)
 	{
-	static M3DMatrix44d	identity = { 1.0, 0.0, 0.0, 0.0,
+	static const M3DMatrix44d	identity = { 1.0, 0.0, 0.0, 0.0,
 									 0.0, 1.0, 0.0, 0.0,
 									 0.0, 0.0, 1.0, 0.0,
 									 0.0, 0.0, 0.0, 1.0 };
@@ -132,7 +134,8 @@ double m3dGetDistanceSquared3(const M3DVector3d u, const M3DVector3d v)
 
 ///////////////////////////////////////////////////////////////////////////////
 // Multiply two 4x4 matricies
-void m3dMatrixMultiply44(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b )
+// Scalar reference, used when SSE is not available and by the benchmarks
+void m3dMatrixMultiply44Scalar(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b )
 {
 	for (int i = 0; i < 4; i++) {
 		float ai0=A(i,0),  ai1=A(i,1),  ai2=A(i,2),  ai3=A(i,3);
@@ -143,8 +146,29 @@ void m3dMatrixMultiply44(M3DMatrix44f product, const M3DMatrix44f a, const M3DMa
 	}
 }
 
+// Each column of the product is the columns of a combined by a column of b,
+// so a is held in four registers and each column of b is splatted across them.
+// product may alias a or b, since every input is read before it is written.
+void m3dMatrixMultiply44(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b )
+{
+#ifdef M3D_SSE
+	__m128 columns[4] = { _mm_loadu_ps(a), _mm_loadu_ps(a + 4), _mm_loadu_ps(a + 8), _mm_loadu_ps(a + 12) };
+	__m128 p0 = m3dLinearCombine(_mm_loadu_ps(b), columns);
+	__m128 p1 = m3dLinearCombine(_mm_loadu_ps(b + 4), columns);
+	__m128 p2 = m3dLinearCombine(_mm_loadu_ps(b + 8), columns);
+	__m128 p3 = m3dLinearCombine(_mm_loadu_ps(b + 12), columns);
+
+	_mm_storeu_ps(product, p0);
+	_mm_storeu_ps(product + 4, p1);
+	_mm_storeu_ps(product + 8, p2);
+	_mm_storeu_ps(product + 12, p3);
+#else
+	m3dMatrixMultiply44Scalar(product, a, b);
+#endif
+}
+
 // Ditto above, but for doubles
-void m3dMatrixMultiply(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b )
+void m3dMatrixMultiply44(M3DMatrix44d product, const M3DMatrix44d a, const M3DMatrix44d b )
 {
 	for (int i = 0; i < 4; i++) {
 		double ai0=A(i,0),  ai1=A(i,1),  ai2=A(i,2),  ai3=A(i,3);
@@ -176,7 +200,7 @@ void m3dMatrixMultiply33(M3DMatrix33f product, const M3DMatrix33f a, const M3DMa
 }
 
 // Ditto above, but for doubles
-void m3dMatrixMultiply44(M3DMatrix33d product, const M3DMatrix33d a, const M3DMatrix33d b )
+void m3dMatrixMultiply33(M3DMatrix33d product, const M3DMatrix33d a, const M3DMatrix33d b )
 {
 	for (int i = 0; i < 3; i++) {
 		double ai0=A33(i,0),  ai1=A33(i,1),  ai2=A33(i,2);
@@ -240,8 +264,7 @@ void m3dRotationMatrix33(M3DMatrix33f m, float angle, float x, float y, float z)
 	float mag, s, c;
 	float xx, yy, zz, xy, yz, zx, xs, ys, zs, one_c;
 
-	s = float(sin(angle));
-	c = float(cos(angle));
+	m3dFastSinCos(angle, &s, &c);
 
 	mag = float(sqrt( x*x + y*y + z*z ));
 
@@ -289,8 +312,7 @@ void m3dRotationMatrix44(M3DMatrix44f m, float angle, float x, float y, float z)
 	float mag, s, c;
 	float xx, yy, zz, xy, yz, zx, xs, ys, zs, one_c;
 
-	s = float(sin(angle));
-	c = float(cos(angle));
+	m3dFastSinCos(angle, &s, &c);
 
 	mag = float(sqrt( x*x + y*y + z*z ));
 
@@ -516,7 +538,8 @@ static double DetIJ(const M3DMatrix44d m, const int i, const int j)
 ////////////////////////////////////////////////////////////////////////////
 ///
 // Invert matrix
-void m3dInvertMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+// Scalar reference, used when SSE is not available and by the benchmarks
+void m3dInvertMatrix44Scalar(M3DMatrix44f mInverse, const M3DMatrix44f m)
     {
     int i, j;
     float det, detij;
@@ -568,6 +591,248 @@ void m3dInvertMatrix44(M3DMatrix44d mInverse, const M3DMatrix44d m)
     }
 
 
+#ifdef M3D_SSE
+////////////////////////////////////////////////////////////////////////////
+// 2x2 matrix helpers for the blockwise inverse. Each 2x2 is held in one
+// register as (m00, m01, m10, m11).
+static inline __m128 Mat2Mul(__m128 a, __m128 b)
+	{
+	return _mm_add_ps(_mm_mul_ps(a, M3D_SWIZZLE(b, 0, 3, 0, 3)),
+					  _mm_mul_ps(M3D_SWIZZLE(a, 1, 0, 3, 2), M3D_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+
+// adj(a) * b
+static inline __m128 Mat2AdjMul(__m128 a, __m128 b)
+	{
+	return _mm_sub_ps(_mm_mul_ps(M3D_SWIZZLE(a, 3, 3, 0, 0), b),
+					  _mm_mul_ps(M3D_SWIZZLE(a, 1, 1, 2, 2), M3D_SWIZZLE(b, 2, 3, 0, 1)));
+	}
+
+// a * adj(b)
+static inline __m128 Mat2MulAdj(__m128 a, __m128 b)
+	{
+	return _mm_sub_ps(_mm_mul_ps(a, M3D_SWIZZLE(b, 3, 0, 3, 0)),
+					  _mm_mul_ps(M3D_SWIZZLE(a, 1, 0, 3, 2), M3D_SWIZZLE(b, 2, 1, 2, 1)));
+	}
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+// General 4x4 inverse. The SSE path splits the matrix into four 2x2 blocks
+// and inverts it blockwise, which needs a handful of 2x2 products instead of
+// the sixteen 3x3 cofactors above. The blocks are taken from memory order, 
+// and since inverse(transpose(m)) = transpose(inverse(m)) it does not matter
+// that the matrix is column major. A singular matrix gives infinities, as
+// the scalar version does.
+void m3dInvertMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+#ifdef M3D_SSE
+	__m128 r0 = _mm_loadu_ps(m);
+	__m128 r1 = _mm_loadu_ps(m + 4);
+	__m128 r2 = _mm_loadu_ps(m + 8);
+	__m128 r3 = _mm_loadu_ps(m + 12);
+
+	__m128 A = _mm_movelh_ps(r0, r1);
+	__m128 B = _mm_movehl_ps(r1, r0);
+	__m128 C = _mm_movelh_ps(r2, r3);
+	__m128 D = _mm_movehl_ps(r3, r2);
+
+	// Determinants of the four blocks
+	__m128 detSub = _mm_sub_ps(
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, M3D_SHUFFLE(0, 2, 0, 2)), _mm_shuffle_ps(r1, r3, M3D_SHUFFLE(1, 3, 1, 3))),
+		_mm_mul_ps(_mm_shuffle_ps(r0, r2, M3D_SHUFFLE(1, 3, 1, 3)), _mm_shuffle_ps(r1, r3, M3D_SHUFFLE(0, 2, 0, 2))));
+	__m128 detA = M3D_SPLAT(detSub, 0);
+	__m128 detB = M3D_SPLAT(detSub, 1);
+	__m128 detC = M3D_SPLAT(detSub, 2);
+	__m128 detD = M3D_SPLAT(detSub, 3);
+
+	__m128 D_C = Mat2AdjMul(D, C);
+	__m128 A_B = Mat2AdjMul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, D_C));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, A_B));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, A_B));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, D_C));
+
+	__m128 det = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+	det = _mm_sub_ps(det, m3dHorizontalSum(_mm_mul_ps(A_B, M3D_SWIZZLE(D_C, 0, 2, 1, 3))));
+
+	__m128 rDet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+	X = _mm_mul_ps(X, rDet);
+	Y = _mm_mul_ps(Y, rDet);
+	Z = _mm_mul_ps(Z, rDet);
+	W = _mm_mul_ps(W, rDet);
+
+	_mm_storeu_ps(mInverse,      _mm_shuffle_ps(X, Y, M3D_SHUFFLE(3, 1, 3, 1)));
+	_mm_storeu_ps(mInverse + 4,  _mm_shuffle_ps(X, Y, M3D_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(mInverse + 8,  _mm_shuffle_ps(Z, W, M3D_SHUFFLE(3, 1, 3, 1)));
+	_mm_storeu_ps(mInverse + 12, _mm_shuffle_ps(Z, W, M3D_SHUFFLE(2, 0, 2, 0)));
+#else
+	m3dInvertMatrix44Scalar(mInverse, m);
+#endif
+	}
+
+////////////////////////////////////////////////////////////////////////////
+// Inverse of an affine matrix - any 3x3 rotation/scale/shear plus a translation,
+// with a bottom row of (0, 0, 0, 1). The 3x3 is inverted from the cross products
+// of its columns, and the translation is carried back through it.
+void m3dInvertAffineMatrix44Scalar(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+	M3DVector3f r0, r1, r2;
+	m3dCrossProduct3(r0, m + 4, m + 8);
+	m3dCrossProduct3(r1, m + 8, m);
+	m3dCrossProduct3(r2, m, m + 4);
+
+	float det = 1.0f / m3dDotProduct3(m, r0);
+	m3dScaleVector3(r0, det);
+	m3dScaleVector3(r1, det);
+	m3dScaleVector3(r2, det);
+
+	M3DVector3f t = { m[12], m[13], m[14] };
+
+	// r0, r1 and r2 are the rows of the inverse
+	mInverse[0] = r0[0]; mInverse[4] = r0[1]; mInverse[8]  = r0[2]; mInverse[12] = -m3dDotProduct3(r0, t);
+	mInverse[1] = r1[0]; mInverse[5] = r1[1]; mInverse[9]  = r1[2]; mInverse[13] = -m3dDotProduct3(r1, t);
+	mInverse[2] = r2[0]; mInverse[6] = r2[1]; mInverse[10] = r2[2]; mInverse[14] = -m3dDotProduct3(r2, t);
+	mInverse[3] = 0.0f;  mInverse[7] = 0.0f;  mInverse[11] = 0.0f;  mInverse[15] = 1.0f;
+	}
+
+void m3dInvertAffineMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m)
+	{
+#ifdef M3D_SSE
+	const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+	__m128 c0 = _mm_and_ps(_mm_loadu_ps(m), mask);
+	__m128 c1 = _mm_and_ps(_mm_loadu_ps(m + 4), mask);
+	__m128 c2 = _mm_and_ps(_mm_loadu_ps(m + 8), mask);
+	__m128 t = _mm_loadu_ps(m + 12);
+
+	// Cross products of the columns give the rows of the inverse, scaled by det
+	#define M3D_CROSS(u, v) _mm_sub_ps(_mm_mul_ps(M3D_SWIZZLE(u, 1, 2, 0, 3), M3D_SWIZZLE(v, 2, 0, 1, 3)), \
+									   _mm_mul_ps(M3D_SWIZZLE(u, 2, 0, 1, 3), M3D_SWIZZLE(v, 1, 2, 0, 3)))
+	__m128 r0 = M3D_CROSS(c1, c2);
+	__m128 r1 = M3D_CROSS(c2, c0);
+	__m128 r2 = M3D_CROSS(c0, c1);
+	#undef M3D_CROSS
+
+	__m128 rDet = _mm_div_ps(_mm_set1_ps(1.0f), m3dHorizontalSum(_mm_mul_ps(c0, r0)));
+	r0 = _mm_mul_ps(r0, rDet);
+	r1 = _mm_mul_ps(r1, rDet);
+	r2 = _mm_mul_ps(r2, rDet);
+	__m128 r3 = _mm_setzero_ps();
+
+	// Rows to columns; the w lanes are all zero after the transpose
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+	__m128 translation = _mm_mul_ps(M3D_SPLAT(t, 0), r0);
+	translation = _mm_add_ps(translation, _mm_mul_ps(M3D_SPLAT(t, 1), r1));
+	translation = _mm_add_ps(translation, _mm_mul_ps(M3D_SPLAT(t, 2), r2));
+	translation = _mm_sub_ps(_mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f), translation);
+
+	_mm_storeu_ps(mInverse,      r0);
+	_mm_storeu_ps(mInverse + 4,  r1);
+	_mm_storeu_ps(mInverse + 8,  r2);
+	_mm_storeu_ps(mInverse + 12, translation);
+#else
+	m3dInvertAffineMatrix44Scalar(mInverse, m);
+#endif
+	}
+
+////////////////////////////////////////////////////////////////////////////
+// Transpose a 4x4 matrix. Safe to transpose in place.
+void m3dTransposeMatrix44(M3DMatrix44f mTranspose, const M3DMatrix44f m)
+	{
+#ifdef M3D_SSE
+	__m128 c0 = _mm_loadu_ps(m);
+	__m128 c1 = _mm_loadu_ps(m + 4);
+	__m128 c2 = _mm_loadu_ps(m + 8);
+	__m128 c3 = _mm_loadu_ps(m + 12);
+
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	_mm_storeu_ps(mTranspose,      c0);
+	_mm_storeu_ps(mTranspose + 4,  c1);
+	_mm_storeu_ps(mTranspose + 8,  c2);
+	_mm_storeu_ps(mTranspose + 12, c3);
+#else
+	M3DMatrix44f t;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			t[i*4 + j] = m[j*4 + i];
+	m3dCopyMatrix44(mTranspose, t);
+#endif
+	}
+
+// Ditto above, but for doubles
+void m3dTransposeMatrix44(M3DMatrix44d mTranspose, const M3DMatrix44d m)
+	{
+	M3DMatrix44d t;
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			t[i*4 + j] = m[j*4 + i];
+	m3dCopyMatrix44(mTranspose, t);
+	}
+
+////////////////////////////////////////////////////////////////////////////
+// Normalize an array of vectors. The SSE path works four vectors at a time,
+// transposing them into x, y and z registers and scaling by a refined
+// reciprocal square root; the vectors left over are done one at a time.
+void m3dNormalizeVectors3(M3DVector3f* v, int count)
+	{
+	int i = 0;
+#ifdef M3D_SSE
+	for (; i + 4 <= count; i += 4)
+		{
+		float* p = v[i];
+		__m128 a = _mm_loadu_ps(p);			// x0 y0 z0 x1
+		__m128 b = _mm_loadu_ps(p + 4);		// y1 z1 x2 y2
+		__m128 c = _mm_loadu_ps(p + 8);		// z2 x3 y3 z3
+
+		__m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, M3D_SHUFFLE(2, 2, 1, 1)), M3D_SHUFFLE(0, 3, 0, 2));
+		__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, M3D_SHUFFLE(1, 1, 0, 0)), 
+								  _mm_shuffle_ps(b, c, M3D_SHUFFLE(3, 3, 2, 2)), M3D_SHUFFLE(0, 2, 0, 2));
+		__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, M3D_SHUFFLE(2, 2, 1, 1)), c, M3D_SHUFFLE(0, 2, 0, 3));
+
+		__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 scale = m3dRsqrt(lengthSq);
+		x = _mm_mul_ps(x, scale);
+		y = _mm_mul_ps(y, scale);
+		z = _mm_mul_ps(z, scale);
+
+		// And back to x y z order
+		a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, M3D_SHUFFLE(0, 0, 0, 0)), 
+						   _mm_shuffle_ps(z, x, M3D_SHUFFLE(0, 0, 1, 1)), M3D_SHUFFLE(0, 2, 0, 2));
+		b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, M3D_SHUFFLE(1, 1, 1, 1)), 
+						   _mm_shuffle_ps(x, y, M3D_SHUFFLE(2, 2, 2, 2)), M3D_SHUFFLE(0, 2, 0, 2));
+		c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, M3D_SHUFFLE(2, 2, 3, 3)), 
+						   _mm_shuffle_ps(y, z, M3D_SHUFFLE(3, 3, 3, 3)), M3D_SHUFFLE(0, 2, 0, 2));
+
+		_mm_storeu_ps(p, a);
+		_mm_storeu_ps(p + 4, b);
+		_mm_storeu_ps(p + 8, c);
+		}
+#endif
+	for (; i < count; i++)
+		m3dNormalizeVector3(v[i]);
+	}
+
+////////////////////////////////////////////////////////////////////////////
+// Transform an array of four component vectors by one matrix. The matrix
+// columns are loaded into registers once and reused for every vector.
+void m3dTransformVectors4(M3DVector4f* vOut, const M3DVector4f* v, int count, const M3DMatrix44f m)
+	{
+#ifdef M3D_SSE
+	__m128 columns[4];
+	columns[0] = _mm_loadu_ps(m);
+	columns[1] = _mm_loadu_ps(m + 4);
+	columns[2] = _mm_loadu_ps(m + 8);
+	columns[3] = _mm_loadu_ps(m + 12);
+
+	for (int i = 0; i < count; i++)
+		_mm_storeu_ps(vOut[i], m3dLinearCombine(_mm_loadu_ps(v[i]), columns));
+#else
+	for (int i = 0; i < count; i++)
+		m3dTransformVector4(vOut[i], v[i], m);
+#endif
+	}
+
 ///////////////////////////////////////////////////////////////////////////////////////
 // Get Window coordinates, discard Z...
 void m3dProjectXY(M3DVector2f vPointOut, const M3DMatrix44f mModelView, const M3DMatrix44f mProjection, const int iViewPort[4], const M3DVector3f vPointIn)
@@ -521,6 +521,27 @@ inline void m3dTranslationMatrix44(M3DMatrix44d m, double x, double y, double z)
 void m3dInvertMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m);
 void m3dInvertMatrix44(M3DMatrix44d mInverse, const M3DMatrix44d m);
 
+// Inverse of a matrix whose bottom row is (0, 0, 0, 1) - much cheaper than the
+// general inverse for world and view matrices
+void m3dInvertAffineMatrix44(M3DMatrix44f mInverse, const M3DMatrix44f m);
+
+// Transpose. Safe to call with mTranspose == m
+void m3dTransposeMatrix44(M3DMatrix44f mTranspose, const M3DMatrix44f m);
+void m3dTransposeMatrix44(M3DMatrix44d mTranspose, const M3DMatrix44d m);
+
+// Normalize count tightly packed vectors in place
+void m3dNormalizeVectors3(M3DVector3f* v, int count);
+
+// Transform count four component vectors by one matrix. vOut may be v
+void m3dTransformVectors4(M3DVector4f* vOut, const M3DVector4f* v, int count, const M3DMatrix44f m);
+
+// The float multiply and inverses above use SSE where the compiler targets it
+// (see m3dSIMD.h). These are the plain scalar versions, kept as the fallback
+// and so the benchmarks can compare the two.
+void m3dMatrixMultiply44Scalar(M3DMatrix44f product, const M3DMatrix44f a, const M3DMatrix44f b);
+void m3dInvertMatrix44Scalar(M3DMatrix44f mInverse, const M3DMatrix44f m);
+void m3dInvertAffineMatrix44Scalar(M3DMatrix44f mInverse, const M3DMatrix44f m);
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
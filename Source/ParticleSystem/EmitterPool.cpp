@@ -0,0 +1,324 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		EmitterPool
+	Brief		Implementation of the EmitterPool class
+*/
+
+#include "ParticleSystem/EmitterPool.hpp"
+#include "Maths/m3dSIMD.h"
+#include "Profiler/Profiler.hpp"
+
+/*
+	Name		EmitterPool::EmitterPool
+	Syntax		EmitterPool()
+	Brief		EmitterPool constructor, with no slots
+*/
+EmitterPool::EmitterPool()
+: slotParticles_(0), seed_(1), liveNo_(0), particlesNo_(0), spawnedNo_(0),
+  refusedNo_(0), recycledNo_(0)
+{
+	m3dSeedRandom(&random_, seed_, 0);
+}
+
+/*
+	Name		EmitterPool::initialise
+	Syntax		EmitterPool::initialise(int maxEmitters, int slotParticles,
+				unsigned int seed)
+	Param		int maxEmitters - Most emitters alive at once
+	Param		int slotParticles - Most particles an emitter has alive at
+				once
+	Param		unsigned int seed - Seed of the random numbers, so that runs
+				can be repeated
+	Brief		Allocates every slot, with no emitters alive
+	Details		Slots are rounded up to a whole number of fours, so that an
+				emitter's particles are moved four at a time to the end of
+				its slot
+*/
+void EmitterPool::initialise(int maxEmitters, int slotParticles, unsigned int seed)
+{
+	slotParticles_ = (slotParticles + 3) & ~3;
+	seed_ = seed;
+
+	emitters_.resize(maxEmitters);
+	live_.resize(maxEmitters);
+
+	int particles = maxEmitters * slotParticles_;
+	x_.assign(particles, 0.0f);
+	y_.assign(particles, 0.0f);
+	z_.assign(particles, 0.0f);
+	vx_.assign(particles, 0.0f);
+	vy_.assign(particles, 0.0f);
+	vz_.assign(particles, 0.0f);
+	age_.assign(particles, 0.0f);
+
+	clear();
+}
+
+/*
+	Name		EmitterPool::spawn
+	Syntax		EmitterPool::spawn(const ParticleRules* rules,
+				const M3DVector3f emitPos, float duration)
+	Param		const ParticleRules* rules - How the emitter emits and moves
+				its particles
+	Param		const M3DVector3f emitPos - Where its bursts are emitted
+				about
+	Param		float duration - Time it emits for. A first burst is emitted
+				at once
+	Return		int - The emitter, or -1 if every slot is taken
+	Brief		Starts an emitter in a free slot
+*/
+int EmitterPool::spawn(const ParticleRules* rules, const M3DVector3f emitPos, float duration)
+{
+	if (liveNo_ == (int)emitters_.size())
+	{
+		++refusedNo_;
+		return -1;
+	}
+
+	int emitter = live_[liveNo_];
+	Emitter& e = emitters_[emitter];
+	e.rules = rules;
+	m3dCopyVector3(e.emitPos, emitPos);
+	e.duration = duration;
+	e.emitTime = 0.0f;
+	e.count = 0;
+	e.liveIndex = liveNo_++;
+	++spawnedNo_;
+
+	emit(emitter, rules->emitCount);
+	return emitter;
+}
+
+/*
+	Name		EmitterPool::stop
+	Syntax		EmitterPool::stop(int emitter)
+	Param		int emitter - A live emitter
+	Brief		Stops the emitter emitting, leaving its particles to die
+*/
+void EmitterPool::stop(int emitter)
+{
+	emitters_[emitter].duration = 0.0f;
+}
+
+/*
+	Name		EmitterPool::clear
+	Syntax		EmitterPool::clear()
+	Brief		Frees every slot and starts the counts and random numbers
+				again
+*/
+void EmitterPool::clear()
+{
+	for (int i = 0; i < (int)emitters_.size(); ++i)
+	{
+		emitters_[i].count = 0;
+		emitters_[i].liveIndex = -1;
+		live_[i] = i;
+	}
+	liveNo_ = 0;
+	particlesNo_ = 0;
+	spawnedNo_ = 0;
+	refusedNo_ = 0;
+	recycledNo_ = 0;
+	m3dSeedRandom(&random_, seed_, 0);
+}
+
+/*
+	Name		EmitterPool::update
+	Syntax		EmitterPool::update(float dt)
+	Param		float dt - Time step
+	Brief		Steps every live emitter and its particles, and recycles
+				those that are finished
+	Details		The live list is walked from its end, so an emitter
+				recycled into the place of the last has already been
+				stepped
+*/
+void EmitterPool::update(float dt)
+{
+	PROFILE_ZONE("EmitterPool::update");
+
+	for (int n = liveNo_ - 1; n >= 0; --n)
+	{
+		int emitter = live_[n];
+		Emitter& e = emitters_[emitter];
+		int before = e.count;
+		step(emitter, dt);
+		particlesNo_ -= before - e.count;
+
+		// Bursts are emitted at the rate their interval gives, however
+		// long the frame, for as long as the emitter lasts
+		if (e.duration > 0.0f)
+		{
+			float emitDt = dt < e.duration ? dt : e.duration;
+			e.duration -= dt;
+			e.emitTime += emitDt;
+			int bursts = (int)(e.emitTime / e.rules->emitInterval);
+			e.emitTime -= bursts * e.rules->emitInterval;
+			if (bursts > 0)
+				emit(emitter, bursts * e.rules->emitCount);
+		}
+
+		if (e.duration <= 0.0f && e.count == 0)
+			recycle(emitter);
+	}
+}
+
+/*
+	Name		EmitterPool::emit
+	Syntax		EmitterPool::emit(int emitter, int count)
+	Param		int emitter - A live emitter
+	Param		int count - Particles to emit
+	Brief		Emits as many of count particles as there is room for in the
+				emitter's slot, as ParticleSimulation emits them
+	Details		The spread and directions are drawn in batches straight
+				into the slot
+*/
+void EmitterPool::emit(int emitter, int count)
+{
+	Emitter& e = emitters_[emitter];
+	const ParticleRules& rules = *e.rules;
+	int room = slotParticles_ - e.count;
+	count = count < room ? count : room;
+
+	if (count <= 0)
+		return;
+
+	int first = emitter * slotParticles_ + e.count;
+	const float spread = rules.spread;
+	if (spread > 0.0f)
+	{
+		m3dRandomFloats(&random_, &x_[first], count, e.emitPos[0] - spread, e.emitPos[0] + spread);
+		m3dRandomFloats(&random_, &z_[first], count, e.emitPos[2] - spread, e.emitPos[2] + spread);
+	}
+	if (rules.speed > 0.0f)
+		m3dRandomUnitVectors3(&random_, &vx_[first], &vy_[first], &vz_[first], count);
+
+	for (int i = first; i < first + count; ++i)
+	{
+		if (spread <= 0.0f)
+		{
+			x_[i] = e.emitPos[0];
+			z_[i] = e.emitPos[2];
+		}
+		y_[i] = e.emitPos[1] + rules.emitHeight;
+
+		if (rules.speed > 0.0f)
+		{
+			vx_[i] = rules.velocity[0] + vx_[i] * rules.speed;
+			vy_[i] = rules.velocity[1] + vy_[i] * rules.speed;
+			vz_[i] = rules.velocity[2] + vz_[i] * rules.speed;
+		}
+		else
+		{
+			vx_[i] = rules.velocity[0];
+			vy_[i] = rules.velocity[1];
+			vz_[i] = rules.velocity[2];
+		}
+		age_[i] = 0.0f;
+	}
+	e.count += count;
+	particlesNo_ += count;
+}
+
+/*
+	Name		EmitterPool::step
+	Syntax		EmitterPool::step(int emitter, float dt)
+	Param		int emitter - A live emitter
+	Param		float dt - Time step
+	Brief		Moves and ages the emitter's particles, and kills those whose
+				lifetime is up
+	Details		The step is exact for a constant acceleration. The unused
+				end of the slot is moved along with the particles, as the
+				slot is a whole number of fours
+*/
+void EmitterPool::step(int emitter, float dt)
+{
+	Emitter& e = emitters_[emitter];
+	const ParticleRules& rules = *e.rules;
+	float dv[3], halfDv[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		dv[axis] = rules.accel[axis] * dt;
+		halfDv[axis] = 0.5f * dv[axis] * dt;
+	}
+
+	float* x = &x_[emitter * slotParticles_];
+	float* y = &y_[emitter * slotParticles_];
+	float* z = &z_[emitter * slotParticles_];
+	float* vx = &vx_[emitter * slotParticles_];
+	float* vy = &vy_[emitter * slotParticles_];
+	float* vz = &vz_[emitter * slotParticles_];
+	float* age = &age_[emitter * slotParticles_];
+
+	int i = 0;
+#ifdef M3D_SSE
+	const int fours = (e.count + 3) & ~3;
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 vdx = _mm_set1_ps(dv[0]), vdy = _mm_set1_ps(dv[1]), vdz = _mm_set1_ps(dv[2]);
+	const __m128 hx = _mm_set1_ps(halfDv[0]), hy = _mm_set1_ps(halfDv[1]),
+				 hz = _mm_set1_ps(halfDv[2]);
+	for (; i < fours; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(vx + i);
+		__m128 py = _mm_loadu_ps(vy + i);
+		__m128 pz = _mm_loadu_ps(vz + i);
+		_mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_add_ps(_mm_mul_ps(px, vdt), hx)));
+		_mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_add_ps(_mm_mul_ps(py, vdt), hy)));
+		_mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), _mm_add_ps(_mm_mul_ps(pz, vdt), hz)));
+		_mm_storeu_ps(vx + i, _mm_add_ps(px, vdx));
+		_mm_storeu_ps(vy + i, _mm_add_ps(py, vdy));
+		_mm_storeu_ps(vz + i, _mm_add_ps(pz, vdz));
+		_mm_storeu_ps(age + i, _mm_add_ps(_mm_loadu_ps(age + i), vdt));
+	}
+#endif
+	for (; i < e.count; ++i)
+	{
+		x[i] += vx[i] * dt + halfDv[0];
+		y[i] += vy[i] * dt + halfDv[1];
+		z[i] += vz[i] * dt + halfDv[2];
+		vx[i] += dv[0];
+		vy[i] += dv[1];
+		vz[i] += dv[2];
+		age[i] += dt;
+	}
+
+	// Few die in a step, so the last particle fills each one's place
+	for (i = 0; i < e.count; )
+	{
+		if (age[i] > rules.lifetime)
+		{
+			int last = --e.count;
+			x[i] = x[last];
+			y[i] = y[last];
+			z[i] = z[last];
+			vx[i] = vx[last];
+			vy[i] = vy[last];
+			vz[i] = vz[last];
+			age[i] = age[last];
+		}
+		else
+		{
+			++i;
+		}
+	}
+}
+
+/*
+	Name		EmitterPool::recycle
+	Syntax		EmitterPool::recycle(int emitter)
+	Param		int emitter - A live emitter with no particles
+	Brief		Frees the emitter's slot, moving the last live emitter into
+				its place in the list
+*/
+void EmitterPool::recycle(int emitter)
+{
+	int n = emitters_[emitter].liveIndex;
+	int last = live_[--liveNo_];
+	live_[n] = last;
+	emitters_[last].liveIndex = n;
+	live_[liveNo_] = emitter;
+	emitters_[emitter].liveIndex = -1;
+	++recycledNo_;
+}
@@ -0,0 +1,105 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		EmitterPool
+	Brief		Definition of the EmitterPool class - many small, short
+				lived emitters simulated on the CPU, such as splashes, kept
+				in storage allocated once
+	Details		Every emitter owns a slot of the same number of particles
+				in one set of separate x, y, z, velocity and age arrays,
+				allocated when the pool is initialised. Spawning an emitter
+				takes a free slot and finishing one gives it back, so
+				emitters come and go without allocating. A spawn is refused
+				when every slot is taken.
+
+				An emitter emits bursts by its rules for its duration, then
+				lives on until the last of its particles has died, and is
+				then recycled. Its particles are moved four at a time with
+				SSE, as ParticleSimulation moves its falling particles, and
+				killed when their lifetime is up by moving the slot's last
+				particle into their place. Pooled emitters neither land
+				nor wrap, and are not blown.
+
+				The live emitters are kept packed at the front of a list,
+				so an update visits only those
+*/
+
+#ifndef EMITTERPOOL_H
+#define EMITTERPOOL_H
+
+#include <vector>
+#include "Maths/math3d.h"
+#include "Maths/m3dRandom.h"
+#include "ParticleSystem/ParticleSimulation.hpp"
+
+class EmitterPool
+{
+public:
+	EmitterPool();
+
+	void initialise(int maxEmitters, int slotParticles, unsigned int seed = 1);
+
+	// The rules are kept by pointer, and must outlive the emitter
+	int spawn(const ParticleRules* rules, const M3DVector3f emitPos, float duration);
+	void stop(int emitter);
+	void clear();
+
+	void update(float dt);
+
+	int getMaxEmitters() const { return (int)emitters_.size(); };
+	int getSlotParticles() const { return slotParticles_; };
+	int getEmittersNo() const { return liveNo_; };
+	int getLiveNo() const { return particlesNo_; };
+	unsigned int getSpawnedNo() const { return spawnedNo_; };
+	unsigned int getRefusedNo() const { return refusedNo_; };
+	unsigned int getRecycledNo() const { return recycledNo_; };
+
+	// The live emitters, and the particles of an emitter's slot
+	int getEmitter(int n) const { return live_[n]; };
+	int getCount(int emitter) const { return emitters_[emitter].count; };
+	const float* getX(int emitter) const { return &x_[emitter * slotParticles_]; };
+	const float* getY(int emitter) const { return &y_[emitter * slotParticles_]; };
+	const float* getZ(int emitter) const { return &z_[emitter * slotParticles_]; };
+	const float* getAge(int emitter) const { return &age_[emitter * slotParticles_]; };
+
+private:
+	/*
+		Name		Emitter
+		Syntax		Emitter
+		Brief		An emitter's state, apart from its particles
+	*/
+	struct Emitter
+	{
+		const ParticleRules* rules;
+		M3DVector3f emitPos;
+		float duration;				// Time left to emit for
+		float emitTime;				// Time since the last burst
+		int count;					// Particles alive in the slot
+		int liveIndex;				// Place in live_, or -1 when free
+	};
+
+	void emit(int emitter, int count);
+	void step(int emitter, float dt);
+	void recycle(int emitter);
+
+	int slotParticles_;
+	unsigned int seed_;
+	M3DRandom random_;
+
+	std::vector<Emitter> emitters_;
+	std::vector<int> live_;				// Live emitters, then free ones
+	int liveNo_;
+	int particlesNo_;
+	unsigned int spawnedNo_;			// Since initialising or clearing
+	unsigned int refusedNo_;
+	unsigned int recycledNo_;
+
+	// Particles, slotParticles_ for each emitter
+	std::vector<float> x_, y_, z_;
+	std::vector<float> vx_, vy_, vz_;
+	std::vector<float> age_;
+};
+
+#endif // EMITTERPOOL_H
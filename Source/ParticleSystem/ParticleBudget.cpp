@@ -0,0 +1,344 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleBudget
+	Brief		Definition of the ParticleBudget class - shares a budget of
+				live particles, and of the time taken to simulate them, out
+				between the particle systems that are running
+*/
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "ParticleSystem/ParticleBudget.hpp"
+
+const float ParticleBudget::FULL_COVERAGE = 0.25f;
+const float ParticleBudget::MIN_SCALE = 0.1f;
+const float ParticleBudget::MAX_SIZE_SCALE = 2.0f;
+const float ParticleBudget::COST_SMOOTHING = 0.1f;
+
+/*
+	Name		ParticleBudget::ParticleBudget
+	Syntax		ParticleBudget()
+	Brief		ParticleBudget constructor, with no systems and no budgets
+*/
+ParticleBudget::ParticleBudget()
+: particleBudget_(0), timeBudget_(0.0f), level_(FLT_MAX), allotted_(0.0f)
+{
+}
+
+/*
+	Name		ParticleBudget::setParticleBudget
+	Syntax		ParticleBudget::setParticleBudget(int particles)
+	Param		int particles - Most particles to keep alive across every
+				system, zero for no limit
+	Brief		Sets the particle count budget
+*/
+void ParticleBudget::setParticleBudget(int particles)
+{
+	particleBudget_ = particles > 0 ? particles : 0;
+}
+
+/*
+	Name		ParticleBudget::setTimeBudget
+	Syntax		ParticleBudget::setTimeBudget(float seconds)
+	Param		float seconds - Most time to spend simulating the particles
+				of every system a frame, zero for no limit
+	Brief		Sets the frame time budget
+	Details		The time is shared out by the cost a particle that each
+				system has reported, so a system yet to report one is not
+				limited by it
+*/
+void ParticleBudget::setTimeBudget(float seconds)
+{
+	timeBudget_ = seconds > 0.0f ? seconds : 0.0f;
+}
+
+/*
+	Name		ParticleBudget::getDemand
+	Syntax		ParticleBudget::getDemand(const ParticleRules& rules,
+				int maxParticles)
+	Param		const ParticleRules& rules - How the system emits and kills
+	Param		int maxParticles - The system's own limit
+	Return		float - Particles the system keeps alive at its full rate
+	Brief		Gets the particles a system asks of the budget
+	Details		Particles that rest on the ground are counted as living for
+				their rest as well as their whole lifetime, which is the
+				most they can
+*/
+float ParticleBudget::getDemand(const ParticleRules& rules, int maxParticles)
+{
+	float life = rules.lifetime;
+	if (rules.impact == IMPACT_SPLASH || rules.impact == IMPACT_SETTLE)
+		life += rules.restTime;
+
+	float demand = rules.emitCount / rules.emitInterval * life;
+	return demand < (float)maxParticles ? demand : (float)maxParticles;
+}
+
+/*
+	Name		ParticleBudget::getVolume
+	Syntax		ParticleBudget::getVolume(const ParticleRules& rules,
+				const M3DVector3f emitPos, M3DVector3f centre, float* radius)
+	Param		const ParticleRules& rules - How the system emits and moves
+	Param		const M3DVector3f emitPos - Where bursts are emitted about
+	Param		M3DVector3f centre - Receives the centre of the volume
+	Param		float* radius - Receives its radius
+	Brief		Gets a sphere around the particles of a system
+	Details		The particles start in the spread about the emitter and
+				drift with the acceleration for their lifetime, so the
+				sphere is centred halfway along that drift and reaches the
+				spread, half the drift and the furthest a starting speed
+				carries them beyond it
+*/
+void ParticleBudget::getVolume(const ParticleRules& rules, const M3DVector3f emitPos,
+							   M3DVector3f centre, float* radius)
+{
+	float t = rules.lifetime;
+	float drift = 0.25f * t * t;
+	centre[0] = emitPos[0] + rules.accel[0] * drift;
+	centre[1] = emitPos[1] + rules.emitHeight + rules.accel[1] * drift;
+	centre[2] = emitPos[2] + rules.accel[2] * drift;
+	*radius = rules.spread * 1.41421356f + m3dGetVectorLength3(rules.accel) * drift +
+			  ParticleSimulation::getTopSpeed(rules) * t;
+}
+
+/*
+	Name		ParticleBudget::addSystem
+	Syntax		ParticleBudget::addSystem(float demand, float priority)
+	Param		float demand - Particles the system keeps alive at its full
+				rate, as getDemand gives it
+	Param		float priority - Multiplies the system's weight
+	Return		int - The system's handle
+	Brief		Registers a system with the budget, at its full rate until
+				the next distribution
+*/
+int ParticleBudget::addSystem(float demand, float priority)
+{
+	int system = 0;
+	while (system < (int)systems_.size() && systems_[system].used)
+		++system;
+	if (system == (int)systems_.size())
+		systems_.push_back(System());
+
+	System& s = systems_[system];
+	s.used = true;
+	s.demand = demand;
+	s.priority = priority;
+	m3dLoadVector3(s.centre, 0.0f, 0.0f, 0.0f);
+	s.radius = 0.0f;
+	s.cost = 0.0f;
+	s.coverage = 1.0f;
+	s.weight = priority;
+	s.lodScale = 1.0f;
+	s.emitScale = 1.0f;
+	s.sizeScale = 1.0f;
+	s.counts.live = 0;
+	s.counts.emitted = 0;
+	s.counts.killed = 0;
+	return system;
+}
+
+/*
+	Name		ParticleBudget::removeSystem
+	Syntax		ParticleBudget::removeSystem(int system)
+	Param		int system - The handle addSystem gave
+	Brief		Takes a system out of the budget, freeing its handle
+*/
+void ParticleBudget::removeSystem(int system)
+{
+	systems_[system].used = false;
+	while (!systems_.empty() && !systems_.back().used)
+		systems_.pop_back();
+}
+
+/*
+	Name		ParticleBudget::setVolume
+	Syntax		ParticleBudget::setVolume(int system, const M3DVector3f centre,
+				float radius)
+	Param		int system - The system's handle
+	Param		const M3DVector3f centre, float radius - A sphere around its
+				particles
+	Brief		Places a system for the next distribution
+*/
+void ParticleBudget::setVolume(int system, const M3DVector3f centre, float radius)
+{
+	m3dCopyVector3(systems_[system].centre, centre);
+	systems_[system].radius = radius;
+}
+
+/*
+	Name		ParticleBudget::setCost
+	Syntax		ParticleBudget::setCost(int system, float seconds, int particles)
+	Param		int system - The system's handle
+	Param		float seconds - Time its last update took
+	Param		int particles - Particles it updated
+	Brief		Measures what a particle of a system costs, against the time
+				budget
+*/
+void ParticleBudget::setCost(int system, float seconds, int particles)
+{
+	if (particles <= 0)
+		return;
+
+	System& s = systems_[system];
+	float cost = seconds / (float)particles;
+	s.cost = s.cost > 0.0f ? s.cost + (cost - s.cost) * COST_SMOOTHING : cost;
+}
+
+/*
+	Name		ParticleBudget::setCounts
+	Syntax		ParticleBudget::setCounts(int system, int live,
+				unsigned int emitted, unsigned int killed)
+	Param		int system - The system's handle
+	Param		int live - Particles it has alive
+	Param		unsigned int emitted, killed - Particles it has emitted and
+				killed since it was reset
+	Brief		Keeps a system's counters with its share
+*/
+void ParticleBudget::setCounts(int system, int live, unsigned int emitted, unsigned int killed)
+{
+	ParticleCounts& counts = systems_[system].counts;
+	counts.live = live;
+	counts.emitted = emitted;
+	counts.killed = killed;
+}
+
+/*
+	Name		ParticleBudget::distribute
+	Syntax		ParticleBudget::distribute(const M3DFrustum& frustum,
+				const M3DVector3f eye, const M3DMatrix44f projection)
+	Param		const M3DFrustum& frustum - The camera's world space frustum
+	Param		const M3DVector3f eye - The camera's position
+	Param		const M3DMatrix44f projection - Its projection matrix
+	Brief		Weighs each system by its screen coverage and shares the
+				budgets out by weight
+	Details		A sphere's coverage is the area of the disc it projects to
+				over the area of the screen, both measured in the units the
+				projection scales y into, the disc's radius being the
+				tangent of the angle the sphere subtends times that scale.
+				It is the whole screen from inside the sphere, and nothing
+				when the sphere is out of view
+*/
+void ParticleBudget::distribute(const M3DFrustum& frustum, const M3DVector3f eye,
+								const M3DMatrix44f projection)
+{
+	const float scaleY = projection[5];
+	const float screenArea = 4.0f * scaleY / projection[0];
+
+	for (int i = 0; i < (int)systems_.size(); ++i)
+	{
+		System& s = systems_[i];
+		if (!s.used)
+			continue;
+
+		M3DVector3f toCentre;
+		m3dSubtractVectors3(toCentre, s.centre, eye);
+		float distanceSq = m3dGetVectorLengthSquared3(toCentre);
+		float radiusSq = s.radius * s.radius;
+		if (distanceSq <= radiusSq)
+		{
+			s.coverage = 1.0f;
+		}
+		else if (!m3dSphereInFrustum(frustum, s.centre, s.radius))
+		{
+			s.coverage = 0.0f;
+		}
+		else
+		{
+			float projected = s.radius * scaleY;
+			float coverage = (float)M3D_PI * projected * projected /
+							 ((distanceSq - radiusSq) * screenArea);
+			s.coverage = coverage < 1.0f ? coverage : 1.0f;
+		}
+
+		s.weight = s.coverage * s.priority;
+		float lod = s.coverage / FULL_COVERAGE;
+		s.lodScale = lod > MIN_SCALE ? (lod < 1.0f ? lod : 1.0f) : MIN_SCALE;
+	}
+
+	level_ = FLT_MAX;
+	if (particleBudget_ > 0)
+		level_ = solveLevel(false, (float)particleBudget_);
+	if (timeBudget_ > 0.0f)
+	{
+		float timed = solveLevel(true, timeBudget_);
+		level_ = timed < level_ ? timed : level_;
+	}
+
+	allotted_ = 0.0f;
+	for (int i = 0; i < (int)systems_.size(); ++i)
+	{
+		System& s = systems_[i];
+		if (!s.used)
+			continue;
+
+		float scale = level_ * s.weight;
+		scale = scale < s.lodScale ? scale : s.lodScale;
+		s.emitScale = scale > MIN_SCALE ? scale : MIN_SCALE;
+		float size = 1.0f / sqrtf(s.emitScale);
+		s.sizeScale = size < MAX_SIZE_SCALE ? size : MAX_SIZE_SCALE;
+		allotted_ += s.emitScale * s.demand;
+	}
+}
+
+/*
+	Name		ParticleBudget::solveLevel
+	Syntax		ParticleBudget::solveLevel(bool timed, float budget)
+	Param		bool timed - Measure the systems' use in time, not particles
+	Param		float budget - The budget to fit in
+	Return		float - The common level, FLT_MAX when nothing need be cut
+	Brief		Finds the level at which the systems use the budget
+	Details		At level L a system emits at its weight times L, kept
+				between MIN_SCALE and its own scale, so its use grows with
+				L from the level it rises off MIN_SCALE until the level it
+				reaches its own scale. The total use is piecewise linear in
+				L, and is walked through those steps in order until it
+				reaches the budget
+*/
+float ParticleBudget::solveLevel(bool timed, float budget)
+{
+	float used = 0.0f;
+	float most = 0.0f;
+	steps_.clear();
+	for (int i = 0; i < (int)systems_.size(); ++i)
+	{
+		const System& s = systems_[i];
+		if (!s.used)
+			continue;
+
+		float use = s.demand * (timed ? s.cost : 1.0f);
+		used += use * MIN_SCALE;
+		most += use * s.lodScale;
+		if (s.weight > 0.0f && s.lodScale > MIN_SCALE)
+		{
+			Step rise = { MIN_SCALE / s.weight, use * s.weight };
+			Step stop = { s.lodScale / s.weight, -use * s.weight };
+			steps_.push_back(rise);
+			steps_.push_back(stop);
+		}
+	}
+
+	if (most <= budget)
+		return FLT_MAX;
+	if (used >= budget)
+		return 0.0f;
+
+	std::sort(steps_.begin(), steps_.end(), stepBefore);
+	float level = 0.0f;
+	float slope = 0.0f;
+	for (int i = 0; i < (int)steps_.size(); ++i)
+	{
+		float next = used + slope * (steps_[i].level - level);
+		if (next >= budget && slope > 0.0f)
+			return level + (budget - used) / slope;
+
+		used = next;
+		level = steps_[i].level;
+		slope += steps_[i].slope;
+	}
+	return level;
+}
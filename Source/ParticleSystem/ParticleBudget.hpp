@@ -0,0 +1,142 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleBudget
+	Brief		Definition of the ParticleBudget class - shares a budget of
+				live particles, and of the time taken to simulate them, out
+				between the particle systems that are running
+	Details		Each system is registered with the particles it keeps alive
+				at its full emission rate and, each frame, the volume its
+				particles fill. A system's weight is how much of the screen
+				that volume covers, so a system close by or around the
+				camera weighs the most, and one behind it the least.
+
+				A system covering less of the screen than FULL_COVERAGE has
+				its emission scaled down with its coverage, whatever the
+				budget. When the systems' particles would still be over the
+				budget, the rates are lowered in order of weight until they
+				fit: each system emits at the lesser of its own scale and a
+				level common to all of them times its weight, the level
+				being found by walking the points at which systems stop
+				being cut. No system is cut below MIN_SCALE, so a system
+				just out of view is still there when the camera turns back.
+
+				Fewer particles are made larger to cover the same area, the
+				size scale being the inverse square root of the emission
+				scale up to MAX_SIZE_SCALE. Both scales are applied as the
+				particles are emitted, so the live particles change over a
+				lifetime rather than all at once.
+
+				The systems report their live, emitted and killed particles
+				to the budget, which keeps them with the share each was given
+*/
+
+#ifndef PARTICLEBUDGET_H
+#define PARTICLEBUDGET_H
+
+#include <vector>
+#include "Maths/math3d.h"
+#include "Maths/m3dCull.h"
+#include "ParticleSystem/ParticleSimulation.hpp"
+
+/*
+	Name		ParticleCounts
+	Syntax		ParticleCounts
+	Brief		Particles a system has alive, and has emitted and killed
+				since it was reset
+*/
+struct ParticleCounts
+{
+	int live;
+	unsigned int emitted;
+	unsigned int killed;
+};
+
+class ParticleBudget
+{
+public:
+	ParticleBudget();
+
+	// Zero leaves either budget unlimited
+	void setParticleBudget(int particles);
+	void setTimeBudget(float seconds);
+
+	// Particles a system with these rules keeps alive, and the sphere its
+	// particles fill when emitted about emitPos
+	static float getDemand(const ParticleRules& rules, int maxParticles);
+	static void getVolume(const ParticleRules& rules, const M3DVector3f emitPos,
+						  M3DVector3f centre, float* radius);
+
+	int addSystem(float demand, float priority = 1.0f);
+	void removeSystem(int system);
+	void setVolume(int system, const M3DVector3f centre, float radius);
+	void setCost(int system, float seconds, int particles);
+	void setCounts(int system, int live, unsigned int emitted, unsigned int killed);
+
+	// Shares the budgets out for the camera looking through projection
+	void distribute(const M3DFrustum& frustum, const M3DVector3f eye,
+					const M3DMatrix44f projection);
+
+	float getEmitScale(int system) const { return systems_[system].emitScale; };
+	float getSizeScale(int system) const { return systems_[system].sizeScale; };
+	float getCoverage(int system) const { return systems_[system].coverage; };
+	const ParticleCounts& getCounts(int system) const { return systems_[system].counts; };
+	int getSystemsNo() const { return (int)systems_.size(); };
+	bool isUsed(int system) const { return systems_[system].used; };
+	float getLevel() const { return level_; };
+	float getAllotted() const { return allotted_; };
+
+	static const float FULL_COVERAGE;	// Screen fraction at which a system is
+										// emitted at its full rate
+	static const float MIN_SCALE;
+	static const float MAX_SIZE_SCALE;
+	static const float COST_SMOOTHING;	// Weight of a new cost measurement
+
+private:
+	/*
+		Name		System
+		Syntax		System
+		Brief		A registered system and the share it was last given
+	*/
+	struct System
+	{
+		bool used;
+		float demand;				// Particles alive at the full rate
+		float priority;
+		M3DVector3f centre;
+		float radius;
+		float cost;					// Seconds a particle, smoothed
+		float coverage;				// Fraction of the screen covered
+		float weight;
+		float lodScale;				// Emission scale the coverage allows
+		float emitScale;
+		float sizeScale;
+		ParticleCounts counts;
+	};
+
+	/*
+		Name		Step
+		Syntax		Step
+		Brief		A level at which a system starts or stops being cut,
+					and the change that makes to how fast its use grows
+	*/
+	struct Step
+	{
+		float level;
+		float slope;
+	};
+
+	static bool stepBefore(const Step& a, const Step& b) { return a.level < b.level; };
+	float solveLevel(bool timed, float budget);
+
+	std::vector<System> systems_;
+	std::vector<Step> steps_;
+	int particleBudget_;
+	float timeBudget_;
+	float level_;						// Common level of the last distribution
+	float allotted_;					// Particles it gave out
+};
+
+#endif
@@ -0,0 +1,271 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleEffect
+	Brief		Implementation of the ParticleEffect class
+*/
+
+#include "ParticleSystem/ParticleEffect.hpp"
+#include <windows.h>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	/*
+		Name		trim
+		Syntax		trim(const std::string& text)
+		Param		const std::string& text - Text to trim
+		Return		std::string - The text without leading or trailing
+					spaces, tabs or carriage returns
+	*/
+	std::string trim(const std::string& text)
+	{
+		const char* SPACE = " \t\r";
+		std::string::size_type first = text.find_first_not_of(SPACE);
+		if (first == std::string::npos)
+			return std::string();
+		return text.substr(first, text.find_last_not_of(SPACE) - first + 1);
+	}
+}
+
+/*
+	Name		ParticleEffect::ParticleEffect
+	Syntax		ParticleEffect()
+	Brief		ParticleEffect constructor, describing a still particle
+				emitted each second and living a second, with no effect
+				file or textures
+*/
+ParticleEffect::ParticleEffect()
+: maxParticles_(1)
+{
+	m3dLoadVector3(rules_.accel, 0.0f, 0.0f, 0.0f);
+	rules_.emitInterval = 1.0f;
+	rules_.emitCount = 1;
+	rules_.spread = 0.0f;
+	rules_.emitHeight = 0.0f;
+	m3dLoadVector3(rules_.velocity, 0.0f, 0.0f, 0.0f);
+	rules_.speed = 0.0f;
+	rules_.lifetime = 1.0f;
+	rules_.impact = IMPACT_NONE;
+	rules_.restTime = 0.0f;
+	rules_.windDrag = 0.0f;
+	rules_.size = 1.0f;
+	rules_.sizeGrowth = 1.0f;
+	rules_.textureFirst = 0;
+	rules_.textureCount = 1;
+}
+
+/*
+	Name		ParticleEffect::ParticleEffect
+	Syntax		ParticleEffect(Particle particle)
+	Param		Particle particle - A built in particle type
+	Brief		ParticleEffect constructor, describing a built in type as
+				its season draws it
+*/
+ParticleEffect::ParticleEffect(Particle particle)
+{
+	ParticleSimulation::getRules(particle, &rules_);
+	switch (particle)
+	{
+	case PARTICLE_LEAVES:
+		effectFile_ = "Effect Files/Leaves.fx";
+		textures_.push_back("Assets/2D Textures/tumbling_leaf.dds");
+		maxParticles_ = 1000;
+		break;
+	case PARTICLE_SNOW:
+		effectFile_ = "Effect Files/Snow.fx";
+		textures_.push_back("Assets/2D Textures/snowflake.dds");
+		maxParticles_ = 100000;
+		break;
+	default:
+		effectFile_ = "Effect Files/Rain.fx";
+		textures_.push_back("Assets/2D Textures/raindrop.dds");
+		maxParticles_ = 50000;
+		break;
+	}
+}
+
+/*
+	Name		ParticleEffect::load
+	Syntax		ParticleEffect::load(const std::string& fileName)
+	Param		const std::string& fileName - The description file
+	Return		bool - True if the file was read and describes a system that
+				can be run
+	Brief		Loads a description from file, over the current one
+	Details		The textures are replaced by those in the file, if it gives
+				any
+*/
+bool ParticleEffect::load(const std::string& fileName)
+{
+	std::ifstream inFile(fileName.c_str());
+	if (!inFile)
+	{
+		MessageBox(0, ("Opening particle effect " + fileName + " - Failed").c_str(), "Error",
+				   MB_OK);
+		return false;
+	}
+
+	std::vector<std::string> textures;
+	std::string line;
+	int lineNo = 0;
+	while (std::getline(inFile, line))
+	{
+		++lineNo;
+		line = trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		std::string::size_type split = line.find_first_of(" \t");
+		std::string name = line.substr(0, split);
+		std::string values = split == std::string::npos ? std::string() : trim(line.substr(split));
+		if (name == "Texture")
+		{
+			textures.push_back(values);
+		}
+		else if (values.empty() || !read(name, values))
+		{
+			std::ostringstream message;
+			message << "Reading " << fileName << " line " << lineNo << " - Failed";
+			MessageBox(0, message.str().c_str(), "Error", MB_OK);
+			return false;
+		}
+	}
+
+	if (!textures.empty())
+		textures_.swap(textures);
+
+	if (!check())
+	{
+		MessageBox(0, ("Checking particle effect " + fileName + " - Failed").c_str(), "Error",
+				   MB_OK);
+		return false;
+	}
+	return true;
+}
+
+/*
+	Name		ParticleEffect::read
+	Syntax		ParticleEffect::read(const std::string& name,
+				const std::string& values)
+	Param		const std::string& name - The setting's name
+	Param		const std::string& values - Its values
+	Return		bool - True if the name is known and its values read whole
+	Brief		Reads one setting of a description file
+*/
+bool ParticleEffect::read(const std::string& name, const std::string& values)
+{
+	if (name == "Effect")
+	{
+		effectFile_ = values;
+		return true;
+	}
+
+	std::istringstream in(values);
+	if (name == "MaxParticles")
+	{
+		in >> maxParticles_;
+	}
+	else if (name == "Accel")
+	{
+		in >> rules_.accel[0] >> rules_.accel[1] >> rules_.accel[2];
+	}
+	else if (name == "EmitInterval")
+	{
+		in >> rules_.emitInterval;
+	}
+	else if (name == "EmitCount")
+	{
+		in >> rules_.emitCount;
+	}
+	else if (name == "Spread")
+	{
+		in >> rules_.spread;
+	}
+	else if (name == "EmitHeight")
+	{
+		in >> rules_.emitHeight;
+	}
+	else if (name == "Velocity")
+	{
+		in >> rules_.velocity[0] >> rules_.velocity[1] >> rules_.velocity[2];
+	}
+	else if (name == "Speed")
+	{
+		in >> rules_.speed;
+	}
+	else if (name == "Lifetime")
+	{
+		in >> rules_.lifetime;
+	}
+	else if (name == "Impact")
+	{
+		std::string impact;
+		in >> impact;
+		if (impact == "none")
+			rules_.impact = IMPACT_NONE;
+		else if (impact == "kill")
+			rules_.impact = IMPACT_KILL;
+		else if (impact == "splash")
+			rules_.impact = IMPACT_SPLASH;
+		else if (impact == "settle")
+			rules_.impact = IMPACT_SETTLE;
+		else
+			return false;
+	}
+	else if (name == "RestTime")
+	{
+		in >> rules_.restTime;
+	}
+	else if (name == "WindDrag")
+	{
+		in >> rules_.windDrag;
+	}
+	else if (name == "Size")
+	{
+		in >> rules_.size;
+	}
+	else if (name == "SizeGrowth")
+	{
+		in >> rules_.sizeGrowth;
+	}
+	else if (name == "TextureFirst")
+	{
+		in >> rules_.textureFirst;
+	}
+	else if (name == "TextureCount")
+	{
+		in >> rules_.textureCount;
+	}
+	else
+	{
+		return false;
+	}
+
+	// Nothing may be left over, nor fail to read
+	std::string rest;
+	return !in.fail() && !(in >> rest);
+}
+
+/*
+	Name		ParticleEffect::check
+	Syntax		ParticleEffect::check()
+	Return		bool - True if the description can be run
+	Brief		Checks the rules emit and kill particles, and that the
+				texture slices they draw with are in the array
+*/
+bool ParticleEffect::check() const
+{
+	if (maxParticles_ < 1 || rules_.emitInterval <= 0.0f || rules_.emitCount < 1 ||
+		rules_.lifetime <= 0.0f || rules_.restTime < 0.0f || rules_.spread < 0.0f ||
+		rules_.speed < 0.0f || rules_.windDrag < 0.0f || rules_.size <= 0.0f ||
+		rules_.sizeGrowth < 0.0f)
+		return false;
+
+	if (rules_.textureFirst < 0 || rules_.textureCount < 1)
+		return false;
+	return textures_.empty() ||
+		   rules_.textureFirst + rules_.textureCount <= (int)textures_.size();
+}
@@ -0,0 +1,74 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleEffect
+	Brief		Definition of the ParticleEffect class - a description of a
+				particle system, loaded from a file or built in
+	Details		The description gives the effect file the system is drawn
+				with, the textures of its texture array, its budget and the
+				rules it emits, moves, draws and kills its particles by. The
+				effect files take the rules as variables, so one effect file
+				serves every system drawn the same way, and a new system
+				needs only a new description.
+
+				A description file has one setting a line, a name followed
+				by its values, and lines starting with # are comments:
+
+				Effect			Effect Files/Snow.fx
+				Texture			Assets/2D Textures/snowflake.dds
+				MaxParticles	100000
+				Accel			0.025 -0.4 -0.05
+				EmitInterval	0.01
+				EmitCount		5
+				Spread			50
+				EmitHeight		25
+				Velocity		0 0 0
+				Speed			1.5
+				Lifetime		15
+				Impact			settle
+				RestTime		3
+				WindDrag		0.8
+				Size			0.05
+				SizeGrowth		1
+				TextureFirst	0
+				TextureCount	1
+
+				Texture may be given more than once, for each slice of the
+				array, and settings left out keep those of a still, single
+				particle a second, living a second
+*/
+
+#ifndef PARTICLEEFFECT_H
+#define PARTICLEEFFECT_H
+
+#include <string>
+#include <vector>
+#include "ParticleSystem/ParticleSimulation.hpp"
+#include "ParticleSystem/Particle.hpp"
+
+class ParticleEffect
+{
+public:
+	ParticleEffect();
+	explicit ParticleEffect(Particle particle);
+
+	bool load(const std::string& fileName);
+
+	const std::string& getEffectFile() const { return effectFile_; };
+	const std::vector<std::string>& getTextures() const { return textures_; };
+	int getMaxParticles() const { return maxParticles_; };
+	const ParticleRules& getRules() const { return rules_; };
+
+private:
+	bool read(const std::string& name, const std::string& values);
+	bool check() const;
+
+	std::string effectFile_;
+	std::vector<std::string> textures_;
+	int maxParticles_;
+	ParticleRules rules_;
+};
+
+#endif // PARTICLEEFFECT_H
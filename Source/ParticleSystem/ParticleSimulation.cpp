@@ -0,0 +1,814 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleSimulation
+	Brief		Implementation of the ParticleSimulation class
+*/
+
+#include "ParticleSystem/ParticleSimulation.hpp"
+#include <math.h>
+#include <float.h>
+#include "Maths/m3dSIMD.h"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	const float RAIN_SPLASH_TIME = 0.15f;
+	const float SNOW_SETTLE_TIME = 3.0f;
+	const float LEAVES_SETTLE_TIME = 6.0f;
+}
+
+/*
+	Name		ParticleSimulation::ParticleSimulation
+	Syntax		ParticleSimulation()
+	Brief		ParticleSimulation constructor
+*/
+ParticleSimulation::ParticleSimulation()
+: maxParticles_(0), seed_(1), emitScale_(1.0f), emitTime_(0.0f), ground_(0),
+  wind_(0), windSpeed_(0.0f),
+  boundsAcross_(0), boundsDown_(0), boundTime_(0.0f), lookupsNo_(0), emittedNo_(0), killedNo_(0),
+  recycledNo_(0), wrapping_(false), wrapDepth_(0.0f), wrapRise_(0.0f), wrapTarget_(0),
+  fallingNo_(0), clock_(0.0), restFirst_(0), restingNo_(0)
+{
+	getRules(PARTICLE_RAIN, &rules_);
+	m3dLoadVector3(emitPos_, 0.0f, 0.0f, 0.0f);
+	m3dSeedRandom(&random_, seed_, 0);
+}
+
+/*
+	Name		ParticleSimulation::getRules
+	Syntax		ParticleSimulation::getRules(Particle particle,
+				ParticleRules* rules)
+	Param		Particle particle - The type of particle
+	Param		ParticleRules* rules - Receives the rules of its effect file
+	Brief		Gets the rules a particle type's effect file simulates by,
+				with what becomes of its particles on the ground
+*/
+void ParticleSimulation::getRules(Particle particle, ParticleRules* rules)
+{
+	switch (particle)
+	{
+	case PARTICLE_LEAVES:
+		m3dLoadVector3(rules->accel, 0.75f, -0.5f, -0.25f);
+		rules->emitInterval = 0.5f;
+		rules->emitCount = 3;
+		rules->spread = 0.0f;
+		rules->emitHeight = 0.0f;
+		m3dLoadVector3(rules->velocity, 0.0f, 0.0f, 0.0f);
+		rules->speed = 5.0f;
+		rules->lifetime = 20.0f;
+		rules->impact = IMPACT_SETTLE;
+		rules->restTime = LEAVES_SETTLE_TIME;
+		rules->windDrag = 1.5f;
+		rules->size = 2.5f;
+		rules->sizeGrowth = 1.0f;
+		rules->textureFirst = 0;
+		rules->textureCount = 1;
+		break;
+	case PARTICLE_SNOW:
+		m3dLoadVector3(rules->accel, 0.025f, -0.4f, -0.05f);
+		rules->emitInterval = 0.01f;
+		rules->emitCount = 5;
+		rules->spread = 50.0f;
+		rules->emitHeight = 25.0f;
+		m3dLoadVector3(rules->velocity, 0.0f, 0.0f, 0.0f);
+		rules->speed = 1.5f;
+		rules->lifetime = 15.0f;
+		rules->impact = IMPACT_SETTLE;
+		rules->restTime = SNOW_SETTLE_TIME;
+		rules->windDrag = 0.8f;
+		rules->size = 0.05f;
+		rules->sizeGrowth = 1.0f;
+		rules->textureFirst = 0;
+		rules->textureCount = 1;
+		break;
+	default:
+		m3dLoadVector3(rules->accel, -1.0f, -9.8f, 0.0f);
+		rules->emitInterval = 0.008f;
+		rules->emitCount = 5;
+		rules->spread = 50.0f;
+		rules->emitHeight = 30.0f;
+		m3dLoadVector3(rules->velocity, 0.0f, 0.0f, 0.0f);
+		rules->speed = 0.0f;
+		rules->lifetime = 4.0f;
+		rules->impact = IMPACT_SPLASH;
+		rules->restTime = RAIN_SPLASH_TIME;
+		rules->windDrag = 0.2f;
+		rules->size = 1.0f;
+		rules->sizeGrowth = 1.0f;
+		rules->textureFirst = 0;
+		rules->textureCount = 1;
+		break;
+	}
+}
+
+/*
+	Name		ParticleSimulation::getTopSpeed
+	Syntax		ParticleSimulation::getTopSpeed(const ParticleRules& rules)
+	Param		const ParticleRules& rules - How the particles are emitted
+	Return		float - The fastest a particle can start
+*/
+float ParticleSimulation::getTopSpeed(const ParticleRules& rules)
+{
+	return m3dGetVectorLength3(rules.velocity) + rules.speed;
+}
+
+/*
+	Name		ParticleSimulation::getWrapBox
+	Syntax		ParticleSimulation::getWrapBox(const ParticleRules& rules,
+				float* depth, float* rise)
+	Param		const ParticleRules& rules - How the particles move
+	Param		float* depth - Receives the depth of the wrapping box, below
+				where bursts start
+	Param		float* rise - Receives the highest a starting speed carries a
+				particle above that
+	Brief		Gets the box a wrapping system's particles are kept in
+	Details		Deep enough for a particle to fall for its lifetime, and
+				high enough for one emitted upwards to rise
+*/
+void ParticleSimulation::getWrapBox(const ParticleRules& rules, float* depth, float* rise)
+{
+	float t = rules.lifetime;
+	float fall = fabsf(rules.accel[1]);
+	float speed = getTopSpeed(rules);
+	*depth = 0.5f * fall * t * t + speed * t;
+	*rise = fall > 0.0f ? 0.5f * speed * speed / fall : speed * t;
+}
+
+/*
+	Name		ParticleSimulation::initialise
+	Syntax		ParticleSimulation::initialise(const ParticleRules& rules,
+				int maxParticles, unsigned int seed)
+	Param		const ParticleRules& rules - How the particles behave
+	Param		int maxParticles - Most particles alive at once, falling and
+				resting together
+	Param		unsigned int seed - Seed of the random numbers, so that runs
+				can be repeated
+	Brief		Initialises the simulation with no particles
+*/
+void ParticleSimulation::initialise(const ParticleRules& rules, int maxParticles,
+									unsigned int seed)
+{
+	rules_ = rules;
+	maxParticles_ = maxParticles;
+	seed_ = seed;
+
+	x_.resize(maxParticles);
+	y_.resize(maxParticles);
+	z_.resize(maxParticles);
+	vx_.resize(maxParticles);
+	vy_.resize(maxParticles);
+	vz_.resize(maxParticles);
+	age_.resize(maxParticles);
+	checkY_.resize(maxParticles);
+	checkAge_.resize(maxParticles);
+	picked_.resize(maxParticles);
+	lookupX_.resize(maxParticles);
+	lookupZ_.resize(maxParticles);
+	groundY_.resize(maxParticles);
+	restX_.resize(maxParticles * 2);
+	restY_.resize(maxParticles * 2);
+	restZ_.resize(maxParticles * 2);
+	restUntil_.resize(maxParticles * 2);
+
+	// One left a box's depth above its top would take as long to fall back
+	// in as one recycled at the top
+	getWrapBox(rules, &wrapDepth_, &wrapRise_);
+
+	// The bounds depend on how fast the particles move
+	reset();
+	setGround(ground_);
+}
+
+/*
+	Name		ParticleSimulation::setEmitPos
+	Syntax		ParticleSimulation::setEmitPos(const M3DVector3f emitPos)
+	Param		const M3DVector3f emitPos - Where bursts are emitted about
+	Brief		Moves the emitter, as ParticleSystem::setEmitPos does
+*/
+void ParticleSimulation::setEmitPos(const M3DVector3f emitPos)
+{
+	m3dCopyVector3(emitPos_, emitPos);
+}
+
+/*
+	Name		ParticleSimulation::setEmitScale
+	Syntax		ParticleSimulation::setEmitScale(float emitScale)
+	Param		float emitScale - Fraction of the rules' burst rate to emit
+				at, as a ParticleBudget gives it
+	Brief		Slows or stops the emission, leaving the live particles be
+*/
+void ParticleSimulation::setEmitScale(float emitScale)
+{
+	emitScale_ = emitScale > 0.0f ? emitScale : 0.0f;
+}
+
+/*
+	Name		ParticleSimulation::setWrapping
+	Syntax		ParticleSimulation::setWrapping(bool wrapping)
+	Param		bool wrapping - Wrap the particles in a box about the emitter
+	Brief		Turns wrapping on or off
+	Details		Only a system spread over an area wraps, as the box is the
+				area its bursts start in
+*/
+void ParticleSimulation::setWrapping(bool wrapping)
+{
+	wrapping_ = wrapping && rules_.spread > 0.0f;
+}
+
+/*
+	Name		ParticleSimulation::setWind
+	Syntax		ParticleSimulation::setWind(const M3DVectorField* wind,
+				float maxSpeed)
+	Param		const M3DVectorField* wind - The wind's velocity, or 0 for
+				still air
+	Param		float maxSpeed - The fastest it blows anywhere
+	Brief		Sets the wind the falling particles are blown by
+	Details		The field is kept by pointer and may change between updates
+				as long as it is no faster than maxSpeed
+*/
+void ParticleSimulation::setWind(const M3DVectorField* wind, float maxSpeed)
+{
+	wind_ = wind;
+	float speed = wind ? maxSpeed : 0.0f;
+	if (speed != windSpeed_)
+	{
+		windSpeed_ = speed;
+		setGround(ground_);
+	}
+}
+
+/*
+	Name		ParticleSimulation::setGround
+	Syntax		ParticleSimulation::setGround(const M3DHeightField* ground)
+	Param		const M3DHeightField* ground - The ground particles land on,
+				or 0 to let them fall through
+	Brief		Sets the height field the particles are collided with
+	Details		The field must be set again if its heights or placing change.
+				Its heights are taken to grow upwards, with a positive
+				heightScale
+*/
+void ParticleSimulation::setGround(const M3DHeightField* ground)
+{
+	ground_ = ground;
+	groundBounds_.clear();
+	groundRises_.clear();
+	boundsAcross_ = boundsDown_ = 0;
+	if (!ground)
+		return;
+
+	// A block's side in world units, along the axis the grid is finest
+	const float* m = ground->toGrid;
+	float scaleX = sqrtf(m[0] * m[0] + m[1] * m[1]);
+	float scaleZ = sqrtf(m[3] * m[3] + m[4] * m[4]);
+	float reach = (float)BOUND_SAMPLES / (scaleX > scaleZ ? scaleX : scaleZ);
+
+	// No particle moves across faster than it can by the end of its life,
+	// nor, being blown, faster than that and the wind together
+	float accel = sqrtf(rules_.accel[0] * rules_.accel[0] + rules_.accel[2] * rules_.accel[2]);
+	float speed = getTopSpeed(rules_) + accel * rules_.lifetime + windSpeed_;
+	boundTime_ = speed > 0.0f ? reach / speed : FLT_MAX;
+
+	// The highest sample and steepest step between samples of each block
+	// of quads
+	const int width = ground->width;
+	boundsAcross_ = (ground->width - 2) / BOUND_SAMPLES + 1;
+	boundsDown_ = (ground->depth - 2) / BOUND_SAMPLES + 1;
+	std::vector<float> highest(boundsAcross_ * boundsDown_, -FLT_MAX);
+	std::vector<float> steepest(boundsAcross_ * boundsDown_, 0.0f);
+	for (int j = 0; j < ground->depth - 1; ++j)
+	{
+		for (int i = 0; i < width - 1; ++i)
+		{
+			const float* h = ground->heights + j * width + i;
+			float top = h[0] > h[1] ? h[0] : h[1];
+			float bottom = h[width] > h[width + 1] ? h[width] : h[width + 1];
+			top = top > bottom ? top : bottom;
+
+			float step = fabsf(h[1] - h[0]);
+			float stepZ = fabsf(h[width] - h[0]);
+			step = stepZ > step ? stepZ : step;
+			stepZ = fabsf(h[width + 1] - h[1]);
+			step = stepZ > step ? stepZ : step;
+			stepZ = fabsf(h[width + 1] - h[width]);
+			step = stepZ > step ? stepZ : step;
+
+			int block = (j / BOUND_SAMPLES) * boundsAcross_ + i / BOUND_SAMPLES;
+			highest[block] = top > highest[block] ? top : highest[block];
+			steepest[block] = step > steepest[block] ? step : steepest[block];
+		}
+	}
+
+	// Then the same over each block and the eight around it, where a
+	// particle stays until it is looked up again. Moving a distance across
+	// crosses at most root two times as many samples, along both axes
+	// together, and the ground rises at most the steepest step for each
+	float riseScale = ground->heightScale * 1.4142136f * (scaleX > scaleZ ? scaleX : scaleZ) *
+					  speed;
+	groundBounds_.resize(highest.size());
+	groundRises_.resize(highest.size());
+	for (int z = 0; z < boundsDown_; ++z)
+	{
+		for (int x = 0; x < boundsAcross_; ++x)
+		{
+			float top = -FLT_MAX, step = 0.0f;
+			for (int nz = z - 1; nz <= z + 1; ++nz)
+			{
+				for (int nx = x - 1; nx <= x + 1; ++nx)
+				{
+					if (nx < 0 || nz < 0 || nx >= boundsAcross_ || nz >= boundsDown_)
+						continue;
+					int block = nz * boundsAcross_ + nx;
+					top = highest[block] > top ? highest[block] : top;
+					step = steepest[block] > step ? steepest[block] : step;
+				}
+			}
+			groundBounds_[z * boundsAcross_ + x] = top * ground->heightScale + ground->heightOffset;
+			groundRises_[z * boundsAcross_ + x] = step * riseScale;
+		}
+	}
+
+	// Have every falling particle looked up afresh
+	for (int i = 0; i < fallingNo_; ++i)
+		checkAge_[i] = 0.0f;
+}
+
+/*
+	Name		ParticleSimulation::reset
+	Syntax		ParticleSimulation::reset()
+	Brief		Kills every particle and restarts the random numbers
+*/
+void ParticleSimulation::reset()
+{
+	fallingNo_ = 0;
+	restFirst_ = 0;
+	restingNo_ = 0;
+	lookupsNo_ = 0;
+	emittedNo_ = 0;
+	killedNo_ = 0;
+	recycledNo_ = 0;
+	clock_ = 0.0;
+	emitTime_ = 0.0f;
+	m3dSeedRandom(&random_, seed_, 0);
+}
+
+/*
+	Name		ParticleSimulation::update
+	Syntax		ParticleSimulation::update(float dt)
+	Param		float dt - Change in time between frames
+	Brief		Emits, moves, lands and kills the particles
+*/
+void ParticleSimulation::update(float dt)
+{
+	PROFILE_ZONE("ParticleSimulation::update");
+
+	if (maxParticles_ == 0)
+		return;
+
+	if (wrapping_)
+	{
+		float target = rules_.emitCount / rules_.emitInterval * rules_.lifetime * emitScale_;
+		wrapTarget_ = target < (float)maxParticles_ ? (int)target : maxParticles_;
+	}
+
+	clock_ += dt;
+	ageResting();
+	if (wind_)
+		blowFalling(dt);
+	retire(integrate(dt));
+
+	emitTime_ += dt * emitScale_;
+	int bursts = (int)(emitTime_ / rules_.emitInterval);
+	emitTime_ -= bursts * rules_.emitInterval;
+	if (bursts > 0)
+		emit(bursts * rules_.emitCount);
+}
+
+/*
+	Name		ParticleSimulation::emit
+	Syntax		ParticleSimulation::emit(int count)
+	Param		int count - Particles to emit
+	Brief		Emits as many of count particles as there is room for
+	Details		The spread and direction are random as the effect files make
+				them, drawn in batches straight into the new particles: the
+				spread uniform over the square about the emitter, and the
+				direction uniform over the sphere
+*/
+void ParticleSimulation::emit(int count)
+{
+	int room = maxParticles_ - fallingNo_ - restingNo_;
+	if (wrapping_ && wrapTarget_ - fallingNo_ < room)
+		room = wrapTarget_ - fallingNo_;
+	count = count < room ? count : room;
+	if (count <= 0)
+		return;
+	emittedNo_ += count;
+
+	int first = fallingNo_;
+	fallingNo_ += count;
+
+	const float spread = rules_.spread;
+	if (spread > 0.0f)
+	{
+		m3dRandomFloats(&random_, &x_[first], count, emitPos_[0] - spread, emitPos_[0] + spread);
+		m3dRandomFloats(&random_, &z_[first], count, emitPos_[2] - spread, emitPos_[2] + spread);
+	}
+	if (rules_.speed > 0.0f)
+		m3dRandomUnitVectors3(&random_, &vx_[first], &vy_[first], &vz_[first], count);
+
+	for (int i = first; i < fallingNo_; ++i)
+	{
+		if (spread <= 0.0f)
+		{
+			x_[i] = emitPos_[0];
+			z_[i] = emitPos_[2];
+		}
+		y_[i] = emitPos_[1] + rules_.emitHeight;
+
+		if (rules_.speed > 0.0f)
+		{
+			vx_[i] = rules_.velocity[0] + vx_[i] * rules_.speed;
+			vy_[i] = rules_.velocity[1] + vy_[i] * rules_.speed;
+			vz_[i] = rules_.velocity[2] + vz_[i] * rules_.speed;
+		}
+		else
+		{
+			vx_[i] = rules_.velocity[0];
+			vy_[i] = rules_.velocity[1];
+			vz_[i] = rules_.velocity[2];
+		}
+
+		age_[i] = 0.0f;
+		checkY_[i] = -FLT_MAX;
+		checkAge_[i] = 0.0f;
+	}
+}
+
+/*
+	Name		ParticleSimulation::integrate
+	Syntax		ParticleSimulation::integrate(float dt)
+	Param		float dt - Time step
+	Return		int - Number of particles picked
+	Brief		Moves and ages the falling particles, and picks out, in
+				order into picked_, those that have grown too old or whose
+				ground must be looked up
+	Details		The step is exact for a constant acceleration, so the path
+				is the one the effect files work out from the age. The
+				particles are moved and tested in the same pass, and the
+				picks are kept without branching, as they are too scattered
+				for branches to be guessed well.
+
+				When wrapping, a particle that has left the box across x or
+				z is moved by whole box widths back into it, and looked up
+				again as it is over new ground. Those that have fallen out
+				of its bottom, or been left a box's depth above its top,
+				are picked to be recycled
+*/
+int ParticleSimulation::integrate(float dt)
+{
+	const bool landing = ground_ && rules_.impact != IMPACT_NONE;
+	const bool wrapping = wrapping_;
+	const float lifetime = rules_.lifetime;
+	const float size = 2.0f * rules_.spread;
+	const float invSize = wrapping ? 1.0f / size : 0.0f;
+	const float bottom = emitPos_[1] + rules_.emitHeight - wrapDepth_;
+	const float top = emitPos_[1] + rules_.emitHeight + wrapRise_ + wrapDepth_;
+	float dv[3], halfDv[3];
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		dv[axis] = rules_.accel[axis] * dt;
+		halfDv[axis] = 0.5f * dv[axis] * dt;
+	}
+
+	int count = 0;
+	int i = 0;
+#ifdef M3D_SSE
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 vdx = _mm_set1_ps(dv[0]), vdy = _mm_set1_ps(dv[1]), vdz = _mm_set1_ps(dv[2]);
+	const __m128 hx = _mm_set1_ps(halfDv[0]), hy = _mm_set1_ps(halfDv[1]),
+				 hz = _mm_set1_ps(halfDv[2]);
+	const __m128 vlifetime = _mm_set1_ps(lifetime);
+	const __m128 cx = _mm_set1_ps(emitPos_[0]), cz = _mm_set1_ps(emitPos_[2]);
+	const __m128 vsize = _mm_set1_ps(size), vinvSize = _mm_set1_ps(invSize);
+	const __m128 vbottom = _mm_set1_ps(bottom), vtop = _mm_set1_ps(top);
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= fallingNo_; i += 4)
+	{
+		__m128 vx = _mm_loadu_ps(&vx_[i]);
+		__m128 vy = _mm_loadu_ps(&vy_[i]);
+		__m128 vz = _mm_loadu_ps(&vz_[i]);
+		__m128 x = _mm_add_ps(_mm_loadu_ps(&x_[i]), _mm_add_ps(_mm_mul_ps(vx, vdt), hx));
+		__m128 y = _mm_add_ps(_mm_loadu_ps(&y_[i]), _mm_add_ps(_mm_mul_ps(vy, vdt), hy));
+		__m128 z = _mm_add_ps(_mm_loadu_ps(&z_[i]), _mm_add_ps(_mm_mul_ps(vz, vdt), hz));
+		__m128 age = _mm_add_ps(_mm_loadu_ps(&age_[i]), vdt);
+		__m128 pick = _mm_cmpgt_ps(age, vlifetime);
+
+		if (wrapping)
+		{
+			// Whole widths out, rounded to nearest by the default rounding
+			// mode
+			__m128 tx = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(x, cx), vinvSize)));
+			__m128 tz = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(z, cz), vinvSize)));
+			x = _mm_sub_ps(x, _mm_mul_ps(tx, vsize));
+			z = _mm_sub_ps(z, _mm_mul_ps(tz, vsize));
+
+			__m128 moved = _mm_or_ps(_mm_cmpneq_ps(tx, zero), _mm_cmpneq_ps(tz, zero));
+			_mm_storeu_ps(&checkAge_[i], _mm_andnot_ps(moved, _mm_loadu_ps(&checkAge_[i])));
+			pick = _mm_or_ps(pick, _mm_or_ps(_mm_cmplt_ps(y, vbottom), _mm_cmpgt_ps(y, vtop)));
+		}
+
+		_mm_storeu_ps(&x_[i], x);
+		_mm_storeu_ps(&y_[i], y);
+		_mm_storeu_ps(&z_[i], z);
+		_mm_storeu_ps(&vx_[i], _mm_add_ps(vx, vdx));
+		_mm_storeu_ps(&vy_[i], _mm_add_ps(vy, vdy));
+		_mm_storeu_ps(&vz_[i], _mm_add_ps(vz, vdz));
+		_mm_storeu_ps(&age_[i], age);
+
+		if (landing)
+		{
+			pick = _mm_or_ps(pick, _mm_cmple_ps(y, _mm_loadu_ps(&checkY_[i])));
+			pick = _mm_or_ps(pick, _mm_cmpge_ps(age, _mm_loadu_ps(&checkAge_[i])));
+		}
+
+		// Every lane is written, but only those picked are kept
+		int mask = _mm_movemask_ps(pick);
+		for (int lane = 0; lane < 4; ++lane)
+		{
+			picked_[count] = i + lane;
+			count += (mask >> lane) & 1;
+		}
+	}
+#endif
+	for (; i < fallingNo_; ++i)
+	{
+		x_[i] += vx_[i] * dt + halfDv[0];
+		y_[i] += vy_[i] * dt + halfDv[1];
+		z_[i] += vz_[i] * dt + halfDv[2];
+		vx_[i] += dv[0];
+		vy_[i] += dv[1];
+		vz_[i] += dv[2];
+		age_[i] += dt;
+
+		int pick = age_[i] > lifetime;
+		if (wrapping)
+		{
+			float tx = floorf((x_[i] - emitPos_[0]) * invSize + 0.5f);
+			float tz = floorf((z_[i] - emitPos_[2]) * invSize + 0.5f);
+			x_[i] -= tx * size;
+			z_[i] -= tz * size;
+			if (tx != 0.0f || tz != 0.0f)
+				checkAge_[i] = 0.0f;
+			pick |= (y_[i] < bottom) | (y_[i] > top);
+		}
+		if (landing)
+			pick |= (y_[i] <= checkY_[i]) | (age_[i] >= checkAge_[i]);
+		picked_[count] = i;
+		count += pick;
+	}
+	return count;
+}
+
+/*
+	Name		ParticleSimulation::retire
+	Syntax		ParticleSimulation::retire(int pickedNo)
+	Param		int pickedNo - Number of particles integrate picked
+	Brief		Kills the picked particles that are too old, looks up the
+				ground below the rest, and kills or sets down to rest those
+				that have reached it
+	Details		When wrapping, those that would be killed, and those that
+				have left the bottom or top of the box, are recycled instead
+*/
+void ParticleSimulation::retire(int pickedNo)
+{
+	lookupsNo_ = 0;
+	const bool landing = ground_ && rules_.impact != IMPACT_NONE;
+	if (landing)
+	{
+		for (int n = 0; n < pickedNo; ++n)
+		{
+			lookupX_[n] = x_[picked_[n]];
+			lookupZ_[n] = z_[picked_[n]];
+		}
+		m3dSampleHeights(ground_, &lookupX_[0], &lookupZ_[0], &groundY_[0], pickedNo);
+		lookupsNo_ = pickedNo;
+	}
+
+	const float bottom = emitPos_[1] + rules_.emitHeight - wrapDepth_;
+	const float top = emitPos_[1] + rules_.emitHeight + wrapRise_ + wrapDepth_;
+
+	// Backwards, so that the particle moved into a gap has been dealt with
+	for (int n = pickedNo - 1; n >= 0; --n)
+	{
+		int i = picked_[n];
+		bool left = wrapping_ && (y_[i] < bottom || y_[i] > top);
+		if (age_[i] <= rules_.lifetime && !left)
+		{
+			if (!landing)
+				continue;
+			if (y_[i] > groundY_[n])
+			{
+				boundFalling(i, groundY_[n]);
+				continue;
+			}
+
+			if (rules_.impact != IMPACT_KILL)
+			{
+				int r = restFirst_ + restingNo_++;
+				restX_[r] = x_[i];
+				restY_[r] = groundY_[n];
+				restZ_[r] = z_[i];
+				restUntil_[r] = clock_ + rules_.restTime;
+				retireFalling(i, true);
+				continue;
+			}
+		}
+		retireFalling(i, false);
+	}
+}
+
+/*
+	Name		ParticleSimulation::retireFalling
+	Syntax		ParticleSimulation::retireFalling(int i, bool rested)
+	Param		int i - A falling particle that has left the falling ones
+	Param		bool rested - It has been set down to rest, not killed
+	Brief		Recycles the particle when wrapping and the box is not over
+				full, or removes it
+	Details		A particle that came to rest leaves a copy on the ground, so
+				it is only recycled while that copy still fits the budget
+*/
+void ParticleSimulation::retireFalling(int i, bool rested)
+{
+	if (wrapping_ && fallingNo_ <= wrapTarget_ && fallingNo_ + restingNo_ <= maxParticles_)
+	{
+		++recycledNo_;
+		respawn(i);
+		return;
+	}
+
+	if (!rested)
+		++killedNo_;
+	removeFalling(i);
+}
+
+/*
+	Name		ParticleSimulation::respawn
+	Syntax		ParticleSimulation::respawn(int i)
+	Param		int i - A falling particle to recycle
+	Brief		Starts the particle again at the top of the box, above where
+				it was, as though it had just been emitted there
+*/
+void ParticleSimulation::respawn(int i)
+{
+	y_[i] = emitPos_[1] + rules_.emitHeight;
+
+	vx_[i] = rules_.velocity[0];
+	vy_[i] = rules_.velocity[1];
+	vz_[i] = rules_.velocity[2];
+	if (rules_.speed > 0.0f)
+	{
+		M3DVector3f dir;
+		m3dRandomUnitVector3(&random_, dir);
+		vx_[i] += dir[0] * rules_.speed;
+		vy_[i] += dir[1] * rules_.speed;
+		vz_[i] += dir[2] * rules_.speed;
+	}
+
+	age_[i] = 0.0f;
+	checkY_[i] = -FLT_MAX;
+	checkAge_[i] = 0.0f;
+}
+
+/*
+	Name		ParticleSimulation::boundFalling
+	Syntax		ParticleSimulation::boundFalling(int i, float groundY)
+	Param		int i - A falling particle above the ground
+	Param		float groundY - Height of the ground below it
+	Brief		Sets how far the particle can fall, and for how long, before
+				its ground must be looked up again
+	Details		The particle is given long enough for the ground below it
+				to rise by at most half its height above it, and is looked
+				up again once it has fallen that far, or below the highest
+				ground around it
+*/
+void ParticleSimulation::boundFalling(int i, float groundY)
+{
+	const float* m = ground_->toGrid;
+	float gx = m[0] * x_[i] + m[1] * z_[i] + m[2];
+	float gz = m[3] * x_[i] + m[4] * z_[i] + m[5];
+	int bx = gx > 0.0f ? (int)gx / BOUND_SAMPLES : 0;
+	int bz = gz > 0.0f ? (int)gz / BOUND_SAMPLES : 0;
+	bx = bx < boundsAcross_ - 1 ? bx : boundsAcross_ - 1;
+	bz = bz < boundsDown_ - 1 ? bz : boundsDown_ - 1;
+
+	int block = bz * boundsAcross_ + bx;
+	float riseRate = groundRises_[block];
+	float time = boundTime_;
+	float halfClearance = 0.5f * (y_[i] - groundY);
+	if (riseRate * time > halfClearance)
+		time = halfClearance / riseRate;
+
+	float rise = groundY + riseRate * time;
+	checkY_[i] = rise < groundBounds_[block] ? rise : groundBounds_[block];
+	checkAge_[i] = age_[i] + time;
+}
+
+/*
+	Name		ParticleSimulation::blowFalling
+	Syntax		ParticleSimulation::blowFalling(float dt)
+	Param		float dt - Time step
+	Brief		Takes the falling particles part of the way to the wind's
+				velocity where they are
+	Details		The wind is sampled a block of particles at a time into
+				arrays small enough to stay in the cache, and each particle
+				is taken the fraction of the way to it that its drag takes
+				it in the step. Only the wind's velocity across is taken up:
+				the rules' fall already stands for the air holding the
+				particles up, and a drag on it as well would leave them
+				hanging in the air
+*/
+void ParticleSimulation::blowFalling(float dt)
+{
+	const int BLOCK = 256;
+	M3D_ALIGN16 float wx[BLOCK], wy[BLOCK], wz[BLOCK];
+	const float k = 1.0f - expf(-rules_.windDrag * dt);
+
+	for (int first = 0; first < fallingNo_; first += BLOCK)
+	{
+		int count = fallingNo_ - first < BLOCK ? fallingNo_ - first : BLOCK;
+		m3dSampleVectors(wind_, &x_[first], &y_[first], &z_[first], wx, wy, wz, count);
+
+		float* vx = &vx_[first];
+		float* vz = &vz_[first];
+		int i = 0;
+#ifdef M3D_SSE
+		const __m128 vk = _mm_set1_ps(k);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(vx + i);
+			__m128 z = _mm_loadu_ps(vz + i);
+			_mm_storeu_ps(vx + i, _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(wx + i), x), vk)));
+			_mm_storeu_ps(vz + i, _mm_add_ps(z, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(wz + i), z), vk)));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			vx[i] += (wx[i] - vx[i]) * k;
+			vz[i] += (wz[i] - vz[i]) * k;
+		}
+	}
+}
+
+/*
+	Name		ParticleSimulation::ageResting
+	Syntax		ParticleSimulation::ageResting()
+	Brief		Kills the resting particles that have rested for long enough
+	Details		Every particle rests for the same time, so they are kept in
+				the order they landed and leave from the front. The rest are
+				moved back to the start once the gap before them is as large
+				as they are, which keeps them in the arrays, as those are
+				twice the budget, for a copy of each particle that leaves
+*/
+void ParticleSimulation::ageResting()
+{
+	while (restingNo_ > 0 && restUntil_[restFirst_] < clock_)
+	{
+		++restFirst_;
+		--restingNo_;
+		++killedNo_;
+	}
+
+	if (restFirst_ > 0 && restFirst_ >= restingNo_)
+	{
+		for (int i = 0; i < restingNo_; ++i)
+		{
+			restX_[i] = restX_[restFirst_ + i];
+			restY_[i] = restY_[restFirst_ + i];
+			restZ_[i] = restZ_[restFirst_ + i];
+			restUntil_[i] = restUntil_[restFirst_ + i];
+		}
+		restFirst_ = 0;
+	}
+}
+
+/*
+	Name		ParticleSimulation::removeFalling
+	Syntax		ParticleSimulation::removeFalling(int i)
+	Param		int i - The falling particle to remove
+	Brief		Fills the particle's place with the last falling particle
+*/
+void ParticleSimulation::removeFalling(int i)
+{
+	int last = --fallingNo_;
+	x_[i] = x_[last];
+	y_[i] = y_[last];
+	z_[i] = z_[last];
+	vx_[i] = vx_[last];
+	vy_[i] = vy_[last];
+	vz_[i] = vz_[last];
+	age_[i] = age_[last];
+	checkY_[i] = checkY_[last];
+	checkAge_[i] = checkAge_[last];
+}
@@ -0,0 +1,204 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleSimulation
+	Brief		Definition of the ParticleSimulation class - a particle system
+				simulated on the CPU, following the same rules as the effect
+				files, so that the particles can be collided with the terrain
+	Details		The effect files simulate the particles on the GPU with
+				stream-out, where the terrain cannot be seen, so a particle
+				falls straight through the ground and lives on until its age
+				runs out. Here the particles are kept as separate arrays,
+				stepped four at a time with SSE, and their heights checked
+				against the terrain's height field in one batched lookup a
+				frame.
+
+				Most falling particles are well above the ground, so each is
+				only looked up again once it falls below the highest ground
+				in the blocks of the height field around it, or has fallen
+				half its height above the ground, or is old enough for the
+				ground below it to have risen that far. Those tests are made
+				in the same SSE pass that moves the particles, and the few
+				particles they pick out are gathered for the batched lookup.
+
+				A particle that reaches the ground is killed, or stops where
+				it landed for a short time: a splash for rain, a settled
+				flake or leaf for snow and leaves, which is what builds up
+				on the ground. Resting particles are kept apart from the
+				falling ones, in the order they landed, so that they need
+				no ageing and leave from the front.
+
+				Bursts are emitted at the rate their interval gives, however
+				long the frame, where the effect files emit at most one burst
+				a frame.
+
+				A system emitted over an area around the camera can instead
+				wrap its particles in a box that follows the emitter: the
+				falling particles are moved across the box as the camera
+				leaves them behind, and those that fall out of its bottom,
+				are left far above it as the camera drops, land or grow too
+				old are recycled at its top rather than killed. Once the box
+				holds as many particles as the system keeps alive, nothing
+				more is emitted.
+
+				A system can be blown by a wind field. Each frame the field
+				is sampled at every falling particle, four at a time, and
+				each is taken part of the way to the wind's velocity across,
+				as quickly as its rules' drag says
+*/
+
+#ifndef PARTICLESIMULATION_H
+#define PARTICLESIMULATION_H
+
+#include <vector>
+#include "Maths/math3d.h"
+#include "Maths/m3dHeight.h"
+#include "Maths/m3dField.h"
+#include "Maths/m3dRandom.h"
+#include "ParticleSystem/Particle.hpp"
+
+/*
+	Name		ParticleImpact
+	Brief		What becomes of a particle when it reaches the ground
+*/
+enum ParticleImpact
+{
+	IMPACT_NONE,		// Falls through, as on the GPU
+	IMPACT_KILL,
+	IMPACT_SPLASH,		// Rests briefly where it landed
+	IMPACT_SETTLE,		// Rests where it landed, building up on the ground
+};
+
+/*
+	Name		ParticleRules
+	Syntax		ParticleRules
+	Brief		How a system emits, moves and kills its particles
+*/
+struct ParticleRules
+{
+	M3DVector3f accel;			// Constant acceleration
+	float emitInterval;			// Seconds between bursts
+	int emitCount;				// Particles a burst
+	float spread;				// Half width of the square about the emitter
+								// a burst starts in
+	float emitHeight;			// Height above the emitter bursts start at
+	M3DVector3f velocity;		// Starting velocity, to which is added
+	float speed;				// a starting speed in a random direction
+	float lifetime;				// Age a falling particle is killed at
+	ParticleImpact impact;
+	float restTime;				// Time a splashed or settled particle lasts
+	float windDrag;				// Rate a particle takes up the wind's velocity
+								// across, a second
+	float size;					// Starting size, growing evenly over the
+	float sizeGrowth;			// lifetime to sizeGrowth times it
+	int textureFirst;			// Slices of the texture array a particle is
+	int textureCount;			// drawn with one of, picked at random
+};
+
+class ParticleSimulation
+{
+public:
+	ParticleSimulation();
+
+	// Gets the rules the effect file of a particle type simulates by
+	static void getRules(Particle particle, ParticleRules* rules);
+	static float getTopSpeed(const ParticleRules& rules);
+	static void getWrapBox(const ParticleRules& rules, float* depth, float* rise);
+
+	void initialise(const ParticleRules& rules, int maxParticles, unsigned int seed = 1);
+
+	void setEmitPos(const M3DVector3f emitPos);
+	void setGround(const M3DHeightField* ground);
+	void setEmitScale(float emitScale);
+	void setWrapping(bool wrapping);
+	void setWind(const M3DVectorField* wind, float maxSpeed);
+
+	void reset();
+	void update(float dt);
+
+	int getFallingNo() const { return fallingNo_; };
+	int getRestingNo() const { return restingNo_; };
+	int getLiveNo() const { return fallingNo_ + restingNo_; };
+	int getMaxParticles() const { return maxParticles_; };
+	int getLookupsNo() const { return lookupsNo_; };
+	unsigned int getEmittedNo() const { return emittedNo_; };
+	unsigned int getKilledNo() const { return killedNo_; };
+	unsigned int getRecycledNo() const { return recycledNo_; };
+	bool isWrapping() const { return wrapping_; };
+	float getWrapDepth() const { return wrapDepth_; };
+	float getEmitScale() const { return emitScale_; };
+	const ParticleRules& getRules() const { return rules_; };
+
+	// Positions of the falling particles, then of the resting ones
+	const float* getX() const { return maxParticles_ ? &x_[0] : 0; };
+	const float* getY() const { return maxParticles_ ? &y_[0] : 0; };
+	const float* getZ() const { return maxParticles_ ? &z_[0] : 0; };
+	const float* getRestX() const { return maxParticles_ ? &restX_[restFirst_] : 0; };
+	const float* getRestY() const { return maxParticles_ ? &restY_[restFirst_] : 0; };
+	const float* getRestZ() const { return maxParticles_ ? &restZ_[restFirst_] : 0; };
+
+	static const int BOUND_SAMPLES = 8;	// Height samples along the side of a block
+
+private:
+	void emit(int count);
+	int integrate(float dt);
+	void retire(int pickedNo);
+	void ageResting();
+	void removeFalling(int i);
+	void retireFalling(int i, bool rested);
+	void respawn(int i);
+	void boundFalling(int i, float groundY);
+	void blowFalling(float dt);
+
+	ParticleRules rules_;
+	int maxParticles_;
+	unsigned int seed_;
+	M3DRandom random_;
+	M3DVector3f emitPos_;
+	float emitScale_;					// Fraction of the rules' burst rate
+	float emitTime_;					// Time since the last burst
+	const M3DHeightField* ground_;
+	const M3DVectorField* wind_;
+	float windSpeed_;					// Fastest the wind blows
+	std::vector<float> groundBounds_;	// Highest ground in each block of the
+										// field and the blocks around it
+	std::vector<float> groundRises_;	// Fastest the ground below a particle
+										// can rise there, a second
+	int boundsAcross_;
+	int boundsDown_;
+	float boundTime_;					// Time a particle takes at its fastest to
+										// leave the blocks around its own
+	int lookupsNo_;						// Heights looked up by the last update
+	unsigned int emittedNo_;			// Particles emitted since the reset
+	unsigned int killedNo_;				// and killed, falling or resting
+	unsigned int recycledNo_;			// and recycled at the top of the box
+
+	// Wrapping box, spread either side of the emitter, wrapDepth_ down
+	// from where bursts start and wrapRise_ up
+	bool wrapping_;
+	float wrapDepth_;
+	float wrapRise_;					// Highest a starting speed carries a particle
+	int wrapTarget_;					// Falling particles the box is filled to
+
+	// Falling particles
+	int fallingNo_;
+	std::vector<float> x_, y_, z_;
+	std::vector<float> vx_, vy_, vz_;
+	std::vector<float> age_;
+	std::vector<float> checkY_;			// Looked up again below this height,
+	std::vector<float> checkAge_;		// or past this age
+	std::vector<int> picked_;			// Particles to kill or look up
+	std::vector<float> lookupX_, lookupZ_;
+	std::vector<float> groundY_;		// Height of the ground below each of them
+
+	// Resting particles, oldest first
+	double clock_;						// Time since the reset
+	int restFirst_;
+	int restingNo_;
+	std::vector<float> restX_, restY_, restZ_;
+	std::vector<double> restUntil_;		// Clock time each is killed at
+};
+
+#endif
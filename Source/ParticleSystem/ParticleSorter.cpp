@@ -0,0 +1,451 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleSorter
+	Brief		Implementation of the ParticleSorter class
+*/
+
+#include "ParticleSystem/ParticleSorter.hpp"
+#include <algorithm>
+#include "Maths/m3dSIMD.h"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	/*
+		Name		depthKey
+		Syntax		depthKey(float depth)
+		Param		float depth - Depth along the view direction
+		Return		UINT - A key that is smaller the deeper the particle
+		Brief		Flips the bits of a float so that unsigned order runs from
+					the largest float to the smallest
+		Details		Positive floats order as unsigned integers once the sign
+					bit is set, and negative ones once every bit is flipped;
+					flipping the result again reverses the order
+	*/
+	inline UINT depthKey(float depth)
+	{
+		union { float f; UINT u; } bits;
+		bits.f = depth;
+		UINT mask = (UINT)((int)bits.u >> 31) | 0x80000000u;
+		return ~(bits.u ^ mask);
+	}
+}
+
+/*
+	Name		ParticleSorter::ParticleSorter
+	Syntax		ParticleSorter()
+	Brief		ParticleSorter constructor
+*/
+ParticleSorter::ParticleSorter()
+: x_(0), y_(0), z_(0), eyeDepth_(0.0f), count_(0), valid_(false), coherent_(false),
+  incremental_(false), retryIn_(0), offsets_(CHUNKS_NO * BUCKETS_NO), shift_(0), insertFailed_(0), job_(JOB_KEYS),
+  workSemaphore_(0), doneEvent_(0), nextChunk_(0), workersBusy_(0), quit_(0)
+{
+	m3dLoadVector3(forward_, 0.0f, 0.0f, 1.0f);
+}
+
+/*
+	Name		ParticleSorter::~ParticleSorter
+	Syntax		~ParticleSorter()
+	Brief		ParticleSorter destructor stops the workers
+*/
+ParticleSorter::~ParticleSorter()
+{
+	deinitialise();
+}
+
+/*
+	Name		ParticleSorter::initialise
+	Syntax		ParticleSorter::initialise(int threadsNo)
+	Param		int threadsNo - Threads to sort with, counting the thread
+				that calls sort
+	Return		bool - True if every worker thread was started
+	Brief		Starts the worker threads
+	Details		If a worker cannot be started, the particles are sorted
+				with those that were
+*/
+bool ParticleSorter::initialise(int threadsNo)
+{
+	deinitialise();
+
+	int workers = threadsNo - 1;
+	if (workers <= 0)
+		return true;
+
+	workSemaphore_ = CreateSemaphore(0, 0, workers, 0);
+	doneEvent_ = CreateEvent(0, FALSE, FALSE, 0);
+	if (!workSemaphore_ || !doneEvent_)
+	{
+		MessageBox(0, "Creating particle sorter events - Failed", "Error", MB_OK);
+		deinitialise();
+		return false;
+	}
+
+	for (int i = 0; i < workers; ++i)
+	{
+		HANDLE thread = CreateThread(0, 0, workerProc, this, 0, 0);
+		if (!thread)
+		{
+			MessageBox(0, "Creating particle sorter thread - Failed", "Error", MB_OK);
+			return false;
+		}
+		threads_.push_back(thread);
+	}
+
+	return true;
+}
+
+/*
+	Name		ParticleSorter::deinitialise
+	Syntax		ParticleSorter::deinitialise()
+	Brief		Stops the worker threads and waits for them to finish
+*/
+void ParticleSorter::deinitialise()
+{
+	if (!threads_.empty())
+	{
+		InterlockedExchange(&quit_, 1);
+		ReleaseSemaphore(workSemaphore_, (LONG)threads_.size(), 0);
+		for (size_t i = 0; i < threads_.size(); ++i)
+		{
+			WaitForSingleObject(threads_[i], INFINITE);
+			CloseHandle(threads_[i]);
+		}
+		threads_.clear();
+		quit_ = 0;
+	}
+	if (workSemaphore_)
+	{
+		CloseHandle(workSemaphore_);
+		workSemaphore_ = 0;
+	}
+	if (doneEvent_)
+	{
+		CloseHandle(doneEvent_);
+		doneEvent_ = 0;
+	}
+}
+
+/*
+	Name		ParticleSorter::sort
+	Syntax		ParticleSorter::sort(const float* x, const float* y,
+				const float* z, int count, const M3DVector3f eye,
+				const M3DVector3f forward)
+	Param		const float* x, y, z - The particle positions
+	Param		int count - Number of particles
+	Param		const M3DVector3f eye - Camera position
+	Param		const M3DVector3f forward - Unit direction the camera faces
+	Brief		Orders the particles furthest first
+*/
+void ParticleSorter::sort(const float* x, const float* y, const float* z, int count,
+						  const M3DVector3f eye, const M3DVector3f forward)
+{
+	PROFILE_ZONE("ParticleSorter::sort");
+
+	x_ = x;
+	y_ = y;
+	z_ = z;
+	m3dCopyVector3(forward_, forward);
+	eyeDepth_ = m3dDotProduct3(eye, forward);
+
+	coherent_ = valid_ && count == count_ && retryIn_ == 0;
+	retryIn_ = retryIn_ > 0 ? retryIn_ - 1 : 0;
+	count_ = count > 0 ? count : 0;
+	incremental_ = false;
+	valid_ = false;
+	if (count_ == 0)
+		return;
+
+	if (coherent_)
+		particleKeys_.resize(count_);
+	keys_.resize(count_);
+	order_.resize(count_);
+	swapKeys_.resize(count_);
+	swapOrder_.resize(count_);
+
+	if (coherent_)
+	{
+		// Put the new keys in the last order, sort each chunk, then join
+		// the chunks
+		runJob(JOB_KEYS);
+		runJob(JOB_GATHER);
+		insertFailed_ = 0;
+		runJob(JOB_INSERT);
+		if (!insertFailed_)
+			incremental_ = insertionSort(0, count_, count_ * INSERTION_MOVES);
+		if (!incremental_)
+			retryIn_ = INSERTION_RETRY;
+	}
+	else
+	{
+		runJob(JOB_KEYS);
+	}
+
+	if (!incremental_)
+		radixSort();
+	valid_ = true;
+}
+
+/*
+	Name		ParticleSorter::reset
+	Syntax		ParticleSorter::reset()
+	Brief		Forgets the last order, so that the next sort starts afresh
+*/
+void ParticleSorter::reset()
+{
+	valid_ = false;
+	retryIn_ = 0;
+}
+
+/*
+	Name		ParticleSorter::runJob
+	Syntax		ParticleSorter::runJob(Job job)
+	Param		Job job - The step of the sort to run over every chunk
+	Brief		Runs one step of the sort over the chunks, with the workers
+				if there are enough particles to be worth waking them
+*/
+void ParticleSorter::runJob(Job job)
+{
+	job_ = job;
+	nextChunk_ = 0;
+	if (threads_.empty() || count_ < PARALLEL_MIN)
+	{
+		runChunks();
+		return;
+	}
+
+	workersBusy_ = (LONG)threads_.size();
+	ReleaseSemaphore(workSemaphore_, (LONG)threads_.size(), 0);
+	runChunks();
+	WaitForSingleObject(doneEvent_, INFINITE);
+}
+
+/*
+	Name		ParticleSorter::runChunks
+	Syntax		ParticleSorter::runChunks()
+	Brief		Takes chunks until none are left
+*/
+void ParticleSorter::runChunks()
+{
+	for (;;)
+	{
+		LONG chunk = InterlockedIncrement(&nextChunk_) - 1;
+		if (chunk >= CHUNKS_NO)
+			return;
+		runChunk((int)chunk);
+	}
+}
+
+/*
+	Name		ParticleSorter::runChunk
+	Syntax		ParticleSorter::runChunk(int chunk)
+	Param		int chunk - The chunk to run the current job over
+	Brief		Runs the current job over one chunk
+*/
+void ParticleSorter::runChunk(int chunk)
+{
+	int first = chunkStart(chunk);
+	int last = chunkStart(chunk + 1);
+	UINT* counts = &offsets_[chunk * BUCKETS_NO];
+	const UINT mask = BUCKETS_NO - 1;
+
+	switch (job_)
+	{
+	case JOB_KEYS:
+		// Without a last order to gather by, the keys are made in place and
+		// the particles start in their own order
+		if (coherent_)
+		{
+			makeKeys(&particleKeys_[0], first, last);
+		}
+		else
+		{
+			makeKeys(&keys_[0], first, last);
+			for (int i = first; i < last; ++i)
+				order_[i] = (UINT)i;
+		}
+		break;
+
+	case JOB_GATHER:
+		for (int i = first; i < last; ++i)
+			keys_[i] = particleKeys_[order_[i]];
+		break;
+
+	case JOB_INSERT:
+		if (!insertionSort(first, last, (last - first) * INSERTION_MOVES))
+			InterlockedExchange(&insertFailed_, 1);
+		break;
+
+	case JOB_HISTOGRAM:
+		std::fill(counts, counts + BUCKETS_NO, 0u);
+		for (int i = first; i < last; ++i)
+			++counts[(keys_[i] >> shift_) & mask];
+		break;
+
+	case JOB_SCATTER:
+		for (int i = first; i < last; ++i)
+		{
+			UINT key = keys_[i];
+			UINT to = counts[(key >> shift_) & mask]++;
+			swapKeys_[to] = key;
+			swapOrder_[to] = order_[i];
+		}
+		break;
+	}
+}
+
+/*
+	Name		ParticleSorter::makeKeys
+	Syntax		ParticleSorter::makeKeys(UINT* keys, int first, int last)
+	Param		UINT* keys - Receives the key of each particle
+	Param		int first, last - The particles to make keys for
+	Brief		Finds the depth of each particle along the view direction
+				and turns it into its key
+*/
+void ParticleSorter::makeKeys(UINT* keys, int first, int last)
+{
+	int i = first;
+
+#ifdef M3D_SSE
+	const __m128 fx = _mm_set1_ps(forward_[0]);
+	const __m128 fy = _mm_set1_ps(forward_[1]);
+	const __m128 fz = _mm_set1_ps(forward_[2]);
+	const __m128 eyeDepth = _mm_set1_ps(eyeDepth_);
+	const __m128i signBit = _mm_set1_epi32((int)0x80000000);
+	const __m128i ones = _mm_set1_epi32(-1);
+
+	for (; i + 4 <= last; i += 4)
+	{
+		__m128 depth = _mm_mul_ps(_mm_loadu_ps(x_ + i), fx);
+		depth = _mm_add_ps(depth, _mm_mul_ps(_mm_loadu_ps(y_ + i), fy));
+		depth = _mm_add_ps(depth, _mm_mul_ps(_mm_loadu_ps(z_ + i), fz));
+		depth = _mm_sub_ps(depth, eyeDepth);
+
+		__m128i bits = _mm_castps_si128(depth);
+		__m128i mask = _mm_or_si128(_mm_srai_epi32(bits, 31), signBit);
+		__m128i key = _mm_xor_si128(_mm_xor_si128(bits, mask), ones);
+		_mm_storeu_si128((__m128i*)(keys + i), key);
+	}
+#endif
+
+	for (; i < last; ++i)
+	{
+		float depth = x_[i] * forward_[0] + y_[i] * forward_[1] + z_[i] * forward_[2] - eyeDepth_;
+		keys[i] = depthKey(depth);
+	}
+}
+
+/*
+	Name		ParticleSorter::insertionSort
+	Syntax		ParticleSorter::insertionSort(int first, int last, int budget)
+	Param		int first, last - The keys to sort
+	Param		int budget - Most moves to make
+	Return		bool - True if the keys were sorted within the budget
+	Brief		Sorts keys that are nearly in order already
+	Details		When the budget runs out the keys are left part sorted, but
+				each is still paired with its particle
+*/
+bool ParticleSorter::insertionSort(int first, int last, int budget)
+{
+	UINT* keys = &keys_[0];
+	UINT* order = &order_[0];
+	int moves = 0;
+
+	for (int i = first + 1; i < last; ++i)
+	{
+		UINT key = keys[i];
+		if (keys[i - 1] <= key)
+			continue;
+
+		UINT particle = order[i];
+		int j = i;
+		do
+		{
+			keys[j] = keys[j - 1];
+			order[j] = order[j - 1];
+			--j;
+		} while (j > first && keys[j - 1] > key);
+		keys[j] = key;
+		order[j] = particle;
+
+		moves += i - j;
+		if (moves > budget)
+			return false;
+	}
+	return true;
+}
+
+/*
+	Name		ParticleSorter::radixSort
+	Syntax		ParticleSorter::radixSort()
+	Brief		Sorts the keys and their particles, a digit at a time from
+				the least significant
+	Details		After the chunks have counted their digits, each chunk's
+				first slot for a digit follows every smaller digit and the
+				same digit in every earlier chunk
+*/
+void ParticleSorter::radixSort()
+{
+	for (shift_ = 0; shift_ < 32; shift_ += RADIX_BITS)
+	{
+		runJob(JOB_HISTOGRAM);
+
+		UINT total = 0;
+		bool sameDigit = false;
+		for (int b = 0; b < BUCKETS_NO; ++b)
+		{
+			UINT bucketStart = total;
+			for (int c = 0; c < CHUNKS_NO; ++c)
+			{
+				UINT& slot = offsets_[c * BUCKETS_NO + b];
+				UINT n = slot;
+				slot = total;
+				total += n;
+			}
+			sameDigit = sameDigit || total - bucketStart == (UINT)count_;
+		}
+
+		// A pass that would move nothing is skipped
+		if (sameDigit)
+			continue;
+
+		runJob(JOB_SCATTER);
+		keys_.swap(swapKeys_);
+		order_.swap(swapOrder_);
+	}
+}
+
+/*
+	Name		ParticleSorter::runWorker
+	Syntax		ParticleSorter::runWorker()
+	Brief		Runs the chunks of each job until told to quit
+*/
+void ParticleSorter::runWorker()
+{
+	for (;;)
+	{
+		WaitForSingleObject(workSemaphore_, INFINITE);
+		if (quit_)
+			return;
+
+		runChunks();
+		if (InterlockedDecrement(&workersBusy_) == 0)
+			SetEvent(doneEvent_);
+	}
+}
+
+/*
+	Name		ParticleSorter::workerProc
+	Syntax		ParticleSorter::workerProc(LPVOID sorter)
+	Param		LPVOID sorter - The sorter
+	Return		DWORD - Zero
+	Brief		Entry point of the worker threads
+*/
+DWORD WINAPI ParticleSorter::workerProc(LPVOID sorter)
+{
+	static_cast<ParticleSorter*>(sorter)->runWorker();
+	return 0;
+}
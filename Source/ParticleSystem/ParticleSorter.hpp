@@ -0,0 +1,119 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		ParticleSorter
+	Brief		Definition of the ParticleSorter class - orders particles
+				from the furthest from the camera to the nearest, so that
+				alpha blended particles can be drawn back to front
+	Details		Each particle's depth along the view direction is found four
+				at a time with SSE and turned into an unsigned key whose
+				order is the reverse of the depths'. The keys are sorted with
+				their particle indices by a least significant digit radix
+				sort, three passes of 11 bits, skipping any pass whose digit
+				is the same for every key.
+
+				Particles and the camera move little from frame to frame, so
+				the last frame's order is kept and, when the particle count
+				has not changed, the keys are first put in that order and
+				finished with an insertion sort. If that would take more
+				than a few moves a particle the radix sort takes over from
+				wherever it got to, and the next few sorts go straight to
+				the radix sort.
+
+				Both sorts are split into chunks that the worker threads and
+				the calling thread take in turn. The radix passes count each
+				chunk's digits separately, so that every chunk can scatter
+				its keys without locking and the sort stays stable
+*/
+
+#ifndef PARTICLESORTER_H
+#define PARTICLESORTER_H
+
+#include <windows.h>
+#include <vector>
+#include "Maths/math3d.h"
+
+class ParticleSorter
+{
+public:
+	ParticleSorter();
+	~ParticleSorter();
+
+	bool initialise(int threadsNo);
+	void deinitialise();
+
+	// Sorts count particles, given as separate x, y and z arrays, far to
+	// near along the unit view direction forward. The order is kept as
+	// the starting point of the next sort
+	void sort(const float* x, const float* y, const float* z, int count,
+			  const M3DVector3f eye, const M3DVector3f forward);
+	void reset();
+
+	// Indices of the particles, furthest first
+	const UINT* getOrder() const { return count_ ? &order_[0] : 0; };
+	int getCount() const { return count_; };
+	bool wasIncremental() const { return incremental_; };
+	int getThreadsNo() const { return (int)threads_.size() + 1; };
+
+	static const int RADIX_BITS = 11;
+	static const int BUCKETS_NO = 1 << RADIX_BITS;
+	static const int CHUNKS_NO = 16;
+	static const int PARALLEL_MIN = 16384;	// Fewer particles are sorted on the
+											// calling thread alone
+	static const int INSERTION_MOVES = 8;	// Moves a particle the insertion sort
+											// may make before giving up
+	static const int INSERTION_RETRY = 8;	// Sorts to wait before trying it again
+
+private:
+	enum Job
+	{
+		JOB_KEYS,
+		JOB_GATHER,
+		JOB_INSERT,
+		JOB_HISTOGRAM,
+		JOB_SCATTER
+	};
+
+	void runJob(Job job);
+	void runChunks();
+	void runChunk(int chunk);
+	void makeKeys(UINT* keys, int first, int last);
+	bool insertionSort(int first, int last, int budget);
+	void radixSort();
+	void runWorker();
+	static DWORD WINAPI workerProc(LPVOID sorter);
+
+	int chunkStart(int chunk) const { return (int)((__int64)count_ * chunk / CHUNKS_NO); };
+
+	const float* x_;
+	const float* y_;
+	const float* z_;
+	M3DVector3f forward_;
+	float eyeDepth_;			// Depth of the eye along forward
+	int count_;
+	bool valid_;				// order_ holds the last sort's order
+	bool coherent_;				// This sort starts from the last order
+	bool incremental_;			// The last sort was finished by insertion
+	int retryIn_;				// Sorts until insertion is tried again
+
+	std::vector<UINT> particleKeys_;	// Key of each particle, in particle order
+	std::vector<UINT> keys_;			// Keys being sorted, and their particles
+	std::vector<UINT> order_;
+	std::vector<UINT> swapKeys_;		// Radix pass destinations
+	std::vector<UINT> swapOrder_;
+	std::vector<UINT> offsets_;			// BUCKETS_NO counts, then offsets, a chunk
+	int shift_;							// Digit of the radix pass
+	volatile LONG insertFailed_;
+
+	Job job_;
+	std::vector<HANDLE> threads_;		// Workers, besides the calling thread
+	HANDLE workSemaphore_;				// Released once for each worker a job
+	HANDLE doneEvent_;					// Set when the last worker is done
+	volatile LONG nextChunk_;
+	volatile LONG workersBusy_;
+	volatile LONG quit_;
+};
+
+#endif
@@ -8,34 +8,68 @@
 	Brief		Definition of ParticleSystem Class used to handle the creation, 
 				updating and rendering of a particle system
 */
+#include <math.h>
 #include <algorithm>
 
 #include "ParticleSystem/ParticleSystem.hpp"
+#include "ParticleSystem/ParticleBudget.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "ParticleSystem/WindField.hpp"
 #include "Utility/Utility.hpp"
 #include "Scene/Scene.hpp"
 #include "Vertex/Vertex.hpp"
 #include "Shaders/ParticleShader.hpp"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	// Most particles the effect files emit in a burst
+	const int MAX_BURST = 5;
+}
 
 /*
 	Name		ParticleSystem::ParticleSystem
-	Syntax		ParticleSystem(Particle particle)
-	Param		Particle particle - The type of particle system
+	Syntax		ParticleSystem(const ParticleEffect& effect)
+	Param		const ParticleEffect& effect - The description of the system
 	Brief		ParticleSystem constructor initialises member variables
 */
-ParticleSystem::ParticleSystem(Particle particle)
-: d3dDevice_(0), initVertexBuffer_(0), renderVertexBuffer_(0), 
-  streamOutVertexBuffer_(0), texArrayRV_(0), randomTexRV_(0)
+ParticleSystem::ParticleSystem(const ParticleEffect& effect)
+: budgetId_(-1), wrapping_(false), soQuery_(0), d3dDevice_(0), initVertexBuffer_(0), renderVertexBuffer_(0), 
+  streamOutVertexBuffer_(0), texArrayRV_(0), randomTexRV_(0), wind_(0), windTex_(0), windRV_(0),
+  windVersion_(0), groundTex_(0), groundRV_(0), groundLinear_(true), particleShader_(0)
 {
-	particle_ = particle;
+	effectFile_ = effect.getEffectFile();
+	rules_ = effect.getRules();
+	if (rules_.emitCount > MAX_BURST)
+		rules_.emitCount = MAX_BURST;
 
 	firstRun_ = true;
 	sceneTime_ = 0.0f;
 	timeStep_ = 0.0f;
 	age_      = 0.0f;
 
+	emitterAge_ = 0.0f;
+	liveNo_ = 0;
+	emittedNo_ = 0;
+	killedNo_ = 0;
+	queryPending_ = false;
+	queryStale_ = false;
+	queryEmitted_ = 0;
+
+	simTime_ = 0.0;
+	simStep_ = 0.0f;
+	resetRequested_ = false;
+	pendingTime_ = 0.0;
+	pendingStep_ = 0.0f;
+	pendingReset_ = false;
+
 	eyePosW_  = D3DXVECTOR4(0.0f, 0.0f, 0.0f, 1.0f);
 	emitPosW_ = D3DXVECTOR4(0.0f, 0.0f, 0.0f, 1.0f);
 	emitDirW_ = D3DXVECTOR4(0.0f, 1.0f, 0.0f, 0.0f);
+
+	groundToU_ = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+	groundToV_ = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+	groundToWorld_ = D3DXVECTOR2(0.0f, 0.0f);
 }
 
 /*
@@ -47,6 +81,15 @@ ParticleSystem::~ParticleSystem()
 {
 	delete particleShader_;
 
+	if (budgetId_ >= 0)
+		Scene::instance()->getParticleBudget()->removeSystem(budgetId_);
+
+	if (soQuery_)
+	{
+		soQuery_->Release();
+		soQuery_ = 0;
+	}
+
 	if (initVertexBuffer_)
 	{
 		initVertexBuffer_->Release();
@@ -64,6 +107,30 @@ ParticleSystem::~ParticleSystem()
 		streamOutVertexBuffer_->Release();
 		streamOutVertexBuffer_ = 0;
 	}	
+
+	if (windRV_)
+	{
+		windRV_->Release();
+		windRV_ = 0;
+	}
+
+	if (windTex_)
+	{
+		windTex_->Release();
+		windTex_ = 0;
+	}
+
+	if (groundRV_)
+	{
+		groundRV_->Release();
+		groundRV_ = 0;
+	}
+
+	if (groundTex_)
+	{
+		groundTex_->Release();
+		groundTex_ = 0;
+	}
 }
 
 /*
@@ -82,11 +149,20 @@ void ParticleSystem::setEyePos(const D3DXVECTOR3& eyePosW)
 	Syntax		ParticleSystem::setEmitPos(const D3DXVECTOR3& emitPosW)
 	Param		const D3DXVECTOR3& emitPosW - Position from which to emit
 				particles for the system
-	Brief		Sets the position of the particle system emitter
+	Brief		Sets the position of the particle system emitter, and moves
+				the volume its particles fill in the particle budget
 */
 void ParticleSystem::setEmitPos(const D3DXVECTOR3& emitPosW)
 {
 	emitPosW_ = D3DXVECTOR4(emitPosW.x, emitPosW.y, emitPosW.z, 1.0f);
+
+	if (budgetId_ >= 0)
+	{
+		M3DVector3f centre;
+		float radius;
+		ParticleBudget::getVolume(rules_, emitPosW, centre, &radius);
+		Scene::instance()->getParticleBudget()->setVolume(budgetId_, centre, radius);
+	}
 }
 
 /*
@@ -101,6 +177,118 @@ void ParticleSystem::setEmitDir(const D3DXVECTOR3& emitDirW)
 	emitDirW_ = D3DXVECTOR4(emitDirW.x, emitDirW.y, emitDirW.z, 0.0f);
 }
 
+/*
+	Name		ParticleSystem::setWrapping
+	Syntax		ParticleSystem::setWrapping(bool wrapping)
+	Param		bool wrapping - Wrap the particles in a box about the emitter
+	Brief		Turns wrapping on or off
+	Details		Only systems emitted over an area wrap, as the box is the
+				area their bursts start in
+*/
+void ParticleSystem::setWrapping(bool wrapping)
+{
+	wrapping_ = wrapping && rules_.spread > 0.0f;
+}
+
+/*
+	Name		ParticleSystem::setWind
+	Syntax		ParticleSystem::setWind(const WindField* wind)
+	Param		const WindField* wind - The wind to blow the particles with,
+				or 0 for none
+	Brief		Sets the wind field the particles are blown by
+	Details		The field must outlive the system. How hard it blows the
+				particles is the drag in the system's rules
+*/
+void ParticleSystem::setWind(const WindField* wind)
+{
+	wind_ = rules_.windDrag > 0.0f ? wind : 0;
+	windVersion_ = 0;
+}
+
+/*
+	Name		ParticleSystem::setGround
+	Syntax		ParticleSystem::setGround(const M3DHeightField* ground)
+	Param		const M3DHeightField* ground - The ground the particles land
+				on, or 0 for none
+	Brief		Sets the ground the particles land on
+	Details		Called once the system is initialised. The heights are
+				uploaded to a texture here, as they are, so the ground must
+				be set again if the terrain is moved. What becomes of the
+				particles that land is the impact in the system's rules.
+				Texel centres lie half a texel in from the texture's edges,
+				so half a texel is added to the map into the grid.
+
+				Filtering 32 bit float textures is optional on D3D10
+				hardware, so the heights are filtered linearly, as the
+				CPU simulation looks them up, only where the device can.
+				Elsewhere the nearest height is taken. The ground is left
+				out when the scene has landing turned off
+*/
+void ParticleSystem::setGround(const M3DHeightField* ground)
+{
+	if (groundRV_)
+	{
+		groundRV_->Release();
+		groundRV_ = 0;
+	}
+
+	if (groundTex_)
+	{
+		groundTex_->Release();
+		groundTex_ = 0;
+	}
+
+	if (!ground || !ground->heights || rules_.impact == IMPACT_NONE || 
+		!Scene::instance()->getParticlesLand())
+		return;
+
+	D3D10_TEXTURE2D_DESC texDesc;
+	texDesc.Width = ground->width;
+	texDesc.Height = ground->depth;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = DXGI_FORMAT_R32_FLOAT;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D10_USAGE_IMMUTABLE;
+	texDesc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = 0;
+
+	D3D10_SUBRESOURCE_DATA initData;
+	initData.pSysMem = ground->heights;
+	initData.SysMemPitch = ground->width * sizeof(float);
+	initData.SysMemSlicePitch = 0;
+
+	RenderBackend* backend = Scene::instance()->getBackend();
+	HRESULT hr = backend->createTexture2D(&texDesc, &initData, &groundTex_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating ps ground texture - Failed", "Error", MB_OK);
+		groundTex_ = 0;
+		return;
+	}
+
+	hr = d3dDevice_->CreateShaderResourceView(groundTex_, 0, &groundRV_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating ps ground view - Failed", "Error", MB_OK);
+		groundRV_ = 0;
+		groundTex_->Release();
+		groundTex_ = 0;
+		return;
+	}
+
+	UINT support = 0;
+	groundLinear_ = SUCCEEDED(d3dDevice_->CheckFormatSupport(DXGI_FORMAT_R32_FLOAT, &support)) &&
+					(support & D3D10_FORMAT_SUPPORT_SHADER_SAMPLE) != 0;
+
+	const float* toGrid = ground->toGrid;
+	groundToU_ = D3DXVECTOR3(toGrid[0], toGrid[1], toGrid[2] + 0.5f) / (float)ground->width;
+	groundToV_ = D3DXVECTOR3(toGrid[3], toGrid[4], toGrid[5] + 0.5f) / (float)ground->depth;
+	groundToWorld_ = D3DXVECTOR2(ground->heightScale, ground->heightOffset);
+}
+
 /*
 	Name		ParticleSystem::initialise
 	Syntax		ParticleSystem::initialise(ID3D10Device* device, 
@@ -111,7 +299,8 @@ void ParticleSystem::setEmitDir(const D3DXVECTOR3& emitDirW)
 				by the particle system
 	Param		UINT maxParticles - The maximum number of particles this system
 				should emit
-	Brief		Initialises the particle system
+	Brief		Initialises the particle system and registers it with the
+				scene's particle budget
 */
 void ParticleSystem::initialise(ID3D10Device* device, 
 								ID3D10ShaderResourceView* texArrayRV,
@@ -121,7 +310,8 @@ void ParticleSystem::initialise(ID3D10Device* device,
 	d3dDevice_ = device;
 
 	particleShader_ = new ParticleShader;
-	particleShader_->initialise(particle_);
+	particleShader_->initialise(effectFile_);
+	particleShader_->setRules(rules_);
 
 	maxParticles_ = maxParticles;
 
@@ -129,6 +319,15 @@ void ParticleSystem::initialise(ID3D10Device* device,
 	randomTexRV_ = createRandomTexture(); 
 
 	buildVertexBuffer();
+
+	D3D10_QUERY_DESC queryDesc;
+	queryDesc.Query = D3D10_QUERY_SO_STATISTICS;
+	queryDesc.MiscFlags = 0;
+	if (FAILED(d3dDevice_->CreateQuery(&queryDesc, &soQuery_)))
+		soQuery_ = 0;
+
+	ParticleBudget* budget = Scene::instance()->getParticleBudget();
+	budgetId_ = budget->addSystem(ParticleBudget::getDemand(rules_, maxParticles));
 }
 
 /*
@@ -138,25 +337,73 @@ void ParticleSystem::initialise(ID3D10Device* device,
 */
 void ParticleSystem::reset()
 {
-	firstRun_ = true;
+	resetRequested_ = true;
 	age_      = 0.0f;
 }
 
 /*
 	Name		ParticleSystem::update
-	Syntax		ParticleSystem::update(float dt, float sceneTime)
+	Syntax		ParticleSystem::update(float dt, double sceneTime)
 	Param		float dt - Change in time between frames
-	Param		float sceneTime - The scene time
+	Param		double sceneTime - The scene time
 	Brief		Updates the particle system based on time
+	Details		The particles themselves are simulated on the GPU when they
+				are rendered, so the time steps are summed until then
 */
-void ParticleSystem::update(float dt, float sceneTime)
+void ParticleSystem::update(float dt, double sceneTime)
 {
-	sceneTime_ = sceneTime;
-	timeStep_ = dt;
+	simTime_ = sceneTime;
+	simStep_ += dt;
 
 	age_ += dt;
 }
 
+/*
+	Name		ParticleSystem::publish
+	Syntax		ParticleSystem::publish()
+	Brief		Hands the time simulated and any reset over to rendering
+*/
+void ParticleSystem::publish()
+{
+	pendingTime_ = simTime_;
+	pendingStep_ += simStep_;
+	simStep_ = 0.0f;
+
+	if (resetRequested_)
+	{
+		pendingReset_ = true;
+		resetRequested_ = false;
+	}
+}
+
+/*
+	Name		ParticleSystem::apply
+	Syntax		ParticleSystem::apply()
+	Brief		Takes the published time step for the next render
+	Details		The shaders only use the scene time to look up the wrapped
+				random texture, so it is wrapped to [0, 1) here where it is
+				still a double. Passing the raw time as a float would lose 
+				precision as the scene runs
+*/
+void ParticleSystem::apply()
+{
+	sceneTime_ = (float)(pendingTime_ - floor(pendingTime_));
+	timeStep_ = pendingStep_;
+	pendingStep_ = 0.0f;
+
+	if (pendingReset_)
+	{
+		firstRun_ = true;
+		pendingReset_ = false;
+
+		emitterAge_ = 0.0f;
+		liveNo_ = 0;
+		emittedNo_ = 0;
+		killedNo_ = 0;
+		queryStale_ = queryPending_;
+	}
+}
+
 /*
 	Name		ParticleSystem::render
 	Syntax		ParticleSystem::render()
@@ -164,8 +411,49 @@ void ParticleSystem::update(float dt, float sceneTime)
 */
 void ParticleSystem::render()
 {
+	PROFILE_ZONE("ParticleSystem::render");
+
+	RenderBackend* backend = Scene::instance()->getBackend();
+	ParticleBudget* budget = Scene::instance()->getParticleBudget();
+	float emitScale = budget->getEmitScale(budgetId_);
+
 	particleShader_->setupRender(sceneTime_, timeStep_, &eyePosW_, &emitPosW_, 
 								 &emitDirW_, texArrayRV_, randomTexRV_);
+	particleShader_->setLod(emitScale, budget->getSizeScale(budgetId_));
+
+	// A wrapping box is filled to what the share keeps alive, at least a
+	// burst
+	float wrapCount = 0.0f;
+	if (wrapping_)
+	{
+		float demand = ParticleBudget::getDemand(rules_, maxParticles_);
+		wrapCount = floorf(demand * emitScale);
+		wrapCount = wrapCount > (float)rules_.emitCount ? wrapCount : (float)rules_.emitCount;
+	}
+	particleShader_->setWrapCount(wrapCount);
+
+	// The wind takes the particles' velocities the same fraction of the
+	// way to its own over the step as the simulation does
+	D3DXVECTOR3 windToTex(0.0f, 0.0f, 0.0f);
+	D3DXVECTOR3 windOffset(0.0f, 0.0f, 0.0f);
+	float windWeight = 0.0f;
+	if (wind_)
+		uploadWind();
+	if (wind_ && windRV_)
+	{
+		const M3DVectorField* field = wind_->getRenderField();
+		const float size[3] = { (float)field->width, (float)field->height, 
+								(float)field->depth };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			windToTex[axis] = field->invSpacing / size[axis];
+			windOffset[axis] = (0.5f - field->origin[axis] * field->invSpacing) / size[axis];
+		}
+		windWeight = 1.0f - expf(-rules_.windDrag * timeStep_);
+	}
+	particleShader_->setWind(windRV_, windToTex, windOffset, windWeight);
+	particleShader_->setGround(groundRV_, groundToU_, groundToV_, groundToWorld_,
+							   groundRV_ ? rules_.impact : IMPACT_NONE, groundLinear_);
 
 	// Set IA stage
 	d3dDevice_->IASetInputLayout(particleShader_->getLayout());
@@ -191,6 +479,13 @@ void ParticleSystem::render()
 	// The updated vertices are streamed-out to the target vertex buffer
 	d3dDevice_->SOSetTargets(1, &streamOutVertexBuffer_, &offset);
 
+	// Count the particles the emitter adds this pass, and the particles
+	// written out, unless the last count has still to come back
+	UINT emitted = countEmitted(emitScale, wrapCount);
+	bool query = soQuery_ && !queryPending_;
+	if (query)
+		soQuery_->Begin();
+
     D3D10_TECHNIQUE_DESC techDesc;
 	particleShader_->setStreamOutTech(&techDesc);
 
@@ -200,15 +495,26 @@ void ParticleSystem::render()
         
 		if (firstRun_)
 		{
-			d3dDevice_->Draw(1, 0);
+			backend->draw(1, 0);
 			firstRun_ = false;
 		}
 		else
 		{
-			d3dDevice_->DrawAuto();
+			backend->drawAuto();
 		}
     }
 
+	if (query)
+	{
+		soQuery_->End();
+		queryPending_ = true;
+		queryStale_ = false;
+		queryEmitted_ = emittedNo_;
+	}
+	UINT killed = readCounts();
+	budget->setCounts(budgetId_, liveNo_, emittedNo_, killedNo_);
+	Scene::instance()->addParticleStats(liveNo_, emitted, killed, emitScale);
+
 	// done streaming-out - unbind the vertex buffer
 	ID3D10Buffer* bufferArray[1] = { 0 };
 	d3dDevice_->SOSetTargets(1, bufferArray, &offset);
@@ -225,10 +531,123 @@ void ParticleSystem::render()
     {
       particleShader_->applyDrawPass(p);
         
-		d3dDevice_->DrawAuto();
+		backend->drawAuto();
     }
 }
 
+/*
+	Name		ParticleSystem::countEmitted
+	Syntax		ParticleSystem::countEmitted(float emitScale, float wrapCount)
+	Param		float emitScale - The emission scale the pass runs with
+	Param		float wrapCount - Particles a wrapping box is filled to, or
+				zero
+	Return		UINT - Particles emitted
+	Brief		Counts the particles the stream-out pass will emit
+	Details		Follows the rule of the emitter particle in the effect file,
+				which emits a burst once its age passes the interval and
+				starts its age again, at most once a pass, unless a
+				wrapping box is full. The emitter counts what it has emitted
+				since the reset, as emittedNo_ does. Particles that do not
+				fit in the buffer are counted as emitted, and killed
+*/
+UINT ParticleSystem::countEmitted(float emitScale, float wrapCount)
+{
+	if (firstRun_)
+		emitterAge_ = 0.0f;
+
+	emitterAge_ += timeStep_;
+	bool full = wrapCount > 0.0f && (float)emittedNo_ >= wrapCount;
+	if (emitterAge_ <= rules_.emitInterval / emitScale || full)
+		return 0;
+
+	emittedNo_ += rules_.emitCount;
+	emitterAge_ = 0.0f;
+	return rules_.emitCount;
+}
+
+/*
+	Name		ParticleSystem::readCounts
+	Syntax		ParticleSystem::readCounts()
+	Return		UINT - Particles newly counted as killed
+	Brief		Takes the particles alive from the stream-out query, if the
+				GPU has answered it, without waiting for it
+	Details		The emitter is written out with the particles, so is taken
+				off the count
+*/
+UINT ParticleSystem::readCounts()
+{
+	if (!queryPending_)
+		return 0;
+
+	D3D10_QUERY_DATA_SO_STATISTICS stats;
+	if (soQuery_->GetData(&stats, sizeof(stats), D3D10_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+		return 0;
+
+	queryPending_ = false;
+	if (queryStale_)
+		return 0;
+
+	unsigned int killedNo = killedNo_;
+	liveNo_ = stats.NumPrimitivesWritten > 0 ? (int)stats.NumPrimitivesWritten - 1 : 0;
+	killedNo_ = queryEmitted_ > (unsigned int)liveNo_ ? queryEmitted_ - liveNo_ : 0;
+	return killedNo_ > killedNo ? killedNo_ - killedNo : 0;
+}
+
+/*
+	Name		ParticleSystem::uploadWind
+	Syntax		ParticleSystem::uploadWind()
+	Brief		Copies the wind field rendering has into the wind texture,
+				if it has changed since the last upload
+	Details		The texture is made on the first upload, as the field is
+				empty until the wind has first been applied. Its samples
+				are laid out as the texture's texels, so are copied as
+				they are
+*/
+void ParticleSystem::uploadWind()
+{
+	const M3DVectorField* field = wind_->getRenderField();
+	if (!field->samples || wind_->getRenderVersion() == windVersion_)
+		return;
+
+	RenderBackend* backend = Scene::instance()->getBackend();
+	if (!windTex_)
+	{
+		D3D10_TEXTURE3D_DESC texDesc;
+		texDesc.Width = field->width;
+		texDesc.Height = field->height;
+		texDesc.Depth = field->depth;
+		texDesc.MipLevels = 1;
+		texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		texDesc.Usage = D3D10_USAGE_DEFAULT;
+		texDesc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+		texDesc.CPUAccessFlags = 0;
+		texDesc.MiscFlags = 0;
+
+		HRESULT hr = backend->createTexture3D(&texDesc, 0, &windTex_);
+		if (FAILED(hr))
+		{
+			MessageBox(0, "Creating ps wind texture - Failed", "Error", MB_OK);
+			wind_ = 0;
+			return;
+		}
+
+		hr = d3dDevice_->CreateShaderResourceView(windTex_, 0, &windRV_);
+		if (FAILED(hr))
+		{
+			MessageBox(0, "Creating ps wind view - Failed", "Error", MB_OK);
+			windRV_ = 0;
+			wind_ = 0;
+			return;
+		}
+	}
+
+	UINT rowPitch = field->width * 4 * sizeof(float);
+	UINT depthPitch = rowPitch * field->height;
+	backend->updateSubresource(windTex_, 0, field->samples, rowPitch, 
+							   depthPitch * field->depth, depthPitch);
+	windVersion_ = wind_->getRenderVersion();
+}
+
 /*
 	Name		ParticleSystem::buildVertexBuffer
 	Syntax		ParticleSystem::buildVertexBuffer()
@@ -254,7 +673,8 @@ void ParticleSystem::buildVertexBuffer()
     D3D10_SUBRESOURCE_DATA vinitData;
     vinitData.pSysMem = &p;
 
-	HRESULT hr = d3dDevice_->CreateBuffer(&vbd, &vinitData, &initVertexBuffer_);
+	RenderBackend* backend = Scene::instance()->getBackend();
+	HRESULT hr = backend->createBuffer(&vbd, &vinitData, &initVertexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Creating ps initial buffer - Failed", "Error", MB_OK);
@@ -265,13 +685,13 @@ void ParticleSystem::buildVertexBuffer()
 	vbd.ByteWidth = sizeof(ParticleVertex) * maxParticles_;
     vbd.BindFlags = D3D10_BIND_VERTEX_BUFFER | D3D10_BIND_STREAM_OUTPUT;
 
-    hr = d3dDevice_->CreateBuffer(&vbd, 0, &renderVertexBuffer_);
+    hr = backend->createBuffer(&vbd, 0, &renderVertexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Creating ps render buffer - Failed", "Error", MB_OK);
 		return;
 	}
-	hr = d3dDevice_->CreateBuffer(&vbd, 0, &streamOutVertexBuffer_);
+	hr = backend->createBuffer(&vbd, 0, &streamOutVertexBuffer_);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Creating ps streamout buffer - Failed", "Error", MB_OK);
@@ -7,49 +7,119 @@
 	Name		ParticleSystem
 	Brief		Definition of ParticleSystem Class used to handle the creation, 
 				updating and rendering of a particle system
+	Details		Each system takes a share of the scene's particle budget,
+				which sets how fast it emits and how large it makes new
+				particles. The particles emitted are counted by following
+				the emitter's rule on the CPU, and the particles alive read
+				back from a stream-out statistics query once the GPU has
+				answered it, a frame or two late, so the killed particles
+				are those emitted before the query less those alive after.
+
+				A system emitted over an area can wrap its particles in a
+				box around the emitter, where the effect file recycles them
+				at the top as they fall out of it. The box is filled to the
+				particles the system's share keeps alive, and once full is
+				not thinned when the share is lowered, until a reset
+
+				Leaves and snow can be blown by a season's wind field. Its
+				samples are uploaded to a 3D texture whenever rendering
+				takes a new version of them, which the effect samples for
+				each particle
+
+				The particles land on the terrain as the system's rules say,
+				killed or resting a while where they landed. Its heights are
+				uploaded to a texture once, which the stream-out pass
+				samples below each falling particle, filtered linearly
+				where the device can filter it. A wrapping system
+				recycles a particle that lands, leaving a resting copy, so
+				the live count read back includes the particles resting
+
+				A system is built from a ParticleEffect, whose effect file
+				it is drawn with and whose rules are given to it, so the
+				count of particles emitted follows the effect file
 */
 
 #ifndef _PARTICLESYSTEM_H
 #define _PARTICLESYSTEM_H
 
 #include <d3dx10.h>
+#include <string>
+#include "ParticleSystem/ParticleSimulation.hpp"
 
+class ParticleEffect;
 class ParticleShader;
-enum Particle;
+class WindField;
 
 class ParticleSystem
 {
 public:
-	ParticleSystem(Particle particle);
+	explicit ParticleSystem(const ParticleEffect& effect);
 	~ParticleSystem();
 
 	float getAge()const { return age_; }; // Time elapsed since the system was reset
 
+	// Counted on the render side, since the system was reset
+	int getLiveNo() const { return liveNo_; };
+	unsigned int getEmittedNo() const { return emittedNo_; };
+	unsigned int getKilledNo() const { return killedNo_; };
+
 	void setEyePos(const D3DXVECTOR3& eyePosW);
 	void setEmitPos(const D3DXVECTOR3& emitPosW);
 	void setEmitDir(const D3DXVECTOR3& emitDirW);
+	void setWrapping(bool wrapping);
+	void setWind(const WindField* wind);
+	void setGround(const M3DHeightField* ground);
 
 	void initialise(ID3D10Device* device, ID3D10ShaderResourceView* texArrayRV, 
 					UINT maxParticles);
 
 	void reset();
-	void update(float dt, float sceneTime);
+	void update(float dt, double sceneTime);
 	void render();
 
+	// Simulation to render hand over
+	void publish();
+	void apply();
+
 private:
 	void buildVertexBuffer();
+	UINT countEmitted(float emitScale, float wrapCount);
+	UINT readCounts();
+	void uploadWind();
 
 	ParticleSystem(const ParticleSystem& rhs);
 	ParticleSystem& operator = (const ParticleSystem& rhs);
 
-	Particle particle_;
+	std::string effectFile_;
+	ParticleRules rules_;
  
 	UINT maxParticles_;
 	bool firstRun_;
+	int budgetId_;			// Handle in the scene's particle budget
+	bool wrapping_;
+
+	// Simulation side
+	double simTime_;
+	float simStep_;			// Time simulated since the last publish
+	float age_;
+	bool resetRequested_;
 
+	// Published, waiting to be applied
+	double pendingTime_;
+	float pendingStep_;
+	bool pendingReset_;
+
+	// Render side
 	float sceneTime_;
 	float timeStep_;
-	float age_;
+	float emitterAge_;		// Follows the emitter particle's age
+	int liveNo_;
+	unsigned int emittedNo_;
+	unsigned int killedNo_;
+	ID3D10Query* soQuery_;
+	bool queryPending_;
+	bool queryStale_;		// Issued before a reset, so its answer is dropped
+	unsigned int queryEmitted_;	// Particles emitted when the query was issued
 
 	D3DXVECTOR4 eyePosW_;
 	D3DXVECTOR4 emitPosW_;
@@ -63,6 +133,18 @@ private:
 	ID3D10ShaderResourceView* texArrayRV_;
 	ID3D10ShaderResourceView* randomTexRV_;
 
+	const WindField* wind_;
+	ID3D10Texture3D* windTex_;
+	ID3D10ShaderResourceView* windRV_;
+	unsigned int windVersion_;	// Of the field last uploaded
+
+	ID3D10Texture2D* groundTex_;
+	ID3D10ShaderResourceView* groundRV_;
+	D3DXVECTOR3 groundToU_;		// World x, z and one to the ground texture
+	D3DXVECTOR3 groundToV_;
+	D3DXVECTOR2 groundToWorld_;	// Scale and offset of its samples to heights
+	bool groundLinear_;			// The device can filter the heights' format
+
 	ParticleShader* particleShader_;
 };
 
@@ -0,0 +1,237 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		PooledSystem
+	Brief		Implementation of the PooledSystem class
+*/
+
+#include "ParticleSystem/PooledSystem.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "Scene/Scene.hpp"
+#include "Shaders/ParticleShader.hpp"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	// Particle types, as the effect files give them. A resting flare is
+	// drawn where it is, at the size it has
+	const unsigned int PT_FLARE = 1;
+	const unsigned int PT_RESTING = 256;
+}
+
+/*
+	Name		PooledSystem::PooledSystem
+	Syntax		PooledSystem(const ParticleEffect& effect)
+	Param		const ParticleEffect& effect - The description of the
+				emitters' particles and the effect file they are drawn with
+	Brief		PooledSystem constructor initialises member variables
+*/
+PooledSystem::PooledSystem(const ParticleEffect& effect)
+: slotParticles_(effect.getMaxParticles()), pendingNo_(0), verticesNo_(0),
+  pendingNew_(false), d3dDevice_(0), vertexBuffer_(0), texArrayRV_(0),
+  particleShader_(0)
+{
+	effectFile_ = effect.getEffectFile();
+	rules_ = effect.getRules();
+
+	eyePosW_ = D3DXVECTOR4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+/*
+	Name		PooledSystem::~PooledSystem
+	Syntax		~PooledSystem()
+	Brief		PooledSystem destructor
+*/
+PooledSystem::~PooledSystem()
+{
+	delete particleShader_;
+
+	if (vertexBuffer_)
+	{
+		vertexBuffer_->Release();
+		vertexBuffer_ = 0;
+	}
+}
+
+/*
+	Name		PooledSystem::initialise
+	Syntax		PooledSystem::initialise(ID3D10Device* device,
+										 ID3D10ShaderResourceView* texArrayRV,
+										 int maxEmitters)
+	Param		ID3D10Device* device - The D3D device
+	Param		ID3D10ShaderResourceView* texArrayRV - Handle to textures used
+				by the particles
+	Param		int maxEmitters - Most emitters alive at once
+	Brief		Allocates the pool, its vertices and their buffer
+	Details		Each emitter's slot holds the effect's MaxParticles
+*/
+void PooledSystem::initialise(ID3D10Device* device, ID3D10ShaderResourceView* texArrayRV,
+							  int maxEmitters)
+{
+	d3dDevice_ = device;
+	texArrayRV_ = texArrayRV;
+
+	particleShader_ = new ParticleShader;
+	particleShader_->initialise(effectFile_);
+	particleShader_->setRules(rules_);
+
+	pool_.initialise(maxEmitters, slotParticles_);
+
+	UINT maxParticles = (UINT)(pool_.getMaxEmitters() * pool_.getSlotParticles());
+	pending_.resize(maxParticles);
+	vertices_.resize(maxParticles);
+
+	D3D10_BUFFER_DESC vbd;
+	vbd.Usage = D3D10_USAGE_DEFAULT;
+	vbd.ByteWidth = sizeof(ParticleVertex) * maxParticles;
+	vbd.BindFlags = D3D10_BIND_VERTEX_BUFFER;
+	vbd.CPUAccessFlags = 0;
+	vbd.MiscFlags = 0;
+
+	RenderBackend* backend = Scene::instance()->getBackend();
+	HRESULT hr = backend->createBuffer(&vbd, 0, &vertexBuffer_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating pooled buffer - Failed", "Error", MB_OK);
+		vertexBuffer_ = 0;
+	}
+}
+
+/*
+	Name		PooledSystem::spawn
+	Syntax		PooledSystem::spawn(const M3DVector3f emitPos, float duration)
+	Param		const M3DVector3f emitPos - Where the emitter's bursts are
+				emitted about
+	Param		float duration - Time it emits for
+	Return		int - The emitter, or -1 if every slot is taken
+	Brief		Starts an emitter with the effect's rules
+*/
+int PooledSystem::spawn(const M3DVector3f emitPos, float duration)
+{
+	return pool_.spawn(&rules_, emitPos, duration);
+}
+
+/*
+	Name		PooledSystem::update
+	Syntax		PooledSystem::update(float dt)
+	Param		float dt - Time step
+	Brief		Steps the emitters and their particles
+*/
+void PooledSystem::update(float dt)
+{
+	pool_.update(dt);
+}
+
+/*
+	Name		PooledSystem::publish
+	Syntax		PooledSystem::publish()
+	Brief		Copies the live particles out as vertices for rendering
+	Details		The particles are given as resting flares of the effect's
+				first slice, at rest where they are, and their size is
+				grown here by their age, as the effect file would grow a
+				falling particle's
+*/
+void PooledSystem::publish()
+{
+	PROFILE_ZONE("PooledSystem::publish");
+
+	unsigned int type = PT_RESTING + PT_FLARE + rules_.textureFirst;
+	float growth = (rules_.sizeGrowth - 1.0f) / rules_.lifetime;
+	UINT n = 0;
+
+	for (int i = 0; i < pool_.getEmittersNo(); ++i)
+	{
+		int emitter = pool_.getEmitter(i);
+		int count = pool_.getCount(emitter);
+		const float* x = pool_.getX(emitter);
+		const float* y = pool_.getY(emitter);
+		const float* z = pool_.getZ(emitter);
+		const float* age = pool_.getAge(emitter);
+
+		for (int j = 0; j < count; ++j)
+		{
+			ParticleVertex& v = pending_[n++];
+			v.initialPos = D3DXVECTOR3(x[j], y[j], z[j]);
+			v.initialVel = D3DXVECTOR3(0.0f, 0.0f, 0.0f);
+			float size = rules_.size * (1.0f + growth * age[j]);
+			v.size = D3DXVECTOR2(size, size);
+			v.age = age[j];
+			v.type = type;
+		}
+	}
+
+	pendingNo_ = n;
+	pendingNew_ = true;
+}
+
+/*
+	Name		PooledSystem::apply
+	Syntax		PooledSystem::apply()
+	Brief		Takes the published vertices for rendering
+	Details		The vertices are swapped, not copied, so the next publish
+				writes over those last drawn
+*/
+void PooledSystem::apply()
+{
+	if (!pendingNew_)
+		return;
+
+	vertices_.swap(pending_);
+	verticesNo_ = pendingNo_;
+	pendingNew_ = false;
+}
+
+/*
+	Name		PooledSystem::setEyePos
+	Syntax		PooledSystem::setEyePos(const D3DXVECTOR3& eyePosW)
+	Param		const D3DXVECTOR3& eyePosW - Position to set as eye position
+	Brief		Sets the position of the eye (camera) in the world
+*/
+void PooledSystem::setEyePos(const D3DXVECTOR3& eyePosW)
+{
+	eyePosW_ = D3DXVECTOR4(eyePosW.x, eyePosW.y, eyePosW.z, 1.0f);
+}
+
+/*
+	Name		PooledSystem::render
+	Syntax		PooledSystem::render()
+	Brief		Uploads the vertices taken and draws them
+	Details		Only the part of the buffer the vertices fill is uploaded.
+				Nothing is streamed out, so the draw technique alone is run
+*/
+void PooledSystem::render()
+{
+	PROFILE_ZONE("PooledSystem::render");
+
+	if (!vertexBuffer_ || verticesNo_ == 0)
+		return;
+
+	RenderBackend* backend = Scene::instance()->getBackend();
+
+	UINT bytes = sizeof(ParticleVertex) * verticesNo_;
+	D3D10_BOX box = { 0, 0, 0, bytes, 1, 1 };
+	backend->updateSubresource(vertexBuffer_, 0, &vertices_[0], bytes, bytes, 0, &box);
+
+	D3DXVECTOR4 emitPosW(0.0f, 0.0f, 0.0f, 1.0f);
+	D3DXVECTOR4 emitDirW(0.0f, 1.0f, 0.0f, 0.0f);
+	particleShader_->setupRender(0.0f, 0.0f, &eyePosW_, &emitPosW, &emitDirW,
+								 texArrayRV_, 0);
+
+	// Set IA stage
+	d3dDevice_->IASetInputLayout(particleShader_->getLayout());
+	d3dDevice_->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_POINTLIST);
+
+	UINT stride = sizeof(ParticleVertex);
+	UINT offset = 0;
+	d3dDevice_->IASetVertexBuffers(0, 1, &vertexBuffer_, &stride, &offset);
+
+	D3D10_TECHNIQUE_DESC techDesc;
+	particleShader_->setDrawTech(&techDesc);
+	for (UINT p = 0; p < techDesc.Passes; ++p)
+	{
+		particleShader_->applyDrawPass(p);
+		backend->draw(verticesNo_, 0);
+	}
+}
@@ -0,0 +1,78 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		PooledSystem
+	Brief		Definition of the PooledSystem class - many small emitters,
+				such as splashes, run in an EmitterPool and drawn with the
+				draw technique of a particle effect file
+	Details		The emitters are spawned and the pool stepped on the
+				simulation side. Each publish copies the live particles out
+				as particle vertices, where they are and at the size their
+				age has grown them to, and rendering uploads those it takes
+				into a vertex buffer made once for the whole pool, so the
+				effect file draws them as still particles.
+
+				The vertices are kept in storage sized for the pool, so
+				nothing is allocated as the emitters come and go
+*/
+
+#ifndef POOLEDSYSTEM_H
+#define POOLEDSYSTEM_H
+
+#include <d3dx10.h>
+#include <string>
+#include <vector>
+#include "ParticleSystem/EmitterPool.hpp"
+#include "Vertex/Vertex.hpp"
+
+class ParticleEffect;
+class ParticleShader;
+
+class PooledSystem
+{
+public:
+	explicit PooledSystem(const ParticleEffect& effect);
+	~PooledSystem();
+
+	void initialise(ID3D10Device* device, ID3D10ShaderResourceView* texArrayRV,
+					int maxEmitters);
+
+	// Simulation side
+	int spawn(const M3DVector3f emitPos, float duration);
+	void update(float dt);
+	const EmitterPool& getPool() const { return pool_; };
+
+	// Simulation to render hand over
+	void publish();
+	void apply();
+
+	void setEyePos(const D3DXVECTOR3& eyePosW);
+	void render();
+
+private:
+	PooledSystem(const PooledSystem& rhs);
+	PooledSystem& operator = (const PooledSystem& rhs);
+
+	std::string effectFile_;
+	ParticleRules rules_;
+	int slotParticles_;
+	EmitterPool pool_;
+
+	// Particle vertices, as published and as taken for rendering
+	std::vector<ParticleVertex> pending_;
+	std::vector<ParticleVertex> vertices_;
+	UINT pendingNo_;
+	UINT verticesNo_;
+	bool pendingNew_;		// Published since the last apply
+
+	D3DXVECTOR4 eyePosW_;
+
+	ID3D10Device* d3dDevice_;
+	ID3D10Buffer* vertexBuffer_;
+	ID3D10ShaderResourceView* texArrayRV_;
+	ParticleShader* particleShader_;
+};
+
+#endif // POOLEDSYSTEM_H
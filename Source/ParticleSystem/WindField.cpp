@@ -0,0 +1,378 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		WindField
+	Brief		Implementation of the WindField class
+*/
+
+#include "ParticleSystem/WindField.hpp"
+#include <math.h>
+#include <float.h>
+#include "Maths/m3dSIMD.h"
+#include "Profiler/Profiler.hpp"
+
+const float WindField::GUST_RATE = 0.2f;
+const float WindField::EDDY_CHANGE = 0.05f;
+const float WindField::CURL_STEP = 0.25f;
+
+namespace
+{
+	/*
+		Name		lattice
+		Syntax		lattice(int x, int y, int z, unsigned int salt)
+		Param		int x, y, z - A point of the noise's integer lattice
+		Param		unsigned int salt - Picks one of many unrelated lattices
+		Return		float - A random value from -1 to 1, the same each time
+					for the same point and salt
+	*/
+	inline float lattice(int x, int y, int z, unsigned int salt)
+	{
+		unsigned int h = (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^
+						 (unsigned int)z * 83492791u ^ salt * 2654435761u;
+		h ^= h >> 13;
+		h *= 1274126177u;
+		h ^= h >> 16;
+		return (float)(h & 0xffffff) * (2.0f / 16777215.0f) - 1.0f;
+	}
+}
+
+/*
+	Name		WindField::WindField
+	Syntax		WindField()
+	Brief		WindField constructor, with no samples and no wind
+*/
+WindField::WindField()
+: width_(0), height_(0), depth_(0), spacing_(1.0f), seed_(1), gusts_(0.0f), turbulence_(0.0f),
+  eddySize_(1.0f), period_(1.0f), from_(0), to_(1), building_(2), keyNo_(0), phase_(0.0f),
+  rowsDone_(0), rowsBuilt_(0), version_(0), publishedVersion_(0), renderVersion_(0)
+{
+	m3dLoadVector3(origin_, 0.0f, 0.0f, 0.0f);
+	m3dLoadVector3(wind_, 0.0f, 0.0f, 0.0f);
+	m3dInitVectorField(&field_, 0, 0, 0, 0, origin_, 1.0f);
+	m3dInitVectorField(&renderField_, 0, 0, 0, 0, origin_, 1.0f);
+}
+
+/*
+	Name		WindField::initialise
+	Syntax		WindField::initialise(const M3DHeightField* ground,
+				float spacing, float above, unsigned int seed)
+	Param		const M3DHeightField* ground - The ground the wind blows over
+	Param		float spacing - World distance between samples
+	Param		float above - Height over the highest ground to reach
+	Param		unsigned int seed - Seed of the noise
+	Brief		Covers the ground with samples, from its lowest point to
+				above over its highest, and builds the first keyframes
+*/
+void WindField::initialise(const M3DHeightField* ground, float spacing, float above,
+						   unsigned int seed)
+{
+	// The ground's corners, taken back out of its grid
+	const float* m = ground->toGrid;
+	float det = m[0] * m[4] - m[1] * m[3];
+	float lowX = FLT_MAX, highX = -FLT_MAX, lowZ = FLT_MAX, highZ = -FLT_MAX;
+	for (int corner = 0; corner < 4; ++corner)
+	{
+		float gx = (corner & 1) ? (float)(ground->width - 1) - m[2] : -m[2];
+		float gz = (corner & 2) ? (float)(ground->depth - 1) - m[5] : -m[5];
+		float x = (m[4] * gx - m[1] * gz) / det;
+		float z = (m[0] * gz - m[3] * gx) / det;
+		lowX = x < lowX ? x : lowX;
+		highX = x > highX ? x : highX;
+		lowZ = z < lowZ ? z : lowZ;
+		highZ = z > highZ ? z : highZ;
+	}
+
+	float lowY = FLT_MAX, highY = -FLT_MAX;
+	for (int i = 0; i < ground->width * ground->depth; ++i)
+	{
+		lowY = ground->heights[i] < lowY ? ground->heights[i] : lowY;
+		highY = ground->heights[i] > highY ? ground->heights[i] : highY;
+	}
+	lowY = lowY * ground->heightScale + ground->heightOffset;
+	highY = highY * ground->heightScale + ground->heightOffset + above;
+
+	spacing_ = spacing;
+	seed_ = seed;
+	m3dLoadVector3(origin_, lowX, lowY, lowZ);
+	width_ = (int)ceilf((highX - lowX) / spacing) + 1;
+	height_ = (int)ceilf((highY - lowY) / spacing) + 1;
+	depth_ = (int)ceilf((highZ - lowZ) / spacing) + 1;
+	width_ = width_ > 2 ? width_ : 2;
+	height_ = height_ > 2 ? height_ : 2;
+	depth_ = depth_ > 2 ? depth_ : 2;
+
+	int floats = getSamplesNo() * 4;
+	for (int key = 0; key < 3; ++key)
+		keys_[key].assign(floats, 0.0f);
+	current_.assign(floats, 0.0f);
+	published_.assign(floats, 0.0f);
+	rendered_.assign(floats, 0.0f);
+	m3dInitVectorField(&field_, &current_[0], width_, height_, depth_, origin_, spacing_);
+	m3dInitVectorField(&renderField_, &rendered_[0], width_, height_, depth_, origin_,
+					   spacing_);
+
+	keyNo_ = 0;
+	setWind(wind_, gusts_, turbulence_, eddySize_, period_);
+}
+
+/*
+	Name		WindField::setWind
+	Syntax		WindField::setWind(const M3DVector3f wind, float gusts,
+				float turbulence, float eddySize, float period)
+	Param		const M3DVector3f wind - The wind's mean velocity
+	Param		float gusts - Fraction the wind's speed rises and falls by
+	Param		float turbulence - Most speed the eddies add, though most add
+				a fifth of it or less
+	Param		float eddySize - World size of the eddies
+	Param		float period - Seconds between keyframes
+	Brief		Sets how the wind blows, starting the keyframes again from
+				the current one
+*/
+void WindField::setWind(const M3DVector3f wind, float gusts, float turbulence, float eddySize,
+						float period)
+{
+	m3dCopyVector3(wind_, wind);
+	gusts_ = gusts;
+	turbulence_ = turbulence;
+	eddySize_ = eddySize > 0.0f ? eddySize : 1.0f;
+	period_ = period > 0.0f ? period : 1.0f;
+	if (current_.empty())
+		return;
+
+	int rows = height_ * depth_;
+	buildRows(keys_[from_], keyNo_, 0, rows);
+	buildRows(keys_[to_], keyNo_ + 1, 0, rows);
+	rowsDone_ = 0;
+	phase_ = 0.0f;
+	rowsBuilt_ = 0;
+	blend(0.0f);
+	++version_;
+}
+
+/*
+	Name		WindField::update
+	Syntax		WindField::update(float dt)
+	Param		float dt - Change in time between frames
+	Brief		Moves the field on in time
+	Details		The keyframe being built is kept as far through its rows as
+				the time is through the period, and finished when the period
+				ends
+*/
+void WindField::update(float dt)
+{
+	PROFILE_ZONE("WindField::update");
+
+	if (current_.empty())
+		return;
+
+	const int rows = height_ * depth_;
+	rowsBuilt_ = 0;
+	phase_ += dt;
+	while (phase_ >= period_)
+	{
+		buildRows(keys_[building_], keyNo_ + 2, rowsDone_, rows);
+		int passed = from_;
+		from_ = to_;
+		to_ = building_;
+		building_ = passed;
+		++keyNo_;
+		phase_ -= period_;
+		rowsDone_ = 0;
+	}
+
+	int due = (int)ceilf((float)rows * phase_ / period_);
+	buildRows(keys_[building_], keyNo_ + 2, rowsDone_, due < rows ? due : rows);
+
+	blend(phase_ / period_);
+	++version_;
+}
+
+/*
+	Name		WindField::publish
+	Syntax		WindField::publish()
+	Brief		Copies the field the simulation stepped with for rendering
+*/
+void WindField::publish()
+{
+	if (publishedVersion_ == version_)
+		return;
+
+	published_ = current_;
+	publishedVersion_ = version_;
+}
+
+/*
+	Name		WindField::apply
+	Syntax		WindField::apply()
+	Brief		Takes the published field for rendering
+*/
+void WindField::apply()
+{
+	if (renderVersion_ == publishedVersion_ || published_.empty())
+		return;
+
+	rendered_.swap(published_);
+	renderField_.samples = &rendered_[0];
+	renderVersion_ = publishedVersion_;
+}
+
+/*
+	Name		WindField::getMaxSpeed
+	Syntax		WindField::getMaxSpeed()
+	Return		float - The fastest the wind can blow anywhere
+*/
+float WindField::getMaxSpeed() const
+{
+	return m3dGetVectorLength3(wind_) * (1.0f + fabsf(gusts_)) + turbulence_;
+}
+
+/*
+	Name		WindField::buildRows
+	Syntax		WindField::buildRows(std::vector<float>& key, int keyNo,
+				int first, int last)
+	Param		std::vector<float>& key - The keyframe to build
+	Param		int keyNo - Its number, keyNo periods after initialising
+	Param		int first, last - The rows, along x, to build, from first up
+				to but not including last
+	Brief		Works out the wind at the samples of some rows of a keyframe
+*/
+void WindField::buildRows(std::vector<float>& key, int keyNo, int first, int last)
+{
+	if (last <= first)
+		return;
+
+	float time = (float)keyNo * period_;
+	float gust = 1.0f + gusts_ * noise(time * GUST_RATE, 0.0f, 0.0f, seed_ + 3);
+	M3DVector3f pos, eddy;
+	for (int row = first; row < last; ++row)
+	{
+		pos[1] = origin_[1] + (float)(row % height_) * spacing_;
+		pos[2] = origin_[2] + (float)(row / height_) * spacing_;
+		float* sample = &key[row * width_ * 4];
+		for (int i = 0; i < width_; ++i, sample += 4)
+		{
+			pos[0] = origin_[0] + (float)i * spacing_;
+			getEddy(pos, time, eddy);
+			sample[0] = wind_[0] * gust + eddy[0];
+			sample[1] = wind_[1] * gust + eddy[1];
+			sample[2] = wind_[2] * gust + eddy[2];
+			sample[3] = 0.0f;
+		}
+	}
+
+	if (&key == &keys_[building_])
+		rowsDone_ = last;
+	rowsBuilt_ += last - first;
+}
+
+/*
+	Name		WindField::getEddy
+	Syntax		WindField::getEddy(const M3DVector3f pos, float time,
+				M3DVector3f eddy)
+	Param		const M3DVector3f pos - A world space position
+	Param		float time - Seconds since initialising
+	Param		M3DVector3f eddy - Receives the eddies' velocity there
+	Brief		Works out the curl of the noise potential by central
+				differences
+	Details		Each noise lies from -1 to 1, so each difference is at most
+				2, each component of the curl at most 4 and its length at
+				most 4 root 3, which is scaled to the turbulence
+*/
+void WindField::getEddy(const M3DVector3f pos, float time, M3DVector3f eddy) const
+{
+	float toEddies = 1.0f / eddySize_;
+	float x = (pos[0] - wind_[0] * time) * toEddies;
+	float y = (pos[1] - wind_[1] * time) * toEddies + time * EDDY_CHANGE;
+	float z = (pos[2] - wind_[2] * time) * toEddies;
+
+	const float h = CURL_STEP;
+	M3DVector3f x0, x1, y0, y1, z0, z1;
+	getPotential(x - h, y, z, x0);
+	getPotential(x + h, y, z, x1);
+	getPotential(x, y - h, z, y0);
+	getPotential(x, y + h, z, y1);
+	getPotential(x, y, z - h, z0);
+	getPotential(x, y, z + h, z1);
+
+	float scale = turbulence_ / (4.0f * 1.7320508f);
+	eddy[0] = ((y1[2] - y0[2]) - (z1[1] - z0[1])) * scale;
+	eddy[1] = ((z1[0] - z0[0]) - (x1[2] - x0[2])) * scale;
+	eddy[2] = ((x1[1] - x0[1]) - (y1[0] - y0[0])) * scale;
+}
+
+/*
+	Name		WindField::getPotential
+	Syntax		WindField::getPotential(float x, float y, float z,
+				M3DVector3f potential)
+	Param		float x, y, z - A position in eddy sizes
+	Param		M3DVector3f potential - Receives the potential there
+	Brief		Gets the vector potential whose curl is the eddies, each
+				component an unrelated noise
+*/
+void WindField::getPotential(float x, float y, float z, M3DVector3f potential) const
+{
+	potential[0] = noise(x, y, z, seed_);
+	potential[1] = noise(x, y, z, seed_ + 1);
+	potential[2] = noise(x, y, z, seed_ + 2);
+}
+
+/*
+	Name		WindField::noise
+	Syntax		WindField::noise(float x, float y, float z, unsigned int salt)
+	Param		float x, y, z - A position in lattice units
+	Param		unsigned int salt - Picks the noise
+	Return		float - Smooth noise from -1 to 1
+	Brief		Blends the random values at the eight lattice points around
+				the position, eased so the noise's slope is continuous
+*/
+float WindField::noise(float x, float y, float z, unsigned int salt) const
+{
+	float fx = floorf(x), fy = floorf(y), fz = floorf(z);
+	int ix = (int)fx, iy = (int)fy, iz = (int)fz;
+	float tx = x - fx, ty = y - fy, tz = z - fz;
+	tx = tx * tx * (3.0f - 2.0f * tx);
+	ty = ty * ty * (3.0f - 2.0f * ty);
+	tz = tz * tz * (3.0f - 2.0f * tz);
+
+	float c00 = lattice(ix, iy, iz, salt);
+	c00 += (lattice(ix + 1, iy, iz, salt) - c00) * tx;
+	float c10 = lattice(ix, iy + 1, iz, salt);
+	c10 += (lattice(ix + 1, iy + 1, iz, salt) - c10) * tx;
+	float c01 = lattice(ix, iy, iz + 1, salt);
+	c01 += (lattice(ix + 1, iy, iz + 1, salt) - c01) * tx;
+	float c11 = lattice(ix, iy + 1, iz + 1, salt);
+	c11 += (lattice(ix + 1, iy + 1, iz + 1, salt) - c11) * tx;
+
+	float c0 = c00 + (c10 - c00) * ty;
+	float c1 = c01 + (c11 - c01) * ty;
+	return c0 + (c1 - c0) * tz;
+}
+
+/*
+	Name		WindField::blend
+	Syntax		WindField::blend(float t)
+	Param		float t - Fraction of the way through the period
+	Brief		Blends the field in use between the keyframes either side
+*/
+void WindField::blend(float t)
+{
+	const float* from = &keys_[from_][0];
+	const float* to = &keys_[to_][0];
+	float* current = &current_[0];
+	const int floats = (int)current_.size();
+
+	int i = 0;
+#ifdef M3D_SSE
+	const __m128 vt = _mm_set1_ps(t);
+	for (; i + 4 <= floats; i += 4)
+	{
+		__m128 a = _mm_loadu_ps(from + i);
+		__m128 b = _mm_loadu_ps(to + i);
+		_mm_storeu_ps(current + i, _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), vt)));
+	}
+#endif
+	for (; i < floats; ++i)
+		current[i] = from[i] + (to[i] - from[i]) * t;
+}
@@ -0,0 +1,107 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		WindField
+	Brief		Definition of the WindField class - a wind blowing over the
+				terrain, with gusts and eddies, kept on a coarse grid that
+				the particle systems of a season share
+	Details		The wind at a point is the season's wind, strengthened and
+				weakened by gusts, plus eddies: the curl of a smooth noise
+				potential, which swirls without gathering or spreading the
+				particles it carries. The eddies drift along with the wind
+				and change slowly as they go.
+
+				Working out the curl for every sample is too slow to do each
+				frame, so the field is kept as keyframes a period apart, and
+				the one in use blended between the two either side of the
+				time. The keyframe after those is built a few rows at a time
+				over the period, in step with the time, so each update does
+				the same small share of the work.
+
+				The samples are four floats each, laid out as a four
+				component float texture, so the field the simulation steps
+				with can be handed over to rendering and uploaded as it is.
+				Particles sample it trilinearly, four at a time, through
+				m3dSampleVectors
+*/
+
+#ifndef WINDFIELD_H
+#define WINDFIELD_H
+
+#include <vector>
+#include "Maths/math3d.h"
+#include "Maths/m3dField.h"
+#include "Maths/m3dHeight.h"
+
+class WindField
+{
+public:
+	WindField();
+
+	void initialise(const M3DHeightField* ground, float spacing, float above,
+					unsigned int seed = 1);
+	void setWind(const M3DVector3f wind, float gusts, float turbulence, float eddySize,
+				 float period);
+
+	void update(float dt);
+
+	// Simulation to render hand over
+	void publish();
+	void apply();
+
+	// The field the simulation steps with, and the one handed to rendering
+	const M3DVectorField* getField() const { return &field_; };
+	const M3DVectorField* getRenderField() const { return &renderField_; };
+	unsigned int getRenderVersion() const { return renderVersion_; };
+
+	float getMaxSpeed() const;
+	int getSamplesNo() const { return width_ * height_ * depth_; };
+	int getRowsBuilt() const { return rowsBuilt_; };	// By the last update
+
+	static const float GUST_RATE;	// Gusts a second, roughly
+	static const float EDDY_CHANGE;	// Eddy sizes the potential moves through a second
+	static const float CURL_STEP;	// Step of the curl's differences, in eddy sizes
+
+private:
+	void buildRows(std::vector<float>& key, int keyNo, int first, int last);
+	void getEddy(const M3DVector3f pos, float time, M3DVector3f eddy) const;
+	void getPotential(float x, float y, float z, M3DVector3f potential) const;
+	float noise(float x, float y, float z, unsigned int salt) const;
+	void blend(float t);
+
+	int width_;
+	int height_;
+	int depth_;
+	M3DVector3f origin_;
+	float spacing_;
+	unsigned int seed_;
+
+	M3DVector3f wind_;
+	float gusts_;					// Fraction the wind's speed varies by
+	float turbulence_;				// Most speed the eddies add
+	float eddySize_;
+	float period_;					// Seconds between keyframes
+
+	// Keyframes at the start and end of the period, and the one after
+	std::vector<float> keys_[3];
+	int from_, to_, building_;
+	int keyNo_;						// Keyframes passed since initialising
+	float phase_;					// Time into the period
+	int rowsDone_;					// Rows of the keyframe being built
+	int rowsBuilt_;
+
+	std::vector<float> current_;
+	M3DVectorField field_;
+	unsigned int version_;
+
+	// Published, waiting to be applied, then rendered
+	std::vector<float> published_;
+	unsigned int publishedVersion_;
+	std::vector<float> rendered_;
+	M3DVectorField renderField_;
+	unsigned int renderVersion_;
+};
+
+#endif // WINDFIELD_H
@@ -0,0 +1,363 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Profiler
+	Brief		Definition of the hierarchical CPU profiler - scoped zones are
+				written to a lock-free ring buffer owned by each thread, and
+				gathered once a frame into a tree of timings
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	// Ring of the calling thread, made the first time the thread opens a zone
+	__declspec(thread) ProfileRing* threadRing = 0;
+
+	/*
+		Name		earlierEvent
+		Syntax		earlierEvent(const ProfileEvent& lhs, const ProfileEvent& rhs)
+		Return		bool - True if lhs should be placed before rhs
+		Brief		Orders events by thread, then start time, then depth, so
+					that a zone always comes before the zones nested in it
+	*/
+	bool earlierEvent(const ProfileEvent& lhs, const ProfileEvent& rhs)
+	{
+		if (lhs.threadId != rhs.threadId) return lhs.threadId < rhs.threadId;
+		if (lhs.start != rhs.start) return lhs.start < rhs.start;
+		return lhs.depth < rhs.depth;
+	}
+}
+
+/*
+	Name		ProfileRing::ProfileRing
+	Syntax		ProfileRing(UINT threadId)
+	Param		UINT threadId - Id of the thread that owns the ring
+	Brief		ProfileRing constructor initialises member variables
+*/
+ProfileRing::ProfileRing(UINT threadId)
+: depth(0), writeIndex_(0), readIndex_(0), dropped_(0), threadId_(threadId)
+{
+}
+
+/*
+	Name		ProfileRing::push
+	Syntax		ProfileRing::push(const ProfileEvent& event)
+	Param		const ProfileEvent& event - The completed zone
+	Brief		Writes an event to the ring - only called by the owning thread
+*/
+void ProfileRing::push(const ProfileEvent& event)
+{
+	LONG write = writeIndex_;
+	if ((ULONG)write - (ULONG)readIndex_ >= CAPACITY)
+	{
+		InterlockedIncrement(&dropped_);
+		return;
+	}
+
+	events_[write & (CAPACITY - 1)] = event;
+
+	// Publish the event only once it has been written
+	MemoryBarrier();
+	writeIndex_ = write + 1;
+}
+
+/*
+	Name		ProfileRing::drain
+	Syntax		ProfileRing::drain(std::vector<ProfileEvent>* events)
+	Param		std::vector<ProfileEvent>* events - Receives the events
+	Return		UINT - The number of events read
+	Brief		Reads every event published to the ring
+*/
+UINT ProfileRing::drain(std::vector<ProfileEvent>* events)
+{
+	LONG write = writeIndex_;
+	LONG read = readIndex_;
+	MemoryBarrier();
+
+	for (LONG i = read; i != write; ++i)
+	{
+		events->push_back(events_[i & (CAPACITY - 1)]);
+	}
+
+	// Free the slots only once they have been read
+	MemoryBarrier();
+	readIndex_ = write;
+
+	return (UINT)((ULONG)write - (ULONG)read);
+}
+
+Profiler* Profiler::instance_ = 0;
+
+/*
+	Name		Profiler::instance
+	Syntax		Profiler::instance()
+	Brief		Create a single instance of Profiler
+*/
+Profiler* Profiler::instance()
+{
+	if (!instance_)
+		instance_ = new Profiler();
+
+	return instance_;
+}
+
+/*
+	Name		Profiler::Profiler
+	Syntax		Profiler()
+	Brief		Profiler constructor initialises member variables
+*/
+Profiler::Profiler()
+: framesNo_(0), traceStart_(0), traceFile_(0), firstTraceEvent_(true)
+{
+	InitializeCriticalSection(&ringsLock_);
+
+	__int64 countsPerSec;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	countsToMs_ = 1000.0 / (double)countsPerSec;
+}
+
+/*
+	Name		Profiler::~Profiler
+	Syntax		~Profiler()
+	Brief		Profiler destructor closes the trace and frees the rings
+*/
+Profiler::~Profiler()
+{
+	endTrace();
+
+	for (size_t i = 0; i < rings_.size(); ++i)
+	{
+		delete rings_[i];
+	}
+	DeleteCriticalSection(&ringsLock_);
+}
+
+/*
+	Name		Profiler::getThreadRing
+	Syntax		Profiler::getThreadRing()
+	Return		ProfileRing* - The ring of the calling thread
+	Brief		Gets the ring of the calling thread, making it the first time
+*/
+ProfileRing* Profiler::getThreadRing()
+{
+	if (!threadRing)
+	{
+		threadRing = new ProfileRing(GetCurrentThreadId());
+
+		EnterCriticalSection(&ringsLock_);
+		rings_.push_back(threadRing);
+		LeaveCriticalSection(&ringsLock_);
+	}
+	return threadRing;
+}
+
+/*
+	Name		Profiler::endFrame
+	Syntax		Profiler::endFrame()
+	Brief		Gathers the zones completed this frame from every thread
+	Details		The zones are summed into the frame's tree, added to the
+				totals and, if a trace is being written, appended to it
+*/
+void Profiler::endFrame()
+{
+	frameEvents_.clear();
+
+	EnterCriticalSection(&ringsLock_);
+	for (size_t i = 0; i < rings_.size(); ++i)
+	{
+		rings_[i]->drain(&frameEvents_);
+	}
+	LeaveCriticalSection(&ringsLock_);
+
+	std::sort(frameEvents_.begin(), frameEvents_.end(), earlierEvent);
+
+	buildFrameNodes();
+
+	// Add the frame's tree to the totals
+	std::vector<int> totalIndex(frameNodes_.size());
+	for (size_t i = 0; i < frameNodes_.size(); ++i)
+	{
+		const ProfileNode& node = frameNodes_[i];
+		int parent = node.parent < 0 ? -1 : totalIndex[node.parent];
+		int total = findOrAddNode(&totalNodes_, parent, node.name, node.depth);
+
+		totalNodes_[total].ms += node.ms;
+		totalNodes_[total].calls += node.calls;
+		totalIndex[i] = total;
+	}
+	++framesNo_;
+
+	if (traceFile_)
+		writeTraceEvents();
+}
+
+/*
+	Name		Profiler::beginTrace
+	Syntax		Profiler::beginTrace(const std::string& fileName)
+	Param		const std::string& fileName - The file the trace is written to
+	Return		bool - False if the file could not be created
+	Brief		Starts writing every zone to a Chrome trace JSON file
+	Details		The file can be opened in chrome://tracing
+*/
+bool Profiler::beginTrace(const std::string& fileName)
+{
+	endTrace();
+
+	if (fopen_s(&traceFile_, fileName.c_str(), "w") != 0)
+	{
+		traceFile_ = 0;
+		return false;
+	}
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&traceStart_);
+	firstTraceEvent_ = true;
+	fprintf(traceFile_, "{\"traceEvents\":[\n");
+	return true;
+}
+
+/*
+	Name		Profiler::endTrace
+	Syntax		Profiler::endTrace()
+	Brief		Finishes and closes the trace file
+*/
+void Profiler::endTrace()
+{
+	if (traceFile_)
+	{
+		fprintf(traceFile_, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		fclose(traceFile_);
+		traceFile_ = 0;
+	}
+}
+
+/*
+	Name		Profiler::writeSummary
+	Syntax		Profiler::writeSummary(FILE* file)
+	Param		FILE* file - The file the summary is written to
+	Brief		Writes the average time and calls per frame of every zone,
+				with nested zones indented under their parents
+*/
+void Profiler::writeSummary(FILE* file) const
+{
+	double frames = framesNo_ ? (double)framesNo_ : 1.0;
+
+	fprintf(file, "zone                                      ms/frame  calls/frame\n");
+	for (size_t i = 0; i < totalNodes_.size(); ++i)
+	{
+		if (totalNodes_[i].parent < 0)
+			writeNode(file, (int)i, frames);
+	}
+}
+
+/*
+	Name		Profiler::findOrAddNode
+	Syntax		Profiler::findOrAddNode(std::vector<ProfileNode>* nodes,
+										int parent, const char* name,
+										UINT depth)
+	Param		std::vector<ProfileNode>* nodes - The tree to search
+	Param		int parent - Index of the parent node, -1 for a root
+	Param		const char* name - Name of the zone
+	Param		UINT depth - Depth of the zone
+	Return		int - Index of the node
+	Brief		Finds the node for a zone under a parent, adding it if needed
+*/
+int Profiler::findOrAddNode(std::vector<ProfileNode>* nodes, int parent,
+							const char* name, UINT depth)
+{
+	for (size_t i = 0; i < nodes->size(); ++i)
+	{
+		const ProfileNode& node = (*nodes)[i];
+		if (node.parent == parent &&
+			(node.name == name || strcmp(node.name, name) == 0))
+		{
+			return (int)i;
+		}
+	}
+
+	ProfileNode node = { name, parent, depth, 0.0, 0 };
+	nodes->push_back(node);
+	return (int)nodes->size() - 1;
+}
+
+/*
+	Name		Profiler::buildFrameNodes
+	Syntax		Profiler::buildFrameNodes()
+	Brief		Sums the sorted events of the frame into a tree
+	Details		Events are sorted so that each zone comes before the zones
+				nested in it, so the parent of an event is the last node
+				seen one level up on the same thread
+*/
+void Profiler::buildFrameNodes()
+{
+	const UINT MAX_DEPTH = 64;
+	int open[MAX_DEPTH];
+
+	frameNodes_.clear();
+
+	for (size_t i = 0; i < frameEvents_.size(); ++i)
+	{
+		const ProfileEvent& event = frameEvents_[i];
+		if (event.depth >= MAX_DEPTH)
+			continue;
+
+		int parent = event.depth == 0 ? -1 : open[event.depth - 1];
+		int node = findOrAddNode(&frameNodes_, parent, event.name, event.depth);
+
+		frameNodes_[node].ms += (event.end - event.start) * countsToMs_;
+		++frameNodes_[node].calls;
+		open[event.depth] = node;
+	}
+}
+
+/*
+	Name		Profiler::writeTraceEvents
+	Syntax		Profiler::writeTraceEvents()
+	Brief		Appends the frame's events to the trace as complete events
+*/
+void Profiler::writeTraceEvents()
+{
+	double countsToUs = countsToMs_ * 1000.0;
+
+	for (size_t i = 0; i < frameEvents_.size(); ++i)
+	{
+		const ProfileEvent& event = frameEvents_[i];
+		if (event.start < traceStart_)
+			continue;
+
+		fprintf(traceFile_,
+			"%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+			firstTraceEvent_ ? "" : ",\n", event.name,
+			(event.start - traceStart_) * countsToUs,
+			(event.end - event.start) * countsToUs, event.threadId);
+		firstTraceEvent_ = false;
+	}
+}
+
+/*
+	Name		Profiler::writeNode
+	Syntax		Profiler::writeNode(FILE* file, int node, double frames)
+	Param		FILE* file - The file the summary is written to
+	Param		int node - Index of the node to write
+	Param		double frames - Number of frames the totals are summed over
+	Brief		Writes a node of the totals and then the nodes nested in it
+*/
+void Profiler::writeNode(FILE* file, int node, double frames) const
+{
+	const ProfileNode& n = totalNodes_[node];
+
+	char label[64];
+	_snprintf_s(label, sizeof(label), _TRUNCATE, "%*s%s", n.depth * 2, "", n.name);
+	fprintf(file, "%-40s %10.4f %12.1f\n", label, n.ms / frames, n.calls / frames);
+
+	for (size_t i = 0; i < totalNodes_.size(); ++i)
+	{
+		if (totalNodes_[i].parent == node)
+			writeNode(file, (int)i, frames);
+	}
+}
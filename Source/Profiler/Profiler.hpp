@@ -0,0 +1,172 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Profiler
+	Brief		Definition of the hierarchical CPU profiler - scoped zones are
+				written to a lock-free ring buffer owned by each thread, and
+				gathered once a frame into a tree of timings
+	Details		The zones are only compiled in when PROFILER_ENABLED is
+				defined in the preprocessor definitions of the project.
+				Otherwise PROFILE_ZONE and PROFILE_END_FRAME expand to nothing
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <windows.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifdef PROFILER_ENABLED
+	#define PROFILE_JOIN2(a, b)		a##b
+	#define PROFILE_JOIN(a, b)		PROFILE_JOIN2(a, b)
+	#define PROFILE_ZONE(name)		ProfileZone PROFILE_JOIN(profileZone, __LINE__)(name)
+	#define PROFILE_END_FRAME()		Profiler::instance()->endFrame()
+#else
+	#define PROFILE_ZONE(name)
+	#define PROFILE_END_FRAME()
+#endif
+
+/*
+	Name		ProfileEvent
+	Syntax		ProfileEvent
+	Brief		A single completed zone
+*/
+struct ProfileEvent
+{
+	const char* name;		// Must be a string literal - only the pointer is kept
+	__int64 start;			// Performance counter at the start of the zone
+	__int64 end;			// Performance counter at the end of the zone
+	UINT threadId;
+	UINT depth;				// Number of zones open on the thread when it started
+};
+
+/*
+	Name		ProfileNode
+	Syntax		ProfileNode
+	Brief		The time spent in a zone, summed over every call made to it
+				from the same parent zone
+*/
+struct ProfileNode
+{
+	const char* name;
+	int parent;				// Index of the parent node, -1 for a root
+	UINT depth;
+	double ms;
+	UINT calls;
+};
+
+/*
+	Name		ProfileRing
+	Syntax		ProfileRing
+	Brief		Single producer, single consumer ring of events
+	Details		Only the owning thread writes events and only the thread
+				calling Profiler::endFrame reads them, so the two indices are
+				enough to share the ring without a lock. Events written while
+				the ring is full are dropped and counted
+*/
+class ProfileRing
+{
+public:
+	enum { CAPACITY = 4096 };	// Must be a power of two
+
+	ProfileRing(UINT threadId);
+
+	void push(const ProfileEvent& event);
+	UINT drain(std::vector<ProfileEvent>* events);
+
+	UINT getThreadId() const { return threadId_; };
+	UINT getDropped() const { return dropped_; };
+
+	UINT depth;					// Zones open on the owning thread
+
+private:
+	ProfileEvent events_[CAPACITY];
+	volatile LONG writeIndex_;
+	volatile LONG readIndex_;
+	volatile LONG dropped_;
+	UINT threadId_;
+};
+
+class Profiler
+{
+public:
+	static Profiler* instance();
+
+	ProfileRing* getThreadRing();
+	void endFrame();
+
+	bool beginTrace(const std::string& fileName);
+	void endTrace();
+
+	const std::vector<ProfileNode>& getFrameNodes() const { return frameNodes_; };
+	const std::vector<ProfileNode>& getTotalNodes() const { return totalNodes_; };
+	UINT getFramesNo() const { return framesNo_; };
+	double getCountsToMs() const { return countsToMs_; };
+
+	void writeSummary(FILE* file) const;
+
+private:
+	Profiler();
+	~Profiler();
+	Profiler(const Profiler& rhs);
+	Profiler& operator=(const Profiler& rhs);
+
+	int findOrAddNode(std::vector<ProfileNode>* nodes, int parent,
+					  const char* name, UINT depth);
+	void buildFrameNodes();
+	void writeTraceEvents();
+	void writeNode(FILE* file, int node, double frames) const;
+
+	static Profiler* instance_;
+
+	CRITICAL_SECTION ringsLock_;		// Only taken when a thread makes its ring
+	std::vector<ProfileRing*> rings_;
+
+	std::vector<ProfileEvent> frameEvents_;
+	std::vector<ProfileNode> frameNodes_;
+	std::vector<ProfileNode> totalNodes_;
+	UINT framesNo_;
+
+	double countsToMs_;
+	__int64 traceStart_;
+	FILE* traceFile_;
+	bool firstTraceEvent_;
+};
+
+/*
+	Name		ProfileZone
+	Syntax		ProfileZone
+	Brief		Times the scope it is declared in
+*/
+class ProfileZone
+{
+public:
+	ProfileZone(const char* name)
+	: ring_(Profiler::instance()->getThreadRing())
+	{
+		event_.name = name;
+		event_.threadId = ring_->getThreadId();
+		event_.depth = ring_->depth++;
+		QueryPerformanceCounter((LARGE_INTEGER*)&event_.start);
+	}
+
+	~ProfileZone()
+	{
+		QueryPerformanceCounter((LARGE_INTEGER*)&event_.end);
+		--ring_->depth;
+		ring_->push(event_);
+	}
+
+private:
+	ProfileZone(const ProfileZone& rhs);
+	ProfileZone& operator=(const ProfileZone& rhs);
+
+	ProfileRing* ring_;
+	ProfileEvent event_;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,538 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		OcclusionBuffer
+	Brief		Implementation of the OcclusionBuffer class
+*/
+
+#include "Renderer/OcclusionBuffer.hpp"
+#include <math.h>
+#include "Maths/m3dSIMD.h"
+#include "Profiler/Profiler.hpp"
+
+namespace
+{
+	/*
+		Name		projectPoint
+		Syntax		projectPoint(float* out, float x, float y, float z,
+								 const M3DMatrix44f m)
+		Param		float* out - Receives the pixel x, y, depth and clip w
+		Param		float x, y, z - The point
+		Param		const M3DMatrix44f m - The world, view and projection
+		Return		bool - False if the point is behind the near plane
+		Brief		Projects a point into the pixels of the occlusion buffer
+	*/
+	inline bool projectPoint(float* out, float x, float y, float z, const M3DMatrix44f m)
+	{
+		M3DVector4f clip;
+		M3DVector4f point = { x, y, z, 1.0f };
+		m3dTransformVector4(clip, point, m);
+
+		out[3] = clip[3];
+		if (clip[2] < 0.0f || clip[3] <= 0.0f)
+			return false;
+
+		float invW = 1.0f / clip[3];
+		out[0] = (clip[0] * invW + 1.0f) * (0.5f * OcclusionBuffer::WIDTH);
+		out[1] = (1.0f - clip[1] * invW) * (0.5f * OcclusionBuffer::HEIGHT);
+		out[2] = clip[2] * invW;
+		return true;
+	}
+}
+
+/*
+	Name		OcclusionBuffer::OcclusionBuffer
+	Syntax		OcclusionBuffer()
+	Brief		OcclusionBuffer constructor
+*/
+OcclusionBuffer::OcclusionBuffer()
+: depth_(WIDTH * HEIGHT, 1.0f), workSemaphore_(0), doneEvent_(0), nextTile_(0),
+  workersBusy_(0), quit_(0)
+{
+	m3dLoadIdentity44(viewProj_);
+}
+
+/*
+	Name		OcclusionBuffer::~OcclusionBuffer
+	Syntax		~OcclusionBuffer()
+	Brief		OcclusionBuffer destructor stops the workers
+*/
+OcclusionBuffer::~OcclusionBuffer()
+{
+	deinitialise();
+}
+
+/*
+	Name		OcclusionBuffer::initialise
+	Syntax		OcclusionBuffer::initialise(int threadsNo)
+	Param		int threadsNo - Threads to rasterise with, counting the
+				thread that calls rasterise
+	Return		bool - True if every worker thread was started
+	Brief		Starts the worker threads
+	Details		If a worker cannot be started, the buffer is rasterised
+				with those that were
+*/
+bool OcclusionBuffer::initialise(int threadsNo)
+{
+	deinitialise();
+
+	int workers = threadsNo - 1;
+	if (workers <= 0)
+		return true;
+
+	workSemaphore_ = CreateSemaphore(0, 0, workers, 0);
+	doneEvent_ = CreateEvent(0, FALSE, FALSE, 0);
+	if (!workSemaphore_ || !doneEvent_)
+	{
+		MessageBox(0, "Creating occlusion buffer events - Failed", "Error", MB_OK);
+		deinitialise();
+		return false;
+	}
+
+	for (int i = 0; i < workers; ++i)
+	{
+		HANDLE thread = CreateThread(0, 0, workerProc, this, 0, 0);
+		if (!thread)
+		{
+			MessageBox(0, "Creating occlusion buffer thread - Failed", "Error", MB_OK);
+			return false;
+		}
+		threads_.push_back(thread);
+	}
+
+	return true;
+}
+
+/*
+	Name		OcclusionBuffer::deinitialise
+	Syntax		OcclusionBuffer::deinitialise()
+	Brief		Stops the worker threads and waits for them to finish
+*/
+void OcclusionBuffer::deinitialise()
+{
+	if (!threads_.empty())
+	{
+		InterlockedExchange(&quit_, 1);
+		ReleaseSemaphore(workSemaphore_, (LONG)threads_.size(), 0);
+		for (size_t i = 0; i < threads_.size(); ++i)
+		{
+			WaitForSingleObject(threads_[i], INFINITE);
+			CloseHandle(threads_[i]);
+		}
+		threads_.clear();
+		quit_ = 0;
+	}
+	if (workSemaphore_)
+	{
+		CloseHandle(workSemaphore_);
+		workSemaphore_ = 0;
+	}
+	if (doneEvent_)
+	{
+		CloseHandle(doneEvent_);
+		doneEvent_ = 0;
+	}
+}
+
+/*
+	Name		OcclusionBuffer::begin
+	Syntax		OcclusionBuffer::begin(const M3DMatrix44f viewProj)
+	Param		const M3DMatrix44f viewProj - The camera's view and projection,
+				which may be passed as a D3DXMATRIX
+	Brief		Starts a frame, dropping the occluders of the last one
+*/
+void OcclusionBuffer::begin(const M3DMatrix44f viewProj)
+{
+	m3dCopyMatrix44(viewProj_, viewProj);
+	triangles_.clear();
+	for (int t = 0; t < TILES_NO; ++t)
+		bins_[t].clear();
+}
+
+/*
+	Name		OcclusionBuffer::addOccluders
+	Syntax		OcclusionBuffer::addOccluders(const float* vertices, int verticesNo,
+											  const UINT* indices, int indicesNo,
+											  const M3DMatrix44f world)
+	Param		const float* vertices - x, y and z of each vertex
+	Param		int verticesNo - Number of vertices
+	Param		const UINT* indices - Three vertices for each triangle
+	Param		int indicesNo - Number of indices
+	Param		const M3DMatrix44f world - World matrix of the vertices
+	Brief		Projects a triangle list and bins its triangles into the tiles
+	Details		Occluders must lie within the surfaces they stand for, as
+				anything behind them is taken to be hidden
+*/
+void OcclusionBuffer::addOccluders(const float* vertices, int verticesNo, const UINT* indices,
+								   int indicesNo, const M3DMatrix44f world)
+{
+	PROFILE_ZONE("OcclusionBuffer::addOccluders");
+
+	if (verticesNo <= 0 || indicesNo < 3)
+		return;
+
+	M3DMatrix44f m;
+	m3dMatrixMultiply44(m, viewProj_, world);
+
+	screen_.resize(verticesNo * 4);
+	float* screen = &screen_[0];
+
+#ifdef M3D_SSE
+	__m128 columns[4] = { _mm_loadu_ps(m), _mm_loadu_ps(m + 4),
+						  _mm_loadu_ps(m + 8), _mm_loadu_ps(m + 12) };
+	const __m128 scale = _mm_setr_ps(0.5f * WIDTH, -0.5f * HEIGHT, 1.0f, 0.0f);
+	const __m128 offset = _mm_setr_ps(0.5f * WIDTH, 0.5f * HEIGHT, 0.0f, 0.0f);
+	for (int i = 0; i < verticesNo; ++i)
+	{
+		const float* v = vertices + i * 3;
+		__m128 clip = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(v[0]), columns[0]), columns[3]);
+		clip = _mm_add_ps(clip, _mm_mul_ps(_mm_set1_ps(v[1]), columns[1]));
+		clip = _mm_add_ps(clip, _mm_mul_ps(_mm_set1_ps(v[2]), columns[2]));
+
+		// The w lane is kept for the near plane test below
+		__m128 w = M3D_SPLAT(clip, 3);
+		__m128 pixel = _mm_add_ps(_mm_mul_ps(_mm_div_ps(clip, w), scale), offset);
+		_mm_storeu_ps(screen + i * 4, pixel);
+
+		float z = _mm_cvtss_f32(M3D_SPLAT(clip, 2));
+		float wLane = _mm_cvtss_f32(w);
+		screen[i * 4 + 3] = (z < 0.0f || wLane <= 0.0f) ? -1.0f : wLane;
+	}
+#else
+	for (int i = 0; i < verticesNo; ++i)
+	{
+		const float* v = vertices + i * 3;
+		if (!projectPoint(screen + i * 4, v[0], v[1], v[2], m))
+			screen[i * 4 + 3] = -1.0f;
+	}
+#endif
+
+	for (int i = 0; i + 2 < indicesNo; i += 3)
+	{
+		const float* a = screen + indices[i] * 4;
+		const float* b = screen + indices[i + 1] * 4;
+		const float* c = screen + indices[i + 2] * 4;
+
+		// Clipping at the near plane would make up depths nearer than any
+		// the occluder has, so triangles crossing it are left out
+		if (a[3] <= 0.0f || b[3] <= 0.0f || c[3] <= 0.0f)
+			continue;
+
+		setupTriangle(a, b, c);
+	}
+}
+
+/*
+	Name		OcclusionBuffer::setupTriangle
+	Syntax		OcclusionBuffer::setupTriangle(const float* a, const float* b,
+											   const float* c)
+	Param		const float* a, b, c - Pixel x, y and depth of the corners
+	Brief		Finds the edge functions, depth plane and pixel bounds of a
+				triangle, and adds it to the bins of the tiles it overlaps
+	Details		Either winding is drawn, as the buffer is not culled by
+				facing. The functions are set up to be evaluated at the pixel
+				index, with the half pixel to its centre folded in
+*/
+void OcclusionBuffer::setupTriangle(const float* a, const float* b, const float* c)
+{
+	float area = (b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]);
+	if (area == 0.0f)
+		return;
+	if (area < 0.0f)
+	{
+		const float* swap = b;
+		b = c;
+		c = swap;
+		area = -area;
+	}
+
+	// Pixels whose centres are within the triangle's bounds
+	float minX = min(a[0], min(b[0], c[0]));
+	float maxX = max(a[0], max(b[0], c[0]));
+	float minY = min(a[1], min(b[1], c[1]));
+	float maxY = max(a[1], max(b[1], c[1]));
+
+	Triangle triangle;
+	triangle.minX = max((int)ceilf(minX - 0.5f), 0);
+	triangle.maxX = min((int)floorf(maxX - 0.5f), WIDTH - 1);
+	triangle.minY = max((int)ceilf(minY - 0.5f), 0);
+	triangle.maxY = min((int)floorf(maxY - 0.5f), HEIGHT - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	const float* corners[4] = { a, b, c, a };
+	for (int e = 0; e < 3; ++e)
+	{
+		const float* from = corners[e];
+		const float* to = corners[e + 1];
+		triangle.edgeA[e] = from[1] - to[1];
+		triangle.edgeB[e] = to[0] - from[0];
+		triangle.edgeC[e] = -(triangle.edgeA[e] * (from[0] - 0.5f) +
+							  triangle.edgeB[e] * (from[1] - 0.5f));
+	}
+
+	float invArea = 1.0f / area;
+	triangle.depthA = ((b[2] - a[2]) * (c[1] - a[1]) - (c[2] - a[2]) * (b[1] - a[1])) * invArea;
+	triangle.depthB = ((c[2] - a[2]) * (b[0] - a[0]) - (b[2] - a[2]) * (c[0] - a[0])) * invArea;
+	triangle.depthC = a[2] - triangle.depthA * (a[0] - 0.5f) - triangle.depthB * (a[1] - 0.5f);
+
+	int index = (int)triangles_.size();
+	triangles_.push_back(triangle);
+
+	for (int ty = triangle.minY / TILE_HEIGHT; ty <= triangle.maxY / TILE_HEIGHT; ++ty)
+	{
+		for (int tx = triangle.minX / TILE_WIDTH; tx <= triangle.maxX / TILE_WIDTH; ++tx)
+			bins_[ty * TILES_X + tx].push_back(index);
+	}
+}
+
+/*
+	Name		OcclusionBuffer::rasterise
+	Syntax		OcclusionBuffer::rasterise()
+	Brief		Clears the buffer and draws the binned occluders into it
+	Details		The workers and the calling thread take tiles in turn until
+				none are left, and the call returns once every tile is done
+*/
+void OcclusionBuffer::rasterise()
+{
+	PROFILE_ZONE("OcclusionBuffer::rasterise");
+
+	nextTile_ = 0;
+	if (threads_.empty())
+	{
+		rasteriseTiles();
+		return;
+	}
+
+	workersBusy_ = (LONG)threads_.size();
+	ReleaseSemaphore(workSemaphore_, (LONG)threads_.size(), 0);
+	rasteriseTiles();
+	WaitForSingleObject(doneEvent_, INFINITE);
+}
+
+/*
+	Name		OcclusionBuffer::isVisible
+	Syntax		OcclusionBuffer::isVisible(const M3DVector3f boxMin,
+										   const M3DVector3f boxMax)
+	Param		const M3DVector3f boxMin - Minimum corner of a world space box
+	Param		const M3DVector3f boxMax - Maximum corner of the box
+	Return		bool - False if the occluders hide the whole box
+	Brief		Tests a box against the rasterised occluders
+	Details		The box is taken as the screen rectangle of its corners, at
+				the depth of its nearest corner, and is hidden when every
+				pixel the rectangle touches holds a nearer occluder. A box
+				crossing the near plane, or off the buffer, is kept, and left
+				to the frustum test
+*/
+bool OcclusionBuffer::isVisible(const M3DVector3f boxMin, const M3DVector3f boxMax) const
+{
+	float minX = (float)WIDTH, maxX = 0.0f;
+	float minY = (float)HEIGHT, maxY = 0.0f;
+	float minDepth = 1.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		float corner[4];
+		if (!projectPoint(corner, (i & 1) ? boxMax[0] : boxMin[0], (i & 2) ? boxMax[1] : boxMin[1],
+						  (i & 4) ? boxMax[2] : boxMin[2], viewProj_))
+		{
+			return true;
+		}
+		minX = min(minX, corner[0]);
+		maxX = max(maxX, corner[0]);
+		minY = min(minY, corner[1]);
+		maxY = max(maxY, corner[1]);
+		minDepth = min(minDepth, corner[2]);
+	}
+
+	// Every pixel the rectangle touches, so that a box smaller than a pixel
+	// is still tested against one
+	if (maxX < 0.0f || maxY < 0.0f || minX >= (float)WIDTH || minY >= (float)HEIGHT)
+		return true;
+	int x0 = max((int)minX, 0);
+	int x1 = min((int)maxX, WIDTH - 1);
+	int y0 = max((int)minY, 0);
+	int y1 = min((int)maxY, HEIGHT - 1);
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		const float* row = &depth_[y * WIDTH];
+		int x = x0;
+#ifdef M3D_SSE
+		const __m128 depth = _mm_set1_ps(minDepth);
+		for (; x + 3 <= x1; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), depth)))
+				return true;
+		}
+#endif
+		for (; x <= x1; ++x)
+		{
+			if (row[x] >= minDepth)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+	Name		OcclusionBuffer::rasteriseTiles
+	Syntax		OcclusionBuffer::rasteriseTiles()
+	Brief		Rasterises tiles until none are left to take
+*/
+void OcclusionBuffer::rasteriseTiles()
+{
+	for (;;)
+	{
+		LONG tile = InterlockedIncrement(&nextTile_) - 1;
+		if (tile >= TILES_NO)
+			return;
+		rasteriseTile((int)tile);
+	}
+}
+
+/*
+	Name		OcclusionBuffer::rasteriseTile
+	Syntax		OcclusionBuffer::rasteriseTile(int tile)
+	Param		int tile - Index of the tile, row by row
+	Brief		Clears a tile to the far plane and draws its triangles
+*/
+void OcclusionBuffer::rasteriseTile(int tile)
+{
+	int tileX = (tile % TILES_X) * TILE_WIDTH;
+	int tileY = (tile / TILES_X) * TILE_HEIGHT;
+
+	for (int y = tileY; y < tileY + TILE_HEIGHT; ++y)
+	{
+		float* row = &depth_[y * WIDTH + tileX];
+		for (int x = 0; x < TILE_WIDTH; ++x)
+			row[x] = 1.0f;
+	}
+
+	const std::vector<int>& bin = bins_[tile];
+	for (size_t i = 0; i < bin.size(); ++i)
+		rasteriseTriangle(triangles_[bin[i]], tileX, tileY);
+}
+
+/*
+	Name		OcclusionBuffer::rasteriseTriangle
+	Syntax		OcclusionBuffer::rasteriseTriangle(const Triangle& triangle,
+												   int tileX, int tileY)
+	Param		const Triangle& triangle - The triangle
+	Param		int tileX, tileY - Top left pixel of the tile
+	Brief		Keeps the nearer of the triangle's depth and the buffer's at
+				each pixel of the tile inside the triangle
+	Details		The SSE version takes four pixels at a time from a multiple
+				of four, which the tile width is, so the pixels taken past
+				the triangle's bounds are still in the tile and fail the
+				edge tests
+*/
+void OcclusionBuffer::rasteriseTriangle(const Triangle& triangle, int tileX, int tileY)
+{
+	int x0 = max(triangle.minX, tileX);
+	int x1 = min(triangle.maxX, tileX + TILE_WIDTH - 1);
+	int y0 = max(triangle.minY, tileY);
+	int y1 = min(triangle.maxY, tileY + TILE_HEIGHT - 1);
+	if (x0 > x1 || y0 > y1)
+		return;
+
+#ifdef M3D_SSE
+	x0 &= ~3;
+
+	__m128 xs = _mm_add_ps(_mm_set1_ps((float)x0), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+	__m128 edgeA[3], edgeStep[3];
+	for (int e = 0; e < 3; ++e)
+	{
+		edgeA[e] = _mm_set1_ps(triangle.edgeA[e]);
+		edgeStep[e] = _mm_set1_ps(triangle.edgeA[e] * 4.0f);
+	}
+	const __m128 depthA = _mm_set1_ps(triangle.depthA);
+	const __m128 depthStep = _mm_set1_ps(triangle.depthA * 4.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (int y = y0; y <= y1; ++y)
+	{
+		float* row = &depth_[y * WIDTH];
+		float fy = (float)y;
+
+		__m128 edge[3];
+		for (int e = 0; e < 3; ++e)
+		{
+			__m128 rowStart = _mm_set1_ps(triangle.edgeB[e] * fy + triangle.edgeC[e]);
+			edge[e] = _mm_add_ps(_mm_mul_ps(edgeA[e], xs), rowStart);
+		}
+		__m128 depth = _mm_add_ps(_mm_mul_ps(depthA, xs),
+								  _mm_set1_ps(triangle.depthB * fy + triangle.depthC));
+
+		for (int x = x0; x <= x1; x += 4)
+		{
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(edge[0], zero), _mm_cmpge_ps(edge[1], zero));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(edge[2], zero));
+			if (_mm_movemask_ps(inside))
+			{
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(old, depth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer),
+												 _mm_andnot_ps(inside, old)));
+			}
+
+			edge[0] = _mm_add_ps(edge[0], edgeStep[0]);
+			edge[1] = _mm_add_ps(edge[1], edgeStep[1]);
+			edge[2] = _mm_add_ps(edge[2], edgeStep[2]);
+			depth = _mm_add_ps(depth, depthStep);
+		}
+	}
+#else
+	for (int y = y0; y <= y1; ++y)
+	{
+		float* row = &depth_[y * WIDTH];
+		float fy = (float)y;
+		for (int x = x0; x <= x1; ++x)
+		{
+			float fx = (float)x;
+			if (triangle.edgeA[0] * fx + triangle.edgeB[0] * fy + triangle.edgeC[0] >= 0.0f &&
+				triangle.edgeA[1] * fx + triangle.edgeB[1] * fy + triangle.edgeC[1] >= 0.0f &&
+				triangle.edgeA[2] * fx + triangle.edgeB[2] * fy + triangle.edgeC[2] >= 0.0f)
+			{
+				float depth = triangle.depthA * fx + triangle.depthB * fy + triangle.depthC;
+				row[x] = min(row[x], depth);
+			}
+		}
+	}
+#endif
+}
+
+/*
+	Name		OcclusionBuffer::runWorker
+	Syntax		OcclusionBuffer::runWorker()
+	Brief		Rasterises tiles each time the workers are released, until
+				the buffer is deinitialised
+*/
+void OcclusionBuffer::runWorker()
+{
+	for (;;)
+	{
+		WaitForSingleObject(workSemaphore_, INFINITE);
+		if (quit_)
+			return;
+
+		rasteriseTiles();
+		if (InterlockedDecrement(&workersBusy_) == 0)
+			SetEvent(doneEvent_);
+	}
+}
+
+/*
+	Name		OcclusionBuffer::workerProc
+	Syntax		OcclusionBuffer::workerProc(LPVOID buffer)
+	Param		LPVOID buffer - The occlusion buffer
+	Return		DWORD - Zero
+	Brief		Entry point of the worker threads
+*/
+DWORD WINAPI OcclusionBuffer::workerProc(LPVOID buffer)
+{
+	static_cast<OcclusionBuffer*>(buffer)->runWorker();
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		OcclusionBuffer
+	Brief		Definition of the OcclusionBuffer class - a low resolution
+				depth buffer rasterised on the CPU from occluder meshes, that
+				bounding boxes are tested against before they are drawn
+	Details		Occluders are transformed and set up once, then binned into
+				the tiles of the buffer they overlap. Each tile is cleared and
+				rasterised on its own, four pixels at a time with SSE, by
+				whichever thread takes it next, so that the threads never
+				write the same pixels.
+
+				The depths are those of the Direct3D projection, 0 at the near
+				plane and 1 at the far. Triangles that cross the near plane are
+				left out rather than clipped, so the buffer only ever holds
+				depths that some occluder really reaches, and a box is only
+				reported hidden when every pixel it may cover is nearer
+*/
+
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+#include <windows.h>
+#include <vector>
+#include "Maths/math3d.h"
+
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+	~OcclusionBuffer();
+
+	bool initialise(int threadsNo);
+	void deinitialise();
+
+	// A frame is begun with the camera, its occluders added, then
+	// rasterised before any box is tested
+	void begin(const M3DMatrix44f viewProj);
+	void addOccluders(const float* vertices, int verticesNo, const UINT* indices,
+					  int indicesNo, const M3DMatrix44f world);
+	void rasterise();
+
+	bool isVisible(const M3DVector3f boxMin, const M3DVector3f boxMax) const;
+
+	int getThreadsNo() const { return (int)threads_.size() + 1; };
+	int getTrianglesNo() const { return (int)triangles_.size(); };
+	const float* getDepth() const { return &depth_[0]; };
+
+	static const int WIDTH = 256;
+	static const int HEIGHT = 128;
+	static const int TILE_WIDTH = 32;
+	static const int TILE_HEIGHT = 32;
+	static const int TILES_X = WIDTH / TILE_WIDTH;
+	static const int TILES_Y = HEIGHT / TILE_HEIGHT;
+	static const int TILES_NO = TILES_X * TILES_Y;
+
+private:
+	/*
+		Name		Triangle
+		Syntax		Triangle
+		Brief		A triangle set up for rasterising, with its edge
+					functions and depth plane in pixel coordinates
+		Details		A pixel centre (x, y) is inside when edgeA[i] * x +
+					edgeB[i] * y + edgeC[i] >= 0 for all three edges, and its
+					depth is depthA * x + depthB * y + depthC
+	*/
+	struct Triangle
+	{
+		float edgeA[3];
+		float edgeB[3];
+		float edgeC[3];
+		float depthA;
+		float depthB;
+		float depthC;
+		int minX;
+		int minY;
+		int maxX;
+		int maxY;
+	};
+
+	void setupTriangle(const float* a, const float* b, const float* c);
+	void rasteriseTiles();
+	void rasteriseTile(int tile);
+	void rasteriseTriangle(const Triangle& triangle, int tileX, int tileY);
+	void runWorker();
+	static DWORD WINAPI workerProc(LPVOID buffer);
+
+	M3DMatrix44f viewProj_;
+	std::vector<float> depth_;				// WIDTH * HEIGHT, row by row
+	std::vector<float> screen_;				// Pixel x, y, depth and clip w of each
+											// vertex being added, four floats apiece
+	std::vector<Triangle> triangles_;
+	std::vector<int> bins_[TILES_NO];		// Triangles overlapping each tile
+
+	std::vector<HANDLE> threads_;			// Workers, besides the calling thread
+	HANDLE workSemaphore_;					// Released once for each worker a frame
+	HANDLE doneEvent_;						// Set when the last worker is done
+	volatile LONG nextTile_;
+	volatile LONG workersBusy_;
+	volatile LONG quit_;
+};
+
+#endif
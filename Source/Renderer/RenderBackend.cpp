@@ -0,0 +1,646 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Render Backend
+	Brief		Definition of the abstract RenderBackend class - owns the
+				Direct3D device and output targets, and records the draw
+				calls, vertices and bytes submitted through it
+*/
+
+#include "Renderer/RenderBackend.hpp"
+
+/*
+	Name		RenderStats::add
+	Syntax		RenderStats::add(const RenderStats& rhs)
+	Param		const RenderStats& rhs - The counters to accumulate
+	Brief		Adds another set of counters to this one
+*/
+void RenderStats::add(const RenderStats& rhs)
+{
+	drawCalls		+= rhs.drawCalls;
+	autoDrawCalls	+= rhs.autoDrawCalls;
+	vertices		+= rhs.vertices;
+	bytesUploaded	+= rhs.bytesUploaded;
+	buffersCreated	+= rhs.buffersCreated;
+	texturesCreated	+= rhs.texturesCreated;
+}
+
+/*
+	Name		RenderBackend::RenderBackend
+	Syntax		RenderBackend()
+	Brief		RenderBackend constructor initialises member variables
+*/
+RenderBackend::RenderBackend()
+: d3dDevice_(0), depthStencilBuffer_(0), renderTargetView_(0),
+  depthStencilView_(0), width_(0), height_(0), frameCount_(0)
+{
+}
+
+/*
+	Name		RenderBackend::~RenderBackend
+	Syntax		~RenderBackend()
+	Brief		RenderBackend destructor
+*/
+RenderBackend::~RenderBackend()
+{
+	RenderBackend::deinitialise();
+}
+
+/*
+	Name		RenderBackend::deinitialise
+	Syntax		RenderBackend::deinitialise()
+	Brief		Releases the output targets and the device
+*/
+void RenderBackend::deinitialise()
+{
+	releaseTargets();
+
+	if (d3dDevice_)
+	{
+		d3dDevice_->Release();
+		d3dDevice_ = 0;
+	}
+}
+
+/*
+	Name		RenderBackend::beginFrame
+	Syntax		RenderBackend::beginFrame()
+	Brief		Clears the output targets and the per-frame counters
+*/
+void RenderBackend::beginFrame()
+{
+	frameStats_.reset();
+
+	d3dDevice_->ClearRenderTargetView(renderTargetView_, D3DXVECTOR4(0, 0, 0, 1)); // Clear to black
+	d3dDevice_->ClearDepthStencilView(depthStencilView_, D3D10_CLEAR_DEPTH|D3D10_CLEAR_STENCIL, 1.0f, 0); // Set depth to 1 (furthest away)
+}
+
+/*
+	Name		RenderBackend::endFrame
+	Syntax		RenderBackend::endFrame()
+	Brief		Presents the frame and counts it
+*/
+void RenderBackend::endFrame()
+{
+	present();
+
+	++frameCount_;
+}
+
+/*
+	Name		RenderBackend::resetOMTargetsAndViewport
+	Syntax		RenderBackend::resetOMTargetsAndViewport()
+	Brief		Rebinds the output targets and the full-target viewport
+*/
+void RenderBackend::resetOMTargetsAndViewport()
+{
+	d3dDevice_->OMSetRenderTargets(1, &renderTargetView_, depthStencilView_);
+
+	D3D10_VIEWPORT vp;
+	vp.TopLeftX = 0;
+	vp.TopLeftY = 0;
+	vp.Width    = width_;
+	vp.Height   = height_;
+	vp.MinDepth = 0.0f;
+	vp.MaxDepth = 1.0f;
+
+	d3dDevice_->RSSetViewports(1, &vp);
+}
+
+/*
+	Name		RenderBackend::createBuffer
+	Syntax		RenderBackend::createBuffer(const D3D10_BUFFER_DESC* desc,
+								const D3D10_SUBRESOURCE_DATA* initData,
+								ID3D10Buffer** buffer)
+	Param		const D3D10_BUFFER_DESC* desc - Description of the buffer
+	Param		const D3D10_SUBRESOURCE_DATA* initData - Initial data or 0
+	Param		ID3D10Buffer** buffer - Receives the created buffer
+	Return		HRESULT - The result of the device call
+	Brief		Creates a buffer on the device
+*/
+HRESULT RenderBackend::createBuffer(const D3D10_BUFFER_DESC* desc,
+									const D3D10_SUBRESOURCE_DATA* initData,
+									ID3D10Buffer** buffer)
+{
+	HRESULT hr = d3dDevice_->CreateBuffer(desc, initData, buffer);
+	if (SUCCEEDED(hr))
+	{
+		RenderStats stats;
+		stats.buffersCreated = 1;
+		if (initData)
+			stats.bytesUploaded = desc->ByteWidth;
+		record(stats);
+	}
+	return hr;
+}
+
+/*
+	Name		RenderBackend::createTexture1D
+	Syntax		RenderBackend::createTexture1D(const D3D10_TEXTURE1D_DESC* desc,
+								const D3D10_SUBRESOURCE_DATA* initData,
+								ID3D10Texture1D** texture)
+	Param		const D3D10_TEXTURE1D_DESC* desc - Description of the texture
+	Param		const D3D10_SUBRESOURCE_DATA* initData - Initial data or 0
+	Param		ID3D10Texture1D** texture - Receives the created texture
+	Return		HRESULT - The result of the device call
+	Brief		Creates a 1D texture on the device
+	Details		Only the top mip of the first array slice is counted
+*/
+HRESULT RenderBackend::createTexture1D(const D3D10_TEXTURE1D_DESC* desc,
+									   const D3D10_SUBRESOURCE_DATA* initData,
+									   ID3D10Texture1D** texture)
+{
+	HRESULT hr = d3dDevice_->CreateTexture1D(desc, initData, texture);
+	if (SUCCEEDED(hr))
+	{
+		RenderStats stats;
+		stats.texturesCreated = 1;
+		if (initData)
+			stats.bytesUploaded = initData->SysMemPitch;
+		record(stats);
+	}
+	return hr;
+}
+
+/*
+	Name		RenderBackend::createTexture2D
+	Syntax		RenderBackend::createTexture2D(const D3D10_TEXTURE2D_DESC* desc,
+								const D3D10_SUBRESOURCE_DATA* initData,
+								ID3D10Texture2D** texture)
+	Param		const D3D10_TEXTURE2D_DESC* desc - Description of the texture
+	Param		const D3D10_SUBRESOURCE_DATA* initData - Initial data or 0
+	Param		ID3D10Texture2D** texture - Receives the created texture
+	Return		HRESULT - The result of the device call
+	Brief		Creates a 2D texture on the device
+	Details		Only the top mip of the first array slice is counted, as
+				rows of pixels. Textures filled by updateSubresource are
+				counted exactly
+*/
+HRESULT RenderBackend::createTexture2D(const D3D10_TEXTURE2D_DESC* desc,
+									   const D3D10_SUBRESOURCE_DATA* initData,
+									   ID3D10Texture2D** texture)
+{
+	HRESULT hr = d3dDevice_->CreateTexture2D(desc, initData, texture);
+	if (SUCCEEDED(hr))
+	{
+		RenderStats stats;
+		stats.texturesCreated = 1;
+		if (initData)
+			stats.bytesUploaded = initData->SysMemPitch * desc->Height;
+		record(stats);
+	}
+	return hr;
+}
+
+/*
+	Name		RenderBackend::createTexture3D
+	Syntax		RenderBackend::createTexture3D(const D3D10_TEXTURE3D_DESC* desc,
+								const D3D10_SUBRESOURCE_DATA* initData,
+								ID3D10Texture3D** texture)
+	Param		const D3D10_TEXTURE3D_DESC* desc - Description of the texture
+	Param		const D3D10_SUBRESOURCE_DATA* initData - Initial data or 0
+	Param		ID3D10Texture3D** texture - Receives the created texture
+	Return		HRESULT - The result of the device call
+	Brief		Creates a 3D texture on the device
+	Details		Only the top mip is counted
+*/
+HRESULT RenderBackend::createTexture3D(const D3D10_TEXTURE3D_DESC* desc,
+									   const D3D10_SUBRESOURCE_DATA* initData,
+									   ID3D10Texture3D** texture)
+{
+	HRESULT hr = d3dDevice_->CreateTexture3D(desc, initData, texture);
+	if (SUCCEEDED(hr))
+	{
+		RenderStats stats;
+		stats.texturesCreated = 1;
+		if (initData)
+			stats.bytesUploaded = initData->SysMemSlicePitch * desc->Depth;
+		record(stats);
+	}
+	return hr;
+}
+
+/*
+	Name		RenderBackend::updateSubresource
+	Syntax		RenderBackend::updateSubresource(ID3D10Resource* resource,
+								UINT subresource, const void* data,
+								UINT rowPitch, UINT bytes, UINT depthPitch,
+								const D3D10_BOX* box)
+	Param		ID3D10Resource* resource - The destination resource
+	Param		UINT subresource - The destination subresource
+	Param		const void* data - The source data
+	Param		UINT rowPitch - Size of one row of the source data
+	Param		UINT bytes - Total size of the source data
+	Param		UINT depthPitch - Size of one slice of the source data, for
+				3D textures
+	Param		const D3D10_BOX* box - The part of the subresource to copy
+				into, or 0 for all of it
+	Brief		Copies CPU memory into a subresource
+*/
+void RenderBackend::updateSubresource(ID3D10Resource* resource, UINT subresource,
+									  const void* data, UINT rowPitch, UINT bytes,
+									  UINT depthPitch, const D3D10_BOX* box)
+{
+	d3dDevice_->UpdateSubresource(resource, subresource, box, data, rowPitch, depthPitch);
+
+	RenderStats stats;
+	stats.bytesUploaded = bytes;
+	record(stats);
+}
+
+/*
+	Name		RenderBackend::draw
+	Syntax		RenderBackend::draw(UINT vertexCount, UINT startVertex)
+	Param		UINT vertexCount - Number of vertices to draw
+	Param		UINT startVertex - First vertex to draw
+	Brief		Draws non-indexed primitives
+*/
+void RenderBackend::draw(UINT vertexCount, UINT startVertex)
+{
+	d3dDevice_->Draw(vertexCount, startVertex);
+
+	RenderStats stats;
+	stats.drawCalls = 1;
+	stats.vertices = vertexCount;
+	record(stats);
+}
+
+/*
+	Name		RenderBackend::drawIndexed
+	Syntax		RenderBackend::drawIndexed(UINT indexCount, UINT startIndex,
+										   INT baseVertex)
+	Param		UINT indexCount - Number of indices to draw
+	Param		UINT startIndex - First index to draw
+	Param		INT baseVertex - Value added to each index
+	Brief		Draws indexed primitives
+*/
+void RenderBackend::drawIndexed(UINT indexCount, UINT startIndex, INT baseVertex)
+{
+	d3dDevice_->DrawIndexed(indexCount, startIndex, baseVertex);
+
+	RenderStats stats;
+	stats.drawCalls = 1;
+	stats.vertices = indexCount;
+	record(stats);
+}
+
+/*
+	Name		RenderBackend::drawAuto
+	Syntax		RenderBackend::drawAuto()
+	Brief		Draws the contents of the bound stream-out buffer
+*/
+void RenderBackend::drawAuto()
+{
+	d3dDevice_->DrawAuto();
+
+	RenderStats stats;
+	stats.drawCalls = 1;
+	stats.autoDrawCalls = 1;
+	record(stats);
+}
+
+/*
+	Name		RenderBackend::drawSubset
+	Syntax		RenderBackend::drawSubset(ID3DX10Mesh* mesh, UINT subset,
+										  UINT vertexCount)
+	Param		ID3DX10Mesh* mesh - The mesh to draw
+	Param		UINT subset - The attribute subset to draw
+	Param		UINT vertexCount - Number of vertices in the subset
+	Brief		Draws a subset of a mesh
+*/
+void RenderBackend::drawSubset(ID3DX10Mesh* mesh, UINT subset, UINT vertexCount)
+{
+	mesh->DrawSubset(subset);
+
+	RenderStats stats;
+	stats.drawCalls = 1;
+	stats.vertices = vertexCount;
+	record(stats);
+}
+
+/*
+	Name		RenderBackend::record
+	Syntax		RenderBackend::record(const RenderStats& stats)
+	Param		const RenderStats& stats - The work just submitted
+	Brief		Adds submitted work to the frame and running totals
+	Details		Resources created while loading a state fall between frames
+				so they only show up in the running totals
+*/
+void RenderBackend::record(const RenderStats& stats)
+{
+	frameStats_.add(stats);
+	totalStats_.add(stats);
+}
+
+/*
+	Name		RenderBackend::createTargets
+	Syntax		RenderBackend::createTargets(int width, int height)
+	Param		int width - Width of the targets
+	Param		int height - Height of the targets
+	Return		bool - False if any of the targets could not be created
+	Brief		Creates the render target and depth/stencil views and binds
+				them to the pipeline
+*/
+bool RenderBackend::createTargets(int width, int height)
+{
+	width_ = width;
+	height_ = height;
+
+	ID3D10Texture2D* backBuffer = acquireBackBuffer();
+	if (!backBuffer)
+		return false;
+
+	HRESULT hr = d3dDevice_->CreateRenderTargetView(backBuffer, 0, &renderTargetView_);
+	backBuffer->Release();
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating render target view - Failed", "Error", MB_OK);
+		return false;
+	}
+
+	// Create the depth/stencil buffer and view
+	D3D10_TEXTURE2D_DESC depthStencilDesc;
+
+	depthStencilDesc.Width = width_;
+	depthStencilDesc.Height = height_;
+	depthStencilDesc.MipLevels = 1;
+	depthStencilDesc.ArraySize = 1;
+	depthStencilDesc.Format= DXGI_FORMAT_D24_UNORM_S8_UINT;
+
+	// Multi-sampling must match the back buffer values
+	depthStencilDesc.SampleDesc.Count = 1;
+	depthStencilDesc.SampleDesc.Quality = 0;
+
+	depthStencilDesc.Usage = D3D10_USAGE_DEFAULT;
+	depthStencilDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL;
+	depthStencilDesc.CPUAccessFlags = 0;
+	depthStencilDesc.MiscFlags = 0;
+
+	hr = d3dDevice_->CreateTexture2D(&depthStencilDesc, 0, &depthStencilBuffer_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating depth/stencil buffer - Failed", "Error", MB_OK);
+		return false;
+	}
+	d3dDevice_->CreateDepthStencilView(depthStencilBuffer_, 0, &depthStencilView_);
+
+	// Bind the render target view and depth/stencil view to the pipeline
+	// and set the viewport transform
+	resetOMTargetsAndViewport();
+
+	return true;
+}
+
+/*
+	Name		RenderBackend::releaseTargets
+	Syntax		RenderBackend::releaseTargets()
+	Brief		Releases the render target and depth/stencil views
+*/
+void RenderBackend::releaseTargets()
+{
+	if (renderTargetView_)
+	{
+		renderTargetView_->Release();
+		renderTargetView_ = 0;
+	}
+
+	if (depthStencilView_)
+	{
+		depthStencilView_->Release();
+		depthStencilView_ = 0;
+	}
+
+	if (depthStencilBuffer_)
+	{
+		depthStencilBuffer_->Release();
+		depthStencilBuffer_ = 0;
+	}
+}
+
+/*
+	Name		HardwareBackend::HardwareBackend
+	Syntax		HardwareBackend()
+	Brief		HardwareBackend constructor initialises member variables
+*/
+HardwareBackend::HardwareBackend()
+: swapChain_(0)
+{
+}
+
+/*
+	Name		HardwareBackend::~HardwareBackend
+	Syntax		~HardwareBackend()
+	Brief		HardwareBackend destructor
+*/
+HardwareBackend::~HardwareBackend()
+{
+	deinitialise();
+}
+
+/*
+	Name		HardwareBackend::initialise
+	Syntax		HardwareBackend::initialise(HWND window, int width, int height)
+	Param		HWND window - The window to present to
+	Param		int width - Width of the back buffer
+	Param		int height - Height of the back buffer
+	Return		bool - False if the device or swap chain could not be created
+	Brief		Creates the Direct3D device and the DXGI swap chain
+	Details		The swap chain is responsible for getting the data from the
+				D3D device and representing it on the screen
+*/
+bool HardwareBackend::initialise(HWND window, int width, int height)
+{
+	// DXGI_SWAP_CHAIN_DESC is used to describe the swap chain
+	DXGI_SWAP_CHAIN_DESC swapChainDesc;
+	ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
+
+	// Description of the display mode
+	swapChainDesc.BufferDesc.Width = width;
+	swapChainDesc.BufferDesc.Height = height;
+	swapChainDesc.BufferDesc.RefreshRate.Numerator = 60;
+	swapChainDesc.BufferDesc.RefreshRate.Denominator = 1;
+	swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
+	swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
+
+	// Multi-sampling parameters (count 1, quality 0 disables multi-sampling)
+	swapChainDesc.SampleDesc.Count = 1;
+	swapChainDesc.SampleDesc.Quality = 0;
+
+	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+	swapChainDesc.BufferCount = 1;
+
+	swapChainDesc.OutputWindow = window;
+	swapChainDesc.Windowed = true;
+
+	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
+	swapChainDesc.Flags = 0;
+
+	// Create the device and swap chain
+	HRESULT hr = D3D10CreateDeviceAndSwapChain(NULL, D3D10_DRIVER_TYPE_HARDWARE, NULL, 0,
+									D3D10_SDK_VERSION, &swapChainDesc, &swapChain_, &d3dDevice_ );
+	if(FAILED(hr))
+	{
+		MessageBox(0, "Creating device and swap chain - Failed",
+			"Error", MB_OK);
+		return false;
+	}
+
+	return createTargets(width, height);
+}
+
+/*
+	Name		HardwareBackend::deinitialise
+	Syntax		HardwareBackend::deinitialise()
+	Brief		Releases the swap chain, the output targets and the device
+*/
+void HardwareBackend::deinitialise()
+{
+	if (swapChain_)
+	{
+		swapChain_->Release();
+		swapChain_ = 0;
+	}
+
+	RenderBackend::deinitialise();
+}
+
+/*
+	Name		HardwareBackend::resize
+	Syntax		HardwareBackend::resize(int width, int height)
+	Param		int width - New width of the back buffer
+	Param		int height - New height of the back buffer
+	Return		bool - False if the targets could not be recreated
+	Brief		Resizes the swap chain and recreates the output targets
+*/
+bool HardwareBackend::resize(int width, int height)
+{
+	releaseTargets();
+
+	swapChain_->ResizeBuffers(1, width, height, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
+
+	return createTargets(width, height);
+}
+
+/*
+	Name		HardwareBackend::acquireBackBuffer
+	Syntax		HardwareBackend::acquireBackBuffer()
+	Return		ID3D10Texture2D* - The swap chain's back buffer
+	Brief		Retrieves the back buffer from the swap chain as a texture
+*/
+ID3D10Texture2D* HardwareBackend::acquireBackBuffer()
+{
+	ID3D10Texture2D* backBuffer = 0;
+	swapChain_->GetBuffer(0, __uuidof(ID3D10Texture2D), reinterpret_cast<void**>(&backBuffer));
+	return backBuffer;
+}
+
+/*
+	Name		HardwareBackend::present
+	Syntax		HardwareBackend::present()
+	Brief		Presents the back buffer to the window
+*/
+void HardwareBackend::present()
+{
+	swapChain_->Present(0, 0);
+}
+
+/*
+	Name		NullBackend::NullBackend
+	Syntax		NullBackend()
+	Brief		NullBackend constructor
+*/
+NullBackend::NullBackend()
+{
+}
+
+/*
+	Name		NullBackend::~NullBackend
+	Syntax		~NullBackend()
+	Brief		NullBackend destructor
+*/
+NullBackend::~NullBackend()
+{
+	deinitialise();
+}
+
+/*
+	Name		NullBackend::initialise
+	Syntax		NullBackend::initialise(HWND window, int width, int height)
+	Param		HWND window - Not used
+	Param		int width - Width of the off-screen target
+	Param		int height - Height of the off-screen target
+	Return		bool - False if the device could not be created
+	Brief		Creates a null reference device and off-screen targets
+*/
+bool NullBackend::initialise(HWND window, int width, int height)
+{
+	HRESULT hr = D3D10CreateDevice(NULL, D3D10_DRIVER_TYPE_NULL, NULL, 0,
+								   D3D10_SDK_VERSION, &d3dDevice_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating null device - Failed", "Error", MB_OK);
+		return false;
+	}
+
+	return createTargets(width, height);
+}
+
+/*
+	Name		NullBackend::resize
+	Syntax		NullBackend::resize(int width, int height)
+	Param		int width - New width of the off-screen target
+	Param		int height - New height of the off-screen target
+	Return		bool - False if the targets could not be recreated
+	Brief		Recreates the off-screen targets
+*/
+bool NullBackend::resize(int width, int height)
+{
+	releaseTargets();
+
+	return createTargets(width, height);
+}
+
+/*
+	Name		NullBackend::acquireBackBuffer
+	Syntax		NullBackend::acquireBackBuffer()
+	Return		ID3D10Texture2D* - An off-screen colour target
+	Brief		Creates a texture to stand in for the swap chain back buffer
+*/
+ID3D10Texture2D* NullBackend::acquireBackBuffer()
+{
+	D3D10_TEXTURE2D_DESC texDesc;
+	texDesc.Width              = width_;
+	texDesc.Height             = height_;
+	texDesc.MipLevels          = 1;
+	texDesc.ArraySize          = 1;
+	texDesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM;
+	texDesc.SampleDesc.Count   = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage              = D3D10_USAGE_DEFAULT;
+	texDesc.BindFlags          = D3D10_BIND_RENDER_TARGET;
+	texDesc.CPUAccessFlags     = 0;
+	texDesc.MiscFlags          = 0;
+
+	ID3D10Texture2D* backBuffer = 0;
+	HRESULT hr = d3dDevice_->CreateTexture2D(&texDesc, 0, &backBuffer);
+	if (FAILED(hr))
+	{
+		MessageBox(0, "Creating off-screen target - Failed", "Error", MB_OK);
+		return 0;
+	}
+	return backBuffer;
+}
+
+/*
+	Name		NullBackend::present
+	Syntax		NullBackend::present()
+	Brief		Nothing is presented - the device is flushed so that queued
+				commands are retired every frame
+*/
+void NullBackend::present()
+{
+	d3dDevice_->Flush();
+}
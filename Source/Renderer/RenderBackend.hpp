@@ -0,0 +1,150 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		Render Backend
+	Brief		Definition of the abstract RenderBackend class - owns the
+				Direct3D device and output targets, and records the draw
+				calls, vertices and bytes submitted through it
+*/
+
+#ifndef RENDERBACKEND_H
+#define RENDERBACKEND_H
+
+#include <d3dx10.h>
+
+/*
+	Name		RenderStats
+	Syntax		RenderStats
+	Brief		Counters for the work submitted to a render backend
+*/
+struct RenderStats
+{
+	RenderStats() { reset(); }
+	void reset() { ZeroMemory(this, sizeof(RenderStats)); }
+	void add(const RenderStats& rhs);
+
+	UINT drawCalls;
+	UINT autoDrawCalls;		// DrawAuto - vertex count is only known on the GPU
+	UINT64 vertices;
+	UINT64 bytesUploaded;
+	UINT buffersCreated;
+	UINT texturesCreated;
+};
+
+class RenderBackend
+{
+public:
+	RenderBackend();
+	virtual ~RenderBackend();
+
+	virtual bool initialise(HWND window, int width, int height) = 0;
+	virtual void deinitialise();
+	virtual bool resize(int width, int height) = 0;
+	virtual bool isHeadless() const = 0;
+
+	void beginFrame();
+	void endFrame();
+	void resetOMTargetsAndViewport();
+
+	// Resource creation - counts the bytes uploaded with the initial data
+	HRESULT createBuffer(const D3D10_BUFFER_DESC* desc,
+						 const D3D10_SUBRESOURCE_DATA* initData,
+						 ID3D10Buffer** buffer);
+	HRESULT createTexture1D(const D3D10_TEXTURE1D_DESC* desc,
+							const D3D10_SUBRESOURCE_DATA* initData,
+							ID3D10Texture1D** texture);
+	HRESULT createTexture2D(const D3D10_TEXTURE2D_DESC* desc,
+							const D3D10_SUBRESOURCE_DATA* initData,
+							ID3D10Texture2D** texture);
+	HRESULT createTexture3D(const D3D10_TEXTURE3D_DESC* desc,
+							const D3D10_SUBRESOURCE_DATA* initData,
+							ID3D10Texture3D** texture);
+	void updateSubresource(ID3D10Resource* resource, UINT subresource,
+						   const void* data, UINT rowPitch, UINT bytes,
+						   UINT depthPitch = 0, const D3D10_BOX* box = 0);
+
+	// Draw submission
+	void draw(UINT vertexCount, UINT startVertex);
+	void drawIndexed(UINT indexCount, UINT startIndex, INT baseVertex);
+	void drawAuto();
+	void drawSubset(ID3DX10Mesh* mesh, UINT subset, UINT vertexCount);
+
+	ID3D10Device* getDevice() const { return d3dDevice_; };
+	const RenderStats& getFrameStats() const { return frameStats_; };
+	const RenderStats& getTotalStats() const { return totalStats_; };
+	UINT getFrameCount() const { return frameCount_; };
+
+protected:
+	virtual ID3D10Texture2D* acquireBackBuffer() = 0;
+	virtual void present() = 0;
+
+	void record(const RenderStats& stats);
+	bool createTargets(int width, int height);
+	void releaseTargets();
+
+	ID3D10Device* d3dDevice_;
+	ID3D10Texture2D* depthStencilBuffer_;
+	ID3D10RenderTargetView* renderTargetView_;
+	ID3D10DepthStencilView* depthStencilView_;
+
+	int width_;
+	int height_;
+
+private:
+	RenderBackend(const RenderBackend& rhs);
+	RenderBackend& operator=(const RenderBackend& rhs);
+
+	RenderStats frameStats_;
+	RenderStats totalStats_;
+	UINT frameCount_;
+};
+
+/*
+	Name		Hardware Backend
+	Brief		Renders through a hardware device to a DXGI swap chain
+*/
+class HardwareBackend : public RenderBackend
+{
+public:
+	HardwareBackend();
+	~HardwareBackend();
+
+	bool initialise(HWND window, int width, int height);
+	void deinitialise();
+	bool resize(int width, int height);
+	bool isHeadless() const { return false; };
+
+protected:
+	ID3D10Texture2D* acquireBackBuffer();
+	void present();
+
+private:
+	IDXGISwapChain* swapChain_;
+};
+
+/*
+	Name		Null Backend
+	Brief		Renders through a null reference device to an off-screen
+				target
+	Details		The null device accepts every API call but never rasterises,
+				so the full frame loop can run and be measured on machines
+				without a GPU or a window
+*/
+class NullBackend : public RenderBackend
+{
+public:
+	NullBackend();
+	~NullBackend();
+
+	bool initialise(HWND window, int width, int height);
+	bool resize(int width, int height);
+	bool isHeadless() const { return true; };
+
+protected:
+	ID3D10Texture2D* acquireBackBuffer();
+	void present();
+};
+
+#endif // RENDERBACKEND_H
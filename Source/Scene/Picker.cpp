@@ -0,0 +1,132 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*	
+	Name		Picker
+	Brief		Definition of Picker class, which finds the object under a 
+				ray from the bounding volumes the states give it
+*/
+
+#include "Scene/Picker.hpp"
+#include "Maths/m3dRay.h"
+
+/*
+	Name		Picker::clear
+	Syntax		Picker::clear()
+	Brief		Removes every bounding volume
+*/
+void Picker::clear()
+{
+	sphereX_.clear();
+	sphereY_.clear();
+	sphereZ_.clear();
+	sphereRadius_.clear();
+	sphereTypes_.clear();
+	sphereIds_.clear();
+
+	boxMinX_.clear();
+	boxMinY_.clear();
+	boxMinZ_.clear();
+	boxMaxX_.clear();
+	boxMaxY_.clear();
+	boxMaxZ_.clear();
+	boxTypes_.clear();
+	boxIds_.clear();
+}
+
+/*
+	Name		Picker::addSphere
+	Syntax		Picker::addSphere(const D3DXVECTOR3& centre, float radius, 
+								  PickType type, int id)
+	Param		const D3DXVECTOR3& centre - Centre of the bounding sphere
+	Param		float radius - Radius of the bounding sphere
+	Param		PickType type - What the object is
+	Param		int id - Returned in the result when the object is picked
+	Brief		Adds an object bounded by a sphere
+*/
+void Picker::addSphere(const D3DXVECTOR3& centre, float radius, PickType type, int id)
+{
+	sphereX_.push_back(centre.x);
+	sphereY_.push_back(centre.y);
+	sphereZ_.push_back(centre.z);
+	sphereRadius_.push_back(radius);
+	sphereTypes_.push_back(type);
+	sphereIds_.push_back(id);
+}
+
+/*
+	Name		Picker::addBox
+	Syntax		Picker::addBox(const D3DXVECTOR3& boxMin, 
+							   const D3DXVECTOR3& boxMax, PickType type, 
+							   int id)
+	Param		const D3DXVECTOR3& boxMin - Lowest corner of the bounding box
+	Param		const D3DXVECTOR3& boxMax - Highest corner of the bounding box
+	Param		PickType type - What the object is
+	Param		int id - Returned in the result when the object is picked
+	Brief		Adds an object bounded by an axis aligned box
+*/
+void Picker::addBox(const D3DXVECTOR3& boxMin, const D3DXVECTOR3& boxMax, PickType type, int id)
+{
+	boxMinX_.push_back(boxMin.x);
+	boxMinY_.push_back(boxMin.y);
+	boxMinZ_.push_back(boxMin.z);
+	boxMaxX_.push_back(boxMax.x);
+	boxMaxY_.push_back(boxMax.y);
+	boxMaxZ_.push_back(boxMax.z);
+	boxTypes_.push_back(type);
+	boxIds_.push_back(id);
+}
+
+/*
+	Name		Picker::pick
+	Syntax		Picker::pick(const D3DXVECTOR3& origin, 
+							 const D3DXVECTOR3& dir, PickResult* result)
+	Param		const D3DXVECTOR3& origin - Start of the ray
+	Param		const D3DXVECTOR3& dir - Unit direction of the ray
+	Param		PickResult* result - Receives the nearest object hit
+	Return		bool - False if the ray hits nothing
+	Brief		Finds the nearest object along a ray
+*/
+bool Picker::pick(const D3DXVECTOR3& origin, const D3DXVECTOR3& dir, PickResult* result) const
+{
+	M3DVector3f o = { origin.x, origin.y, origin.z };
+	M3DVector3f d = { dir.x, dir.y, dir.z };
+
+	float sphereT = -1.0f;
+	int sphere = -1;
+	if (!sphereIds_.empty())
+	{
+		M3DSphereArray spheres = { &sphereX_[0], &sphereY_[0], &sphereZ_[0], 
+								   &sphereRadius_[0], (int)sphereIds_.size() };
+		sphere = m3dRayNearestSphere(o, d, spheres, &sphereT);
+	}
+
+	float boxT = -1.0f;
+	int box = -1;
+	if (!boxIds_.empty())
+	{
+		M3DBoxArray boxes = { &boxMinX_[0], &boxMinY_[0], &boxMinZ_[0], 
+							  &boxMaxX_[0], &boxMaxY_[0], &boxMaxZ_[0], 
+							  (int)boxIds_.size() };
+		box = m3dRayNearestBox(o, d, boxes, &boxT);
+	}
+
+	if (sphere < 0 && box < 0)
+		return false;
+
+	if (box < 0 || (sphere >= 0 && sphereT <= boxT))
+	{
+		result->type = sphereTypes_[sphere];
+		result->id = sphereIds_[sphere];
+		result->distance = sphereT;
+	}
+	else
+	{
+		result->type = boxTypes_[box];
+		result->id = boxIds_[box];
+		result->distance = boxT;
+	}
+	result->point = origin + dir * result->distance;
+	return true;
+}
@@ -0,0 +1,55 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*	
+	Name		Picker
+	Brief		Definition of Picker class, which finds the object under a 
+				ray from the bounding volumes the states give it
+*/
+
+#ifndef PICKER_H
+#define PICKER_H
+
+#include <d3dx10.h>
+#include <vector>
+
+enum PickType
+{
+	PICK_TREE,
+	PICK_TYPES_NO
+};
+
+/*
+	Name		PickResult
+	Syntax		PickResult
+	Brief		The object found by a pick and where the ray hit it
+*/
+struct PickResult
+{
+	PickType type;
+	int id;					// Id the object was added with
+	float distance;			// Along the ray, 0 if the ray starts inside it
+	D3DXVECTOR3 point;
+};
+
+class Picker
+{
+public:
+	void clear();
+	void addSphere(const D3DXVECTOR3& centre, float radius, PickType type, int id);
+	void addBox(const D3DXVECTOR3& boxMin, const D3DXVECTOR3& boxMax, PickType type, int id);
+	bool pick(const D3DXVECTOR3& origin, const D3DXVECTOR3& dir, PickResult* result) const;
+
+private:
+	// Bounding volumes, as separate arrays for the ray kernels
+	std::vector<float> sphereX_, sphereY_, sphereZ_, sphereRadius_;
+	std::vector<PickType> sphereTypes_;
+	std::vector<int> sphereIds_;
+
+	std::vector<float> boxMinX_, boxMinY_, boxMinZ_, boxMaxX_, boxMaxY_, boxMaxZ_;
+	std::vector<PickType> boxTypes_;
+	std::vector<int> boxIds_;
+};
+
+#endif // PICKER_H
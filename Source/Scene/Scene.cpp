@@ -10,6 +10,8 @@
 #include "Scene/Scene.hpp"
 #include "States/Spring.hpp"
 #include "Global/Global.hpp"
+#include "Input/InputLog.hpp"
+#include "Profiler/Profiler.hpp"
 
 Scene * Scene::instance_ = 0;
 
@@ -32,12 +34,15 @@ Scene * Scene::instance()
 	Brief		Scene constructor initialises member variables
 */
 Scene::Scene()
-: d3dDevice_(0), swapChain_(0), depthStencilBuffer_(0), renderTargetView_(0),
-  depthStencilView_(0), width_(SCREENWIDTH), height_(SCREENHEIGHT), paused_(false),
+: backend_(0), inputLog_(0), replayStep_(0), particlesLand_(true), sceneTime_(0), simStep_(0), 
+  simThreaded_(false), simThread_(0), simRunning_(0), stateOver_(0), 
+  publishTicks_(0), width_(SCREENWIDTH), height_(SCREENHEIGHT), paused_(false), 
   minimised_(false), maximised_(false), resizing_(false), initialised_(false),
   currentState_(0)
 {
 	aspect_ = (float)width_/height_;
+
+	InitializeCriticalSection(&snapshotLock_);
 }
 
 /*
@@ -47,52 +52,39 @@ Scene::Scene()
 */
 Scene::~Scene()
 {
-
+	DeleteCriticalSection(&snapshotLock_);
 }
 
 /*
 	Name		Scene::initialise
-	Syntax		Scene::initialise()
-	Brief		Creates the Direct3D device and the DXGI swap chain 
-	Details	The swap chain is responsible for getting the data from the D3D device and representing it on the screen
-*/
-void Scene::initialise()
-{
-	// DXGI_SWAP_CHAIN_DESC is used to describe the swap chain
-	DXGI_SWAP_CHAIN_DESC swapChainDesc;
-	ZeroMemory(&swapChainDesc, sizeof(swapChainDesc));
-
-	// Description of the display mode
-	swapChainDesc.BufferDesc.Width = width_;
-	swapChainDesc.BufferDesc.Height = height_;
-	swapChainDesc.BufferDesc.RefreshRate.Numerator = 60;
-	swapChainDesc.BufferDesc.RefreshRate.Denominator = 1;
-	swapChainDesc.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	swapChainDesc.BufferDesc.ScanlineOrdering = DXGI_MODE_SCANLINE_ORDER_UNSPECIFIED;
-	swapChainDesc.BufferDesc.Scaling = DXGI_MODE_SCALING_UNSPECIFIED;
-
-	// Multi-sampling parameters (count 1, quality 0 disables multi-sampling)
-	swapChainDesc.SampleDesc.Count = 1;
-	swapChainDesc.SampleDesc.Quality = 0;
-	
-	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	swapChainDesc.BufferCount = 1;
-
-	swapChainDesc.OutputWindow = ghWnd;
-	swapChainDesc.Windowed = true;
-
-	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_DISCARD;
-	swapChainDesc.Flags = 0;
-
-	// Create the device and swap chain
-	HRESULT hr = D3D10CreateDeviceAndSwapChain(NULL, D3D10_DRIVER_TYPE_HARDWARE, NULL, 0, 
-									D3D10_SDK_VERSION, &swapChainDesc, &swapChain_, &d3dDevice_ );
-	if(FAILED(hr))
+	Syntax		Scene::initialise(bool headless)
+	Param		bool headless - True to render through the null backend
+	Brief		Creates the render backend and sets the initial state
+	Details		The hardware backend presents to the main window through a
+				DXGI swap chain. The null backend needs neither a window nor
+				a GPU and is used to run and measure the frame loop headlessly
+*/
+void Scene::initialise(bool headless)
+{
+	if (headless)
+		backend_ = new NullBackend;
+	else
+		backend_ = new HardwareBackend;
+
+	if (!backend_->initialise(ghWnd, width_, height_))
 	{
-		MessageBox(0, "Creating device and swap chain - Failed",
+		MessageBox(0, "Initialising render backend - Failed",
 			"Error", MB_OK);
 	}
 	timer_.reset();
+	sceneTime_ = 0.0;
+
+	// Rasterise the occluders on every core, up to one thread per tile
+	SYSTEM_INFO systemInfo;
+	GetSystemInfo(&systemInfo);
+	occlusion_.initialise(min((int)systemInfo.dwNumberOfProcessors, OcclusionBuffer::TILES_NO));
+	particleBudget_.setParticleBudget(PARTICLE_BUDGET);
+	textureArrays_.initialise(backend_);
 
 	initialised_ = true;
 
@@ -101,6 +93,9 @@ void Scene::initialise()
 	// Set initial state for the scene
 	currentState_ = new Spring;
 	currentState_->initialise();
+
+	timer_.setFixedStep(simStep_);
+	startSimThread();
 }
 
 /*
@@ -110,78 +105,21 @@ void Scene::initialise()
 */
 void Scene::resetOMTargetsAndViewport()
 {
-	d3dDevice_->OMSetRenderTargets(1, &renderTargetView_, depthStencilView_);
-
-	D3D10_VIEWPORT vp;
-	vp.TopLeftX = 0;
-	vp.TopLeftY = 0;
-	vp.Width    = width_;
-	vp.Height   = height_;
-	vp.MinDepth = 0.0f;
-	vp.MaxDepth = 1.0f;
-
-	d3dDevice_->RSSetViewports(1, &vp);
+	backend_->resetOMTargetsAndViewport();
 }
 
 /*
 	Name		Scene::onResize
 	Syntax		Scene::onResize()
-	Brief		
-	Details	Retrieves the back buffer from the swap chain as a texture, creates a render target 
-				using the texture, and passes it to D3D device as the active render target
+	Brief		Resizes the back buffer and updates the projection matrix
+	Details	The backend recreates its render target and depth/stencil views 
+				at the new size and binds them to the D3D device
 */
 void Scene::onResize()
 {
 	if(initialised_)
 	{
-		// Release the old views
-		if(renderTargetView_)
-			renderTargetView_->Release();
-
-		if(depthStencilView_)
-			depthStencilView_->Release();
-
-		if(depthStencilBuffer_)
-			depthStencilBuffer_->Release();
-
-		// Resize the swap chain
-		swapChain_->ResizeBuffers(1, width_, height_, DXGI_FORMAT_R8G8B8A8_UNORM, 0);
-
-		// Set up the back buffer of the swap chain to be used as a render target by the D3D device
-		ID3D10Texture2D * backBuffer;
-
-		swapChain_->GetBuffer(0, __uuidof(ID3D10Texture2D), reinterpret_cast<void**>(&backBuffer));
-		d3dDevice_->CreateRenderTargetView(backBuffer, 0, &renderTargetView_);
-		
-		backBuffer->Release();
-
-		// Create the depth/stencil buffer and view
-		D3D10_TEXTURE2D_DESC depthStencilDesc;
-		
-		depthStencilDesc.Width = width_;
-		depthStencilDesc.Height = height_;
-		depthStencilDesc.MipLevels = 1;
-		depthStencilDesc.ArraySize = 1;
-		depthStencilDesc.Format= DXGI_FORMAT_D24_UNORM_S8_UINT;
-
-		// Multi-sampling must match the swap chain values
-		depthStencilDesc.SampleDesc.Count = 1; 
-		depthStencilDesc.SampleDesc.Quality = 0;
-
-		depthStencilDesc.Usage = D3D10_USAGE_DEFAULT;
-		depthStencilDesc.BindFlags = D3D10_BIND_DEPTH_STENCIL;
-		depthStencilDesc.CPUAccessFlags = 0; 
-		depthStencilDesc.MiscFlags = 0;
-
-		d3dDevice_->CreateTexture2D(&depthStencilDesc, 0, &depthStencilBuffer_);
-		d3dDevice_->CreateDepthStencilView(depthStencilBuffer_, 0, &depthStencilView_);
-
-		// Bind the render target view and depth/stencil view to the pipeline
-		d3dDevice_->OMSetRenderTargets(1, &renderTargetView_, depthStencilView_);
-		
-		// Set the viewport transform
-		D3D10_VIEWPORT vp = {0, 0, width_, height_, 0, 1};
-		d3dDevice_->RSSetViewports(1, &vp);
+		backend_->resize(width_, height_);
 
 		aspect_ = (float)width_/height_;
 		D3DXMatrixPerspectiveFovLH(&projection_, (float)D3DX_PI * 0.25f, aspect_, 1.0f, 5000.0f);
@@ -191,20 +129,74 @@ void Scene::onResize()
 /*
 	Name		Scene::runFrame
 	Syntax		Scene::runFrame()
-	Return		bool - False if the scene is changing state
+	Return		bool - False if the scene is changing state or a replay has
+				finished
 	Brief		Runs the current frame of the scene
+	Details		With a simulation step set, the state is updated in fixed 
+				steps for the time that has built up, at most 
+				MAX_CATCHUP_STEPS a frame, and rendered interpolated between
+				the last two steps. When replaying, one step is run a frame 
+				with either the replay step or the one recorded, so that the
+				states see the same input and time on every run
 */
 bool Scene::runFrame()
 {
-	timer_.tick();
-	bool stateOver = currentState_->update(timer_.getDeltaTime());
+	PROFILE_ZONE("Scene::runFrame");
+
+	bool stateOver = false;
+	float alpha = 1.0f;
+
+	if (inputLog_ && inputLog_->isReplaying())
+	{
+		if (!inputLog_->nextFrame())
+			return false;
+
+		stateOver = simulate(replayStep_ > 0.0f ? replayStep_ : inputLog_->getFrame().dt);
+	}
+	else if (simThread_)
+	{
+		// The frame is only timed for the frame cap
+		timer_.tick();
+		timer_.dropSteps();
+
+		stateOver = stateOver_ != 0;
+		alpha = getThreadAlpha();
+	}
+	else if (simStep_ > 0.0f)
+	{
+		timer_.tick();
+
+		int steps = 0;
+		while (!stateOver && timer_.stepFixed())
+		{
+			stateOver = simulate(simStep_);
+
+			if (++steps == MAX_CATCHUP_STEPS)
+			{
+				timer_.dropSteps();
+				break;
+			}
+		}
+		alpha = timer_.getStepAlpha();
+	}
+	else
+	{
+		timer_.tick();
+		stateOver = simulate(timer_.getDeltaTime());
+	}
 
 	if(stateOver)
 	{
+		stopSimThread();
 		changeState();
+		startSimThread();
 	}
 	else
 	{
+		EnterCriticalSection(&snapshotLock_);
+		currentState_->apply(alpha);
+		LeaveCriticalSection(&snapshotLock_);
+
 		startFrame();
 		currentState_->render();
 		endFrame();
@@ -224,7 +216,21 @@ bool Scene::runFrame()
 */
 void Scene::deinitialise()
 {
+	stopSimThread();
+	occlusion_.deinitialise();
+
+	if (currentState_)
+	{
+		currentState_->deinitialise();
+		delete currentState_;
+		currentState_ = 0;
+	}
+
+	textureArrays_.clear();
+	delete backend_;
+	backend_ = 0;
 
+	initialised_ = false;
 }
 
 /*
@@ -254,9 +260,16 @@ void Scene::setHeight(int height)
 	Syntax		Scene::setPaused(bool paused)
 	Param		bool paused - Flag to indicate if the scene is paused
 	Brief		Sets the window paused flag
+	Details		The timer is stopped while the scene is paused so that the 
+				first frame after it resumes does not take a huge step
 */
 void Scene::setPaused(bool paused)
 {
+	if (paused && !paused_)
+		timer_.stop();
+	else if (!paused && paused_)
+		timer_.start();
+
 	paused_ = paused;
 }
 
@@ -293,6 +306,216 @@ void Scene::setResizing(bool resizing)
 	resizing_ = resizing;
 }
 
+/*
+	Name		Scene::setInputLog
+	Syntax		Scene::setInputLog(InputLog* log)
+	Param		InputLog* log - Log to record the input to or replay it from
+	Brief		Sets the input log used by the states created after this call
+*/
+void Scene::setInputLog(InputLog* log)
+{
+	inputLog_ = log;
+}
+
+/*
+	Name		Scene::setReplayStep
+	Syntax		Scene::setReplayStep(float replayStep)
+	Param		float replayStep - Time step for replays, zero to use the 
+				recorded one
+	Brief		Sets the time step used when replaying an input log
+*/
+void Scene::setReplayStep(float replayStep)
+{
+	replayStep_ = replayStep;
+}
+
+/*
+	Name		Scene::setSimStep
+	Syntax		Scene::setSimStep(float simStep)
+	Param		float simStep - Simulation time step, zero to update once a 
+				frame with the frame time
+	Brief		Sets the fixed time step the states are updated with
+	Details		Takes effect when the scene is next initialised
+*/
+void Scene::setSimStep(float simStep)
+{
+	simStep_ = simStep;
+}
+
+/*
+	Name		Scene::setSimThreaded
+	Syntax		Scene::setSimThreaded(bool threaded)
+	Param		bool threaded - True to simulate on a thread of its own
+	Brief		Sets whether the states are updated on a simulation thread
+	Details		Takes effect when the scene is next initialised. Only used
+				with a fixed simulation step, and never when replaying
+*/
+void Scene::setSimThreaded(bool threaded)
+{
+	simThreaded_ = threaded;
+}
+
+/*
+	Name		Scene::setParticlesLand
+	Syntax		Scene::setParticlesLand(bool land)
+	Param		bool land - False to let the particles fall through the
+				terrain
+	Brief		Sets whether the particle systems land on the terrain, so
+				the particles alive can be compared with and without
+	Details		Takes effect when a state next sets its systems' ground
+*/
+void Scene::setParticlesLand(bool land)
+{
+	particlesLand_ = land;
+}
+
+/*
+	Name		Scene::getSceneTime
+	Syntax		Scene::getSceneTime()
+	Return		double - Sum of the time steps simulated so far
+	Brief		Gets the time the scene has been simulated for
+	Details		The simulation thread adds to it under the snapshot lock,
+				so it is read under the lock too
+*/
+double Scene::getSceneTime()
+{
+	EnterCriticalSection(&snapshotLock_);
+	double sceneTime = sceneTime_;
+	LeaveCriticalSection(&snapshotLock_);
+	return sceneTime;
+}
+
+/*
+	Name		Scene::getSeason
+	Syntax		Scene::getSeason()
+	Return		Season - The season of the current state
+	Brief		Gets the season the scene is in
+*/
+Season Scene::getSeason() const
+{
+	return currentState_ ? currentState_->getSeason() : SEASON_SPRING;
+}
+
+/*
+	Name		Scene::pick
+	Syntax		Scene::pick(int x, int y, PickResult* result)
+	Param		int x - Horizontal position in the window, in pixels
+	Param		int y - Vertical position in the window, in pixels
+	Param		PickResult* result - Receives the object picked
+	Return		bool - False if there is nothing under the point
+	Brief		Finds the object under a point in the window
+	Details		A ray is cast through the point with the view and projection
+				of the last frame rendered, and tested against the bounding
+				volumes the current state adds to the picker
+*/
+bool Scene::pick(int x, int y, PickResult* result)
+{
+	if (!currentState_)
+		return false;
+
+	D3D10_VIEWPORT viewport;
+	viewport.TopLeftX = 0;
+	viewport.TopLeftY = 0;
+	viewport.Width = width_;
+	viewport.Height = height_;
+	viewport.MinDepth = 0.0f;
+	viewport.MaxDepth = 1.0f;
+
+	D3DXMATRIX identity;
+	D3DXMatrixIdentity(&identity);
+
+	D3DXVECTOR3 nearPoint((float)x, (float)y, 0.0f);
+	D3DXVECTOR3 farPoint((float)x, (float)y, 1.0f);
+	D3DXVec3Unproject(&nearPoint, &nearPoint, &viewport, &projection_, &view_, &identity);
+	D3DXVec3Unproject(&farPoint, &farPoint, &viewport, &projection_, &view_, &identity);
+
+	D3DXVECTOR3 dir = farPoint - nearPoint;
+	D3DXVec3Normalize(&dir, &dir);
+
+	picker_.clear();
+	currentState_->addPickables(&picker_);
+	return picker_.pick(nearPoint, dir, result);
+}
+
+/*
+	Name		Scene::addCullStats
+	Syntax		Scene::addCullStats(UINT tested, UINT culled, TimerTicks ticks)
+	Param		UINT tested - Objects tested against the frustum
+	Param		UINT culled - Objects found to be out of view
+	Param		TimerTicks ticks - Time taken to cull them
+	Brief		Adds a state's culling for the frame to the totals
+*/
+void Scene::addCullStats(UINT tested, UINT culled, TimerTicks ticks)
+{
+	cullStats_.tested += tested;
+	cullStats_.culled += culled;
+	cullStats_.ticks += ticks;
+}
+
+/*
+	Name		Scene::addOcclusionStats
+	Syntax		Scene::addOcclusionStats(UINT occluded, TimerTicks ticks)
+	Param		UINT occluded - Objects in view found to be hidden
+	Param		TimerTicks ticks - Time taken to rasterise the occluders and
+				test the objects
+	Brief		Adds a state's occlusion culling for the frame to the totals
+*/
+void Scene::addOcclusionStats(UINT occluded, TimerTicks ticks)
+{
+	cullStats_.occluded += occluded;
+	cullStats_.occlusionTicks += ticks;
+}
+
+/*
+	Name		Scene::addShadowStats
+	Syntax		Scene::addShadowStats(UINT cascades, UINT drawn, TimerTicks ticks)
+	Param		UINT cascades - Shadow cascades fitted to the camera
+	Param		UINT drawn - Cascades whose shadow maps were drawn again
+	Param		TimerTicks ticks - Time taken to fit them
+	Brief		Adds a state's shadow cascades for the frame to the totals
+*/
+void Scene::addShadowStats(UINT cascades, UINT drawn, TimerTicks ticks)
+{
+	shadowStats_.cascades += cascades;
+	shadowStats_.drawn += drawn;
+	shadowStats_.ticks += ticks;
+}
+
+/*
+	Name		Scene::addParticleStats
+	Syntax		Scene::addParticleStats(UINT live, UINT emitted, UINT killed,
+				float emitScale)
+	Param		UINT live - Particles the system has alive
+	Param		UINT emitted - Particles it emitted in the frame
+	Param		UINT killed - Particles newly counted as killed
+	Param		float emitScale - The emission scale the budget gave it
+	Brief		Adds a particle system's frame to the totals
+*/
+void Scene::addParticleStats(UINT live, UINT emitted, UINT killed, float emitScale)
+{
+	++particleStats_.systems;
+	particleStats_.live += live;
+	particleStats_.emitted += emitted;
+	particleStats_.killed += killed;
+	particleStats_.emitScale += emitScale;
+}
+
+/*
+	Name		Scene::addPrefetchResult
+	Syntax		Scene::addPrefetchResult(int hint, bool hit, bool stillHit)
+	Param		int hint - Which of the camera's look ahead hints was scored
+	Param		bool hit - True if it named the cell the camera reached
+	Param		bool stillHit - True if the cell the camera was over when the
+				hint was given would have been right
+	Brief		Adds a scored look ahead hint to the totals
+*/
+void Scene::addPrefetchResult(int hint, bool hit, bool stillHit)
+{
+	++prefetchStats_.hints[hint];
+	prefetchStats_.hits[hint] += hit ? 1 : 0;
+	prefetchStats_.stillHits[hint] += stillHit ? 1 : 0;
+}
+
 /*
 	Name		Scene::setWorld
 	Syntax		Scene::setWorld(D3DXMATRIX world)
@@ -343,8 +566,7 @@ void Scene::setWVP()
 */
 void Scene::startFrame()
 {
-	d3dDevice_->ClearRenderTargetView(renderTargetView_, D3DXVECTOR4(0, 0, 0, 1)); // Clear to black
-	d3dDevice_->ClearDepthStencilView(depthStencilView_, D3D10_CLEAR_DEPTH|D3D10_CLEAR_STENCIL, 1.0f, 0); // Set depth to 1 (furthest away)
+	backend_->beginFrame();
 }
 
 /*
@@ -354,7 +576,162 @@ void Scene::startFrame()
 */
 void Scene::endFrame()
 {
-	swapChain_->Present(0, 0);
+	backend_->endFrame();
+}
+
+/*
+	Name		Scene::simulate
+	Syntax		Scene::simulate(float dt)
+	Param		float dt - The time step
+	Return		bool - True if the state is to be changed
+	Brief		Runs one simulation step and publishes it for rendering
+	Details		Each step is recorded to the input log on its own, so that a
+				replay runs exactly the same steps
+*/
+bool Scene::simulate(float dt)
+{
+	if (inputLog_ && inputLog_->isRecording())
+		inputLog_->beginFrame(dt, getSeason());
+
+	EnterCriticalSection(&snapshotLock_);
+	sceneTime_ += dt;
+	LeaveCriticalSection(&snapshotLock_);
+	bool stateOver = currentState_->update(dt);
+
+	if (inputLog_ && inputLog_->isRecording())
+		inputLog_->endFrame();
+
+	if (!stateOver)
+	{
+		EnterCriticalSection(&snapshotLock_);
+		currentState_->publish();
+		publishTicks_ = GameTimer::now();
+		LeaveCriticalSection(&snapshotLock_);
+	}
+	return stateOver;
+}
+
+/*
+	Name		Scene::getThreadAlpha
+	Syntax		Scene::getThreadAlpha()
+	Return		float - Fraction of a step to interpolate by
+	Brief		Gets how far the frame is between the last two steps 
+				published by the simulation thread
+	Details		Rendering runs one step behind the simulation, so the
+				fraction is the time since the last step was published
+*/
+float Scene::getThreadAlpha()
+{
+	EnterCriticalSection(&snapshotLock_);
+	TimerTicks published = publishTicks_;
+	LeaveCriticalSection(&snapshotLock_);
+
+	double elapsed = (double)(GameTimer::now() - published) / 
+					 (double)GameTimer::ticksPerSecond();
+	float alpha = (float)(elapsed / simStep_);
+
+	return alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+}
+
+/*
+	Name		Scene::startSimThread
+	Syntax		Scene::startSimThread()
+	Brief		Starts the simulation thread if the scene is set to use one
+*/
+void Scene::startSimThread()
+{
+	if (!simThreaded_ || simStep_ <= 0.0f || simThread_ ||
+		(inputLog_ && inputLog_->isReplaying()))
+	{
+		return;
+	}
+
+	stateOver_ = 0;
+	simRunning_ = 1;
+	publishTicks_ = GameTimer::now();
+
+	simThread_ = CreateThread(0, 0, simThreadProc, this, 0, 0);
+	if (!simThread_)
+	{
+		MessageBox(0, "Creating simulation thread - Failed", "Error", MB_OK);
+		simRunning_ = 0;
+	}
+}
+
+/*
+	Name		Scene::stopSimThread
+	Syntax		Scene::stopSimThread()
+	Brief		Stops the simulation thread and waits for it to finish
+*/
+void Scene::stopSimThread()
+{
+	if (simThread_)
+	{
+		InterlockedExchange(&simRunning_, 0);
+		WaitForSingleObject(simThread_, INFINITE);
+		CloseHandle(simThread_);
+		simThread_ = 0;
+	}
+}
+
+/*
+	Name		Scene::simThreadProc
+	Syntax		Scene::simThreadProc(LPVOID scene)
+	Param		LPVOID scene - The scene
+	Return		DWORD - Zero
+	Brief		Entry point of the simulation thread
+*/
+DWORD WINAPI Scene::simThreadProc(LPVOID scene)
+{
+	static_cast<Scene*>(scene)->runSimThread();
+	return 0;
+}
+
+/*
+	Name		Scene::runSimThread
+	Syntax		Scene::runSimThread()
+	Brief		Runs fixed simulation steps until stopped or the state ends
+	Details		The thread has its own timer, capped to the step rate so 
+				that it sleeps between steps, with the timer period raised
+				so that it wakes on time. When the state ends it flags
+				it and exits, and the main thread changes the state and 
+				starts it again
+*/
+void Scene::runSimThread()
+{
+	GameTimer timer;
+	timer.setFixedStep(simStep_);
+	timer.setFrameCap(1.0 / simStep_);
+	timer.reset();
+
+	while (simRunning_)
+	{
+		if (paused_)
+		{
+			timer.stop();
+			GameTimer::sleepUntil(GameTimer::now() + GameTimer::ticksPerSecond() / 20);
+			continue;
+		}
+		timer.start();
+		timer.tick();
+
+		int steps = 0;
+		while (timer.stepFixed())
+		{
+			if (simulate(simStep_))
+			{
+				InterlockedExchange(&stateOver_, 1);
+				return;
+			}
+
+			if (++steps == MAX_CATCHUP_STEPS)
+			{
+				timer.dropSteps();
+				break;
+			}
+		}
+		timer.waitForNextFrame();
+	}
 }
 
 /*
@@ -12,8 +12,63 @@
 
 #include <d3dx10.h>
 #include "GameTimer/GameTimer.h"
+#include "Renderer/RenderBackend.hpp"
+#include "Renderer/OcclusionBuffer.hpp"
+#include "ParticleSystem/ParticleBudget.hpp"
+#include "Utility/TextureArrays.hpp"
+#include "States/State.hpp"
+#include "Scene/Picker.hpp"
 
-class State;
+class InputLog;
+
+/*
+	Name		CullStats
+	Syntax		CullStats
+	Brief		Counters for the objects the states cull against the camera
+*/
+struct CullStats
+{
+	CullStats() { reset(); }
+	void reset() { ZeroMemory(this, sizeof(CullStats)); }
+
+	UINT64 tested;
+	UINT64 culled;
+	TimerTicks ticks;	// Time spent culling
+	UINT64 occluded;	// Objects in view hidden by the occlusion buffer
+	TimerTicks occlusionTicks;	// Time spent rasterising and testing
+};
+
+/*
+	Name		ShadowStats
+	Syntax		ShadowStats
+	Brief		Counters for the shadow cascades the states fit and draw
+*/
+struct ShadowStats
+{
+	ShadowStats() { reset(); }
+	void reset() { ZeroMemory(this, sizeof(ShadowStats)); }
+
+	UINT64 cascades;	// Cascades fitted
+	UINT64 drawn;		// Cascades whose shadow maps were drawn again
+	TimerTicks ticks;	// Time spent fitting
+};
+
+/*
+	Name		ParticleStats
+	Syntax		ParticleStats
+	Brief		Counters for the particle systems the states render
+*/
+struct ParticleStats
+{
+	ParticleStats() { reset(); }
+	void reset() { ZeroMemory(this, sizeof(ParticleStats)); }
+
+	UINT64 systems;		// Systems rendered, summed over the frames
+	UINT64 live;
+	UINT64 emitted;
+	UINT64 killed;
+	double emitScale;	// Sum of the emission scales the budget gave
+};
 
 class Scene
 {
@@ -23,7 +78,7 @@ public:
 
 	static Scene* instance();
 
-	void initialise();
+	void initialise(bool headless = false);
 	void onResize();
 	bool runFrame();	
 	void deinitialise();
@@ -35,6 +90,11 @@ public:
 	void setMinimised(bool min);
 	void setMaximised(bool max);
 	void setResizing(bool resizing);
+	void setInputLog(InputLog* log);
+	void setReplayStep(float replayStep);
+	void setSimStep(float simStep);
+	void setSimThreaded(bool threaded);
+	void setParticlesLand(bool land);
 
 	void setWorld(D3DXMATRIX world);
 	void setView(D3DXMATRIX view);
@@ -47,28 +107,69 @@ public:
 	bool isResizing() const { return resizing_; };
 
 	float getAspect() const { return aspect_; };
-	ID3D10Device * getDevice() const { return d3dDevice_; };
+	ID3D10Device * getDevice() const { return backend_ ? backend_->getDevice() : 0; };
+	RenderBackend* getBackend() const { return backend_; };
 	D3DXMATRIX getWorld() const { return world_; };
 	D3DXMATRIX getView() const { return view_; };
 	D3DXMATRIX getProjection() const { return projection_; };
 	D3DXMATRIX getWVP() const { return wvp_; };
 	GameTimer* getTimer() { return &timer_; };
+	InputLog* getInputLog() const { return inputLog_; };
+	double getSceneTime();
+	Season getSeason() const;
+
+	bool pick(int x, int y, PickResult* result);
+
+	OcclusionBuffer* getOcclusionBuffer() { return &occlusion_; };
+	ParticleBudget* getParticleBudget() { return &particleBudget_; };
+	TextureArrays* getTextureArrays() { return &textureArrays_; };
+	bool getParticlesLand() const { return particlesLand_; };
+
+	void addCullStats(UINT tested, UINT culled, TimerTicks ticks);
+	void addOcclusionStats(UINT occluded, TimerTicks ticks);
+	void addShadowStats(UINT cascades, UINT drawn, TimerTicks ticks);
+	void addParticleStats(UINT live, UINT emitted, UINT killed, float emitScale);
+
+	void addPrefetchResult(int hint, bool hit, bool stillHit);
+	const PrefetchStats& getPrefetchStats() const { return prefetchStats_; };
+	const CullStats& getCullStats() const { return cullStats_; };
+	const ShadowStats& getShadowStats() const { return shadowStats_; };
+	const ParticleStats& getParticleStats() const { return particleStats_; };
 
 private:
 	void startFrame();
 	void endFrame();
 
+	bool simulate(float dt);
+	float getThreadAlpha();
+	void startSimThread();
+	void stopSimThread();
+	void runSimThread();
+	static DWORD WINAPI simThreadProc(LPVOID scene);
+
 	void changeState();
 
 	static Scene* instance_;
 
-	ID3D10Device* d3dDevice_;
-	IDXGISwapChain* swapChain_;
-	ID3D10Texture2D* depthStencilBuffer_;
-	ID3D10RenderTargetView* renderTargetView_;
-	ID3D10DepthStencilView* depthStencilView_;
+	RenderBackend* backend_;
 
 	GameTimer timer_;
+	InputLog* inputLog_;	// Records or replays the input, if set
+	float replayStep_;		// Time step used in replays, zero to use the recorded one
+	bool particlesLand_;	// The particle systems are given the terrain to land on
+	double sceneTime_;		// Sum of the time steps the states have been updated with
+
+	// Fixed step simulation
+	float simStep_;			// Zero to update once a frame with the frame time
+	bool simThreaded_;		// Simulate on a thread of its own
+	HANDLE simThread_;
+	volatile LONG simRunning_;
+	volatile LONG stateOver_;	// Set by the simulation thread when the state ends
+	CRITICAL_SECTION snapshotLock_;	// Guards the state published for rendering
+	TimerTicks publishTicks_;	// When the last step was published
+
+	static const int MAX_CATCHUP_STEPS = 5;
+	static const int PARTICLE_BUDGET = 60000;	// Live particles across every system
 
 	int width_;
 	int height_;
@@ -87,6 +188,15 @@ private:
 	D3DXMATRIX wvp_;
 
 	State* currentState_;
+
+	Picker picker_;
+	OcclusionBuffer occlusion_;	// Shared by the states to cull what is behind the terrain
+	ParticleBudget particleBudget_;	// Shared by the states' particle systems
+	TextureArrays textureArrays_;	// Particle texture arrays, shared by their systems
+	CullStats cullStats_;	// Totals over every frame rendered
+	ShadowStats shadowStats_;
+	ParticleStats particleStats_;
+	PrefetchStats prefetchStats_;	// Totals over every simulation step
 };
 
 #endif
\ No newline at end of file
@@ -7,9 +7,11 @@
 	Brief		Definition of Model Shader Class inherited from Shader
 */
 
+#include <float.h>
 #include "Shaders/ModelShader.hpp"
 #include "Scene/Scene.hpp"
 #include "Lighting/Light.hpp"
+#include "Maths/m3dCascade.h"
 
 /*
 	Name		ModelShader::initialise
@@ -54,7 +56,9 @@ bool ModelShader::initialise()
 	lightSpotFactorVar_	= fx_->GetVariableByName("spotFactor")->AsScalar();
 	lightRangeVar_		= fx_->GetVariableByName("range")->AsScalar();
 	cameraPositionVar_  = fx_->GetVariableByName("cameraPos");
-	lightWvpVar_	    = fx_->GetVariableByName("lightWvp")->AsMatrix();
+	lightWvpsVar_	    = fx_->GetVariableByName("lightWvps")->AsMatrix();
+	cascadeEndsVar_	    = fx_->GetVariableByName("cascadeEnds")->AsVector();
+	cascadesNoVar_	    = fx_->GetVariableByName("cascadesNo")->AsScalar();
 	fogColorVar_		= fx_->GetVariableByName("fogColor");
 	wvpVar_				= fx_->GetVariableByName("wvp")->AsMatrix();
 	worldVar_			= fx_->GetVariableByName("world")->AsMatrix();
@@ -91,14 +95,25 @@ void ModelShader::deinitialise()
 }
 
 /*
-	Name		ModelShader::setLightWvp
-	Syntax		ModelShader::setLightWvp(D3DXMATRIX lightWvp)
-	Param		D3DXMATRIX lightWvp - The light WVP matrix of the model
-	Brief		Sets the effect file's light WVP
+	Name		ModelShader::setCascades
+	Syntax		ModelShader::setCascades(const D3DXMATRIX* lightWvps,
+				const float* splitFars, int count)
+	Param		const D3DXMATRIX* lightWvps - The light WVP matrix of the
+				model for each shadow cascade
+	Param		const float* splitFars - The view depth each cascade ends at
+	Param		int count - Number of cascades
+	Brief		Sets the effect file's shadow cascades
 */
-void ModelShader::setLightWvp(D3DXMATRIX lightWvp)
+void ModelShader::setCascades(const D3DXMATRIX* lightWvps, const float* splitFars, int count)
 {
-	lightWvpVar_->SetMatrix((float*)&lightWvp);
+	// Depths past the last cascade pick the last cascade
+	D3DXVECTOR4 cascadeEnds(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX);
+	for (int i = 0; i < count && i < M3D_MAX_CASCADES; ++i)
+		cascadeEnds[i] = splitFars[i];
+
+	lightWvpsVar_->SetMatrixArray((float*)lightWvps, 0, count);
+	cascadeEndsVar_->SetFloatVector((float*)&cascadeEnds);
+	cascadesNoVar_->SetInt(count);
 }
 
 /*
@@ -18,7 +18,7 @@ class ModelShader : public Shader
 {
 public:
     bool initialise();
-	void setLightWvp(D3DXMATRIX lightWvp);
+	void setCascades(const D3DXMATRIX* lightWvps, const float* splitFars, int count);
 	void setTechniqueDesc(D3D10_TECHNIQUE_DESC* techDesc);
 	void setWorldandWvp();
 	void setConstants(D3DXVECTOR3* cameraPos, Light* light,
@@ -44,7 +44,9 @@ private:
 	ID3D10EffectVariable* lightAttVar_;
 	ID3D10EffectScalarVariable* lightSpotFactorVar_;
 	ID3D10EffectScalarVariable* lightRangeVar_;
-	ID3D10EffectMatrixVariable* lightWvpVar_;
+	ID3D10EffectMatrixVariable* lightWvpsVar_;
+	ID3D10EffectVectorVariable* cascadeEndsVar_;
+	ID3D10EffectScalarVariable* cascadesNoVar_;
 	ID3D10EffectVariable* fogColorVar_;
 	ID3D10EffectVectorVariable* reflectMtrlVar_;
 	ID3D10EffectShaderResourceVariable* diffuseMapVar_;
@@ -10,52 +10,43 @@
 #include "Shaders/ParticleShader.hpp"
 #include "Scene/Scene.hpp"
 #include "ParticleSystem/Particle.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
 #include "Vertex/Vertex.hpp"
 
 /*
 	Name		ParticleShader::initialise
 	Syntax		ParticleShader::initialise()
 	Return		bool - Returns true once initialised
-	Brief		Initialises the shader
+	Brief		Initialises the shader with the rain effect file
 */
 bool ParticleShader::initialise()
 {
-	d3dDevice_ = Scene::instance()->getDevice();
-	if (!d3dDevice_)
-	{
-		MessageBox(0, "Retrieving device - Failed", "Error", MB_OK);
-		return false;
-	}
-
-	if (!createEffectFile(PARTICLE_RAIN))
-		return false;
-
-	streamOutTech_  = fx_->GetTechniqueByName("StreamOutTech");	
-	drawTech_       = fx_->GetTechniqueByName("DrawTech");	
-	viewProjVar_	= fx_->GetVariableByName("viewProj")->AsMatrix();
-	sceneTimeVar_	= fx_->GetVariableByName("sceneTime")->AsScalar();
-	timeStepVar_	= fx_->GetVariableByName("timeStep")->AsScalar();
-	eyePosVar_		= fx_->GetVariableByName("eyePosW")->AsVector();
-	emitPosVar_		= fx_->GetVariableByName("emitPosW")->AsVector();
-	emitDirVar_		= fx_->GetVariableByName("emitDirW")->AsVector();
-	texArrayVar_	= fx_->GetVariableByName("texArray")->AsShaderResource();
-	randomTexVar_	= fx_->GetVariableByName("randomTex")->AsShaderResource();
-
-
-	if (!buildVertexLayout())
-		return false;
-
-	return true;
+	return initialise(PARTICLE_RAIN);
 }
 
 /*
 	Name		ParticleShader::initialise
 	Syntax		ParticleShader::initialise(Particle particle)
-	Param		Particle particle - The particle effect file to use
+	Param		Particle particle - The built in particle type whose effect
+				file to use
 	Return		bool - Returns true once initialised
 	Brief		Initialises the shader
 */
 bool ParticleShader::initialise(Particle particle)
+{
+	return initialise(ParticleEffect(particle).getEffectFile());
+}
+
+/*
+	Name		ParticleShader::initialise
+	Syntax		ParticleShader::initialise(const std::string& effectFile)
+	Param		const std::string& effectFile - The effect file to use
+	Return		bool - Returns true once initialised
+	Brief		Initialises the shader
+	Details		Variables an effect file does not have are given as invalid
+				variables, which ignore being set
+*/
+bool ParticleShader::initialise(const std::string& effectFile)
 {
 	d3dDevice_ = Scene::instance()->getDevice();
 	if (!d3dDevice_)
@@ -64,7 +55,7 @@ bool ParticleShader::initialise(Particle particle)
 		return false;
 	}
 
-	if (!createEffectFile(particle))
+	if (!createEffectFile(effectFile))
 		return false;
 
 	streamOutTech_  = fx_->GetTechniqueByName("StreamOutTech");	
@@ -77,7 +68,34 @@ bool ParticleShader::initialise(Particle particle)
 	emitDirVar_		= fx_->GetVariableByName("emitDirW")->AsVector();
 	texArrayVar_	= fx_->GetVariableByName("texArray")->AsShaderResource();
 	randomTexVar_	= fx_->GetVariableByName("randomTex")->AsShaderResource();
+	emitScaleVar_	= fx_->GetVariableByName("emitScale")->AsScalar();
+	sizeScaleVar_	= fx_->GetVariableByName("sizeScale")->AsScalar();
+	wrapCountVar_	= fx_->GetVariableByName("wrapCount")->AsScalar();
+	windTexVar_		= fx_->GetVariableByName("windTex")->AsShaderResource();
+	windToTexVar_	= fx_->GetVariableByName("windToTex")->AsVector();
+	windOffsetVar_	= fx_->GetVariableByName("windOffset")->AsVector();
+	windWeightVar_	= fx_->GetVariableByName("windWeight")->AsScalar();
+	impactVar_		= fx_->GetVariableByName("impact")->AsScalar();
+	groundTexVar_	= fx_->GetVariableByName("groundTex")->AsShaderResource();
+	groundToUVar_	= fx_->GetVariableByName("groundToU")->AsVector();
+	groundToVVar_	= fx_->GetVariableByName("groundToV")->AsVector();
+	groundToWorldVar_ = fx_->GetVariableByName("groundToWorld")->AsVector();
+	groundLinearVar_ = fx_->GetVariableByName("groundLinear")->AsScalar();
 
+	accelVar_			= fx_->GetVariableByName("accelW")->AsVector();
+	emitIntervalVar_	= fx_->GetVariableByName("emitInterval")->AsScalar();
+	emitCountVar_		= fx_->GetVariableByName("emitCount")->AsScalar();
+	spreadVar_			= fx_->GetVariableByName("spread")->AsScalar();
+	emitHeightVar_		= fx_->GetVariableByName("emitHeight")->AsScalar();
+	initialVelVar_		= fx_->GetVariableByName("initialVel")->AsVector();
+	speedVar_			= fx_->GetVariableByName("speed")->AsScalar();
+	lifetimeVar_		= fx_->GetVariableByName("lifetime")->AsScalar();
+	sizeVar_			= fx_->GetVariableByName("size")->AsScalar();
+	sizeGrowthVar_		= fx_->GetVariableByName("sizeGrowth")->AsScalar();
+	textureFirstVar_	= fx_->GetVariableByName("textureFirst")->AsScalar();
+	textureCountVar_	= fx_->GetVariableByName("textureCount")->AsScalar();
+	wrapDepthVar_		= fx_->GetVariableByName("wrapDepth")->AsScalar();
+	restTimeVar_		= fx_->GetVariableByName("restTime")->AsScalar();
 
 	if (!buildVertexLayout())
 		return false;
@@ -132,6 +150,119 @@ void ParticleShader::setupRender(float sceneTime, float timeStep,
 	randomTexVar_->SetResource(randomTexRV);
 }
 
+/*
+	Name		ParticleShader::setLod
+	Syntax		ParticleShader::setLod(float emitScale, float sizeScale)
+	Param		float emitScale - Fraction of the effect's burst rate to emit at
+	Param		float sizeScale - Scale of the size new particles are given
+	Brief		Sets the level of detail the particle budget gives the system
+*/
+void ParticleShader::setLod(float emitScale, float sizeScale)
+{
+	emitScaleVar_->SetFloat(emitScale);
+	sizeScaleVar_->SetFloat(sizeScale);
+}
+
+/*
+	Name		ParticleShader::setWrapCount
+	Syntax		ParticleShader::setWrapCount(float wrapCount)
+	Param		float wrapCount - Particles to fill the box around the emitter
+				with, or zero not to wrap
+	Brief		Sets how many particles a wrapping system keeps
+	Details		Effects that cannot wrap have no such variable, and setting
+				the invalid variable the effect gives for it does nothing
+*/
+void ParticleShader::setWrapCount(float wrapCount)
+{
+	wrapCountVar_->SetFloat(wrapCount);
+}
+
+/*
+	Name		ParticleShader::setWind
+	Syntax		ParticleShader::setWind(ID3D10ShaderResourceView* windRV,
+										const D3DXVECTOR3& toTex,
+										const D3DXVECTOR3& offset, float weight)
+	Param		ID3D10ShaderResourceView* windRV - The wind field's 3D texture
+	Param		const D3DXVECTOR3& toTex - Scale from world space to texture
+				coordinates
+	Param		const D3DXVECTOR3& offset - Texture coordinates of the world
+				origin
+	Param		float weight - Fraction of the way to the wind's velocity a
+				particle is taken over the step, or zero for no wind
+	Brief		Sets the wind the particles are blown by
+	Details		As with wrapping, effects the wind does not blow have no
+				such variables
+*/
+void ParticleShader::setWind(ID3D10ShaderResourceView* windRV, const D3DXVECTOR3& toTex,
+							 const D3DXVECTOR3& offset, float weight)
+{
+	windTexVar_->SetResource(windRV);
+	windToTexVar_->SetFloatVector((float*)&toTex);
+	windOffsetVar_->SetFloatVector((float*)&offset);
+	windWeightVar_->SetFloat(weight);
+}
+
+/*
+	Name		ParticleShader::setGround
+	Syntax		ParticleShader::setGround(ID3D10ShaderResourceView* groundRV,
+										  const D3DXVECTOR3& toU,
+										  const D3DXVECTOR3& toV,
+										  const D3DXVECTOR2& toWorld,
+										  ParticleImpact impact, bool linear)
+	Param		ID3D10ShaderResourceView* groundRV - The ground's heights
+	Param		const D3DXVECTOR3& toU, toV - Maps from world x, z and one to
+				the texture coordinates of the heights
+	Param		const D3DXVECTOR2& toWorld - Scale and offset from a height
+				sample to a world height
+	Param		ParticleImpact impact - What becomes of a particle that
+				reaches the ground, or IMPACT_NONE to fall through it
+	Param		bool linear - Filter the heights linearly, or take the
+				nearest where the hardware cannot filter their format
+	Brief		Sets the ground the particles land on
+*/
+void ParticleShader::setGround(ID3D10ShaderResourceView* groundRV, const D3DXVECTOR3& toU,
+							   const D3DXVECTOR3& toV, const D3DXVECTOR2& toWorld,
+							   ParticleImpact impact, bool linear)
+{
+	impactVar_->SetFloat((float)impact);
+	groundTexVar_->SetResource(groundRV);
+	groundToUVar_->SetFloatVector((float*)&toU);
+	groundToVVar_->SetFloatVector((float*)&toV);
+	groundToWorldVar_->SetFloatVector((float*)&toWorld);
+	groundLinearVar_->SetFloat(linear ? 1.0f : 0.0f);
+}
+
+/*
+	Name		ParticleShader::setRules
+	Syntax		ParticleShader::setRules(const ParticleRules& rules)
+	Param		const ParticleRules& rules - The rules of the particle effect
+	Brief		Sets how the effect file emits, moves, draws and kills its
+				particles
+	Details		The effect files emit at most 5 particles a burst, and draw
+				from the slices of the texture array they are given
+*/
+void ParticleShader::setRules(const ParticleRules& rules)
+{
+	accelVar_->SetFloatVector((float*)rules.accel);
+	emitIntervalVar_->SetFloat(rules.emitInterval);
+	emitCountVar_->SetFloat((float)rules.emitCount);
+	spreadVar_->SetFloat(rules.spread);
+	emitHeightVar_->SetFloat(rules.emitHeight);
+	initialVelVar_->SetFloatVector((float*)rules.velocity);
+	speedVar_->SetFloat(rules.speed);
+	lifetimeVar_->SetFloat(rules.lifetime);
+	sizeVar_->SetFloat(rules.size);
+	sizeGrowthVar_->SetFloat(rules.sizeGrowth);
+	textureFirstVar_->SetFloat((float)rules.textureFirst);
+	textureCountVar_->SetFloat((float)rules.textureCount);
+
+	restTimeVar_->SetFloat(rules.restTime);
+
+	float wrapDepth, wrapRise;
+	ParticleSimulation::getWrapBox(rules, &wrapDepth, &wrapRise);
+	wrapDepthVar_->SetFloat(wrapDepth);
+}
+
 /*
 	Name		ParticleShader::setStreamOutTech
 	Syntax		ParticleShader::setStreamOutTech(D3D10_TECHNIQUE_DESC* techDesc)
@@ -182,53 +313,24 @@ void ParticleShader::applyDrawPass(UINT pass)
 
 /*
 	Name		ParticleShader::createEffectFile
-	Syntax		ParticleShader::createEffectFile(Particle particle)
-	Param		Particle particle - The particle type
+	Syntax		ParticleShader::createEffectFile(const std::string& effectFile)
+	Param		const std::string& effectFile - The effect file's name
 	Return		bool - True once the effect file has been created
-	Brief		Creates the effect file based on the particle type passed
+	Brief		Creates the effect from file
 */
-bool ParticleShader::createEffectFile(Particle particle)
+bool ParticleShader::createEffectFile(const std::string& effectFile)
 {
 	ID3D10Blob* compilationErrors = 0;
-	HRESULT hr = 0;
-	switch (particle)
-	{
-	case PARTICLE_RAIN:
-			hr = D3DX10CreateEffectFromFile("Effect Files/Rain.fx", 0, 0, 
-											"fx_4_0", 
-											D3D10_SHADER_ENABLE_STRICTNESS, 0, 
-											d3dDevice_, 0, 0, &fx_, 
-											&compilationErrors, 0);
-			break;
-
-	case PARTICLE_LEAVES:
-			hr = D3DX10CreateEffectFromFile("Effect Files/Leaves.fx", 0, 0, 
-											"fx_4_0", 
-											D3D10_SHADER_ENABLE_STRICTNESS, 0, 
-											d3dDevice_, 0, 0, &fx_, 
-											&compilationErrors, 0);
-			break;
-
-	case PARTICLE_SNOW:
-			hr = D3DX10CreateEffectFromFile("Effect Files/Snow.fx", 0, 0, 
-											"fx_4_0", 
+	HRESULT hr = D3DX10CreateEffectFromFile(effectFile.c_str(), 0, 0, "fx_4_0", 
 											D3D10_SHADER_ENABLE_STRICTNESS, 0, 
 											d3dDevice_, 0, 0, &fx_, 
 											&compilationErrors, 0);
-			break;
-
-	default:
-			return false;
-	}
-
 	if (FAILED(hr))
 	{
+		MessageBoxA(0, "Creating effect from file - Failed", "Error", MB_OK);
 		if (compilationErrors)
-		{
-			MessageBoxA(0, "Creating effect from file - Failed", "Error", MB_OK);
 			compilationErrors->Release();
-			return false;
-		}
+		return false;
 	} 
 	return true;
 }
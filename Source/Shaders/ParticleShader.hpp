@@ -10,22 +10,35 @@
 #ifndef _PARTICLE_SHADER_H
 #define _PARTICLE_SHADER_H
 
+#include <string>
 #include "Shaders/Shader.hpp"
 
 struct LightSimple;
+struct ParticleRules;
 enum Particle;
+enum ParticleImpact;
 
 class ParticleShader : public Shader
 {
 public:
 	bool initialise();
     bool initialise(Particle particle);
+	bool initialise(const std::string& effectFile);
 	void deinitialise();
 
+	void setRules(const ParticleRules& rules);
+
 	void setupRender(float sceneTime, float timeStep, D3DXVECTOR4* eyePosW, 
 					 D3DXVECTOR4* emitPosW, D3DXVECTOR4* emitDirW,
 					 ID3D10ShaderResourceView* texArrayRV, 
 					 ID3D10ShaderResourceView* randomTexRV);
+	void setLod(float emitScale, float sizeScale);
+	void setWrapCount(float wrapCount);
+	void setWind(ID3D10ShaderResourceView* windRV, const D3DXVECTOR3& toTex,
+				 const D3DXVECTOR3& offset, float weight);
+	void setGround(ID3D10ShaderResourceView* groundRV, const D3DXVECTOR3& toU,
+				   const D3DXVECTOR3& toV, const D3DXVECTOR2& toWorld,
+				   ParticleImpact impact, bool linear);
 
 	void setStreamOutTech(D3D10_TECHNIQUE_DESC* techDesc);
 	void setDrawTech(D3D10_TECHNIQUE_DESC* techDesc);
@@ -36,7 +49,7 @@ public:
 	ID3D10InputLayout *  getLayout() const { return vertexLayout_; };
 	
 private:
-	bool createEffectFile(Particle particle);
+	bool createEffectFile(const std::string& effectFile);
 	bool buildVertexLayout();
 
 	ID3D10EffectTechnique* streamOutTech_;
@@ -49,6 +62,35 @@ private:
 	ID3D10EffectVectorVariable* emitDirVar_;
 	ID3D10EffectShaderResourceVariable* texArrayVar_;
 	ID3D10EffectShaderResourceVariable* randomTexVar_;
+	ID3D10EffectScalarVariable* emitScaleVar_;
+	ID3D10EffectScalarVariable* sizeScaleVar_;
+	ID3D10EffectScalarVariable* wrapCountVar_;
+	ID3D10EffectShaderResourceVariable* windTexVar_;
+	ID3D10EffectVectorVariable* windToTexVar_;
+	ID3D10EffectVectorVariable* windOffsetVar_;
+	ID3D10EffectScalarVariable* windWeightVar_;
+	ID3D10EffectScalarVariable* impactVar_;
+	ID3D10EffectShaderResourceVariable* groundTexVar_;
+	ID3D10EffectVectorVariable* groundToUVar_;
+	ID3D10EffectVectorVariable* groundToVVar_;
+	ID3D10EffectVectorVariable* groundToWorldVar_;
+	ID3D10EffectScalarVariable* groundLinearVar_;
+
+	// Set from the particle effect's rules
+	ID3D10EffectVectorVariable* accelVar_;
+	ID3D10EffectScalarVariable* emitIntervalVar_;
+	ID3D10EffectScalarVariable* emitCountVar_;
+	ID3D10EffectScalarVariable* spreadVar_;
+	ID3D10EffectScalarVariable* emitHeightVar_;
+	ID3D10EffectVectorVariable* initialVelVar_;
+	ID3D10EffectScalarVariable* speedVar_;
+	ID3D10EffectScalarVariable* lifetimeVar_;
+	ID3D10EffectScalarVariable* sizeVar_;
+	ID3D10EffectScalarVariable* sizeGrowthVar_;
+	ID3D10EffectScalarVariable* textureFirstVar_;
+	ID3D10EffectScalarVariable* textureCountVar_;
+	ID3D10EffectScalarVariable* wrapDepthVar_;
+	ID3D10EffectScalarVariable* restTimeVar_;
 };
 
 #endif // _PARTICLE_SHADER_H
\ No newline at end of file
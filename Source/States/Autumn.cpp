@@ -10,12 +10,14 @@
 #include "States/Autumn.hpp"
 #include "States/Winter.hpp"
 #include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
 
 #include "Shaders/TerrainShader.hpp"
 #include "Shaders/SkyMapShader.hpp"
 
 #include "ParticleSystem/ParticleSystem.hpp"
 #include "ParticleSystem/Particle.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
 
 /*
 	Name		Autumn::Autumn
@@ -28,6 +30,8 @@ Autumn::Autumn()
   sunDirection_(-300.0f, 250.0f, -200.0f), fogColor_(0.4f, 0.4f, 0.25f), MOVESPEED(50), 
   ROTATESPEED(1.5), noCullRS_(0), leavesArrayRV_(0), leaves_(0) 
 {
+	pickTree_ = &tree_;
+
 	terrainLayerMapRVs_[0] = 0;
 	terrainLayerMapRVs_[1] = 0;
 	terrainLayerMapRVs_[2] = 0;
@@ -63,7 +67,7 @@ bool Autumn::initialise()
 {
 	
 	camera_ = new Camera;
-	input_ = new DirectInput;
+	input_ = new DirectInput(Scene::instance()->getInputLog());
 
 	d3dDevice_ = Scene::instance()->getDevice();
 	if (!d3dDevice_)
@@ -86,6 +90,11 @@ bool Autumn::initialise()
 		return false;
 	}
 
+	// The particle textures are read on a worker thread while the shaders
+	// and geometry load
+	if (leavesEffect_.load("Assets/Particles/Leaves.txt"))
+		Scene::instance()->getTextureArrays()->prefetch(leavesEffect_.getTextures());
+
 	initialiseShaders();
 	initialiseGeometry();
 	initialiseParticleSystems();
@@ -97,14 +106,9 @@ bool Autumn::initialise()
 	light_.setSpecular(D3DXCOLOR(0.5f, 0.5f, 0.5f, 1.0f));
 	light_.setPosition(D3DXVECTOR3(-95.0f, 200.0f, 350.0f));
 
-	D3DXMATRIX lightView, lightVolume;
-
-	D3DXMatrixLookAtLH(&lightView, &light_.getPosition(),
-		&D3DXVECTOR3(0.0f, 0.0f, 0.0f), &D3DXVECTOR3(0.0f, 1.0f, 0.0f));
-
-	D3DXMatrixOrthoLH(&lightVolume, 400.0f, 400.0f, -100.0f, 100.0f);
-	
-	lightViewProj_ = lightView * lightVolume;
+	// The near two shadow cascades follow the camera every frame, and the
+	// far two are drawn again only when it leaves them
+	m3dInitCascades(&shadowCascades_, M3D_MAX_CASCADES, Model::SHADOW_MAP_SIZE, 2);
 
 
 	moveX_ = 0.0f;
@@ -128,6 +132,8 @@ bool Autumn::deinitialise()
 	delete terrainShader_;
 	delete skyMapShader_;
 	delete leaves_;
+	Scene::instance()->getTextureArrays()->release(leavesArrayRV_);
+	leavesArrayRV_ = 0;
     return true;
 }
 
@@ -140,6 +146,8 @@ bool Autumn::deinitialise()
 */
 bool Autumn::update(float dt)
 {
+	PROFILE_ZONE("Autumn::update");
+
 	input_->update();
 
 	if (input_->isKeyDown(DIK_1)) return true;
@@ -171,18 +179,41 @@ bool Autumn::update(float dt)
 	moveX_ = 0.0f;
 	moveZ_ = 0.0f;
 
-	// Update camera - updates the View and Projection matrices
-	camera_->update();
-
-	skySphere_.setPos(camera_->getPosition());
-	skySphere_.setTrans();
+	// Update camera - stores the pose for rendering
+	camera_->update(dt);
 
-	leaves_->update(dt, Scene::instance()->getTimer()->getGameTime());
+	wind_.update(dt);
+	leaves_->update(dt, Scene::instance()->getSceneTime());
 
-	tree_.update(lightViewProj_);
     return false;
 }
 
+/*
+	Name		Autumn::publish
+	Syntax		Autumn::publish()
+	Brief		Hands the camera and particle state of the step over to 
+				rendering
+*/
+void Autumn::publish()
+{
+	State::publish();
+	wind_.publish();
+	leaves_->publish();
+}
+
+/*
+	Name		Autumn::apply
+	Syntax		Autumn::apply(float alpha)
+	Param		float alpha - Fraction of a step to interpolate the camera by
+	Brief		Takes the published camera and particle state for rendering
+*/
+void Autumn::apply(float alpha)
+{
+	State::apply(alpha);
+	wind_.apply();
+	leaves_->apply();
+}
+
 /*
 	Name		Autumn::render
 	Syntax		Autumn::render()
@@ -190,6 +221,16 @@ bool Autumn::update(float dt)
 */
 void Autumn::render()
 {
+	PROFILE_ZONE("Autumn::render");
+
+	// Centre the sky sphere on the interpolated camera
+	skySphere_.setPos(camera_->getRenderPosition());
+	skySphere_.setTrans();
+
+	// Cull the tree and the terrain cells against the camera and drop
+	// those hidden behind nearer hills
+	bool treeVisible = cullScene(tree_, &terrain_);
+
 	// Reset the depth stencil state and blend state 
 	d3dDevice_->OMSetDepthStencilState(0, 0);
 	float blendFactor[] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -199,9 +240,11 @@ void Autumn::render()
 	// Disable culling of back faces so that tree foliage is rendered correctly
 	d3dDevice_->RSSetState(noCullRS_);
 	// Build the shadow map for the tree model
-	tree_.renderShadow();
-	// Draw tree
-	tree_.render(&camera_->getPosition(), &light_, &fogColor_);
+	renderShadows(&tree_, light_, &shadowCascades_);
+	// Draw tree, unless it is out of view or hidden. Its shadow is still built,
+	// as it may fall on terrain that is in view
+	if (treeVisible)
+		tree_.render(&camera_->getRenderPosition(), &light_, &fogColor_);
 	// Reenable back face culling once tree is rendered
 	d3dDevice_->RSSetState(0);
 
@@ -212,7 +255,7 @@ void Autumn::render()
 	Scene::instance()->setWVP();	
 	// Create a new technique description for our terrain technique
     D3D10_TECHNIQUE_DESC terrainTechDesc;
-	terrainShader_->setupRender(&terrainTechDesc, &camera_->getPosition(), 
+	terrainShader_->setupRender(&terrainTechDesc, &camera_->getRenderPosition(), 
 								&sunDirection_, &fogColor_, terrainLayerMapRVs_, 
 								terrainBlendMapRV_, terrainSpecMap_);
 	// Draw the terrain
@@ -239,8 +282,12 @@ void Autumn::render()
 
 	// Render leaf particles
 	d3dDevice_->OMSetBlendState(0, blendFactor, 0xffffffff); // restore default
-	leaves_->setEyePos(camera_->getPosition());
+	leaves_->setEyePos(camera_->getRenderPosition());
 	leaves_->setEmitPos(D3DXVECTOR3(0.0f, 50.0f, 350.0f));
+
+	// Share the particle budget out for the view, now the emitter is placed
+	Scene::instance()->getParticleBudget()->distribute(camera_->getFrustum(), 
+		camera_->getRenderPosition(), Scene::instance()->getProjection());
 	leaves_->render();
 }
 
@@ -272,6 +319,7 @@ void Autumn::initialiseGeometry()
 	terrain_.setScale(5.0f, 5.0f, 5.0f);
 	terrain_.setPos(D3DXVECTOR3(-600.0f, -150.0f, -600.0f));
 	terrain_.setTrans();
+	camera_->setGround(&terrain_);
 
 	// Create sky sphere and scale it so that it does not clip with the camera
 	skySphere_.initialise(d3dDevice_);
@@ -292,117 +340,29 @@ void Autumn::initialiseGeometry()
 */
 void Autumn::initialiseParticleSystems()
 {
-	HRESULT hr = 0;
-
-	std::vector<std::string> tumbling_leaves;
-	tumbling_leaves.push_back("Assets/2D Textures/tumbling_leaf.dds");
-
-	// Load the texture elements individually from file.  These textures
-	// won't be used by the GPU (0 bind flags), they are just used to 
-	// load the image data from file.  We use the STAGING usage so the
-	// CPU can read the resource.
-	UINT arraySize = (UINT)tumbling_leaves.size();
-
-	std::vector<ID3D10Texture2D*> srcTex(arraySize, 0);
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		D3DX10_IMAGE_LOAD_INFO loadInfo;
-
-        loadInfo.Width  = D3DX10_FROM_FILE;
-        loadInfo.Height = D3DX10_FROM_FILE;
-        loadInfo.Depth  = D3DX10_FROM_FILE;
-        loadInfo.FirstMipLevel = 0;
-        loadInfo.MipLevels = D3DX10_FROM_FILE;
-        loadInfo.Usage = D3D10_USAGE_STAGING;
-        loadInfo.BindFlags = 0;
-        loadInfo.CpuAccessFlags = D3D10_CPU_ACCESS_WRITE | D3D10_CPU_ACCESS_READ;
-        loadInfo.MiscFlags = 0;
-        loadInfo.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        loadInfo.Filter = D3DX10_FILTER_NONE;
-        loadInfo.MipFilter = D3DX10_FILTER_NONE;
-		loadInfo.pSrcInfo  = 0;
-
-        hr = D3DX10CreateTextureFromFile(d3dDevice_, tumbling_leaves[i].c_str(), 
-			&loadInfo, 0, (ID3D10Resource**)&srcTex[i], 0);
-
-		if (FAILED(hr))
-		{
-			MessageBox(0, "Create tumbling leaves texture - Failed", "Error", MB_OK);
-			return;
-		}
-	}
-
-	// Create the texture array.  Each element in the texture 
-	// array has the same format/dimensions.
-	D3D10_TEXTURE2D_DESC texElementDesc;
-	srcTex[0]->GetDesc(&texElementDesc);
-
-	D3D10_TEXTURE2D_DESC texArrayDesc;
-	texArrayDesc.Width              = texElementDesc.Width;
-	texArrayDesc.Height             = texElementDesc.Height;
-	texArrayDesc.MipLevels          = texElementDesc.MipLevels;
-	texArrayDesc.ArraySize          = arraySize;
-	texArrayDesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texArrayDesc.SampleDesc.Count   = 1;
-	texArrayDesc.SampleDesc.Quality = 0;
-	texArrayDesc.Usage              = D3D10_USAGE_DEFAULT;
-	texArrayDesc.BindFlags          = D3D10_BIND_SHADER_RESOURCE;
-	texArrayDesc.CPUAccessFlags     = 0;
-	texArrayDesc.MiscFlags          = 0;
-
-	ID3D10Texture2D* texArray = 0;
-	hr = d3dDevice_->CreateTexture2D( &texArrayDesc, 0, &texArray);
-	if (FAILED(hr))
+	// The falling leaves are described by file, and their texture array is
+	// shared with any other system using the same textures
+	leavesArrayRV_ = Scene::instance()->getTextureArrays()->acquire(leavesEffect_.getTextures());
+	if (!leavesArrayRV_)
 	{
-		MessageBox(0, "Create tumbling_leaves array - Failed", "Error", MB_OK);
+		MessageBox(0, "Create tumbling leaves array - Failed", "Error", MB_OK);
 		return;
 	}
 
-	// Copy individual texture elements into texture array.
+	leaves_ = new ParticleSystem(leavesEffect_);
+	leaves_->initialise(d3dDevice_, leavesArrayRV_, leavesEffect_.getMaxParticles());
 
-	// for each texture element...
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		// for each mipmap level...
-		for (UINT j = 0; j < texElementDesc.MipLevels; ++j)
-		{
-			D3D10_MAPPED_TEXTURE2D mappedTex2D;
-			srcTex[i]->Map(j, D3D10_MAP_READ, 0, &mappedTex2D);
-                    
-            d3dDevice_->UpdateSubresource(texArray, 
-				D3D10CalcSubresource(j, i, texElementDesc.MipLevels),
-                0, mappedTex2D.pData, mappedTex2D.RowPitch, 0);
-
-            srcTex[i]->Unmap(j);
-		}
-	}	
-
-	// Create a resource view to the texture array.
-	D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
-	viewDesc.Format = texArrayDesc.Format;
-	viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
-	viewDesc.Texture2DArray.MostDetailedMip = 0;
-	viewDesc.Texture2DArray.MipLevels = texArrayDesc.MipLevels;
-	viewDesc.Texture2DArray.FirstArraySlice = 0;
-	viewDesc.Texture2DArray.ArraySize = arraySize;
-
-	hr = d3dDevice_->CreateShaderResourceView(texArray, &viewDesc, &leavesArrayRV_);
-	if (FAILED(hr))
-	{
-		MessageBox(0, "Create tumbling_leaves RV - Failed", "Error", MB_OK);
-		return;
-	}
-
-	// Cleanup - we only need the resource view.
-	texArray->Release();
-
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		srcTex[i]->Release(); 
-	}
+	// A steady breeze over the terrain, gusting, with eddies to toss the
+	// leaves about
+	M3DHeightField ground;
+	terrain_.getHeightField(&ground);
+	M3DVector3f wind = { 3.0f, 0.0f, 1.5f };
+	wind_.initialise(&ground, 40.0f, 200.0f);
+	wind_.setWind(wind, 0.5f, 4.0f, 60.0f, 2.0f);
+	leaves_->setWind(&wind_);
 
-	leaves_ = new ParticleSystem(PARTICLE_LEAVES);
-	leaves_->initialise(d3dDevice_, leavesArrayRV_, 1000);
+	// The leaves settle on the terrain
+	leaves_->setGround(&ground);
 }
 
 /*
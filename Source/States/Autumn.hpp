@@ -15,6 +15,8 @@
 #include "Geometry/Terrain.hpp"
 #include "Geometry/SkySphere.hpp"
 #include "Geometry/Model.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "ParticleSystem/WindField.hpp"
 
 class TerrainShader;
 class SkyMapShader;
@@ -26,10 +28,13 @@ public:
 	Autumn();
 	~Autumn();
     virtual State* getNextState();
+	virtual Season getSeason() const { return SEASON_AUTUMN; };
 	virtual bool initialise();
 	virtual bool deinitialise();
 	virtual bool update(float dt);
 	virtual void render();
+	virtual void publish();
+	virtual void apply(float alpha);
 
 private:
 	void initialiseShaders();
@@ -54,6 +59,7 @@ private:
 
 	// Leaves particle system resource
 	ID3D10ShaderResourceView* leavesArrayRV_;
+	ParticleEffect leavesEffect_;
 
 	Light light_;
 
@@ -62,11 +68,12 @@ private:
 	Model tree_;
 
 	ParticleSystem* leaves_;
+	WindField wind_;
 
 	float moveX_, moveZ_, yaw_, pitch_; // Camera movement
 	D3DXVECTOR3 sunDirection_;
 	D3DXVECTOR3 fogColor_;
-	D3DXMATRIX lightViewProj_;
+	M3DCascadeSet shadowCascades_;
 
 	// Constants
 	const int MOVESPEED;
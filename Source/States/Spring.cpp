@@ -12,12 +12,25 @@
 #include "States/Spring.hpp"
 #include "States/Summer.hpp"
 #include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
 
 #include "Shaders/TerrainShader.hpp"
 #include "Shaders/SkyMapShader.hpp"
 
 #include "ParticleSystem/ParticleSystem.hpp"
 #include "ParticleSystem/Particle.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "ParticleSystem/PooledSystem.hpp"
+
+namespace
+{
+	// Decorative splashes started a second about the camera, how far from
+	// it, for how long each emits and most alive at once
+	const float SPLASH_RATE = 300.0f;
+	const float SPLASH_RANGE = 20.0f;
+	const float SPLASH_DURATION = 0.1f;
+	const int MAX_SPLASHES = 256;
+}
 
 /*
 	Name		Spring::Spring
@@ -26,15 +39,20 @@
 */
 Spring::Spring()
 : d3dDevice_(0), terrainShader_(0), skyMapShader_(0), terrainBlendMapRV_(0), 
-  terrainSpecMap_(0), skyMapRV_(0), rainArrayRV_(0), rain_(0), moveX_(0), 
+  terrainSpecMap_(0), skyMapRV_(0), rainArrayRV_(0), splashArrayRV_(0), rain_(0), 
+  splashes_(0), splashTime_(0.0f), moveX_(0), 
   moveZ_(0), yaw_(0), pitch_(0), MOVESPEED(50), ROTATESPEED(1.5), noCullRS_(0)
 {
+	pickTree_ = &tree_;
+
 	sunDirection_	= D3DXVECTOR3(-200.0f, 80.0f, -500.0f);
 	fogColor_		= D3DXVECTOR3(0.25f, 0.25f, 0.25f);
 
 	terrainLayerMapRVs_[0] = 0;
 	terrainLayerMapRVs_[1] = 0;
 	terrainLayerMapRVs_[2] = 0;
+
+	m3dSeedRandom(&splashRandom_, 1, 0);
 }
 
 /*
@@ -67,7 +85,7 @@ bool Spring::initialise()
 {
 	
 	camera_ = new Camera;
-	input_ = new DirectInput;
+	input_ = new DirectInput(Scene::instance()->getInputLog());
 
 	d3dDevice_ = Scene::instance()->getDevice();
 	if (!d3dDevice_)
@@ -90,6 +108,13 @@ bool Spring::initialise()
 		return false;
 	}
 
+	// The particle textures are read on a worker thread while the shaders
+	// and geometry load
+	if (rainEffect_.load("Assets/Particles/Rain.txt"))
+		Scene::instance()->getTextureArrays()->prefetch(rainEffect_.getTextures());
+	if (splashEffect_.load("Assets/Particles/Splash.txt"))
+		Scene::instance()->getTextureArrays()->prefetch(splashEffect_.getTextures());
+
 	initialiseShaders();
 	initialiseGeometry();
 	initialiseParticleSystems();
@@ -101,14 +126,9 @@ bool Spring::initialise()
 	light_.setSpecular(D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f));
 	light_.setPosition(D3DXVECTOR3(-20.0f, 50.0f, 400.0f));
 
-	D3DXMATRIX lightView, lightVolume;
-
-	D3DXMatrixLookAtLH(&lightView, &light_.getPosition(),
-		&D3DXVECTOR3(0.0f, 0.0f, 0.0f), &D3DXVECTOR3(0.0f, 1.0f, 0.0f));
-
-	D3DXMatrixOrthoLH(&lightVolume, 200.0f, 200.0f, -35.0f, 100.0f);
-	
-	lightViewProj_ = lightView * lightVolume;
+	// The near two shadow cascades follow the camera every frame, and the
+	// far two are drawn again only when it leaves them
+	m3dInitCascades(&shadowCascades_, M3D_MAX_CASCADES, Model::SHADOW_MAP_SIZE, 2);
 
 	moveX_ = 0.0f;
 	moveZ_ = 0.0f;
@@ -131,6 +151,11 @@ bool Spring::deinitialise()
 	delete terrainShader_;
 	delete skyMapShader_;
 	delete rain_;
+	delete splashes_;
+	Scene::instance()->getTextureArrays()->release(rainArrayRV_);
+	rainArrayRV_ = 0;
+	Scene::instance()->getTextureArrays()->release(splashArrayRV_);
+	splashArrayRV_ = 0;
 
     return true;
 }
@@ -144,6 +169,8 @@ bool Spring::deinitialise()
 */
 bool Spring::update(float dt)
 {
+	PROFILE_ZONE("Spring::update");
+
 	input_->update();
 
 	if (input_->isKeyDown(DIK_1)) return true;
@@ -180,17 +207,41 @@ bool Spring::update(float dt)
 	// Zoom camera
 	camera_->zoom(input_->getMouseZ());
 
-	// Update camera - updates the View and Projection matrices
-	camera_->update();
+	// Update camera - stores the pose for rendering
+	camera_->update(dt);
 
-	skySphere_.setPos(camera_->getPosition());
-	skySphere_.setTrans();
+	rain_->update(dt, Scene::instance()->getSceneTime());
+	spawnSplashes(dt);
 
-	rain_->update(dt, Scene::instance()->getTimer()->getGameTime());
+    return false;
+}
 
-	tree_.update(lightViewProj_);
+/*
+	Name		Spring::publish
+	Syntax		Spring::publish()
+	Brief		Hands the camera and particle state of the step over to 
+				rendering
+*/
+void Spring::publish()
+{
+	State::publish();
+	rain_->publish();
+	if (splashes_)
+		splashes_->publish();
+}
 
-    return false;
+/*
+	Name		Spring::apply
+	Syntax		Spring::apply(float alpha)
+	Param		float alpha - Fraction of a step to interpolate the camera by
+	Brief		Takes the published camera and particle state for rendering
+*/
+void Spring::apply(float alpha)
+{
+	State::apply(alpha);
+	rain_->apply();
+	if (splashes_)
+		splashes_->apply();
 }
 
 /*
@@ -200,6 +251,16 @@ bool Spring::update(float dt)
 */
 void Spring::render()
 {
+	PROFILE_ZONE("Spring::render");
+
+	// Centre the sky sphere on the interpolated camera
+	skySphere_.setPos(camera_->getRenderPosition());
+	skySphere_.setTrans();
+
+	// Cull the tree and the terrain cells against the camera and drop
+	// those hidden behind nearer hills
+	bool treeVisible = cullScene(tree_, &terrain_);
+
 	// Reset the depth stencil state and blend state 
 	d3dDevice_->OMSetDepthStencilState(0, 0);
 	float blendFactor[] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -209,9 +270,11 @@ void Spring::render()
 	// Disable culling of back faces so that tree foliage is rendered correctly
 	d3dDevice_->RSSetState(noCullRS_);
 	// Build the shadow map for the tree model
-	tree_.renderShadow();
-	// Draw tree
-	tree_.render(&camera_->getPosition(), &light_, &fogColor_);
+	renderShadows(&tree_, light_, &shadowCascades_);
+	// Draw tree, unless it is out of view or hidden. Its shadow is still built,
+	// as it may fall on terrain that is in view
+	if (treeVisible)
+		tree_.render(&camera_->getRenderPosition(), &light_, &fogColor_);
 	// Reenable back face culling once tree is rendered
 	d3dDevice_->RSSetState(0);
 
@@ -222,7 +285,7 @@ void Spring::render()
 	Scene::instance()->setWVP();	
 	// Create a new technique description for our terrain technique
     D3D10_TECHNIQUE_DESC terrainTechDesc;
-	terrainShader_->setupRender(&terrainTechDesc, &camera_->getPosition(), 
+	terrainShader_->setupRender(&terrainTechDesc, &camera_->getRenderPosition(), 
 								&sunDirection_, &fogColor_, terrainLayerMapRVs_, 
 								terrainBlendMapRV_, terrainSpecMap_);
 	// Draw the terrain
@@ -249,9 +312,21 @@ void Spring::render()
 
 	// Render rain particles
 	d3dDevice_->OMSetBlendState(0, blendFactor, 0xffffffff); // restore default
-	rain_->setEyePos(camera_->getPosition());
-	rain_->setEmitPos(camera_->getPosition());
+	rain_->setEyePos(camera_->getRenderPosition());
+	rain_->setEmitPos(camera_->getRenderPosition());
+
+	// Share the particle budget out for the view, now the emitter is placed
+	Scene::instance()->getParticleBudget()->distribute(camera_->getFrustum(), 
+		camera_->getRenderPosition(), Scene::instance()->getProjection());
 	rain_->render();
+
+	// Render the decorative splashes about the camera, which are not where
+	// the drops land
+	if (splashes_)
+	{
+		splashes_->setEyePos(camera_->getRenderPosition());
+		splashes_->render();
+	}
 }
 
 /*
@@ -282,6 +357,7 @@ void Spring::initialiseGeometry()
 	terrain_.setScale(5.0f, 5.0f, 5.0f);
 	terrain_.setPos(D3DXVECTOR3(-600.0f, -150.0f, -600.0f));
 	terrain_.setTrans();
+	camera_->setGround(&terrain_);
 
 	// Create sky sphere and scale it so that it does not clip with the camera
 	skySphere_.initialise(d3dDevice_);
@@ -302,117 +378,68 @@ void Spring::initialiseGeometry()
 */
 void Spring::initialiseParticleSystems()
 {
-	HRESULT hr = 0;
-
-	std::vector<std::string> raindrops;
-	raindrops.push_back("Assets/2D Textures/raindrop.dds");
-
-	// Load the texture elements individually from file.  These textures
-	// won't be used by the GPU (0 bind flags), they are just used to 
-	// load the image data from file.  We use the STAGING usage so the
-	// CPU can read the resource.
-	UINT arraySize = (UINT)raindrops.size();
-
-	std::vector<ID3D10Texture2D*> srcTex(arraySize, 0);
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		D3DX10_IMAGE_LOAD_INFO loadInfo;
-
-        loadInfo.Width  = D3DX10_FROM_FILE;
-        loadInfo.Height = D3DX10_FROM_FILE;
-        loadInfo.Depth  = D3DX10_FROM_FILE;
-        loadInfo.FirstMipLevel = 0;
-        loadInfo.MipLevels = D3DX10_FROM_FILE;
-        loadInfo.Usage = D3D10_USAGE_STAGING;
-        loadInfo.BindFlags = 0;
-        loadInfo.CpuAccessFlags = D3D10_CPU_ACCESS_WRITE | D3D10_CPU_ACCESS_READ;
-        loadInfo.MiscFlags = 0;
-        loadInfo.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        loadInfo.Filter = D3DX10_FILTER_NONE;
-        loadInfo.MipFilter = D3DX10_FILTER_NONE;
-		loadInfo.pSrcInfo  = 0;
-
-        hr = D3DX10CreateTextureFromFile(d3dDevice_, raindrops[i].c_str(), 
-			&loadInfo, 0, (ID3D10Resource**)&srcTex[i], 0);
-
-		if (FAILED(hr))
-		{
-			MessageBox(0, "Create raindrops texture - Failed", "Error", MB_OK);
-			return;
-		}
-	}
-
-	// Create the texture array.  Each element in the texture 
-	// array has the same format/dimensions.
-	D3D10_TEXTURE2D_DESC texElementDesc;
-	srcTex[0]->GetDesc(&texElementDesc);
-
-	D3D10_TEXTURE2D_DESC texArrayDesc;
-	texArrayDesc.Width              = texElementDesc.Width;
-	texArrayDesc.Height             = texElementDesc.Height;
-	texArrayDesc.MipLevels          = texElementDesc.MipLevels;
-	texArrayDesc.ArraySize          = arraySize;
-	texArrayDesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texArrayDesc.SampleDesc.Count   = 1;
-	texArrayDesc.SampleDesc.Quality = 0;
-	texArrayDesc.Usage              = D3D10_USAGE_DEFAULT;
-	texArrayDesc.BindFlags          = D3D10_BIND_SHADER_RESOURCE;
-	texArrayDesc.CPUAccessFlags     = 0;
-	texArrayDesc.MiscFlags          = 0;
-
-	ID3D10Texture2D* texArray = 0;
-	hr = d3dDevice_->CreateTexture2D( &texArrayDesc, 0, &texArray);
-	if (FAILED(hr))
+	// The rain is described by file, and its texture array is
+	// shared with any other system using the same textures
+	rainArrayRV_ = Scene::instance()->getTextureArrays()->acquire(rainEffect_.getTextures());
+	if (!rainArrayRV_)
 	{
 		MessageBox(0, "Create raindrops array - Failed", "Error", MB_OK);
 		return;
 	}
 
-	// Copy individual texture elements into texture array.
+	rain_ = new ParticleSystem(rainEffect_);
+	rain_->initialise(d3dDevice_, rainArrayRV_, rainEffect_.getMaxParticles());
+	rain_->setWrapping(true);
 
-	// for each texture element...
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		// for each mipmap level...
-		for (UINT j = 0; j < texElementDesc.MipLevels; ++j)
-		{
-			D3D10_MAPPED_TEXTURE2D mappedTex2D;
-			srcTex[i]->Map(j, D3D10_MAP_READ, 0, &mappedTex2D);
-                    
-            d3dDevice_->UpdateSubresource(texArray, 
-				D3D10CalcSubresource(j, i, texElementDesc.MipLevels),
-                0, mappedTex2D.pData, mappedTex2D.RowPitch, 0);
-
-            srcTex[i]->Unmap(j);
-		}
-	}	
-
-	// Create a resource view to the texture array.
-	D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
-	viewDesc.Format = texArrayDesc.Format;
-	viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
-	viewDesc.Texture2DArray.MostDetailedMip = 0;
-	viewDesc.Texture2DArray.MipLevels = texArrayDesc.MipLevels;
-	viewDesc.Texture2DArray.FirstArraySlice = 0;
-	viewDesc.Texture2DArray.ArraySize = arraySize;
-
-	hr = d3dDevice_->CreateShaderResourceView(texArray, &viewDesc, &rainArrayRV_);
-	if (FAILED(hr))
+	// The drops splash on the terrain
+	M3DHeightField ground;
+	terrain_.getHeightField(&ground);
+	rain_->setGround(&ground);
+
+	// Decorative splashes are scattered about the camera, not started
+	// where the drops land. They are drawn as the rain is, so share its
+	// array
+	splashArrayRV_ = Scene::instance()->getTextureArrays()->acquire(splashEffect_.getTextures());
+	if (!splashArrayRV_)
 	{
-		MessageBox(0, "Create raindrops RV - Failed", "Error", MB_OK);
+		MessageBox(0, "Create splashes array - Failed", "Error", MB_OK);
 		return;
 	}
 
-	// Cleanup - we only need the resource view.
-	texArray->Release();
+	splashes_ = new PooledSystem(splashEffect_);
+	splashes_->initialise(d3dDevice_, splashArrayRV_, MAX_SPLASHES);
+}
 
-	for (UINT i = 0; i < arraySize; ++i)
+/*
+	Name		Spring::spawnSplashes
+	Syntax		Spring::spawnSplashes(float dt)
+	Param		float dt - Time since last frame
+	Brief		Starts the splashes due over the time step and steps them
+	Details		The splashes are decoration. The rain is simulated on the
+				GPU, so where its drops land is not known here, and the
+				splashes are started at random spots on the terrain about
+				the camera at a steady rate instead. They take no share of
+				the particle budget and are not reset with the rain
+*/
+void Spring::spawnSplashes(float dt)
+{
+	if (!splashes_)
+		return;
+
+	D3DXVECTOR3 eye = camera_->getPosition();
+	splashTime_ += SPLASH_RATE * dt;
+	while (splashTime_ >= 1.0f)
 	{
-		srcTex[i]->Release(); 
+		splashTime_ -= 1.0f;
+
+		M3DVector3f pos;
+		pos[0] = eye.x + m3dRandomFloat(&splashRandom_, -SPLASH_RANGE, SPLASH_RANGE);
+		pos[2] = eye.z + m3dRandomFloat(&splashRandom_, -SPLASH_RANGE, SPLASH_RANGE);
+		if (terrain_.getHeight(pos[0], pos[2], &pos[1]))
+			splashes_->spawn(pos, SPLASH_DURATION);
 	}
 
-	rain_ = new ParticleSystem(PARTICLE_RAIN);
-	rain_->initialise(d3dDevice_, rainArrayRV_, 50000);
+	splashes_->update(dt);
 }
 
 /*
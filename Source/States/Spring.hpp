@@ -15,10 +15,13 @@
 #include "Geometry/Terrain.hpp"
 #include "Geometry/SkySphere.hpp"
 #include "Geometry/Model.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
+#include "Maths/m3dRandom.h"
 
 class TerrainShader;
 class SkyMapShader;
 class ParticleSystem;
+class PooledSystem;
 
 class Spring : public State
 {
@@ -26,16 +29,20 @@ public:
 	Spring();
 	~Spring();
     virtual State* getNextState();
+	virtual Season getSeason() const { return SEASON_SPRING; };
 	virtual bool initialise();
 	virtual bool deinitialise();
 	virtual bool update(float dt);
 	virtual void render();
+	virtual void publish();
+	virtual void apply(float alpha);
 
 private:
 	void initialiseShaders();
 	void initialiseGeometry();
 	void initialiseParticleSystems();
 	void createResources();
+	void spawnSplashes(float dt);
 
 	ID3D10Device* d3dDevice_;
 
@@ -54,6 +61,11 @@ private:
 
 	// Rain particle system resource
 	ID3D10ShaderResourceView* rainArrayRV_;
+	ParticleEffect rainEffect_;
+
+	// Splash particle system resource
+	ID3D10ShaderResourceView* splashArrayRV_;
+	ParticleEffect splashEffect_;
 
 	Light light_;
 
@@ -62,11 +74,14 @@ private:
 	Model tree_;
 
 	ParticleSystem* rain_;
+	PooledSystem* splashes_;
+	M3DRandom splashRandom_;
+	float splashTime_;		// Splashes due, in whole and part splashes
 
 	float moveX_, moveZ_, yaw_, pitch_; // Camera movement
 	D3DXVECTOR3 sunDirection_;
 	D3DXVECTOR3 fogColor_;
-	D3DXMATRIX lightViewProj_;
+	M3DCascadeSet shadowCascades_;
 
 	// Constants
 	const int MOVESPEED;
@@ -0,0 +1,116 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*	
+	Name		State
+	Brief		Implementation of the helpers the states share
+*/
+
+#include "States/State.hpp"
+#include "Scene/Scene.hpp"
+#include "Geometry/Model.hpp"
+#include "Geometry/Terrain.hpp"
+#include "Lighting/Light.hpp"
+#include "Scene/Picker.hpp"
+
+/*
+	Name		State::State
+	Syntax		State()
+	Brief		State constructor initialises member variables
+*/
+State::State()
+: camera_(0), input_(0), pickTree_(0)
+{
+}
+
+/*
+	Name		State::addPickables
+	Syntax		State::addPickables(Picker* picker)
+	Param		Picker* picker - Receives the bounding volumes
+	Brief		Adds the state's tree, if it has one, to the objects that
+				can be picked
+*/
+void State::addPickables(Picker* picker) const
+{
+	if (!pickTree_)
+		return;
+
+	D3DXVECTOR3 centre;
+	float radius;
+	pickTree_->getBoundingSphere(&centre, &radius);
+	picker->addSphere(centre, radius, PICK_TREE, 0);
+}
+
+/*
+	Name		State::cullScene
+	Syntax		State::cullScene(const Model& tree, Terrain* terrain)
+	Param		const Model& tree - The state's tree
+	Param		Terrain* terrain - The state's terrain, whose cells in view
+				are marked for rendering
+	Return		bool - True if the tree is to be drawn
+	Brief		Culls the tree and the terrain cells against the camera,
+				then drops those hidden behind nearer hills
+	Details		The terrain in view is drawn into the occlusion buffer and
+				the tree and cells tested against it. The sky sphere is
+				centred on the camera and any particles are emitted around
+				it, so both are always in view
+*/
+bool State::cullScene(const Model& tree, Terrain* terrain)
+{
+	TimerTicks cullStart = GameTimer::now();
+	const M3DFrustum& frustum = camera_->getFrustum();
+	D3DXVECTOR3 treeCentre;
+	float treeRadius;
+	tree.getBoundingSphere(&treeCentre, &treeRadius);
+	bool treeVisible = m3dSphereInFrustum(frustum, treeCentre, treeRadius);
+	UINT cellsVisible = terrain->cull(frustum);
+	UINT tested = terrain->getCellsNo() + 1;
+	UINT culled = tested - cellsVisible - (treeVisible ? 1 : 0);
+	Scene::instance()->addCullStats(tested, culled, GameTimer::now() - cullStart);
+
+	TimerTicks occlusionStart = GameTimer::now();
+	OcclusionBuffer* occlusion = Scene::instance()->getOcclusionBuffer();
+	occlusion->begin(camera_->getViewProj());
+	terrain->drawOccluders(occlusion);
+	occlusion->rasterise();
+	UINT occluded = terrain->cullOccluded(*occlusion);
+	if (treeVisible)
+	{
+		M3DVector3f treeMin = { treeCentre.x - treeRadius, treeCentre.y - treeRadius, 
+								treeCentre.z - treeRadius };
+		M3DVector3f treeMax = { treeCentre.x + treeRadius, treeCentre.y + treeRadius, 
+								treeCentre.z + treeRadius };
+		treeVisible = occlusion->isVisible(treeMin, treeMax);
+		occluded += treeVisible ? 0 : 1;
+	}
+	Scene::instance()->addOcclusionStats(occluded, GameTimer::now() - occlusionStart);
+
+	return treeVisible;
+}
+
+/*
+	Name		State::renderShadows
+	Syntax		State::renderShadows(Model* tree, const Light& light,
+				M3DCascadeSet* cascades)
+	Param		Model* tree - The state's tree
+	Param		const Light& light - The light casting the shadows
+	Param		M3DCascadeSet* cascades - The state's shadow cascades
+	Brief		Fits the shadow cascades to the camera, for the light
+				shining from its position towards the origin, and draws the
+				tree into those that have to be drawn again
+	Details		The shadow is drawn whether or not the tree is in view, as
+				it may fall on terrain that is
+*/
+void State::renderShadows(Model* tree, const Light& light, M3DCascadeSet* cascades)
+{
+	TimerTicks shadowStart = GameTimer::now();
+	D3DXVECTOR3 lightDir = -light.getPosition();
+	D3DXVec3Normalize(&lightDir, &lightDir);
+	camera_->fitShadowCascades(cascades, lightDir);
+	tree->update(*cascades);
+	TimerTicks shadowTicks = GameTimer::now() - shadowStart;
+
+	UINT cascadesDrawn = tree->renderShadow(*cascades);
+	Scene::instance()->addShadowStats(cascades->count, cascadesDrawn, shadowTicks);
+}
@@ -14,19 +14,64 @@
 #include "Input/DirectInput.hpp"
 #include <d3dx10.h>
 
+class Picker;
+class Model;
+class Terrain;
+class Light;
+
+enum Season
+{
+	SEASON_SPRING,
+	SEASON_SUMMER,
+	SEASON_AUTUMN,
+	SEASON_WINTER,
+	SEASONS_NO
+};
+
+/*
+	Name		getSeasonName
+	Syntax		getSeasonName(Season season)
+	Param		Season season - The season
+	Return		const char* - The name of the season
+	Brief		Gets the name of a season for reports
+*/
+inline const char* getSeasonName(Season season)
+{
+	static const char* names[SEASONS_NO] = { "spring", "summer", "autumn", "winter" };
+	return season < SEASONS_NO ? names[season] : "unknown";
+}
+
 class State
 {
 public:
+	State();
+
 	// Pure virtual function
     virtual State * getNextState() = 0;
+	virtual Season getSeason() const = 0;
 	virtual bool initialise() = 0;
 	virtual bool deinitialise() = 0;
 	virtual bool update(float dt) = 0;
 	virtual void render() = 0;
 
+	// Hand the state of a simulation step over to rendering. Called with
+	// the scene's snapshot lock held, so they should only copy state
+	virtual void publish() { camera_->publish(); };
+	virtual void apply(float alpha) { camera_->apply(alpha); };
+
+	// Adds the bounding volumes of the objects that can be picked
+	virtual void addPickables(Picker* picker) const;
+
 protected:
+	// Culls the tree and terrain cells against the camera and the
+	// occlusion buffer, returning true if the tree is to be drawn
+	bool cullScene(const Model& tree, Terrain* terrain);
+	// Fits the shadow cascades and draws the tree into those that moved
+	void renderShadows(Model* tree, const Light& light, M3DCascadeSet* cascades);
+
 	Camera * camera_;
 	DirectInput * input_;
+	const Model* pickTree_;		// The tree that can be picked, if any
 };
 
 #endif
\ No newline at end of file
@@ -10,6 +10,7 @@
 #include "States/Summer.hpp"
 #include "States/Autumn.hpp"
 #include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
 
 #include "Shaders/TerrainShader.hpp"
 #include "Shaders/SkyMapShader.hpp"
@@ -25,6 +26,8 @@ Summer::Summer()
   sunDirection_(-300.0f, 100.0f, -100.0f), fogColor_(0.7f, 0.65f, 0.55f), MOVESPEED(50), 
   ROTATESPEED(1.5), noCullRS_(0) 
 {
+	pickTree_ = &tree_;
+
 	terrainLayerMapRVs_[0] = 0;
 	terrainLayerMapRVs_[1] = 0;
 	terrainLayerMapRVs_[2] = 0;
@@ -60,7 +63,7 @@ bool Summer::initialise()
 {
 	
 	camera_ = new Camera;
-	input_ = new DirectInput;
+	input_ = new DirectInput(Scene::instance()->getInputLog());
 
 	d3dDevice_ = Scene::instance()->getDevice();
 	if (!d3dDevice_)
@@ -93,14 +96,9 @@ bool Summer::initialise()
 	light_.setSpecular(D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f));
 	light_.setPosition(D3DXVECTOR3(-10.0f, 100.0f, 350.0f));
 
-	D3DXMATRIX lightView, lightVolume;
-
-	D3DXMatrixLookAtLH(&lightView, &light_.getPosition(),
-		&D3DXVECTOR3(0.0f, 0.0f, 0.0f), &D3DXVECTOR3(0.0f, 1.0f, 0.0f));
-
-	D3DXMatrixOrthoLH(&lightVolume, 200.0f, 200.0f, -35.0f, 100.0f);
-	
-	lightViewProj_ = lightView * lightVolume;
+	// The near two shadow cascades follow the camera every frame, and the
+	// far two are drawn again only when it leaves them
+	m3dInitCascades(&shadowCascades_, M3D_MAX_CASCADES, Model::SHADOW_MAP_SIZE, 2);
 
 	moveX_ = 0.0f;
 	moveZ_ = 0.0f;
@@ -134,6 +132,8 @@ bool Summer::deinitialise()
 */
 bool Summer::update(float dt)
 {
+	PROFILE_ZONE("Summer::update");
+
 	input_->update();
 
 	if (input_->isKeyDown(DIK_1)) return true;
@@ -165,13 +165,9 @@ bool Summer::update(float dt)
 	moveX_ = 0.0f;
 	moveZ_ = 0.0f;
 
-	// Update camera - updates the View and Projection matrices
-	camera_->update();
+	// Update camera - stores the pose for rendering
+	camera_->update(dt);
 
-	skySphere_.setPos(camera_->getPosition());
-	skySphere_.setTrans();
-
-	tree_.update(lightViewProj_);
     return false;
 }
 
@@ -182,6 +178,16 @@ bool Summer::update(float dt)
 */
 void Summer::render()
 {
+	PROFILE_ZONE("Summer::render");
+
+	// Centre the sky sphere on the interpolated camera
+	skySphere_.setPos(camera_->getRenderPosition());
+	skySphere_.setTrans();
+
+	// Cull the tree and the terrain cells against the camera and drop
+	// those hidden behind nearer hills
+	bool treeVisible = cullScene(tree_, &terrain_);
+
 	// Reset the depth stencil state and blend state 
 	d3dDevice_->OMSetDepthStencilState(0, 0);
 	float blendFactors[] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -191,9 +197,11 @@ void Summer::render()
 	// Disable culling of back faces so that tree foliage is rendered correctly
 	d3dDevice_->RSSetState(noCullRS_);
 	// Build the shadow map for the tree model
-	tree_.renderShadow();
-	// Draw tree
-	tree_.render(&camera_->getPosition(), &light_, &fogColor_);
+	renderShadows(&tree_, light_, &shadowCascades_);
+	// Draw tree, unless it is out of view or hidden. Its shadow is still built,
+	// as it may fall on terrain that is in view
+	if (treeVisible)
+		tree_.render(&camera_->getRenderPosition(), &light_, &fogColor_);
 	// Reenable back face culling once tree is rendered
 	d3dDevice_->RSSetState(0);
 
@@ -204,7 +212,7 @@ void Summer::render()
 	Scene::instance()->setWVP();	
 	// Create a new technique description for our terrain technique
     D3D10_TECHNIQUE_DESC terrainTechDesc;
-	terrainShader_->setupRender(&terrainTechDesc, &camera_->getPosition(), 
+	terrainShader_->setupRender(&terrainTechDesc, &camera_->getRenderPosition(), 
 								&sunDirection_, &fogColor_, terrainLayerMapRVs_, 
 								terrainBlendMapRV_, terrainSpecMap_);
 	// Draw the terrain
@@ -258,6 +266,7 @@ void Summer::initialiseGeometry()
 	terrain_.setScale(5.0f, 5.0f, 5.0f);
 	terrain_.setPos(D3DXVECTOR3(-600.0f, -150.0f, -600.0f));
 	terrain_.setTrans();
+	camera_->setGround(&terrain_);
 
 	// Create sky sphere and scale it so that it does not clip with the camera
 	skySphere_.initialise(d3dDevice_);
@@ -25,6 +25,7 @@ public:
 	Summer();
 	~Summer();
     virtual State* getNextState();
+	virtual Season getSeason() const { return SEASON_SUMMER; };
 	virtual bool initialise();
 	virtual bool deinitialise();
 	virtual bool update(float dt);
@@ -59,7 +60,7 @@ private:
 	float moveX_, moveZ_, yaw_, pitch_; // Camera movement
 	D3DXVECTOR3 sunDirection_;
 	D3DXVECTOR3 fogColor_;
-	D3DXMATRIX lightViewProj_;
+	M3DCascadeSet shadowCascades_;
 
 	// Constants
 	const int MOVESPEED;
@@ -12,12 +12,14 @@
 #include "States/Winter.hpp"
 #include "States/Spring.hpp"
 #include "Scene/Scene.hpp"
+#include "Profiler/Profiler.hpp"
 
 #include "Shaders/TerrainShader.hpp"
 #include "Shaders/SkyMapShader.hpp"
 
 #include "ParticleSystem/ParticleSystem.hpp"
 #include "ParticleSystem/Particle.hpp"
+#include "ParticleSystem/ParticleEffect.hpp"
 
 /*
 	Name		Winter::Winter
@@ -29,6 +31,8 @@ Winter::Winter()
   terrainSpecMap_(0), skyMapRV_(0), snowArrayRV_(0), snow_(0), moveX_(0), 
   moveZ_(0), yaw_(0), pitch_(0), MOVESPEED(50), ROTATESPEED(1.5), noCullRS_(0)
 {
+	pickTree_ = &tree_;
+
 	sunDirection_	= D3DXVECTOR3(300.0f, 100.0f, 500.0f);
 	fogColor_		= D3DXVECTOR3(0.7f, 0.8f, 0.9f);
 
@@ -67,7 +71,7 @@ bool Winter::initialise()
 {
 	
 	camera_ = new Camera;
-	input_ = new DirectInput;
+	input_ = new DirectInput(Scene::instance()->getInputLog());
 
 	d3dDevice_ = Scene::instance()->getDevice();
 	if (!d3dDevice_)
@@ -90,6 +94,11 @@ bool Winter::initialise()
 		return false;
 	}
 
+	// The particle textures are read on a worker thread while the shaders
+	// and geometry load
+	if (snowEffect_.load("Assets/Particles/Snow.txt"))
+		Scene::instance()->getTextureArrays()->prefetch(snowEffect_.getTextures());
+
 	initialiseShaders();
 	initialiseGeometry();
 	initialiseParticleSystems();
@@ -101,14 +110,9 @@ bool Winter::initialise()
 	light_.setSpecular(D3DXCOLOR(1.0f, 1.0f, 1.0f, 1.0f));
 	light_.setPosition(D3DXVECTOR3(10.0f, 100.0f, 350.0f));
 
-	D3DXMATRIX lightView, lightVolume;
-
-	D3DXMatrixLookAtLH(&lightView, &light_.getPosition(),
-		&D3DXVECTOR3(0.0f, 0.0f, 0.0f), &D3DXVECTOR3(0.0f, 1.0f, 0.0f));
-
-	D3DXMatrixOrthoLH(&lightVolume, -200.0f, 200.0f, -35.0f, 100.0f);
-	
-	lightViewProj_ = lightView * lightVolume;
+	// The near two shadow cascades follow the camera every frame, and the
+	// far two are drawn again only when it leaves them
+	m3dInitCascades(&shadowCascades_, M3D_MAX_CASCADES, Model::SHADOW_MAP_SIZE, 2);
 
 	moveX_ = 0.0f;
 	moveZ_ = 0.0f;
@@ -131,6 +135,8 @@ bool Winter::deinitialise()
 	delete terrainShader_;
 	delete skyMapShader_;
 	delete snow_;
+	Scene::instance()->getTextureArrays()->release(snowArrayRV_);
+	snowArrayRV_ = 0;
 
     return true;
 }
@@ -144,6 +150,8 @@ bool Winter::deinitialise()
 */
 bool Winter::update(float dt)
 {
+	PROFILE_ZONE("Winter::update");
+
 	input_->update();
 
 	if (input_->isKeyDown(DIK_1)) return true;
@@ -180,17 +188,39 @@ bool Winter::update(float dt)
 	// Zoom camera
 	camera_->zoom(input_->getMouseZ());
 
-	// Update camera - updates the View and Projection matrices
-	camera_->update();
+	// Update camera - stores the pose for rendering
+	camera_->update(dt);
 
-	skySphere_.setPos(camera_->getPosition());
-	skySphere_.setTrans();
+	wind_.update(dt);
+	snow_->update(dt, Scene::instance()->getSceneTime());
 
-	snow_->update(dt, Scene::instance()->getTimer()->getGameTime());
+    return false;
+}
 
-	tree_.update(lightViewProj_);
+/*
+	Name		Winter::publish
+	Syntax		Winter::publish()
+	Brief		Hands the camera and particle state of the step over to 
+				rendering
+*/
+void Winter::publish()
+{
+	State::publish();
+	wind_.publish();
+	snow_->publish();
+}
 
-    return false;
+/*
+	Name		Winter::apply
+	Syntax		Winter::apply(float alpha)
+	Param		float alpha - Fraction of a step to interpolate the camera by
+	Brief		Takes the published camera and particle state for rendering
+*/
+void Winter::apply(float alpha)
+{
+	State::apply(alpha);
+	wind_.apply();
+	snow_->apply();
 }
 
 /*
@@ -200,6 +230,16 @@ bool Winter::update(float dt)
 */
 void Winter::render()
 {
+	PROFILE_ZONE("Winter::render");
+
+	// Centre the sky sphere on the interpolated camera
+	skySphere_.setPos(camera_->getRenderPosition());
+	skySphere_.setTrans();
+
+	// Cull the tree and the terrain cells against the camera and drop
+	// those hidden behind nearer hills
+	bool treeVisible = cullScene(tree_, &terrain_);
+
 	// Reset the depth stencil state and blend state 
 	d3dDevice_->OMSetDepthStencilState(0, 0);
 	float blendFactor[] = {0.0f, 0.0f, 0.0f, 0.0f};
@@ -209,9 +249,11 @@ void Winter::render()
 	// Disable culling of back faces so that tree foliage is rendered correctly
 	d3dDevice_->RSSetState(noCullRS_);
 	// Build the shadow map for the tree model
-	tree_.renderShadow();
-	// Draw tree
-	tree_.render(&camera_->getPosition(), &light_, &fogColor_);
+	renderShadows(&tree_, light_, &shadowCascades_);
+	// Draw tree, unless it is out of view or hidden. Its shadow is still built,
+	// as it may fall on terrain that is in view
+	if (treeVisible)
+		tree_.render(&camera_->getRenderPosition(), &light_, &fogColor_);
 	// Reenable back face culling once tree is rendered
 	d3dDevice_->RSSetState(0);
 
@@ -222,7 +264,7 @@ void Winter::render()
 	Scene::instance()->setWVP();	
 	// Create a new technique description for our terrain technique
     D3D10_TECHNIQUE_DESC terrainTechDesc;
-	terrainShader_->setupRender(&terrainTechDesc, &camera_->getPosition(), 
+	terrainShader_->setupRender(&terrainTechDesc, &camera_->getRenderPosition(), 
 								&sunDirection_, &fogColor_, terrainLayerMapRVs_, 
 								terrainBlendMapRV_, terrainSpecMap_);
 	// Draw the terrain
@@ -249,8 +291,12 @@ void Winter::render()
 
 	// Render snow particles
 	d3dDevice_->OMSetBlendState(0, blendFactor, 0xffffffff); // restore default
-	snow_->setEyePos(camera_->getPosition());
-	snow_->setEmitPos(camera_->getPosition());
+	snow_->setEyePos(camera_->getRenderPosition());
+	snow_->setEmitPos(camera_->getRenderPosition());
+
+	// Share the particle budget out for the view, now the emitter is placed
+	Scene::instance()->getParticleBudget()->distribute(camera_->getFrustum(), 
+		camera_->getRenderPosition(), Scene::instance()->getProjection());
 	snow_->render();
 }
 
@@ -282,6 +328,7 @@ void Winter::initialiseGeometry()
 	terrain_.setScale(5.0f, 5.0f, 5.0f);
 	terrain_.setPos(D3DXVECTOR3(-600.0f, -150.0f, -600.0f));
 	terrain_.setTrans();
+	camera_->setGround(&terrain_);
 
 	// Create sky sphere and scale it so that it does not clip with the camera
 	skySphere_.initialise(d3dDevice_);
@@ -302,117 +349,29 @@ void Winter::initialiseGeometry()
 */
 void Winter::initialiseParticleSystems()
 {
-	HRESULT hr = 0;
-
-	std::vector<std::string> snowflakes;
-	snowflakes.push_back("Assets/2D Textures/snowflake.dds");
-
-	// Load the texture elements individually from file.  These textures
-	// won't be used by the GPU (0 bind flags), they are just used to 
-	// load the image data from file.  We use the STAGING usage so the
-	// CPU can read the resource.
-	UINT arraySize = (UINT)snowflakes.size();
-
-	std::vector<ID3D10Texture2D*> srcTex(arraySize, 0);
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		D3DX10_IMAGE_LOAD_INFO loadInfo;
-
-        loadInfo.Width  = D3DX10_FROM_FILE;
-        loadInfo.Height = D3DX10_FROM_FILE;
-        loadInfo.Depth  = D3DX10_FROM_FILE;
-        loadInfo.FirstMipLevel = 0;
-        loadInfo.MipLevels = D3DX10_FROM_FILE;
-        loadInfo.Usage = D3D10_USAGE_STAGING;
-        loadInfo.BindFlags = 0;
-        loadInfo.CpuAccessFlags = D3D10_CPU_ACCESS_WRITE | D3D10_CPU_ACCESS_READ;
-        loadInfo.MiscFlags = 0;
-        loadInfo.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-        loadInfo.Filter = D3DX10_FILTER_NONE;
-        loadInfo.MipFilter = D3DX10_FILTER_NONE;
-		loadInfo.pSrcInfo  = 0;
-
-        hr = D3DX10CreateTextureFromFile(d3dDevice_, snowflakes[i].c_str(), 
-			&loadInfo, 0, (ID3D10Resource**)&srcTex[i], 0);
-
-		if (FAILED(hr))
-		{
-			MessageBox(0, "Create snowflakes texture - Failed", "Error", MB_OK);
-			return;
-		}
-	}
-
-	// Create the texture array.  Each element in the texture 
-	// array has the same format/dimensions.
-	D3D10_TEXTURE2D_DESC texElementDesc;
-	srcTex[0]->GetDesc(&texElementDesc);
-
-	D3D10_TEXTURE2D_DESC texArrayDesc;
-	texArrayDesc.Width              = texElementDesc.Width;
-	texArrayDesc.Height             = texElementDesc.Height;
-	texArrayDesc.MipLevels          = texElementDesc.MipLevels;
-	texArrayDesc.ArraySize          = arraySize;
-	texArrayDesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texArrayDesc.SampleDesc.Count   = 1;
-	texArrayDesc.SampleDesc.Quality = 0;
-	texArrayDesc.Usage              = D3D10_USAGE_DEFAULT;
-	texArrayDesc.BindFlags          = D3D10_BIND_SHADER_RESOURCE;
-	texArrayDesc.CPUAccessFlags     = 0;
-	texArrayDesc.MiscFlags          = 0;
-
-	ID3D10Texture2D* texArray = 0;
-	hr = d3dDevice_->CreateTexture2D( &texArrayDesc, 0, &texArray);
-	if (FAILED(hr))
+	// The snow is described by file, and its texture array is
+	// shared with any other system using the same textures
+	snowArrayRV_ = Scene::instance()->getTextureArrays()->acquire(snowEffect_.getTextures());
+	if (!snowArrayRV_)
 	{
 		MessageBox(0, "Create snowflakes array - Failed", "Error", MB_OK);
 		return;
 	}
 
-	// Copy individual texture elements into texture array.
+	snow_ = new ParticleSystem(snowEffect_);
+	snow_->initialise(d3dDevice_, snowArrayRV_, snowEffect_.getMaxParticles());
+	snow_->setWrapping(true);
 
-	// for each texture element...
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		// for each mipmap level...
-		for (UINT j = 0; j < texElementDesc.MipLevels; ++j)
-		{
-			D3D10_MAPPED_TEXTURE2D mappedTex2D;
-			srcTex[i]->Map(j, D3D10_MAP_READ, 0, &mappedTex2D);
-                    
-            d3dDevice_->UpdateSubresource(texArray, 
-				D3D10CalcSubresource(j, i, texElementDesc.MipLevels),
-                0, mappedTex2D.pData, mappedTex2D.RowPitch, 0);
-
-            srcTex[i]->Unmap(j);
-		}
-	}	
-
-	// Create a resource view to the texture array.
-	D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
-	viewDesc.Format = texArrayDesc.Format;
-	viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
-	viewDesc.Texture2DArray.MostDetailedMip = 0;
-	viewDesc.Texture2DArray.MipLevels = texArrayDesc.MipLevels;
-	viewDesc.Texture2DArray.FirstArraySlice = 0;
-	viewDesc.Texture2DArray.ArraySize = arraySize;
-
-	hr = d3dDevice_->CreateShaderResourceView(texArray, &viewDesc, &snowArrayRV_);
-	if (FAILED(hr))
-	{
-		MessageBox(0, "Create snowflakes RV - Failed", "Error", MB_OK);
-		return;
-	}
-
-	// Cleanup - we only need the resource view.
-	texArray->Release();
-
-	for (UINT i = 0; i < arraySize; ++i)
-	{
-		srcTex[i]->Release(); 
-	}
+	// A light wind for the snow to drift on
+	M3DHeightField ground;
+	terrain_.getHeightField(&ground);
+	M3DVector3f wind = { 1.5f, 0.0f, -1.0f };
+	wind_.initialise(&ground, 40.0f, 200.0f);
+	wind_.setWind(wind, 0.3f, 1.5f, 40.0f, 3.0f);
+	snow_->setWind(&wind_);
 
-	snow_ = new ParticleSystem(PARTICLE_SNOW);
-	snow_->initialise(d3dDevice_, snowArrayRV_, 100000);
+	// The flakes settle on the terrain
+	snow_->setGround(&ground);
 }
 
 /*
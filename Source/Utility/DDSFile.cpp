@@ -0,0 +1,499 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		DDSFile
+	Brief		Implementation of the DDSFile class
+*/
+
+#include "Utility/DDSFile.hpp"
+
+namespace
+{
+	const DWORD DDS_MAGIC = 0x20534444;				// "DDS "
+	const UINT PAGE_BYTES = 4096;					// Pages are touched this far apart
+
+	// Header flags
+	const DWORD DDSD_MIPMAPCOUNT = 0x20000;
+	const DWORD DDSD_DEPTH = 0x800000;
+
+	// Pixel format flags
+	const DWORD DDPF_ALPHAPIXELS = 0x1;
+	const DWORD DDPF_ALPHA = 0x2;
+	const DWORD DDPF_FOURCC = 0x4;
+	const DWORD DDPF_RGB = 0x40;
+	const DWORD DDPF_LUMINANCE = 0x20000;
+
+	// Caps2 flags
+	const DWORD DDSCAPS2_CUBEMAP = 0x200;
+	const DWORD DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+	const DWORD DDSCAPS2_VOLUME = 0x200000;
+
+	// DX10 header dimension and flags
+	const UINT DDS_DIMENSION_TEXTURE2D = 3;
+	const UINT DDS_MISC_TEXTURECUBE = 0x4;
+
+	/*
+		Name		DDSPixelFormat
+		Syntax		DDSPixelFormat
+		Brief		The legacy header's pixel format
+	*/
+	struct DDSPixelFormat
+	{
+		DWORD size;
+		DWORD flags;
+		DWORD fourCC;
+		DWORD rgbBitCount;
+		DWORD rMask, gMask, bMask, aMask;
+	};
+
+	/*
+		Name		DDSHeader
+		Syntax		DDSHeader
+		Brief		The header following the magic number
+	*/
+	struct DDSHeader
+	{
+		DWORD size;
+		DWORD flags;
+		DWORD height;
+		DWORD width;
+		DWORD pitchOrLinearSize;
+		DWORD depth;
+		DWORD mipMapCount;
+		DWORD reserved1[11];
+		DDSPixelFormat format;
+		DWORD caps, caps2, caps3, caps4;
+		DWORD reserved2;
+	};
+
+	/*
+		Name		DDSHeaderDX10
+		Syntax		DDSHeaderDX10
+		Brief		The header following DDSHeader when its four character
+					code is DX10
+	*/
+	struct DDSHeaderDX10
+	{
+		DXGI_FORMAT format;
+		UINT dimension;
+		UINT miscFlag;
+		UINT arraySize;
+		UINT miscFlags2;
+	};
+
+	/*
+		Name		fourCC
+		Syntax		fourCC(const char* code)
+		Return		DWORD - The four characters as the header holds them
+	*/
+	inline DWORD fourCC(const char* code)
+	{
+		return (DWORD)(BYTE)code[0] | ((DWORD)(BYTE)code[1] << 8) |
+			   ((DWORD)(BYTE)code[2] << 16) | ((DWORD)(BYTE)code[3] << 24);
+	}
+
+	inline bool isMask(const DDSPixelFormat& f, DWORD r, DWORD g, DWORD b, DWORD a)
+	{
+		return f.rMask == r && f.gMask == g && f.bMask == b && f.aMask == a;
+	}
+
+	/*
+		Name		legacyFormat
+		Syntax		legacyFormat(const DDSPixelFormat& f)
+		Param		const DDSPixelFormat& f - The legacy header's pixel format
+		Return		DXGI_FORMAT - The same layout of bits, or
+					DXGI_FORMAT_UNKNOWN if there is none
+		Brief		Maps a legacy pixel format to DXGI by its four character
+					code, or by its masks. The numeric codes are those of the
+					D3DFORMAT enumeration
+	*/
+	DXGI_FORMAT legacyFormat(const DDSPixelFormat& f)
+	{
+		if (f.flags & DDPF_FOURCC)
+		{
+			if (f.fourCC == fourCC("DXT1"))
+				return DXGI_FORMAT_BC1_UNORM;
+			if (f.fourCC == fourCC("DXT2") || f.fourCC == fourCC("DXT3"))
+				return DXGI_FORMAT_BC2_UNORM;
+			if (f.fourCC == fourCC("DXT4") || f.fourCC == fourCC("DXT5"))
+				return DXGI_FORMAT_BC3_UNORM;
+			if (f.fourCC == fourCC("ATI1") || f.fourCC == fourCC("BC4U"))
+				return DXGI_FORMAT_BC4_UNORM;
+			if (f.fourCC == fourCC("BC4S"))
+				return DXGI_FORMAT_BC4_SNORM;
+			if (f.fourCC == fourCC("ATI2") || f.fourCC == fourCC("BC5U"))
+				return DXGI_FORMAT_BC5_UNORM;
+			if (f.fourCC == fourCC("BC5S"))
+				return DXGI_FORMAT_BC5_SNORM;
+
+			switch (f.fourCC)
+			{
+			case 36:	return DXGI_FORMAT_R16G16B16A16_UNORM;
+			case 110:	return DXGI_FORMAT_R16G16B16A16_SNORM;
+			case 111:	return DXGI_FORMAT_R16_FLOAT;
+			case 112:	return DXGI_FORMAT_R16G16_FLOAT;
+			case 113:	return DXGI_FORMAT_R16G16B16A16_FLOAT;
+			case 114:	return DXGI_FORMAT_R32_FLOAT;
+			case 115:	return DXGI_FORMAT_R32G32_FLOAT;
+			case 116:	return DXGI_FORMAT_R32G32B32A32_FLOAT;
+			}
+			return DXGI_FORMAT_UNKNOWN;
+		}
+
+		if (f.flags & DDPF_RGB)
+		{
+			if (f.rgbBitCount == 32)
+			{
+				if (isMask(f, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+					return DXGI_FORMAT_R8G8B8A8_UNORM;
+				if (isMask(f, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000))
+					return DXGI_FORMAT_B8G8R8A8_UNORM;
+				if (isMask(f, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000))
+					return DXGI_FORMAT_B8G8R8X8_UNORM;
+				if (isMask(f, 0x000003ff, 0x000ffc00, 0x3ff00000, 0xc0000000))
+					return DXGI_FORMAT_R10G10B10A2_UNORM;
+				if (isMask(f, 0x0000ffff, 0xffff0000, 0x00000000, 0x00000000))
+					return DXGI_FORMAT_R16G16_UNORM;
+				if (isMask(f, 0xffffffff, 0x00000000, 0x00000000, 0x00000000))
+					return DXGI_FORMAT_R32_FLOAT;
+			}
+			else if (f.rgbBitCount == 16)
+			{
+				if (isMask(f, 0xf800, 0x07e0, 0x001f, 0x0000))
+					return DXGI_FORMAT_B5G6R5_UNORM;
+				if (isMask(f, 0x7c00, 0x03e0, 0x001f, 0x8000))
+					return DXGI_FORMAT_B5G5R5A1_UNORM;
+			}
+			return DXGI_FORMAT_UNKNOWN;
+		}
+
+		if (f.flags & DDPF_LUMINANCE)
+		{
+			if (f.rgbBitCount == 8 && f.rMask == 0xff)
+				return DXGI_FORMAT_R8_UNORM;
+			if (f.rgbBitCount == 16 && f.rMask == 0xffff)
+				return DXGI_FORMAT_R16_UNORM;
+			if (f.rgbBitCount == 16 && f.rMask == 0xff && f.aMask == 0xff00 &&
+				(f.flags & DDPF_ALPHAPIXELS))
+				return DXGI_FORMAT_R8G8_UNORM;
+			return DXGI_FORMAT_UNKNOWN;
+		}
+
+		if ((f.flags & DDPF_ALPHA) && f.rgbBitCount == 8)
+			return DXGI_FORMAT_A8_UNORM;
+
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	/*
+		Name		formatSize
+		Syntax		formatSize(DXGI_FORMAT format, UINT* blockBytes,
+					UINT* pixelBits)
+		Param		DXGI_FORMAT format - A format
+		Param		UINT* blockBytes - Receives the bytes of a 4x4 block, or 0
+					if the format is not block compressed
+		Param		UINT* pixelBits - Receives the bits of a pixel if it is not
+		Return		bool - False if the format has no plain layout of rows,
+					such as the packed 4:2:2 and 1 bit formats
+	*/
+	bool formatSize(DXGI_FORMAT format, UINT* blockBytes, UINT* pixelBits)
+	{
+		*blockBytes = 0;
+		*pixelBits = 0;
+
+		if ((format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC1_UNORM_SRGB) ||
+			(format >= DXGI_FORMAT_BC4_TYPELESS && format <= DXGI_FORMAT_BC4_SNORM))
+			*blockBytes = 8;
+		else if ((format >= DXGI_FORMAT_BC2_TYPELESS && format <= DXGI_FORMAT_BC3_UNORM_SRGB) ||
+				 (format >= DXGI_FORMAT_BC5_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+				 (format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB))
+			*blockBytes = 16;
+		else if (format >= DXGI_FORMAT_R32G32B32A32_TYPELESS &&
+				 format <= DXGI_FORMAT_R32G32B32A32_SINT)
+			*pixelBits = 128;
+		else if (format >= DXGI_FORMAT_R32G32B32_TYPELESS && format <= DXGI_FORMAT_R32G32B32_SINT)
+			*pixelBits = 96;
+		else if (format >= DXGI_FORMAT_R16G16B16A16_TYPELESS &&
+				 format <= DXGI_FORMAT_X32_TYPELESS_G8X24_UINT)
+			*pixelBits = 64;
+		else if ((format >= DXGI_FORMAT_R10G10B10A2_TYPELESS &&
+				  format <= DXGI_FORMAT_X24_TYPELESS_G8_UINT) ||
+				 format == DXGI_FORMAT_R9G9B9E5_SHAREDEXP ||
+				 (format >= DXGI_FORMAT_B8G8R8A8_UNORM && format <= DXGI_FORMAT_B8G8R8X8_UNORM_SRGB))
+			*pixelBits = 32;
+		else if ((format >= DXGI_FORMAT_R8G8_TYPELESS && format <= DXGI_FORMAT_R16_SINT) ||
+				 format == DXGI_FORMAT_B5G6R5_UNORM || format == DXGI_FORMAT_B5G5R5A1_UNORM)
+			*pixelBits = 16;
+		else if (format >= DXGI_FORMAT_R8_TYPELESS && format <= DXGI_FORMAT_A8_UNORM)
+			*pixelBits = 8;
+
+		return *blockBytes != 0 || *pixelBits != 0;
+	}
+}
+
+/*
+	Name		DDSFile::DDSFile
+	Syntax		DDSFile()
+	Brief		DDSFile constructor, with no file open
+*/
+DDSFile::DDSFile()
+: file_(INVALID_HANDLE_VALUE), mapping_(0), view_(0), fileSize_(0),
+  format_(DXGI_FORMAT_UNKNOWN), width_(0), height_(0), mipLevels_(0), arraySize_(0),
+  cube_(false), blockBytes_(0), pixelBits_(0)
+{
+}
+
+/*
+	Name		DDSFile::~DDSFile
+	Syntax		~DDSFile()
+	Brief		DDSFile destructor, unmapping the file
+*/
+DDSFile::~DDSFile()
+{
+	close();
+}
+
+/*
+	Name		DDSFile::open
+	Syntax		DDSFile::open(const std::string& fileName)
+	Param		const std::string& fileName - The DDS file
+	Return		bool - True if the file was mapped and holds a texture that
+				can be read
+	Brief		Maps the file and reads its header, laying out where each
+				surface is in the mapping
+	Details		Only the header is read. The surfaces are read from disk as
+				they are touched
+*/
+bool DDSFile::open(const std::string& fileName)
+{
+	close();
+
+	file_ = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+						FILE_ATTRIBUTE_NORMAL, 0);
+	if (file_ == INVALID_HANDLE_VALUE)
+	{
+		MessageBox(0, ("Opening DDS file " + fileName + " - Failed").c_str(), "Error", MB_OK);
+		return false;
+	}
+
+	DWORD sizeHigh = 0;
+	fileSize_ = GetFileSize(file_, &sizeHigh);
+	if (sizeHigh != 0 || fileSize_ < sizeof(DWORD) + sizeof(DDSHeader))
+	{
+		MessageBox(0, ("Reading DDS file " + fileName + " - Bad size").c_str(), "Error", MB_OK);
+		close();
+		return false;
+	}
+
+	mapping_ = CreateFileMappingA(file_, 0, PAGE_READONLY, 0, 0, 0);
+	if (mapping_)
+		view_ = (const BYTE*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (!view_)
+	{
+		MessageBox(0, ("Mapping DDS file " + fileName + " - Failed").c_str(), "Error", MB_OK);
+		close();
+		return false;
+	}
+
+	if (!parse(fileName))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+/*
+	Name		DDSFile::close
+	Syntax		DDSFile::close()
+	Brief		Unmaps and closes the file, if one is open. Its surfaces may
+				no longer be used
+*/
+void DDSFile::close()
+{
+	if (view_)
+		UnmapViewOfFile(view_);
+	if (mapping_)
+		CloseHandle(mapping_);
+	if (file_ != INVALID_HANDLE_VALUE)
+		CloseHandle(file_);
+
+	view_ = 0;
+	mapping_ = 0;
+	file_ = INVALID_HANDLE_VALUE;
+	fileSize_ = 0;
+	surfaces_.clear();
+}
+
+/*
+	Name		DDSFile::parse
+	Syntax		DDSFile::parse(const std::string& fileName)
+	Param		const std::string& fileName - The file, for its messages
+	Return		bool - True if the header describes a texture that can be
+				read and the file holds all of it
+	Brief		Reads the headers and lays out the surfaces, each item's
+				mips from the largest in turn, as they are in the file
+*/
+bool DDSFile::parse(const std::string& fileName)
+{
+	const DDSHeader* header = (const DDSHeader*)(view_ + sizeof(DWORD));
+	if (*(const DWORD*)view_ != DDS_MAGIC || header->size != sizeof(DDSHeader) ||
+		header->format.size != sizeof(DDSPixelFormat))
+	{
+		MessageBox(0, ("Reading DDS file " + fileName + " - Not a DDS file").c_str(), "Error",
+				   MB_OK);
+		return false;
+	}
+
+	UINT offset = sizeof(DWORD) + sizeof(DDSHeader);
+	width_ = header->width;
+	height_ = header->height;
+	mipLevels_ = (header->flags & DDSD_MIPMAPCOUNT) && header->mipMapCount > 0 ?
+				 header->mipMapCount : 1;
+	arraySize_ = 1;
+	cube_ = false;
+
+	bool flat = true;
+	if ((header->format.flags & DDPF_FOURCC) && header->format.fourCC == fourCC("DX10"))
+	{
+		const DDSHeaderDX10* header10 = (const DDSHeaderDX10*)(view_ + offset);
+		offset += sizeof(DDSHeaderDX10);
+		if (offset > fileSize_)
+		{
+			MessageBox(0, ("Reading DDS file " + fileName + " - Bad size").c_str(), "Error", MB_OK);
+			return false;
+		}
+		format_ = header10->format;
+		arraySize_ = header10->arraySize;
+		flat = header10->dimension == DDS_DIMENSION_TEXTURE2D;
+		if (header10->miscFlag & DDS_MISC_TEXTURECUBE)
+		{
+			cube_ = true;
+			arraySize_ *= 6;
+		}
+	}
+	else
+	{
+		format_ = legacyFormat(header->format);
+		flat = !(header->caps2 & DDSCAPS2_VOLUME) &&
+			   !((header->flags & DDSD_DEPTH) && header->depth > 1);
+		if (header->caps2 & DDSCAPS2_CUBEMAP)
+		{
+			// Cube maps missing faces cannot be made into textures
+			flat = flat && (header->caps2 & DDSCAPS2_CUBEMAP_ALLFACES) ==
+						   DDSCAPS2_CUBEMAP_ALLFACES;
+			cube_ = true;
+			arraySize_ = 6;
+		}
+	}
+
+	if (!flat || !formatSize(format_, &blockBytes_, &pixelBits_))
+	{
+		MessageBox(0, ("Reading DDS file " + fileName + " - Unsupported format").c_str(), "Error",
+				   MB_OK);
+		return false;
+	}
+
+	UINT fullChain = 1;
+	for (UINT size = max(width_, height_); size > 1; size >>= 1)
+		++fullChain;
+	if (width_ == 0 || height_ == 0 || width_ > D3D10_REQ_TEXTURE2D_U_OR_V_DIMENSION ||
+		height_ > D3D10_REQ_TEXTURE2D_U_OR_V_DIMENSION || mipLevels_ > fullChain ||
+		arraySize_ == 0 || arraySize_ > D3D10_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION)
+	{
+		MessageBox(0, ("Reading DDS file " + fileName + " - Bad dimensions").c_str(), "Error",
+				   MB_OK);
+		return false;
+	}
+
+	// Rows of pixels are packed with no padding, as are rows of blocks
+	surfaces_.resize(arraySize_ * mipLevels_);
+	for (UINT item = 0; item < arraySize_; ++item)
+	{
+		for (UINT mip = 0; mip < mipLevels_; ++mip)
+		{
+			DDSSurface& surface = surfaces_[item * mipLevels_ + mip];
+			surface.width = max(1u, width_ >> mip);
+			surface.height = max(1u, height_ >> mip);
+			UINT rows;
+			if (blockBytes_)
+			{
+				surface.rowPitch = max(1u, (surface.width + 3) / 4) * blockBytes_;
+				rows = max(1u, (surface.height + 3) / 4);
+			}
+			else
+			{
+				surface.rowPitch = (surface.width * pixelBits_ + 7) / 8;
+				rows = surface.height;
+			}
+			surface.bytes = surface.rowPitch * rows;
+
+			if (surface.bytes > fileSize_ - offset)
+			{
+				MessageBox(0, ("Reading DDS file " + fileName + " - File is short").c_str(),
+						   "Error", MB_OK);
+				return false;
+			}
+			surface.data = view_ + offset;
+			offset += surface.bytes;
+		}
+	}
+	return true;
+}
+
+/*
+	Name		DDSFile::getMipBytes
+	Syntax		DDSFile::getMipBytes(UINT mip)
+	Param		UINT mip - A mip level
+	Return		UINT - The bytes of the mip over every item
+*/
+UINT DDSFile::getMipBytes(UINT mip) const
+{
+	UINT bytes = 0;
+	for (UINT item = 0; item < arraySize_; ++item)
+		bytes += getSurface(item, mip).bytes;
+	return bytes;
+}
+
+/*
+	Name		DDSFile::pageIn
+	Syntax		DDSFile::pageIn(UINT firstMip, UINT lastMip)
+	Param		UINT firstMip, lastMip - The mips to touch, from the larger
+	Return		UINT - The sum of the bytes read, so that the reads are kept
+	Brief		Reads a byte from each page of the mips, which has the
+				system read any pages not yet in memory from the file
+	Details		The small mips share their pages, so touching the smallest
+				brings in the others at the end of the file with it
+*/
+UINT DDSFile::pageIn(UINT firstMip, UINT lastMip) const
+{
+	UINT sum = 0;
+	for (UINT item = 0; item < arraySize_; ++item)
+	{
+		for (UINT mip = firstMip; mip <= lastMip && mip < mipLevels_; ++mip)
+		{
+			const DDSSurface& surface = getSurface(item, mip);
+			for (UINT i = 0; i < surface.bytes; i += PAGE_BYTES)
+				sum += surface.data[i];
+			sum += surface.data[surface.bytes - 1];
+		}
+	}
+	return sum;
+}
+
+/*
+	Name		DDSFile::getMipFor
+	Syntax		DDSFile::getMipFor(UINT size)
+	Param		UINT size - Most pixels across
+	Return		UINT - The largest mip that is no more than size wide or
+				high, or the smallest mip if none is
+*/
+UINT DDSFile::getMipFor(UINT size) const
+{
+	UINT mip = 0;
+	while (mip + 1 < mipLevels_ && max(width_ >> mip, height_ >> mip) > size)
+		++mip;
+	return mip;
+}
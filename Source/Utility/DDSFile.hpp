@@ -0,0 +1,98 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		DDSFile
+	Brief		Definition of the DDSFile class - a DDS texture read in place
+				from a mapping of its file
+	Details		The file is mapped read only and its header checked, and
+				each mip of each array item is then a view straight into the
+				mapping, with nothing copied. The pages of a mip are only
+				read from disk once they are touched, by an upload or by
+				pageIn, so the small mips at the end of the file can be used
+				long before the large ones have been read.
+
+				The 2D textures, arrays and cube maps of the DXGI formats are
+				read, from the legacy header by their four character code or
+				masks, or from the DX10 header. Volume textures, and the
+				legacy formats with no DXGI equivalent, such as 24 bit RGB,
+				are refused
+*/
+
+#ifndef DDSFILE_H
+#define DDSFILE_H
+
+#include <d3d10.h>
+#include <string>
+#include <vector>
+
+/*
+	Name		DDSSurface
+	Syntax		DDSSurface
+	Brief		One mip of one array item, in the file's mapping
+*/
+struct DDSSurface
+{
+	const BYTE* data;
+	UINT width;
+	UINT height;
+	UINT rowPitch;			// Bytes from a row of pixels, or of 4x4 blocks, to the next
+	UINT bytes;
+};
+
+class DDSFile
+{
+public:
+	DDSFile();
+	~DDSFile();
+
+	bool open(const std::string& fileName);
+	void close();
+	bool isOpen() const { return view_ != 0; };
+
+	DXGI_FORMAT getFormat() const { return format_; };
+	UINT getWidth() const { return width_; };
+	UINT getHeight() const { return height_; };
+	UINT getMipLevels() const { return mipLevels_; };
+	UINT getArraySize() const { return arraySize_; };		// Six for each cube
+	bool isCube() const { return cube_; };
+	bool isBlockCompressed() const { return blockBytes_ != 0; };
+	UINT getFileSize() const { return fileSize_; };
+
+	// Mip 0 is the largest
+	const DDSSurface& getSurface(UINT item, UINT mip) const
+		{ return surfaces_[item * mipLevels_ + mip]; };
+	UINT getMipBytes(UINT mip) const;
+
+	// Touches every page of the mips from firstMip to lastMip of each item,
+	// reading them in from disk if they are not already
+	UINT pageIn(UINT firstMip, UINT lastMip) const;
+
+	// The largest mip no bigger than size across
+	UINT getMipFor(UINT size) const;
+
+private:
+	DDSFile(const DDSFile& rhs);
+	DDSFile& operator=(const DDSFile& rhs);
+
+	bool parse(const std::string& fileName);
+
+	HANDLE file_;
+	HANDLE mapping_;
+	const BYTE* view_;
+	UINT fileSize_;
+
+	DXGI_FORMAT format_;
+	UINT width_;
+	UINT height_;
+	UINT mipLevels_;
+	UINT arraySize_;
+	bool cube_;
+	UINT blockBytes_;		// Bytes of a 4x4 block, or 0 if not block compressed
+	UINT pixelBits_;		// Bits of a pixel, if not
+
+	std::vector<DDSSurface> surfaces_;	// Each item's mips in turn
+};
+
+#endif // DDSFILE_H
@@ -18,7 +18,7 @@
 	Brief		DepthMap constructor initialises member variables
 */
 DepthMap::DepthMap()
-: width_(0), height_(0),  d3dDevice_(0), depthMapSRV_(0), depthMapDSV_(0)
+: width_(0), height_(0), slices_(0), d3dDevice_(0), depthMapSRV_(0)
 {
 	ZeroMemory(&viewport_, sizeof(D3D10_VIEWPORT));
 }
@@ -36,25 +36,29 @@ DepthMap::~DepthMap()
 		depthMapSRV_ = 0;
 	}
 	
-	if (depthMapDSV_)
+	for (UINT i = 0; i < depthMapDSVs_.size(); ++i)
 	{
-		depthMapDSV_->Release();
-		depthMapDSV_ = 0;
+		if (depthMapDSVs_[i])
+			depthMapDSVs_[i]->Release();
 	}
+	depthMapDSVs_.clear();
 }
 
 /*
 	Name		DepthMap::initialise
-	Syntax		DepthMap::initialise(ID3D10Device* device, UINT width, UINT height)
+	Syntax		DepthMap::initialise(ID3D10Device* device, UINT width, UINT height,
+				UINT slices)
 	Param		ID3D10Device* device - Pointer to the Direct3D device
 	Param		UINT width - Width of the depth map
 	Param		UINT height - Height of the depth map
+	Param		UINT slices - Number of slices, more than one for an array
 	Brief		Initialises the Depth Map
 */
-void DepthMap::initialise(ID3D10Device* device, UINT width, UINT height)
+void DepthMap::initialise(ID3D10Device* device, UINT width, UINT height, UINT slices)
 {
 	width_  = width;
 	height_ = height;
+	slices_ = slices;
 
 	d3dDevice_ = device;
 
@@ -81,16 +85,18 @@ ID3D10ShaderResourceView* DepthMap::depthMap()
 
 /*
 	Name		DepthMap::begin
-	Syntax		DepthMap::begin()
+	Syntax		DepthMap::begin(UINT slice)
+	Param		UINT slice - The slice to render to
 	Brief		Changes the render target, viewport and depth/stencil buffer
-				so that the scene can be rendered to the depth map texture
+				so that the scene can be rendered to a slice of the depth map
+				texture. Only that slice is cleared
 */
-void DepthMap::begin()
+void DepthMap::begin(UINT slice)
 {
 	ID3D10RenderTargetView* renderTargets[1] = {0};	
-	d3dDevice_->OMSetRenderTargets(1, renderTargets, depthMapDSV_);
+	d3dDevice_->OMSetRenderTargets(1, renderTargets, depthMapDSVs_[slice]);
 	d3dDevice_->RSSetViewports(1, &viewport_);
-	d3dDevice_->ClearDepthStencilView(depthMapDSV_, D3D10_CLEAR_DEPTH, 1.0f, 0);
+	d3dDevice_->ClearDepthStencilView(depthMapDSVs_[slice], D3D10_CLEAR_DEPTH, 1.0f, 0);
 }
 
 /*
@@ -117,7 +123,7 @@ void DepthMap::buildDepthMap()
 	texDesc.Width     = width_;
 	texDesc.Height    = height_;
 	texDesc.MipLevels = 1;
-	texDesc.ArraySize = 1;
+	texDesc.ArraySize = slices_;
 	texDesc.Format    = DXGI_FORMAT_R32_TYPELESS;
 	texDesc.SampleDesc.Count   = 1;  
 	texDesc.SampleDesc.Quality = 0;  
@@ -132,21 +138,47 @@ void DepthMap::buildDepthMap()
 		MessageBox(0, "Create 2d texture - Failed", "Error", MB_OK);
 	}
 
-	D3D10_DEPTH_STENCIL_VIEW_DESC dsvDesc;
-	dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
-	dsvDesc.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
-	dsvDesc.Texture2D.MipSlice = 0;
-	hr = d3dDevice_->CreateDepthStencilView(depthMap, &dsvDesc, &depthMapDSV_);
-	if (FAILED(hr))
+	// A view for each slice to render to, and one over them all to read
+	depthMapDSVs_.resize(slices_, 0);
+	for (UINT i = 0; i < slices_; ++i)
 	{
-		MessageBox(0, "Create depth map DSV - Failed", "Error", MB_OK);
+		D3D10_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+		dsvDesc.Format = DXGI_FORMAT_D32_FLOAT;
+		if (slices_ > 1)
+		{
+			dsvDesc.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2DARRAY;
+			dsvDesc.Texture2DArray.MipSlice = 0;
+			dsvDesc.Texture2DArray.FirstArraySlice = i;
+			dsvDesc.Texture2DArray.ArraySize = 1;
+		}
+		else
+		{
+			dsvDesc.ViewDimension = D3D10_DSV_DIMENSION_TEXTURE2D;
+			dsvDesc.Texture2D.MipSlice = 0;
+		}
+		hr = d3dDevice_->CreateDepthStencilView(depthMap, &dsvDesc, &depthMapDSVs_[i]);
+		if (FAILED(hr))
+		{
+			MessageBox(0, "Create depth map DSV - Failed", "Error", MB_OK);
+		}
 	}
 
 	D3D10_SHADER_RESOURCE_VIEW_DESC srvDesc;
 	srvDesc.Format = DXGI_FORMAT_R32_FLOAT;
-	srvDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
-	srvDesc.Texture2D.MostDetailedMip = 0;
+	if (slices_ > 1)
+	{
+		srvDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+		srvDesc.Texture2DArray.MipLevels = texDesc.MipLevels;
+		srvDesc.Texture2DArray.MostDetailedMip = 0;
+		srvDesc.Texture2DArray.FirstArraySlice = 0;
+		srvDesc.Texture2DArray.ArraySize = slices_;
+	}
+	else
+	{
+		srvDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MipLevels = texDesc.MipLevels;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+	}
 	hr = d3dDevice_->CreateShaderResourceView(depthMap, &srvDesc, &depthMapSRV_);
 	if (FAILED(hr))
 	{
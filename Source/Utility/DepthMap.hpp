@@ -5,12 +5,15 @@
 /*	
 	Name		Depth Map
 	Brief		Definition of Depth Map Class
+	Details		A depth map may have several slices, drawn one at a time and
+				read together by the shaders as a texture array
 */
 
 #ifndef _DEPTHMAP_H
 #define _DEPTHMAP_H
 
 #include <d3dx10.h>
+#include <vector>
 
 class DepthMap
 {
@@ -18,9 +21,10 @@ public:
 	DepthMap();
 	~DepthMap();
 
-	void initialise(ID3D10Device* device, UINT width, UINT height);
+	void initialise(ID3D10Device* device, UINT width, UINT height, UINT slices = 1);
 	ID3D10ShaderResourceView* depthMap();
-	void begin();
+	UINT getSlices() const { return slices_; };
+	void begin(UINT slice = 0);
 	void end();
 private:
 	DepthMap(const DepthMap& rhs);
@@ -30,11 +34,12 @@ private:
 
 	UINT width_;
 	UINT height_;
+	UINT slices_;
 
 	ID3D10Device* d3dDevice_;
 
 	ID3D10ShaderResourceView* depthMapSRV_;
-	ID3D10DepthStencilView* depthMapDSV_;
+	std::vector<ID3D10DepthStencilView*> depthMapDSVs_;	// One for each slice
 
 	D3D10_VIEWPORT viewport_;
 };
@@ -0,0 +1,257 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		StreamedTexture
+	Brief		Implementation of the StreamedTexture class
+*/
+
+#include <algorithm>
+#include "Utility/StreamedTexture.hpp"
+#include "Scene/Scene.hpp"
+
+/*
+	Name		StreamedTexture::StreamedTexture
+	Syntax		StreamedTexture()
+	Brief		StreamedTexture constructor, with no texture
+*/
+StreamedTexture::StreamedTexture()
+: d3dDevice_(0), texture_(0), view_(0), mipLevels_(0), topMip_(0), swizzle_(false)
+{
+	ZeroMemory(&desc_, sizeof(D3D10_TEXTURE2D_DESC));
+}
+
+/*
+	Name		StreamedTexture::~StreamedTexture
+	Syntax		~StreamedTexture()
+	Brief		StreamedTexture destructor
+*/
+StreamedTexture::~StreamedTexture()
+{
+	release();
+}
+
+/*
+	Name		StreamedTexture::initialise
+	Syntax		StreamedTexture::initialise(ID3D10Device* device,
+				const std::string& fileName, UINT residentSize)
+	Param		ID3D10Device* device - Pointer to the Direct3D device
+	Param		const std::string& fileName - The DDS file
+	Param		UINT residentSize - The mips no more than this across are
+				uploaded at once, and always the smallest
+	Return		bool - True if the texture was created
+	Brief		Maps the file, creates the texture with its whole mip chain
+				and uploads the small mips, the smallest first
+*/
+bool StreamedTexture::initialise(ID3D10Device* device, const std::string& fileName,
+								 UINT residentSize)
+{
+	release();
+	d3dDevice_ = device;
+	fileName_ = fileName;
+
+	if (!file_.open(fileName))
+		return false;
+
+	// D3D10 devices need not sample BGR order, which is then swapped
+	DXGI_FORMAT format = file_.getFormat();
+	UINT support = 0;
+	d3dDevice_->CheckFormatSupport(format, &support);
+	const UINT SAMPLED = D3D10_FORMAT_SUPPORT_TEXTURE2D | D3D10_FORMAT_SUPPORT_SHADER_SAMPLE;
+	if ((support & SAMPLED) != SAMPLED &&
+		(format == DXGI_FORMAT_B8G8R8A8_UNORM || format == DXGI_FORMAT_B8G8R8X8_UNORM))
+	{
+		format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		swizzle_ = true;
+		d3dDevice_->CheckFormatSupport(format, &support);
+	}
+
+	// Cube arrays need D3D10.1
+	if ((support & SAMPLED) != SAMPLED || (file_.isCube() && file_.getArraySize() > 6))
+	{
+		MessageBox(0, ("Loading texture " + fileName + " - Format not supported").c_str(),
+				   "Error", MB_OK);
+		file_.close();
+		return false;
+	}
+
+	bool generate = file_.getMipLevels() == 1 && !file_.isBlockCompressed() &&
+					(support & D3D10_FORMAT_SUPPORT_MIP_AUTOGEN) &&
+					max(file_.getWidth(), file_.getHeight()) > 1;
+
+	desc_.Width = file_.getWidth();
+	desc_.Height = file_.getHeight();
+	desc_.MipLevels = generate ? 0 : file_.getMipLevels();
+	desc_.ArraySize = file_.getArraySize();
+	desc_.Format = format;
+	desc_.SampleDesc.Count = 1;
+	desc_.SampleDesc.Quality = 0;
+	desc_.Usage = D3D10_USAGE_DEFAULT;
+	desc_.BindFlags = D3D10_BIND_SHADER_RESOURCE | (generate ? D3D10_BIND_RENDER_TARGET : 0);
+	desc_.CPUAccessFlags = 0;
+	desc_.MiscFlags = (file_.isCube() ? D3D10_RESOURCE_MISC_TEXTURECUBE : 0) |
+					  (generate ? D3D10_RESOURCE_MISC_GENERATE_MIPS : 0);
+
+	HRESULT hr = Scene::instance()->getBackend()->createTexture2D(&desc_, 0, &texture_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, ("Create texture " + fileName + " - Failed").c_str(), "Error", MB_OK);
+		file_.close();
+		return false;
+	}
+	texture_->GetDesc(&desc_);
+	mipLevels_ = desc_.MipLevels;
+
+	if (generate)
+	{
+		upload(0);
+		topMip_ = 0;
+		finish();
+		if (!createView())
+			return false;
+		d3dDevice_->GenerateMips(view_);
+		return true;
+	}
+
+	topMip_ = file_.getMipFor(residentSize);
+	for (UINT mip = mipLevels_; mip-- > topMip_; )
+		upload(mip);
+	if (topMip_ == 0)
+		finish();
+	return createView();
+}
+
+/*
+	Name		StreamedTexture::release
+	Syntax		StreamedTexture::release()
+	Brief		Releases the texture and its view, and unmaps its file
+*/
+void StreamedTexture::release()
+{
+	if (view_)
+		view_->Release();
+	if (texture_)
+		texture_->Release();
+
+	view_ = 0;
+	texture_ = 0;
+	mipLevels_ = 0;
+	topMip_ = 0;
+	swizzle_ = false;
+	finish();
+}
+
+/*
+	Name		StreamedTexture::requestMip
+	Syntax		StreamedTexture::requestMip(UINT mip)
+	Param		UINT mip - The largest mip wanted
+	Return		bool - True if the mip is uploaded
+	Brief		Uploads the next larger mip, if the one wanted is not yet
+				uploaded, and widens the view to it
+	Details		Only one mip is uploaded a call, so that a texture asked for
+				in full does not stall the frame reading all of its file
+*/
+bool StreamedTexture::requestMip(UINT mip)
+{
+	if (topMip_ <= mip)
+		return true;
+	if (!texture_)
+		return false;
+
+	upload(--topMip_);
+	if (topMip_ == 0)
+		finish();
+	createView();
+	return topMip_ <= mip;
+}
+
+/*
+	Name		StreamedTexture::upload
+	Syntax		StreamedTexture::upload(UINT mip)
+	Param		UINT mip - The mip to upload
+	Brief		Uploads a mip of each item straight from the file's
+				mapping, or from a copy in RGB order when swizzling
+*/
+void StreamedTexture::upload(UINT mip)
+{
+	RenderBackend* backend = Scene::instance()->getBackend();
+	bool opaque = file_.getFormat() == DXGI_FORMAT_B8G8R8X8_UNORM;
+	for (UINT item = 0; item < file_.getArraySize(); ++item)
+	{
+		const DDSSurface& surface = file_.getSurface(item, mip);
+		const void* data = surface.data;
+		if (swizzle_)
+		{
+			swizzled_.assign(surface.data, surface.data + surface.bytes);
+			for (UINT i = 0; i < surface.bytes; i += 4)
+			{
+				std::swap(swizzled_[i], swizzled_[i + 2]);
+				if (opaque)
+					swizzled_[i + 3] = 0xff;
+			}
+			data = &swizzled_[0];
+		}
+		backend->updateSubresource(texture_, D3D10CalcSubresource(mip, item, mipLevels_),
+								   data, surface.rowPitch, surface.bytes);
+	}
+}
+
+/*
+	Name		StreamedTexture::finish
+	Syntax		StreamedTexture::finish()
+	Brief		Unmaps the file and frees the swizzled copy, once every mip
+				is uploaded
+*/
+void StreamedTexture::finish()
+{
+	file_.close();
+	std::vector<BYTE>().swap(swizzled_);
+}
+
+/*
+	Name		StreamedTexture::createView
+	Syntax		StreamedTexture::createView()
+	Return		bool - True if the view was created
+	Brief		Creates a view of the mips uploaded so far, in place of the
+				last one
+*/
+bool StreamedTexture::createView()
+{
+	if (view_)
+	{
+		view_->Release();
+		view_ = 0;
+	}
+
+	D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = desc_.Format;
+	if (desc_.MiscFlags & D3D10_RESOURCE_MISC_TEXTURECUBE)
+	{
+		viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURECUBE;
+		viewDesc.TextureCube.MostDetailedMip = topMip_;
+		viewDesc.TextureCube.MipLevels = mipLevels_ - topMip_;
+	}
+	else if (desc_.ArraySize > 1)
+	{
+		viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+		viewDesc.Texture2DArray.MostDetailedMip = topMip_;
+		viewDesc.Texture2DArray.MipLevels = mipLevels_ - topMip_;
+		viewDesc.Texture2DArray.FirstArraySlice = 0;
+		viewDesc.Texture2DArray.ArraySize = desc_.ArraySize;
+	}
+	else
+	{
+		viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2D;
+		viewDesc.Texture2D.MostDetailedMip = topMip_;
+		viewDesc.Texture2D.MipLevels = mipLevels_ - topMip_;
+	}
+
+	HRESULT hr = d3dDevice_->CreateShaderResourceView(texture_, &viewDesc, &view_);
+	if (FAILED(hr))
+	{
+		MessageBox(0, ("Create texture RV " + fileName_ + " - Failed").c_str(), "Error", MB_OK);
+		return false;
+	}
+	return true;
+}
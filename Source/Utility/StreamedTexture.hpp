@@ -0,0 +1,71 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		StreamedTexture
+	Brief		Definition of the StreamedTexture class - a texture loaded
+				from a DDS file a mip at a time, the smallest first
+	Details		The texture is created with its whole mip chain, but only
+				the small mips are uploaded at once, straight from the
+				file's mapping, and its view is limited to them. Each
+				request for a larger mip uploads one more level and widens
+				the view, so the texture sharpens over a few frames and the
+				large mips are only read from disk when they are wanted.
+				Once every mip is uploaded the file is unmapped.
+
+				Textures with no mips of their own have them generated on
+				the GPU, as D3DX does, when their format allows it. Formats
+				in BGR order are uploaded in RGB order on devices that cannot
+				sample them
+*/
+
+#ifndef STREAMEDTEXTURE_H
+#define STREAMEDTEXTURE_H
+
+#include <d3dx10.h>
+#include <string>
+#include <vector>
+#include "Utility/DDSFile.hpp"
+
+class StreamedTexture
+{
+public:
+	StreamedTexture();
+	~StreamedTexture();
+
+	// The mips no larger than residentSize across are uploaded at once
+	bool initialise(ID3D10Device* device, const std::string& fileName, UINT residentSize = 64);
+	void release();
+
+	// Uploads the next larger mip if mip is not yet uploaded. Returns true
+	// once it is
+	bool requestMip(UINT mip);
+
+	ID3D10ShaderResourceView* getView() const { return view_; };
+	UINT getTopMip() const { return topMip_; };
+	UINT getMipLevels() const { return mipLevels_; };
+	bool isComplete() const { return topMip_ == 0; };
+
+private:
+	StreamedTexture(const StreamedTexture& rhs);
+	StreamedTexture& operator=(const StreamedTexture& rhs);
+
+	void upload(UINT mip);
+	void finish();
+	bool createView();
+
+	ID3D10Device* d3dDevice_;
+	DDSFile file_;
+	std::string fileName_;
+
+	ID3D10Texture2D* texture_;
+	ID3D10ShaderResourceView* view_;
+	D3D10_TEXTURE2D_DESC desc_;
+	UINT mipLevels_;
+	UINT topMip_;					// Largest mip uploaded
+	bool swizzle_;					// BGR order uploaded as RGB
+	std::vector<BYTE> swizzled_;	// A mip in RGB order, when swizzling
+};
+
+#endif // STREAMEDTEXTURE_H
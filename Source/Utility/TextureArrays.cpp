@@ -0,0 +1,424 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		TextureArrays
+	Brief		Implementation of the TextureArrays class
+*/
+
+#include <algorithm>
+#include "Utility/TextureArrays.hpp"
+#include "Utility/DDSFile.hpp"
+#include "Renderer/RenderBackend.hpp"
+
+/*
+	Name		TextureArrays::TextureArrays
+	Syntax		TextureArrays()
+	Brief		TextureArrays constructor, with no arrays
+*/
+TextureArrays::TextureArrays()
+: backend_(0), builtNo_(0)
+{
+}
+
+/*
+	Name		TextureArrays::~TextureArrays
+	Syntax		~TextureArrays()
+	Brief		TextureArrays destructor releases every array
+*/
+TextureArrays::~TextureArrays()
+{
+	clear();
+}
+
+/*
+	Name		TextureArrays::initialise
+	Syntax		TextureArrays::initialise(RenderBackend* backend)
+	Param		RenderBackend* backend - The backend the arrays are created
+				through
+*/
+void TextureArrays::initialise(RenderBackend* backend)
+{
+	clear();
+	backend_ = backend;
+	builtNo_ = 0;
+}
+
+/*
+	Name		TextureArrays::clear
+	Syntax		TextureArrays::clear()
+	Brief		Waits for any files still being read and releases every
+				array, whether or not it is still acquired
+*/
+void TextureArrays::clear()
+{
+	for (size_t i = 0; i < entries_.size(); ++i)
+		destroy(entries_[i]);
+	entries_.clear();
+}
+
+/*
+	Name		TextureArrays::prefetch
+	Syntax		TextureArrays::prefetch(
+				const std::vector<std::string>& fileNames)
+	Param		const std::vector<std::string>& fileNames - The DDS file of
+				each slice
+	Brief		Starts reading the files on a worker thread, so that they
+				are mapped, checked and paged in by the time the array is
+				acquired
+	Details		If the thread cannot be started the files are read at once
+*/
+void TextureArrays::prefetch(const std::vector<std::string>& fileNames)
+{
+	if (fileNames.empty() || find(fileNames) || !backend_)
+		return;
+
+	Entry* entry = create(fileNames);
+	entries_.push_back(entry);
+
+	entry->thread = CreateThread(0, 0, readProc, entry, 0, 0);
+	if (!entry->thread)
+		entry->read = read(entry);
+}
+
+/*
+	Name		TextureArrays::acquire
+	Syntax		TextureArrays::acquire(
+				const std::vector<std::string>& fileNames)
+	Param		const std::vector<std::string>& fileNames - The DDS file of
+				each slice
+	Return		ID3D10ShaderResourceView* - The array, or 0 if it could not
+				be built
+	Brief		Builds the array of the files if it is not already built,
+				and counts another user of it
+*/
+ID3D10ShaderResourceView* TextureArrays::acquire(const std::vector<std::string>& fileNames)
+{
+	if (fileNames.empty() || !backend_)
+		return 0;
+
+	Entry* entry = find(fileNames);
+	if (!entry)
+	{
+		entry = create(fileNames);
+		entries_.push_back(entry);
+		entry->read = read(entry);
+	}
+
+	if (!entry->view && !build(entry))
+	{
+		entries_.erase(std::find(entries_.begin(), entries_.end(), entry));
+		destroy(entry);
+		return 0;
+	}
+
+	++entry->users;
+	return entry->view;
+}
+
+/*
+	Name		TextureArrays::release
+	Syntax		TextureArrays::release(ID3D10ShaderResourceView* view)
+	Param		ID3D10ShaderResourceView* view - An array acquired, or 0
+	Brief		Counts one user fewer of the array, and releases it once it
+				has none
+*/
+void TextureArrays::release(ID3D10ShaderResourceView* view)
+{
+	if (!view)
+		return;
+
+	for (size_t i = 0; i < entries_.size(); ++i)
+	{
+		Entry* entry = entries_[i];
+		if (entry->view == view)
+		{
+			if (--entry->users == 0)
+			{
+				entries_.erase(entries_.begin() + i);
+				destroy(entry);
+			}
+			return;
+		}
+	}
+}
+
+/*
+	Name		TextureArrays::find
+	Syntax		TextureArrays::find(
+				const std::vector<std::string>& fileNames)
+	Param		const std::vector<std::string>& fileNames - The DDS file of
+				each slice
+	Return		Entry* - The array of the same files in the same order, or 0
+*/
+TextureArrays::Entry* TextureArrays::find(const std::vector<std::string>& fileNames) const
+{
+	for (size_t i = 0; i < entries_.size(); ++i)
+	{
+		if (entries_[i]->fileNames == fileNames)
+			return entries_[i];
+	}
+	return 0;
+}
+
+/*
+	Name		TextureArrays::create
+	Syntax		TextureArrays::create(
+				const std::vector<std::string>& fileNames)
+	Param		const std::vector<std::string>& fileNames - The DDS file of
+				each slice
+	Return		Entry* - A new entry for the files, not yet read
+*/
+TextureArrays::Entry* TextureArrays::create(const std::vector<std::string>& fileNames) const
+{
+	Entry* entry = new Entry;
+	entry->fileNames = fileNames;
+	entry->device = backend_->getDevice();
+	entry->thread = 0;
+	entry->read = false;
+	ZeroMemory(&entry->desc, sizeof(D3D10_TEXTURE2D_DESC));
+	entry->view = 0;
+	entry->users = 0;
+	return entry;
+}
+
+/*
+	Name		TextureArrays::build
+	Syntax		TextureArrays::build(Entry* entry)
+	Param		Entry* entry - An entry whose files are read, or being read
+	Return		bool - True if the array and its view were created
+	Brief		Waits for the files to be read, then creates the array from
+				them and unmaps them
+*/
+bool TextureArrays::build(Entry* entry)
+{
+	if (entry->thread)
+	{
+		WaitForSingleObject(entry->thread, INFINITE);
+		CloseHandle(entry->thread);
+		entry->thread = 0;
+	}
+
+	if (!entry->read)
+		return false;
+
+	ID3D10Texture2D* texture = 0;
+	HRESULT hr = backend_->createTexture2D(&entry->desc, &entry->data[0], &texture);
+	closeFiles(entry);
+	if (FAILED(hr))
+	{
+		MessageBox(0, ("Create texture array " + entry->fileNames[0] + " - Failed").c_str(),
+				   "Error", MB_OK);
+		return false;
+	}
+
+	D3D10_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	viewDesc.Format = entry->desc.Format;
+	viewDesc.ViewDimension = D3D10_SRV_DIMENSION_TEXTURE2DARRAY;
+	viewDesc.Texture2DArray.MostDetailedMip = 0;
+	viewDesc.Texture2DArray.MipLevels = entry->desc.MipLevels;
+	viewDesc.Texture2DArray.FirstArraySlice = 0;
+	viewDesc.Texture2DArray.ArraySize = entry->desc.ArraySize;
+
+	// The view keeps the texture alive
+	hr = entry->device->CreateShaderResourceView(texture, &viewDesc, &entry->view);
+	texture->Release();
+	if (FAILED(hr))
+	{
+		MessageBox(0, ("Create texture array RV " + entry->fileNames[0] + " - Failed").c_str(),
+				   "Error", MB_OK);
+		entry->view = 0;
+		return false;
+	}
+
+	++builtNo_;
+	return true;
+}
+
+/*
+	Name		TextureArrays::destroy
+	Syntax		TextureArrays::destroy(Entry* entry)
+	Param		Entry* entry - An entry no longer in the list
+	Brief		Waits for its files to be read, if they still are, and frees
+				the entry and its array
+*/
+void TextureArrays::destroy(Entry* entry) const
+{
+	if (entry->thread)
+	{
+		WaitForSingleObject(entry->thread, INFINITE);
+		CloseHandle(entry->thread);
+	}
+	closeFiles(entry);
+	if (entry->view)
+		entry->view->Release();
+	delete entry;
+}
+
+/*
+	Name		TextureArrays::read
+	Syntax		TextureArrays::read(Entry* entry)
+	Param		Entry* entry - An entry not yet read
+	Return		bool - True if every file was read and matches the first
+	Brief		Maps the files, checks them and lays out the array's
+				initial data from their mappings
+	Details		Runs on the worker thread when the files are read ahead. It
+				touches nothing but the entry, and the device only to check
+				the format, which a device created without the single
+				threaded flag allows from any thread. Every page of the
+				mips is touched here, so that the array is created without
+				waiting on the disk
+*/
+bool TextureArrays::read(Entry* entry)
+{
+	const std::vector<std::string>& fileNames = entry->fileNames;
+	UINT arraySize = 0;
+	for (size_t i = 0; i < fileNames.size(); ++i)
+	{
+		DDSFile* file = new DDSFile;
+		entry->files.push_back(file);
+		if (!file->open(fileNames[i]))
+			return false;
+
+		const DDSFile& first = *entry->files[0];
+		if (file->isCube())
+		{
+			MessageBox(0, ("Reading texture array " + fileNames[i] + " - Cube maps cannot be "
+						   "slices").c_str(), "Error", MB_OK);
+			return false;
+		}
+		if (file->getFormat() != first.getFormat() || file->getWidth() != first.getWidth() ||
+			file->getHeight() != first.getHeight() ||
+			file->getMipLevels() != first.getMipLevels())
+		{
+			MessageBox(0, ("Reading texture array " + fileNames[i] + " - Format or size differs "
+						   "from " + fileNames[0]).c_str(), "Error", MB_OK);
+			return false;
+		}
+		arraySize += file->getArraySize();
+	}
+
+	if (arraySize > D3D10_REQ_TEXTURE2D_ARRAY_AXIS_DIMENSION)
+	{
+		MessageBox(0, ("Reading texture array " + fileNames[0] + " - Too many slices").c_str(),
+				   "Error", MB_OK);
+		return false;
+	}
+
+	// D3D10 devices need not sample BGR order, which is then swapped
+	const DDSFile& first = *entry->files[0];
+	DXGI_FORMAT format = first.getFormat();
+	bool swizzle = false;
+	UINT support = 0;
+	entry->device->CheckFormatSupport(format, &support);
+	const UINT SAMPLED = D3D10_FORMAT_SUPPORT_TEXTURE2D | D3D10_FORMAT_SUPPORT_SHADER_SAMPLE;
+	if ((support & SAMPLED) != SAMPLED &&
+		(format == DXGI_FORMAT_B8G8R8A8_UNORM || format == DXGI_FORMAT_B8G8R8X8_UNORM))
+	{
+		format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		swizzle = true;
+		entry->device->CheckFormatSupport(format, &support);
+	}
+	if ((support & SAMPLED) != SAMPLED)
+	{
+		MessageBox(0, ("Reading texture array " + fileNames[0] + " - Format not supported").c_str(),
+				   "Error", MB_OK);
+		return false;
+	}
+
+	D3D10_TEXTURE2D_DESC& desc = entry->desc;
+	desc.Width = first.getWidth();
+	desc.Height = first.getHeight();
+	desc.MipLevels = first.getMipLevels();
+	desc.ArraySize = arraySize;
+	desc.Format = format;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Usage = D3D10_USAGE_DEFAULT;
+	desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
+	desc.CPUAccessFlags = 0;
+	desc.MiscFlags = 0;
+
+	if (swizzle)
+	{
+		UINT bytes = 0;
+		for (UINT mip = 0; mip < desc.MipLevels; ++mip)
+			bytes += first.getSurface(0, mip).bytes;
+		entry->swizzled.resize(bytes * arraySize);
+	}
+
+	BYTE* swizzled = swizzle ? &entry->swizzled[0] : 0;
+	bool opaque = first.getFormat() == DXGI_FORMAT_B8G8R8X8_UNORM;
+	entry->data.resize(arraySize * desc.MipLevels);
+	D3D10_SUBRESOURCE_DATA* data = &entry->data[0];
+	for (size_t i = 0; i < entry->files.size(); ++i)
+	{
+		const DDSFile& file = *entry->files[i];
+		if (!swizzle)
+			file.pageIn(0, desc.MipLevels - 1);
+
+		for (UINT item = 0; item < file.getArraySize(); ++item)
+		{
+			for (UINT mip = 0; mip < desc.MipLevels; ++mip, ++data)
+			{
+				const DDSSurface& surface = file.getSurface(item, mip);
+				data->pSysMem = surface.data;
+				data->SysMemPitch = surface.rowPitch;
+				data->SysMemSlicePitch = surface.bytes;
+				if (swizzle)
+				{
+					for (UINT b = 0; b < surface.bytes; b += 4)
+					{
+						swizzled[b] = surface.data[b + 2];
+						swizzled[b + 1] = surface.data[b + 1];
+						swizzled[b + 2] = surface.data[b];
+						swizzled[b + 3] = opaque ? 0xff : surface.data[b + 3];
+					}
+					data->pSysMem = swizzled;
+					swizzled += surface.bytes;
+				}
+			}
+		}
+	}
+
+	// The swizzled copy no longer needs the files
+	if (swizzle)
+	{
+		for (size_t i = 0; i < entry->files.size(); ++i)
+			delete entry->files[i];
+		entry->files.clear();
+	}
+	return true;
+}
+
+/*
+	Name		TextureArrays::closeFiles
+	Syntax		TextureArrays::closeFiles(Entry* entry)
+	Param		Entry* entry - An entry that is not being read
+	Brief		Unmaps its files and frees any swizzled copy, along with the
+				initial data that points into them
+*/
+void TextureArrays::closeFiles(Entry* entry)
+{
+	for (size_t i = 0; i < entry->files.size(); ++i)
+		delete entry->files[i];
+	entry->files.clear();
+
+	std::vector<D3D10_SUBRESOURCE_DATA>().swap(entry->data);
+	std::vector<BYTE>().swap(entry->swizzled);
+}
+
+/*
+	Name		TextureArrays::readProc
+	Syntax		TextureArrays::readProc(LPVOID entry)
+	Param		LPVOID entry - The entry to read
+	Return		DWORD - Unused
+	Brief		Worker thread entry point, reading one entry's files
+*/
+DWORD WINAPI TextureArrays::readProc(LPVOID entry)
+{
+	Entry* e = (Entry*)entry;
+	e->read = read(e);
+	return 0;
+}
@@ -0,0 +1,94 @@
+/*
+	Created 	Elinor Townsend 2011
+*/
+
+/*
+	Name		TextureArrays
+	Brief		Definition of the TextureArrays class - builds the texture
+				arrays of the particle systems from their DDS files, and
+				shares each between the systems that use the same files
+	Details		Each file is mapped with DDSFile and checked against the
+				first, so that every slice has the same format, size and
+				mips. The array is then created at once from the mips in
+				the mappings, with no staging copy of its own, in the
+				files' format. Only formats in BGR order that the device
+				cannot sample are copied, swizzled into one allocation for
+				the whole array.
+
+				The files can be read ahead on a worker thread while the
+				rest of a state loads, and the array is created on the
+				calling thread when it is first acquired, waiting for the
+				worker if it has not finished. An array is kept until every
+				system that acquired it has released it
+*/
+
+#ifndef TEXTUREARRAYS_H
+#define TEXTUREARRAYS_H
+
+#include <d3d10.h>
+#include <string>
+#include <vector>
+
+class DDSFile;
+class RenderBackend;
+
+class TextureArrays
+{
+public:
+	TextureArrays();
+	~TextureArrays();
+
+	void initialise(RenderBackend* backend);
+	void clear();
+
+	// Starts reading the files on a worker thread, unless their array is
+	// already built or being read
+	void prefetch(const std::vector<std::string>& fileNames);
+
+	// The array of the files, a slice for each in turn, or 0 if they could
+	// not be read or do not match. Each view acquired is to be released
+	ID3D10ShaderResourceView* acquire(const std::vector<std::string>& fileNames);
+	void release(ID3D10ShaderResourceView* view);
+
+	UINT getArraysNo() const { return (UINT)entries_.size(); };
+	UINT getArraysBuilt() const { return builtNo_; };
+
+private:
+	TextureArrays(const TextureArrays& rhs);
+	TextureArrays& operator=(const TextureArrays& rhs);
+
+	/*
+		Name		Entry
+		Syntax		Entry
+		Brief		The array of a list of files, while it is read and once
+					it is built
+	*/
+	struct Entry
+	{
+		std::vector<std::string> fileNames;
+		ID3D10Device* device;
+		HANDLE thread;			// Reading the files, if read ahead
+		bool read;				// The files were read and match
+		std::vector<DDSFile*> files;
+		D3D10_TEXTURE2D_DESC desc;
+		std::vector<D3D10_SUBRESOURCE_DATA> data;	// Each slice's mips in turn
+		std::vector<BYTE> swizzled;	// Every slice in RGB order, when swizzling
+		ID3D10ShaderResourceView* view;
+		int users;
+	};
+
+	Entry* find(const std::vector<std::string>& fileNames) const;
+	Entry* create(const std::vector<std::string>& fileNames) const;
+	bool build(Entry* entry);
+	void destroy(Entry* entry) const;
+
+	static bool read(Entry* entry);
+	static void closeFiles(Entry* entry);
+	static DWORD WINAPI readProc(LPVOID entry);
+
+	RenderBackend* backend_;
+	std::vector<Entry*> entries_;
+	UINT builtNo_;				// Arrays built since initialised
+};
+
+#endif // TEXTUREARRAYS_H
@@ -11,25 +11,63 @@
 #include "Utility/Utility.hpp"
 #include "Scene/Scene.hpp"
 
+namespace
+{
+	unsigned int randomSeed = 1;
+	volatile LONG randomStreams = 0;		// Streams given to threads so far
+	__declspec(thread) M3DRandom threadRandom;
+	__declspec(thread) bool threadSeeded = false;
+	__declspec(thread) unsigned int threadStream = 0;
+}
+
+/*
+	Name		getThreadRandom
+	Syntax		getThreadRandom()
+	Return		M3DRandom* - The calling thread's stream of random numbers
+	Brief		Gives the thread the next stream of the seed the first time
+				it is called on the thread
+*/
+M3DRandom* getThreadRandom()
+{
+	if (!threadSeeded)
+	{
+		threadStream = (unsigned int)(InterlockedIncrement(&randomStreams) - 1);
+		m3dSeedRandom(&threadRandom, randomSeed, threadStream);
+		threadSeeded = true;
+	}
+	return &threadRandom;
+}
+
+/*
+	Name		seedRandom
+	Syntax		seedRandom(unsigned int seed)
+	Param		unsigned int seed - Seed of the random numbers
+	Brief		Starts the calling thread's stream again from the seed, and
+				seeds the streams threads are given from now on
+	Details		Threads that have already drawn carry on with their streams,
+				so the seed is best set before starting any
+*/
+void seedRandom(unsigned int seed)
+{
+	randomSeed = seed;
+	M3DRandom* random = getThreadRandom();
+	m3dSeedRandom(random, seed, threadStream);
+}
+
 /*
 	Name		createRandomTexture
 	Syntax		createRandomTexture(ID3D10ShaderResourceView* _texRV)
 	Param		ID3D10ShaderResourceView* _texRV - The texture resource view
 	Brief		Builds a random 1D texture used for generating
 				random values in effect files
+	Details		The values are drawn in one batch from the calling thread's
+				stream
 */
 ID3D10ShaderResourceView* createRandomTexture()
 {
 	// Create random data
 	D3DXVECTOR4 randomValues[1024];
-
-	for (int i = 0; i < 1024; ++i)
-	{
-		randomValues[i].x = randFloat(-1.0f, 1.0f);
-		randomValues[i].y = randFloat(-1.0f, 1.0f);
-		randomValues[i].z = randFloat(-1.0f, 1.0f);
-		randomValues[i].w = randFloat(-1.0f, 1.0f);
-	}
+	m3dRandomFloats(getThreadRandom(), (float*)randomValues, 1024 * 4, -1.0f, 1.0f);
 
 	D3D10_SUBRESOURCE_DATA initData;
 	initData.pSysMem = randomValues;
@@ -49,7 +87,8 @@ ID3D10ShaderResourceView* createRandomTexture()
 
 	ID3D10Texture1D* randomTex = 0;
 	ID3D10Device* d3dDevice = Scene::instance()->getDevice();
-	HRESULT hr = d3dDevice->CreateTexture1D(&texDesc, &initData, &randomTex);
+	HRESULT hr = Scene::instance()->getBackend()->createTexture1D(&texDesc, 
+												&initData, &randomTex);
 	if (FAILED(hr))
 	{
 		MessageBox(0, "Create random texture - Failed", "Error", MB_OK);
@@ -13,11 +13,18 @@
 
 #include <d3dx10.h>
 #include <string>
+#include "Maths/m3dRandom.h"
+
+// The calling thread's stream of random numbers. Each thread is given its
+// own stream of the seed the first time it draws, numbered in the order the
+// threads first draw, so the numbers are the same each run from a seed
+M3DRandom* getThreadRandom();
+void seedRandom(unsigned int seed);
 
 // Returns random float in [0, 1)
 D3DX10INLINE float randFloat()
 {
-	return (float)(rand()) / (float)RAND_MAX;
+	return m3dRandomFloat(getThreadRandom());
 }
 
 // Returns random float in [a, b)
@@ -29,8 +36,8 @@ D3DX10INLINE float randFloat(float a, float b)
 // Returns random vector on the unit sphere
 D3DX10INLINE D3DXVECTOR3 randUnitVector3()
 {
-	D3DXVECTOR3 v(randFloat(), randFloat(), randFloat());
-	D3DXVec3Normalize(&v, &v);
+	D3DXVECTOR3 v;
+	m3dRandomUnitVector3(getThreadRandom(), (float*)&v);
 	return v;
 }
 
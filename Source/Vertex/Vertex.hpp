@@ -10,6 +10,8 @@
 #ifndef VERTEX_H
 #define VERTEX_H
 
+#include "Maths/m3dConst.h"
+
 /*
 	Name		Vertex
 	Syntax		Vertex
@@ -29,6 +31,23 @@ struct Vertex
 	D3DXVECTOR2 texC;
 };
 
+/*
+	Name		VertexData
+	Syntax		VertexData
+	Brief		Plain layout of Vertex that can be filled by an aggregate
+				initialiser, so that constant tables of vertices are built by
+				the compiler rather than at startup
+*/
+struct VertexData
+{
+	float pos[3];
+	float normal[3];
+	float texC[2];
+};
+
+// VertexData tables are passed to the same buffers as Vertex
+M3D_STATIC_ASSERT(sizeof(VertexData) == sizeof(Vertex), vertexDataMatchesVertex);
+
 /*
 	Name		ParticleVertex
 	Syntax		ParticleVertex
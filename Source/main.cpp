@@ -10,8 +10,13 @@
 				to the window
 */
 //..............................................................................
+#include <stdio.h>
+
 #include "Scene/Scene.hpp"
 #include "Global/Global.hpp"
+#include "Benchmark/Benchmark.hpp"
+#include "Input/InputLog.hpp"
+#include "Profiler/Profiler.hpp"
 
 // Declarations of Windows API functions
 void registerWindow(HINSTANCE hInstance);
@@ -32,6 +37,10 @@ bool running = true;
 							   maximized, or shown normally
 	Return		int - Not used
 	Brief		Entry point of programme
+	Details		Passing -headless runs the frame benchmark through the null
+				render backend without opening a window. Passing -replay runs
+				a recorded input log, and -record records the input of a 
+				normal run. Passing -bench runs a math benchmark on its own
 */
 int WINAPI WinMain(	HINSTANCE hInstance,
 					HINSTANCE prevInstance, 
@@ -39,15 +48,50 @@ int WINAPI WinMain(	HINSTANCE hInstance,
 					int showCmd)
 {
 	MSG msg;
+
+	BenchmarkOptions options;
+	if (!parseBenchmarkOptions(cmdLine, &options))
+	{
+		MessageBox(0, "Usage: Seasons [-headless] [-frames n] [-report file] "
+			"[-trace file] [-fpscap n] [-simstep s] [-simthread] [-noground] "
+			"[-record file | -replay file [-fixedstep s]] [-bench name]", "Error", MB_OK);
+		return 1;
+	}
+
+	if (!options.bench.empty())
+		return runMathBenchmark(options);
+
+	if (options.headless)
+	{
+		if (!options.replay.empty())
+			return runReplayBenchmark(options);
+
+		return runFrameBenchmark(options);
+	}
 	
 	registerWindow(hInstance);
 
    	if (!initialiseWindow(hInstance, showCmd))
 		return false;
 
+	if (!options.replay.empty())
+		return runReplayBenchmark(options);
+
+	InputLog inputLog;
+	if (!options.record.empty())
+	{
+		if (!inputLog.openForRecording(options.record))
+		{
+			MessageBox(0, "Opening input log - Failed", "Error", MB_OK);
+			return 1;
+		}
+		App->setInputLog(&inputLog);
+	}
 	
-	
+	App->setSimStep(options.simStep);
+	App->setSimThreaded(options.simThread);
 	App->initialise();
+	App->getTimer()->setFrameCap(options.frameCap);
 
 	while(running) 
 	{
@@ -64,13 +108,20 @@ int WINAPI WinMain(	HINSTANCE hInstance,
 			TranslateMessage (&msg);							
 			DispatchMessage (&msg);
 		}
+		else if (App->isPaused())
+		{
+			Sleep(50);
+		}
 		else
 		{
+			App->getTimer()->waitForNextFrame();
 			running = App->runFrame();
+			PROFILE_END_FRAME();
 		}		
     }
 
 	App->deinitialise();
+	App->setInputLog(0);
 
 	return msg.wParam;	
 }
@@ -232,8 +283,25 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 		case WM_MOUSEMOVE:
 			break;
 
+		// A left click picks the object under the cursor and reports it in
+		// the window title
 		case WM_LBUTTONDOWN:
+		{
+			PickResult result;
+			char title[128];
+			if (App->pick((short)LOWORD(lParam), (short)HIWORD(lParam), &result))
+			{
+				_snprintf_s(title, sizeof(title), _TRUNCATE,
+					"3D Scene - picked tree at (%.1f, %.1f, %.1f), %.1f away",
+					result.point.x, result.point.y, result.point.z, result.distance);
+			}
+			else
+			{
+				_snprintf_s(title, sizeof(title), _TRUNCATE, "3D Scene - nothing picked");
+			}
+			SetWindowText(hWnd, title);
 			break;
+		}
 			
 		case WM_RBUTTONDOWN:
 			break;